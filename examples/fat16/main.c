@@ -330,6 +330,9 @@ static void init(void)
                (fat16_write_t)sd_write_block,
                &sd,
                0);
+    fat16_set_multi_block_functions(&fs,
+                                    (fat16_read_blocks_t)sd_read_blocks,
+                                    (fat16_write_blocks_t)sd_write_blocks);
     fat16_start(&fs);
     std_printf(FSTR("fat16 started\r\n"));
 }
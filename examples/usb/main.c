@@ -32,6 +32,9 @@ static struct usb_host_class_hid_device_t hid_devices[1];
 
 static struct usb_host_class_mass_storage_driver_t mass_storage;
 static struct usb_host_class_mass_storage_device_t mass_storage_devices[1];
+static uint8_t read_ahead_buf[4 * USB_HOST_CLASS_MASS_STORAGE_BLOCK_SIZE];
+
+static struct fat16_t fs;
 
 static struct fs_command_t cmd_state;
 
@@ -103,7 +106,6 @@ static int handle_message_add(struct usb_message_add_t *msg_p)
     int i, j;
     struct usb_descriptor_configuration_t *conf_p = NULL;
     struct usb_descriptor_interface_t *int_p = NULL;
-    uint8_t buf[512];
 
     device_p = usb_host_device_open(&usb, msg_p->device);
 
@@ -125,15 +127,34 @@ static int handle_message_add(struct usb_message_add_t *msg_p)
 
             if (int_p->interface_class == USB_CLASS_MASS_STORAGE) {
                 std_printf(FSTR("A MASS_STORAGE interface was found.\r\n"));
-                std_printf(FSTR("reading from USB device\r\n"));
-                
-                usb_host_class_mass_storage_device_read(device_p,
-                                                        buf,
-                                                        0,
-                                                        512);
-                
-                std_printf(FSTR("read from USB device\r\n"));
-                
+
+                usb_host_class_mass_storage_device_init(&mass_storage_devices[0],
+                                                        device_p,
+                                                        read_ahead_buf,
+                                                        sizeof(read_ahead_buf));
+
+                if (usb_host_class_mass_storage_device_start(
+                        &mass_storage_devices[0]) != 0) {
+                    return (1);
+                }
+
+                /* Mount the file system on the USB stick. */
+                fat16_init(&fs,
+                           (fat16_read_t)usb_host_class_mass_storage_device_read_block,
+                           (fat16_write_t)usb_host_class_mass_storage_device_write_block,
+                           &mass_storage_devices[0],
+                           0);
+                fat16_set_multi_block_functions(
+                    &fs,
+                    (fat16_read_blocks_t)usb_host_class_mass_storage_device_read_blocks,
+                    (fat16_write_blocks_t)usb_host_class_mass_storage_device_write_blocks);
+
+                if (fat16_start(&fs) != 0) {
+                    return (1);
+                }
+
+                std_printf(FSTR("fat16 started\r\n"));
+
                 return (0);
             }
         }
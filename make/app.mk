@@ -164,19 +164,19 @@ $(EXE): $(OBJ) $(GENOBJ)
 	@echo "Linking $@"
 	$(LD) -o $@ $(LDFLAGS) $^ $(LDFLAGS_AFTER)
 
-$(SETTINGS_H): $(SETTINGS_INI)
+$(SETTINGS_H): $(SETTINGS_INI) $(SIMBA_ROOT)/src/kernel/tools/settings.py
 	@echo "Generating $@ from $<"
 	$(SIMBA_ROOT)/src/kernel/tools/settings.py --header $(SETTINGS_INI) \
             --setting-memory $(SETTING_MEMORY) --setting-offset $(SETTING_OFFSET) \
             --setting-size $(SETTING_SIZE) $(ENDIANESS)
 
-$(SETTINGS_C): $(SETTINGS_INI)
+$(SETTINGS_C): $(SETTINGS_INI) $(SIMBA_ROOT)/src/kernel/tools/settings.py
 	@echo "Generating $@ from $<"
 	$(SIMBA_ROOT)/src/kernel/tools/settings.py --source $(SETTINGS_INI) \
             --setting-memory $(SETTING_MEMORY) --setting-offset $(SETTING_OFFSET) \
             --setting-size $(SETTING_SIZE) $(ENDIANESS)
 
-$(SETTINGS_BIN): $(SETTINGS_INI)
+$(SETTINGS_BIN): $(SETTINGS_INI) $(SIMBA_ROOT)/src/kernel/tools/settings.py
 	@echo "Generating $@ from $<"
 	$(SIMBA_ROOT)/src/kernel/tools/settings.py --binary $(SETTINGS_INI) \
             --setting-memory $(SETTING_MEMORY) --setting-offset $(SETTING_OFFSET) \
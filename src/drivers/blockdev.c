@@ -0,0 +1,792 @@
+/**
+ * @file blockdev.c
+ * @version 0.5.0
+ *
+ * @section License
+ * Copyright (C) 2016, Erik Moqvist
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Simba project.
+ */
+
+#include "simba.h"
+
+#define BLOCK_SIZE BLOCKDEV_BLOCK_SIZE
+
+static void request_remove(struct blockdev_t *self_p,
+                           struct blockdev_request_t *request_p)
+{
+    struct blockdev_request_t **next_pp;
+
+    next_pp = &self_p->head_p;
+
+    while (*next_pp != request_p) {
+        next_pp = &(*next_pp)->next_p;
+    }
+
+    *next_pp = request_p->next_p;
+    request_p->next_p = NULL;
+}
+
+/**
+ * Returns true(1) if given request overlaps an older queued request
+ * and any of them is a write. Such requests are served in queue
+ * order so that reads see earlier writes and writes are applied in
+ * order.
+ */
+static int request_is_blocked(struct blockdev_t *self_p,
+                              struct blockdev_request_t *request_p)
+{
+    struct blockdev_request_t *older_p;
+
+    for (older_p = self_p->head_p;
+         older_p != request_p;
+         older_p = older_p->next_p) {
+        if ((older_p->direction == BLOCKDEV_REQUEST_READ)
+            && (request_p->direction == BLOCKDEV_REQUEST_READ)) {
+            continue;
+        }
+
+        if ((older_p->block < request_p->block + request_p->count)
+            && (request_p->block < older_p->block + older_p->count)) {
+            return (1);
+        }
+    }
+
+    return (0);
+}
+
+/**
+ * Select the next request to serve. The oldest request is served if
+ * its deadline has passed, otherwise the elevator continues upwards
+ * from the current position, or wraps around to the lowest block. The
+ * oldest request is never blocked, so a request is always found.
+ */
+static struct blockdev_request_t *request_select(struct blockdev_t *self_p)
+{
+    struct blockdev_request_t *request_p;
+    struct blockdev_request_t *next_p;
+    struct blockdev_request_t *lowest_p;
+
+    if ((int32_t)(self_p->dispatches - self_p->head_p->deadline) >= 0) {
+        return (self_p->head_p);
+    }
+
+    next_p = NULL;
+    lowest_p = NULL;
+
+    for (request_p = self_p->head_p;
+         request_p != NULL;
+         request_p = request_p->next_p) {
+        if (request_is_blocked(self_p, request_p)) {
+            continue;
+        }
+
+        if ((request_p->block >= self_p->position)
+            && ((next_p == NULL) || (request_p->block < next_p->block))) {
+            next_p = request_p;
+        }
+
+        if ((lowest_p == NULL) || (request_p->block < lowest_p->block)) {
+            lowest_p = request_p;
+        }
+    }
+
+    return (next_p != NULL ? next_p : lowest_p);
+}
+
+/**
+ * Find a queued request in given direction starting at given block
+ * that may be served now.
+ */
+static struct blockdev_request_t *request_find(struct blockdev_t *self_p,
+                                               int direction,
+                                               uint32_t block)
+{
+    struct blockdev_request_t *request_p;
+
+    for (request_p = self_p->head_p;
+         request_p != NULL;
+         request_p = request_p->next_p) {
+        if ((request_p->direction == direction)
+            && (request_p->block == block)
+            && !request_is_blocked(self_p, request_p)) {
+            return (request_p);
+        }
+    }
+
+    return (NULL);
+}
+
+/**
+ * Find a queued request in given direction ending just before given
+ * block that may be served now.
+ */
+static struct blockdev_request_t *request_find_end(struct blockdev_t *self_p,
+                                                   int direction,
+                                                   uint32_t block)
+{
+    struct blockdev_request_t *request_p;
+
+    for (request_p = self_p->head_p;
+         request_p != NULL;
+         request_p = request_p->next_p) {
+        if ((request_p->direction == direction)
+            && (request_p->block + request_p->count == block)
+            && !request_is_blocked(self_p, request_p)) {
+            return (request_p);
+        }
+    }
+
+    return (NULL);
+}
+
+/**
+ * Copy valid cached blocks to given buffer. The cache has the most
+ * recent version of the blocks.
+ */
+static void cache_overlay(struct blockdev_t *self_p,
+                          uint8_t *buf_p,
+                          uint32_t block,
+                          size_t count)
+{
+    struct blockdev_cache_block_t *cache_block_p;
+    size_t i;
+
+    for (i = 0; i < self_p->cache.length; i++) {
+        cache_block_p = &self_p->cache.blocks_p[i];
+
+        if (cache_block_p->valid
+            && (cache_block_p->block >= block)
+            && (cache_block_p->block < block + count)) {
+            memcpy(&buf_p[BLOCK_SIZE * (cache_block_p->block - block)],
+                   cache_block_p->buf,
+                   BLOCK_SIZE);
+        }
+    }
+}
+
+/**
+ * Update cached copies of given blocks.
+ */
+static void cache_update(struct blockdev_t *self_p,
+                         const uint8_t *buf_p,
+                         uint32_t block,
+                         size_t count)
+{
+    struct blockdev_cache_block_t *cache_block_p;
+    size_t i;
+
+    for (i = 0; i < self_p->cache.length; i++) {
+        cache_block_p = &self_p->cache.blocks_p[i];
+
+        if (cache_block_p->valid
+            && (cache_block_p->block >= block)
+            && (cache_block_p->block < block + count)) {
+            memcpy(cache_block_p->buf,
+                   &buf_p[BLOCK_SIZE * (cache_block_p->block - block)],
+                   BLOCK_SIZE);
+        }
+    }
+}
+
+/**
+ * Serve the next request, merged with queued requests in the same
+ * direction for the following blocks.
+ */
+static void dispatch_one(struct blockdev_t *self_p)
+{
+    struct blockdev_request_t *first_p;
+    struct blockdev_request_t *last_p;
+    struct blockdev_request_t *next_p;
+    struct blockdev_request_t *request_p;
+    uint8_t *buf_p;
+    uint8_t *end_p;
+    size_t count;
+    size_t offset;
+    ssize_t res;
+    int direct;
+
+    first_p = request_select(self_p);
+    request_remove(self_p, first_p);
+    last_p = first_p;
+    count = first_p->count;
+    end_p = &((uint8_t *)first_p->buf_p)[BLOCK_SIZE * count];
+    direct = 1;
+
+    /* Merge requests for the preceding and following blocks. Requests
+       with adjacent buffers are transferred directly, otherwise the
+       merge buffer is used. */
+    while (1) {
+        next_p = request_find_end(self_p, first_p->direction, first_p->block);
+
+        if (next_p == NULL) {
+            break;
+        }
+
+        if (!(direct
+              && (&((uint8_t *)next_p->buf_p)[BLOCK_SIZE * next_p->count]
+                  == first_p->buf_p))) {
+            if (count + next_p->count > self_p->merge.length) {
+                break;
+            }
+
+            direct = 0;
+        }
+
+        request_remove(self_p, next_p);
+        next_p->next_p = first_p;
+        first_p = next_p;
+        count += next_p->count;
+    }
+
+    while (1) {
+        next_p = request_find(self_p,
+                              first_p->direction,
+                              first_p->block + count);
+
+        if (next_p == NULL) {
+            break;
+        }
+
+        if (!(direct && (next_p->buf_p == end_p))) {
+            if (count + next_p->count > self_p->merge.length) {
+                break;
+            }
+
+            direct = 0;
+        }
+
+        request_remove(self_p, next_p);
+        last_p->next_p = next_p;
+        last_p = next_p;
+        count += next_p->count;
+        end_p = &((uint8_t *)next_p->buf_p)[BLOCK_SIZE * next_p->count];
+    }
+
+    if (direct) {
+        buf_p = first_p->buf_p;
+    } else {
+        buf_p = self_p->merge.buf_p;
+    }
+
+    if (first_p->direction == BLOCKDEV_REQUEST_READ) {
+        res = self_p->read(self_p->arg_p, buf_p, first_p->block, count);
+    } else {
+        if (!direct) {
+            offset = 0;
+
+            for (request_p = first_p;
+                 request_p != NULL;
+                 request_p = request_p->next_p) {
+                memcpy(&buf_p[offset],
+                       request_p->buf_p,
+                       BLOCK_SIZE * request_p->count);
+                offset += (BLOCK_SIZE * request_p->count);
+            }
+        }
+
+        res = self_p->write(self_p->arg_p, first_p->block, buf_p, count);
+    }
+
+    if ((res >= 0) && (res != BLOCK_SIZE * count)) {
+        res = -EIO;
+    }
+
+    /* Complete the merged requests. */
+    offset = 0;
+    request_p = first_p;
+
+    while (request_p != NULL) {
+        next_p = request_p->next_p;
+
+        if (res < 0) {
+            request_p->res = res;
+        } else {
+            if ((request_p->direction == BLOCKDEV_REQUEST_READ) && !direct) {
+                memcpy(request_p->buf_p,
+                       &buf_p[offset],
+                       BLOCK_SIZE * request_p->count);
+            }
+
+            request_p->res = (BLOCK_SIZE * request_p->count);
+        }
+
+        offset += (BLOCK_SIZE * request_p->count);
+        request_p->next_p = NULL;
+        request_p->done = 1;
+        request_p = next_p;
+    }
+
+    self_p->position = (first_p->block + count);
+    self_p->dispatches++;
+}
+
+static void submit(struct blockdev_t *self_p,
+                   struct blockdev_request_t *request_p)
+{
+    struct blockdev_request_t **next_pp;
+
+    request_p->res = 0;
+    request_p->done = 0;
+    request_p->deadline = (self_p->dispatches + BLOCKDEV_REQUEST_DEADLINE);
+    request_p->next_p = NULL;
+
+    /* Keep cached copies of the written blocks up to date. */
+    if (request_p->direction == BLOCKDEV_REQUEST_WRITE) {
+        cache_update(self_p,
+                     request_p->buf_p,
+                     request_p->block,
+                     request_p->count);
+    }
+
+    /* Append to the queue. */
+    next_pp = &self_p->head_p;
+
+    while (*next_pp != NULL) {
+        next_pp = &(*next_pp)->next_p;
+    }
+
+    *next_pp = request_p;
+}
+
+static ssize_t wait(struct blockdev_t *self_p,
+                    struct blockdev_request_t *request_p)
+{
+    while (!request_p->done) {
+        /* The request is not queued. */
+        if (self_p->head_p == NULL) {
+            return (-EINVAL);
+        }
+
+        dispatch_one(self_p);
+    }
+
+    return (request_p->res);
+}
+
+static int flush(struct blockdev_t *self_p)
+{
+    struct blockdev_cache_block_t *cache_block_p;
+    size_t i;
+    int res;
+
+    /* Queue all dirty blocks. The elevator merges adjacent blocks. */
+    for (i = 0; i < self_p->cache.length; i++) {
+        cache_block_p = &self_p->cache.blocks_p[i];
+
+        if (cache_block_p->valid && cache_block_p->dirty) {
+            blockdev_request_init(&cache_block_p->request,
+                                  BLOCKDEV_REQUEST_WRITE,
+                                  cache_block_p->buf,
+                                  cache_block_p->block,
+                                  1);
+            submit(self_p, &cache_block_p->request);
+        }
+    }
+
+    while (self_p->head_p != NULL) {
+        dispatch_one(self_p);
+    }
+
+    res = 0;
+
+    for (i = 0; i < self_p->cache.length; i++) {
+        cache_block_p = &self_p->cache.blocks_p[i];
+
+        if (cache_block_p->valid && cache_block_p->dirty) {
+            if (cache_block_p->request.res == BLOCK_SIZE) {
+                cache_block_p->dirty = 0;
+            } else {
+                res = -EIO;
+            }
+        }
+    }
+
+    return (res);
+}
+
+/**
+ * Find given block in the cache.
+ */
+static struct blockdev_cache_block_t *cache_find(struct blockdev_t *self_p,
+                                                 uint32_t block)
+{
+    struct blockdev_cache_block_t *cache_block_p;
+    size_t i;
+
+    for (i = 0; i < self_p->cache.length; i++) {
+        cache_block_p = &self_p->cache.blocks_p[i];
+
+        if (cache_block_p->valid && (cache_block_p->block == block)) {
+            return (cache_block_p);
+        }
+    }
+
+    return (NULL);
+}
+
+/**
+ * Allocate a cache block for given block. All dirty blocks are
+ * written back if the least recently used block is dirty.
+ */
+static struct blockdev_cache_block_t *cache_alloc(struct blockdev_t *self_p,
+                                                  uint32_t block)
+{
+    struct blockdev_cache_block_t *cache_block_p;
+    struct blockdev_cache_block_t *lru_p;
+    size_t i;
+
+    lru_p = NULL;
+
+    for (i = 0; i < self_p->cache.length; i++) {
+        cache_block_p = &self_p->cache.blocks_p[i];
+
+        if (!cache_block_p->valid) {
+            lru_p = cache_block_p;
+            break;
+        }
+
+        if ((lru_p == NULL)
+            || ((int32_t)(cache_block_p->used - lru_p->used) < 0)) {
+            lru_p = cache_block_p;
+        }
+    }
+
+    if (lru_p->valid && lru_p->dirty) {
+        if (flush(self_p) != 0) {
+            return (NULL);
+        }
+    }
+
+    lru_p->block = block;
+    lru_p->valid = 0;
+    lru_p->dirty = 0;
+
+    return (lru_p);
+}
+
+static ssize_t read_blocks(struct blockdev_t *self_p,
+                           void *dst_p,
+                           uint32_t src_block,
+                           size_t count)
+{
+    struct blockdev_request_t request;
+    ssize_t res;
+
+    blockdev_request_init(&request,
+                          BLOCKDEV_REQUEST_READ,
+                          dst_p,
+                          src_block,
+                          count);
+    submit(self_p, &request);
+    res = wait(self_p, &request);
+
+    if (res < 0) {
+        return (res);
+    }
+
+    cache_overlay(self_p, dst_p, src_block, count);
+
+    return (res);
+}
+
+static ssize_t write_blocks(struct blockdev_t *self_p,
+                            uint32_t dst_block,
+                            const void *src_p,
+                            size_t count)
+{
+    struct blockdev_request_t request;
+
+    blockdev_request_init(&request,
+                          BLOCKDEV_REQUEST_WRITE,
+                          (void *)src_p,
+                          dst_block,
+                          count);
+    submit(self_p, &request);
+
+    return (wait(self_p, &request));
+}
+
+static ssize_t read_block(struct blockdev_t *self_p,
+                          void *dst_p,
+                          uint32_t src_block)
+{
+    struct blockdev_cache_block_t *cache_block_p;
+    ssize_t res;
+
+    if (self_p->cache.length == 0) {
+        return (read_blocks(self_p, dst_p, src_block, 1));
+    }
+
+    cache_block_p = cache_find(self_p, src_block);
+
+    if (cache_block_p == NULL) {
+        cache_block_p = cache_alloc(self_p, src_block);
+
+        if (cache_block_p == NULL) {
+            return (-EIO);
+        }
+
+        blockdev_request_init(&cache_block_p->request,
+                              BLOCKDEV_REQUEST_READ,
+                              cache_block_p->buf,
+                              src_block,
+                              1);
+        submit(self_p, &cache_block_p->request);
+        res = wait(self_p, &cache_block_p->request);
+
+        if (res < 0) {
+            return (res);
+        }
+
+        cache_block_p->valid = 1;
+    }
+
+    cache_block_p->used = self_p->cache.counter++;
+    memcpy(dst_p, cache_block_p->buf, BLOCK_SIZE);
+
+    return (BLOCK_SIZE);
+}
+
+static ssize_t write_block(struct blockdev_t *self_p,
+                           uint32_t dst_block,
+                           const void *src_p)
+{
+    struct blockdev_cache_block_t *cache_block_p;
+
+    if (self_p->cache.length == 0) {
+        return (write_blocks(self_p, dst_block, src_p, 1));
+    }
+
+    cache_block_p = cache_find(self_p, dst_block);
+
+    if (cache_block_p == NULL) {
+        cache_block_p = cache_alloc(self_p, dst_block);
+
+        if (cache_block_p == NULL) {
+            return (-EIO);
+        }
+    }
+
+    memcpy(cache_block_p->buf, src_p, BLOCK_SIZE);
+    cache_block_p->valid = 1;
+    cache_block_p->dirty = 1;
+    cache_block_p->used = self_p->cache.counter++;
+
+    return (BLOCK_SIZE);
+}
+
+int blockdev_init(struct blockdev_t *self_p,
+                  blockdev_read_t read,
+                  blockdev_write_t write,
+                  void *arg_p)
+{
+    self_p->read = read;
+    self_p->write = write;
+    self_p->arg_p = arg_p;
+    self_p->head_p = NULL;
+    self_p->position = 0;
+    self_p->dispatches = 0;
+    self_p->merge.buf_p = NULL;
+    self_p->merge.length = 0;
+    self_p->cache.blocks_p = NULL;
+    self_p->cache.length = 0;
+    self_p->cache.counter = 0;
+    sem_init(&self_p->sem, 1);
+
+    return (0);
+}
+
+int blockdev_set_merge_buffer(struct blockdev_t *self_p,
+                              void *buf_p,
+                              size_t size)
+{
+    self_p->merge.buf_p = buf_p;
+    self_p->merge.length = (size / BLOCK_SIZE);
+
+    return (0);
+}
+
+int blockdev_set_cache(struct blockdev_t *self_p,
+                       struct blockdev_cache_block_t *blocks_p,
+                       size_t length)
+{
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+        blocks_p[i].valid = 0;
+        blocks_p[i].dirty = 0;
+    }
+
+    self_p->cache.blocks_p = blocks_p;
+    self_p->cache.length = length;
+
+    return (0);
+}
+
+int blockdev_request_init(struct blockdev_request_t *request_p,
+                          int direction,
+                          void *buf_p,
+                          uint32_t block,
+                          size_t count)
+{
+    request_p->direction = direction;
+    request_p->buf_p = buf_p;
+    request_p->block = block;
+    request_p->count = count;
+    request_p->res = 0;
+    request_p->done = 0;
+    request_p->next_p = NULL;
+
+    return (0);
+}
+
+int blockdev_submit(struct blockdev_t *self_p,
+                    struct blockdev_request_t *request_p)
+{
+    sem_get(&self_p->sem, NULL);
+    submit(self_p, request_p);
+    sem_put(&self_p->sem, 1);
+
+    return (0);
+}
+
+int blockdev_dispatch(struct blockdev_t *self_p)
+{
+    sem_get(&self_p->sem, NULL);
+
+    while (self_p->head_p != NULL) {
+        dispatch_one(self_p);
+    }
+
+    sem_put(&self_p->sem, 1);
+
+    return (0);
+}
+
+ssize_t blockdev_wait(struct blockdev_t *self_p,
+                      struct blockdev_request_t *request_p)
+{
+    ssize_t res;
+
+    sem_get(&self_p->sem, NULL);
+    res = wait(self_p, request_p);
+    sem_put(&self_p->sem, 1);
+
+    return (res);
+}
+
+int blockdev_flush(struct blockdev_t *self_p)
+{
+    int res;
+
+    sem_get(&self_p->sem, NULL);
+    res = flush(self_p);
+    sem_put(&self_p->sem, 1);
+
+    return (res);
+}
+
+ssize_t blockdev_read_block(struct blockdev_t *self_p,
+                            void *dst_p,
+                            uint32_t src_block)
+{
+    ssize_t res;
+
+    sem_get(&self_p->sem, NULL);
+    res = read_block(self_p, dst_p, src_block);
+    sem_put(&self_p->sem, 1);
+
+    return (res);
+}
+
+ssize_t blockdev_write_block(struct blockdev_t *self_p,
+                             uint32_t dst_block,
+                             const void *src_p)
+{
+    ssize_t res;
+
+    sem_get(&self_p->sem, NULL);
+    res = write_block(self_p, dst_block, src_p);
+    sem_put(&self_p->sem, 1);
+
+    return (res);
+}
+
+ssize_t blockdev_read_blocks(struct blockdev_t *self_p,
+                             void *dst_p,
+                             uint32_t src_block,
+                             size_t count)
+{
+    ssize_t res;
+
+    sem_get(&self_p->sem, NULL);
+    res = read_blocks(self_p, dst_p, src_block, count);
+    sem_put(&self_p->sem, 1);
+
+    return (res);
+}
+
+ssize_t blockdev_write_blocks(struct blockdev_t *self_p,
+                              uint32_t dst_block,
+                              const void *src_p,
+                              size_t count)
+{
+    ssize_t res;
+
+    sem_get(&self_p->sem, NULL);
+    res = write_blocks(self_p, dst_block, src_p, count);
+    sem_put(&self_p->sem, 1);
+
+    return (res);
+}
+
+int blockdev_ram_init(struct blockdev_ram_t *self_p,
+                      void *buf_p,
+                      size_t size)
+{
+    self_p->buf_p = buf_p;
+    self_p->length = (size / BLOCK_SIZE);
+
+    return (0);
+}
+
+ssize_t blockdev_ram_read(struct blockdev_ram_t *self_p,
+                          void *dst_p,
+                          uint32_t src_block,
+                          size_t count)
+{
+    if ((src_block > self_p->length)
+        || (count > self_p->length - src_block)) {
+        return (-EINVAL);
+    }
+
+    memcpy(dst_p, &self_p->buf_p[BLOCK_SIZE * src_block], BLOCK_SIZE * count);
+
+    return (BLOCK_SIZE * count);
+}
+
+ssize_t blockdev_ram_write(struct blockdev_ram_t *self_p,
+                           uint32_t dst_block,
+                           const void *src_p,
+                           size_t count)
+{
+    if ((dst_block > self_p->length)
+        || (count > self_p->length - dst_block)) {
+        return (-EINVAL);
+    }
+
+    memcpy(&self_p->buf_p[BLOCK_SIZE * dst_block], src_p, BLOCK_SIZE * count);
+
+    return (BLOCK_SIZE * count);
+}
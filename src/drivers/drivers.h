@@ -31,6 +31,7 @@
 #    include "drivers/can.h"
 #    include "drivers/sd.h"
 #    include "drivers/flash.h"
+#    include "drivers/blockdev.h"
 #endif
 
 #if defined(ARCH_AVR)
@@ -47,6 +48,7 @@
 #    include "drivers/mcp2515.h"
 #    include "drivers/nrf24l01.h"
 #    include "drivers/sd.h"
+#    include "drivers/blockdev.h"
 #endif
 
 #if defined(ARCH_ARM)
@@ -57,6 +59,7 @@
 #    include "drivers/spi.h"
 #    include "drivers/uart.h"
 #    include "drivers/sd.h"
+#    include "drivers/blockdev.h"
 #    include "drivers/can.h"
 #    include "drivers/mcp2515.h"
 #    include "drivers/adc.h"
@@ -22,7 +22,8 @@ INC += $(SIMBA_ROOT)/src/drivers
 INC += $(SIMBA_ROOT)/src/drivers/ports/$(ARCH)
 
 ifeq ($(ARCH),linux)
-DRIVERS_SRC ?= pin.c \
+DRIVERS_SRC ?= blockdev.c \
+               pin.c \
                sd.c \
                flash.c \
                spi.c \
@@ -31,6 +32,7 @@ endif
 
 ifeq ($(ARCH),avr)
 DRIVERS_SRC ?= adc.c \
+               blockdev.c \
                ds18b20.c \
                ds3231.c \
                exti.c \
@@ -47,6 +49,7 @@ endif
 
 ifeq ($(ARCH),arm)
 DRIVERS_SRC ?= adc.c \
+               blockdev.c \
                can.c \
                chipid.c \
                dac.c \
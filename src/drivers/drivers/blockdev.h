@@ -0,0 +1,332 @@
+/**
+ * @file drivers/blockdev.h
+ * @version 0.5.0
+ *
+ * @section License
+ * Copyright (C) 2016, Erik Moqvist
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Simba project.
+ */
+
+#ifndef __DRIVERS_BLOCKDEV_H__
+#define __DRIVERS_BLOCKDEV_H__
+
+#include "simba.h"
+
+#define BLOCKDEV_BLOCK_SIZE 512
+
+/**
+ * Number of dispatched batches a queued request may be passed over
+ * by the elevator before it is served first.
+ */
+#ifndef BLOCKDEV_REQUEST_DEADLINE
+#    define BLOCKDEV_REQUEST_DEADLINE 8
+#endif
+
+/* Request directions. */
+#define BLOCKDEV_REQUEST_READ  0
+#define BLOCKDEV_REQUEST_WRITE 1
+
+/**
+ * Read given number of consecutive blocks from a backing store. The
+ * multiple block read functions of the SD and USB mass storage
+ * drivers have this signature.
+ */
+typedef ssize_t (*blockdev_read_t)(void *arg_p,
+                                   void *dst_p,
+                                   uint32_t src_block,
+                                   size_t count);
+
+/**
+ * Write given number of consecutive blocks to a backing store.
+ */
+typedef ssize_t (*blockdev_write_t)(void *arg_p,
+                                    uint32_t dst_block,
+                                    const void *src_p,
+                                    size_t count);
+
+struct blockdev_request_t {
+    int direction;
+    void *buf_p;
+    uint32_t block;
+    size_t count;
+    /* Number of transferred bytes or negative error code. */
+    ssize_t res;
+    int done;
+    /* Dispatch count when the request must be served. */
+    uint32_t deadline;
+    struct blockdev_request_t *next_p;
+};
+
+struct blockdev_cache_block_t {
+    /* Used to write the block back to the backing store. */
+    struct blockdev_request_t request;
+    uint32_t block;
+    int valid;
+    int dirty;
+    /* Used to find the least recently used block. */
+    uint32_t used;
+    uint8_t buf[BLOCKDEV_BLOCK_SIZE];
+};
+
+/**
+ * A block device on top of a backing store, for example an SD card
+ * or an USB stick. Requests are queued and dispatched in elevator
+ * order, and requests for adjacent blocks are merged into a single
+ * multiple block transfer. Single block writes are cached and
+ * written back in batches.
+ */
+struct blockdev_t {
+    blockdev_read_t read;
+    blockdev_write_t write;
+    void *arg_p;
+    /* Protects the queue and the cache. */
+    struct sem_t sem;
+    /* Queued requests, oldest first. */
+    struct blockdev_request_t *head_p;
+    /* Block after the last transferred block. */
+    uint32_t position;
+    uint32_t dispatches;
+    struct {
+        uint8_t *buf_p;
+        size_t length;
+    } merge;
+    struct {
+        struct blockdev_cache_block_t *blocks_p;
+        size_t length;
+        uint32_t counter;
+    } cache;
+};
+
+/**
+ * A block device backed by a buffer in RAM.
+ */
+struct blockdev_ram_t {
+    uint8_t *buf_p;
+    size_t length;
+};
+
+/**
+ * Initialize given block device.
+ *
+ * @param[out] self_p Block device to initialize.
+ * @param[in] read Function reading consecutive blocks from the
+ *                 backing store.
+ * @param[in] write Function writing consecutive blocks to the
+ *                  backing store.
+ * @param[in] arg_p Argument passed to the read and write functions.
+ *
+ * @return zero(0) or negative error code.
+ */
+int blockdev_init(struct blockdev_t *self_p,
+                  blockdev_read_t read,
+                  blockdev_write_t write,
+                  void *arg_p);
+
+/**
+ * Set a buffer used to merge requests for adjacent blocks whose
+ * buffers are not adjacent in memory. Without it, only requests with
+ * adjacent buffers are merged.
+ *
+ * @param[in] self_p Initialized block device.
+ * @param[in] buf_p Merge buffer.
+ * @param[in] size Size of the merge buffer in bytes.
+ *
+ * @return zero(0) or negative error code.
+ */
+int blockdev_set_merge_buffer(struct blockdev_t *self_p,
+                              void *buf_p,
+                              size_t size);
+
+/**
+ * Set the write-back cache of given block device. Single block reads
+ * and writes use the cache. Dirty blocks are written to the backing
+ * store by `blockdev_flush()`, or when a block is evicted.
+ *
+ * @param[in] self_p Initialized block device.
+ * @param[in] blocks_p Array of cache blocks.
+ * @param[in] length Number of cache blocks.
+ *
+ * @return zero(0) or negative error code.
+ */
+int blockdev_set_cache(struct blockdev_t *self_p,
+                       struct blockdev_cache_block_t *blocks_p,
+                       size_t length);
+
+/**
+ * Initialize given request.
+ *
+ * @param[out] request_p Request to initialize.
+ * @param[in] direction ``BLOCKDEV_REQUEST_READ`` or
+ *                      ``BLOCKDEV_REQUEST_WRITE``.
+ * @param[in] buf_p Buffer to read into or write from. Must be valid
+ *                  until the request is done.
+ * @param[in] block First block.
+ * @param[in] count Number of blocks.
+ *
+ * @return zero(0) or negative error code.
+ */
+int blockdev_request_init(struct blockdev_request_t *request_p,
+                          int direction,
+                          void *buf_p,
+                          uint32_t block,
+                          size_t count);
+
+/**
+ * Queue given request without executing it. Queued requests are
+ * executed by `blockdev_dispatch()`, `blockdev_wait()` and
+ * `blockdev_flush()`. Queued requests may be executed in any order,
+ * except that a request overlapping an older queued request is
+ * executed after it if any of them is a write.
+ *
+ * @param[in] self_p Initialized block device.
+ * @param[in] request_p Initialized request.
+ *
+ * @return zero(0) or negative error code.
+ */
+int blockdev_submit(struct blockdev_t *self_p,
+                    struct blockdev_request_t *request_p);
+
+/**
+ * Execute all queued requests. The requests are served in ascending
+ * block order starting at the current position, wrapping around to
+ * the lowest block. A request passed over
+ * ``BLOCKDEV_REQUEST_DEADLINE`` times is served first. Requests in
+ * the same direction for adjacent blocks are merged into one
+ * transfer.
+ *
+ * @param[in] self_p Initialized block device.
+ *
+ * @return zero(0) or negative error code.
+ */
+int blockdev_dispatch(struct blockdev_t *self_p);
+
+/**
+ * Wait for given request to complete, dispatching queued requests.
+ *
+ * @param[in] self_p Initialized block device.
+ * @param[in] request_p Submitted request.
+ *
+ * @return Number of transferred bytes or negative error code.
+ */
+ssize_t blockdev_wait(struct blockdev_t *self_p,
+                      struct blockdev_request_t *request_p);
+
+/**
+ * Write all dirty cache blocks to the backing store, merging
+ * adjacent blocks, and execute all queued requests.
+ *
+ * @param[in] self_p Initialized block device.
+ *
+ * @return zero(0) or negative error code.
+ */
+int blockdev_flush(struct blockdev_t *self_p);
+
+/**
+ * Read a block from given block device. Can be given to
+ * `fat16_init()` as the read function.
+ *
+ * @param[in] self_p Initialized block device.
+ * @param[out] dst_p Buffer to read into.
+ * @param[in] src_block Block to read from.
+ *
+ * @return Number of read bytes or negative error code.
+ */
+ssize_t blockdev_read_block(struct blockdev_t *self_p,
+                            void *dst_p,
+                            uint32_t src_block);
+
+/**
+ * Write a block to given block device. The block is only written to
+ * the cache if the device has one. Can be given to `fat16_init()` as
+ * the write function.
+ *
+ * @param[in] self_p Initialized block device.
+ * @param[in] dst_block Block to write to.
+ * @param[in] src_p Buffer to write.
+ *
+ * @return Number of written bytes or negative error code.
+ */
+ssize_t blockdev_write_block(struct blockdev_t *self_p,
+                             uint32_t dst_block,
+                             const void *src_p);
+
+/**
+ * Read given number of consecutive blocks from given block
+ * device. Can be given to `fat16_set_multi_block_functions()`.
+ *
+ * @param[in] self_p Initialized block device.
+ * @param[out] dst_p Buffer to read into.
+ * @param[in] src_block First block to read from.
+ * @param[in] count Number of blocks to read.
+ *
+ * @return Number of read bytes or negative error code.
+ */
+ssize_t blockdev_read_blocks(struct blockdev_t *self_p,
+                             void *dst_p,
+                             uint32_t src_block,
+                             size_t count);
+
+/**
+ * Write given number of consecutive blocks to given block device,
+ * bypassing the cache. Can be given to
+ * `fat16_set_multi_block_functions()`.
+ *
+ * @param[in] self_p Initialized block device.
+ * @param[in] dst_block First block to write to.
+ * @param[in] src_p Buffer to write.
+ * @param[in] count Number of blocks to write.
+ *
+ * @return Number of written bytes or negative error code.
+ */
+ssize_t blockdev_write_blocks(struct blockdev_t *self_p,
+                              uint32_t dst_block,
+                              const void *src_p,
+                              size_t count);
+
+/**
+ * Initialize given RAM block device.
+ *
+ * @param[out] self_p RAM block device to initialize.
+ * @param[in] buf_p Buffer with the blocks.
+ * @param[in] size Size of the buffer in bytes.
+ *
+ * @return zero(0) or negative error code.
+ */
+int blockdev_ram_init(struct blockdev_ram_t *self_p,
+                      void *buf_p,
+                      size_t size);
+
+/**
+ * Read given number of blocks from given RAM block device. Can be
+ * given to `blockdev_init()` as the read function.
+ *
+ * @return Number of read bytes or negative error code.
+ */
+ssize_t blockdev_ram_read(struct blockdev_ram_t *self_p,
+                          void *dst_p,
+                          uint32_t src_block,
+                          size_t count);
+
+/**
+ * Write given number of blocks to given RAM block device. Can be
+ * given to `blockdev_init()` as the write function.
+ *
+ * @return Number of written bytes or negative error code.
+ */
+ssize_t blockdev_ram_write(struct blockdev_ram_t *self_p,
+                           uint32_t dst_block,
+                           const void *src_p,
+                           size_t count);
+
+#endif
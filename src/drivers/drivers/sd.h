@@ -247,4 +247,41 @@ ssize_t sd_write_block(struct sd_driver_t *self_p,
                        uint32_t dst_block,
                        const void *src_p);
 
+/**
+ * Read given number of consecutive blocks from SD card with a single
+ * multiple block read command.
+ *
+ * @param[in] self_p Initialized driver object.
+ * @param[in] dst_p Buffer to read into. Must be at least ``count``
+ *                  times ``SD_BLOCK_SIZE`` bytes.
+ * @param[in] src_block First block to read from.
+ * @param[in] count Number of blocks to read. Nothing is sent to the
+ *                  card if zero.
+ *
+ * @return Number of read bytes or negative error code.
+ */
+ssize_t sd_read_blocks(struct sd_driver_t *self_p,
+                       void *dst_p,
+                       uint32_t src_block,
+                       size_t count);
+
+/**
+ * Write given number of consecutive blocks to SD card with a single
+ * multiple block write command. The card is told the number of
+ * blocks before the write so it can erase them in advance.
+ *
+ * @param[in] self_p Initialized driver object.
+ * @param[in] dst_block First block to write to.
+ * @param[in] src_p Buffer to write. Must be at least ``count`` times
+ *                  ``SD_BLOCK_SIZE`` bytes.
+ * @param[in] count Number of blocks to write. Nothing is sent to the
+ *                  card if zero.
+ *
+ * @return Number of written bytes or negative error code.
+ */
+ssize_t sd_write_blocks(struct sd_driver_t *self_p,
+                        uint32_t dst_block,
+                        const void *src_p,
+                        size_t count);
+
 #endif
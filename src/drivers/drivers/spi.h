@@ -40,6 +40,38 @@
 
 extern struct spi_device_t spi_device[SPI_DEVICE_MAX];
 
+/**
+ * Transaction complete callback. Called from interrupt context, or
+ * with the system lock taken, when given transaction is complete. A
+ * thread waiting for the transaction is resumed before the callback
+ * is called, so the callback may queue the transaction again.
+ */
+typedef void (*spi_transaction_callback_t)(
+    struct spi_transaction_t *transaction_p,
+    void *arg_p);
+
+/**
+ * An SPI transaction. The transaction is transferred with the slave
+ * select pin, mode and speed of its driver object. Transactions are
+ * queued per device and transferred in order.
+ */
+struct spi_transaction_t {
+    struct spi_driver_t *drv_p;
+    void *rxbuf_p;
+    const void *txbuf_p;
+    size_t size;
+    spi_transaction_callback_t callback;
+    void *arg_p;
+    /* Number of transferred bytes or negative error code. Valid once
+       the transaction is complete. */
+    ssize_t res;
+    /* Set when the transaction is complete. */
+    int done;
+    /* Thread waiting for the transaction to complete. */
+    struct thrd_t *thrd_p;
+    struct spi_transaction_t *next_p;
+};
+
 /**
  * Initialize SPI module.
  */
@@ -67,7 +99,8 @@ int spi_init(struct spi_driver_t *self_p,
              int cpha);
 
 /**
- * Simultaniuos read/write operation over the SPI bus.
+ * Simultaniuos read/write operation over the SPI bus. Queues a
+ * transaction and waits for it to complete.
  *
  * @param[in] self_p Initialized driver object.
  * @param[in] rxbuf_p Buffer to read into.
@@ -81,6 +114,63 @@ ssize_t spi_transfer(struct spi_driver_t *self_p,
                      const void *txbuf_p,
                      size_t size);
 
+/**
+ * Initialize given transaction.
+ *
+ * @param[out] transaction_p Transaction to initialize.
+ * @param[in] drv_p Initialized driver object to transfer with.
+ * @param[in] rxbuf_p Buffer to read into, or NULL.
+ * @param[in] txbuf_p Buffer to write, or NULL to write 0xff.
+ * @param[in] size Number of bytes to transfer.
+ * @param[in] callback Called when the transaction is complete, or
+ *                     NULL.
+ * @param[in] arg_p Callback argument.
+ *
+ * @return zero(0) or negative error code.
+ */
+int spi_transaction_init(struct spi_transaction_t *transaction_p,
+                         struct spi_driver_t *drv_p,
+                         void *rxbuf_p,
+                         const void *txbuf_p,
+                         size_t size,
+                         spi_transaction_callback_t callback,
+                         void *arg_p);
+
+/**
+ * Add given transaction to the queue of its device and return
+ * without waiting for it to be transferred. The hardware is only
+ * reconfigured if the previous transaction on the device was made
+ * with another driver object. The transaction and its buffers must
+ * be valid until it is complete.
+ *
+ * @param[in] transaction_p Initialized transaction.
+ *
+ * @return zero(0) or negative error code.
+ */
+int spi_transfer_async(struct spi_transaction_t *transaction_p);
+
+/**
+ * Same as `spi_transfer_async()`, but called from interrupt context
+ * or with the system lock taken, for example from a transaction
+ * complete callback.
+ *
+ * @param[in] transaction_p Initialized transaction.
+ *
+ * @return zero(0) or negative error code.
+ */
+int spi_transfer_async_isr(struct spi_transaction_t *transaction_p);
+
+/**
+ * Wait for given queued transaction to complete. Returns the result
+ * of the first completion, even if the transaction complete callback
+ * queues the transaction again.
+ *
+ * @param[in] transaction_p Queued transaction.
+ *
+ * @return Number of transferred bytes or negative error code.
+ */
+ssize_t spi_transfer_wait(struct spi_transaction_t *transaction_p);
+
 /**
  * Read data from the SPI bus.
  *
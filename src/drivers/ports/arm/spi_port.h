@@ -31,6 +31,7 @@
 #define SPI_PORT_SPEED_500KBPS  (F_CPU /  500000)
 
 struct spi_driver_t;
+struct spi_transaction_t;
 
 struct spi_device_t {
     struct spi_driver_t *drv_p;
@@ -39,7 +40,9 @@ struct spi_device_t {
     struct pin_device_t *miso_p;
     struct pin_device_t *sck_p;
     int id;
-    struct sem_t sem;
+    /* Queued transactions. The first is being transferred. */
+    struct spi_transaction_t *head_p;
+    struct spi_transaction_t *tail_p;
 };
 
 struct spi_driver_t {
@@ -54,7 +57,7 @@ struct spi_driver_t {
     uint8_t *rxbuf_p;                        /* Transfer receive buffer or NULL. */
     const uint8_t *txbuf_p;                  /* Transfer transmit buffer or NULL. */
     size_t size;                             /* Number of bytes left to transfer. */
-    struct thrd_t *thrd_p;                   /* Waiting thread. */
+    size_t block_size;                       /* Size of ongoing DMA transfer. */
 };
 
 #endif
@@ -18,50 +18,149 @@
  * This file is part of the Simba project.
  */
 
+/* DMA channels used by SPI0. */
+#define DMA_CHANNEL_TX                                     0
+#define DMA_CHANNEL_RX                                     1
+
+/* DMA hardware handshaking interfaces of SPI0. */
+#define DMA_PER_SPI0_TX                                    1
+#define DMA_PER_SPI0_RX                                    2
+
+/* Maximum number of bytes in one DMA buffer transfer. */
+#define DMA_BLOCK_SIZE_MAX                             0xfff
+
+/* DMA source and destination when there is no buffer. */
+static const uint8_t dummy_tx = 0xff;
+static uint8_t dummy_rx;
+
+/**
+ * Start DMA transfer of up to DMA_BLOCK_SIZE_MAX bytes. One channel
+ * writes to the transmit data register and one reads from the receive
+ * data register.
+ */
+static void start_dma_transfer_isr(struct spi_driver_t *drv_p)
+{
+    volatile struct sam_spi_t *regs_p = drv_p->dev_p->regs_p;
+    size_t size;
+    uint32_t dst_incr;
+    uint32_t src_incr;
+
+    size = MIN(drv_p->size, DMA_BLOCK_SIZE_MAX);
+    drv_p->block_size = size;
+    drv_p->size -= size;
+
+    /* Discard any old received byte. */
+    (void)regs_p->RDR;
+
+    /* Receive channel, peripheral to memory. */
+    if (drv_p->rxbuf_p != NULL) {
+        SAM_DMAC->channel[DMA_CHANNEL_RX].DADDR = (uint32_t)drv_p->rxbuf_p;
+        dst_incr = 0;
+    } else {
+        SAM_DMAC->channel[DMA_CHANNEL_RX].DADDR = (uint32_t)&dummy_rx;
+        dst_incr = 2;
+    }
+
+    SAM_DMAC->channel[DMA_CHANNEL_RX].SADDR = (uint32_t)&regs_p->RDR;
+    SAM_DMAC->channel[DMA_CHANNEL_RX].DSCR = 0;
+    SAM_DMAC->channel[DMA_CHANNEL_RX].CTRLA = (DMAC_CTRLA_BTSIZE(size)
+                                               | DMAC_CTRLA_SRC_WIDTH(0)
+                                               | DMAC_CTRLA_DST_WIDTH(0));
+    SAM_DMAC->channel[DMA_CHANNEL_RX].CTRLB = (DMAC_CTRLB_SRC_DSCR
+                                               | DMAC_CTRLB_DST_DSCR
+                                               | DMAC_CTRLB_FC(2)
+                                               | DMAC_CTRLB_SRC_INCR(2)
+                                               | DMAC_CTRLB_DST_INCR(dst_incr));
+    SAM_DMAC->channel[DMA_CHANNEL_RX].CFG = (DMAC_CFG_SRC_PER(DMA_PER_SPI0_RX)
+                                             | DMAC_CFG_SRC_H2SEL
+                                             | DMAC_CFG_SOD
+                                             | DMAC_CFG_FIFOCFG(2));
+
+    /* Transmit channel, memory to peripheral. */
+    if (drv_p->txbuf_p != NULL) {
+        SAM_DMAC->channel[DMA_CHANNEL_TX].SADDR = (uint32_t)drv_p->txbuf_p;
+        src_incr = 0;
+    } else {
+        SAM_DMAC->channel[DMA_CHANNEL_TX].SADDR = (uint32_t)&dummy_tx;
+        src_incr = 2;
+    }
+
+    SAM_DMAC->channel[DMA_CHANNEL_TX].DADDR = (uint32_t)&regs_p->TDR;
+    SAM_DMAC->channel[DMA_CHANNEL_TX].DSCR = 0;
+    SAM_DMAC->channel[DMA_CHANNEL_TX].CTRLA = (DMAC_CTRLA_BTSIZE(size)
+                                               | DMAC_CTRLA_SRC_WIDTH(0)
+                                               | DMAC_CTRLA_DST_WIDTH(0));
+    SAM_DMAC->channel[DMA_CHANNEL_TX].CTRLB = (DMAC_CTRLB_SRC_DSCR
+                                               | DMAC_CTRLB_DST_DSCR
+                                               | DMAC_CTRLB_FC(1)
+                                               | DMAC_CTRLB_SRC_INCR(src_incr)
+                                               | DMAC_CTRLB_DST_INCR(2));
+    SAM_DMAC->channel[DMA_CHANNEL_TX].CFG = (DMAC_CFG_DST_PER(DMA_PER_SPI0_TX)
+                                             | DMAC_CFG_DST_H2SEL
+                                             | DMAC_CFG_SOD
+                                             | DMAC_CFG_FIFOCFG(2));
+
+    /* Clear old interrupt flags and start both channels. */
+    (void)SAM_DMAC->EBCISR;
+    SAM_DMAC->CHER = (BIT(DMA_CHANNEL_RX) | BIT(DMA_CHANNEL_TX));
+}
+
 /**
- * SPI TX complete interrupt.
+ * DMA receive channel complete and channel error interrupt. All bytes
+ * are transferred when the last byte is received. An AHB access error
+ * on either channel aborts the transaction.
  */
-ISR(spi0)
+ISR(dmac)
 {
     struct spi_device_t *dev_p = &spi_device[0];
     struct spi_driver_t *drv_p = dev_p->drv_p;
     uint32_t sr;
 
+    sr = SAM_DMAC->EBCISR;
+
     if (drv_p == NULL) {
         return;
     }
 
-    sr = dev_p->regs_p->SR;
-    sr &= dev_p->regs_p->IMR;
+    if ((sr & ((DMAC_EBCIER_ERR0 << DMA_CHANNEL_RX)
+               | (DMAC_EBCIER_ERR0 << DMA_CHANNEL_TX))) != 0) {
+        SAM_DMAC->CHDR = (BIT(DMA_CHANNEL_RX) | BIT(DMA_CHANNEL_TX));
+        drv_p->size = 0;
+        transfer_complete_isr(dev_p, -EIO);
 
-    if (sr == 0) {
         return;
     }
 
-    /* Read incoming byte. */
+    if ((sr & BIT(DMA_CHANNEL_RX)) == 0) {
+        return;
+    }
+
     if (drv_p->rxbuf_p != NULL) {
-        *drv_p->rxbuf_p++ = drv_p->dev_p->regs_p->RDR;
+        drv_p->rxbuf_p += drv_p->block_size;
+    }
+
+    if (drv_p->txbuf_p != NULL) {
+        drv_p->txbuf_p += drv_p->block_size;
     }
 
-    /* Resume on complete transfer. */
     if (drv_p->size == 0) {
-        /* Disable tx interrupt. */
-        dev_p->regs_p->IDR = (SPI_IDR_TXEMPTY);
-        thrd_resume_isr(drv_p->thrd_p, 0);
+        transfer_complete_isr(dev_p, 0);
     } else {
-        /* Write next byte. */
-        if (drv_p->txbuf_p != NULL) {
-            drv_p->dev_p->regs_p->TDR = SPI_TDR_TD(*drv_p->txbuf_p++);
-        } else {
-            drv_p->dev_p->regs_p->TDR = SPI_TDR_TD(0xff);
-        }
-        
-        drv_p->size--;
+        start_dma_transfer_isr(drv_p);
     }
 }
 
 static int spi_port_module_init(void)
 {
+    /* Enable the DMA controller, the receive channel buffer transfer
+       complete interrupt and the error interrupts of both channels. */
+    pmc_peripheral_clock_enable(PERIPHERAL_ID_DMAC);
+    SAM_DMAC->EN = DMAC_EN_ENABLE;
+    SAM_DMAC->EBCIER = (BIT(DMA_CHANNEL_RX)
+                        | (DMAC_EBCIER_ERR0 << DMA_CHANNEL_RX)
+                        | (DMAC_EBCIER_ERR0 << DMA_CHANNEL_TX));
+    nvic_enable_interrupt(PERIPHERAL_ID_DMAC);
+
     return (0);
 }
 
@@ -108,7 +207,6 @@ static int spi_port_start(struct spi_driver_t *self_p)
     pio_p->ABSR &= ~mask;
 
     pmc_peripheral_clock_enable(dev_p->id);
-    nvic_enable_interrupt(dev_p->id);
 
     dev_p->regs_p->CSR[0] = (SPI_CSR_SCBR(self_p->speed)
                              | (SPI_CSR_NCPHA * self_p->cpha)
@@ -141,28 +239,12 @@ static ssize_t spi_port_transfer(struct spi_driver_t *self_p,
                                  const void *txbuf_p,
                                  size_t n)
 {
-    struct spi_device_t *dev_p = self_p->dev_p;
-
     self_p->rxbuf_p = rxbuf_p;
     self_p->txbuf_p = txbuf_p;
-    self_p->size = (n - 1);
-    self_p->thrd_p = thrd_self();
-
-    sys_lock();
-
-    /* Write first byte. The rest are written from isr. */
-    if (self_p->txbuf_p != NULL) {
-        dev_p->regs_p->TDR = SPI_TDR_TD(*self_p->txbuf_p++);
-    } else {
-        dev_p->regs_p->TDR = SPI_TDR_TD(0xff);
-    }
-
-    /* Enable tx interrupt. */
-    dev_p->regs_p->IER = (SPI_IER_TXEMPTY);
-
-    thrd_suspend_isr(NULL);
+    self_p->size = n;
 
-    sys_unlock();
+    /* The rest of the transfer is started from the isr. */
+    start_dma_transfer_isr(self_p);
 
     return (n);
 }
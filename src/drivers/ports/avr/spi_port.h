@@ -33,13 +33,16 @@
 #define SPI_PORT_SPEED_125KBPS  0x7
 
 struct spi_driver_t;
+struct spi_transaction_t;
 
 struct spi_device_t {
     struct spi_driver_t *drv_p;
     struct pin_device_t *mosi_p;
     struct pin_device_t *miso_p;
     struct pin_device_t *sck_p;
-    struct sem_t sem;
+    /* Queued transactions. The first is being transferred. */
+    struct spi_transaction_t *head_p;
+    struct spi_transaction_t *tail_p;
 };
 
 struct spi_driver_t {
@@ -57,7 +60,6 @@ struct spi_driver_t {
     uint8_t *rxbuf_p;                        /* Transfer receive buffer or NULL. */
     const uint8_t *txbuf_p;                  /* Transfer transmit buffer or NULL. */
     size_t size;                             /* Number of bytes left to transfer. */
-    struct thrd_t *thrd_p;                   /* Waiting thread. */
 };
 
 #endif
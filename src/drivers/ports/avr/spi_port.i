@@ -36,9 +36,9 @@ ISR(SPI_STC_vect)
         *drv_p->rxbuf_p++ = SPDR;
     }
 
-    /* Resume on complete transfer. */
+    /* End the transaction on complete transfer. */
     if (drv_p->size == 0) {
-        thrd_resume_isr(drv_p->thrd_p, 0);
+        transfer_complete_isr(drv_p->dev_p, 0);
     } else {
         /* Write next byte. */
         if (drv_p->txbuf_p != NULL) {
@@ -110,7 +110,6 @@ static ssize_t spi_port_transfer(struct spi_driver_t *self_p,
     self_p->rxbuf_p = rxbuf_p;
     self_p->txbuf_p = txbuf_p;
     self_p->size = (n - 1);
-    self_p->thrd_p = thrd_self();
 
     /* Write first byte. The rest are written from isr. */
     if (self_p->txbuf_p != NULL) {
@@ -119,7 +118,5 @@ static ssize_t spi_port_transfer(struct spi_driver_t *self_p,
         SPDR = 0xff;
     }
 
-    thrd_suspend(NULL);
-
     return (n);
 }
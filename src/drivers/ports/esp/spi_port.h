@@ -31,11 +31,14 @@
 #define SPI_PORT_SPEED_125KBPS  0x4fc1001
 
 struct spi_driver_t;
+struct spi_transaction_t;
 
 struct spi_device_t {
     struct spi_driver_t *drv_p;
     volatile struct esp8266_spi_t *regs_p;
-    struct sem_t sem;
+    /* Queued transactions. The first is being transferred. */
+    struct spi_transaction_t *head_p;
+    struct spi_transaction_t *tail_p;
 };
 
 struct spi_driver_t {
@@ -49,7 +52,6 @@ struct spi_driver_t {
     const uint8_t *txbuf_p;         /* Transfer transmit buffer or NULL. */
     size_t size;                    /* Number of bytes left to transfer. */
     size_t block_size;
-    struct thrd_t *thrd_p;          /* Waiting thread. */
 };
 
 #endif
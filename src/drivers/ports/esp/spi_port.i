@@ -86,9 +86,9 @@ static void isr(void *arg_p)
         }
     }
 
-    /* Resume the waiting thread when the transfer is complete. */
+    /* End the transaction when the transfer is complete. */
     if (drv_p->size == 0) {
-        thrd_resume_isr(drv_p->thrd_p, 0);
+        transfer_complete_isr(dev_p, 0);
     } else {
         start_block_transfer_isr(drv_p);
     }
@@ -161,13 +161,9 @@ static ssize_t spi_port_transfer(struct spi_driver_t *self_p,
     self_p->rxbuf_p = rxbuf_p;
     self_p->txbuf_p = txbuf_p;
     self_p->size = n;
-    self_p->thrd_p = thrd_self();
 
     /* Write first block. The rest are written from the isr. */
-    sys_lock();
     start_block_transfer_isr(self_p);
-    thrd_suspend_isr(NULL);
-    sys_unlock();
 
     return (n);
 }
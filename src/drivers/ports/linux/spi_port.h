@@ -33,10 +33,17 @@
 #define SPI_PORT_SPEED_125KBPS  0
 
 struct spi_driver_t;
+struct spi_transaction_t;
 
 struct spi_device_t {
     struct spi_driver_t *drv_p;
-    struct sem_t sem;
+    /* Queued transactions. The first is being transferred. */
+    struct spi_transaction_t *head_p;
+    struct spi_transaction_t *tail_p;
+    /* Completes the simulated transfers. */
+    struct timer_t timer;
+    /* Number of times the hardware is configured. */
+    long starts;
 };
 
 struct spi_driver_t {
@@ -46,6 +53,9 @@ struct spi_driver_t {
     int speed;
     int cpol;
     int cpha;
+    uint8_t *rxbuf_p;               /* Transfer receive buffer or NULL. */
+    const uint8_t *txbuf_p;         /* Transfer transmit buffer or NULL. */
+    size_t size;                    /* Number of bytes to transfer. */
 };
 
 #endif
@@ -18,6 +18,26 @@
  * This file is part of the Simba project.
  */
 
+/**
+ * Called by the timer when the simulated transfer is complete.
+ */
+static void on_transfer_complete(void *arg_p)
+{
+    struct spi_device_t *dev_p = arg_p;
+    struct spi_driver_t *drv_p = dev_p->drv_p;
+
+    /* Loopback. The received data is the transmitted data. */
+    if (drv_p->rxbuf_p != NULL) {
+        if (drv_p->txbuf_p != NULL) {
+            memmove(drv_p->rxbuf_p, drv_p->txbuf_p, drv_p->size);
+        } else {
+            memset(drv_p->rxbuf_p, 0xff, drv_p->size);
+        }
+    }
+
+    transfer_complete_isr(dev_p, 0);
+}
+
 static int spi_port_module_init(void)
 {
     return (0);
@@ -36,6 +56,8 @@ static int spi_port_init(struct spi_driver_t *self_p,
 
 static int spi_port_start(struct spi_driver_t *self_p)
 {
+    self_p->dev_p->starts++;
+
     return (0);
 }
 
@@ -49,5 +71,21 @@ static ssize_t spi_port_transfer(struct spi_driver_t *self_p,
                                  const void *txbuf_p,
                                  size_t n)
 {
+    struct time_t timeout;
+
+    self_p->rxbuf_p = rxbuf_p;
+    self_p->txbuf_p = txbuf_p;
+    self_p->size = n;
+
+    /* The transfer is complete on next system tick. */
+    timeout.seconds = 0;
+    timeout.nanoseconds = 0;
+    timer_init(&self_p->dev_p->timer,
+               &timeout,
+               on_transfer_complete,
+               self_p->dev_p,
+               0);
+    timer_start_isr(&self_p->dev_p->timer);
+
     return (n);
 }
@@ -178,93 +178,47 @@ static const uint8_t INIT_PULSES = 10;
 static const uint8_t INIT_RETRY = 200;
 static const uint8_t RESPONSE_RETRY = 100;
 
-FAR static const uint16_t crctab[] = {
-    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
-    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
-    0x1231, 0x0210, 0x3273, 0x2252, 0x52b5, 0x4294, 0x72f7, 0x62d6,
-    0x9339, 0x8318, 0xb37b, 0xa35a, 0xd3bd, 0xc39c, 0xf3ff, 0xe3de,
-    0x2462, 0x3443, 0x0420, 0x1401, 0x64e6, 0x74c7, 0x44a4, 0x5485,
-    0xa56a, 0xb54b, 0x8528, 0x9509, 0xe5ee, 0xf5cf, 0xc5ac, 0xd58d,
-    0x3653, 0x2672, 0x1611, 0x0630, 0x76d7, 0x66f6, 0x5695, 0x46b4,
-    0xb75b, 0xa77a, 0x9719, 0x8738, 0xf7df, 0xe7fe, 0xd79d, 0xc7bc,
-    0x48c4, 0x58e5, 0x6886, 0x78a7, 0x0840, 0x1861, 0x2802, 0x3823,
-    0xc9cc, 0xd9ed, 0xe98e, 0xf9af, 0x8948, 0x9969, 0xa90a, 0xb92b,
-    0x5af5, 0x4ad4, 0x7ab7, 0x6a96, 0x1a71, 0x0a50, 0x3a33, 0x2a12,
-    0xdbfd, 0xcbdc, 0xfbbf, 0xeb9e, 0x9b79, 0x8b58, 0xbb3b, 0xab1a,
-    0x6ca6, 0x7c87, 0x4ce4, 0x5cc5, 0x2c22, 0x3c03, 0x0c60, 0x1c41,
-    0xedae, 0xfd8f, 0xcdec, 0xddcd, 0xad2a, 0xbd0b, 0x8d68, 0x9d49,
-    0x7e97, 0x6eb6, 0x5ed5, 0x4ef4, 0x3e13, 0x2e32, 0x1e51, 0x0e70,
-    0xff9f, 0xefbe, 0xdfdd, 0xcffc, 0xbf1b, 0xaf3a, 0x9f59, 0x8f78,
-    0x9188, 0x81a9, 0xb1ca, 0xa1eb, 0xd10c, 0xc12d, 0xf14e, 0xe16f,
-    0x1080, 0x00a1, 0x30c2, 0x20e3, 0x5004, 0x4025, 0x7046, 0x6067,
-    0x83b9, 0x9398, 0xa3fb, 0xb3da, 0xc33d, 0xd31c, 0xe37f, 0xf35e,
-    0x02b1, 0x1290, 0x22f3, 0x32d2, 0x4235, 0x5214, 0x6277, 0x7256,
-    0xb5ea, 0xa5cb, 0x95a8, 0x8589, 0xf56e, 0xe54f, 0xd52c, 0xc50d,
-    0x34e2, 0x24c3, 0x14a0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
-    0xa7db, 0xb7fa, 0x8799, 0x97b8, 0xe75f, 0xf77e, 0xc71d, 0xd73c,
-    0x26d3, 0x36f2, 0x0691, 0x16b0, 0x6657, 0x7676, 0x4615, 0x5634,
-    0xd94c, 0xc96d, 0xf90e, 0xe92f, 0x99c8, 0x89e9, 0xb98a, 0xa9ab,
-    0x5844, 0x4865, 0x7806, 0x6827, 0x18c0, 0x08e1, 0x3882, 0x28a3,
-    0xcb7d, 0xdb5c, 0xeb3f, 0xfb1e, 0x8bf9, 0x9bd8, 0xabbb, 0xbb9a,
-    0x4a75, 0x5a54, 0x6a37, 0x7a16, 0x0af1, 0x1ad0, 0x2ab3, 0x3a92,
-    0xfd2e, 0xed0f, 0xdd6c, 0xcd4d, 0xbdaa, 0xad8b, 0x9de8, 0x8dc9,
-    0x7c26, 0x6c07, 0x5c64, 0x4c45, 0x3ca2, 0x2c83, 0x1ce0, 0x0cc1,
-    0xef1f, 0xff3e, 0xcf5d, 0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8,
-    0x6e17, 0x7e36, 0x4e55, 0x5e74, 0x2e93, 0x3eb2, 0x0ed1, 0x1ef0
-};
-
-static uint8_t crc7(const void* buf, size_t size)
+static int wait_for_response(struct sd_driver_t *self_p,
+                             uint8_t mask,
+                             uint8_t value,
+                             uint8_t *response_p)
 {
-    uint8_t* bp = (uint8_t*) buf;
-    uint8_t crc = 0;
-    uint8_t data;
-
-    while (size--) {
-        data = *bp++;
-        data ^= crc << 1;
-
-        if (data & 0x80) {
-            data ^= 9;
+    do {
+        if (spi_get(self_p->spi_p, response_p) != 1) {
+            return (-1);
         }
+    } while ((*response_p & mask) != value);
 
-        crc = data ^ (crc & 0x78) ^ (crc << 4) ^ ((crc >> 3) & 0x0f);
-    }
-
-    crc = (crc << 1) ^ (crc << 4) ^ (crc & 0x70) ^ ((crc >> 3) & 0x0f);
-
-    return (crc | 1);
+    return (0);
 }
 
 /**
- * CRC-XMODEM calculation.
- *
- * Polynomial: x^16 + x^12 + x^5 + 1 (0x1021)
+ * Wait for the card to release the data line after a write or an
+ * erase. The card holds the line low while busy.
  */
-static uint16_t crc_xmodem_update(uint16_t crc, uint8_t data)
+static int wait_while_busy(struct sd_driver_t *self_p)
 {
-    return (crctab[((crc >> 8) ^ data) & 0xff] ^ (crc << 8));
+    uint8_t response;
+
+    return (wait_for_response(self_p, 0xff, 0xff, &response));
 }
 
-static uint16_t crc_xmodem(uint16_t crc, const uint8_t *data_p, size_t size)
+/**
+ * Write given command index and argument to the SD card.
+ */
+static int command_write(struct sd_driver_t *self_p,
+                         uint8_t index,
+                         uint32_t arg)
 {
-    while (size > 0) {
-        crc = crc_xmodem_update(crc, *data_p++);
-        size--;
-    }
+    /* Build request with command, argument and add check-sum (CRC7) */
+    struct command_t command;
 
-    return (crc);
-}
+    /* Initiate the command. */
+    command.index = (0x40 | index);
+    command.arg = htonl(arg);
+    command.crc = ((crc_7(0, &command, sizeof(command) - 1) << 1) | 1);
 
-static int wait_for_response(struct sd_driver_t *self_p,
-                             uint8_t mask,
-                             uint8_t value,
-                             uint8_t *response_p)
-{
-    do {
-        if (spi_get(self_p->spi_p, response_p) != 1) {
-            return (-1);
-        }
-    } while ((*response_p & mask) != value);
+    spi_write(self_p->spi_p, &command, sizeof(command));
 
     return (0);
 }
@@ -278,18 +232,10 @@ static int command_call(struct sd_driver_t *self_p,
                         uint32_t arg,
                         uint8_t *response_p)
 {
-    /* Build request with command, argument and add check-sum (CRC7) */
-    struct command_t command;
-
-    /* Initiate the command. */
-    command.index = (0x40 | index);
-    command.arg = htonl(arg);
-    command.crc = crc7(&command, sizeof(command) - 1);
-
     /* Issue the command; wait while busy. */
     wait_for_response(self_p, 0xff, 0xff, response_p);
 
-    spi_write(self_p->spi_p, &command, sizeof(command));
+    command_write(self_p, index, arg);
 
     /* Wait for the response. */
     wait_for_response(self_p, 0x80, 0x0, response_p);
@@ -319,20 +265,16 @@ static int read_command_response(struct sd_driver_t *self_p,
     return (0);
 }
 
-static ssize_t read(struct sd_driver_t *self_p,
-                    uint8_t index,
-                    uint32_t arg,
-                    void *dst_p,
-                    size_t size)
+/**
+ * Receive a data block and verify its checksum.
+ */
+static ssize_t read_data_block(struct sd_driver_t *self_p,
+                               void *dst_p,
+                               size_t size)
 {
     uint16_t real_crc, expected_crc;
     uint8_t response;
 
-    /* Issue read command. */
-    if (command_call(self_p, index, arg, &response) != 0) {
-        return (-1);
-    }
-
     /* Receive the data block start token. */
     wait_for_response(self_p, 0xff, TOKEN_DATA_START_BLOCK, &response);
 
@@ -351,6 +293,75 @@ static ssize_t read(struct sd_driver_t *self_p,
     }
 }
 
+/**
+ * Transmit a data block with given start token and wait for the card
+ * to program it.
+ */
+static ssize_t write_data_block(struct sd_driver_t *self_p,
+                                uint8_t token,
+                                const void *src_p)
+{
+    uint16_t crc;
+    uint8_t status;
+
+    /* Calculate the checksum of the data to send. */
+    crc = crc_xmodem(0, src_p, SD_BLOCK_SIZE);
+    crc = htons(crc);
+
+    spi_put(self_p->spi_p, token);
+
+    /* Write the data and it's checksum. */
+    spi_write(self_p->spi_p, src_p, SD_BLOCK_SIZE);
+    spi_write(self_p->spi_p, &crc, sizeof(crc));
+
+    spi_get(self_p->spi_p, &status);
+
+    if ((status & TOKEN_DATA_RES_MASK) != TOKEN_DATA_RES_ACCEPTED) {
+        return (-1);
+    }
+
+    /* Wait for the write operation to complete. */
+    wait_while_busy(self_p);
+
+    return (SD_BLOCK_SIZE);
+}
+
+/**
+ * Read the card status. Returns zero(0) if no error is reported.
+ */
+static int read_status(struct sd_driver_t *self_p)
+{
+    uint8_t status;
+
+    if (command_call(self_p, CMD_SEND_STATUS, 0, &status)) {
+        return (-1);
+    }
+
+    if (status != 0) {
+        return (-1);
+    }
+
+    spi_get(self_p->spi_p, &status);
+
+    return (status == 0 ? 0 : -1);
+}
+
+static ssize_t read(struct sd_driver_t *self_p,
+                    uint8_t index,
+                    uint32_t arg,
+                    void *dst_p,
+                    size_t size)
+{
+    uint8_t response;
+
+    /* Issue read command. */
+    if (command_call(self_p, index, arg, &response) != 0) {
+        return (-1);
+    }
+
+    return (read_data_block(self_p, dst_p, size));
+}
+
 int sd_init(struct sd_driver_t *self_p,
             struct spi_driver_t *spi_p)
 {
@@ -528,7 +539,6 @@ ssize_t sd_write_block(struct sd_driver_t *self_p,
                        uint32_t dst_block,
                        const void *src_p)
 {
-    uint16_t crc;
     uint8_t status;
 
     /* Check for byte address adjustment. */
@@ -536,39 +546,163 @@ ssize_t sd_write_block(struct sd_driver_t *self_p,
         dst_block <<= 9;
     }
 
-    /* Calculate the checksum of the reseiced data. */
-    crc = crc_xmodem(0, src_p, SD_BLOCK_SIZE);
-    crc = htons(crc);
-
-    /* Issue write block command, transfer block, calculate check sum. */
+    /* Issue write block command and transfer the block. */
     if (command_call(self_p, CMD_WRITE_BLOCK, dst_block, &status)) {
         return (-1);
     }
 
-    spi_put(self_p->spi_p, TOKEN_DATA_START_BLOCK);
+    if (status != 0) {
+        return (-1);
+    }
 
-    /* Write the data and it's checksum. */
-    spi_write(self_p->spi_p, src_p, SD_BLOCK_SIZE);
-    spi_write(self_p->spi_p, &crc, sizeof(crc));
+    if (write_data_block(self_p,
+                         TOKEN_DATA_START_BLOCK,
+                         src_p) != SD_BLOCK_SIZE) {
+        return (-1);
+    }
 
-    spi_get(self_p->spi_p, &status);
+    if (read_status(self_p) != 0) {
+        return (-1);
+    }
 
-    if ((status & TOKEN_DATA_RES_MASK) != TOKEN_DATA_RES_ACCEPTED) {
+    return (SD_BLOCK_SIZE);
+}
+
+ssize_t sd_read_blocks(struct sd_driver_t *self_p,
+                       void *dst_p,
+                       uint32_t src_block,
+                       size_t count)
+{
+    uint8_t *u8_dst_p;
+    uint8_t response;
+    size_t i;
+    ssize_t res;
+
+    /* Nothing to transfer. CMD18 without a data phase is a protocol
+       error. */
+    if (count == 0) {
+        return (0);
+    }
+
+    /* A single block read does not need the stop command. */
+    if (count == 1) {
+        return (sd_read_block(self_p, dst_p, src_block));
+    }
+
+    if (self_p->type != TYPE_SDHC) {
+        src_block <<= 9;
+    }
+
+    if (command_call(self_p,
+                     CMD_READ_MULTIPLE_BLOCK,
+                     src_block,
+                     &response) != 0) {
         return (-1);
     }
 
-    /* Wait for the write operation to complete and check status */
-    wait_for_response(self_p, 0xff, 0x0, &status);
+    if (response != 0) {
+        return (-1);
+    }
 
-    if (command_call(self_p, CMD_SEND_STATUS, 0, &status)) {
+    u8_dst_p = dst_p;
+    res = (SD_BLOCK_SIZE * count);
+
+    for (i = 0; i < count; i++) {
+        if (read_data_block(self_p,
+                            u8_dst_p,
+                            SD_BLOCK_SIZE) != SD_BLOCK_SIZE) {
+            res = -1;
+            break;
+        }
+
+        u8_dst_p += SD_BLOCK_SIZE;
+    }
+
+    /* Stop the transmission. The card is still sending data, so there
+       is no wait for idle before the command, and the stuff byte
+       after it is discarded. */
+    command_write(self_p, CMD_STOP_TRANSMISSION, 0);
+    spi_get(self_p->spi_p, &response);
+    wait_for_response(self_p, 0x80, 0x0, &response);
+    wait_while_busy(self_p);
+
+    if (response != 0) {
         return (-1);
     }
 
-    if (status != 0) {
+    return (res);
+}
+
+ssize_t sd_write_blocks(struct sd_driver_t *self_p,
+                        uint32_t dst_block,
+                        const void *src_p,
+                        size_t count)
+{
+    const uint8_t *u8_src_p;
+    uint8_t response;
+    size_t i;
+    ssize_t res;
+
+    /* Nothing to transfer. CMD25 without a data phase is a protocol
+       error. */
+    if (count == 0) {
+        return (0);
+    }
+
+    if (count == 1) {
+        return (sd_write_block(self_p, dst_block, src_p));
+    }
+
+    if (self_p->type != TYPE_SDHC) {
+        dst_block <<= 9;
+    }
+
+    /* Tell the card how many blocks to erase before the write. */
+    if (application_command_call(self_p,
+                                 ACMD_SET_WR_BLK_ERASE_COUNT,
+                                 count,
+                                 &response) != 0) {
         return (-1);
     }
 
-    spi_get(self_p->spi_p, &status);
+    if (response != 0) {
+        return (-1);
+    }
+
+    if (command_call(self_p,
+                     CMD_WRITE_MULTIPLE_BLOCK,
+                     dst_block,
+                     &response) != 0) {
+        return (-1);
+    }
+
+    if (response != 0) {
+        return (-1);
+    }
+
+    u8_src_p = src_p;
+    res = (SD_BLOCK_SIZE * count);
+
+    for (i = 0; i < count; i++) {
+        if (write_data_block(self_p,
+                             TOKEN_WRITE_MULTIPLE_TOKEN,
+                             u8_src_p) != SD_BLOCK_SIZE) {
+            res = -1;
+            break;
+        }
+
+        u8_src_p += SD_BLOCK_SIZE;
+    }
+
+    /* End the transmission. The busy signal starts one byte after the
+       stop token. */
+    spi_put(self_p->spi_p, TOKEN_STOP_TRAN_TOKEN);
+    spi_get(self_p->spi_p, &response);
+    wait_while_busy(self_p);
+
+    if (read_status(self_p) != 0) {
+        return (-1);
+    }
 
-    return (status == 0 ? SD_BLOCK_SIZE : -1);
+    return (res);
 }
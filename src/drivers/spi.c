@@ -20,8 +20,118 @@
 
 #include "simba.h"
 
+static void transfer_complete_isr(struct spi_device_t *dev_p, int res);
+
 #include "spi_port.i"
 
+/**
+ * Remove the transaction first in the queue of given device and
+ * notify its owner. Returns the next transaction in the queue, if
+ * any.
+ */
+static struct spi_transaction_t *transfer_end_isr(struct spi_device_t *dev_p,
+                                                  int res)
+{
+    struct spi_transaction_t *transaction_p;
+    struct spi_transaction_t *next_p;
+
+    transaction_p = dev_p->head_p;
+
+    if (transaction_p->drv_p->mode == SPI_MODE_MASTER) {
+        pin_write(&transaction_p->drv_p->ss, 1);
+    }
+
+    /* Remove the transaction from the queue. */
+    next_p = transaction_p->next_p;
+    dev_p->head_p = next_p;
+
+    if (next_p == NULL) {
+        dev_p->tail_p = NULL;
+    }
+
+    if (res == 0) {
+        transaction_p->res = transaction_p->size;
+    } else {
+        transaction_p->res = res;
+    }
+
+    transaction_p->done = 1;
+
+    /* Resume the waiter before calling the callback, which may queue
+       the transaction again and reset its result. The result is
+       passed to the waiter. */
+    if (transaction_p->thrd_p != NULL) {
+        thrd_resume_isr(transaction_p->thrd_p, transaction_p->res);
+        transaction_p->thrd_p = NULL;
+    }
+
+    /* Transactions queued by the callback are not started as the
+       queue is not empty. */
+    if (transaction_p->callback != NULL) {
+        transaction_p->callback(transaction_p, transaction_p->arg_p);
+    }
+
+    return (next_p);
+}
+
+/**
+ * Start the transaction first in the queue of given device. Empty
+ * transactions and transactions the port fails to start are ended
+ * immediately, and the next one in the queue is started instead.
+ */
+static void transfer_start_isr(struct spi_device_t *dev_p)
+{
+    struct spi_transaction_t *transaction_p;
+    struct spi_driver_t *drv_p;
+    ssize_t res;
+
+    do {
+        transaction_p = dev_p->head_p;
+        drv_p = transaction_p->drv_p;
+
+        /* Configure and start SPI hardware with driver configuration. */
+        if (dev_p->drv_p != drv_p) {
+            if (dev_p->drv_p != NULL) {
+                spi_port_stop(dev_p->drv_p);
+            }
+
+            dev_p->drv_p = drv_p;
+            spi_port_start(drv_p);
+        }
+
+        if (transaction_p->size == 0) {
+            res = 0;
+        } else {
+            if (drv_p->mode == SPI_MODE_MASTER) {
+                pin_write(&drv_p->ss, 0);
+            }
+
+            res = spi_port_transfer(drv_p,
+                                    transaction_p->rxbuf_p,
+                                    transaction_p->txbuf_p,
+                                    transaction_p->size);
+
+            /* Started. The port ends the transaction by calling
+               transfer_complete_isr(). */
+            if (res >= 0) {
+                return;
+            }
+        }
+    } while (transfer_end_isr(dev_p, res) != NULL);
+}
+
+/**
+ * Called by the port when the transfer of the first transaction in
+ * the queue is complete. `res` is zero(0) on success or a negative
+ * error code.
+ */
+static void transfer_complete_isr(struct spi_device_t *dev_p, int res)
+{
+    if (transfer_end_isr(dev_p, res) != NULL) {
+        transfer_start_isr(dev_p);
+    }
+}
+
 int spi_module_init(void)
 {
     return (spi_port_module_init());
@@ -44,36 +154,100 @@ int spi_init(struct spi_driver_t *self_p,
     return (spi_port_init(self_p, dev_p, ss_pin_p, mode, speed, cpol, cpha));
 }
 
-ssize_t spi_transfer(struct spi_driver_t *self_p,
-                     void *rxbuf_p,
-                     const void *txbuf_p,
-                     size_t size)
+int spi_transaction_init(struct spi_transaction_t *transaction_p,
+                         struct spi_driver_t *drv_p,
+                         void *rxbuf_p,
+                         const void *txbuf_p,
+                         size_t size,
+                         spi_transaction_callback_t callback,
+                         void *arg_p)
 {
-    sem_get(&self_p->dev_p->sem, NULL);
+    transaction_p->drv_p = drv_p;
+    transaction_p->rxbuf_p = rxbuf_p;
+    transaction_p->txbuf_p = txbuf_p;
+    transaction_p->size = size;
+    transaction_p->callback = callback;
+    transaction_p->arg_p = arg_p;
+    transaction_p->res = 0;
+    transaction_p->done = 0;
+    transaction_p->thrd_p = NULL;
+    transaction_p->next_p = NULL;
 
-    /* Configure and start SPI hardware with driver configuration. */
-    if (self_p->dev_p->drv_p != self_p) {
-        if (self_p->dev_p->drv_p != NULL) {
-            spi_port_stop(self_p->dev_p->drv_p);
-        }
+    return (0);
+}
 
-        self_p->dev_p->drv_p = self_p;
-        spi_port_start(self_p);
-    }
+int spi_transfer_async_isr(struct spi_transaction_t *transaction_p)
+{
+    struct spi_device_t *dev_p;
 
-    if (self_p->mode == SPI_MODE_MASTER) {
-        pin_write(&self_p->ss, 0);
+    dev_p = transaction_p->drv_p->dev_p;
+    transaction_p->res = 0;
+    transaction_p->done = 0;
+    transaction_p->next_p = NULL;
+
+    /* Append to the queue, and start the transfer if the device is
+       idle. */
+    if (dev_p->head_p == NULL) {
+        dev_p->head_p = transaction_p;
+        dev_p->tail_p = transaction_p;
+        transfer_start_isr(dev_p);
+    } else {
+        dev_p->tail_p->next_p = transaction_p;
+        dev_p->tail_p = transaction_p;
     }
 
-    size = spi_port_transfer(self_p, rxbuf_p, txbuf_p, size);
+    return (0);
+}
+
+int spi_transfer_async(struct spi_transaction_t *transaction_p)
+{
+    int res;
+
+    sys_lock();
+    res = spi_transfer_async_isr(transaction_p);
+    sys_unlock();
+
+    return (res);
+}
+
+ssize_t spi_transfer_wait(struct spi_transaction_t *transaction_p)
+{
+    ssize_t res;
 
-    if (self_p->mode == SPI_MODE_MASTER) {
-        pin_write(&self_p->ss, 1);
+    sys_lock();
+
+    if (transaction_p->done) {
+        res = transaction_p->res;
+    } else {
+        transaction_p->thrd_p = thrd_self();
+        res = thrd_suspend_isr(NULL);
     }
 
-    sem_put(&self_p->dev_p->sem, 1);
+    sys_unlock();
+
+    return (res);
+}
+
+ssize_t spi_transfer(struct spi_driver_t *self_p,
+                     void *rxbuf_p,
+                     const void *txbuf_p,
+                     size_t size)
+{
+    struct spi_transaction_t transaction;
+
+    spi_transaction_init(&transaction,
+                         self_p,
+                         rxbuf_p,
+                         txbuf_p,
+                         size,
+                         NULL,
+                         NULL);
+
+    if (spi_transfer_async(&transaction) != 0) {
+        return (-1);
+    }
 
-    return (size);
+    return (spi_transfer_wait(&transaction));
 }
 
 ssize_t spi_read(struct spi_driver_t *self_p,
@@ -96,7 +96,7 @@ struct cbw_t {
                                 * device shall ignore the content of
                                 * the CBWCB field past the byte at
                                 * offset (15 + bCBWCBLength - 1). */
-};
+} PACKED;
 
 #define CSW_SIGNATURE 0x53425355
 
@@ -148,10 +148,11 @@ struct csw_t {
                      * 02h             Phase Error
                      * 03h and 04h     Reserved (Obsolete)
                      * 05h to FFh      Reserved */
-};
+} PACKED;
 
 #define SCSI_CDB_OPERATION_CODE_TEST_UNIT_READY 0x00
 #define SCSI_CDB_OPERATION_CODE_INQUIRY         0x12
+#define SCSI_CDB_OPERATION_CODE_READ_CAPACITY_10 0x25
 #define SCSI_CDB_OPERATION_CODE_READ_10         0x28
 #define SCSI_CDB_OPERATION_CODE_WRITE_10        0x2a
 
@@ -185,7 +186,21 @@ struct scsi_cdb_read_t {
     uint8_t group_number : 5;
     uint16_t transfer_length;
     uint8_t control;    
-};
+} PACKED;
+
+struct scsi_cdb_read_capacity_t {
+    uint8_t operation_code;
+    uint8_t reserved0;
+    uint32_t logical_block_address;
+    uint8_t reserved1[2];
+    uint8_t pmi;
+    uint8_t control;
+} PACKED;
+
+struct scsi_cdb_read_capacity_data_t {
+    uint32_t logical_block_address; /* Address of the last block. */
+    uint32_t block_length;
+} PACKED;
 
 struct scsi_cdb_inquiry_data_t {
     uint8_t peripheral_qualifier : 3;
@@ -200,6 +215,221 @@ struct scsi_cdb_inquiry_data_t {
     uint8_t product_id[16];
 };
 
+/* Pipes used for the bulk transfers. */
+#define PIPE_BULK_IN  1
+#define PIPE_BULK_OUT 2
+
+/* Maximum number of blocks in one READ(10) or WRITE(10) command. */
+#define TRANSFER_LENGTH_MAX 0xffff
+
+#define BLOCK_SIZE USB_HOST_CLASS_MASS_STORAGE_BLOCK_SIZE
+
+/* Tag of the next command. */
+static uint32_t next_tag = 0;
+
+/**
+ * Get the maximum packet size of the bulk-in endpoint of given
+ * device. It is usually 512 bytes for high speed devices and 64
+ * bytes for full speed devices.
+ */
+static size_t get_bulk_max_packet_size(struct usb_host_device_t *device_p)
+{
+    struct usb_descriptor_endpoint_t *endpoint_p;
+    int i;
+
+    for (i = 1; i < 16; i++) {
+        endpoint_p = usb_desc_get_endpoint(device_p->descriptors.buf,
+                                           device_p->descriptors.size,
+                                           1,
+                                           0,
+                                           i);
+
+        if (endpoint_p == NULL) {
+            continue;
+        }
+
+        if ((endpoint_p->endpoint_address & 0x80)
+            && ((endpoint_p->attributes & 0x3) == USB_PIPE_TYPE_BULK)) {
+            return (endpoint_p->max_packet_size & 0x7ff);
+        }
+    }
+
+    return (64);
+}
+
+/**
+ * Initiate given Command Block Wrapper and return a pointer to its
+ * command block.
+ */
+static void *cbw_init(struct cbw_t *cbw_p,
+                      int flags,
+                      size_t command_block_length)
+{
+    memset(cbw_p, 0, sizeof(*cbw_p));
+    cbw_p->signature = CBW_SIGNATURE;
+    cbw_p->flags = flags;
+    cbw_p->lun = 0;
+    cbw_p->command_block_length = command_block_length;
+
+    return (cbw_p->command_block);
+}
+
+/**
+ * Execute given command. The Command Block Wrapper is written to the
+ * device, then the data is transferred in the direction given by the
+ * wrapper flags, and finally the Command Status Wrapper is read from
+ * the device.
+ *
+ * @return Number of transferred bytes or negative error code.
+ */
+static ssize_t command_transfer(struct usb_host_device_t *device_p,
+                                struct cbw_t *cbw_p,
+                                void *buf_p,
+                                size_t size)
+{
+    struct csw_t csw;
+    ssize_t res;
+
+    device_p->max_packet_size = get_bulk_max_packet_size(device_p);
+
+    cbw_p->tag = next_tag++;
+    cbw_p->data_transfer_length = size;
+
+    /* Write the Command Block Wrapper to the device. */
+    if (usb_host_device_write(device_p, PIPE_BULK_OUT, cbw_p, sizeof(*cbw_p))
+        != sizeof(*cbw_p)) {
+        std_printf(FSTR("failed to write the command block wrapper.\r\n"));
+
+        return (-1);
+    }
+
+    /* Transfer the data. */
+    if (size > 0) {
+        if (cbw_p->flags & 0x80) {
+            res = usb_host_device_read(device_p, PIPE_BULK_IN, buf_p, size);
+        } else {
+            res = usb_host_device_write(device_p, PIPE_BULK_OUT, buf_p, size);
+        }
+
+        if (res != size) {
+            std_printf(FSTR("Failed to transfer data.\r\n"));
+
+            return (-1);
+        }
+    }
+
+    /* Read the Comand Status Wrapper from the device. */
+    if (usb_host_device_read(device_p, PIPE_BULK_IN, &csw, sizeof(csw))
+        != sizeof(csw)) {
+        return (-1);
+    }
+
+    if ((csw.signature != CSW_SIGNATURE) || (csw.tag != cbw_p->tag)) {
+        return (-1);
+    }
+
+    if (csw.status != CSW_STATUS_PASSED) {
+        std_printf(FSTR("status = %d\r\n"), csw.status);
+
+        return (-1);
+    }
+
+    return (size - csw.data_residue);
+}
+
+/**
+ * Read or write given number of blocks with a single READ(10) or
+ * WRITE(10) command. Both commands have the same layout.
+ */
+static ssize_t scsi_read_write_10(struct usb_host_device_t *device_p,
+                                  int operation_code,
+                                  void *buf_p,
+                                  uint32_t block,
+                                  size_t count)
+{
+    struct cbw_t cbw;
+    struct scsi_cdb_read_t *cdb_p;
+    int flags;
+
+    if (operation_code == SCSI_CDB_OPERATION_CODE_READ_10) {
+        flags = 0x80;
+    } else {
+        flags = 0x00;
+    }
+
+    cdb_p = cbw_init(&cbw, flags, sizeof(*cdb_p));
+    cdb_p->operation_code = operation_code;
+    cdb_p->logical_block_address = htonl(block);
+    cdb_p->transfer_length = htons(count);
+
+    return (command_transfer(device_p, &cbw, buf_p, BLOCK_SIZE * count));
+}
+
+static int scsi_read_capacity(struct usb_host_device_t *device_p,
+                              uint32_t *number_of_blocks_p)
+{
+    struct cbw_t cbw;
+    struct scsi_cdb_read_capacity_t *cdb_p;
+    struct scsi_cdb_read_capacity_data_t data;
+
+    cdb_p = cbw_init(&cbw, 0x80, sizeof(*cdb_p));
+    cdb_p->operation_code = SCSI_CDB_OPERATION_CODE_READ_CAPACITY_10;
+
+    if (command_transfer(device_p, &cbw, &data, sizeof(data))
+        != sizeof(data)) {
+        return (-1);
+    }
+
+    /* Only 512 bytes blocks are supported. */
+    if (ntohl(data.block_length) != BLOCK_SIZE) {
+        return (-1);
+    }
+
+    *number_of_blocks_p = (ntohl(data.logical_block_address) + 1);
+
+    return (0);
+}
+
+/**
+ * Returns true(1) if given block is in the read-ahead buffer.
+ */
+static int read_ahead_contains(struct usb_host_class_mass_storage_device_t *self_p,
+                               uint32_t block)
+{
+    return ((block >= self_p->read_ahead.block)
+            && (block < self_p->read_ahead.block + self_p->read_ahead.count));
+}
+
+/**
+ * Fill the read-ahead buffer with the blocks starting at given block.
+ */
+static int read_ahead_fill(struct usb_host_class_mass_storage_device_t *self_p,
+                           uint32_t block)
+{
+    size_t count;
+
+    count = self_p->read_ahead.length;
+
+    if (count > self_p->number_of_blocks - block) {
+        count = (self_p->number_of_blocks - block);
+    }
+
+    self_p->read_ahead.count = 0;
+
+    if (scsi_read_write_10(self_p->device_p,
+                           SCSI_CDB_OPERATION_CODE_READ_10,
+                           self_p->read_ahead.buf_p,
+                           block,
+                           count) != BLOCK_SIZE * count) {
+        return (-1);
+    }
+
+    self_p->read_ahead.block = block;
+    self_p->read_ahead.count = count;
+
+    return (0);
+}
+
 static int get_max_lun(struct usb_host_device_t *device_p)
 {
     struct usb_setup_t setup;
@@ -235,103 +465,36 @@ static int get_max_lun(struct usb_host_device_t *device_p)
 static int scsi_get_inquiry(struct usb_host_device_t *device_p)
 {
     struct cbw_t cbw;
-    struct csw_t csw;
     struct scsi_cdb_inquiry_t *cdb_p;
     struct scsi_cdb_inquiry_data_t inquiry_data;
 
     std_printf(FSTR("get inquiry\r\n"));
 
-    device_p->max_packet_size = 512;
-
-    /* Initiate the Command Block Wrapper. */
-    memset(&cbw, 0, sizeof(cbw));
-    cbw.signature = CBW_SIGNATURE;
-    cbw.tag = (uint32_t)device_p;
-    cbw.data_transfer_length = sizeof(inquiry_data);
-    cbw.flags = 0x80;
-    cbw.lun = 0;
-    cbw.command_block_length = sizeof(*cdb_p);
-
-    cdb_p = (struct scsi_cdb_inquiry_t *)cbw.command_block;
+    cdb_p = cbw_init(&cbw, 0x80, sizeof(*cdb_p));
     cdb_p->operation_code = SCSI_CDB_OPERATION_CODE_INQUIRY;
     cdb_p->allocation_length = sizeof(inquiry_data);
 
-    /* Write the Command Block Wrapper to the device. */
-    if (usb_host_device_write(device_p, 2, &cbw, sizeof(cbw))
-        != sizeof(cbw)) {
-        std_printf(FSTR("failed to write the command block wrapper.\r\n"));
-
-        return (-1);
-    }
-
-    /* Read the data from the device. */
-    if (usb_host_device_read(device_p, 1, &inquiry_data, sizeof(inquiry_data))
+    if (command_transfer(device_p, &cbw, &inquiry_data, sizeof(inquiry_data))
         != sizeof(inquiry_data)) {
-        std_printf(FSTR("Failed to read data.\r\n"));
-
-        return (-1);
-    }
-
-    /* Read the Comand Status Wrapper from the device. */
-    if (usb_host_device_read(device_p, 1, &csw, sizeof(csw))
-        != sizeof(csw)) {
-        return (-1);
-    }
-
-    if (csw.status != CSW_STATUS_PASSED) {
-        std_printf(FSTR("status = %d\r\n"), csw.status);
-
         return (-1);
     }
 
     std_printf(FSTR("version = %d\r\n"), inquiry_data.version);
 
-    return (csw.data_residue);
+    return (0);
 }
 
 static int scsi_test_unit_ready(struct usb_host_device_t *device_p)
 {
     struct cbw_t cbw;
-    struct csw_t csw;
     struct scsi_cdb_test_unit_ready_t *cdb_p;
 
     std_printf(FSTR("test unit ready\r\n"));
 
-    device_p->max_packet_size = 512;
-
-    /* Initiate the Command Block Wrapper. */
-    memset(&cbw, 0, sizeof(cbw));
-    cbw.signature = CBW_SIGNATURE;
-    cbw.tag = (uint32_t)device_p;
-    cbw.data_transfer_length = 0;
-    cbw.flags = 0x80;
-    cbw.lun = 0;
-    cbw.command_block_length = sizeof(*cdb_p);
-
-    cdb_p = (struct scsi_cdb_test_unit_ready_t *)cbw.command_block;
+    cdb_p = cbw_init(&cbw, 0x80, sizeof(*cdb_p));
     cdb_p->operation_code = SCSI_CDB_OPERATION_CODE_TEST_UNIT_READY;
 
-    /* Write the Command Block Wrapper to the device. */
-    if (usb_host_device_write(device_p, 2, &cbw, sizeof(cbw))
-        != sizeof(cbw)) {
-        std_printf(FSTR("failed to write the command block wrapper.\r\n"));
-
-        return (-1);
-    }
-
-    /* Read the Comand Status Wrapper from the device. */
-    if (usb_host_device_read(device_p, 1, &csw, sizeof(csw))
-        != sizeof(csw)) {
-        return (-1);
-    }
-
-    if (csw.status != CSW_STATUS_PASSED) {
-        std_printf(FSTR("status = %d\r\n"), csw.status);
-
-        return (-1);
-    }
-
-    return (csw.data_residue);
+    return (command_transfer(device_p, &cbw, NULL, 0));
 }
 
 static int supports(struct usb_host_device_t *device_p)
@@ -415,52 +578,198 @@ ssize_t usb_host_class_mass_storage_device_read(
     size_t address,
     size_t size)
 {
-    struct cbw_t cbw;
-    struct csw_t csw;
-    struct scsi_cdb_read_t *cdb_p;
+    return (scsi_read_write_10(device_p,
+                               SCSI_CDB_OPERATION_CODE_READ_10,
+                               buf_p,
+                               address / BLOCK_SIZE,
+                               size / BLOCK_SIZE));
+}
+
+ssize_t usb_host_class_mass_storage_device_write(
+    struct usb_host_device_t *device_p,
+    const void *buf_p,
+    size_t address,
+    size_t size)
+{
+    return (scsi_read_write_10(device_p,
+                               SCSI_CDB_OPERATION_CODE_WRITE_10,
+                               (void *)buf_p,
+                               address / BLOCK_SIZE,
+                               size / BLOCK_SIZE));
+}
 
-    device_p->max_packet_size = 512;
+int usb_host_class_mass_storage_device_init(
+    struct usb_host_class_mass_storage_device_t *self_p,
+    struct usb_host_device_t *device_p,
+    void *buf_p,
+    size_t size)
+{
+    self_p->device_p = device_p;
+    self_p->number_of_blocks = 0;
+    self_p->read_ahead.buf_p = buf_p;
+    self_p->read_ahead.length = (size / BLOCK_SIZE);
+    self_p->read_ahead.block = 0;
+    self_p->read_ahead.count = 0;
+    self_p->read_ahead.next_block = 0;
 
-    /* Initiate the Command Block Wrapper. */
-    memset(&cbw, 0, sizeof(cbw));
-    cbw.signature = CBW_SIGNATURE;
-    cbw.tag = (uint32_t)device_p;
-    cbw.data_transfer_length = size;
-    cbw.flags = 0x80;
-    cbw.lun = 0;
-    cbw.command_block_length = sizeof(*cdb_p);
+    return (0);
+}
 
-    cdb_p = (struct scsi_cdb_read_t *)cbw.command_block;
-    cdb_p->operation_code = SCSI_CDB_OPERATION_CODE_READ_10;
-    cdb_p->logical_block_address = htonl(address / 512);
-    cdb_p->transfer_length = htons(size / 512);
+int usb_host_class_mass_storage_device_start(
+    struct usb_host_class_mass_storage_device_t *self_p)
+{
+    self_p->read_ahead.count = 0;
 
-    /* Write the Command Block Wrapper to the device. */
-    if (usb_host_device_write(device_p, 2, &cbw, sizeof(cbw))
-        != sizeof(cbw)) {
-        std_printf(FSTR("failed to write the command block wrapper.\r\n"));
+    return (scsi_read_capacity(self_p->device_p, &self_p->number_of_blocks));
+}
 
-        return (-1);
+ssize_t usb_host_class_mass_storage_device_read_block(
+    struct usb_host_class_mass_storage_device_t *self_p,
+    void *dst_p,
+    uint32_t src_block)
+{
+    return (usb_host_class_mass_storage_device_read_blocks(self_p,
+                                                           dst_p,
+                                                           src_block,
+                                                           1));
+}
+
+ssize_t usb_host_class_mass_storage_device_write_block(
+    struct usb_host_class_mass_storage_device_t *self_p,
+    uint32_t dst_block,
+    const void *src_p)
+{
+    return (usb_host_class_mass_storage_device_write_blocks(self_p,
+                                                            dst_block,
+                                                            src_p,
+                                                            1));
+}
+
+ssize_t usb_host_class_mass_storage_device_read_blocks(
+    struct usb_host_class_mass_storage_device_t *self_p,
+    void *dst_p,
+    uint32_t src_block,
+    size_t count)
+{
+    uint8_t *u8_dst_p;
+    uint32_t block;
+    size_t left;
+    size_t n;
+    size_t offset;
+
+    if ((src_block >= self_p->number_of_blocks)
+        || (count > self_p->number_of_blocks - src_block)) {
+        return (-EINVAL);
     }
 
-    /* Read the dat from the device. */
-    if (usb_host_device_read(device_p, 1, buf_p, size) != size) {
-        std_printf(FSTR("Failed to read data.\r\n"));
+    u8_dst_p = dst_p;
+    block = src_block;
+    left = count;
+
+    while (left > 0) {
+        if (read_ahead_contains(self_p, block)) {
+            /* Copy from the read-ahead buffer. */
+            offset = (block - self_p->read_ahead.block);
+            n = (self_p->read_ahead.count - offset);
+
+            if (n > left) {
+                n = left;
+            }
+
+            memcpy(u8_dst_p,
+                   &self_p->read_ahead.buf_p[BLOCK_SIZE * offset],
+                   BLOCK_SIZE * n);
+        } else if ((block == self_p->read_ahead.next_block)
+                   && (left < self_p->read_ahead.length)) {
+            /* A sequential read smaller than the read-ahead
+               buffer. Read the following blocks as well with a
+               single command to keep the bulk-in endpoint busy. */
+            if (read_ahead_fill(self_p, block) != 0) {
+                return (-1);
+            }
+
+            continue;
+        } else {
+            /* Large or random reads go directly to the destination
+               buffer. */
+            n = left;
+
+            if (n > TRANSFER_LENGTH_MAX) {
+                n = TRANSFER_LENGTH_MAX;
+            }
+
+            if (scsi_read_write_10(self_p->device_p,
+                                   SCSI_CDB_OPERATION_CODE_READ_10,
+                                   u8_dst_p,
+                                   block,
+                                   n) != BLOCK_SIZE * n) {
+                return (-1);
+            }
+        }
+
+        u8_dst_p += (BLOCK_SIZE * n);
+        block += n;
+        left -= n;
+    }
 
-        return (-1);
+    self_p->read_ahead.next_block = block;
+
+    return (BLOCK_SIZE * count);
+}
+
+ssize_t usb_host_class_mass_storage_device_write_blocks(
+    struct usb_host_class_mass_storage_device_t *self_p,
+    uint32_t dst_block,
+    const void *src_p,
+    size_t count)
+{
+    const uint8_t *u8_src_p;
+    uint32_t block;
+    size_t left;
+    size_t n;
+
+    if ((dst_block >= self_p->number_of_blocks)
+        || (count > self_p->number_of_blocks - dst_block)) {
+        return (-EINVAL);
     }
 
-    /* Read the Comand Status Wrapper from the device. */
-    if (usb_host_device_read(device_p, 1, &csw, sizeof(csw))
-        != sizeof(csw)) {
-        return (-1);
+    u8_src_p = src_p;
+
+    /* Keep the read-ahead buffer up to date. */
+    for (block = dst_block; block < dst_block + count; block++) {
+        if (read_ahead_contains(self_p, block)) {
+            memcpy(&self_p->read_ahead.buf_p[BLOCK_SIZE
+                                             * (block - self_p->read_ahead.block)],
+                   &u8_src_p[BLOCK_SIZE * (block - dst_block)],
+                   BLOCK_SIZE);
+        }
     }
 
-    if (csw.status != CSW_STATUS_PASSED) {
-        std_printf(FSTR("status = %d\r\n"), csw.status);
+    block = dst_block;
+    left = count;
 
-        return (-1);
+    while (left > 0) {
+        n = left;
+
+        if (n > TRANSFER_LENGTH_MAX) {
+            n = TRANSFER_LENGTH_MAX;
+        }
+
+        if (scsi_read_write_10(self_p->device_p,
+                               SCSI_CDB_OPERATION_CODE_WRITE_10,
+                               (void *)u8_src_p,
+                               block,
+                               n) != BLOCK_SIZE * n) {
+            /* The device content is unknown. */
+            self_p->read_ahead.count = 0;
+
+            return (-1);
+        }
+
+        u8_src_p += (BLOCK_SIZE * n);
+        block += n;
+        left -= n;
     }
 
-    return (size - csw.data_residue);
+    return (BLOCK_SIZE * count);
 }
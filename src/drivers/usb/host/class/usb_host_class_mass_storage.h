@@ -23,8 +23,27 @@
 
 #include "simba.h"
 
+/** Size of a block on a mass storage device. */
+#define USB_HOST_CLASS_MASS_STORAGE_BLOCK_SIZE 512
+
+/**
+ * A mass storage device accessed as a block device. Small sequential
+ * reads are served from a read-ahead buffer that is filled by a
+ * single multiple block command.
+ */
 struct usb_host_class_mass_storage_device_t {
-    uint8_t buf[1];
+    struct usb_host_device_t *device_p;
+    uint32_t number_of_blocks;
+    struct {
+        uint8_t *buf_p;
+        /* Size of the buffer in blocks. */
+        size_t length;
+        /* First block and number of blocks in the buffer. */
+        uint32_t block;
+        size_t count;
+        /* The block after the last read block. */
+        uint32_t next_block;
+    } read_ahead;
 };
 
 struct usb_host_class_mass_storage_driver_t {
@@ -46,10 +65,140 @@ int usb_host_class_mass_storage_start(struct usb_host_class_mass_storage_driver_
 
 int usb_host_class_mass_storage_stop(struct usb_host_class_mass_storage_driver_t *self_p);
 
+/**
+ * Read data from given mass storage device using a single READ(10)
+ * command.
+ *
+ * @param[in] device_p Enumerated mass storage device.
+ * @param[out] buf_p Buffer to read into.
+ * @param[in] address Address to read from. Must be a multiple of
+ *                    the block size.
+ * @param[in] size Number of bytes to read. Must be a multiple of the
+ *                 block size.
+ *
+ * @return Number of read bytes or negative error code.
+ */
 ssize_t usb_host_class_mass_storage_device_read(
     struct usb_host_device_t *device_p,
     void *buf_p,
     size_t address,
     size_t size);
 
+/**
+ * Write data to given mass storage device using a single WRITE(10)
+ * command.
+ *
+ * @param[in] device_p Enumerated mass storage device.
+ * @param[in] buf_p Buffer to write.
+ * @param[in] address Address to write to. Must be a multiple of the
+ *                    block size.
+ * @param[in] size Number of bytes to write. Must be a multiple of
+ *                 the block size.
+ *
+ * @return Number of written bytes or negative error code.
+ */
+ssize_t usb_host_class_mass_storage_device_write(
+    struct usb_host_device_t *device_p,
+    const void *buf_p,
+    size_t address,
+    size_t size);
+
+/**
+ * Initialize given block device object.
+ *
+ * @param[out] self_p Block device object to initialize.
+ * @param[in] device_p Enumerated mass storage device.
+ * @param[in] buf_p Read-ahead buffer, or NULL.
+ * @param[in] size Size of the read-ahead buffer in bytes. A multiple
+ *                 of ``USB_HOST_CLASS_MASS_STORAGE_BLOCK_SIZE``,
+ *                 typically a few blocks.
+ *
+ * @return zero(0) or negative error code.
+ */
+int usb_host_class_mass_storage_device_init(
+    struct usb_host_class_mass_storage_device_t *self_p,
+    struct usb_host_device_t *device_p,
+    void *buf_p,
+    size_t size);
+
+/**
+ * Start given block device by reading the capacity of the mass
+ * storage device.
+ *
+ * @param[in] self_p Initialized block device object.
+ *
+ * @return zero(0) or negative error code.
+ */
+int usb_host_class_mass_storage_device_start(
+    struct usb_host_class_mass_storage_device_t *self_p);
+
+/**
+ * Read a block from given block device. Can be given to
+ * `fat16_init()` as the read function.
+ *
+ * @param[in] self_p Started block device object.
+ * @param[out] dst_p Buffer to read into.
+ * @param[in] src_block Block to read from.
+ *
+ * @return Number of read bytes or negative error code.
+ */
+ssize_t usb_host_class_mass_storage_device_read_block(
+    struct usb_host_class_mass_storage_device_t *self_p,
+    void *dst_p,
+    uint32_t src_block);
+
+/**
+ * Write a block to given block device. Can be given to
+ * `fat16_init()` as the write function.
+ *
+ * @param[in] self_p Started block device object.
+ * @param[in] dst_block Block to write to.
+ * @param[in] src_p Buffer to write.
+ *
+ * @return Number of written bytes or negative error code.
+ */
+ssize_t usb_host_class_mass_storage_device_write_block(
+    struct usb_host_class_mass_storage_device_t *self_p,
+    uint32_t dst_block,
+    const void *src_p);
+
+/**
+ * Read given number of consecutive blocks from given block
+ * device. Can be given to `fat16_set_multi_block_functions()`.
+ *
+ * A read that continues where the previous read ended and is smaller
+ * than the read-ahead buffer fills the buffer with one command, so
+ * the following reads are served without accessing the device.
+ *
+ * @param[in] self_p Started block device object.
+ * @param[out] dst_p Buffer to read into.
+ * @param[in] src_block First block to read from.
+ * @param[in] count Number of blocks to read.
+ *
+ * @return Number of read bytes or negative error code.
+ */
+ssize_t usb_host_class_mass_storage_device_read_blocks(
+    struct usb_host_class_mass_storage_device_t *self_p,
+    void *dst_p,
+    uint32_t src_block,
+    size_t count);
+
+/**
+ * Write given number of consecutive blocks to given block device
+ * with a single command. Can be given to
+ * `fat16_set_multi_block_functions()`.
+ *
+ * @param[in] self_p Started block device object.
+ * @param[in] dst_block First block to write to.
+ * @param[in] src_p Buffer to write.
+ * @param[in] count Number of blocks to write.
+ *
+ * @return Number of written bytes or negative error code.
+ */
+ssize_t usb_host_class_mass_storage_device_write_blocks(
+    struct usb_host_class_mass_storage_device_t *self_p,
+    uint32_t dst_block,
+    const void *src_p,
+    size_t count);
+
 #endif
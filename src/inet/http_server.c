@@ -32,54 +32,171 @@ static FAR char not_found_fmt[] =
     "Content-Length: %d\r\n"
     "\r\n";
 
-static int read_initial_request_line(struct socket_t *socket_p,
-                                     char *buf_p,
-                                     struct http_server_request_t *request_p)
-{
-    char *action_p = NULL;
-    char *path_p = NULL;
-    char *proto_p = NULL;
+/** Size of the file chunks streamed to the client. */
+#define FILE_CHUNK_SIZE 512
 
-    *buf_p++ = '\0';
-    action_p = buf_p;
+/** File served for paths ending with a slash. */
+#define FILE_INDEX "INDEX.HTM"
+
+/** Directory in the root path with gzip compressed copies of the
+    files. */
+#define FILE_GZIP_DIR "GZ"
+
+/** A chunk starts with its size as four hexadecimal digits and a line
+    ending, and ends with a line ending. */
+#define CHUNK_HEADER_SIZE 6
+#define CHUNK_TRAILER_SIZE 2
+
+/** The last chunk has size zero and no trailing header fields. */
+#define LAST_CHUNK "0\r\n\r\n"
+#define LAST_CHUNK_SIZE (sizeof(LAST_CHUNK) - 1)
+
+/** Maximum total length of the streaming response header values,
+    leaving room for the first chunk in the chunk buffer. */
+#define STREAM_HEADER_VALUES_SIZE_MAX 128
+
+static FAR char file_fmt[] =
+    "Content-Type: %s\r\n"
+    "Content-Length: %lu\r\n"
+    "Accept-Ranges: bytes\r\n"
+    "ETag: %s\r\n"
+    "%s%s%s";
+
+static FAR char stream_fmt[] =
+    "HTTP/1.1 %d %s\r\n"
+    "Content-Type: %s\r\n"
+    "%s%s%s"
+    "Transfer-Encoding: chunked\r\n"
+    "\r\n";
+
+static FAR char date_fmt[] = "%s, %02d %s %d %02d:%02d:%02d GMT";
+
+static const char *weekdays[] = {
+    "Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun"
+};
+
+static const char *months[] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+/**
+ * Reason phrases of the response status codes.
+ */
+static const struct {
+    int code;
+    const char *reason_p;
+} reason_phrases[] = {
+    { 200, "OK" },
+    { 201, "Created" },
+    { 204, "No Content" },
+    { 206, "Partial Content" },
+    { 304, "Not Modified" },
+    { 400, "Bad Request" },
+    { 404, "Not Found" },
+    { 416, "Range Not Satisfiable" },
+    { 500, "Internal Server Error" },
+    { 0, "" }
+};
+
+/**
+ * Content types of static files by file name extension.
+ */
+static const struct {
+    const char *extension_p;
+    const char *type_p;
+} file_content_types[] = {
+    { "HTM", "text/html" },
+    { "CSS", "text/css" },
+    { "JS", "application/javascript" },
+    { "TXT", "text/plain" },
+    { "PNG", "image/png" },
+    { "JPG", "image/jpeg" },
+    { "GIF", "image/gif" },
+    { "ICO", "image/x-icon" },
+    { "SVG", "image/svg+xml" },
+    { NULL, "application/octet-stream" }
+};
+
+/**
+ * Read one line, excluding the "\r\n" line ending, into given
+ * buffer. Characters that do not fit in the buffer are discarded.
+ *
+ * @return Line length or negative error code.
+ */
+static ssize_t read_line(struct socket_t *socket_p,
+                         char *buf_p,
+                         size_t size)
+{
+    char c;
+    char prev = '\0';
+    size_t pos = 0;
 
     while (1) {
-        if (socket_read(socket_p,
-                        buf_p,
-                        sizeof(*buf_p)) != sizeof(*buf_p)) {
+        if (socket_read(socket_p, &c, sizeof(c)) != sizeof(c)) {
             return (-EIO);
         }
 
-        buf_p++;
-
         /* The line ending is "\r\n". */
-        if ((buf_p[-2] == '\r') && (buf_p[-1] == '\n')) {
-            buf_p[-2] = '\0';
+        if ((prev == '\r') && (c == '\n')) {
             break;
         }
 
-        /* Action and path has ' ' as terminator. */
-        if (buf_p[-1] == ' ') {
-            buf_p[-1] = '\0';
-
-            if (path_p == NULL) {
-                path_p = buf_p;
-            } else if (proto_p == NULL) {
-                proto_p = buf_p;
-            }
+        if (pos < size - 1) {
+            buf_p[pos++] = c;
         }
+
+        prev = c;
+    }
+
+    /* Remove the '\r' if it was saved in the buffer. */
+    if ((pos > 0) && (buf_p[pos - 1] == '\r')) {
+        pos--;
+    }
+
+    buf_p[pos] = '\0';
+
+    return (pos);
+}
+
+static int read_initial_request_line(struct socket_t *socket_p,
+                                     char *buf_p,
+                                     size_t size,
+                                     struct http_server_request_t *request_p)
+{
+    char *action_p = NULL;
+    char *path_p = NULL;
+    char *proto_p = NULL;
+
+    if (read_line(socket_p, buf_p, size) < 0) {
+        return (-EIO);
     }
 
+    /* Action and path has ' ' as terminator. */
+    action_p = buf_p;
+    path_p = strchr(action_p, ' ');
+
     /* A path is required. */
     if (path_p == NULL) {
         return (-1);
     }
 
+    *path_p++ = '\0';
+    proto_p = strchr(path_p, ' ');
+
+    if (proto_p != NULL) {
+        *proto_p++ = '\0';
+    }
+
     log_object_print(NULL,
                      LOG_DEBUG,
                      FSTR("%s %s %s\r\n"), action_p, path_p, proto_p);
 
     /* Save the action and path in the request struct. */
+    if (strlen(path_p) >= sizeof(request_p->path)) {
+        return (-1);
+    }
+
     strcpy(request_p->path, path_p);
 
     if (strcmp(action_p, "GET") == 0) {
@@ -93,45 +210,48 @@ static int read_initial_request_line(struct socket_t *socket_p,
 
 static int read_header_line(struct socket_t *socket_p,
                             char *buf_p,
+                            size_t size,
                             char **header_pp,
                             char **value_pp)
 {
-    *buf_p++ = '\0';
-    *header_pp = buf_p;
-    *value_pp = NULL;
-
-    while (1) {
-        if (socket_read(socket_p,
-                        buf_p,
-                        sizeof(*buf_p)) != sizeof(*buf_p)) {
-            return (-EIO);
-        }
+    char *separator_p;
 
-        buf_p++;
+    if (read_line(socket_p, buf_p, size) < 0) {
+        return (-EIO);
+    }
 
-        /* The line ending is "\r\n". */
-        if ((buf_p[-2] == '\r') && (buf_p[-1] == '\n')) {
-            buf_p[-2] = '\0';
-            break;
-        }
+    /* Value starts after ': '. */
+    *header_pp = buf_p;
+    separator_p = strstr(buf_p, ": ");
 
-        /* Value starts after ': '. */
-        if ((buf_p[-2] == ':') && (buf_p[-1] == ' ')) {
-            if (*value_pp == NULL) {
-                buf_p[-2] = '\0';
-                *value_pp = buf_p;
-            }
-        }
-    }
+    if (separator_p != NULL) {
+        *separator_p = '\0';
+        *value_pp = &separator_p[2];
 
-    if (*value_pp != NULL) {
         return (0);
     } else {
+        *value_pp = NULL;
+
         /* Empty line. */
         return (1);
     }
 }
 
+/**
+ * Save given header value in given request header field. Too long
+ * values are dropped.
+ */
+static void save_header_value(int *present_p,
+                              char *dst_p,
+                              size_t size,
+                              const char *value_p)
+{
+    if (strlen(value_p) < size) {
+        strcpy(dst_p, value_p);
+        *present_p = 1;
+    }
+}
+
 static int read_request(struct http_server_t *self_p,
                         struct http_server_connection_t *connection_p,
                         struct http_server_request_t *request_p)
@@ -144,6 +264,7 @@ static int read_request(struct http_server_t *self_p,
     /* Read the intial line in the request. */
     if (read_initial_request_line(&connection_p->socket,
                                   buf,
+                                  sizeof(buf),
                                   request_p) != 0) {
         return (-EIO);
     }
@@ -154,6 +275,7 @@ static int read_request(struct http_server_t *self_p,
     while (1) {
         res = read_header_line(&connection_p->socket,
                                buf,
+                               sizeof(buf),
                                &header_p,
                                &value_p);
 
@@ -167,8 +289,35 @@ static int read_request(struct http_server_t *self_p,
 
         /* Save the header field in the request object. */
         if (strcmp(header_p, "Sec-WebSocket-Key") == 0) {
-            request_p->headers.sec_websocket_key.present = 1;
-            strcpy(request_p->headers.sec_websocket_key.value, value_p);
+            save_header_value(&request_p->headers.sec_websocket_key.present,
+                              request_p->headers.sec_websocket_key.value,
+                              sizeof(request_p->headers.sec_websocket_key.value),
+                              value_p);
+        } else if (strcmp(header_p, "Sec-WebSocket-Extensions") == 0) {
+            save_header_value(&request_p->headers.sec_websocket_extensions.present,
+                              request_p->headers.sec_websocket_extensions.value,
+                              sizeof(request_p->headers.sec_websocket_extensions.value),
+                              value_p);
+        } else if (strcmp(header_p, "Range") == 0) {
+            save_header_value(&request_p->headers.range.present,
+                              request_p->headers.range.value,
+                              sizeof(request_p->headers.range.value),
+                              value_p);
+        } else if (strcmp(header_p, "If-None-Match") == 0) {
+            save_header_value(&request_p->headers.if_none_match.present,
+                              request_p->headers.if_none_match.value,
+                              sizeof(request_p->headers.if_none_match.value),
+                              value_p);
+        } else if (strcmp(header_p, "If-Modified-Since") == 0) {
+            save_header_value(&request_p->headers.if_modified_since.present,
+                              request_p->headers.if_modified_since.value,
+                              sizeof(request_p->headers.if_modified_since.value),
+                              value_p);
+        } else if (strcmp(header_p, "Accept-Encoding") == 0) {
+            save_header_value(&request_p->headers.accept_encoding.present,
+                              request_p->headers.accept_encoding.value,
+                              sizeof(request_p->headers.accept_encoding.value),
+                              value_p);
         }
     }
 
@@ -203,13 +352,19 @@ static int handle_request(struct http_server_t *self_p,
     int res;
     struct http_server_request_t request;
     http_server_route_callback_t callback;
+    struct time_t timeout;
 
     /* Read the HTTP request. */
+    timeout.seconds = HTTP_SERVER_REQUEST_TIMEOUT;
+    timeout.nanoseconds = 0;
+    socket_set_recv_timeout(&connection_p->socket, &timeout);
     res = read_request(self_p, connection_p, &request);
 
     if (res != 0) {
         return (res);
     }
+
+    socket_set_recv_timeout(&connection_p->socket, NULL);
     
     /* Find the callback for given path. */
     callback = find_route_callback(self_p, request.path);
@@ -296,7 +451,7 @@ allocate_connection(struct http_server_t *self_p)
         sys_unlock();
 
         /* Connection available. */
-        if (connection_p->thrd.name_p != NULL) {
+        if (connection_p->thrd.stack.buf_p != NULL) {
             break;
         }
 
@@ -326,7 +481,7 @@ static void *listener_main(void *arg_p)
                 SOCKET_DOMAIN_AF_INET,
                 SOCKET_TYPE_STREAM,
                 0);
-    addr.ip = 0x6701a8c0;
+    socket_inet_aton(listener_p->address_p, &addr.ip);
     addr.port = listener_p->port;
     socket_bind(&listener_p->socket, &addr, sizeof(addr));
     socket_listen(&listener_p->socket, 3);
@@ -521,3 +676,702 @@ http_server_response_write(struct http_server_connection_t *connection_p,
 
     return (res);
 }
+
+/**
+ * Create the file system path of the requested file, optionally in
+ * given directory in the root path.
+ */
+static int make_file_path(struct http_server_t *self_p,
+                          struct http_server_request_t *request_p,
+                          const char *dir_p,
+                          char *path_p,
+                          size_t size)
+{
+    const char *request_path_p;
+    size_t root_size;
+    size_t dir_size;
+    size_t request_path_size;
+    char *query_p;
+    char *c_p;
+
+    /* Skip the leading slash. */
+    request_path_p = request_p->path;
+
+    if (request_path_p[0] == '/') {
+        request_path_p++;
+    }
+
+    /* Do not allow requests outside the root path. */
+    if (strstr(request_path_p, "..") != NULL) {
+        return (-ENOENT);
+    }
+
+    root_size = 0;
+
+    if ((self_p->root_path_p != NULL) && (self_p->root_path_p[0] != '\0')) {
+        root_size = strlen(self_p->root_path_p);
+    }
+
+    dir_size = 0;
+
+    if (dir_p != NULL) {
+        dir_size = strlen(dir_p);
+    }
+
+    request_path_size = strlen(request_path_p);
+
+    if (root_size + dir_size + request_path_size + sizeof(FILE_INDEX) + 2
+        > size) {
+        return (-ENOENT);
+    }
+
+    /* Join the root path and the request path. */
+    path_p[0] = '\0';
+
+    if (root_size > 0) {
+        strcpy(path_p, self_p->root_path_p);
+
+        if (path_p[root_size - 1] != '/') {
+            strcat(path_p, "/");
+        }
+    }
+
+    if (dir_p != NULL) {
+        strcat(path_p, dir_p);
+        strcat(path_p, "/");
+    }
+
+    strcat(path_p, request_path_p);
+
+    /* The query string is not part of the path. */
+    query_p = strchr(path_p, '?');
+
+    if (query_p != NULL) {
+        *query_p = '\0';
+    }
+
+    /* File names are case insensitive and stored in upper case. */
+    for (c_p = path_p; *c_p != '\0'; c_p++) {
+        if ((*c_p >= 'a') && (*c_p <= 'z')) {
+            *c_p -= ('a' - 'A');
+        }
+    }
+
+    /* Directory index. */
+    if ((path_p[0] == '\0') || (path_p[strlen(path_p) - 1] == '/')) {
+        strcat(path_p, FILE_INDEX);
+    }
+
+    return (0);
+}
+
+/**
+ * Find the content type of given file name by its extension.
+ */
+static const char *get_file_content_type(const char *path_p)
+{
+    const char *extension_p;
+    int i;
+
+    extension_p = strrchr(path_p, '.');
+
+    if ((extension_p == NULL) || (strchr(extension_p, '/') != NULL)) {
+        extension_p = "";
+    } else {
+        extension_p++;
+    }
+
+    for (i = 0; file_content_types[i].extension_p != NULL; i++) {
+        if (strcmp(extension_p, file_content_types[i].extension_p) == 0) {
+            break;
+        }
+    }
+
+    return (file_content_types[i].type_p);
+}
+
+/**
+ * Parse a non-negative decimal number.
+ *
+ * @return Number of parsed digits.
+ */
+static int parse_decimal(const char **str_pp, size_t *value_p)
+{
+    int digits = 0;
+
+    *value_p = 0;
+
+    while ((**str_pp >= '0') && (**str_pp <= '9')) {
+        *value_p *= 10;
+        *value_p += (**str_pp - '0');
+        (*str_pp)++;
+        digits++;
+    }
+
+    return (digits);
+}
+
+/**
+ * Parse given Range header value, on the form "bytes=first-last",
+ * "bytes=first-" or "bytes=-suffix_length". Multiple ranges are not
+ * supported and are ignored.
+ *
+ * @return true(1) if a satisfiable range was found, false(0) if the
+ *         header should be ignored, or negative error code if the
+ *         range is not satisfiable.
+ */
+static int parse_range(const char *value_p,
+                       size_t file_size,
+                       size_t *first_p,
+                       size_t *last_p)
+{
+    size_t first;
+    size_t last;
+    int first_digits;
+    int last_digits;
+
+    if (strncmp(value_p, "bytes=", 6) != 0) {
+        return (0);
+    }
+
+    value_p += 6;
+    first_digits = parse_decimal(&value_p, &first);
+
+    if (*value_p != '-') {
+        return (0);
+    }
+
+    value_p++;
+    last_digits = parse_decimal(&value_p, &last);
+
+    if (*value_p != '\0') {
+        return (0);
+    }
+
+    if (first_digits == 0) {
+        /* Neither first nor suffix length, "bytes=-". */
+        if (last_digits == 0) {
+            return (0);
+        }
+
+        /* Suffix range. */
+        if ((last == 0) || (file_size == 0)) {
+            return (-1);
+        }
+
+        if (last > file_size) {
+            last = file_size;
+        }
+
+        first = (file_size - last);
+        last = (file_size - 1);
+    } else {
+        if (first >= file_size) {
+            return (-1);
+        }
+
+        if ((last_digits == 0) || (last >= file_size)) {
+            last = (file_size - 1);
+        } else if (last < first) {
+            return (0);
+        }
+    }
+
+    *first_p = first;
+    *last_p = last;
+
+    return (1);
+}
+
+/**
+ * Format given date as a HTTP date. An invalid date, for example a
+ * zeroed file system timestamp, is not formatted.
+ *
+ * @return zero(0) or negative error code.
+ */
+static int format_date(char *buf_p, struct date_t *date_p)
+{
+    if ((date_p->month < 1)
+        || (date_p->month > 12)
+        || (date_p->date < 1)
+        || (date_p->date > 31)
+        || (date_p->day < 1)
+        || (date_p->day > 7)) {
+        buf_p[0] = '\0';
+
+        return (-EINVAL);
+    }
+
+    std_sprintf(buf_p,
+                date_fmt,
+                weekdays[(date_p->day - 1) % 7],
+                date_p->date,
+                months[(date_p->month - 1) % 12],
+                date_p->year,
+                date_p->hour,
+                date_p->minute,
+                date_p->second);
+
+    return (0);
+}
+
+/**
+ * Find the file to send for given request. A gzip compressed copy of
+ * the file is preferred if the client accepts gzip.
+ *
+ * @return zero(0) or negative error code.
+ */
+static int find_file(struct http_server_t *self_p,
+                     struct http_server_request_t *request_p,
+                     struct fat16_t *fs_p,
+                     char *path_p,
+                     size_t size,
+                     struct fat16_stat_t *stat_p,
+                     int *gzip_p)
+{
+    int res;
+
+    if ((request_p->headers.accept_encoding.present == 1)
+        && (strstr(request_p->headers.accept_encoding.value, "gzip") != NULL)) {
+        if ((make_file_path(self_p,
+                            request_p,
+                            FILE_GZIP_DIR,
+                            path_p,
+                            size) == 0)
+            && (fat16_stat(fs_p, path_p, stat_p) == 0)
+            && (stat_p->is_dir == 0)) {
+            *gzip_p = 1;
+
+            return (0);
+        }
+    }
+
+    *gzip_p = 0;
+    res = make_file_path(self_p, request_p, NULL, path_p, size);
+
+    if (res != 0) {
+        return (res);
+    }
+
+    if (fat16_stat(fs_p, path_p, stat_p) != 0) {
+        return (-ENOENT);
+    }
+
+    if (stat_p->is_dir == 1) {
+        return (-ENOENT);
+    }
+
+    return (0);
+}
+
+/**
+ * Stream given number of bytes from the file to the client.
+ */
+static int write_file_content(struct http_server_connection_t *connection_p,
+                              struct fat16_file_t *file_p,
+                              size_t size)
+{
+    char buf[FILE_CHUNK_SIZE];
+    size_t n;
+
+    while (size > 0) {
+        n = FILE_CHUNK_SIZE;
+
+        /* Align the chunks with the file system blocks. */
+        n -= (fat16_file_tell(file_p) % FILE_CHUNK_SIZE);
+
+        if (n > size) {
+            n = size;
+        }
+
+        if (fat16_file_read(file_p, buf, n) != n) {
+            return (-EIO);
+        }
+
+        if (socket_write(&connection_p->socket, buf, n) != n) {
+            return (-EIO);
+        }
+
+        size -= n;
+    }
+
+    return (0);
+}
+
+int http_server_response_write_file(struct http_server_connection_t *connection_p,
+                                    struct http_server_request_t *request_p,
+                                    struct fat16_t *fs_p)
+{
+    int res;
+    char path[96];
+    char header[320];
+    char etag[32];
+    char last_modified[32];
+    const char *last_modified_header_p;
+    const char *last_modified_end_p;
+    struct fat16_stat_t stat;
+    struct fat16_file_t file;
+    size_t first;
+    size_t last;
+    size_t size;
+    ssize_t header_size;
+    int gzip;
+
+    /* Only the GET action is supported. */
+    if (request_p->action != http_server_request_action_get_t) {
+        return (-1);
+    }
+
+    res = find_file(connection_p->self_p,
+                    request_p,
+                    fs_p,
+                    path,
+                    sizeof(path),
+                    &stat,
+                    &gzip);
+
+    if (res != 0) {
+        return (res);
+    }
+
+    /* The entity tag and modification date are used by the client to
+       validate its cached copy of the file. */
+    std_sprintf(etag,
+                FSTR("\"%lx-%d%02d%02d%02d%02d%02d\""),
+                (unsigned long)stat.size,
+                stat.latest_mod_date.year,
+                stat.latest_mod_date.month,
+                stat.latest_mod_date.date,
+                stat.latest_mod_date.hour,
+                stat.latest_mod_date.minute,
+                stat.latest_mod_date.second);
+
+    /* Omit the Last-Modified header if the date is invalid. */
+    if (format_date(last_modified, &stat.latest_mod_date) == 0) {
+        last_modified_header_p = "Last-Modified: ";
+        last_modified_end_p = "\r\n";
+    } else {
+        last_modified_header_p = "";
+        last_modified_end_p = "";
+    }
+
+    /* The cached copy in the client is up to date. */
+    if (((request_p->headers.if_none_match.present == 1)
+         && ((strcmp(request_p->headers.if_none_match.value, etag) == 0)
+             || (strcmp(request_p->headers.if_none_match.value, "*") == 0)))
+        || ((request_p->headers.if_none_match.present == 0)
+            && (request_p->headers.if_modified_since.present == 1)
+            && (last_modified[0] != '\0')
+            && (strcmp(request_p->headers.if_modified_since.value,
+                       last_modified) == 0))) {
+        header_size = std_sprintf(header,
+                                  FSTR("HTTP/1.1 304 Not Modified\r\n"
+                                       "ETag: %s\r\n"
+                                       "%s%s%s"
+                                       "\r\n"),
+                                  etag,
+                                  last_modified_header_p,
+                                  last_modified,
+                                  last_modified_end_p);
+
+        if (socket_write(&connection_p->socket,
+                         header,
+                         header_size) != header_size) {
+            return (-EIO);
+        }
+
+        return (0);
+    }
+
+    first = 0;
+    last = (stat.size - 1);
+    res = 0;
+
+    if (request_p->headers.range.present == 1) {
+        res = parse_range(request_p->headers.range.value,
+                          stat.size,
+                          &first,
+                          &last);
+    }
+
+    if (res < 0) {
+        header_size = std_sprintf(header,
+                                  FSTR("HTTP/1.1 416 Range Not Satisfiable\r\n"
+                                       "Content-Range: bytes */%lu\r\n"
+                                       "Content-Length: 0\r\n"
+                                       "\r\n"),
+                                  (unsigned long)stat.size);
+
+        if (socket_write(&connection_p->socket,
+                         header,
+                         header_size) != header_size) {
+            return (-EIO);
+        }
+
+        return (0);
+    }
+
+    size = (stat.size > 0 ? (last - first + 1) : 0);
+
+    if (fat16_file_open(fs_p, &file, path, O_READ) != 0) {
+        return (-EIO);
+    }
+
+    if (fat16_file_seek(&file, first, FAT16_SEEK_SET) != 0) {
+        fat16_file_close(&file);
+
+        return (-EIO);
+    }
+
+    /* Write the header. */
+    if (res == 1) {
+        header_size = std_sprintf(header,
+                                  FSTR("HTTP/1.1 206 Partial Content\r\n"
+                                       "Content-Range: bytes %lu-%lu/%lu\r\n"),
+                                  (unsigned long)first,
+                                  (unsigned long)last,
+                                  (unsigned long)stat.size);
+    } else {
+        header_size = std_sprintf(header, FSTR("HTTP/1.1 200 OK\r\n"));
+    }
+
+    header_size += std_sprintf(&header[header_size],
+                               file_fmt,
+                               get_file_content_type(path),
+                               (unsigned long)size,
+                               etag,
+                               last_modified_header_p,
+                               last_modified,
+                               last_modified_end_p);
+
+    if (gzip == 1) {
+        header_size += std_sprintf(&header[header_size],
+                                   FSTR("Content-Encoding: gzip\r\n"
+                                        "Vary: Accept-Encoding\r\n"));
+    }
+
+    header_size += std_sprintf(&header[header_size], FSTR("\r\n"));
+
+    if (socket_write(&connection_p->socket,
+                     header,
+                     header_size) != header_size) {
+        res = -EIO;
+    } else {
+        res = write_file_content(connection_p, &file, size);
+    }
+
+    fat16_file_close(&file);
+
+    return (res);
+}
+
+/**
+ * Get the reason phrase of given response status code.
+ */
+static const char *get_reason_phrase(int code)
+{
+    int i;
+
+    for (i = 0; reason_phrases[i].code != 0; i++) {
+        if (reason_phrases[i].code == code) {
+            break;
+        }
+    }
+
+    return (reason_phrases[i].reason_p);
+}
+
+/**
+ * Number of bytes that can be added to the current chunk.
+ */
+static size_t stream_chunk_space(struct http_server_response_stream_t *self_p)
+{
+    return (sizeof(self_p->chunk.buf)
+            - self_p->chunk.offset
+            - self_p->chunk.size
+            - CHUNK_TRAILER_SIZE
+            - LAST_CHUNK_SIZE);
+}
+
+/**
+ * Send the header, if not already sent, and the current chunk, if
+ * any, in a single socket write. The last chunk is appended if
+ * requested.
+ */
+static int stream_flush(struct http_server_response_stream_t *self_p,
+                        int last)
+{
+    static const char digits[] = "0123456789abcdef";
+    char *buf_p;
+    size_t size;
+    int i;
+
+    buf_p = self_p->chunk.buf;
+
+    /* The header, if any, is located before the chunk. */
+    size = (self_p->chunk.offset - CHUNK_HEADER_SIZE);
+
+    if (self_p->chunk.size > 0) {
+        for (i = 0; i < 4; i++) {
+            buf_p[size + i] = digits[(self_p->chunk.size >> (12 - 4 * i)) & 0xf];
+        }
+
+        buf_p[size + 4] = '\r';
+        buf_p[size + 5] = '\n';
+        size = (self_p->chunk.offset + self_p->chunk.size);
+        buf_p[size++] = '\r';
+        buf_p[size++] = '\n';
+    }
+
+    if (last == 1) {
+        memcpy(&buf_p[size], LAST_CHUNK, LAST_CHUNK_SIZE);
+        size += LAST_CHUNK_SIZE;
+    }
+
+    self_p->chunk.offset = CHUNK_HEADER_SIZE;
+    self_p->chunk.size = 0;
+
+    if (size == 0) {
+        return (0);
+    }
+
+    if (socket_write(&self_p->connection_p->socket, buf_p, size) != size) {
+        return (-EIO);
+    }
+
+    return (0);
+}
+
+int http_server_response_stream_begin(struct http_server_response_stream_t *self_p,
+                                      struct http_server_connection_t *connection_p,
+                                      int code,
+                                      const char *content_type_p,
+                                      const char *content_encoding_p)
+{
+    size_t size;
+
+    /* The header must fit in the chunk buffer. */
+    size = strlen(content_type_p);
+
+    if (content_encoding_p != NULL) {
+        size += strlen(content_encoding_p);
+    }
+
+    if (size > STREAM_HEADER_VALUES_SIZE_MAX) {
+        return (-EINVAL);
+    }
+
+    self_p->connection_p = connection_p;
+    self_p->deflate_p = NULL;
+
+    /* The header is sent together with the first chunk. */
+    size = std_sprintf(self_p->chunk.buf,
+                       stream_fmt,
+                       code,
+                       get_reason_phrase(code),
+                       content_type_p,
+                       (content_encoding_p != NULL ? "Content-Encoding: " : ""),
+                       (content_encoding_p != NULL ? content_encoding_p : ""),
+                       (content_encoding_p != NULL ? "\r\n" : ""));
+
+    self_p->chunk.offset = (size + CHUNK_HEADER_SIZE);
+    self_p->chunk.size = 0;
+
+    return (0);
+}
+
+/**
+ * Write given data to the chunk buffer and send full chunks.
+ */
+static ssize_t stream_write_chunks(struct http_server_response_stream_t *self_p,
+                                   const void *buf_p,
+                                   size_t size)
+{
+    const char *b_p;
+    size_t left;
+    size_t n;
+
+    b_p = buf_p;
+    left = size;
+
+    while (left > 0) {
+        n = stream_chunk_space(self_p);
+
+        if (n > left) {
+            n = left;
+        }
+
+        memcpy(&self_p->chunk.buf[self_p->chunk.offset + self_p->chunk.size],
+               b_p,
+               n);
+        self_p->chunk.size += n;
+        b_p += n;
+        left -= n;
+
+        /* Send the chunk when the buffer is full. */
+        if (stream_chunk_space(self_p) == 0) {
+            if (stream_flush(self_p, 0) != 0) {
+                return (-EIO);
+            }
+        }
+    }
+
+    return (size);
+}
+
+int http_server_response_stream_begin_gzip(struct http_server_response_stream_t *self_p,
+                                           struct http_server_connection_t *connection_p,
+                                           int code,
+                                           const char *content_type_p,
+                                           struct deflate_t *deflate_p)
+{
+    int res;
+
+    res = http_server_response_stream_begin(self_p,
+                                            connection_p,
+                                            code,
+                                            content_type_p,
+                                            "gzip");
+
+    if (res != 0) {
+        return (res);
+    }
+
+    /* The compressed data is written to the chunk buffer. */
+    chan_init(&self_p->base,
+              NULL,
+              (ssize_t (*)(void *, const void *, size_t))stream_write_chunks,
+              NULL);
+
+    res = deflate_init(deflate_p, &self_p->base, DEFLATE_FORMAT_GZIP);
+
+    if (res != 0) {
+        return (res);
+    }
+
+    self_p->deflate_p = deflate_p;
+
+    return (0);
+}
+
+ssize_t http_server_response_stream_write(struct http_server_response_stream_t *self_p,
+                                          const void *buf_p,
+                                          size_t size)
+{
+    if (self_p->deflate_p != NULL) {
+        return (deflate_write(self_p->deflate_p, buf_p, size));
+    }
+
+    return (stream_write_chunks(self_p, buf_p, size));
+}
+
+int http_server_response_stream_end(struct http_server_response_stream_t *self_p)
+{
+    if (self_p->deflate_p != NULL) {
+        if (deflate_finish(self_p->deflate_p) != 0) {
+            return (-EIO);
+        }
+    }
+
+    return (stream_flush(self_p, 1));
+}
@@ -0,0 +1,769 @@
+/**
+ * @file http_websocket.c
+ * @version 0.5.0
+ *
+ * @section License
+ * Copyright (C) 2016, Erik Moqvist
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Simba project.
+ */
+
+#include "simba.h"
+
+/* Maximum payload size of a control frame. */
+#define CONTROL_PAYLOAD_MAX 125
+
+/* Size of the chunks compressed payload is decompressed in. */
+#define INFLATE_CHUNK_SIZE 64
+
+/* Size of the chunks written payload is masked in. */
+#define MASK_CHUNK_SIZE 64
+
+struct frame_header_t {
+    int fin;
+    int compressed;
+    int opcode;
+    uint64_t size;
+    int masked;
+    uint8_t masking_key[4];
+};
+
+/* The end of a flushed deflate stream, removed from each compressed
+   message. */
+static const uint8_t deflate_trailer[4] = { 0x00, 0x00, 0xff, 0xff };
+
+/**
+ * Read given number of bytes from the data borrowed from the
+ * socket. The data is discarded if the buffer is NULL.
+ *
+ * @return Number of read bytes, fewer than requested if the socket
+ *         is closed, or negative error code.
+ */
+static ssize_t input_read(struct http_websocket_t *self_p,
+                          void *buf_p,
+                          size_t size)
+{
+    uint8_t *b_p;
+    const void *borrowed_p;
+    size_t left;
+    size_t n;
+    ssize_t res;
+
+    b_p = buf_p;
+    left = size;
+
+    while (left > 0) {
+        /* Borrow more data from the socket. */
+        if (self_p->input.size == 0) {
+            res = socket_recv_borrow(self_p->socket_p, &borrowed_p);
+
+            if (res < 0) {
+                return (res);
+            }
+
+            /* Socket closed. */
+            if (res == 0) {
+                break;
+            }
+
+            self_p->input.buf_p = borrowed_p;
+            self_p->input.size = res;
+        }
+
+        n = left;
+
+        if (n > self_p->input.size) {
+            n = self_p->input.size;
+        }
+
+        if (b_p != NULL) {
+            memcpy(b_p, self_p->input.buf_p, n);
+            b_p += n;
+        }
+
+        self_p->input.buf_p += n;
+        self_p->input.size -= n;
+        left -= n;
+
+        if (socket_recv_release(self_p->socket_p, n) != 0) {
+            return (-EIO);
+        }
+    }
+
+    return (size - left);
+}
+
+/**
+ * Discard given number of bytes from the socket.
+ *
+ * @return zero(0) or negative error code.
+ */
+static int input_discard(struct http_websocket_t *self_p,
+                         uint64_t size)
+{
+    size_t n;
+
+    while (size > 0) {
+        n = 0x4000;
+
+        if (n > size) {
+            n = size;
+        }
+
+        if (input_read(self_p, NULL, n) != n) {
+            return (-EIO);
+        }
+
+        size -= n;
+    }
+
+    return (0);
+}
+
+/**
+ * Read a frame header.
+ *
+ * @return true(1) if a header was read, false(0) if the socket was
+ *         closed before the header, or negative error code.
+ */
+static int read_frame_header(struct http_websocket_t *self_p,
+                             struct frame_header_t *header_p)
+{
+    uint8_t buf[8];
+    ssize_t res;
+    size_t i;
+
+    res = input_read(self_p, buf, 2);
+
+    if (res != 2) {
+        if (res == 0) {
+            return (0);
+        }
+
+        return (-EIO);
+    }
+
+    header_p->fin = ((buf[0] & INET_HTTP_WEBSOCKET_FIN) != 0);
+    header_p->compressed = ((buf[0] & INET_HTTP_WEBSOCKET_RSV1) != 0);
+    header_p->opcode = (buf[0] & INET_HTTP_WEBSOCKET_OPCODE_MASK);
+    header_p->masked = ((buf[1] & INET_HTTP_WEBSOCKET_MASK) != 0);
+    header_p->size = (buf[1] & ~INET_HTTP_WEBSOCKET_MASK);
+
+    /* Extended payload length in network byte order. */
+    if (header_p->size == 126) {
+        if (input_read(self_p, buf, 2) != 2) {
+            return (-EIO);
+        }
+
+        header_p->size = (((uint64_t)buf[0] << 8) | buf[1]);
+    } else if (header_p->size == 127) {
+        if (input_read(self_p, buf, 8) != 8) {
+            return (-EIO);
+        }
+
+        header_p->size = 0;
+
+        for (i = 0; i < 8; i++) {
+            header_p->size <<= 8;
+            header_p->size |= buf[i];
+        }
+    }
+
+    if (header_p->masked) {
+        if (input_read(self_p,
+                       header_p->masking_key,
+                       sizeof(header_p->masking_key)) != 4) {
+            return (-EIO);
+        }
+    }
+
+    return (1);
+}
+
+/**
+ * Read the payload of a control frame and act on it.
+ *
+ * @return true(1) if the frame was handled, false(0) if the frame
+ *         closed the connection, or negative error code.
+ */
+static int handle_control_frame(struct http_websocket_t *self_p,
+                                struct frame_header_t *header_p)
+{
+    uint8_t buf[CONTROL_PAYLOAD_MAX];
+    size_t size;
+
+    /* Control frames may not be fragmented and are short. */
+    if ((header_p->fin == 0) || (header_p->size > sizeof(buf))) {
+        return (-EPROTO);
+    }
+
+    size = header_p->size;
+
+    if (input_read(self_p, buf, size) != size) {
+        return (-EIO);
+    }
+
+    if (header_p->masked) {
+        http_websocket_unmask(buf, size, header_p->masking_key, 0);
+    }
+
+    switch (header_p->opcode) {
+
+    case INET_HTTP_WEBSOCKET_OPCODE_PING:
+        if (http_websocket_write_frame(self_p,
+                                       INET_HTTP_WEBSOCKET_OPCODE_PONG,
+                                       1,
+                                       buf,
+                                       size) != size) {
+            return (-EIO);
+        }
+
+        return (1);
+
+    case INET_HTTP_WEBSOCKET_OPCODE_CLOSE:
+        /* Echo the status code, if any. */
+        if (size > 2) {
+            size = 2;
+        }
+
+        http_websocket_write_frame(self_p,
+                                   INET_HTTP_WEBSOCKET_OPCODE_CLOSE,
+                                   1,
+                                   buf,
+                                   size);
+
+        return (0);
+
+    default:
+        /* Unsolicited pongs are ignored. */
+        return (1);
+    }
+}
+
+/**
+ * Output channel of the compressor. Compressed data is written in
+ * frames. The last four bytes are kept in the buffer, as the flush
+ * trailer is not written.
+ */
+static ssize_t frame_write(struct http_websocket_deflate_frame_t *self_p,
+                           const void *buf_p,
+                           size_t size)
+{
+    const uint8_t *b_p;
+    size_t left;
+    size_t n;
+
+    b_p = buf_p;
+    left = size;
+
+    while (left > 0) {
+        n = (sizeof(self_p->buf) - self_p->size);
+
+        if (n > left) {
+            n = left;
+        }
+
+        memcpy(&self_p->buf[self_p->size], b_p, n);
+        self_p->size += n;
+        b_p += n;
+        left -= n;
+
+        if (self_p->size == sizeof(self_p->buf)) {
+            n = (self_p->size - sizeof(deflate_trailer));
+
+            if (http_websocket_write_frame(self_p->websocket_p,
+                                           self_p->opcode,
+                                           0,
+                                           self_p->buf,
+                                           n) != n) {
+                return (-EIO);
+            }
+
+            memmove(&self_p->buf[0],
+                    &self_p->buf[n],
+                    sizeof(deflate_trailer));
+            self_p->size = sizeof(deflate_trailer);
+            self_p->opcode = INET_HTTP_WEBSOCKET_OPCODE_CONTINUATION;
+        }
+    }
+
+    return (size);
+}
+
+/**
+ * Output channel of the decompressor. Data that does not fit in the
+ * read buffer is dropped.
+ */
+static ssize_t message_write(struct http_websocket_deflate_message_t *self_p,
+                             const void *buf_p,
+                             size_t size)
+{
+    size_t n;
+
+    n = size;
+
+    if (n > self_p->left) {
+        n = self_p->left;
+    }
+
+    memcpy(&self_p->buf_p[self_p->size - self_p->left], buf_p, n);
+    self_p->left -= n;
+
+    return (size);
+}
+
+/**
+ * Read and decompress the payload of a frame of a compressed message.
+ *
+ * @return zero(0) or negative error code.
+ */
+static int read_compressed_payload(struct http_websocket_t *self_p,
+                                   struct frame_header_t *header_p)
+{
+    uint8_t buf[INFLATE_CHUNK_SIZE];
+    uint64_t left;
+    size_t offset;
+    size_t n;
+    ssize_t res;
+
+    left = header_p->size;
+    offset = 0;
+
+    while (left > 0) {
+        n = sizeof(buf);
+
+        if (n > left) {
+            n = left;
+        }
+
+        if (input_read(self_p, buf, n) != n) {
+            return (-EIO);
+        }
+
+        if (header_p->masked) {
+            offset = http_websocket_unmask(buf,
+                                           n,
+                                           header_p->masking_key,
+                                           offset);
+        }
+
+        res = inflate_write(&self_p->deflate_p->inflate, buf, n);
+
+        if (res < 0) {
+            return (res);
+        }
+
+        left -= n;
+    }
+
+    return (0);
+}
+
+/**
+ * Compress given message and write it in one or more frames.
+ */
+static ssize_t write_compressed(struct http_websocket_t *self_p,
+                                int type,
+                                const void *buf_p,
+                                size_t size)
+{
+    struct http_websocket_deflate_frame_t *frame_p;
+    size_t n;
+
+    frame_p = &self_p->deflate_p->frame;
+    frame_p->opcode = (type | INET_HTTP_WEBSOCKET_RSV1);
+    frame_p->size = 0;
+
+    if (deflate_write(&self_p->deflate_p->deflate, buf_p, size) != size) {
+        return (-EIO);
+    }
+
+    if (deflate_flush(&self_p->deflate_p->deflate) != 0) {
+        return (-EIO);
+    }
+
+    /* Write the last frame without the flush trailer. */
+    n = (frame_p->size - sizeof(deflate_trailer));
+
+    if (http_websocket_write_frame(self_p,
+                                   frame_p->opcode,
+                                   1,
+                                   frame_p->buf,
+                                   n) != n) {
+        return (-EIO);
+    }
+
+    return (size);
+}
+
+int http_websocket_init(struct http_websocket_t *self_p,
+                        struct socket_t *socket_p,
+                        int mask)
+{
+    self_p->socket_p = socket_p;
+    self_p->mask = mask;
+    self_p->deflate_p = NULL;
+    self_p->input.buf_p = NULL;
+    self_p->input.size = 0;
+
+    return (0);
+}
+
+int http_websocket_enable_deflate(struct http_websocket_t *self_p,
+                                  struct http_websocket_deflate_t *deflate_p)
+{
+    chan_init(&deflate_p->frame.base,
+              NULL,
+              (ssize_t (*)(void *, const void *, size_t))frame_write,
+              NULL);
+    deflate_p->frame.websocket_p = self_p;
+    deflate_p->frame.size = 0;
+
+    chan_init(&deflate_p->message.base,
+              NULL,
+              (ssize_t (*)(void *, const void *, size_t))message_write,
+              NULL);
+
+    if (deflate_init(&deflate_p->deflate,
+                     &deflate_p->frame.base,
+                     DEFLATE_FORMAT_RAW) != 0) {
+        return (-1);
+    }
+
+    if (inflate_init(&deflate_p->inflate, &deflate_p->message.base) != 0) {
+        return (-1);
+    }
+
+    self_p->deflate_p = deflate_p;
+
+    return (0);
+}
+
+ssize_t http_websocket_read(struct http_websocket_t *self_p,
+                            int *type_p,
+                            void *buf_p,
+                            size_t size)
+{
+    struct frame_header_t header;
+    struct http_websocket_deflate_message_t *message_p;
+    uint8_t *b_p;
+    size_t left;
+    size_t n;
+    int compressed;
+    int type;
+    int res;
+
+    b_p = buf_p;
+    left = size;
+    message_p = NULL;
+    compressed = 0;
+    type = -1;
+
+    do {
+        res = read_frame_header(self_p, &header);
+
+        if (res <= 0) {
+            return (res);
+        }
+
+        /* Control frames may be injected in fragmented messages. */
+        if (header.opcode & INET_HTTP_WEBSOCKET_OPCODE_CONTROL) {
+            res = handle_control_frame(self_p, &header);
+
+            if (res <= 0) {
+                return (res);
+            }
+
+            header.fin = 0;
+            continue;
+        }
+
+        /* Only the first frame in a message has a type. */
+        if (header.opcode == INET_HTTP_WEBSOCKET_OPCODE_CONTINUATION) {
+            if (type == -1) {
+                return (-EPROTO);
+            }
+        } else {
+            if (type != -1) {
+                return (-EPROTO);
+            }
+
+            type = header.opcode;
+            compressed = header.compressed;
+
+            if (compressed) {
+                if (self_p->deflate_p == NULL) {
+                    return (-EPROTO);
+                }
+
+                /* Decompress into given buffer. */
+                message_p = &self_p->deflate_p->message;
+                message_p->buf_p = buf_p;
+                message_p->size = size;
+                message_p->left = size;
+            }
+        }
+
+        if (compressed) {
+            res = read_compressed_payload(self_p, &header);
+
+            if (res != 0) {
+                return (res);
+            }
+
+            continue;
+        }
+
+        /* Read the payload that fits in the buffer. */
+        n = left;
+
+        if (n > header.size) {
+            n = header.size;
+        }
+
+        if (input_read(self_p, b_p, n) != n) {
+            return (-EIO);
+        }
+
+        if (header.masked) {
+            http_websocket_unmask(b_p, n, header.masking_key, 0);
+        }
+
+        b_p += n;
+        left -= n;
+
+        /* Discard leftover data. */
+        if (input_discard(self_p, header.size - n) != 0) {
+            return (-EIO);
+        }
+    } while (header.fin == 0);
+
+    if (compressed) {
+        res = inflate_write(&self_p->deflate_p->inflate,
+                            deflate_trailer,
+                            sizeof(deflate_trailer));
+
+        if (res < 0) {
+            return (res);
+        }
+
+        left = message_p->left;
+    }
+
+    if (type_p != NULL) {
+        *type_p = type;
+    }
+
+    return (size - left);
+}
+
+ssize_t http_websocket_write(struct http_websocket_t *self_p,
+                             int type,
+                             const void *buf_p,
+                             size_t size)
+{
+    if (self_p->deflate_p != NULL) {
+        return (write_compressed(self_p, type, buf_p, size));
+    }
+
+    return (http_websocket_write_frame(self_p, type, 1, buf_p, size));
+}
+
+/**
+ * Generate a masking key for a written frame.
+ */
+static void masking_key_generate(uint8_t *key_p)
+{
+    int i;
+
+    /* The low bits of some rand() implementations are weak. */
+    for (i = 0; i < 4; i++) {
+        key_p[i] = (rand() >> 7);
+    }
+}
+
+/**
+ * Write a masked frame. The payload is masked in chunks, as the
+ * caller's buffer must not be modified.
+ */
+static ssize_t write_frame_masked(struct http_websocket_t *self_p,
+                                  int opcode,
+                                  int fin,
+                                  const uint8_t *buf_p,
+                                  size_t size)
+{
+    uint8_t buf[HTTP_WEBSOCKET_HEADER_SIZE_MAX + MASK_CHUNK_SIZE];
+    uint8_t masking_key[4];
+    size_t header_size;
+    size_t offset;
+    size_t left;
+    size_t n;
+
+    masking_key_generate(masking_key);
+    header_size = http_websocket_encode_header(buf,
+                                               opcode,
+                                               fin,
+                                               masking_key,
+                                               size);
+    offset = 0;
+    left = size;
+
+    /* The header is written together with the first chunk. */
+    do {
+        n = MIN(left, sizeof(buf) - header_size);
+        memcpy(&buf[header_size], buf_p, n);
+        offset = http_websocket_unmask(&buf[header_size],
+                                       n,
+                                       masking_key,
+                                       offset);
+
+        if (socket_write(self_p->socket_p,
+                         buf,
+                         header_size + n) != (header_size + n)) {
+            return (-EIO);
+        }
+
+        header_size = 0;
+        buf_p += n;
+        left -= n;
+    } while (left > 0);
+
+    return (size);
+}
+
+ssize_t http_websocket_write_frame(struct http_websocket_t *self_p,
+                                   int opcode,
+                                   int fin,
+                                   const void *buf_p,
+                                   size_t size)
+{
+    uint8_t header[HTTP_WEBSOCKET_HEADER_SIZE_MAX];
+    struct socket_iov_t iov[2];
+    size_t header_size;
+
+    if (self_p->mask) {
+        return (write_frame_masked(self_p, opcode, fin, buf_p, size));
+    }
+
+    header_size = http_websocket_encode_header(header,
+                                               opcode,
+                                               fin,
+                                               NULL,
+                                               size);
+
+    /* Write the header and the payload in one go. */
+    iov[0].buf_p = header;
+    iov[0].size = header_size;
+    iov[1].buf_p = (void *)buf_p;
+    iov[1].size = size;
+
+    if (socket_writev(self_p->socket_p,
+                      iov,
+                      membersof(iov),
+                      0) != (header_size + size)) {
+        return (-EIO);
+    }
+
+    return (size);
+}
+
+size_t http_websocket_encode_header(uint8_t *buf_p,
+                                    int opcode,
+                                    int fin,
+                                    const uint8_t *masking_key_p,
+                                    size_t size)
+{
+    size_t header_size;
+    int i;
+
+    buf_p[0] = opcode;
+
+    if (fin) {
+        buf_p[0] |= INET_HTTP_WEBSOCKET_FIN;
+    }
+
+    header_size = 2;
+
+    if (size < 126) {
+        buf_p[1] = size;
+    } else if (size < 65536) {
+        buf_p[1] = 126;
+        buf_p[2] = ((size >> 8) & 0xff);
+        buf_p[3] = ((size >> 0) & 0xff);
+        header_size += 2;
+    } else {
+        buf_p[1] = 127;
+
+        for (i = 0; i < 8; i++) {
+            buf_p[9 - i] = (((uint64_t)size >> (8 * i)) & 0xff);
+        }
+
+        header_size += 8;
+    }
+
+    if (masking_key_p != NULL) {
+        buf_p[1] |= INET_HTTP_WEBSOCKET_MASK;
+        memcpy(&buf_p[header_size], masking_key_p, 4);
+        header_size += 4;
+    }
+
+    return (header_size);
+}
+
+size_t http_websocket_unmask(void *buf_p,
+                             size_t size,
+                             const uint8_t *key_p,
+                             size_t offset)
+{
+    uint8_t *b_p;
+    unsigned long key;
+    unsigned long word;
+    size_t i;
+
+    b_p = buf_p;
+    offset &= 0x3;
+
+    /* Unmask one byte at a time until the buffer is word aligned. */
+    while ((size > 0) && (((uintptr_t)b_p % sizeof(key)) != 0)) {
+        *b_p++ ^= key_p[offset];
+        offset = ((offset + 1) & 0x3);
+        size--;
+    }
+
+    /* The masking key repeated over a word, starting at the current
+       offset. */
+    for (i = 0; i < sizeof(key); i++) {
+        ((uint8_t *)&key)[i] = key_p[(offset + i) & 0x3];
+    }
+
+    /* Unmask whole words. The word size is a multiple of the key
+       size, so the offset is unchanged. The words are copied as the
+       buffer must not be accessed through a word pointer. */
+    while (size >= sizeof(key)) {
+        memcpy(&word, b_p, sizeof(word));
+        word ^= key;
+        memcpy(b_p, &word, sizeof(word));
+        b_p += sizeof(word);
+        size -= sizeof(word);
+    }
+
+    /* Unmask the remaining bytes. */
+
+    while (size > 0) {
+        *b_p++ ^= key_p[offset];
+        offset = ((offset + 1) & 0x3);
+        size--;
+    }
+
+    return (offset);
+}
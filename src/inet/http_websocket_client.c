@@ -20,52 +20,46 @@
 
 #include "simba.h"
 
-static int readline(struct http_websocket_client_t *self_p,
-                    FAR char *expected_p,
-                    size_t size)
+/**
+ * Read a line into given buffer. Too long lines are truncated.
+ *
+ * @return Line length or negative error code.
+ */
+static int read_line(struct http_websocket_client_t *self_p,
+                     char *buf_p,
+                     size_t size)
 {
-    int pos;
-    int match = 1;
-    char curr, prev;
+    size_t pos;
+    char curr;
+    char prev;
 
     pos = 0;
     prev = '\0';
 
     while (1) {
-        /* Get a byte from the stream. */
         if (socket_read(&self_p->server.socket,
                         &curr,
                         sizeof(curr)) != sizeof(curr)) {
             return (-EIO);
         }
 
-        /* Line ending. */
         if ((prev == '\r') && (curr == '\n')) {
             break;
         }
 
-        /* Compare the read byte to the expected byte. */
-        if (expected_p != NULL) {
-            if (pos < size) {
-                if (curr != expected_p[pos]) {
-                    match = 0;
-                }
-            }
+        if (pos < size - 1) {
+            buf_p[pos] = curr;
         }
 
         prev = curr;
         pos++;
     }
 
-    if (match == 0) {
-        return (pos);
-    } else {
-        if ((pos - 1) == size) {
-            return (0);
-        }
-    }
+    /* Drop the carriage return. */
+    pos--;
+    buf_p[MIN(pos, size - 1)] = '\0';
 
-    return (-1);
+    return (pos);
 }
 
 int http_websocket_client_init(struct http_websocket_client_t *self_p,
@@ -76,6 +70,17 @@ int http_websocket_client_init(struct http_websocket_client_t *self_p,
     self_p->server.host_p = host_p;
     self_p->server.port = port;
     self_p->path_p = path_p;
+    self_p->deflate_p = NULL;
+
+    return (http_websocket_init(&self_p->websocket,
+                                &self_p->server.socket,
+                                1));
+}
+
+int http_websocket_client_enable_deflate(struct http_websocket_client_t *self_p,
+                                         struct http_websocket_deflate_t *deflate_p)
+{
+    self_p->deflate_p = deflate_p;
 
     return (0);
 }
@@ -83,17 +88,30 @@ int http_websocket_client_init(struct http_websocket_client_t *self_p,
 int http_websocket_client_connect(struct http_websocket_client_t *self_p)
 {
     int res;
+    int deflate;
+    char buf[96];
     struct socket_addr_t server_addr;
 
+    /* The server host must be an IPv4 address. */
+    if (socket_inet_aton(self_p->server.host_p, &server_addr.ip) != 0) {
+        return (-EINVAL);
+    }
+
+    server_addr.port = self_p->server.port;
+
     /* Open a TCP socket and connect to the server. */
     socket_open(&self_p->server.socket,
                 SOCKET_DOMAIN_AF_INET,
                 SOCKET_TYPE_STREAM,
                 0);
 
-    socket_connect(&self_p->server.socket,
-                   &server_addr,
-                   sizeof(server_addr));
+    if (socket_connect(&self_p->server.socket,
+                       &server_addr,
+                       sizeof(server_addr)) != 0) {
+        socket_close(&self_p->server.socket);
+
+        return (-EIO);
+    }
 
     /* Perform the handshake with the server. */
     std_fprintf(&self_p->server.socket,
@@ -101,27 +119,56 @@ int http_websocket_client_connect(struct http_websocket_client_t *self_p)
                      "Host: %s\r\n"
                      "Upgrade: WebSocket\r\n"
                      "Connection: Upgrade\r\n"
-                     "Origin: SimbaWebSocketClient\r\n"
-                     "\r\n"),
+                     "Origin: SimbaWebSocketClient\r\n"),
                 self_p->path_p,
                 self_p->server.host_p);
 
-    /* Expect a positive response. */
-    if (readline(self_p, FSTR("HTTP/1.1 101"), 12) != 0) {
+    if (self_p->deflate_p != NULL) {
+        std_fprintf(&self_p->server.socket,
+                    FSTR("Sec-WebSocket-Extensions: permessage-deflate; "
+                         "client_max_window_bits=%d; "
+                         "server_max_window_bits=%d\r\n"),
+                    DEFLATE_WINDOW_BITS,
+                    DEFLATE_WINDOW_BITS);
+    }
+
+    std_fprintf(&self_p->server.socket, FSTR("\r\n"));
+
+    /* Expect a positive response. The reason phrase is optional. */
+    if (read_line(self_p, buf, sizeof(buf)) < 12) {
+        return (-1);
+    }
+
+    if (strncmp(buf, "HTTP/1.1 101", 12) != 0) {
         return (-1);
     }
 
     /* Find the empty line at the end of the message. */
+    deflate = 0;
+
     while (1) {
-        res = readline(self_p, FSTR(""), 0);
+        res = read_line(self_p, buf, sizeof(buf));
 
         if (res == 0) {
             break;
-        } else if (res > 0) {
-            continue;
-        } else {
+        } else if (res < 0) {
             return (res);
         }
+
+        if ((strncmp(buf, "Sec-WebSocket-Extensions:", 25) == 0)
+            && (strstr(buf, "permessage-deflate") != NULL)) {
+            deflate = 1;
+        }
+    }
+
+    if (deflate == 1) {
+        /* Only an offered extension may be accepted. */
+        if (self_p->deflate_p == NULL) {
+            return (-EPROTO);
+        }
+
+        return (http_websocket_enable_deflate(&self_p->websocket,
+                                              self_p->deflate_p));
     }
 
     return (0);
@@ -136,60 +183,7 @@ ssize_t http_websocket_client_read(struct http_websocket_client_t *self_p,
                                    void *buf_p,
                                    size_t size)
 {
-    uint8_t buf[16];
-    size_t left = size, n;
-
-    while (left > 0) {
-        /* Read buffered frame data. */
-        if (self_p->frame.left > 0) {
-            if (left > self_p->frame.left) {
-                n = self_p->frame.left;
-            } else {
-                n = left;
-            }
-
-            if (socket_read(&self_p->server.socket, buf_p, n) != n) {
-                return (-EIO);
-            }
-
-            self_p->frame.left -= n;
-            left -= n;
-        }
-
-        if (left > 0) {
-            /* Read the next frame. */
-            if (socket_read(&self_p->server.socket, buf, 2) != 2) {
-                return (-EIO);
-            }
-
-            self_p->frame.left = (buf[1] & ~INET_HTTP_WEBSOCKET_MASK);
-
-            if (self_p->frame.left == 126) {
-                if (socket_read(&self_p->server.socket, &buf[2], 2) != 2) {
-                    return (-EIO);
-                }
-
-                self_p->frame.left = ((uint32_t)(buf[2]) << 8 | buf[3]);
-            } else if (self_p->frame.left == 127) {
-                if (socket_read(&self_p->server.socket, &buf[2], 8) != 8) {
-                    return (-EIO);
-                }
-
-                self_p->frame.left = ((uint32_t)(buf[6]) << 24
-                                      | (uint32_t)(buf[7]) << 16
-                                      | (uint32_t)(buf[8]) << 8
-                                      | buf[9]);
-            }
-
-            if (buf[1] & INET_HTTP_WEBSOCKET_MASK) {
-                if (socket_read(&self_p->server.socket, buf, 4) != 4) {
-                    return (-EIO);
-                }
-            }
-        }
-    }
-
-    return (size);
+    return (http_websocket_read(&self_p->websocket, NULL, buf_p, size));
 }
 
 ssize_t http_websocket_client_write(struct http_websocket_client_t *self_p,
@@ -197,47 +191,5 @@ ssize_t http_websocket_client_write(struct http_websocket_client_t *self_p,
                                     const void *buf_p,
                                     size_t size)
 {
-    const uint8_t masking_key[4] = { 0x00, 0x00, 0x00, 0x00 };
-    uint8_t header[16];
-    size_t header_size = 2;
-
-    header[0] = (INET_HTTP_WEBSOCKET_FIN | type);
-
-    if (size < 126) {
-        header[1] = (INET_HTTP_WEBSOCKET_MASK | size);
-    } else if (size < 65536) {
-        header[1] = (INET_HTTP_WEBSOCKET_MASK | 126);
-        header[2] = ((size >> 8) & 0xff);
-        header[3] = ((size >> 0) & 0xff);
-        header_size += 2;
-    } else {
-        header[1] = (INET_HTTP_WEBSOCKET_MASK | 127);
-        header[2] = 0;
-        header[3] = 0;
-        header[4] = 0;
-        header[5] = 0;
-        header[6] = ((size >> 24) & 0xff);
-        header[7] = ((size >> 16) & 0xff);
-        header[8] = ((size >>  8) & 0xff);
-        header[9] = ((size >>  0) & 0xff);
-        header_size += 8;
-    }
-
-    header[header_size + 0] = masking_key[0];
-    header[header_size + 1] = masking_key[1];
-    header[header_size + 2] = masking_key[2];
-    header[header_size + 3] = masking_key[3];
-    header_size += 4;
-
-    if (socket_write(&self_p->server.socket,
-                     header,
-                     header_size) != header_size) {
-        return (-EIO);
-    }
-
-    if (socket_write(&self_p->server.socket, buf_p, size) != size) {
-        return (-EIO);
-    }
-
-    return (size);
+    return (http_websocket_write(&self_p->websocket, type, buf_p, size));
 }
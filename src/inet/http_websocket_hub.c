@@ -0,0 +1,247 @@
+/**
+ * @file http_websocket_hub.c
+ * @version 0.5.0
+ *
+ * @section License
+ * Copyright (C) 2016, Erik Moqvist
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Simba project.
+ */
+
+#include "simba.h"
+
+/* Encoded frame header stored in front of the message in the heap
+   buffer. The subscriber queues refer to frames. */
+struct frame_t {
+    size_t size;
+    size_t header_size;
+    uint8_t header[HTTP_WEBSOCKET_HEADER_SIZE_MAX];
+};
+
+static struct frame_t *buf_to_frame(void *buf_p)
+{
+    return (&((struct frame_t *)buf_p)[-1]);
+}
+
+/**
+ * Add given message to the queue of given subscriber. The oldest
+ * frame is dropped if the queue is full. Called with the hub
+ * semaphore taken.
+ */
+static void enqueue(struct http_websocket_hub_t *self_p,
+                    struct http_websocket_hub_subscriber_t *subscriber_p,
+                    struct frame_t *frame_p)
+{
+    size_t wr;
+
+    if (subscriber_p->queue.length == HTTP_WEBSOCKET_HUB_QUEUE_DEPTH) {
+        heap_free(self_p->heap_p,
+                  subscriber_p->queue.frames[subscriber_p->queue.rd]);
+        subscriber_p->queue.frames[subscriber_p->queue.rd] = frame_p;
+        subscriber_p->queue.rd++;
+
+        if (subscriber_p->queue.rd == HTTP_WEBSOCKET_HUB_QUEUE_DEPTH) {
+            subscriber_p->queue.rd = 0;
+        }
+
+        subscriber_p->dropped++;
+    } else {
+        wr = (subscriber_p->queue.rd + subscriber_p->queue.length);
+
+        if (wr >= HTTP_WEBSOCKET_HUB_QUEUE_DEPTH) {
+            wr -= HTTP_WEBSOCKET_HUB_QUEUE_DEPTH;
+        }
+
+        subscriber_p->queue.frames[wr] = frame_p;
+        subscriber_p->queue.length++;
+        sem_put(&subscriber_p->sem, 1);
+    }
+}
+
+int http_websocket_hub_init(struct http_websocket_hub_t *self_p,
+                            struct heap_t *heap_p)
+{
+    self_p->heap_p = heap_p;
+    self_p->subscribers_p = NULL;
+
+    return (sem_init(&self_p->sem, 1));
+}
+
+int http_websocket_hub_subscribe(struct http_websocket_hub_t *self_p,
+                                 struct http_websocket_hub_subscriber_t *subscriber_p,
+                                 struct socket_t *socket_p)
+{
+    subscriber_p->socket_p = socket_p;
+    subscriber_p->queue.rd = 0;
+    subscriber_p->queue.length = 0;
+    subscriber_p->dropped = 0;
+    sem_init(&subscriber_p->sem, 0);
+
+    sem_get(&self_p->sem, NULL);
+    subscriber_p->next_p = self_p->subscribers_p;
+    self_p->subscribers_p = subscriber_p;
+    sem_put(&self_p->sem, 1);
+
+    return (0);
+}
+
+int http_websocket_hub_unsubscribe(struct http_websocket_hub_t *self_p,
+                                   struct http_websocket_hub_subscriber_t *subscriber_p)
+{
+    struct http_websocket_hub_subscriber_t **subscriber_pp;
+    int res;
+
+    res = -1;
+
+    sem_get(&self_p->sem, NULL);
+
+    subscriber_pp = &self_p->subscribers_p;
+
+    while (*subscriber_pp != NULL) {
+        if (*subscriber_pp == subscriber_p) {
+            *subscriber_pp = subscriber_p->next_p;
+            res = 0;
+            break;
+        }
+
+        subscriber_pp = &(*subscriber_pp)->next_p;
+    }
+
+    /* Drop frames not yet written. */
+    while (subscriber_p->queue.length > 0) {
+        heap_free(self_p->heap_p,
+                  subscriber_p->queue.frames[subscriber_p->queue.rd]);
+        subscriber_p->queue.rd++;
+
+        if (subscriber_p->queue.rd == HTTP_WEBSOCKET_HUB_QUEUE_DEPTH) {
+            subscriber_p->queue.rd = 0;
+        }
+
+        subscriber_p->queue.length--;
+    }
+
+    sem_put(&self_p->sem, 1);
+
+    return (res);
+}
+
+void *http_websocket_hub_alloc(struct http_websocket_hub_t *self_p,
+                               size_t size)
+{
+    struct frame_t *frame_p;
+
+    frame_p = heap_alloc(self_p->heap_p, sizeof(*frame_p) + size);
+
+    if (frame_p == NULL) {
+        return (NULL);
+    }
+
+    return (&frame_p[1]);
+}
+
+int http_websocket_hub_broadcast(struct http_websocket_hub_t *self_p,
+                                 int type,
+                                 void *buf_p,
+                                 size_t size)
+{
+    struct frame_t *frame_p;
+    struct http_websocket_hub_subscriber_t *subscriber_p;
+    int count;
+
+    /* Encode the header once for all subscribers. Server frames are
+       not masked. */
+    frame_p = buf_to_frame(buf_p);
+    frame_p->size = size;
+    frame_p->header_size = http_websocket_encode_header(frame_p->header,
+                                                        type,
+                                                        1,
+                                                        NULL,
+                                                        size);
+
+    sem_get(&self_p->sem, NULL);
+
+    count = 0;
+    subscriber_p = self_p->subscribers_p;
+
+    while (subscriber_p != NULL) {
+        count++;
+        subscriber_p = subscriber_p->next_p;
+    }
+
+    if (count == 0) {
+        heap_free(self_p->heap_p, frame_p);
+    } else {
+        /* One reference per subscriber. */
+        heap_share(self_p->heap_p, frame_p, count - 1);
+        subscriber_p = self_p->subscribers_p;
+
+        while (subscriber_p != NULL) {
+            enqueue(self_p, subscriber_p, frame_p);
+            subscriber_p = subscriber_p->next_p;
+        }
+    }
+
+    sem_put(&self_p->sem, 1);
+
+    return (count);
+}
+
+ssize_t http_websocket_hub_write(struct http_websocket_hub_t *self_p,
+                                 struct http_websocket_hub_subscriber_t *subscriber_p)
+{
+    struct frame_t *frame_p;
+    struct socket_iov_t iov[2];
+    ssize_t res;
+
+    if (sem_get(&subscriber_p->sem, NULL) != 0) {
+        return (-EIO);
+    }
+
+    sem_get(&self_p->sem, NULL);
+
+    /* The queue was emptied by an unsubscribe. */
+    if (subscriber_p->queue.length == 0) {
+        sem_put(&self_p->sem, 1);
+
+        return (-ENOENT);
+    }
+
+    frame_p = subscriber_p->queue.frames[subscriber_p->queue.rd];
+    subscriber_p->queue.rd++;
+
+    if (subscriber_p->queue.rd == HTTP_WEBSOCKET_HUB_QUEUE_DEPTH) {
+        subscriber_p->queue.rd = 0;
+    }
+
+    subscriber_p->queue.length--;
+
+    sem_put(&self_p->sem, 1);
+
+    /* Write the shared header and message. */
+    iov[0].buf_p = frame_p->header;
+    iov[0].size = frame_p->header_size;
+    iov[1].buf_p = &frame_p[1];
+    iov[1].size = frame_p->size;
+
+    res = socket_writev(subscriber_p->socket_p, iov, membersof(iov), 0);
+
+    if (res == (frame_p->header_size + frame_p->size)) {
+        res = frame_p->size;
+    } else {
+        res = -EIO;
+    }
+
+    heap_free(self_p->heap_p, frame_p);
+
+    return (res);
+}
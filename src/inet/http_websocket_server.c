@@ -24,6 +24,58 @@ int http_websocket_server_init(struct http_websocket_server_t *self_p,
                                struct socket_t *socket_p)
 {
     self_p->socket_p = socket_p;
+    self_p->deflate_p = NULL;
+
+    return (http_websocket_init(&self_p->websocket, socket_p, 0));
+}
+
+/**
+ * Returns true(1) if the permessage-deflate extension offer in given
+ * request can be accepted.
+ */
+static int is_deflate_acceptable(struct http_websocket_server_t *self_p,
+                                 struct http_server_request_t *request_p)
+{
+    const char *value_p;
+    const char *bits_p;
+
+    if ((self_p->deflate_p == NULL)
+        || (request_p->headers.sec_websocket_extensions.present == 0)) {
+        return (0);
+    }
+
+    value_p = request_p->headers.sec_websocket_extensions.value;
+
+    if (strstr(value_p, "permessage-deflate") == NULL) {
+        return (0);
+    }
+
+    /* The client window must fit in the decompressor window. */
+    if (strstr(value_p, "client_max_window_bits") == NULL) {
+        return (0);
+    }
+
+    /* The compressor keeps its window between messages and uses
+       DEFLATE_WINDOW_BITS. */
+    if (strstr(value_p, "server_no_context_takeover") != NULL) {
+        return (0);
+    }
+
+    bits_p = strstr(value_p, "server_max_window_bits=");
+
+    if (bits_p != NULL) {
+        if (atoi(&bits_p[23]) < DEFLATE_WINDOW_BITS) {
+            return (0);
+        }
+    }
+
+    return (1);
+}
+
+int http_websocket_server_enable_deflate(struct http_websocket_server_t *self_p,
+                                         struct http_websocket_deflate_t *deflate_p)
+{
+    self_p->deflate_p = deflate_p;
 
     return (0);
 }
@@ -31,8 +83,9 @@ int http_websocket_server_init(struct http_websocket_server_t *self_p,
 int http_websocket_server_handshake(struct http_websocket_server_t *self_p,
                                     struct http_server_request_t *request_p)
 {
-    char buf[160];
+    char buf[256];
     char accept_key[29];
+    char extensions[112];
     const char *key_p;
     struct hash_sha1_t sha;
     uint8_t hash[20];
@@ -65,20 +118,38 @@ int http_websocket_server_handshake(struct http_websocket_server_t *self_p,
 
     base64_encode(accept_key, hash, sizeof(hash));
     accept_key[sizeof(accept_key) - 1] = '\0';
-    
+
+    extensions[0] = '\0';
+
+    if (is_deflate_acceptable(self_p, request_p)) {
+        std_sprintf(extensions,
+                    FSTR("Sec-WebSocket-Extensions: permessage-deflate; "
+                         "server_max_window_bits=%d; "
+                         "client_max_window_bits=%d\r\n"),
+                    DEFLATE_WINDOW_BITS,
+                    DEFLATE_WINDOW_BITS);
+    }
+
     /* Format and write the websocket handshake response to the
        client. */
     size = std_sprintf(buf,
                        FSTR("HTTP/1.1 101 Switching Protocols\r\n"
                             "Connection: Upgrade\r\n"
                             "Sec-WebSocket-Accept: %s\r\n"
+                            "%s"
                             "\r\n"),
-                       accept_key);
+                       accept_key,
+                       extensions);
 
     if (socket_write(self_p->socket_p, buf, size) != size) {
         return (-EIO);
     }
 
+    if (extensions[0] != '\0') {
+        return (http_websocket_enable_deflate(&self_p->websocket,
+                                              self_p->deflate_p));
+    }
+
     return (0);
 }
 
@@ -87,71 +158,7 @@ ssize_t http_websocket_server_read(struct http_websocket_server_t *self_p,
                                    void *buf_p,
                                    size_t size)
 {
-    uint8_t buf[16], *b_p = buf_p;
-    size_t payload_left, left = size, n;
-    int fin = 0;
-
-    while (fin == 0) {
-        /* Read the next frame. */
-        if (socket_read(self_p->socket_p, buf, 2) != 2) {
-            return (-EIO);
-        }
-
-        fin = (buf[0] & INET_HTTP_WEBSOCKET_FIN);
-        payload_left = (buf[1] & ~INET_HTTP_WEBSOCKET_MASK);
-        
-        if (payload_left == 126) {
-            if (socket_read(self_p->socket_p, &buf[2], 2) != 2) {
-                return (-EIO);
-            }
-            
-            payload_left = ((uint32_t)(buf[2]) << 8 | buf[3]);
-        } else if (payload_left == 127) {
-            if (socket_read(self_p->socket_p, &buf[2], 8) != 8) {
-                return (-EIO);
-            }
-            
-            payload_left = ((uint32_t)(buf[6]) << 24
-                    | (uint32_t)(buf[7]) << 16
-                    | (uint32_t)(buf[8]) << 8
-                    | buf[9]);
-        }
-        
-        /* Read the mask. */
-        if (buf[1] & INET_HTTP_WEBSOCKET_MASK) {
-            if (socket_read(self_p->socket_p, buf, 4) != 4) {
-                return (-EIO);
-            }
-        }
-
-        /* Read the payload. */
-        while ((payload_left > 0) && (left > 0)) {
-            if (payload_left < left) {
-                n = payload_left;
-            } else {
-                n = left;
-            }
-
-            if (socket_read(self_p->socket_p, b_p, n) != n) {
-                return (-1);
-            }
-
-            b_p += n;            
-            left -= n;
-            payload_left -= n;
-        }
-
-        /* Discard leftover data. */
-        while (payload_left > 0) {
-            if (socket_read(self_p->socket_p, buf, 1) != 1) {
-                return (-1);
-            }
-
-            payload_left--;
-        }
-    }
-
-    return (size - left);
+    return (http_websocket_read(&self_p->websocket, type_p, buf_p, size));
 }
 
 ssize_t http_websocket_server_write(struct http_websocket_server_t *self_p,
@@ -159,47 +166,5 @@ ssize_t http_websocket_server_write(struct http_websocket_server_t *self_p,
                                     const void *buf_p,
                                     size_t size)
 {
-    const uint8_t masking_key[4] = { 0x00, 0x00, 0x00, 0x00 };
-    uint8_t header[16];
-    size_t header_size = 2;
-    
-    header[0] = (INET_HTTP_WEBSOCKET_FIN | type);
-
-    if (size < 126) {
-        header[1] = (INET_HTTP_WEBSOCKET_MASK | size);
-    } else if (size < 65536) {
-        header[1] = (INET_HTTP_WEBSOCKET_MASK | 126);
-        header[2] = ((size >> 8) & 0xff);
-        header[3] = ((size >> 0) & 0xff);
-        header_size += 2;
-    } else {
-        header[1] = (INET_HTTP_WEBSOCKET_MASK | 127);
-        header[2] = 0;
-        header[3] = 0;
-        header[4] = 0;
-        header[5] = 0;
-        header[6] = ((size >> 24) & 0xff);
-        header[7] = ((size >> 16) & 0xff);
-        header[8] = ((size >>  8) & 0xff);
-        header[9] = ((size >>  0) & 0xff);
-        header_size += 8;
-    }
-
-    header[header_size + 0] = masking_key[0];
-    header[header_size + 1] = masking_key[1];
-    header[header_size + 2] = masking_key[2];
-    header[header_size + 3] = masking_key[3];
-    header_size += 4;
-
-    if (socket_write(self_p->socket_p,
-                     header,
-                     header_size) != header_size) {
-        return (-EIO);
-    }
-
-    if (socket_write(self_p->socket_p, buf_p, size) != size) {
-        return (-EIO);
-    }
-
-    return (size);
+    return (http_websocket_write(&self_p->websocket, type, buf_p, size));
 }
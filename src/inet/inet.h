@@ -24,6 +24,8 @@
 #include "inet/types.h"
 #include "inet/socket.h"
 #include "inet/http_server.h"
+#include "inet/http_websocket.h"
+#include "inet/http_websocket_hub.h"
 #include "inet/http_websocket_server.h"
 #include "inet/http_websocket_client.h"
 
@@ -18,13 +18,33 @@
 # This file is part of the Simba project.
 #
 
-# The inet package can only be used by the ESP.
+# The inet package is available on the ESP, using lwIP, and on Linux,
+# using BSD sockets.
+ifeq ($(ARCH),linux)
+    INC += $(SIMBA_ROOT)/src/inet
+    INC += $(SIMBA_ROOT)/src/inet/ports/linux
+
+    # For recvmmsg() and sendmmsg().
+    CDEFS += -D_GNU_SOURCE
+
+    INET_SRC ?= \
+	socket.c \
+	http_server.c \
+	http_websocket.c \
+	http_websocket_hub.c \
+	http_websocket_server.c \
+	http_websocket_client.c
+endif
+
 ifneq (,$(filter $(BOARD), esp12e esp01))
     INC += $(SIMBA_ROOT)/src/inet
+    INC += $(SIMBA_ROOT)/src/inet/ports/esp
 
     INET_SRC ?= \
 	socket.c \
 	http_server.c \
+	http_websocket.c \
+	http_websocket_hub.c \
 	http_websocket_server.c \
 	http_websocket_client.c
 endif
@@ -23,6 +23,24 @@
 
 #include "simba.h"
 
+/**
+ * Size of the streaming response buffer. Small writes are coalesced
+ * into chunks of this size, which should be the TCP maximum segment
+ * size (MSS) of the network stack.
+ */
+#define HTTP_SERVER_RESPONSE_STREAM_BUFFER_SIZE 536
+
+/**
+ * Number of seconds to wait for more data from a client while
+ * receiving its request. The connection is closed when the timeout
+ * expires, so a client that stops sending cannot occupy a
+ * connection thread forever. The route callback is called without a
+ * receive timeout.
+ */
+#ifndef HTTP_SERVER_REQUEST_TIMEOUT
+#    define HTTP_SERVER_REQUEST_TIMEOUT 10
+#endif
+
 /**
  * Request action types.
  */
@@ -43,7 +61,14 @@ enum http_server_content_type_t {
  */
 enum http_server_response_code_t {
     http_server_response_code_200_ok_t = 200,
-    http_server_response_code_404_not_found_t = 404
+    http_server_response_code_201_created_t = 201,
+    http_server_response_code_204_no_content_t = 204,
+    http_server_response_code_206_partial_content_t = 206,
+    http_server_response_code_304_not_modified_t = 304,
+    http_server_response_code_400_bad_request_t = 400,
+    http_server_response_code_404_not_found_t = 404,
+    http_server_response_code_416_range_not_satisfiable_t = 416,
+    http_server_response_code_500_internal_server_error_t = 500
 };
 
 /**
@@ -65,6 +90,26 @@ struct http_server_request_t {
             int present;
             char value[32];
         } sec_websocket_key;
+        struct {
+            int present;
+            char value[64];
+        } sec_websocket_extensions;
+        struct {
+            int present;
+            char value[32];
+        } range;
+        struct {
+            int present;
+            char value[32];
+        } if_none_match;
+        struct {
+            int present;
+            char value[32];
+        } if_modified_since;
+        struct {
+            int present;
+            char value[32];
+        } accept_encoding;
     } headers;
 };
 
@@ -93,6 +138,23 @@ struct http_server_response_t {
 
 struct http_server_connection_t;
 
+/**
+ * Streaming HTTP response with a body of unknown size.
+ */
+struct http_server_response_stream_t {
+    /* Output channel of the compressor. */
+    struct chan_t base;
+    struct http_server_connection_t *connection_p;
+    /* Compressor of a gzip encoded body, or NULL. */
+    struct deflate_t *deflate_p;
+    struct {
+        /* Offset of the chunk data in the buffer. */
+        size_t offset;
+        size_t size;
+        char buf[HTTP_SERVER_RESPONSE_STREAM_BUFFER_SIZE];
+    } chunk;
+};
+
 typedef int (*http_server_route_callback_t)(struct http_server_connection_t *connection_p,
                                             struct http_server_request_t *request_p);
 
@@ -201,4 +263,108 @@ int http_server_response_write(struct http_server_connection_t *connection_p,
                                struct http_server_request_t *request_p,
                                struct http_server_response_t *response_p);
 
+/**
+ * Write the file at the request path to given connected client. The
+ * path is relative to the server root path, and a path ending with a
+ * slash is served as ``INDEX.HTM`` in that directory. The file is
+ * streamed from given file system in block sized chunks, and is never
+ * buffered as a whole.
+ *
+ * The response has ``ETag`` and ``Last-Modified`` headers. Requests
+ * with a matching ``If-None-Match`` or ``If-Modified-Since`` header
+ * are answered with ``304 Not Modified``, and a single byte range in
+ * a ``Range`` header is answered with ``206 Partial Content``.
+ *
+ * Pre-compressed copies of the files can be stored with the same path
+ * in the ``GZ`` directory of the root path. A compressed copy is sent
+ * with ``Content-Encoding: gzip`` to clients accepting gzip.
+ *
+ * This function should only be called from the route callbacks to
+ * respond to given request.
+ *
+ * @param[in] connection_p Current connection.
+ * @param[in] request_p Current request.
+ * @param[in] fs_p Mounted file system to read the file from.
+ *
+ * @return zero(0), -ENOENT if the file does not exist, in which case
+ *         nothing is written to the client, or negative error code.
+ */
+int http_server_response_write_file(struct http_server_connection_t *connection_p,
+                                    struct http_server_request_t *request_p,
+                                    struct fat16_t *fs_p);
+
+/**
+ * Begin a streaming response to given connected client. The body is
+ * written with `http_server_response_stream_write()` and sent using
+ * chunked transfer encoding, so its size does not have to be known in
+ * advance. The status line and the header are sent together with the
+ * first chunk.
+ *
+ * This function should only be called from the route callbacks to
+ * respond to given request.
+ *
+ * @param[in] self_p Response stream to begin.
+ * @param[in] connection_p Current connection.
+ * @param[in] code Response status code.
+ * @param[in] content_type_p Content type, for example
+ *                           ``application/json``.
+ * @param[in] content_encoding_p Content encoding of the written data,
+ *                               for example ``gzip`` for pre-compressed
+ *                               data, or NULL if not encoded.
+ *
+ * @return zero(0) or negative error code.
+ */
+int http_server_response_stream_begin(struct http_server_response_stream_t *self_p,
+                                      struct http_server_connection_t *connection_p,
+                                      int code,
+                                      const char *content_type_p,
+                                      const char *content_encoding_p);
+
+/**
+ * Begin a streaming response to given connected client, just as
+ * `http_server_response_stream_begin()`, but compress the written
+ * data with gzip. Only use this function if the ``Accept-Encoding``
+ * header of the request includes ``gzip``.
+ *
+ * @param[in] self_p Response stream to begin.
+ * @param[in] connection_p Current connection.
+ * @param[in] code Response status code.
+ * @param[in] content_type_p Content type, for example
+ *                           ``application/json``.
+ * @param[in] deflate_p Compressor to use. Must be valid until the
+ *                      stream is ended.
+ *
+ * @return zero(0) or negative error code.
+ */
+int http_server_response_stream_begin_gzip(struct http_server_response_stream_t *self_p,
+                                           struct http_server_connection_t *connection_p,
+                                           int code,
+                                           const char *content_type_p,
+                                           struct deflate_t *deflate_p);
+
+/**
+ * Write given data to given response stream. Small writes are
+ * buffered and sent in chunks of
+ * `HTTP_SERVER_RESPONSE_STREAM_BUFFER_SIZE` bytes.
+ *
+ * @param[in] self_p Started response stream.
+ * @param[in] buf_p Data to write.
+ * @param[in] size Number of bytes to write.
+ *
+ * @return Number of written bytes or negative error code.
+ */
+ssize_t http_server_response_stream_write(struct http_server_response_stream_t *self_p,
+                                          const void *buf_p,
+                                          size_t size);
+
+/**
+ * End given response stream. Buffered data is sent together with the
+ * last chunk. The compressed data is ended for gzip streams.
+ *
+ * @param[in] self_p Started response stream.
+ *
+ * @return zero(0) or negative error code.
+ */
+int http_server_response_stream_end(struct http_server_response_stream_t *self_p);
+
 #endif
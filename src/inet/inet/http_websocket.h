@@ -0,0 +1,214 @@
+/**
+ * @file inet/http_websocket.h
+ * @version 0.5.0
+ *
+ * @section License
+ * Copyright (C) 2016, Erik Moqvist
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Simba project.
+ */
+
+#ifndef __INET_HTTP_WEBSOCKET_H__
+#define __INET_HTTP_WEBSOCKET_H__
+
+#include "simba.h"
+
+/** Maximum size of an encoded frame header. */
+#define HTTP_WEBSOCKET_HEADER_SIZE_MAX 14
+
+/**
+ * Maximum payload size of the frames a compressed message is written
+ * in. Longer compressed messages are fragmented.
+ */
+#ifndef HTTP_WEBSOCKET_DEFLATE_FRAME_SIZE
+#    define HTTP_WEBSOCKET_DEFLATE_FRAME_SIZE 256
+#endif
+
+struct http_websocket_t;
+
+/* Frame of a compressed message being written. */
+struct http_websocket_deflate_frame_t {
+    struct chan_t base;
+    struct http_websocket_t *websocket_p;
+    int opcode;
+    size_t size;
+    uint8_t buf[HTTP_WEBSOCKET_DEFLATE_FRAME_SIZE];
+};
+
+/* Buffer of a compressed message being read. */
+struct http_websocket_deflate_message_t {
+    struct chan_t base;
+    uint8_t *buf_p;
+    size_t size;
+    size_t left;
+};
+
+/**
+ * State of the permessage-deflate extension of a websocket. The LZ77
+ * windows of both directions are kept between messages.
+ */
+struct http_websocket_deflate_t {
+    struct deflate_t deflate;
+    struct inflate_t inflate;
+    struct http_websocket_deflate_frame_t frame;
+    struct http_websocket_deflate_message_t message;
+};
+
+/**
+ * Websocket frame codec shared by the websocket server and
+ * client. Frames are read from data borrowed from the socket, so
+ * headers and payload are parsed without reading the socket one byte
+ * at a time.
+ */
+struct http_websocket_t {
+    struct socket_t *socket_p;
+    /* Mask written frames. Set on the client side. */
+    int mask;
+    /* Negotiated permessage-deflate extension, or NULL. */
+    struct http_websocket_deflate_t *deflate_p;
+    /* Received data borrowed from the socket. */
+    struct {
+        const uint8_t *buf_p;
+        size_t size;
+    } input;
+};
+
+/**
+ * Initialize given websocket frame codec.
+ *
+ * @param[in] self_p Websocket to initialize.
+ * @param[in] socket_p Connected socket.
+ * @param[in] mask true(1) to mask written frames, which clients must
+ *                 do, otherwise false(0). The masking key of each
+ *                 frame is generated with ``rand()``, so seed it
+ *                 with ``srand()`` for unpredictable keys.
+ *
+ * @return zero(0) or negative error code.
+ */
+int http_websocket_init(struct http_websocket_t *self_p,
+                        struct socket_t *socket_p,
+                        int mask);
+
+/**
+ * Compress written messages and decompress read messages with the
+ * permessage-deflate extension. Call this function once the extension
+ * has been negotiated in the handshake.
+ *
+ * @param[in] self_p Initialized websocket.
+ * @param[in] deflate_p Extension state. Must be valid as long as the
+ *                      websocket is used.
+ *
+ * @return zero(0) or negative error code.
+ */
+int http_websocket_enable_deflate(struct http_websocket_t *self_p,
+                                  struct http_websocket_deflate_t *deflate_p);
+
+/**
+ * Read a message from given websocket. Fragmented messages are
+ * reassembled from their continuation frames. Ping frames are
+ * answered with a pong frame, and a close frame is answered with a
+ * close frame. Compressed messages are decompressed.
+ *
+ * @param[in] self_p Websocket to read from.
+ * @param[out] type_p Read message type, ``HTTP_TYPE_TEXT`` or
+ *                    ``HTTP_TYPE_BINARY``. May be NULL.
+ * @param[in] buf_p Buffer to read into.
+ * @param[in] size Size of the buffer. Longer messages will be
+ *                 truncated and the leftover data dropped.
+ *
+ * @return Number of bytes read, zero(0) if the connection is closed,
+ *         or negative error code.
+ */
+ssize_t http_websocket_read(struct http_websocket_t *self_p,
+                            int *type_p,
+                            void *buf_p,
+                            size_t size);
+
+/**
+ * Write given message as a single frame to given websocket. If the
+ * permessage-deflate extension is enabled the message is compressed
+ * and written in frames of at most
+ * ``HTTP_WEBSOCKET_DEFLATE_FRAME_SIZE`` bytes instead.
+ *
+ * @param[in] self_p Websocket to write to.
+ * @param[in] type One of ``HTTP_TYPE_TEXT`` and ``HTTP_TYPE_BINARY``.
+ * @param[in] buf_p Buffer to write.
+ * @param[in] size Number of bytes to write.
+ *
+ * @return Number of bytes written or negative error code.
+ */
+ssize_t http_websocket_write(struct http_websocket_t *self_p,
+                             int type,
+                             const void *buf_p,
+                             size_t size);
+
+/**
+ * Write a frame to given websocket. Use this function to send
+ * fragmented messages and control frames. The payload is never
+ * compressed.
+ *
+ * @param[in] self_p Websocket to write to.
+ * @param[in] opcode Frame opcode, one of the
+ *                   ``INET_HTTP_WEBSOCKET_OPCODE_*`` defines.
+ * @param[in] fin true(1) if this is the last frame in the message,
+ *                otherwise false(0).
+ * @param[in] buf_p Payload to write.
+ * @param[in] size Payload size.
+ *
+ * @return Number of payload bytes written or negative error code.
+ */
+ssize_t http_websocket_write_frame(struct http_websocket_t *self_p,
+                                   int opcode,
+                                   int fin,
+                                   const void *buf_p,
+                                   size_t size);
+
+/**
+ * Encode a frame header into given buffer.
+ *
+ * @param[out] buf_p Buffer of at least ``HTTP_WEBSOCKET_HEADER_SIZE_MAX``
+ *                   bytes to encode the header into.
+ * @param[in] opcode Frame opcode.
+ * @param[in] fin true(1) if this is the last frame in the message,
+ *                otherwise false(0).
+ * @param[in] masking_key_p Four bytes masking key of a masked frame,
+ *                          or NULL.
+ * @param[in] size Payload size.
+ *
+ * @return Header size.
+ */
+size_t http_websocket_encode_header(uint8_t *buf_p,
+                                    int opcode,
+                                    int fin,
+                                    const uint8_t *masking_key_p,
+                                    size_t size);
+
+/**
+ * Unmask given buffer in place with given masking key. The key is
+ * applied starting at given offset into the key, which allows the
+ * payload of a frame to be unmasked in multiple calls. Whole words
+ * are unmasked at once.
+ *
+ * @param[in,out] buf_p Buffer to unmask.
+ * @param[in] size Buffer size.
+ * @param[in] key_p Four bytes masking key.
+ * @param[in] offset Offset into the masking key of the first byte.
+ *
+ * @return Offset into the masking key of the byte after the buffer.
+ */
+size_t http_websocket_unmask(void *buf_p,
+                             size_t size,
+                             const uint8_t *key_p,
+                             size_t offset);
+
+#endif
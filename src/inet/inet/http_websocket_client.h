@@ -32,10 +32,10 @@ struct http_websocket_client_t {
         const char *host_p;
         int port;
     } server;
-    struct {
-        size_t left;
-    } frame;
+    struct http_websocket_t websocket;
     const char *path_p;
+    /* Offered permessage-deflate extension state, or NULL. */
+    struct http_websocket_deflate_t *deflate_p;
 };
 
 /**
@@ -53,6 +53,21 @@ int http_websocket_client_init(struct http_websocket_client_t *self_p,
                                int port,
                                const char *path_p);
 
+/**
+ * Offer the permessage-deflate extension to the server in the
+ * handshake. The server window is limited to ``DEFLATE_WINDOW_BITS``
+ * with the ``server_max_window_bits`` parameter. Call this function
+ * before `http_websocket_client_connect()`.
+ *
+ * @param[in] self_p Initialized http.
+ * @param[in] deflate_p Extension state used if the server accepts
+ *                      the extension.
+ *
+ * @return zero(0) or negative error code.
+ */
+int http_websocket_client_enable_deflate(struct http_websocket_client_t *self_p,
+                                         struct http_websocket_deflate_t *deflate_p);
+
 /**
  * Connect given http to the server.
  *
@@ -0,0 +1,144 @@
+/**
+ * @file inet/http_websocket_hub.h
+ * @version 0.5.0
+ *
+ * @section License
+ * Copyright (C) 2016, Erik Moqvist
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Simba project.
+ */
+
+#ifndef __INET_HTTP_WEBSOCKET_HUB_H__
+#define __INET_HTTP_WEBSOCKET_HUB_H__
+
+#include "simba.h"
+
+/* Maximum number of frames queued per subscriber. The oldest frame
+   is dropped when a new frame is broadcasted to a full queue. */
+#ifndef HTTP_WEBSOCKET_HUB_QUEUE_DEPTH
+#    define HTTP_WEBSOCKET_HUB_QUEUE_DEPTH 4
+#endif
+
+struct http_websocket_hub_subscriber_t {
+    struct socket_t *socket_p;
+    /* Shared frames not yet written to the client. */
+    struct {
+        void *frames[HTTP_WEBSOCKET_HUB_QUEUE_DEPTH];
+        size_t rd;
+        size_t length;
+    } queue;
+    /* Number of queued frames. */
+    struct sem_t sem;
+    /** Number of frames dropped because the client did not keep
+        up. */
+    unsigned long dropped;
+    struct http_websocket_hub_subscriber_t *next_p;
+};
+
+/**
+ * A broadcast hub sends the same message to all subscribed websocket
+ * clients. Each message is encoded once into a buffer allocated from
+ * a heap, and the buffer is shared by all subscribers.
+ */
+struct http_websocket_hub_t {
+    struct heap_t *heap_p;
+    /* Protects the subscriber list and queues. */
+    struct sem_t sem;
+    struct http_websocket_hub_subscriber_t *subscribers_p;
+};
+
+/**
+ * Initialize given broadcast hub.
+ *
+ * @param[in] self_p Hub to initialize.
+ * @param[in] heap_p Heap to allocate messages from.
+ *
+ * @return zero(0) or negative error code.
+ */
+int http_websocket_hub_init(struct http_websocket_hub_t *self_p,
+                            struct heap_t *heap_p);
+
+/**
+ * Subscribe given websocket connection to all messages broadcasted
+ * by given hub.
+ *
+ * @param[in] self_p Hub.
+ * @param[in] subscriber_p Subscriber to initialize and add to the hub.
+ * @param[in] socket_p Socket of a websocket connection that has
+ *                     completed its handshake.
+ *
+ * @return zero(0) or negative error code.
+ */
+int http_websocket_hub_subscribe(struct http_websocket_hub_t *self_p,
+                                 struct http_websocket_hub_subscriber_t *subscriber_p,
+                                 struct socket_t *socket_p);
+
+/**
+ * Remove given subscriber from given hub. Frames not yet written are
+ * dropped.
+ *
+ * @param[in] self_p Hub.
+ * @param[in] subscriber_p Subscriber to remove.
+ *
+ * @return zero(0) or negative error code.
+ */
+int http_websocket_hub_unsubscribe(struct http_websocket_hub_t *self_p,
+                                   struct http_websocket_hub_subscriber_t *subscriber_p);
+
+/**
+ * Allocate a message buffer from the heap of given hub. Fill it with
+ * the message and pass it to `http_websocket_hub_broadcast()`.
+ *
+ * @param[in] self_p Hub.
+ * @param[in] size Message size.
+ *
+ * @return Message buffer or NULL if out of memory.
+ */
+void *http_websocket_hub_alloc(struct http_websocket_hub_t *self_p,
+                               size_t size);
+
+/**
+ * Queue given message on all subscribers of given hub. The frame
+ * header is encoded once and the message buffer is shared by all
+ * subscribers. This function never waits for slow subscribers; the
+ * oldest queued frame of a subscriber with a full queue is dropped
+ * instead. The hub owns the buffer after this call.
+ *
+ * @param[in] self_p Hub.
+ * @param[in] type One of ``HTTP_TYPE_TEXT`` and ``HTTP_TYPE_BINARY``.
+ * @param[in] buf_p Message buffer allocated with
+ *                  `http_websocket_hub_alloc()`.
+ * @param[in] size Message size.
+ *
+ * @return Number of subscribers the message was queued on or
+ *         negative error code.
+ */
+int http_websocket_hub_broadcast(struct http_websocket_hub_t *self_p,
+                                 int type,
+                                 void *buf_p,
+                                 size_t size);
+
+/**
+ * Wait for the next queued frame of given subscriber and write it to
+ * the client. Call this function in a loop from the connection
+ * thread of the subscriber.
+ *
+ * @param[in] self_p Hub.
+ * @param[in] subscriber_p Subscriber.
+ *
+ * @return Number of written payload bytes or negative error code.
+ */
+ssize_t http_websocket_hub_write(struct http_websocket_hub_t *self_p,
+                                 struct http_websocket_hub_subscriber_t *subscriber_p);
+
+#endif
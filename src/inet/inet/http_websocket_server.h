@@ -28,6 +28,9 @@
 
 struct http_websocket_server_t {
     struct socket_t *socket_p;
+    struct http_websocket_t websocket;
+    /* Accepted permessage-deflate extension state, or NULL. */
+    struct http_websocket_deflate_t *deflate_p;
 };
 
 /**
@@ -42,6 +45,22 @@ struct http_websocket_server_t {
 int http_websocket_server_init(struct http_websocket_server_t *self_p,
                                struct socket_t *socket_p);
 
+/**
+ * Accept the permessage-deflate extension if offered by the client
+ * in the handshake. The client must offer the
+ * ``client_max_window_bits`` parameter, as the client window may not
+ * be larger than ``DEFLATE_WINDOW_BITS``. Call this function before
+ * `http_websocket_server_handshake()`.
+ *
+ * @param[in] self_p Initialized websocket server.
+ * @param[in] deflate_p Extension state used if the extension is
+ *                      accepted.
+ *
+ * @return zero(0) or negative error code.
+ */
+int http_websocket_server_enable_deflate(struct http_websocket_server_t *self_p,
+                                         struct http_websocket_deflate_t *deflate_p);
+
 /**
  * Read the handshake request from the client and send the handshake
  * response.
@@ -55,7 +74,9 @@ int http_websocket_server_handshake(struct http_websocket_server_t *self_p,
                                     struct http_server_request_t *request_p);
 
 /**
- * Read a message from given websocket.
+ * Read a message from given websocket. Fragmented messages are
+ * reassembled and control frames are handled as described in
+ * `http_websocket_read()`.
  *
  * @param[in] self_p Websocket to read from.
  * @param[out] type_p Read message type.
@@ -63,7 +84,8 @@ int http_websocket_server_handshake(struct http_websocket_server_t *self_p,
  * @param[in] size Number of bytes to read. Longer messages will be
  *                 truncated and the leftover data dropped.
  *
- * @return Number of bytes read or negative error code.
+ * @return Number of bytes read, zero(0) if the connection is closed,
+ *         or negative error code.
  */
 ssize_t http_websocket_server_read(struct http_websocket_server_t *self_p,
                                    int *type_p,
@@ -32,6 +32,33 @@
 /** UDP socket type. */
 #define SOCKET_TYPE_DGRAM      2
 
+/** The written buffers are never modified or freed, for example
+    constant data, so the network stack may refer to them instead of
+    copying them. TCP writes with this flag fail with -EINVAL on ESP,
+    where lwip would refer to the buffers until the data is
+    acknowledged without telling the writer. */
+#define SOCKET_FLAG_NO_COPY    0x1
+
+/** Do not wait for the operation to complete. -EAGAIN is returned if
+    the operation would have to wait. */
+#define SOCKET_FLAG_DONT_WAIT  0x2
+
+/** Maximum number of received TCP segments queued per socket before
+    the network stack is told to hold back further segments. Only used
+    by ports where the network stack hands over received segments to
+    the socket. */
+#ifndef SOCKET_TCP_RECV_QUEUE_DEPTH
+#    define SOCKET_TCP_RECV_QUEUE_DEPTH 4
+#endif
+
+/** Maximum number of received UDP datagrams queued per socket. A
+    datagram received when the queue is full is dropped and counted
+    by ``/inet/socket/udp/rx_dropped``. Only used by ports where the
+    network stack hands over received datagrams to the socket. */
+#ifndef SOCKET_UDP_RECV_QUEUE_DEPTH
+#    define SOCKET_UDP_RECV_QUEUE_DEPTH 8
+#endif
+
 struct socket_addr_t {
     /** IPv4 address. */
     uint32_t ip;
@@ -39,24 +66,43 @@ struct socket_addr_t {
     uint16_t port;
 };
 
+/**
+ * A buffer in an io vector.
+ */
+struct socket_iov_t {
+    void *buf_p;
+    size_t size;
+};
+
+/**
+ * A datagram in a batch of datagrams.
+ */
+struct socket_msg_t {
+    /** Datagram buffer. */
+    void *buf_p;
+    /** Size of the datagram to send, or size of the buffer to receive
+        into. */
+    size_t size;
+    /** Number of sent or received bytes. */
+    size_t length;
+    /** Remote address to send to, or the address a datagram was
+        received from. */
+    struct socket_addr_t addr;
+};
+
+#include "socket_port.h"
+
 struct socket_t {
     struct chan_t base;
     int type;
+    /* Receive and send timeouts, NULL to wait forever. */
     struct {
-        struct {
-            volatile int reading;
-            struct {
-                void * volatile buf_p;
-                volatile size_t size;
-                volatile size_t offset;
-            } pbuf;
-        } recv;
-        void *buf_p;
-        size_t size;
-        struct socket_addr_t remote_addr;
-        struct thrd_t * volatile thrd_p;
-    } io;
-    void *pcb_p;
+        struct time_t *recv_p;
+        struct time_t *send_p;
+        struct time_t recv;
+        struct time_t send;
+    } timeout;
+    struct socket_port_t port;
 };
 
 /**
@@ -66,6 +112,17 @@ struct socket_t {
  */
 int socket_module_init(void);
 
+/**
+ * Convert given IPv4 address in dotted decimal notation, for example
+ * ``192.168.0.5``, to an address in network byte order.
+ *
+ * @param[in] src_p Address string to convert.
+ * @param[out] dst_p Converted address.
+ *
+ * @return zero(0) or negative error code.
+ */
+int socket_inet_aton(const char *src_p, uint32_t *dst_p);
+
 /**
  * Initialize given socket with given domain, type and protocol.
  *
@@ -145,13 +202,47 @@ int socket_accept(struct socket_t *self_p,
                   struct socket_addr_t *remote_addr_p,
                   size_t *addrlen_p);
 
+/**
+ * Set the receive timeout of given socket. Receive functions and
+ * `socket_accept()` return -ETIMEDOUT if no data, or connection, is
+ * received within the timeout, unless some data was received. A zero
+ * timeout makes the receive functions non-blocking; -EAGAIN is
+ * returned instead of waiting.
+ *
+ * @param[in] self_p Socket.
+ * @param[in] timeout_p Receive timeout, or NULL to wait forever,
+ *                      which is the default.
+ *
+ * @return zero(0) or negative error code.
+ */
+int socket_set_recv_timeout(struct socket_t *self_p,
+                            const struct time_t *timeout_p);
+
+/**
+ * Set the send timeout of given socket. Send functions and
+ * `socket_connect()` return -ETIMEDOUT if they have to wait longer
+ * than the timeout, unless some data was sent. A zero timeout makes
+ * the send functions non-blocking; -EAGAIN is returned instead of
+ * waiting. Only used by ports where sending may wait for the network
+ * stack.
+ *
+ * @param[in] self_p Socket.
+ * @param[in] timeout_p Send timeout, or NULL to wait forever, which
+ *                      is the default.
+ *
+ * @return zero(0) or negative error code.
+ */
+int socket_set_send_timeout(struct socket_t *self_p,
+                            const struct time_t *timeout_p);
+
 /**
  * Write data to given socket.
  *
  * @param[in] self_p Socket.
  * @param[in] buf_p Buffer to send.
  * @param[in] size Size of buffer to send.
- * @param[in] flags Unused.
+ * @param[in] flags Zero(0) or more of ``SOCKET_FLAG_NO_COPY`` and
+ *                  ``SOCKET_FLAG_DONT_WAIT``.
  * @param[in] remote_addr_p Remote address to send the data to.
  * @param[in] addrlen Size of remote_addr.
  *
@@ -170,7 +261,7 @@ ssize_t socket_sendto(struct socket_t *self_p,
  * @param[in] self_p Socket.
  * @param[in] buf_p Buffer to read into.
  * @param[in] size Size of buffer to read.
- * @param[in] flags Unused.
+ * @param[in] flags Zero(0) or ``SOCKET_FLAG_DONT_WAIT``.
  * @param[in] remote_addr_p Remote address to receive data from.
  * @param[in] addrlen Length of remote_addr.
  *
@@ -209,4 +300,119 @@ ssize_t socket_read(struct socket_t *self_p,
                     void *buf_p,
                     size_t size);
 
+/**
+ * Get the number of bytes that can be read from given socket without
+ * waiting. It is at least one if a read would not wait, for example
+ * if the connection is closed, a zero length datagram is received or
+ * a client is waiting to be accepted. This is the size function of
+ * the socket channel, so sockets can be polled together with other
+ * channels with `chan_list_poll()`.
+ *
+ * @param[in] self_p Socket.
+ *
+ * @return Number of bytes available or negative error code.
+ */
+ssize_t socket_size(struct socket_t *self_p);
+
+/**
+ * Write the buffers in given io vector to given socket. The buffers
+ * are sent as a single stream of data, without first copying them
+ * into a common buffer. Only used by TCP sockets.
+ *
+ * @param[in] self_p Socket.
+ * @param[in] iov_p Io vector of buffers to send.
+ * @param[in] length Number of buffers in the io vector.
+ * @param[in] flags Zero(0) or more of ``SOCKET_FLAG_NO_COPY`` and
+ *                  ``SOCKET_FLAG_DONT_WAIT``.
+ *
+ * @return Number of written bytes or negative error code.
+ */
+ssize_t socket_writev(struct socket_t *self_p,
+                      const struct socket_iov_t *iov_p,
+                      size_t length,
+                      int flags);
+
+/**
+ * Read data from given socket into the buffers in given io
+ * vector. All buffers are filled unless the socket is closed. Only
+ * used by TCP sockets.
+ *
+ * @param[in] self_p Socket.
+ * @param[in] iov_p Io vector of buffers to read into.
+ * @param[in] length Number of buffers in the io vector.
+ *
+ * @return Number of read bytes or negative error code.
+ */
+ssize_t socket_readv(struct socket_t *self_p,
+                     struct socket_iov_t *iov_p,
+                     size_t length);
+
+/**
+ * Send given datagrams to their remote addresses. The network stack
+ * is entered once per batch on ports that support it, and send
+ * buffers are reused between the datagrams. Only used by UDP
+ * sockets.
+ *
+ * @param[in] self_p Socket.
+ * @param[in,out] msgs_p Datagrams to send. The length member of each
+ *                       sent datagram is set to the number of sent
+ *                       bytes.
+ * @param[in] length Number of datagrams.
+ * @param[in] flags Zero(0) or more of ``SOCKET_FLAG_NO_COPY`` and
+ *                  ``SOCKET_FLAG_DONT_WAIT``.
+ *
+ * @return Number of sent datagrams or negative error code.
+ */
+ssize_t socket_sendmmsg(struct socket_t *self_p,
+                        struct socket_msg_t *msgs_p,
+                        size_t length,
+                        int flags);
+
+/**
+ * Receive up to given number of datagrams. Waits for a datagram if
+ * none is available, and then returns all queued datagrams that fit
+ * in the given array without waiting any further. Datagrams larger
+ * than their buffer are truncated. Only used by UDP sockets.
+ *
+ * @param[in] self_p Socket.
+ * @param[in,out] msgs_p Buffers to receive into. The length and
+ *                       address members of each received datagram
+ *                       are set.
+ * @param[in] length Number of buffers.
+ * @param[in] flags Zero(0) or ``SOCKET_FLAG_DONT_WAIT``.
+ *
+ * @return Number of received datagrams or negative error code.
+ */
+ssize_t socket_recvmmsg(struct socket_t *self_p,
+                        struct socket_msg_t *msgs_p,
+                        size_t length,
+                        int flags);
+
+/**
+ * Borrow received data from given socket without copying it. Waits
+ * for data if none is available. The data is owned by the socket and
+ * must be released with `socket_recv_release()` once processed. Only
+ * used by TCP sockets.
+ *
+ * @param[in] self_p Socket.
+ * @param[out] buf_pp Borrowed data.
+ *
+ * @return Number of borrowed bytes, zero(0) if the socket is closed,
+ *         or negative error code.
+ */
+ssize_t socket_recv_borrow(struct socket_t *self_p,
+                           const void **buf_pp);
+
+/**
+ * Release given number of borrowed bytes, at most the number of
+ * bytes returned by the latest call to `socket_recv_borrow()`.
+ *
+ * @param[in] self_p Socket.
+ * @param[in] size Number of bytes to release.
+ *
+ * @return zero(0), or -EINVAL if more bytes than borrowed are
+ *         released.
+ */
+int socket_recv_release(struct socket_t *self_p, size_t size);
+
 #endif
@@ -125,4 +125,19 @@
 #define INET_HTTP_WEBSOCKET_FIN  0x80
 #define INET_HTTP_WEBSOCKET_MASK 0x80
 
+/* Set in the first frame of a message compressed by the
+   permessage-deflate extension. */
+#define INET_HTTP_WEBSOCKET_RSV1 0x40
+
+#define INET_HTTP_WEBSOCKET_OPCODE_MASK         0x0f
+#define INET_HTTP_WEBSOCKET_OPCODE_CONTINUATION 0x0
+#define INET_HTTP_WEBSOCKET_OPCODE_TEXT         0x1
+#define INET_HTTP_WEBSOCKET_OPCODE_BINARY       0x2
+#define INET_HTTP_WEBSOCKET_OPCODE_CLOSE        0x8
+#define INET_HTTP_WEBSOCKET_OPCODE_PING         0x9
+#define INET_HTTP_WEBSOCKET_OPCODE_PONG         0xa
+
+/* Control frames have the most significant opcode bit set. */
+#define INET_HTTP_WEBSOCKET_OPCODE_CONTROL      0x8
+
 #endif
@@ -0,0 +1,69 @@
+/**
+ * @file inet/ports/esp/socket_port.h
+ * @version 0.5.0
+ *
+ * @section License
+ * Copyright (C) 2016, Erik Moqvist
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Simba project.
+ */
+
+#ifndef __INET_SOCKET_PORT_H__
+#define __INET_SOCKET_PORT_H__
+
+struct socket_port_t {
+    struct {
+        struct {
+            volatile int reading;
+            /* Received UDP datagrams not yet read by the
+               application. */
+            struct {
+                struct {
+                    void *pbuf_p;
+                    struct socket_addr_t remote_addr;
+                } entries[SOCKET_UDP_RECV_QUEUE_DEPTH];
+                volatile size_t length;
+                size_t rd;
+                size_t wr;
+            } datagrams;
+            /* Received TCP segments not yet read by the application. */
+            struct {
+                void *pbufs[SOCKET_TCP_RECV_QUEUE_DEPTH];
+                volatile size_t length;
+                size_t rd;
+                size_t wr;
+                /* Read offset in the first segment. */
+                size_t offset;
+                volatile int closed;
+                /* Read bytes not yet reported to lwip. */
+                volatile size_t recved;
+                /* Borrowed bytes not yet released. */
+                size_t borrowed;
+            } queue;
+        } recv;
+        /* UDP send buffer reused by consecutive datagrams. */
+        struct {
+            void *pbuf_p;
+            void *payload_p;
+            size_t size;
+        } send;
+        void *buf_p;
+        size_t size;
+        int flags;
+        struct socket_addr_t remote_addr;
+        struct thrd_t * volatile thrd_p;
+    } io;
+    void *pcb_p;
+};
+
+#endif
@@ -0,0 +1,1265 @@
+/**
+ * @file inet/ports/esp/socket_port.i
+ * @version 0.5.0
+ *
+ * @section License
+ * Copyright (C) 2016, Erik Moqvist
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Simba project.
+ */
+
+#include "lwip/tcp.h"
+#include "lwip/udp.h"
+#include "lwip/tcpip.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_common.h"
+
+extern xSemaphoreHandle thrd_idle_sem;
+
+static void init(struct socket_t *self_p,
+                 int type,
+                 void *pcb_p)
+{
+    chan_init(&self_p->base,
+              (thrd_read_fn_t)socket_read,
+              (thrd_write_fn_t)socket_write,
+              (thrd_size_fn_t)socket_size);
+
+    self_p->type = type;
+    self_p->port.pcb_p = pcb_p;
+    self_p->port.io.recv.reading = 0;
+    self_p->port.io.recv.datagrams.length = 0;
+    self_p->port.io.recv.datagrams.rd = 0;
+    self_p->port.io.recv.datagrams.wr = 0;
+    self_p->port.io.recv.queue.length = 0;
+    self_p->port.io.recv.queue.rd = 0;
+    self_p->port.io.recv.queue.wr = 0;
+    self_p->port.io.recv.queue.offset = 0;
+    self_p->port.io.recv.queue.closed = 0;
+    self_p->port.io.recv.queue.recved = 0;
+    self_p->port.io.recv.queue.borrowed = 0;
+    self_p->port.io.send.pbuf_p = NULL;
+    self_p->port.io.send.payload_p = NULL;
+    self_p->port.io.send.size = 0;
+}
+
+/**
+ * Resume the thread waiting for given socket, if any. Called with the
+ * system lock taken. The waiting thread is cleared before it is
+ * resumed, so a thread whose timeout has expired, and that has
+ * cleared it itself, is never resumed.
+ */
+static void resume_isr(struct socket_t *socket_p)
+{
+    struct thrd_t *thrd_p;
+
+    thrd_p = socket_p->port.io.thrd_p;
+
+    if (thrd_p != NULL) {
+        socket_p->port.io.thrd_p = NULL;
+        thrd_resume_isr(thrd_p, 0);
+        xSemaphoreGive(thrd_idle_sem);
+    }
+}
+
+static void resume(struct socket_t *socket_p)
+{
+    sys_lock();
+    resume_isr(socket_p);
+    sys_unlock();
+}
+
+/**
+ * Claim the thread waiting for given socket. Called by lwip thread
+ * callbacks before they access the io arguments of the waiting
+ * thread, as the thread returns if its timeout expires before it is
+ * claimed.
+ *
+ * @return The waiting thread, or NULL if it has returned.
+ */
+static struct thrd_t *claim(struct socket_t *socket_p)
+{
+    struct thrd_t *thrd_p;
+
+    sys_lock();
+    thrd_p = socket_p->port.io.thrd_p;
+    socket_p->port.io.thrd_p = NULL;
+    sys_unlock();
+
+    return (thrd_p);
+}
+
+/**
+ * Resume given claimed thread.
+ */
+static void resume_claimed(struct thrd_t *thrd_p)
+{
+    sys_lock();
+    thrd_resume_isr(thrd_p, 0);
+    xSemaphoreGive(thrd_idle_sem);
+    sys_unlock();
+}
+
+/**
+ * Call given function in the lwip thread and wait for it to
+ * complete. The wait is aborted if the timeout expires before the
+ * function has claimed the current thread, in which case the function
+ * returns without accessing the io arguments.
+ *
+ * @return zero(0), -EAGAIN if the timeout is zero or -ETIMEDOUT if the
+ *         timeout expired.
+ */
+static int call_lwip(struct socket_t *self_p,
+                     tcpip_callback_fn function,
+                     struct time_t *timeout_p)
+{
+    int res;
+
+    sys_lock();
+    self_p->port.io.thrd_p = thrd_self();
+    sys_unlock();
+
+    tcpip_callback_with_block(function, self_p, 0);
+
+    sys_lock();
+
+    if (is_no_wait(timeout_p)) {
+        res = -EAGAIN;
+    } else {
+        res = thrd_suspend_isr(timeout_p);
+    }
+
+    if (res != 0) {
+        if (self_p->port.io.thrd_p != NULL) {
+            /* Not yet claimed by the function. */
+            self_p->port.io.thrd_p = NULL;
+        } else {
+            /* Claimed by the function. Wait for it to complete. */
+            res = thrd_suspend_isr(NULL);
+        }
+    }
+
+    sys_unlock();
+
+    return (res);
+}
+
+/**
+ * Resume the thread waiting for received data on given socket, if
+ * any. Called with the system lock taken.
+ */
+static void resume_reader_isr(struct socket_t *socket_p)
+{
+    if (socket_p->port.io.recv.reading == 1) {
+        socket_p->port.io.recv.reading = 0;
+        resume_isr(socket_p);
+    }
+}
+
+/**
+ * Resume the thread polling given socket with `chan_list_poll()`, if
+ * any.
+ */
+static void resume_polling_thread(struct socket_t *socket_p)
+{
+    sys_lock();
+
+    if (chan_is_polled_isr(&socket_p->base)) {
+        thrd_resume_isr(socket_p->base.reader_p, 0);
+        socket_p->base.reader_p = NULL;
+        xSemaphoreGive(thrd_idle_sem);
+    }
+
+    sys_unlock();
+}
+
+/**
+ * Suspend the current thread until data is received or the timeout
+ * expires. Called with the system lock taken.
+ *
+ * @return zero(0) if resumed, -EAGAIN if the timeout is zero or
+ *         -ETIMEDOUT if the timeout expired.
+ */
+static int wait_for_data_isr(struct socket_t *self_p,
+                             struct time_t *timeout_p)
+{
+    int res;
+
+    if (is_no_wait(timeout_p)) {
+        return (-EAGAIN);
+    }
+
+    self_p->port.io.recv.reading = 1;
+    self_p->port.io.thrd_p = thrd_self();
+    res = thrd_suspend_isr(timeout_p);
+
+    if (res != 0) {
+        self_p->port.io.recv.reading = 0;
+        self_p->port.io.thrd_p = NULL;
+    }
+
+    return (res);
+}
+
+/*
+ * All callback functions below are called from the LwIP-thread. For
+ * ESP, this is the FreeRTOS LwIP-thread.
+ */
+
+/**
+ * An UDP packet has been received. The datagram is added to the
+ * receive queue of the socket, or dropped if the queue is full.
+ */
+static void on_udp_recv(void *arg_p,
+                        struct udp_pcb *pcb_p,
+                        struct pbuf *pbuf_p,
+                        ip_addr_t *addr_p,
+                        uint16_t port)
+{
+    struct socket_t *socket_p = arg_p;
+    struct socket_port_t *port_p = &socket_p->port;
+    size_t wr;
+
+    sys_lock();
+
+    if (port_p->io.recv.datagrams.length == SOCKET_UDP_RECV_QUEUE_DEPTH) {
+        sys_unlock();
+        fs_counter_increment(&udp_rx_dropped, 1);
+        pbuf_free(pbuf_p);
+
+        return;
+    }
+
+    wr = port_p->io.recv.datagrams.wr;
+    port_p->io.recv.datagrams.entries[wr].pbuf_p = pbuf_p;
+    port_p->io.recv.datagrams.entries[wr].remote_addr.ip = addr_p->addr;
+    port_p->io.recv.datagrams.entries[wr].remote_addr.port = port;
+    wr++;
+
+    if (wr == SOCKET_UDP_RECV_QUEUE_DEPTH) {
+        wr = 0;
+    }
+
+    port_p->io.recv.datagrams.wr = wr;
+    port_p->io.recv.datagrams.length++;
+    resume_reader_isr(socket_p);
+    sys_unlock();
+
+    resume_polling_thread(socket_p);
+}
+
+/**
+ * TCP data is available in the lwip stack. The segment is added to
+ * the receive queue of the socket. The receive window is not updated
+ * until the application has read the data.
+ */
+static err_t on_tcp_recv(void *arg_p,
+                         struct tcp_pcb *pcb_p,
+                         struct pbuf *pbuf_p,
+                         err_t err)
+{
+    struct socket_t *socket_p = arg_p;
+    struct socket_port_t *port_p = &socket_p->port;
+
+    if ((pbuf_p != NULL) && (err != ERR_OK)) {
+        fs_counter_increment(&tcp_rx_dropped, 1);
+        pbuf_free(pbuf_p);
+
+        return (ERR_OK);
+    }
+
+    sys_lock();
+
+    if (pbuf_p == NULL) {
+        port_p->io.recv.queue.closed = 1;
+    } else {
+        /* lwip keeps the segment and delivers it again later if the
+           queue is full. */
+        if (port_p->io.recv.queue.length == SOCKET_TCP_RECV_QUEUE_DEPTH) {
+            sys_unlock();
+            fs_counter_increment(&tcp_rx_deferred, 1);
+
+            return (ERR_MEM);
+        }
+
+        port_p->io.recv.queue.pbufs[port_p->io.recv.queue.wr] = pbuf_p;
+        port_p->io.recv.queue.wr++;
+
+        if (port_p->io.recv.queue.wr == SOCKET_TCP_RECV_QUEUE_DEPTH) {
+            port_p->io.recv.queue.wr = 0;
+        }
+
+        port_p->io.recv.queue.length++;
+    }
+
+    resume_reader_isr(socket_p);
+    sys_unlock();
+
+    resume_polling_thread(socket_p);
+
+    return (ERR_OK);
+}
+
+/**
+ * A TCP client is trying to connect. The client is only accepted if
+ * a thread is waiting in `socket_port_accept()`, which is checked
+ * with the system lock taken as the wait may time out.
+ */
+static err_t on_tcp_accept(void *arg_p,
+                           struct tcp_pcb *new_pcb_p,
+                           err_t err)
+{
+    struct socket_t *socket_p = arg_p;
+    struct socket_t *accepted_p;
+
+    sys_lock();
+
+    if (socket_p->port.io.thrd_p != NULL) {
+        /* Initialize the new socket and accept the client. */
+        accepted_p = socket_p->port.io.buf_p;
+        tcp_arg(new_pcb_p, accepted_p);
+        tcp_recv(new_pcb_p, on_tcp_recv);
+        init(accepted_p, SOCKET_TYPE_STREAM, new_pcb_p);
+        tcp_accepted(((struct tcp_pcb *)socket_p->port.pcb_p));
+        resume_isr(socket_p);
+    }
+
+    sys_unlock();
+
+    return (0);
+}
+
+/**
+ * Write the TCP data in the io vector from the lwip thread. lwip
+ * always copies the data, as the writer is not told when it has been
+ * acknowledged by the remote host.
+ */
+static void tcp_write_cb(void *ctx_p)
+{
+    struct socket_t *self_p = ctx_p;
+    struct thrd_t *thrd_p;
+    const struct socket_iov_t *iov_p;
+    size_t i;
+    size_t length;
+    ssize_t size;
+    u8_t flags;
+    err_t res;
+
+    thrd_p = claim(self_p);
+
+    /* The writer has timed out. */
+    if (thrd_p == NULL) {
+        return;
+    }
+
+    iov_p = self_p->port.io.buf_p;
+    length = self_p->port.io.size;
+    size = 0;
+
+    for (i = 0; i < length; i++) {
+        flags = TCP_WRITE_FLAG_COPY;
+
+        /* More data follows in the same segment. */
+        if (i < length - 1) {
+            flags |= TCP_WRITE_FLAG_MORE;
+        }
+
+        res = tcp_write(self_p->port.pcb_p,
+                        iov_p[i].buf_p,
+                        iov_p[i].size,
+                        flags);
+
+        if (res != ERR_OK) {
+            size = -1;
+            break;
+        }
+
+        size += iov_p[i].size;
+    }
+
+    self_p->port.io.size = size;
+    resume_claimed(thrd_p);
+}
+
+/**
+ * Open a TCP socket from the lwip thread.
+ */
+static void tcp_open_cb(void *ctx_p)
+{
+    struct socket_t *self_p = ctx_p;
+    void *pcb_p;
+
+    /* Create and initiate the TCP pcb. */
+    pcb_p = tcp_new();
+    tcp_arg(pcb_p, self_p);
+    tcp_recv(pcb_p, on_tcp_recv);
+    init(self_p, SOCKET_TYPE_STREAM, pcb_p);
+    resume(self_p);
+}
+
+/**
+ * Report read bytes to lwip from the lwip thread to open the receive
+ * window.
+ */
+static void tcp_recved_cb(void *ctx_p)
+{
+    struct socket_t *self_p = ctx_p;
+    size_t size;
+
+    sys_lock();
+    size = self_p->port.io.recv.queue.recved;
+    self_p->port.io.recv.queue.recved = 0;
+    sys_unlock();
+
+    tcp_recved(self_p->port.pcb_p, size);
+}
+
+/**
+ * Close a TCP socket from the lwip thread. Unread segments are
+ * dropped.
+ */
+static void tcp_close_cb(void *ctx_p)
+{
+    struct socket_t *self_p = ctx_p;
+    struct socket_port_t *port_p = &self_p->port;
+
+    /* Segments received after the close are handled by lwip. */
+    tcp_arg(port_p->pcb_p, NULL);
+    tcp_recv(port_p->pcb_p, NULL);
+
+    while (port_p->io.recv.queue.length > 0) {
+        pbuf_free(port_p->io.recv.queue.pbufs[port_p->io.recv.queue.rd]);
+        port_p->io.recv.queue.rd++;
+
+        if (port_p->io.recv.queue.rd == SOCKET_TCP_RECV_QUEUE_DEPTH) {
+            port_p->io.recv.queue.rd = 0;
+        }
+
+        port_p->io.recv.queue.length--;
+        fs_counter_increment(&tcp_rx_dropped, 1);
+    }
+
+    tcp_close(port_p->pcb_p);
+    resume(self_p);
+}
+
+/**
+ * Get a pbuf for an UDP datagram of given size. The send pbuf of the
+ * socket is reused if lwip has released it and it is large enough,
+ * saving an allocation per datagram.
+ */
+static struct pbuf *udp_get_send_pbuf(struct socket_t *self_p,
+                                      size_t size)
+{
+    struct socket_port_t *port_p = &self_p->port;
+    struct pbuf *pbuf_p;
+
+    pbuf_p = port_p->io.send.pbuf_p;
+
+    if (pbuf_p != NULL) {
+        if ((pbuf_p->ref == 1) && (size <= port_p->io.send.size)) {
+            /* Remove headers added by lwip and resize the payload
+               within the allocated buffer. */
+            pbuf_header(pbuf_p,
+                        (s16_t)((u8_t *)pbuf_p->payload
+                                - (u8_t *)port_p->io.send.payload_p));
+            pbuf_p->len = size;
+            pbuf_p->tot_len = size;
+
+            return (pbuf_p);
+        }
+
+        pbuf_free(pbuf_p);
+    }
+
+    pbuf_p = pbuf_alloc(PBUF_TRANSPORT, size, PBUF_RAM);
+    port_p->io.send.pbuf_p = pbuf_p;
+
+    if (pbuf_p != NULL) {
+        port_p->io.send.payload_p = pbuf_p->payload;
+        port_p->io.send.size = size;
+    }
+
+    return (pbuf_p);
+}
+
+/**
+ * Send an UDP datagram. Data that is never modified is referred to
+ * instead of copied.
+ */
+static ssize_t udp_send_to(struct socket_t *self_p,
+                           const void *buf_p,
+                           size_t size,
+                           int flags,
+                           const struct socket_addr_t *remote_addr_p,
+                           size_t addrlen)
+{
+    ssize_t res = size;
+    struct pbuf *pbuf_p;
+    ip_addr_t ip;
+    err_t err;
+
+    if (flags & SOCKET_FLAG_NO_COPY) {
+        pbuf_p = pbuf_alloc(PBUF_TRANSPORT, size, PBUF_REF);
+
+        if (pbuf_p == NULL) {
+            return (-ENOMEM);
+        }
+
+        pbuf_p->payload = (void *)buf_p;
+    } else {
+        pbuf_p = udp_get_send_pbuf(self_p, size);
+
+        if (pbuf_p == NULL) {
+            return (-ENOMEM);
+        }
+
+        memcpy(pbuf_p->payload, buf_p, size);
+    }
+
+    if (remote_addr_p != NULL) {
+        ip.addr = remote_addr_p->ip;
+        err = udp_sendto(self_p->port.pcb_p,
+                         pbuf_p,
+                         &ip,
+                         remote_addr_p->port);
+    } else {
+        /* The default remote address of a connected socket. */
+        err = udp_send(self_p->port.pcb_p, pbuf_p);
+    }
+
+    if (err != ERR_OK) {
+        res = -1;
+    }
+
+    /* The send pbuf is kept for the next datagram. */
+    if (flags & SOCKET_FLAG_NO_COPY) {
+        pbuf_free(pbuf_p);
+    }
+
+    return (res);
+}
+
+/**
+ * Send the UDP datagrams in the message vector from the lwip thread.
+ */
+static void udp_sendmmsg_cb(void *ctx_p)
+{
+    struct socket_t *self_p = ctx_p;
+    struct thrd_t *thrd_p;
+    struct socket_msg_t *msgs_p;
+    size_t i;
+    size_t length;
+
+    thrd_p = claim(self_p);
+
+    /* The sender has timed out. */
+    if (thrd_p == NULL) {
+        return;
+    }
+
+    msgs_p = self_p->port.io.buf_p;
+    length = self_p->port.io.size;
+
+    for (i = 0; i < length; i++) {
+        if (udp_send_to(self_p,
+                        msgs_p[i].buf_p,
+                        msgs_p[i].size,
+                        self_p->port.io.flags,
+                        &msgs_p[i].addr,
+                        sizeof(msgs_p[i].addr)) != msgs_p[i].size) {
+            break;
+        }
+
+        msgs_p[i].length = msgs_p[i].size;
+    }
+
+    self_p->port.io.size = i;
+    resume_claimed(thrd_p);
+}
+
+static ssize_t udp_sendmmsg(struct socket_t *self_p,
+                            struct socket_msg_t *msgs_p,
+                            size_t length,
+                            int flags,
+                            struct time_t *timeout_p)
+{
+    int res;
+
+    self_p->port.io.buf_p = msgs_p;
+    self_p->port.io.size = length;
+    self_p->port.io.flags = flags;
+
+    res = call_lwip(self_p, udp_sendmmsg_cb, timeout_p);
+
+    if (res != 0) {
+        return (res);
+    }
+
+    if ((self_p->port.io.size == 0) && (length > 0)) {
+        return (-EIO);
+    }
+
+    return (self_p->port.io.size);
+}
+
+static ssize_t tcp_writev(struct socket_t *self_p,
+                          const struct socket_iov_t *iov_p,
+                          size_t length,
+                          int flags,
+                          struct time_t *timeout_p)
+{
+    int res;
+
+    /* lwip refers to uncopied data until it is acknowledged, which
+       the writer is never told about. */
+    if (flags & SOCKET_FLAG_NO_COPY) {
+        return (-EINVAL);
+    }
+
+    self_p->port.io.buf_p = (void *)iov_p;
+    self_p->port.io.size = length;
+    self_p->port.io.flags = flags;
+
+    res = call_lwip(self_p, tcp_write_cb, timeout_p);
+
+    if (res != 0) {
+        return (res);
+    }
+
+    return (self_p->port.io.size);
+}
+
+static ssize_t tcp_send_to(struct socket_t *self_p,
+                           const void *buf_p,
+                           size_t size,
+                           int flags,
+                           const struct socket_addr_t *remote_addr_p,
+                           size_t addrlen)
+{
+    struct socket_iov_t iov;
+
+    iov.buf_p = (void *)buf_p;
+    iov.size = size;
+
+    return (tcp_writev(self_p,
+                       &iov,
+                       1,
+                       flags,
+                       get_timeout(self_p->timeout.send_p, flags)));
+}
+
+static ssize_t udp_recvmmsg(struct socket_t *self_p,
+                            struct socket_msg_t *msgs_p,
+                            size_t length,
+                            struct time_t *timeout_p)
+{
+    struct socket_port_t *port_p = &self_p->port;
+    struct pbuf *pbuf_p;
+    size_t i;
+    size_t rd;
+    int res;
+
+    /* Wait for the first datagram only. */
+    sys_lock();
+
+    if (port_p->io.recv.datagrams.length == 0) {
+        res = wait_for_data_isr(self_p, timeout_p);
+
+        if (res != 0) {
+            sys_unlock();
+
+            return (res);
+        }
+    }
+
+    sys_unlock();
+
+    for (i = 0; (i < length) && (port_p->io.recv.datagrams.length > 0); i++) {
+        rd = port_p->io.recv.datagrams.rd;
+        pbuf_p = port_p->io.recv.datagrams.entries[rd].pbuf_p;
+
+        /* Copy data from the pbuf to the local buffer. */
+        msgs_p[i].length = MIN(msgs_p[i].size, pbuf_p->tot_len);
+        pbuf_copy_partial(pbuf_p, msgs_p[i].buf_p, msgs_p[i].length, 0);
+        msgs_p[i].addr = port_p->io.recv.datagrams.entries[rd].remote_addr;
+        rd++;
+
+        if (rd == SOCKET_UDP_RECV_QUEUE_DEPTH) {
+            rd = 0;
+        }
+
+        sys_lock();
+        port_p->io.recv.datagrams.rd = rd;
+        port_p->io.recv.datagrams.length--;
+        sys_unlock();
+
+        pbuf_free(pbuf_p);
+    }
+
+    return (i);
+}
+
+static ssize_t udp_recv_from(struct socket_t *self_p,
+                             void *buf_p,
+                             size_t size,
+                             int flags,
+                             struct socket_addr_t *remote_addr_p,
+                             size_t addrlen)
+{
+    struct socket_msg_t msg;
+    ssize_t res;
+
+    msg.buf_p = buf_p;
+    msg.size = size;
+    res = udp_recvmmsg(self_p,
+                       &msg,
+                       1,
+                       get_timeout(self_p->timeout.recv_p, flags));
+
+    if (res != 1) {
+        return (res);
+    }
+
+    if (remote_addr_p != NULL) {
+        *remote_addr_p = msg.addr;
+    }
+
+    return (msg.length);
+}
+
+/**
+ * Wait for received TCP data.
+ *
+ * @return true(1) if data is available, false(0) if the socket is
+ *         closed, or negative error code if the timeout expired.
+ */
+static int tcp_wait_for_data(struct socket_t *self_p,
+                             struct time_t *timeout_p)
+{
+    int res;
+
+    res = 0;
+    sys_lock();
+
+    if ((self_p->port.io.recv.queue.length == 0)
+        && (self_p->port.io.recv.queue.closed == 0)) {
+        res = wait_for_data_isr(self_p, timeout_p);
+    }
+
+    sys_unlock();
+
+    if (res != 0) {
+        return (res);
+    }
+
+    return (self_p->port.io.recv.queue.length > 0);
+}
+
+/**
+ * Get the first segment in the receive queue.
+ */
+static struct pbuf *tcp_queue_head(struct socket_t *self_p)
+{
+    return (self_p->port.io.recv.queue.pbufs[self_p->port.io.recv.queue.rd]);
+}
+
+/**
+ * Mark given number of bytes in the first segment in the receive
+ * queue as read. The segment is freed when all its data has been
+ * read, and the read bytes are reported to lwip to open the receive
+ * window.
+ */
+static void tcp_consume(struct socket_t *self_p, size_t size)
+{
+    struct socket_port_t *port_p = &self_p->port;
+    struct pbuf *pbuf_p;
+    size_t recved;
+
+    pbuf_p = tcp_queue_head(self_p);
+    port_p->io.recv.queue.offset += size;
+
+    /* Any borrowed data is no longer valid. */
+    port_p->io.recv.queue.borrowed = 0;
+
+    if (port_p->io.recv.queue.offset < pbuf_p->tot_len) {
+        return;
+    }
+
+    sys_lock();
+
+    port_p->io.recv.queue.offset = 0;
+    port_p->io.recv.queue.rd++;
+
+    if (port_p->io.recv.queue.rd == SOCKET_TCP_RECV_QUEUE_DEPTH) {
+        port_p->io.recv.queue.rd = 0;
+    }
+
+    port_p->io.recv.queue.length--;
+    recved = port_p->io.recv.queue.recved;
+    port_p->io.recv.queue.recved += pbuf_p->tot_len;
+
+    sys_unlock();
+
+    /* Only one window update is pending at a time. */
+    if (recved == 0) {
+        tcpip_callback_with_block(tcp_recved_cb, self_p, 0);
+    }
+
+    pbuf_free(pbuf_p);
+}
+
+static ssize_t tcp_recv_from(struct socket_t *self_p,
+                             void *buf_p,
+                             size_t size,
+                             int flags,
+                             struct socket_addr_t *remote_addr_p,
+                             size_t addrlen)
+{
+    size_t left = size, pbuf_len, chunk_size;
+    struct pbuf *pbuf_p;
+    struct time_t *timeout_p;
+    int res;
+
+    timeout_p = get_timeout(self_p->timeout.recv_p, flags);
+
+    while (left > 0) {
+        /* Wait for data if none is available. */
+        res = tcp_wait_for_data(self_p, timeout_p);
+
+        if (res <= 0) {
+            /* Timeout before any data was received. */
+            if ((res < 0) && (left == size)) {
+                return (res);
+            }
+
+            break;
+        }
+
+        /* Copy data from the pbuf to the local buffer. */
+        pbuf_p = tcp_queue_head(self_p);
+        pbuf_len = (pbuf_p->tot_len - self_p->port.io.recv.queue.offset);
+
+        if (pbuf_len > left) {
+            chunk_size = left;
+        } else {
+            chunk_size = pbuf_len;
+        }
+
+        pbuf_copy_partial(pbuf_p,
+                          buf_p,
+                          chunk_size,
+                          self_p->port.io.recv.queue.offset);
+        left -= chunk_size;
+        buf_p += chunk_size;
+        tcp_consume(self_p, chunk_size);
+    }
+
+    return (size - left);
+}
+
+static ssize_t tcp_readv(struct socket_t *self_p,
+                         struct socket_iov_t *iov_p,
+                         size_t length)
+{
+    size_t i;
+    ssize_t res;
+    ssize_t size;
+
+    size = 0;
+
+    for (i = 0; i < length; i++) {
+        res = tcp_recv_from(self_p, iov_p[i].buf_p, iov_p[i].size, 0, NULL, 0);
+
+        if (res < 0) {
+            return (size > 0 ? size : res);
+        }
+
+        size += res;
+
+        /* Socket closed or timeout. */
+        if (res != iov_p[i].size) {
+            break;
+        }
+    }
+
+    return (size);
+}
+
+/**
+ * Lend the unread payload of the pbuf segment with the first unread
+ * byte to the caller.
+ */
+static ssize_t tcp_recv_borrow(struct socket_t *self_p,
+                               const void **buf_pp)
+{
+    struct pbuf *pbuf_p;
+    size_t offset;
+    int res;
+
+    res = tcp_wait_for_data(self_p, self_p->timeout.recv_p);
+
+    if (res <= 0) {
+        return (res);
+    }
+
+    /* Find the pbuf in the chain with the first unread byte. */
+    pbuf_p = tcp_queue_head(self_p);
+    offset = self_p->port.io.recv.queue.offset;
+
+    while (offset >= pbuf_p->len) {
+        offset -= pbuf_p->len;
+        pbuf_p = pbuf_p->next;
+    }
+
+    *buf_pp = ((char *)pbuf_p->payload + offset);
+    self_p->port.io.recv.queue.borrowed = (pbuf_p->len - offset);
+
+    return (self_p->port.io.recv.queue.borrowed);
+}
+
+/**
+ * Free unread datagrams and the send pbuf of a closed UDP socket.
+ */
+static void udp_free_pbufs(struct socket_t *self_p)
+{
+    struct socket_port_t *port_p = &self_p->port;
+    size_t rd;
+
+    rd = port_p->io.recv.datagrams.rd;
+
+    while (port_p->io.recv.datagrams.length > 0) {
+        pbuf_free(port_p->io.recv.datagrams.entries[rd].pbuf_p);
+        rd++;
+
+        if (rd == SOCKET_UDP_RECV_QUEUE_DEPTH) {
+            rd = 0;
+        }
+
+        port_p->io.recv.datagrams.length--;
+    }
+
+    port_p->io.recv.datagrams.rd = rd;
+
+    if (port_p->io.send.pbuf_p != NULL) {
+        pbuf_free(port_p->io.send.pbuf_p);
+        port_p->io.send.pbuf_p = NULL;
+    }
+}
+
+static int socket_port_module_init(void)
+{
+    return (0);
+}
+
+static int socket_port_open(struct socket_t *self_p,
+                            int domain,
+                            int type,
+                            int protocol)
+{
+    void *pcb_p = NULL;
+
+    switch (type) {
+
+    case SOCKET_TYPE_STREAM:
+        self_p->port.io.thrd_p = thrd_self();
+        tcpip_callback_with_block(tcp_open_cb, self_p, 0);
+        thrd_suspend(NULL);
+        break;
+
+    case SOCKET_TYPE_DGRAM:
+        /* Create and initiate the UDP pcb. */
+        pcb_p = udp_new();
+        udp_recv(pcb_p, on_udp_recv, self_p);
+        init(self_p, SOCKET_TYPE_DGRAM, pcb_p);
+        break;
+
+    default:
+        return (-1);
+    }
+
+    return (0);
+}
+
+static int socket_port_close(struct socket_t *self_p)
+{
+    switch (self_p->type) {
+
+    case SOCKET_TYPE_STREAM:
+        self_p->port.io.thrd_p = thrd_self();
+        tcpip_callback_with_block(tcp_close_cb, self_p, 0);
+        thrd_suspend(NULL);
+        break;
+
+    case SOCKET_TYPE_DGRAM:
+        udp_recv(self_p->port.pcb_p, NULL, NULL);
+        udp_remove(self_p->port.pcb_p);
+        udp_free_pbufs(self_p);
+        break;
+
+    default:
+        return (-1);
+    }
+
+    return (0);
+}
+
+static int socket_port_bind(struct socket_t *self_p,
+                            const struct socket_addr_t *local_addr_p,
+                            size_t addrlen)
+{
+    ip_addr_t ip;
+
+    ip.addr = local_addr_p->ip;
+
+    switch (self_p->type) {
+
+    case SOCKET_TYPE_STREAM:
+        return (tcp_bind(self_p->port.pcb_p, &ip, local_addr_p->port));
+
+    case SOCKET_TYPE_DGRAM:
+        return (udp_bind(self_p->port.pcb_p, &ip, local_addr_p->port));
+
+    default:
+        return (-1);
+    }
+}
+
+static int socket_port_listen(struct socket_t *self_p, int backlog)
+{
+    switch (self_p->type) {
+
+    case SOCKET_TYPE_STREAM:
+        self_p->port.pcb_p = tcp_listen_with_backlog(self_p->port.pcb_p, backlog);
+        tcp_accept(self_p->port.pcb_p, on_tcp_accept);
+        break;
+
+    default:
+        return (-1);
+    }
+
+    return (0);
+}
+
+static int socket_port_connect(struct socket_t *self_p,
+                               const struct socket_addr_t *addr_p,
+                               size_t addrlen)
+{
+    ip_addr_t ip;
+
+    ip.addr = addr_p->ip;
+
+    switch (self_p->type) {
+
+    case SOCKET_TYPE_STREAM:
+        return (tcp_connect(self_p->port.pcb_p, &ip, addr_p->port, NULL));
+
+    case SOCKET_TYPE_DGRAM:
+        return (udp_connect(self_p->port.pcb_p, &ip, addr_p->port));
+
+    default:
+        return (-1);
+    }
+
+}
+
+static int socket_port_accept(struct socket_t *self_p,
+                              struct socket_t *accepted_p,
+                              struct socket_addr_t *addr_p,
+                              size_t *addrlen_p)
+{
+    int res;
+
+    /* Clients are only accepted by a waiting thread. */
+    if (is_no_wait(self_p->timeout.recv_p)) {
+        return (-EAGAIN);
+    }
+
+    /* The waiting thread is published and cleared on timeout with
+       the system lock taken, as on_tcp_accept() may run at any
+       time. */
+    sys_lock();
+
+    self_p->port.io.buf_p = accepted_p;
+    self_p->port.io.thrd_p = thrd_self();
+    res = thrd_suspend_isr(self_p->timeout.recv_p);
+
+    if (res != 0) {
+        self_p->port.io.thrd_p = NULL;
+    }
+
+    sys_unlock();
+
+    return (res);
+}
+
+static ssize_t socket_port_sendto(struct socket_t *self_p,
+                                  const void *buf_p,
+                                  size_t size,
+                                  int flags,
+                                  const struct socket_addr_t *remote_addr_p,
+                                  size_t addrlen)
+{
+    switch (self_p->type) {
+
+    case SOCKET_TYPE_STREAM:
+        return (tcp_send_to(self_p,
+                            buf_p,
+                            size,
+                            flags,
+                            remote_addr_p,
+                            addrlen));
+
+    case SOCKET_TYPE_DGRAM:
+        return (udp_send_to(self_p,
+                            buf_p,
+                            size,
+                            flags,
+                            remote_addr_p,
+                            addrlen));
+
+    default:
+        return (-1);
+    }
+}
+
+static ssize_t socket_port_recvfrom(struct socket_t *self_p,
+                                    void *buf_p,
+                                    size_t size,
+                                    int flags,
+                                    struct socket_addr_t *remote_addr_p,
+                                    size_t addrlen)
+{
+    switch (self_p->type) {
+
+    case SOCKET_TYPE_STREAM:
+        return (tcp_recv_from(self_p,
+                              buf_p,
+                              size,
+                              flags,
+                              remote_addr_p,
+                              addrlen));
+
+    case SOCKET_TYPE_DGRAM:
+        return (udp_recv_from(self_p,
+                              buf_p,
+                              size,
+                              flags,
+                              remote_addr_p,
+                              addrlen));
+
+    default:
+        return (-1);
+    }
+}
+
+static ssize_t socket_port_writev(struct socket_t *self_p,
+                                  const struct socket_iov_t *iov_p,
+                                  size_t length,
+                                  int flags)
+{
+    return (tcp_writev(self_p,
+                       iov_p,
+                       length,
+                       flags,
+                       get_timeout(self_p->timeout.send_p, flags)));
+}
+
+static ssize_t socket_port_readv(struct socket_t *self_p,
+                                 struct socket_iov_t *iov_p,
+                                 size_t length)
+{
+    return (tcp_readv(self_p, iov_p, length));
+}
+
+static ssize_t socket_port_sendmmsg(struct socket_t *self_p,
+                                    struct socket_msg_t *msgs_p,
+                                    size_t length,
+                                    int flags)
+{
+    return (udp_sendmmsg(self_p,
+                         msgs_p,
+                         length,
+                         flags,
+                         get_timeout(self_p->timeout.send_p, flags)));
+}
+
+static ssize_t socket_port_recvmmsg(struct socket_t *self_p,
+                                    struct socket_msg_t *msgs_p,
+                                    size_t length,
+                                    int flags)
+{
+    return (udp_recvmmsg(self_p,
+                         msgs_p,
+                         length,
+                         get_timeout(self_p->timeout.recv_p, flags)));
+}
+
+static ssize_t socket_port_recv_borrow(struct socket_t *self_p,
+                                       const void **buf_pp)
+{
+    return (tcp_recv_borrow(self_p, buf_pp));
+}
+
+static int socket_port_recv_release(struct socket_t *self_p, size_t size)
+{
+    size_t borrowed;
+
+    borrowed = self_p->port.io.recv.queue.borrowed;
+
+    if (size > borrowed) {
+        return (-EINVAL);
+    }
+
+    if (size > 0) {
+        tcp_consume(self_p, size);
+        self_p->port.io.recv.queue.borrowed = (borrowed - size);
+    }
+
+    return (0);
+}
+
+static ssize_t socket_port_size(struct socket_t *self_p)
+{
+    struct socket_port_t *port_p = &self_p->port;
+    struct pbuf *pbuf_p;
+    size_t rd;
+
+    switch (self_p->type) {
+
+    case SOCKET_TYPE_STREAM:
+        if (port_p->io.recv.queue.length > 0) {
+            pbuf_p = tcp_queue_head(self_p);
+
+            return (pbuf_p->tot_len - port_p->io.recv.queue.offset);
+        }
+
+        /* A read returns immediately if the connection is closed. */
+        return (port_p->io.recv.queue.closed);
+
+    case SOCKET_TYPE_DGRAM:
+        if (port_p->io.recv.datagrams.length > 0) {
+            rd = port_p->io.recv.datagrams.rd;
+            pbuf_p = port_p->io.recv.datagrams.entries[rd].pbuf_p;
+
+            return (MAX(pbuf_p->tot_len, 1));
+        }
+
+        return (0);
+
+    default:
+        return (-1);
+    }
+}
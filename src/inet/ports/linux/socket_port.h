@@ -0,0 +1,42 @@
+/**
+ * @file inet/ports/linux/socket_port.h
+ * @version 0.5.0
+ *
+ * @section License
+ * Copyright (C) 2016, Erik Moqvist
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Simba project.
+ */
+
+#ifndef __INET_SOCKET_PORT_H__
+#define __INET_SOCKET_PORT_H__
+
+/** Size of the buffer of received data lent to the application. */
+#define SOCKET_PORT_RECV_BUFFER_SIZE 2048
+
+struct socket_port_t {
+    /* Non-blocking BSD socket. */
+    int fd;
+    /* Thread waiting for the socket to become ready. */
+    struct thrd_t * volatile thrd_p;
+    /* Received data not yet read by the application. */
+    struct {
+        size_t offset;
+        size_t size;
+        char buf[SOCKET_PORT_RECV_BUFFER_SIZE];
+    } recv;
+    /* Number of datagrams dropped by the kernel, as last reported. */
+    uint32_t udp_dropped;
+};
+
+#endif
@@ -0,0 +1,1030 @@
+/**
+ * @file inet/ports/linux/socket_port.i
+ * @version 0.5.0
+ *
+ * @section License
+ * Copyright (C) 2016, Erik Moqvist
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Simba project.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+
+/* Maximum number of events handled per reactor iteration. */
+#define REACTOR_EVENTS_MAX 16
+
+/* Maximum number of buffers passed to the kernel per system call. */
+#define IOV_MAX_BATCH 16
+
+extern void thrd_tick(void);
+
+struct socket_port_module_t {
+    int epoll_fd;
+    pthread_t reactor;
+};
+
+static struct socket_port_module_t module;
+
+/**
+ * The reactor thread waits for socket events and resumes the Simba
+ * threads waiting for them. It is not a Simba thread, but behaves as
+ * an interrupt handler.
+ */
+static void *reactor_main(void *arg_p)
+{
+    struct epoll_event events[REACTOR_EVENTS_MAX];
+    struct socket_t *socket_p;
+    int i;
+    int n;
+
+    while (1) {
+        n = epoll_wait(module.epoll_fd, events, membersof(events), -1);
+
+        if (n <= 0) {
+            continue;
+        }
+
+        sys_lock_isr();
+
+        for (i = 0; i < n; i++) {
+            socket_p = events[i].data.ptr;
+
+            if (socket_p->port.thrd_p != NULL) {
+                thrd_resume_isr(socket_p->port.thrd_p, 0);
+                socket_p->port.thrd_p = NULL;
+            } else if (chan_is_polled_isr(&socket_p->base)) {
+                thrd_resume_isr(socket_p->base.reader_p, 0);
+                socket_p->base.reader_p = NULL;
+            }
+        }
+
+        sys_unlock_isr();
+
+        /* Wake the idle thread to schedule the resumed threads. */
+        thrd_tick();
+    }
+
+    return (NULL);
+}
+
+/**
+ * Arm given events on the socket for one notification.
+ */
+static int arm_events(struct socket_t *self_p, uint32_t events)
+{
+    struct epoll_event event;
+
+    event.events = (events | EPOLLONESHOT);
+    event.data.ptr = self_p;
+
+    return (epoll_ctl(module.epoll_fd,
+                      EPOLL_CTL_MOD,
+                      self_p->port.fd,
+                      &event));
+}
+
+/**
+ * Suspend the current thread until given events occur on the socket
+ * or the timeout expires.
+ *
+ * @return zero(0) if an event occured, -EAGAIN if the timeout is
+ *         zero, -ETIMEDOUT if the timeout expired, or other negative
+ *         error code.
+ */
+static int wait_for_events(struct socket_t *self_p,
+                           uint32_t events,
+                           struct time_t *timeout_p)
+{
+    int res;
+
+    if (is_no_wait(timeout_p)) {
+        return (-EAGAIN);
+    }
+
+    sys_lock();
+    self_p->port.thrd_p = thrd_self();
+
+    if (arm_events(self_p, events) == 0) {
+        res = thrd_suspend_isr(timeout_p);
+    } else {
+        res = -EIO;
+    }
+
+    /* Not resumed by the reactor. */
+    if (res != 0) {
+        self_p->port.thrd_p = NULL;
+    }
+
+    sys_unlock();
+
+    return (res);
+}
+
+static int is_would_block(void)
+{
+    return ((errno == EAGAIN) || (errno == EWOULDBLOCK));
+}
+
+static void addr_to_sockaddr(const struct socket_addr_t *addr_p,
+                             struct sockaddr_in *sockaddr_p)
+{
+    memset(sockaddr_p, 0, sizeof(*sockaddr_p));
+    sockaddr_p->sin_family = AF_INET;
+    sockaddr_p->sin_addr.s_addr = addr_p->ip;
+    sockaddr_p->sin_port = htons(addr_p->port);
+}
+
+static void sockaddr_to_addr(const struct sockaddr_in *sockaddr_p,
+                             struct socket_addr_t *addr_p)
+{
+    addr_p->ip = sockaddr_p->sin_addr.s_addr;
+    addr_p->port = ntohs(sockaddr_p->sin_port);
+}
+
+/**
+ * Initialize given socket object and add its file descriptor to the
+ * reactor, without any armed events.
+ */
+static int init(struct socket_t *self_p, int type, int fd)
+{
+    struct epoll_event event;
+
+    chan_init(&self_p->base,
+              (thrd_read_fn_t)socket_read,
+              (thrd_write_fn_t)socket_write,
+              (thrd_size_fn_t)socket_size);
+
+    self_p->type = type;
+    self_p->port.fd = fd;
+    self_p->port.thrd_p = NULL;
+    self_p->port.recv.offset = 0;
+    self_p->port.recv.size = 0;
+    self_p->port.udp_dropped = 0;
+
+    event.events = 0;
+    event.data.ptr = self_p;
+
+    if (epoll_ctl(module.epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        close(fd);
+
+        return (-EIO);
+    }
+
+    return (0);
+}
+
+/**
+ * Copy data from the receive buffer.
+ *
+ * @return Number of copied bytes.
+ */
+static size_t recv_buffered(struct socket_t *self_p,
+                            void *buf_p,
+                            size_t size)
+{
+    size_t n;
+
+    n = (self_p->port.recv.size - self_p->port.recv.offset);
+
+    if (n > size) {
+        n = size;
+    }
+
+    memcpy(buf_p, &self_p->port.recv.buf[self_p->port.recv.offset], n);
+    self_p->port.recv.offset += n;
+
+    return (n);
+}
+
+/**
+ * Move given io vector position given number of bytes forward.
+ */
+static void iov_advance(const struct socket_iov_t *iov_p,
+                        size_t length,
+                        size_t *index_p,
+                        size_t *offset_p,
+                        size_t size)
+{
+    size_t n;
+
+    while ((*index_p < length) && (size > 0)) {
+        n = (iov_p[*index_p].size - *offset_p);
+
+        if (n > size) {
+            *offset_p += size;
+            break;
+        }
+
+        size -= n;
+        (*index_p)++;
+        *offset_p = 0;
+    }
+
+    /* Skip empty buffers. */
+    while ((*index_p < length) && (iov_p[*index_p].size == *offset_p)) {
+        (*index_p)++;
+        *offset_p = 0;
+    }
+}
+
+/**
+ * Fill given kernel io vector with the buffers starting at given io
+ * vector position.
+ *
+ * @return Number of buffers in the kernel io vector.
+ */
+static int iov_fill(const struct socket_iov_t *iov_p,
+                    size_t length,
+                    size_t index,
+                    size_t offset,
+                    struct iovec *kiov_p)
+{
+    int i;
+
+    for (i = 0; (index < length) && (i < IOV_MAX_BATCH); i++, index++) {
+        kiov_p[i].iov_base = ((char *)iov_p[index].buf_p + offset);
+        kiov_p[i].iov_len = (iov_p[index].size - offset);
+        offset = 0;
+    }
+
+    return (i);
+}
+
+static ssize_t tcp_writev(struct socket_t *self_p,
+                          const struct socket_iov_t *iov_p,
+                          size_t length,
+                          struct time_t *timeout_p)
+{
+    struct iovec kiov[IOV_MAX_BATCH];
+    struct msghdr msg;
+    size_t index;
+    size_t offset;
+    ssize_t size;
+    ssize_t n;
+    int res;
+
+    index = 0;
+    offset = 0;
+    size = 0;
+    iov_advance(iov_p, length, &index, &offset, 0);
+
+    while (index < length) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = kiov;
+        msg.msg_iovlen = iov_fill(iov_p, length, index, offset, kiov);
+        n = sendmsg(self_p->port.fd, &msg, MSG_NOSIGNAL);
+
+        if (n < 0) {
+            if (!is_would_block()) {
+                return (-EIO);
+            }
+
+            res = wait_for_events(self_p, EPOLLOUT, timeout_p);
+
+            if (res != 0) {
+                return (size > 0 ? size : res);
+            }
+
+            continue;
+        }
+
+        iov_advance(iov_p, length, &index, &offset, n);
+        size += n;
+    }
+
+    return (size);
+}
+
+static ssize_t tcp_readv(struct socket_t *self_p,
+                         struct socket_iov_t *iov_p,
+                         size_t length,
+                         struct time_t *timeout_p)
+{
+    struct iovec kiov[IOV_MAX_BATCH];
+    size_t index;
+    size_t offset;
+    ssize_t size;
+    ssize_t n;
+    int res;
+
+    index = 0;
+    offset = 0;
+    size = 0;
+    iov_advance(iov_p, length, &index, &offset, 0);
+
+    /* Data left in the receive buffer is read first. */
+    while ((index < length)
+           && (self_p->port.recv.offset < self_p->port.recv.size)) {
+        n = recv_buffered(self_p,
+                          (char *)iov_p[index].buf_p + offset,
+                          iov_p[index].size - offset);
+        iov_advance(iov_p, length, &index, &offset, n);
+        size += n;
+    }
+
+    while (index < length) {
+        n = readv(self_p->port.fd,
+                  kiov,
+                  iov_fill(iov_p, length, index, offset, kiov));
+
+        if (n < 0) {
+            if (!is_would_block()) {
+                return (-EIO);
+            }
+
+            res = wait_for_events(self_p, EPOLLIN, timeout_p);
+
+            if (res != 0) {
+                return (size > 0 ? size : res);
+            }
+
+            continue;
+        }
+
+        /* Socket closed. */
+        if (n == 0) {
+            break;
+        }
+
+        iov_advance(iov_p, length, &index, &offset, n);
+        size += n;
+    }
+
+    return (size);
+}
+
+/**
+ * Lend the unread data in the receive buffer to the caller. The
+ * buffer is filled from the socket if empty.
+ */
+static ssize_t tcp_recv_borrow(struct socket_t *self_p,
+                               const void **buf_pp,
+                               struct time_t *timeout_p)
+{
+    ssize_t n;
+    int res;
+
+    while (self_p->port.recv.offset == self_p->port.recv.size) {
+        n = recv(self_p->port.fd,
+                 self_p->port.recv.buf,
+                 sizeof(self_p->port.recv.buf),
+                 0);
+
+        if (n < 0) {
+            if (!is_would_block()) {
+                return (-EIO);
+            }
+
+            res = wait_for_events(self_p, EPOLLIN, timeout_p);
+
+            if (res != 0) {
+                return (res);
+            }
+
+            continue;
+        }
+
+        /* Socket closed. */
+        if (n == 0) {
+            return (0);
+        }
+
+        self_p->port.recv.offset = 0;
+        self_p->port.recv.size = n;
+    }
+
+    *buf_pp = &self_p->port.recv.buf[self_p->port.recv.offset];
+
+    return (self_p->port.recv.size - self_p->port.recv.offset);
+}
+
+static ssize_t tcp_send_to(struct socket_t *self_p,
+                           const void *buf_p,
+                           size_t size,
+                           struct time_t *timeout_p)
+{
+    const char *b_p;
+    size_t left;
+    ssize_t n;
+    int res;
+
+    b_p = buf_p;
+    left = size;
+
+    while (left > 0) {
+        n = send(self_p->port.fd, b_p, left, MSG_NOSIGNAL);
+
+        if (n < 0) {
+            if (!is_would_block()) {
+                return (-EIO);
+            }
+
+            res = wait_for_events(self_p, EPOLLOUT, timeout_p);
+
+            if (res != 0) {
+                return (left < size ? (ssize_t)(size - left) : res);
+            }
+
+            continue;
+        }
+
+        b_p += n;
+        left -= n;
+    }
+
+    return (size);
+}
+
+static ssize_t udp_send_to(struct socket_t *self_p,
+                           const void *buf_p,
+                           size_t size,
+                           const struct socket_addr_t *remote_addr_p,
+                           struct time_t *timeout_p)
+{
+    struct sockaddr_in sockaddr;
+    ssize_t n;
+    int res;
+
+    while (1) {
+        if (remote_addr_p != NULL) {
+            addr_to_sockaddr(remote_addr_p, &sockaddr);
+            n = sendto(self_p->port.fd,
+                       buf_p,
+                       size,
+                       0,
+                       (struct sockaddr *)&sockaddr,
+                       sizeof(sockaddr));
+        } else {
+            /* The default remote address of a connected socket. */
+            n = send(self_p->port.fd, buf_p, size, 0);
+        }
+
+        if (n >= 0) {
+            return (n);
+        }
+
+        if (!is_would_block()) {
+            return (-EIO);
+        }
+
+        res = wait_for_events(self_p, EPOLLOUT, timeout_p);
+
+        if (res != 0) {
+            return (res);
+        }
+    }
+}
+
+static ssize_t tcp_recv_from(struct socket_t *self_p,
+                             void *buf_p,
+                             size_t size,
+                             struct time_t *timeout_p)
+{
+    char *b_p;
+    size_t left;
+    ssize_t n;
+    int res;
+
+    /* Data left in the receive buffer is read first. */
+    n = recv_buffered(self_p, buf_p, size);
+    b_p = ((char *)buf_p + n);
+    left = (size - n);
+
+    while (left > 0) {
+        n = recv(self_p->port.fd, b_p, left, 0);
+
+        if (n < 0) {
+            if (!is_would_block()) {
+                return (-EIO);
+            }
+
+            res = wait_for_events(self_p, EPOLLIN, timeout_p);
+
+            if (res != 0) {
+                return (left < size ? (ssize_t)(size - left) : res);
+            }
+
+            continue;
+        }
+
+        /* Socket closed. */
+        if (n == 0) {
+            break;
+        }
+
+        b_p += n;
+        left -= n;
+    }
+
+    return (size - left);
+}
+
+/**
+ * Count the datagrams dropped by the kernel because the receive
+ * buffer was full. The kernel reports the total number of dropped
+ * datagrams in a control message.
+ */
+static void udp_count_dropped(struct socket_t *self_p,
+                              struct msghdr *msg_p)
+{
+    struct cmsghdr *cmsg_p;
+    uint32_t dropped;
+
+    for (cmsg_p = CMSG_FIRSTHDR(msg_p);
+         cmsg_p != NULL;
+         cmsg_p = CMSG_NXTHDR(msg_p, cmsg_p)) {
+        if ((cmsg_p->cmsg_level == SOL_SOCKET)
+            && (cmsg_p->cmsg_type == SO_RXQ_OVFL)) {
+            memcpy(&dropped, CMSG_DATA(cmsg_p), sizeof(dropped));
+            fs_counter_increment(&udp_rx_dropped,
+                                 dropped - self_p->port.udp_dropped);
+            self_p->port.udp_dropped = dropped;
+        }
+    }
+}
+
+static ssize_t udp_recvmmsg(struct socket_t *self_p,
+                            struct socket_msg_t *msgs_p,
+                            size_t length,
+                            struct time_t *timeout_p)
+{
+    struct mmsghdr kmsgs[IOV_MAX_BATCH];
+    struct iovec kiov[IOV_MAX_BATCH];
+    struct sockaddr_in sockaddrs[IOV_MAX_BATCH];
+    union {
+        struct cmsghdr header;
+        char buf[CMSG_SPACE(sizeof(uint32_t))];
+    } controls[IOV_MAX_BATCH];
+    size_t i;
+    int n;
+    int res;
+
+    if (length > IOV_MAX_BATCH) {
+        length = IOV_MAX_BATCH;
+    }
+
+    memset(&kmsgs[0], 0, sizeof(kmsgs));
+
+    for (i = 0; i < length; i++) {
+        kiov[i].iov_base = msgs_p[i].buf_p;
+        kiov[i].iov_len = msgs_p[i].size;
+        kmsgs[i].msg_hdr.msg_name = &sockaddrs[i];
+        kmsgs[i].msg_hdr.msg_namelen = sizeof(sockaddrs[i]);
+        kmsgs[i].msg_hdr.msg_iov = &kiov[i];
+        kmsgs[i].msg_hdr.msg_iovlen = 1;
+        kmsgs[i].msg_hdr.msg_control = controls[i].buf;
+        kmsgs[i].msg_hdr.msg_controllen = sizeof(controls[i].buf);
+    }
+
+    /* Wait for the first datagram only. */
+    while (1) {
+        n = recvmmsg(self_p->port.fd, kmsgs, length, 0, NULL);
+
+        if (n >= 0) {
+            break;
+        }
+
+        if (!is_would_block()) {
+            return (-EIO);
+        }
+
+        res = wait_for_events(self_p, EPOLLIN, timeout_p);
+
+        if (res != 0) {
+            return (res);
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        msgs_p[i].length = kmsgs[i].msg_len;
+        sockaddr_to_addr(&sockaddrs[i], &msgs_p[i].addr);
+        udp_count_dropped(self_p, &kmsgs[i].msg_hdr);
+    }
+
+    return (n);
+}
+
+static ssize_t udp_sendmmsg(struct socket_t *self_p,
+                            struct socket_msg_t *msgs_p,
+                            size_t length,
+                            struct time_t *timeout_p)
+{
+    struct mmsghdr kmsgs[IOV_MAX_BATCH];
+    struct iovec kiov[IOV_MAX_BATCH];
+    struct sockaddr_in sockaddrs[IOV_MAX_BATCH];
+    size_t sent;
+    size_t batch;
+    size_t i;
+    int n;
+    int res;
+
+    sent = 0;
+    res = -EIO;
+
+    while (sent < length) {
+        batch = MIN(length - sent, IOV_MAX_BATCH);
+        memset(&kmsgs[0], 0, sizeof(kmsgs));
+
+        for (i = 0; i < batch; i++) {
+            addr_to_sockaddr(&msgs_p[sent + i].addr, &sockaddrs[i]);
+            kiov[i].iov_base = msgs_p[sent + i].buf_p;
+            kiov[i].iov_len = msgs_p[sent + i].size;
+            kmsgs[i].msg_hdr.msg_name = &sockaddrs[i];
+            kmsgs[i].msg_hdr.msg_namelen = sizeof(sockaddrs[i]);
+            kmsgs[i].msg_hdr.msg_iov = &kiov[i];
+            kmsgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        n = sendmmsg(self_p->port.fd, kmsgs, batch, 0);
+
+        if (n < 0) {
+            if (!is_would_block()) {
+                break;
+            }
+
+            res = wait_for_events(self_p, EPOLLOUT, timeout_p);
+
+            if (res != 0) {
+                break;
+            }
+
+            continue;
+        }
+
+        for (i = 0; i < n; i++) {
+            msgs_p[sent + i].length = kmsgs[i].msg_len;
+        }
+
+        sent += n;
+    }
+
+    if ((sent == 0) && (length > 0)) {
+        return (res);
+    }
+
+    return (sent);
+}
+
+static ssize_t udp_recv_from(struct socket_t *self_p,
+                             void *buf_p,
+                             size_t size,
+                             struct socket_addr_t *remote_addr_p,
+                             struct time_t *timeout_p)
+{
+    struct socket_msg_t msg;
+    ssize_t res;
+
+    msg.buf_p = buf_p;
+    msg.size = size;
+    res = udp_recvmmsg(self_p, &msg, 1, timeout_p);
+
+    if (res != 1) {
+        return (res);
+    }
+
+    if (remote_addr_p != NULL) {
+        *remote_addr_p = msg.addr;
+    }
+
+    return (msg.length);
+}
+
+static int socket_port_module_init(void)
+{
+    module.epoll_fd = epoll_create1(0);
+
+    if (module.epoll_fd < 0) {
+        return (-EIO);
+    }
+
+    if (pthread_create(&module.reactor, NULL, reactor_main, NULL) != 0) {
+        close(module.epoll_fd);
+
+        return (-EIO);
+    }
+
+    return (0);
+}
+
+static int socket_port_open(struct socket_t *self_p,
+                            int domain,
+                            int type,
+                            int protocol)
+{
+    int fd;
+    int value;
+
+    switch (type) {
+
+    case SOCKET_TYPE_STREAM:
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+
+        if (fd < 0) {
+            return (-EIO);
+        }
+
+        /* Allow quick restarts of listening servers. */
+        value = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &value, sizeof(value));
+        break;
+
+    case SOCKET_TYPE_DGRAM:
+        fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+
+        if (fd < 0) {
+            return (-EIO);
+        }
+
+        /* Let the kernel report dropped datagrams. */
+        value = 1;
+        setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &value, sizeof(value));
+        break;
+
+    default:
+        return (-1);
+    }
+
+    return (init(self_p, type, fd));
+}
+
+static int socket_port_close(struct socket_t *self_p)
+{
+    epoll_ctl(module.epoll_fd, EPOLL_CTL_DEL, self_p->port.fd, NULL);
+
+    if (close(self_p->port.fd) != 0) {
+        return (-EIO);
+    }
+
+    return (0);
+}
+
+static int socket_port_bind(struct socket_t *self_p,
+                            const struct socket_addr_t *local_addr_p,
+                            size_t addrlen)
+{
+    struct sockaddr_in sockaddr;
+
+    addr_to_sockaddr(local_addr_p, &sockaddr);
+
+    if (bind(self_p->port.fd,
+             (struct sockaddr *)&sockaddr,
+             sizeof(sockaddr)) != 0) {
+        return (-EIO);
+    }
+
+    return (0);
+}
+
+static int socket_port_listen(struct socket_t *self_p, int backlog)
+{
+    if (self_p->type != SOCKET_TYPE_STREAM) {
+        return (-1);
+    }
+
+    if (listen(self_p->port.fd, backlog) != 0) {
+        return (-EIO);
+    }
+
+    return (0);
+}
+
+static int socket_port_connect(struct socket_t *self_p,
+                               const struct socket_addr_t *addr_p,
+                               size_t addrlen)
+{
+    struct sockaddr_in sockaddr;
+    socklen_t size;
+    int error;
+    int res;
+
+    addr_to_sockaddr(addr_p, &sockaddr);
+
+    if (connect(self_p->port.fd,
+                (struct sockaddr *)&sockaddr,
+                sizeof(sockaddr)) == 0) {
+        return (0);
+    }
+
+    if (errno != EINPROGRESS) {
+        return (-EIO);
+    }
+
+    /* Wait for the three-way handshake to complete. */
+    res = wait_for_events(self_p, EPOLLOUT, self_p->timeout.send_p);
+
+    if (res != 0) {
+        return (res);
+    }
+
+    size = sizeof(error);
+
+    if (getsockopt(self_p->port.fd, SOL_SOCKET, SO_ERROR, &error, &size) != 0) {
+        return (-EIO);
+    }
+
+    return (error == 0 ? 0 : -EIO);
+}
+
+static int socket_port_accept(struct socket_t *self_p,
+                              struct socket_t *accepted_p,
+                              struct socket_addr_t *addr_p,
+                              size_t *addrlen_p)
+{
+    struct sockaddr_in sockaddr;
+    socklen_t sockaddr_size;
+    int fd;
+    int res;
+
+    while (1) {
+        sockaddr_size = sizeof(sockaddr);
+        fd = accept(self_p->port.fd,
+                    (struct sockaddr *)&sockaddr,
+                    &sockaddr_size);
+
+        if (fd >= 0) {
+            if (fcntl(fd, F_SETFL, O_NONBLOCK) != 0) {
+                close(fd);
+
+                return (-EIO);
+            }
+
+            break;
+        }
+
+        if (!is_would_block()) {
+            return (-EIO);
+        }
+
+        res = wait_for_events(self_p, EPOLLIN, self_p->timeout.recv_p);
+
+        if (res != 0) {
+            return (res);
+        }
+    }
+
+    if (addr_p != NULL) {
+        sockaddr_to_addr(&sockaddr, addr_p);
+    }
+
+    return (init(accepted_p, SOCKET_TYPE_STREAM, fd));
+}
+
+static ssize_t socket_port_sendto(struct socket_t *self_p,
+                                  const void *buf_p,
+                                  size_t size,
+                                  int flags,
+                                  const struct socket_addr_t *remote_addr_p,
+                                  size_t addrlen)
+{
+    struct time_t *timeout_p;
+
+    timeout_p = get_timeout(self_p->timeout.send_p, flags);
+
+    switch (self_p->type) {
+
+    case SOCKET_TYPE_STREAM:
+        return (tcp_send_to(self_p, buf_p, size, timeout_p));
+
+    case SOCKET_TYPE_DGRAM:
+        return (udp_send_to(self_p, buf_p, size, remote_addr_p, timeout_p));
+
+    default:
+        return (-1);
+    }
+}
+
+static ssize_t socket_port_recvfrom(struct socket_t *self_p,
+                                    void *buf_p,
+                                    size_t size,
+                                    int flags,
+                                    struct socket_addr_t *remote_addr_p,
+                                    size_t addrlen)
+{
+    struct time_t *timeout_p;
+
+    timeout_p = get_timeout(self_p->timeout.recv_p, flags);
+
+    switch (self_p->type) {
+
+    case SOCKET_TYPE_STREAM:
+        return (tcp_recv_from(self_p, buf_p, size, timeout_p));
+
+    case SOCKET_TYPE_DGRAM:
+        return (udp_recv_from(self_p, buf_p, size, remote_addr_p, timeout_p));
+
+    default:
+        return (-1);
+    }
+}
+
+static ssize_t socket_port_writev(struct socket_t *self_p,
+                                  const struct socket_iov_t *iov_p,
+                                  size_t length,
+                                  int flags)
+{
+    /* The kernel always copies the data. */
+    return (tcp_writev(self_p,
+                       iov_p,
+                       length,
+                       get_timeout(self_p->timeout.send_p, flags)));
+}
+
+static ssize_t socket_port_readv(struct socket_t *self_p,
+                                 struct socket_iov_t *iov_p,
+                                 size_t length)
+{
+    return (tcp_readv(self_p, iov_p, length, self_p->timeout.recv_p));
+}
+
+static ssize_t socket_port_sendmmsg(struct socket_t *self_p,
+                                    struct socket_msg_t *msgs_p,
+                                    size_t length,
+                                    int flags)
+{
+    /* The kernel always copies the data. */
+    return (udp_sendmmsg(self_p,
+                         msgs_p,
+                         length,
+                         get_timeout(self_p->timeout.send_p, flags)));
+}
+
+static ssize_t socket_port_recvmmsg(struct socket_t *self_p,
+                                    struct socket_msg_t *msgs_p,
+                                    size_t length,
+                                    int flags)
+{
+    return (udp_recvmmsg(self_p,
+                         msgs_p,
+                         length,
+                         get_timeout(self_p->timeout.recv_p, flags)));
+}
+
+static ssize_t socket_port_recv_borrow(struct socket_t *self_p,
+                                       const void **buf_pp)
+{
+    return (tcp_recv_borrow(self_p, buf_pp, self_p->timeout.recv_p));
+}
+
+static int socket_port_recv_release(struct socket_t *self_p, size_t size)
+{
+    if (size > (self_p->port.recv.size - self_p->port.recv.offset)) {
+        return (-EINVAL);
+    }
+
+    self_p->port.recv.offset += size;
+
+    return (0);
+}
+
+static ssize_t socket_port_size(struct socket_t *self_p)
+{
+    struct pollfd pollfd;
+    int size;
+
+    if (self_p->port.recv.offset < self_p->port.recv.size) {
+        return (self_p->port.recv.size - self_p->port.recv.offset);
+    }
+
+    pollfd.fd = self_p->port.fd;
+    pollfd.events = POLLIN;
+
+    if (poll(&pollfd, 1, 0) < 0) {
+        return (-EIO);
+    }
+
+    /* Let the reactor resume a polling thread when data arrives. */
+    if (pollfd.revents == 0) {
+        if (arm_events(self_p, EPOLLIN) != 0) {
+            return (-EIO);
+        }
+
+        return (0);
+    }
+
+    /* Zero bytes if the connection is closed, a client is waiting to
+       be accepted or a zero length datagram is received. */
+    if ((ioctl(self_p->port.fd, FIONREAD, &size) != 0) || (size == 0)) {
+        size = 1;
+    }
+
+    return (size);
+}
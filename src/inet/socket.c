@@ -22,336 +22,50 @@
 
 #include "inet.h"
 
-#include "lwip/tcp.h"
-#include "lwip/udp.h"
-#include "lwip/tcpip.h"
-
-#include "freertos/FreeRTOS.h"
-#include "freertos/semphr.h"
-#include "esp_common.h"
-
-extern xSemaphoreHandle thrd_idle_sem;
-
 struct fs_counter_t udp_rx_bytes;
 struct fs_counter_t udp_tx_bytes;
+struct fs_counter_t udp_rx_dropped;
 
 struct fs_counter_t tcp_accepts;
 struct fs_counter_t tcp_rx_bytes;
 struct fs_counter_t tcp_tx_bytes;
+struct fs_counter_t tcp_rx_deferred;
+struct fs_counter_t tcp_rx_dropped;
 
-static void init(struct socket_t *self_p,
-                 int type,
-                 void *pcb_p)
-{
-    /* Channel functions. */
-    self_p->base.read = (thrd_read_fn_t)socket_read;
-    self_p->base.write = (thrd_write_fn_t)socket_write;
-    self_p->base.size = (thrd_size_fn_t)NULL;
-
-    self_p->type = type;
-    self_p->pcb_p = pcb_p;
-    self_p->io.recv.reading = 0;
-    self_p->io.recv.pbuf.buf_p = NULL;
-    self_p->io.recv.pbuf.size = -1;
-    self_p->io.recv.pbuf.offset = 0;
-}
-
-static void resume(struct socket_t *socket_p)
-{
-    /* Resume the reading thread. */
-    thrd_resume_isr((struct thrd_t *)socket_p->io.thrd_p, 0);
-    socket_p->io.thrd_p = NULL;
-    xSemaphoreGive(thrd_idle_sem);
-}
-
-/*
- * All callback functions below are called from the LwIP-thread. For
- * ESP, this is the FreeRTOS LwIP-thread.
- */
-
-/**
- * An UDP packet has been received.
- */
-static void on_udp_recv(void *arg_p,
-                        struct udp_pcb *pcb_p,
-                        struct pbuf *pbuf_p,
-                        ip_addr_t *addr_p,
-                        uint16_t port)
-{
-    struct socket_t *socket_p = arg_p;
-
-    if (socket_p->io.recv.pbuf.size == -1) {
-        /* Save the new buffer. */
-        socket_p->io.recv.pbuf.buf_p = pbuf_p;
-
-        if (pbuf_p == NULL) {
-            socket_p->io.recv.pbuf.size = 0;
-        } else {
-            socket_p->io.recv.pbuf.size = pbuf_p->tot_len;
-        }
-
-        /* Copy the remote address and port to the receiver. */
-        socket_p->io.remote_addr.ip = addr_p->addr;
-        socket_p->io.remote_addr.port = port;
-
-        /* Resume any waiting thread. */
-        if (socket_p->io.thrd_p != NULL) {
-            resume(socket_p);
-        }
-    }
-}
+/* Timeout of operations that must not wait. */
+static struct time_t no_wait = { .seconds = 0, .nanoseconds = 0 };
 
 /**
- * TCP data is available in the lwip stack.
- */
-static err_t on_tcp_recv(void *arg_p,
-                         struct tcp_pcb *pcb_p,
-                         struct pbuf *pbuf_p,
-                         err_t err)
-{
-    struct socket_t *socket_p = arg_p;
-
-    /* Ready for the next buffer? */
-    if (socket_p->io.recv.pbuf.size != -1) {
-        return (ERR_MEM);
-    }
-
-    /* Save the new buffer. */
-    socket_p->io.recv.pbuf.buf_p = pbuf_p;
-
-    if (pbuf_p == NULL) {
-        socket_p->io.recv.pbuf.size = 0;
-    } else {
-        socket_p->io.recv.pbuf.size = pbuf_p->tot_len;
-        tcp_recved(pcb_p, pbuf_p->tot_len);
-    }
-
-    /* Resume any waiting thread. */
-    if ((socket_p->io.thrd_p != NULL)
-        && (socket_p->io.recv.reading == 1)) {
-        socket_p->io.recv.reading = 0;
-        resume(socket_p);
-    }
-
-    return (ERR_OK);
-}
-
-/**
- * A TCP client is trying to connect.
- */
-static err_t on_tcp_accept(void *arg_p,
-                           struct tcp_pcb *new_pcb_p,
-                           err_t err)
-{
-    struct socket_t *socket_p = arg_p;
-    struct socket_t *accepted_p = socket_p->io.buf_p;
-
-    if (socket_p->io.thrd_p != NULL) {
-        /* Initialize the new socket and accpet the client. */
-        tcp_arg(new_pcb_p, accepted_p);
-        tcp_recv(new_pcb_p, on_tcp_recv);
-        init(accepted_p, SOCKET_TYPE_STREAM, new_pcb_p);
-        tcp_accepted(((struct tcp_pcb *)socket_p->pcb_p));
-        resume(socket_p);
-    }
-
-    return (0);
-}
-
-/**
- * Write TCP data from the lwip thread.
+ * Get the timeout of an operation with given flags.
+ *
+ * @return Timeout, or NULL to wait forever.
  */
-static void tcp_write_cb(void *ctx_p)
+static struct time_t *get_timeout(struct time_t *timeout_p, int flags)
 {
-    struct socket_t *self_p = ctx_p;
-    err_t res;
-
-    res = tcp_write(self_p->pcb_p,
-                    self_p->io.buf_p,
-                    self_p->io.size,
-                    TCP_WRITE_FLAG_COPY);
-
-    if (res != ERR_OK) {
-        self_p->io.size = -1;
+    if (flags & SOCKET_FLAG_DONT_WAIT) {
+        return (&no_wait);
     }
 
-    resume(self_p);
+    return (timeout_p);
 }
 
 /**
- * Open a TCP socket from the lwip thread.
+ * Returns true(1) if an operation with given timeout must not wait.
  */
-static void tcp_open_cb(void *ctx_p)
-{
-    struct socket_t *self_p = ctx_p;
-    void *pcb_p;
-
-    /* Create and initiate the TCP pcb. */
-    pcb_p = tcp_new();
-    tcp_arg(pcb_p, self_p);
-    tcp_recv(pcb_p, on_tcp_recv);
-    init(self_p, SOCKET_TYPE_STREAM, pcb_p);
-    resume(self_p);
-}
-
-/**
- * Close a TCP socket from the lwip thread.
- */
-static void tcp_close_cb(void *ctx_p)
-{
-    struct socket_t *self_p = ctx_p;
-
-    tcp_close(self_p->pcb_p);
-    resume(self_p);
-}
-
-static ssize_t udp_send_to(struct socket_t *self_p,
-                           const void *buf_p,
-                           size_t size,
-                           int flags,
-                           const struct socket_addr_t *remote_addr_p,
-                           size_t addrlen)
-{
-    ssize_t res = size;
-    struct pbuf *pbuf_p;
-    ip_addr_t ip;
-
-    /* Copy the data to a pbuf.*/
-    ip.addr = remote_addr_p->ip;
-    pbuf_p = pbuf_alloc(PBUF_TRANSPORT, size, PBUF_RAM);
-    memcpy(pbuf_p->payload, buf_p, size);
-
-    fs_counter_increment(&udp_tx_bytes, size);
-
-    if (udp_sendto(self_p->pcb_p,
-                   pbuf_p,
-                   &ip,
-                   remote_addr_p->port) != 0) {
-        res = -1;
-    }
-
-    pbuf_free(pbuf_p);
-
-    return (res);
-}
-
-static ssize_t tcp_send_to(struct socket_t *self_p,
-                           const void *buf_p,
-                           size_t size,
-                           int flags,
-                           const struct socket_addr_t *remote_addr_p,
-                           size_t addrlen)
+static int is_no_wait(const struct time_t *timeout_p)
 {
-    self_p->io.buf_p = (void *)buf_p;
-    self_p->io.size = size;
-    self_p->io.thrd_p = thrd_self();
-
-    tcpip_callback_with_block(tcp_write_cb, self_p, 0);
-    thrd_suspend(NULL);
-
-    if (self_p->io.size >= 0) {
-        fs_counter_increment(&tcp_tx_bytes, self_p->io.size);
-    }
-
-    return (self_p->io.size);
+    return ((timeout_p != NULL)
+            && (timeout_p->seconds == 0)
+            && (timeout_p->nanoseconds == 0));
 }
 
-static ssize_t udp_recv_from(struct socket_t *self_p,
-                             void *buf_p,
-                             size_t size,
-                             int flags,
-                             struct socket_addr_t *remote_addr_p,
-                             size_t addrlen)
+static void init_timeouts(struct socket_t *self_p)
 {
-    struct pbuf *pbuf_p;
-
-    /* Wait for data if none is available. */
-    if (self_p->io.recv.pbuf.size == -1) {
-        self_p->io.thrd_p = thrd_self();
-        thrd_suspend(NULL);
-    }
-
-    /* Socket closed. */
-    if (self_p->io.recv.pbuf.size == 0) {
-        return (0);
-    }
-
-    pbuf_p = (struct pbuf *)self_p->io.recv.pbuf.buf_p;
-
-    /* Copy data from the pbuf to the local buffer. */
-    if (size > pbuf_p->tot_len) {
-        size = pbuf_p->tot_len;
-    }
-
-    *remote_addr_p = self_p->io.remote_addr;
-
-    pbuf_copy_partial(pbuf_p, buf_p, size, 0);
-    self_p->io.recv.pbuf.size = -1;
-    pbuf_free(pbuf_p);
-
-    fs_counter_increment(&udp_rx_bytes, size);
-
-    return (size);
+    self_p->timeout.recv_p = NULL;
+    self_p->timeout.send_p = NULL;
 }
 
-static ssize_t tcp_recv_from(struct socket_t *self_p,
-                             void *buf_p,
-                             size_t size,
-                             int flags,
-                             struct socket_addr_t *remote_addr_p,
-                             size_t addrlen)
-{
-    size_t left = size, pbuf_len, chunk_size;
-    volatile struct pbuf *pbuf_p;
-
-    while (left > 0) {
-        /* Wait for data if none is available. */
-        sys_lock();
-
-        if (self_p->io.recv.pbuf.size == -1) {
-            self_p->io.recv.reading = 1;
-            self_p->io.thrd_p = thrd_self();
-            thrd_suspend_isr(NULL);
-        }
-
-        sys_unlock();
-
-        /* Socket closed. */
-        if (self_p->io.recv.pbuf.size == 0) {
-            break;
-        }
-
-        /* Copy data from the pbuf to the local buffer. */
-        pbuf_p = self_p->io.recv.pbuf.buf_p;
-        pbuf_len = (pbuf_p->tot_len - self_p->io.recv.pbuf.offset);
-
-        if (pbuf_len > left) {
-            chunk_size = left;
-        } else {
-            chunk_size = pbuf_len;
-        }
-
-        pbuf_copy_partial((struct pbuf *)pbuf_p,
-                          buf_p,
-                          chunk_size,
-                          (size_t)self_p->io.recv.pbuf.offset);
-        left -= chunk_size;
-        buf_p += chunk_size;
-        self_p->io.recv.pbuf.offset += chunk_size;
-
-        /* Free the pbuf when all data has been read. */
-        if (pbuf_len == chunk_size) {
-            self_p->io.recv.pbuf.buf_p = NULL;
-            self_p->io.recv.pbuf.size = -1;
-            self_p->io.recv.pbuf.offset = 0;
-            pbuf_free((struct pbuf *)pbuf_p);
-        }
-    }
-
-    fs_counter_increment(&tcp_rx_bytes, size - left);
-
-    return (size - left);
-}
+#include "socket_port.i"
 
 int socket_module_init(void)
 {
@@ -366,6 +80,11 @@ int socket_module_init(void)
                     0);
     fs_counter_register(&udp_tx_bytes);
 
+    fs_counter_init(&udp_rx_dropped,
+                    FSTR("/inet/socket/udp/rx_dropped"),
+                    0);
+    fs_counter_register(&udp_rx_dropped);
+
     /* TCP counters. */
     fs_counter_init(&tcp_accepts,
                     FSTR("/inet/socket/tcp/accepts"),
@@ -382,128 +101,142 @@ int socket_module_init(void)
                     0);
     fs_counter_register(&tcp_tx_bytes);
 
-    return (0);    
+    fs_counter_init(&tcp_rx_deferred,
+                    FSTR("/inet/socket/tcp/rx_deferred"),
+                    0);
+    fs_counter_register(&tcp_rx_deferred);
+
+    fs_counter_init(&tcp_rx_dropped,
+                    FSTR("/inet/socket/tcp/rx_dropped"),
+                    0);
+    fs_counter_register(&tcp_rx_dropped);
+
+    return (socket_port_module_init());
 }
 
-int socket_open(struct socket_t *self_p,
-                int domain,
-                int type,
-                int protocol)
+int socket_inet_aton(const char *src_p, uint32_t *dst_p)
 {
-    void *pcb_p = NULL;
+    int i;
+    int digits;
+    long number;
+    uint32_t addr;
+
+    addr = 0;
+
+    for (i = 0; i < 4; i++) {
+        number = 0;
+        digits = 0;
+
+        while ((*src_p >= '0') && (*src_p <= '9')) {
+            number *= 10;
+            number += (*src_p - '0');
+            src_p++;
+            digits++;
+
+            if (digits > 3) {
+                return (-EINVAL);
+            }
+        }
 
-    switch (type) {
+        if ((digits == 0) || (number > 255)) {
+            return (-EINVAL);
+        }
 
-    case SOCKET_TYPE_STREAM:
-        self_p->io.thrd_p = thrd_self();
-        tcpip_callback_with_block(tcp_open_cb, self_p, 0);
-        thrd_suspend(NULL);
-        break;
+        /* Dots between the numbers. */
+        if (i < 3) {
+            if (*src_p != '.') {
+                return (-EINVAL);
+            }
 
-    case SOCKET_TYPE_DGRAM:
-        /* Create and initiate the UDP pcb. */
-        pcb_p = udp_new();
-        udp_recv(pcb_p, on_udp_recv, self_p);
-        init(self_p, SOCKET_TYPE_DGRAM, pcb_p);
-        break;
+            src_p++;
+        }
 
-    default:
-        return (-1);
+        /* The first number is the first byte in memory. */
+        addr |= ((uint32_t)number << (8 * i));
     }
 
+    if (*src_p != '\0') {
+        return (-EINVAL);
+    }
+
+    *dst_p = addr;
+
     return (0);
 }
 
-int socket_close(struct socket_t *self_p)
+int socket_open(struct socket_t *self_p,
+                int domain,
+                int type,
+                int protocol)
 {
-    switch (self_p->type) {
+    init_timeouts(self_p);
 
-    case SOCKET_TYPE_STREAM:
-        self_p->io.thrd_p = thrd_self();
-        tcpip_callback_with_block(tcp_close_cb, self_p, 0);
-        thrd_suspend(NULL);
-        break;
-
-    case SOCKET_TYPE_DGRAM:
-        udp_recv(self_p->pcb_p, NULL, NULL);
-        udp_remove(self_p->pcb_p);
-        break;
-
-    default:
-        return (-1);
-    }
+    return (socket_port_open(self_p, domain, type, protocol));
+}
 
-    return (0);
+int socket_close(struct socket_t *self_p)
+{
+    return (socket_port_close(self_p));
 }
 
 int socket_bind(struct socket_t *self_p,
                 const struct socket_addr_t *local_addr_p,
                 size_t addrlen)
 {
-    ip_addr_t ip;
-
-    ip.addr = local_addr_p->ip;
-
-    switch (self_p->type) {
-
-    case SOCKET_TYPE_STREAM:
-        return (tcp_bind(self_p->pcb_p, &ip, local_addr_p->port));
-
-    case SOCKET_TYPE_DGRAM:
-        return (udp_bind(self_p->pcb_p, &ip, local_addr_p->port));
-
-    default:
-        return (-1);
-    }
+    return (socket_port_bind(self_p, local_addr_p, addrlen));
 }
 
 int socket_listen(struct socket_t *self_p, int backlog)
 {
-    switch (self_p->type) {
-
-    case SOCKET_TYPE_STREAM:
-        self_p->pcb_p = tcp_listen_with_backlog(self_p->pcb_p, backlog);
-        tcp_accept(self_p->pcb_p, on_tcp_accept);
-        break;
-
-    default:
-        return (-1);
-    }
-
-    return (0);
+    return (socket_port_listen(self_p, backlog));
 }
 
 int socket_connect(struct socket_t *self_p,
                    const struct socket_addr_t *addr_p,
                    size_t addrlen)
 {
-    ip_addr_t ip;
+    return (socket_port_connect(self_p, addr_p, addrlen));
+}
 
-    ip.addr = addr_p->ip;
+int socket_accept(struct socket_t *self_p,
+                  struct socket_t *accepted_p,
+                  struct socket_addr_t *addr_p,
+                  size_t *addrlen_p)
+{
+    int res;
 
-    switch (self_p->type) {
+    init_timeouts(accepted_p);
+    res = socket_port_accept(self_p, accepted_p, addr_p, addrlen_p);
 
-    case SOCKET_TYPE_STREAM:
-        return (tcp_connect(self_p->pcb_p, &ip, addr_p->port, NULL));
+    if (res == 0) {
+        fs_counter_increment(&tcp_accepts, 1);
+    }
 
-    case SOCKET_TYPE_DGRAM:
-        return (udp_connect(self_p->pcb_p, &ip, addr_p->port));
+    return (res);
+}
 
-    default:
-        return (-1);
+int socket_set_recv_timeout(struct socket_t *self_p,
+                            const struct time_t *timeout_p)
+{
+    if (timeout_p == NULL) {
+        self_p->timeout.recv_p = NULL;
+    } else {
+        self_p->timeout.recv = *timeout_p;
+        self_p->timeout.recv_p = &self_p->timeout.recv;
     }
 
+    return (0);
 }
 
-int socket_accept(struct socket_t *self_p,
-                  struct socket_t *accepted_p,
-                  struct socket_addr_t *addr_p,
-                  size_t *addrlen_p)
+int socket_set_send_timeout(struct socket_t *self_p,
+                            const struct time_t *timeout_p)
 {
-    self_p->io.buf_p = accepted_p;
-    self_p->io.thrd_p = thrd_self();
-    thrd_suspend(NULL);
-    fs_counter_increment(&tcp_accepts, 1);
+    if (timeout_p == NULL) {
+        self_p->timeout.send_p = NULL;
+    } else {
+        self_p->timeout.send = *timeout_p;
+        self_p->timeout.send_p = &self_p->timeout.send;
+    }
 
     return (0);
 }
@@ -515,27 +248,24 @@ ssize_t socket_sendto(struct socket_t *self_p,
                       const struct socket_addr_t *remote_addr_p,
                       size_t addrlen)
 {
-    switch (self_p->type) {
-
-    case SOCKET_TYPE_STREAM:
-        return (tcp_send_to(self_p,
-                            buf_p,
-                            size,
-                            flags,
-                            remote_addr_p,
-                            addrlen));
-
-    case SOCKET_TYPE_DGRAM:
-        return (udp_send_to(self_p,
-                            buf_p,
-                            size,
-                            flags,
-                            remote_addr_p,
-                            addrlen));
-
-    default:
-        return (-1);
+    ssize_t res;
+
+    res = socket_port_sendto(self_p,
+                             buf_p,
+                             size,
+                             flags,
+                             remote_addr_p,
+                             addrlen);
+
+    if (res > 0) {
+        if (self_p->type == SOCKET_TYPE_STREAM) {
+            fs_counter_increment(&tcp_tx_bytes, res);
+        } else {
+            fs_counter_increment(&udp_tx_bytes, res);
+        }
     }
+
+    return (res);
 }
 
 ssize_t socket_recvfrom(struct socket_t *self_p,
@@ -545,27 +275,24 @@ ssize_t socket_recvfrom(struct socket_t *self_p,
                         struct socket_addr_t *remote_addr_p,
                         size_t addrlen)
 {
-    switch (self_p->type) {
-
-    case SOCKET_TYPE_STREAM:
-        return (tcp_recv_from(self_p,
-                              buf_p,
-                              size,
-                              flags,
-                              remote_addr_p,
-                              addrlen));
-
-    case SOCKET_TYPE_DGRAM:
-        return (udp_recv_from(self_p,
-                              buf_p,
-                              size,
-                              flags,
-                              remote_addr_p,
-                              addrlen));
-
-    default:
-        return (-1);
+    ssize_t res;
+
+    res = socket_port_recvfrom(self_p,
+                               buf_p,
+                               size,
+                               flags,
+                               remote_addr_p,
+                               addrlen);
+
+    if (res > 0) {
+        if (self_p->type == SOCKET_TYPE_STREAM) {
+            fs_counter_increment(&tcp_rx_bytes, res);
+        } else {
+            fs_counter_increment(&udp_rx_bytes, res);
+        }
     }
+
+    return (res);
 }
 
 ssize_t socket_write(struct socket_t *self_p,
@@ -581,3 +308,116 @@ ssize_t socket_read(struct socket_t *self_p,
 {
     return (socket_recvfrom(self_p, buf_p, size, 0, NULL, 0));
 }
+
+ssize_t socket_size(struct socket_t *self_p)
+{
+    return (socket_port_size(self_p));
+}
+
+ssize_t socket_writev(struct socket_t *self_p,
+                      const struct socket_iov_t *iov_p,
+                      size_t length,
+                      int flags)
+{
+    ssize_t res;
+
+    if (self_p->type != SOCKET_TYPE_STREAM) {
+        return (-EINVAL);
+    }
+
+    res = socket_port_writev(self_p, iov_p, length, flags);
+
+    if (res > 0) {
+        fs_counter_increment(&tcp_tx_bytes, res);
+    }
+
+    return (res);
+}
+
+ssize_t socket_readv(struct socket_t *self_p,
+                     struct socket_iov_t *iov_p,
+                     size_t length)
+{
+    ssize_t res;
+
+    if (self_p->type != SOCKET_TYPE_STREAM) {
+        return (-EINVAL);
+    }
+
+    res = socket_port_readv(self_p, iov_p, length);
+
+    if (res > 0) {
+        fs_counter_increment(&tcp_rx_bytes, res);
+    }
+
+    return (res);
+}
+
+ssize_t socket_sendmmsg(struct socket_t *self_p,
+                        struct socket_msg_t *msgs_p,
+                        size_t length,
+                        int flags)
+{
+    ssize_t res;
+    ssize_t i;
+
+    if (self_p->type != SOCKET_TYPE_DGRAM) {
+        return (-EINVAL);
+    }
+
+    res = socket_port_sendmmsg(self_p, msgs_p, length, flags);
+
+    for (i = 0; i < res; i++) {
+        fs_counter_increment(&udp_tx_bytes, msgs_p[i].length);
+    }
+
+    return (res);
+}
+
+ssize_t socket_recvmmsg(struct socket_t *self_p,
+                        struct socket_msg_t *msgs_p,
+                        size_t length,
+                        int flags)
+{
+    ssize_t res;
+    ssize_t i;
+
+    if (self_p->type != SOCKET_TYPE_DGRAM) {
+        return (-EINVAL);
+    }
+
+    res = socket_port_recvmmsg(self_p, msgs_p, length, flags);
+
+    for (i = 0; i < res; i++) {
+        fs_counter_increment(&udp_rx_bytes, msgs_p[i].length);
+    }
+
+    return (res);
+}
+
+ssize_t socket_recv_borrow(struct socket_t *self_p,
+                           const void **buf_pp)
+{
+    if (self_p->type != SOCKET_TYPE_STREAM) {
+        return (-EINVAL);
+    }
+
+    return (socket_port_recv_borrow(self_p, buf_pp));
+}
+
+int socket_recv_release(struct socket_t *self_p, size_t size)
+{
+    int res;
+
+    if (self_p->type != SOCKET_TYPE_STREAM) {
+        return (-EINVAL);
+    }
+
+    res = socket_port_recv_release(self_p, size);
+
+    if (res == 0) {
+        fs_counter_increment(&tcp_rx_bytes, size);
+    }
+
+    return (res);
+}
@@ -25,7 +25,30 @@
 #include "setting_port.h"
 
 /**
- * Initialize the setting module.
+ * Number of entries in the RAM index of settings written since the
+ * last compaction. The log is compacted when the index is full.
+ */
+#ifndef SETTING_INDEX_LENGTH
+#    define SETTING_INDEX_LENGTH 16
+#endif
+
+/** Size of the header of each setting in a transaction. */
+#define SETTING_TRANSACTION_ENTRY_HEADER_SIZE 4
+
+/**
+ * A transaction writes one or more settings atomically. Either all
+ * or none of the settings are written, even on power failure.
+ */
+struct setting_transaction_t {
+    uint8_t *buf_p;
+    size_t size;
+    size_t pos;
+};
+
+/**
+ * Initialize the setting module. Finds the newest valid settings in
+ * the non-volatile memory and builds the RAM index of written
+ * settings.
  *
  * @return zero(0) or negative error code.
  */
@@ -35,22 +58,68 @@ int setting_module_init(void);
  * Read setting at given address to given buffer.
  *
  * @param[in,out] dst_p Destination buffer.
- * @param[in] src Setting source address.
- * @param[in] size Number of words to read.
+ * @param[in] src Setting source address, ``SETTING_<NAME>_ADDR``.
+ * @param[in] size Number of words to read, ``SETTING_<NAME>_SIZE``.
  *
  * @return Number of words read or negative error code.
  */
 ssize_t setting_read(void *dst_p, size_t src, size_t size);
 
 /**
- * Write setting from given buffer to given address.
+ * Write setting from given buffer to given address. The setting is
+ * appended to the settings log in the non-volatile memory. A setting
+ * may be written with another address and size than earlier writes
+ * of overlapping settings, but then the log is compacted first.
  *
- * @param[in] dst Destination setting address.
+ * @param[in] dst Destination setting address, ``SETTING_<NAME>_ADDR``.
  * @param[in] src_p Source buffer.
- * @param[in] size Number of words to write.
+ * @param[in] size Number of words to write, ``SETTING_<NAME>_SIZE``.
  *
  * @return Number of words written or negative error code.
  */
 ssize_t setting_write(size_t dst, const void *src_p, size_t size);
 
+/**
+ * Initialize given transaction.
+ *
+ * @param[out] self_p Transaction to initialize.
+ * @param[in] buf_p Buffer for the settings in the transaction. Each
+ *                  setting uses its size plus
+ *                  ``SETTING_TRANSACTION_ENTRY_HEADER_SIZE`` bytes.
+ * @param[in] size Size of the buffer.
+ *
+ * @return zero(0) or negative error code.
+ */
+int setting_transaction_init(struct setting_transaction_t *self_p,
+                             void *buf_p,
+                             size_t size);
+
+/**
+ * Add a setting to given transaction. The setting is written to the
+ * non-volatile memory by `setting_transaction_commit()`.
+ *
+ * @param[in] self_p Initialized transaction.
+ * @param[in] dst Destination setting address, ``SETTING_<NAME>_ADDR``.
+ * @param[in] src_p Source buffer.
+ * @param[in] size Number of words to write, ``SETTING_<NAME>_SIZE``.
+ *
+ * @return zero(0), -EINVAL if the setting overlaps a setting already
+ *         in the transaction with another address or size, or other
+ *         negative error code.
+ */
+int setting_transaction_write(struct setting_transaction_t *self_p,
+                              size_t dst,
+                              const void *src_p,
+                              size_t size);
+
+/**
+ * Atomically write all settings in given transaction. The
+ * transaction is empty afterwards and may be reused.
+ *
+ * @param[in] self_p Initialized transaction.
+ *
+ * @return zero(0) or negative error code.
+ */
+int setting_transaction_commit(struct setting_transaction_t *self_p);
+
 #endif
@@ -28,16 +28,18 @@ static int setting_port_module_init(void)
     return (0);
 }
 
-static int setting_port_read(void *dst_p, size_t src, size_t size)
+static ssize_t setting_port_read(void *dst_p, size_t src, size_t size)
 {
-    eeprom_read_block(dst_p, &setting_area[src], size);
+    eeprom_read_block(dst_p, &setting_area[SETTING_AREA_OFFSET + src], size);
 
     return (size);
 }
 
-static int setting_port_write(size_t dst, const void *src_p, size_t size)
+static ssize_t setting_port_write(size_t dst, const void *src_p, size_t size)
 {
-    eeprom_update_block(src_p, &setting_area[dst], size);
+    eeprom_update_block(src_p,
+                        &setting_area[SETTING_AREA_OFFSET + dst],
+                        size);
 
     return (size);
 }
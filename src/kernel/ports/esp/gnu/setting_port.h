@@ -21,6 +21,7 @@
 #ifndef __KERNEL_SETTING_PORT_H__
 #define __KERNEL_SETTING_PORT_H__
 
-#define SETTING_MEMORY_EEPROM
+/* There is no setting memory driver yet. */
+#define SETTING_MEMORY_NONE
 
 #endif
@@ -23,12 +23,12 @@ static int setting_port_module_init(void)
     return (0);
 }
 
-static int setting_port_read(void *dst_p, size_t src, size_t size)
+static ssize_t setting_port_read(void *dst_p, size_t src, size_t size)
 {
     return (-1);
 }
 
-static int setting_port_write(size_t dst, const void *src_p, size_t size)
+static ssize_t setting_port_write(size_t dst, const void *src_p, size_t size)
 {
     return (-1);
 }
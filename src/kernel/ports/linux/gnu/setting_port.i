@@ -24,6 +24,10 @@ static FILE *setting_p = NULL;
 
 static int setting_port_module_init(void)
 {
+    if (setting_p != NULL) {
+        fclose(setting_p);
+    }
+
     setting_p = fopen(SETTINGS_FILENAME, "r+");
 
     if (setting_p == NULL) {
@@ -36,14 +40,21 @@ static int setting_port_module_init(void)
 
 static ssize_t setting_port_read(void *dst_p, size_t src, size_t size)
 {
-    fseek(setting_p, src, SEEK_SET);
+    fseek(setting_p, SETTING_AREA_OFFSET + src, SEEK_SET);
 
     return (fread(dst_p, 1, size, setting_p));
 }
 
 static ssize_t setting_port_write(size_t dst, const void *src_p, size_t size)
 {
-    fseek(setting_p, dst, SEEK_SET);
+    size_t res;
+
+    fseek(setting_p, SETTING_AREA_OFFSET + dst, SEEK_SET);
+    res = fwrite(src_p, 1, size, setting_p);
+
+    if (fflush(setting_p) != 0) {
+        return (-EIO);
+    }
 
-    return (fwrite(src_p, 1, size, setting_p));
+    return (res);
 }
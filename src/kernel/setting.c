@@ -22,17 +22,868 @@
 
 #include "setting_port.i"
 
+/**
+ * The setting area is divided into two pages. Each page has a
+ * header, an image of all settings and a log. Written settings are
+ * appended to the log of the active page. When the log or the RAM
+ * index is full, the image and the log are compacted into a new image
+ * in the other page, which then becomes the active page.
+ *
+ * The page header is written last when compacting, so the old page
+ * is used if the compaction is interrupted.
+ */
+#define PAGE_SIZE                          (SETTING_AREA_SIZE / 2)
+#define PAGE_MAGIC                                      0x73657467
+#define IMAGE_OFFSET          (sizeof(struct page_header_t))
+#define LOG_OFFSET                 (IMAGE_OFFSET + SETTING_IMAGE_SIZE)
+
+/* Size of an erased record header, the end of the log. */
+#define RECORD_SIZE_ERASED                                  0xffff
+
+#define KEY_EMPTY                                           0xffff
+
+/**
+ * Header at the beginning of each page. The crc covers the sequence
+ * number and the image.
+ */
+struct page_header_t {
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t crc;
+};
+
+/**
+ * Header of a record in the log. A record contains the settings of
+ * one transaction. The crc covers the size, the reserved field and
+ * the settings.
+ */
+struct record_header_t {
+    uint16_t size;
+    uint16_t reserved;
+    uint32_t crc;
+};
+
+/**
+ * Header of each setting in a record.
+ */
+struct entry_header_t {
+    uint16_t key;
+    uint16_t size;
+};
+
+/**
+ * Location of the newest value of a setting in the log.
+ */
+struct index_entry_t {
+    uint16_t key;
+    uint16_t size;
+    uint16_t offset;
+};
+
+struct module_t {
+    /* Serializes access to the log, the index and the active page. */
+    struct sem_t sem;
+    size_t page;
+    uint32_t sequence;
+    /* Offset in the page of the end of the log. */
+    size_t log_end;
+    size_t index_count;
+    struct index_entry_t index[SETTING_INDEX_LENGTH];
+};
+
+static struct module_t module;
+
+static int storage_read(void *dst_p, size_t src, size_t size)
+{
+    if (setting_port_read(dst_p, src, size) != (ssize_t)size) {
+        return (-EIO);
+    }
+
+    return (0);
+}
+
+static int storage_write(size_t dst, const void *src_p, size_t size)
+{
+    if (setting_port_write(dst, src_p, size) != (ssize_t)size) {
+        return (-EIO);
+    }
+
+    return (0);
+}
+
+/**
+ * Erase given storage region.
+ */
+static int storage_erase(size_t dst, size_t size)
+{
+    uint8_t buf[32];
+    size_t n;
+
+    memset(buf, 0xff, sizeof(buf));
+
+    while (size > 0) {
+        n = MIN(size, sizeof(buf));
+
+        if (storage_write(dst, buf, n) != 0) {
+            return (-EIO);
+        }
+
+        dst += n;
+        size -= n;
+    }
+
+    return (0);
+}
+
+static size_t page_offset(size_t page)
+{
+    return (page * PAGE_SIZE);
+}
+
+/**
+ * Convert given setting address to a key, which is the offset of the
+ * setting in the image.
+ *
+ * @return zero(0) or negative error code.
+ */
+static int address_to_key(size_t address, size_t size, size_t *key_p)
+{
+    if ((address < SETTING_AREA_OFFSET) || (size == 0)) {
+        return (-EINVAL);
+    }
+
+    address -= SETTING_AREA_OFFSET;
+
+    if (address + size > SETTING_IMAGE_SIZE) {
+        return (-EINVAL);
+    }
+
+    *key_p = address;
+
+    return (0);
+}
+
+static void index_clear(void)
+{
+    size_t i;
+
+    for (i = 0; i < membersof(module.index); i++) {
+        module.index[i].key = KEY_EMPTY;
+    }
+
+    module.index_count = 0;
+}
+
+/**
+ * Find the index entry of given key, or the empty entry where the key
+ * should be inserted.
+ *
+ * @return Found entry or NULL if the index is full.
+ */
+static struct index_entry_t *index_find(size_t key)
+{
+    struct index_entry_t *entry_p;
+    size_t i;
+    size_t n;
+
+    i = (key % membersof(module.index));
+
+    for (n = 0; n < membersof(module.index); n++) {
+        entry_p = &module.index[i];
+
+        if ((entry_p->key == key) || (entry_p->key == KEY_EMPTY)) {
+            return (entry_p);
+        }
+
+        i = ((i + 1) % membersof(module.index));
+    }
+
+    return (NULL);
+}
+
+static struct index_entry_t *index_lookup(size_t key)
+{
+    struct index_entry_t *entry_p;
+
+    entry_p = index_find(key);
+
+    if ((entry_p == NULL) || (entry_p->key != key)) {
+        return (NULL);
+    }
+
+    return (entry_p);
+}
+
+static int index_insert(size_t key, size_t size, size_t offset)
+{
+    struct index_entry_t *entry_p;
+
+    entry_p = index_find(key);
+
+    if (entry_p == NULL) {
+        return (-ENOMEM);
+    }
+
+    if (entry_p->key == KEY_EMPTY) {
+        module.index_count++;
+    }
+
+    entry_p->key = key;
+    entry_p->size = size;
+    entry_p->offset = offset;
+
+    return (0);
+}
+
+/**
+ * Check if given setting overlaps a setting in the index with another
+ * address or size. The log is compacted before such a setting is
+ * written, so settings in the index never overlap each other, and
+ * the order in which they are applied to the image does not matter.
+ *
+ * @return true(1) if an overlap was found, otherwise false(0).
+ */
+static int index_overlaps(size_t key, size_t size)
+{
+    struct index_entry_t *entry_p;
+    size_t i;
+
+    for (i = 0; i < membersof(module.index); i++) {
+        entry_p = &module.index[i];
+
+        if (entry_p->key == KEY_EMPTY) {
+            continue;
+        }
+
+        if ((entry_p->key == key) && (entry_p->size == size)) {
+            continue;
+        }
+
+        if ((key < entry_p->key + entry_p->size)
+            && (entry_p->key < key + size)) {
+            return (1);
+        }
+    }
+
+    return (0);
+}
+
+/**
+ * Overwrite given part of the image, already read into given buffer,
+ * with the settings in the log of the page at given offset.
+ *
+ * @return zero(0) or negative error code.
+ */
+static int overlay_log(uint8_t *buf_p, size_t pos, size_t size, size_t src)
+{
+    struct index_entry_t *entry_p;
+    size_t begin;
+    size_t end;
+    size_t i;
+
+    for (i = 0; i < membersof(module.index); i++) {
+        entry_p = &module.index[i];
+
+        if (entry_p->key == KEY_EMPTY) {
+            continue;
+        }
+
+        begin = MAX(entry_p->key, pos);
+        end = MIN(entry_p->key + entry_p->size, pos + size);
+
+        if (begin >= end) {
+            continue;
+        }
+
+        if (storage_read(&buf_p[begin - pos],
+                         src + entry_p->offset + begin - entry_p->key,
+                         end - begin) != 0) {
+            return (-EIO);
+        }
+    }
+
+    return (0);
+}
+
+/**
+ * Read given setting from the log if it was written with the same
+ * size, otherwise from the image overlaid with any overlapping
+ * settings in the log.
+ */
+static int read_value(void *dst_p, size_t key, size_t size)
+{
+    struct index_entry_t *entry_p;
+    size_t offset;
+
+    offset = page_offset(module.page);
+    entry_p = index_lookup(key);
+
+    if ((entry_p != NULL) && (entry_p->size == size)) {
+        return (storage_read(dst_p, offset + entry_p->offset, size));
+    }
+
+    if (storage_read(dst_p, offset + IMAGE_OFFSET + key, size) != 0) {
+        return (-EIO);
+    }
+
+    return (overlay_log(dst_p, key, size, offset));
+}
+
+/**
+ * Write the newest value of all settings to the image of the other
+ * page and make it the active page.
+ *
+ * @return zero(0) or negative error code.
+ */
+static int compact(void)
+{
+    struct page_header_t header;
+    uint8_t buf[32];
+    size_t src;
+    size_t dst;
+    size_t pos;
+    size_t n;
+
+    src = page_offset(module.page);
+    dst = page_offset(module.page ^ 1);
+
+    /* Invalidate the other page before overwriting it. */
+    if (storage_erase(dst, sizeof(header)) != 0) {
+        return (-EIO);
+    }
+
+    if (storage_erase(dst + LOG_OFFSET, PAGE_SIZE - LOG_OFFSET) != 0) {
+        return (-EIO);
+    }
+
+    header.magic = PAGE_MAGIC;
+    header.sequence = (module.sequence + 1);
+    header.crc = crc_32(0, &header.sequence, sizeof(header.sequence));
+
+    for (pos = 0; pos < SETTING_IMAGE_SIZE; pos += n) {
+        n = MIN(SETTING_IMAGE_SIZE - pos, sizeof(buf));
+
+        if (storage_read(buf, src + IMAGE_OFFSET + pos, n) != 0) {
+            return (-EIO);
+        }
+
+        /* Overwrite with settings in the log. */
+        if (overlay_log(buf, pos, n, src) != 0) {
+            return (-EIO);
+        }
+
+        if (storage_write(dst + IMAGE_OFFSET + pos, buf, n) != 0) {
+            return (-EIO);
+        }
+
+        header.crc = crc_32(header.crc, buf, n);
+    }
+
+    if (storage_write(dst, &header, sizeof(header)) != 0) {
+        return (-EIO);
+    }
+
+    module.page ^= 1;
+    module.sequence = header.sequence;
+    module.log_end = LOG_OFFSET;
+    index_clear();
+
+    return (0);
+}
+
+/**
+ * Make sure there is room for a record of given size in the log, and
+ * for given number of keys in the index. The log is compacted if
+ * needed.
+ *
+ * @param[in] size Size of the record data.
+ * @param[in] new_keys Number of keys not already in the index.
+ * @param[in] keys Number of unique keys in the record.
+ * @param[in] overlaps True(1) if a setting in the record overlaps a
+ *                     setting in the index with another address or
+ *                     size, which forces a compaction.
+ *
+ * @return zero(0) or negative error code.
+ */
+static int log_reserve(size_t size,
+                       size_t new_keys,
+                       size_t keys,
+                       int overlaps)
+{
+    size_t record_size;
+    int res;
+
+    record_size = (sizeof(struct record_header_t) + size);
+
+    if (!overlaps
+        && (module.log_end + record_size <= PAGE_SIZE)
+        && (module.index_count + new_keys <= membersof(module.index))) {
+        return (0);
+    }
+
+    res = compact();
+
+    if (res != 0) {
+        return (res);
+    }
+
+    if ((module.log_end + record_size > PAGE_SIZE)
+        || (keys > membersof(module.index))) {
+        return (-ENOMEM);
+    }
+
+    return (0);
+}
+
+/**
+ * Append a record to the log. The record data is given in two
+ * parts. The record header is written last.
+ *
+ * @return zero(0) or negative error code.
+ */
+static int log_append(const void *head_p,
+                      size_t head_size,
+                      const void *tail_p,
+                      size_t tail_size)
+{
+    struct record_header_t header;
+    size_t offset;
+
+    header.size = (head_size + tail_size);
+    header.reserved = 0;
+    header.crc = crc_32(0, &header, offsetof(struct record_header_t, crc));
+    header.crc = crc_32(header.crc, head_p, head_size);
+
+    if (tail_size > 0) {
+        header.crc = crc_32(header.crc, tail_p, tail_size);
+    }
+
+    offset = (page_offset(module.page) + module.log_end);
+
+    if (storage_write(offset + sizeof(header), head_p, head_size) != 0) {
+        return (-EIO);
+    }
+
+    if (tail_size > 0) {
+        if (storage_write(offset + sizeof(header) + head_size,
+                          tail_p,
+                          tail_size) != 0) {
+            return (-EIO);
+        }
+    }
+
+    if (storage_write(offset, &header, sizeof(header)) != 0) {
+        return (-EIO);
+    }
+
+    module.log_end += (sizeof(header) + header.size);
+
+    return (0);
+}
+
+#if !defined(SETTING_MEMORY_NONE)
+
+/**
+ * Check if the image in given page matches the crc in the page
+ * header.
+ *
+ * @return true(1) if the page is valid, otherwise false(0).
+ */
+static int is_page_valid(size_t page, uint32_t *sequence_p)
+{
+    struct page_header_t header;
+    uint8_t buf[32];
+    uint32_t crc;
+    size_t offset;
+    size_t pos;
+    size_t n;
+
+    offset = page_offset(page);
+
+    if (storage_read(&header, offset, sizeof(header)) != 0) {
+        return (0);
+    }
+
+    if (header.magic != PAGE_MAGIC) {
+        return (0);
+    }
+
+    crc = crc_32(0, &header.sequence, sizeof(header.sequence));
+
+    for (pos = 0; pos < SETTING_IMAGE_SIZE; pos += n) {
+        n = MIN(SETTING_IMAGE_SIZE - pos, sizeof(buf));
+
+        if (storage_read(buf, offset + IMAGE_OFFSET + pos, n) != 0) {
+            return (0);
+        }
+
+        crc = crc_32(crc, buf, n);
+    }
+
+    *sequence_p = header.sequence;
+
+    return (crc == header.crc);
+}
+
+/**
+ * Add all records in the log of the active page to the index.
+ *
+ * @return zero(0) if the log is ok, one(1) if the last record is
+ *         corrupt, or negative error code.
+ */
+static int log_scan(void)
+{
+    struct record_header_t header;
+    struct entry_header_t entry;
+    uint8_t buf[32];
+    uint32_t crc;
+    size_t offset;
+    size_t pos;
+    size_t end;
+    size_t n;
+
+    offset = page_offset(module.page);
+    module.log_end = LOG_OFFSET;
+    index_clear();
+
+    while (module.log_end + sizeof(header) <= PAGE_SIZE) {
+        if (storage_read(&header,
+                         offset + module.log_end,
+                         sizeof(header)) != 0) {
+            return (-EIO);
+        }
+
+        if (header.size == RECORD_SIZE_ERASED) {
+            break;
+        }
+
+        pos = (module.log_end + sizeof(header));
+        end = (pos + header.size);
+
+        if (end > PAGE_SIZE) {
+            return (1);
+        }
+
+        crc = crc_32(0, &header, offsetof(struct record_header_t, crc));
+
+        for (; pos < end; pos += n) {
+            n = MIN(end - pos, sizeof(buf));
+
+            if (storage_read(buf, offset + pos, n) != 0) {
+                return (-EIO);
+            }
+
+            crc = crc_32(crc, buf, n);
+        }
+
+        if (crc != header.crc) {
+            return (1);
+        }
+
+        /* Add the settings in the record to the index. */
+        for (pos = (module.log_end + sizeof(header)); pos < end; pos += n) {
+            if (storage_read(&entry, offset + pos, sizeof(entry)) != 0) {
+                return (-EIO);
+            }
+
+            n = (sizeof(entry) + entry.size);
+
+            if ((pos + n > end)
+                || (entry.key + entry.size > SETTING_IMAGE_SIZE)) {
+                return (1);
+            }
+
+            if (index_insert(entry.key,
+                             entry.size,
+                             pos + sizeof(entry)) != 0) {
+                return (-ENOMEM);
+            }
+        }
+
+        module.log_end = end;
+    }
+
+    return (0);
+}
+
+#endif
+
 int setting_module_init(void)
 {
-    return (setting_port_module_init());
+#if !defined(SETTING_MEMORY_NONE)
+    uint32_t sequences[2];
+    int valid[2];
+#endif
+    int res;
+
+    sem_init(&module.sem, 1);
+    res = setting_port_module_init();
+
+    if (res != 0) {
+        return (res);
+    }
+
+    module.page = 0;
+    module.log_end = LOG_OFFSET;
+    index_clear();
+
+#if defined(SETTING_MEMORY_NONE)
+    /* The port has no setting memory. All reads and writes fail. */
+    return (0);
+#else
+    valid[0] = is_page_valid(0, &sequences[0]);
+    valid[1] = is_page_valid(1, &sequences[1]);
+
+    if (valid[0] && valid[1]) {
+        module.page = ((int32_t)(sequences[1] - sequences[0]) > 0);
+    } else if (valid[0] || valid[1]) {
+        module.page = valid[1];
+    } else {
+        /* No valid page found. Format by compacting page one into
+           page zero. */
+        module.page = 1;
+        module.sequence = 0;
+
+        return (compact());
+    }
+
+    module.sequence = sequences[module.page];
+    res = log_scan();
+
+    /* Drop the corrupt record, probably interrupted by a power
+       failure. */
+    if (res == 1) {
+        res = compact();
+    }
+
+    return (res);
+#endif
 }
 
 ssize_t setting_read(void *dst_p, size_t src, size_t size)
 {
-    return (setting_port_read(dst_p, src, size));
+    size_t key;
+    int res;
+
+    res = address_to_key(src, size, &key);
+
+    if (res != 0) {
+        return (res);
+    }
+
+    sem_get(&module.sem, NULL);
+    res = read_value(dst_p, key, size);
+    sem_put(&module.sem, 1);
+
+    if (res != 0) {
+        return (res);
+    }
+
+    return (size);
+}
+
+/**
+ * Append given setting to the log and add it to the index.
+ *
+ * @return zero(0) or negative error code.
+ */
+static int write_value(size_t key, const void *src_p, size_t size)
+{
+    struct entry_header_t entry;
+    size_t offset;
+    int res;
+
+    res = log_reserve(sizeof(entry) + size,
+                      index_lookup(key) == NULL,
+                      1,
+                      index_overlaps(key, size));
+
+    if (res != 0) {
+        return (res);
+    }
+
+    entry.key = key;
+    entry.size = size;
+    offset = (module.log_end
+              + sizeof(struct record_header_t)
+              + sizeof(entry));
+
+    res = log_append(&entry, sizeof(entry), src_p, size);
+
+    if (res != 0) {
+        return (res);
+    }
+
+    return (index_insert(key, size, offset));
 }
 
 ssize_t setting_write(size_t dst, const void *src_p, size_t size)
 {
-    return (setting_port_write(dst, src_p, size));
+    size_t key;
+    int res;
+
+    res = address_to_key(dst, size, &key);
+
+    if (res != 0) {
+        return (res);
+    }
+
+    sem_get(&module.sem, NULL);
+    res = write_value(key, src_p, size);
+    sem_put(&module.sem, 1);
+
+    if (res != 0) {
+        return (res);
+    }
+
+    return (size);
+}
+
+int setting_transaction_init(struct setting_transaction_t *self_p,
+                             void *buf_p,
+                             size_t size)
+{
+    self_p->buf_p = buf_p;
+    self_p->size = size;
+    self_p->pos = 0;
+
+    return (0);
+}
+
+int setting_transaction_write(struct setting_transaction_t *self_p,
+                              size_t dst,
+                              const void *src_p,
+                              size_t size)
+{
+    struct entry_header_t entry;
+    size_t key;
+    size_t pos;
+    int res;
+
+    res = address_to_key(dst, size, &key);
+
+    if (res != 0) {
+        return (res);
+    }
+
+    if (self_p->pos + sizeof(entry) + size > self_p->size) {
+        return (-ENOMEM);
+    }
+
+    /* Settings in a record are added to the index in order, so they
+       must not overlap each other with another address or size. */
+    for (pos = 0; pos < self_p->pos; pos += sizeof(entry) + entry.size) {
+        memcpy(&entry, &self_p->buf_p[pos], sizeof(entry));
+
+        if ((entry.key == key) && (entry.size == size)) {
+            continue;
+        }
+
+        if ((key < entry.key + entry.size) && (entry.key < key + size)) {
+            return (-EINVAL);
+        }
+    }
+
+    entry.key = key;
+    entry.size = size;
+    memcpy(&self_p->buf_p[self_p->pos], &entry, sizeof(entry));
+    self_p->pos += sizeof(entry);
+    memcpy(&self_p->buf_p[self_p->pos], src_p, size);
+    self_p->pos += size;
+
+    return (0);
+}
+
+/**
+ * Append given transaction record to the log and add its settings to
+ * the index.
+ *
+ * @return zero(0) or negative error code.
+ */
+static int write_record(const uint8_t *buf_p, size_t size)
+{
+    struct entry_header_t entry;
+    struct entry_header_t other;
+    size_t new_keys;
+    size_t keys;
+    size_t offset;
+    size_t pos;
+    size_t i;
+    int overlaps;
+    int res;
+
+    /* Count unique keys, and those not already in the index. */
+    new_keys = 0;
+    keys = 0;
+    overlaps = 0;
+
+    for (pos = 0; pos < size; pos += sizeof(entry) + entry.size) {
+        memcpy(&entry, &buf_p[pos], sizeof(entry));
+        overlaps |= index_overlaps(entry.key, entry.size);
+
+        for (i = 0; i < pos; i += sizeof(other) + other.size) {
+            memcpy(&other, &buf_p[i], sizeof(other));
+
+            if (other.key == entry.key) {
+                break;
+            }
+        }
+
+        if (i < pos) {
+            continue;
+        }
+
+        keys++;
+
+        if (index_lookup(entry.key) == NULL) {
+            new_keys++;
+        }
+    }
+
+    res = log_reserve(size, new_keys, keys, overlaps);
+
+    if (res != 0) {
+        return (res);
+    }
+
+    offset = (module.log_end + sizeof(struct record_header_t));
+    res = log_append(buf_p, size, NULL, 0);
+
+    if (res != 0) {
+        return (res);
+    }
+
+    for (pos = 0; pos < size; pos += sizeof(entry) + entry.size) {
+        memcpy(&entry, &buf_p[pos], sizeof(entry));
+        res = index_insert(entry.key,
+                           entry.size,
+                           offset + pos + sizeof(entry));
+
+        if (res != 0) {
+            return (res);
+        }
+    }
+
+    return (0);
+}
+
+int setting_transaction_commit(struct setting_transaction_t *self_p)
+{
+    int res;
+
+    if (self_p->pos == 0) {
+        return (0);
+    }
+
+    sem_get(&module.sem, NULL);
+    res = write_record(self_p->buf_p, self_p->pos);
+    sem_put(&module.sem, 1);
+
+    if (res != 0) {
+        return (res);
+    }
+
+    self_p->pos = 0;
+
+    return (0);
 }
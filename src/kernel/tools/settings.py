@@ -48,7 +48,7 @@ HEADER_FMT = """/**
 
 #define SETTING_AREA_OFFSET     {setting_offset}
 #define SETTING_AREA_SIZE       {setting_size}
-#define SETTING_AREA_CRC_OFFSET (SETTING_AREA_SIZE - 4)
+#define SETTING_IMAGE_SIZE      {image_size}
 
 {addresses}
 
@@ -93,21 +93,27 @@ uint8_t setting_area[SETTING_AREA_OFFSET + SETTING_AREA_SIZE] __attribute__ ((se
     {content}
 }};
 
+#elif defined(SETTING_MEMORY_NONE)
+
+uint8_t setting_area[SETTING_AREA_OFFSET + SETTING_AREA_SIZE] = {{
+    {content}
+}};
+
 #else
 
-uint8_t setting_area[2][SETTING_AREA_OFFSET + SETTING_AREA_SIZE] __attribute__ ((section (".setting"))) = {{
-    {{
-        {content}
-    }},
-    {{
-        {content}
-    }}
+uint8_t setting_area[SETTING_AREA_OFFSET + SETTING_AREA_SIZE] __attribute__ ((section (".setting"))) = {{
+    {content}
 }};
 
 #endif
 
 """
 
+# Must match the page layout in setting.c.
+PAGE_MAGIC = 0x73657467
+PAGE_HEADER_SIZE = 12
+RECORD_HEADER_SIZE = 8
+
 re_integer = re.compile(r"(?P<sign>[u]?)int(?P<bits>\d+)_t")
 
 
@@ -164,10 +170,10 @@ def create_setting_dict(addresses, sizes, types, values):
     return setting
 
 
-def create_binary_content(setting, setting_memory, setting_size, endianess):
+def create_image(setting, endianess):
     endianess_prefix = ">" if endianess == "big" else "<"
 
-    # create the setting file content
+    # create the image with the default values of all settings
     content = ""
 
     for name, item in setting.items():
@@ -206,19 +212,37 @@ def create_binary_content(setting, setting_memory, setting_size, endianess):
         else:
             sys.stderr.write("{}: bad type\n".format(item["type"]))
             sys.exit(1)
+        # pad strings shorter than the size
+        content += "\xff" * (item["address"] + item["size"] - len(content))
+
+    return content
+
+
+def create_binary_content(setting, setting_size, endianess):
+    """The setting area is divided into two pages. The first page
+    contains a header and the image with the default values. The
+    second page and the log after the image in the first page are
+    erased.
+
+    """
+
+    endianess_prefix = ">" if endianess == "big" else "<"
+    page_size = setting_size / 2
+    image = create_image(setting, endianess)
 
-    if len(content) > setting_size:
-        fmt = "Settings area of size {} does not fit in memory of size {}.\n"
-        sys.stderr.write(fmt.format(len(content), setting_size))
+    # the log must fit at least one record
+    if PAGE_HEADER_SIZE + len(image) + RECORD_HEADER_SIZE > page_size:
+        fmt = "Settings image of size {} does not fit in page of size {}.\n"
+        sys.stderr.write(fmt.format(len(image), page_size))
         sys.exit(1)
 
-    if setting_memory == "eeprom":
-        content += '\xff' * (setting_size - len(content))
-    else:
-        # pad the rest of the area and calculate a crc32
-        content += '\xff' * (setting_size - 4 - len(content))
-        crc = (zlib.crc32(content) & 0xffffffff)
-        content += struct.pack(endianess_prefix + 'I', crc)
+    sequence = struct.pack(endianess_prefix + 'I', 1)
+    crc = (zlib.crc32(sequence + image) & 0xffffffff)
+    content = struct.pack(endianess_prefix + 'I', PAGE_MAGIC)
+    content += sequence
+    content += struct.pack(endianess_prefix + 'I', crc)
+    content += image
+    content += '\xff' * (setting_size - len(content))
 
     return content
 
@@ -226,6 +250,7 @@ def create_binary_content(setting, setting_memory, setting_size, endianess):
 def create_header_file(outdir,
                        setting_offset,
                        setting_size,
+                       image_size,
                        setting):
 
     addresses = []
@@ -253,6 +278,7 @@ def create_header_file(outdir,
                                      minor=MINOR,
                                      setting_offset=setting_offset,
                                      setting_size=setting_size,
+                                     image_size=image_size,
                                      addresses="\n".join(addresses),
                                      sizes="\n".join(sizes),
                                      types="\n".join(types),
@@ -316,10 +342,10 @@ if __name__ == "__main__":
         create_header_file(args.output_directory,
                            setting_offset,
                            setting_size,
+                           len(create_image(setting, endianess)),
                            setting)
 
     content = create_binary_content(setting,
-                                    args.setting_memory,
                                     setting_size,
                                     endianess)
 
@@ -107,8 +107,7 @@ struct spi_device_t spi_device[SPI_DEVICE_MAX] = {
         .drv_p = NULL,
         .mosi_p = &pin_d51_dev,
         .miso_p = &pin_d50_dev,
-        .sck_p = &pin_d52_dev,
-        .sem = { .count = 1, .head_p = NULL }
+        .sck_p = &pin_d52_dev
     }
 };
 
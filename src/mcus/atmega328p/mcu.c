@@ -58,8 +58,7 @@ struct spi_device_t spi_device[SPI_DEVICE_MAX] = {
         .drv_p = NULL,
         .mosi_p = &pin_d11_dev,
         .miso_p = &pin_d12_dev,
-        .sck_p = &pin_d13_dev,
-        .sem = { .count = 1, .head_p = NULL }
+        .sck_p = &pin_d13_dev
     }
 };
 
@@ -49,7 +49,6 @@ struct adc_device_t adc_device[ADC_DEVICE_MAX];
 struct spi_device_t spi_device[SPI_DEVICE_MAX] = {
     {
         .drv_p = NULL,
-        .regs_p = ESP8266_SPI0,
-        .sem = { .count = 1, .head_p = NULL }
+        .regs_p = ESP8266_SPI0
     }
 };
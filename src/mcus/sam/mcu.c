@@ -140,8 +140,7 @@ struct spi_device_t spi_device[SPI_DEVICE_MAX] = {
         .mosi_p = &pin_device[26],
         .miso_p = &pin_device[25],
         .sck_p = &pin_device[27],
-        .id = PERIPHERAL_ID_SPI0,
-        .sem = { .count = 1, .head_p = NULL }
+        .id = PERIPHERAL_ID_SPI0
     }
 };
 
@@ -605,8 +605,8 @@ struct sam_dmac_t {
 #define DMAC_CTRLA_DONE                 BIT(31)
 
 /* DMAC Channel x [x = 0..5] Control B Register */
-#define DMAC_CTRLB_SRC_DSCR             (16)
-#define DMAC_CTRLB_DST_DSCR             (20)
+#define DMAC_CTRLB_SRC_DSCR             BIT(16)
+#define DMAC_CTRLB_DST_DSCR             BIT(20)
 #define DMAC_CTRLB_FC_POS               (21)
 #define DMAC_CTRLB_FC_MASK              (0x7 << DMAC_CTRLB_FC_POS)
 #define DMAC_CTRLB_FC(value)            BITFIELD_SET(DMAC_CTRLB_FC, (value))
@@ -39,7 +39,7 @@ typedef unsigned long off_t;
 #include "drivers.h"
 #include "slib.h"
 
-#if defined(ARCH_ESP)
+#if defined(ARCH_ESP) || defined(ARCH_LINUX)
 #    include "inet.h"
 #endif
 
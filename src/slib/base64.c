@@ -20,108 +20,672 @@
 
 #include "simba.h"
 
-static char index_to_encoded(int index)
-{
-    if ((index >= 0) && (index <= 25)) {
-        return ('A' + index - 0);
-    } else if ((index >= 26) && (index <= 51)) {
-        return ('a' + index - 26);
-    } else if ((index >= 52) && (index <= 61)) {
-        return ('0' + index - 52);
-    } else if (index == 62) {
-        return ('+');
-    } else if (index == 63) {
-        return ('/');
-    } else if (index == 64) {
-        return ('=');
-    }
-
-    return (-1);
-}
-
-static int encoded_to_index(char encoded)
-{
-    if ((encoded >= 'A') && (encoded <= 'Z')) {
-        return (0 + encoded - 'A');
-    } else if ((encoded >= 'a') && (encoded <= 'z')) {
-        return (26 + encoded - 'a');
-    } else if ((encoded >= '0') && (encoded <= '9')) {
-        return (52 + encoded - '0');
-    } else if (encoded == '+') {
-        return (62);
-    } else if (encoded == '/') {
-        return (63);
-    } else if (encoded == '=') {
-        return (0);
+#if defined(ARCH_LINUX) && defined(__x86_64__)
+#    include <cpuid.h>
+#    include <immintrin.h>
+#    define BASE64_SIMD_X86
+#endif
+
+#define PAD                                               '='
+
+/* Marks characters not in the alphabet in the decoding tables. */
+#define INVALID                                          0xff
+
+FAR static const char encode_standard[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+FAR static const char encode_url[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+FAR static const uint8_t decode_standard[256] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0xff, 0xff, 0x3f,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+    0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x11, 0x12,
+    0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24,
+    0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30,
+    0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff
+};
+
+FAR static const uint8_t decode_url[256] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0xff,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+    0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x11, 0x12,
+    0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0x3f,
+    0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24,
+    0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30,
+    0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff
+};
+
+#if defined(BASE64_SIMD_X86)
+
+/* One(1) if the CPU has SSSE3, zero(0) if not and minus one(-1)
+   before the first call. */
+static int simd_available = -1;
+
+static int simd_is_available(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if (simd_available == -1) {
+        if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0) {
+            simd_available = 0;
+        } else {
+            simd_available = ((ecx & bit_SSSE3) != 0);
+        }
     }
 
-    return (-1);
+    return (simd_available);
 }
 
-int base64_encode(char *dst_p, const void *src_p, size_t size)
+/**
+ * Encode 12 bytes into 16 characters per iteration. The input is read
+ * 16 bytes at a time, so at least six groups of three bytes must be
+ * left. Returns the number of encoded groups.
+ */
+__attribute__((target("ssse3")))
+static size_t simd_encode(char *dst_p,
+                          const uint8_t *src_p,
+                          size_t groups,
+                          int alphabet)
 {
+    __m128i input, indices, t0, t1, offsets, lookup;
+    size_t left;
+
+    if (alphabet == BASE64_ALPHABET_URL) {
+        lookup = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52,
+                               '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                               '0' - 52, '0' - 52, '0' - 52, '-' - 62,
+                               '_' - 63, 'A', 0, 0);
+    } else {
+        lookup = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52,
+                               '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                               '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                               '/' - 63, 'A', 0, 0);
+    }
+
+    left = groups;
+
+    while (left >= 6) {
+        /* Spread three bytes into four 6 bits indices. */
+        input = _mm_loadu_si128((const __m128i *)src_p);
+        input = _mm_shuffle_epi8(input,
+                                 _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4,
+                                               7, 6, 8, 7, 10, 9, 11, 10));
+        t0 = _mm_and_si128(input, _mm_set1_epi32(0x0fc0fc00));
+        t0 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+        t1 = _mm_and_si128(input, _mm_set1_epi32(0x003f03f0));
+        t1 = _mm_mullo_epi16(t1, _mm_set1_epi32(0x01000010));
+        indices = _mm_or_si128(t0, t1);
+
+        /* Add the offset of the range of each index to the index. */
+        offsets = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+        t0 = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+        offsets = _mm_or_si128(offsets, _mm_and_si128(t0, _mm_set1_epi8(13)));
+        offsets = _mm_shuffle_epi8(lookup, offsets);
+        _mm_storeu_si128((__m128i *)dst_p, _mm_add_epi8(indices, offsets));
+
+        src_p += 12;
+        dst_p += 16;
+        left -= 4;
+    }
+
+    return (groups - left);
+}
+
+/**
+ * Decode 16 characters in the standard alphabet into 12 bytes per
+ * iteration. The output is written 16 bytes at a time, so at least
+ * six groups of four characters must be left. Returns the number of
+ * decoded groups, or -EINVAL on an invalid character.
+ */
+__attribute__((target("ssse3")))
+static ssize_t simd_decode(uint8_t *dst_p,
+                           const char *src_p,
+                           size_t groups)
+{
+    __m128i input, hi_nibbles, lo_nibbles, hi, lo, roll, mask_2f;
+    size_t left;
+
+    mask_2f = _mm_set1_epi8(0x2f);
+    left = groups;
+
+    while (left >= 6) {
+        input = _mm_loadu_si128((const __m128i *)src_p);
+
+        /* Validate using one bit per character class in two nibble
+           lookup tables. */
+        hi_nibbles = _mm_and_si128(_mm_srli_epi32(input, 4), mask_2f);
+        lo_nibbles = _mm_and_si128(input, mask_2f);
+        hi = _mm_shuffle_epi8(_mm_setr_epi8(0x10, 0x10, 0x01, 0x02,
+                                            0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10,
+                                            0x10, 0x10, 0x10, 0x10),
+                              hi_nibbles);
+        lo = _mm_shuffle_epi8(_mm_setr_epi8(0x15, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1a,
+                                            0x1b, 0x1b, 0x1b, 0x1a),
+                              lo_nibbles);
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi),
+                                             _mm_setzero_si128()))
+            != 0xffff) {
+            return (-EINVAL);
+        }
+
+        /* Characters to indices. */
+        roll = _mm_add_epi8(_mm_cmpeq_epi8(input, mask_2f), hi_nibbles);
+        roll = _mm_shuffle_epi8(_mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                              0, 0, 0, 0, 0, 0, 0, 0),
+                                roll);
+        input = _mm_add_epi8(input, roll);
+
+        /* Pack four 6 bits indices into three bytes. */
+        input = _mm_maddubs_epi16(input, _mm_set1_epi32(0x01400140));
+        input = _mm_madd_epi16(input, _mm_set1_epi32(0x00011000));
+        input = _mm_shuffle_epi8(input,
+                                 _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9,
+                                               8, 14, 13, 12, -1, -1, -1, -1));
+        _mm_storeu_si128((__m128i *)dst_p, input);
+
+        src_p += 16;
+        dst_p += 12;
+        left -= 4;
+    }
+
+    return (groups - left);
+}
+
+#endif
+
+/**
+ * Encode given number of groups of three bytes.
+ */
+static void encode_groups(char *dst_p,
+                          const uint8_t *src_p,
+                          size_t groups,
+                          int alphabet)
+{
+    FAR const char *table_p;
+    uint32_t value;
     int i;
-    int j;
-    int index;
-    const uint8_t *s_p = src_p;
-
-    for (i = 0, j = 0; i < size; i += 3, j += 4) {
-        index = ((s_p[i + 0] & 0xfc) >> 2);
-        dst_p[j + 0] = index_to_encoded(index);
-        index = ((s_p[i + 0] & 0x03) << 4);
-
-        if (i + 1 < size) {
-            index |= ((s_p[i + 1] & 0xf0) >> 4);
-            dst_p[j + 1] = index_to_encoded(index);
-            index = (s_p[i + 1] & 0x0f) << 2;
-            
-            if (i + 2 < size) {
-                index |= ((s_p[i + 2] & 0xc0) >> 6);
-                dst_p[j + 2] = index_to_encoded(index);
-                index = (s_p[i + 2] & 0x3f);
-                dst_p[j + 3] = index_to_encoded(index);
-            } else {
-                dst_p[j + 2] = index_to_encoded(index);
-                dst_p[j + 3] = index_to_encoded(64);
-            }
-        } else {
-            dst_p[j + 1] = index_to_encoded(index);
-            dst_p[j + 2] = index_to_encoded(64);
-            dst_p[j + 3] = index_to_encoded(64);
+
+#if defined(BASE64_SIMD_X86)
+    size_t size;
+
+    if (simd_is_available()) {
+        size = simd_encode(dst_p, src_p, groups, alphabet);
+        dst_p += (4 * size);
+        src_p += (3 * size);
+        groups -= size;
+    }
+#endif
+
+    if (alphabet == BASE64_ALPHABET_URL) {
+        table_p = encode_url;
+    } else {
+        table_p = encode_standard;
+    }
+
+    /* Twelve bytes per iteration. */
+    while (groups >= 4) {
+        for (i = 0; i < 4; i++) {
+            value = ((src_p[0] << 16) | (src_p[1] << 8) | src_p[2]);
+            dst_p[0] = table_p[value >> 18];
+            dst_p[1] = table_p[(value >> 12) & 0x3f];
+            dst_p[2] = table_p[(value >> 6) & 0x3f];
+            dst_p[3] = table_p[value & 0x3f];
+            src_p += 3;
+            dst_p += 4;
+        }
+
+        groups -= 4;
+    }
+
+    while (groups > 0) {
+        value = ((src_p[0] << 16) | (src_p[1] << 8) | src_p[2]);
+        dst_p[0] = table_p[value >> 18];
+        dst_p[1] = table_p[(value >> 12) & 0x3f];
+        dst_p[2] = table_p[(value >> 6) & 0x3f];
+        dst_p[3] = table_p[value & 0x3f];
+        src_p += 3;
+        dst_p += 4;
+        groups--;
+    }
+}
+
+/**
+ * Encode the last one or two bytes, followed by padding.
+ */
+static void encode_last(char *dst_p,
+                        const uint8_t *src_p,
+                        size_t size,
+                        int alphabet)
+{
+    uint8_t buf[3];
+
+    buf[0] = src_p[0];
+    buf[1] = ((size == 2) ? src_p[1] : 0);
+    buf[2] = 0;
+    encode_groups(dst_p, buf, 1, alphabet);
+    dst_p[3] = PAD;
+
+    if (size == 1) {
+        dst_p[2] = PAD;
+    }
+}
+
+static FAR const uint8_t *decode_table(int alphabet)
+{
+    if (alphabet == BASE64_ALPHABET_URL) {
+        return (decode_url);
+    } else {
+        return (decode_standard);
+    }
+}
+
+/**
+ * Decode given number of groups of four characters without padding.
+ */
+static int decode_groups(uint8_t *dst_p,
+                         const char *src_p,
+                         size_t groups,
+                         int alphabet)
+{
+    FAR const uint8_t *table_p;
+    uint32_t a, b, c, d;
+    uint32_t invalid;
+    int i;
+
+#if defined(BASE64_SIMD_X86)
+    ssize_t size;
+
+    if ((alphabet == BASE64_ALPHABET_STANDARD) && simd_is_available()) {
+        size = simd_decode(dst_p, src_p, groups);
+
+        if (size < 0) {
+            return (size);
+        }
+
+        dst_p += (3 * size);
+        src_p += (4 * size);
+        groups -= size;
+    }
+#endif
+
+    table_p = decode_table(alphabet);
+    invalid = 0;
+
+    /* Sixteen characters per iteration. */
+    while (groups > 0) {
+        for (i = 0; (i < 4) && (groups > 0); i++) {
+            a = table_p[(uint8_t)src_p[0]];
+            b = table_p[(uint8_t)src_p[1]];
+            c = table_p[(uint8_t)src_p[2]];
+            d = table_p[(uint8_t)src_p[3]];
+            invalid |= (a | b | c | d);
+            a = ((a << 18) | (b << 12) | (c << 6) | d);
+            dst_p[0] = (a >> 16);
+            dst_p[1] = (a >> 8);
+            dst_p[2] = a;
+            src_p += 4;
+            dst_p += 3;
+            groups--;
+        }
+
+        if (invalid & 0x80) {
+            return (-EINVAL);
         }
     }
 
     return (0);
 }
 
+/**
+ * Decode the last two to four characters, where the last one or two
+ * may be padding. Returns the number of decoded bytes.
+ */
+static ssize_t decode_last(uint8_t *dst_p,
+                           const char *src_p,
+                           size_t size,
+                           int alphabet)
+{
+    char buf[4];
+    uint8_t output[3];
+    ssize_t res;
+
+    /* Remove padding. */
+    if ((size == 4) && (src_p[3] == PAD)) {
+        size--;
+
+        if (src_p[2] == PAD) {
+            size--;
+        }
+    }
+
+    if (size < 2) {
+        return (-EINVAL);
+    }
+
+    /* Replace the missing characters with the first character of the
+       alphabet, decoded as zero. */
+    memset(buf, 'A', sizeof(buf));
+    memcpy(buf, src_p, size);
+    res = decode_groups(output, buf, 1, alphabet);
+
+    if (res != 0) {
+        return (res);
+    }
+
+    memcpy(dst_p, output, size - 1);
+
+    return (size - 1);
+}
+
+static int encode(char *dst_p,
+                  const void *src_p,
+                  size_t size,
+                  int alphabet)
+{
+    const uint8_t *s_p;
+
+    s_p = src_p;
+    encode_groups(dst_p, s_p, size / 3, alphabet);
+
+    if ((size % 3) != 0) {
+        encode_last(&dst_p[4 * (size / 3)],
+                    &s_p[3 * (size / 3)],
+                    size % 3,
+                    alphabet);
+    }
+
+    return (0);
+}
+
+static ssize_t decode(void *dst_p,
+                      const char *src_p,
+                      size_t size,
+                      int alphabet)
+{
+    uint8_t *d_p;
+    size_t groups;
+    ssize_t res;
+
+    if (size == 0) {
+        return (0);
+    }
+
+    /* All groups but the last, which may contain padding. */
+    d_p = dst_p;
+    groups = ((size - 1) / 4);
+    res = decode_groups(d_p, src_p, groups, alphabet);
+
+    if (res != 0) {
+        return (res);
+    }
+
+    res = decode_last(&d_p[3 * groups],
+                      &src_p[4 * groups],
+                      size - 4 * groups,
+                      alphabet);
+
+    if (res < 0) {
+        return (res);
+    }
+
+    return (3 * groups + res);
+}
+
+int base64_encode(char *dst_p, const void *src_p, size_t size)
+{
+    return (encode(dst_p, src_p, size, BASE64_ALPHABET_STANDARD));
+}
+
 int base64_decode(void *dst_p, const char *src_p, size_t size)
 {
-    int i;
-    int j;
-    uint8_t index[4];
-    uint8_t *d_p = dst_p;
-    
+    ssize_t res;
+
     if ((size % 4) != 0) {
         return (-EINVAL);
     }
 
-    for (i = 0, j = 0; i < size; i += 4, j += 3) {
-        index[0] = encoded_to_index(src_p[i + 0]);
-        index[1] = encoded_to_index(src_p[i + 1]);
-        index[2] = encoded_to_index(src_p[i + 2]);
-        index[3] = encoded_to_index(src_p[i + 3]);
+    res = decode(dst_p, src_p, size, BASE64_ALPHABET_STANDARD);
+
+    if (res < 0) {
+        return (res);
+    }
+
+    return (0);
+}
+
+int base64_url_encode(char *dst_p, const void *src_p, size_t size)
+{
+    return (encode(dst_p, src_p, size, BASE64_ALPHABET_URL));
+}
+
+ssize_t base64_url_decode(void *dst_p, const char *src_p, size_t size)
+{
+    return (decode(dst_p, src_p, size, BASE64_ALPHABET_URL));
+}
+
+int base64_encoder_init(struct base64_encoder_t *self_p,
+                        struct chan_t *chan_p,
+                        int alphabet)
+{
+    chan_init(&self_p->base,
+              NULL,
+              (ssize_t (*)(void *, const void *, size_t))base64_encoder_write,
+              NULL);
+
+    self_p->chan_p = chan_p;
+    self_p->alphabet = alphabet;
+    self_p->input.size = 0;
+
+    return (0);
+}
+
+ssize_t base64_encoder_write(struct base64_encoder_t *self_p,
+                             const void *buf_p,
+                             size_t size)
+{
+    const uint8_t *b_p;
+    size_t left;
+    size_t groups;
+    size_t n;
+
+    b_p = buf_p;
+    left = size;
+
+    /* Complete the buffered group. */
+    if (self_p->input.size > 0) {
+        n = MIN(3 - self_p->input.size, left);
+        memcpy(&self_p->input.buf[self_p->input.size], b_p, n);
+        self_p->input.size += n;
+        b_p += n;
+        left -= n;
+
+        if (self_p->input.size < 3) {
+            return (size);
+        }
+
+        encode_groups(self_p->output, self_p->input.buf, 1, self_p->alphabet);
+        self_p->input.size = 0;
+
+        if (chan_write(self_p->chan_p, self_p->output, 4) != 4) {
+            return (-EIO);
+        }
+    }
+
+    /* Encode directly from the input buffer. */
+    while (left >= 3) {
+        groups = MIN(left / 3, sizeof(self_p->output) / 4);
+        encode_groups(self_p->output, b_p, groups, self_p->alphabet);
+
+        if (chan_write(self_p->chan_p,
+                       self_p->output,
+                       4 * groups) != (4 * groups)) {
+            return (-EIO);
+        }
+
+        b_p += (3 * groups);
+        left -= (3 * groups);
+    }
+
+    memcpy(self_p->input.buf, b_p, left);
+    self_p->input.size = left;
+
+    return (size);
+}
+
+int base64_encoder_finish(struct base64_encoder_t *self_p)
+{
+    if (self_p->input.size == 0) {
+        return (0);
+    }
+
+    encode_last(self_p->output,
+                self_p->input.buf,
+                self_p->input.size,
+                self_p->alphabet);
+    self_p->input.size = 0;
+
+    if (chan_write(self_p->chan_p, self_p->output, 4) != 4) {
+        return (-EIO);
+    }
+
+    return (0);
+}
+
+int base64_decoder_init(struct base64_decoder_t *self_p,
+                        struct chan_t *chan_p,
+                        int alphabet)
+{
+    chan_init(&self_p->base,
+              NULL,
+              (ssize_t (*)(void *, const void *, size_t))base64_decoder_write,
+              NULL);
+
+    self_p->chan_p = chan_p;
+    self_p->alphabet = alphabet;
+    self_p->input.size = 0;
+
+    return (0);
+}
+
+ssize_t base64_decoder_write(struct base64_decoder_t *self_p,
+                             const void *buf_p,
+                             size_t size)
+{
+    const char *b_p;
+    size_t left;
+    size_t groups;
+    size_t n;
+
+    b_p = buf_p;
+    left = size;
+
+    while (left > 0) {
+        /* More data follows the buffered group, so it has no
+           padding. */
+        if (self_p->input.size == 4) {
+            if (decode_groups(self_p->output,
+                              self_p->input.buf,
+                              1,
+                              self_p->alphabet) != 0) {
+                return (-EINVAL);
+            }
+
+            self_p->input.size = 0;
+
+            if (chan_write(self_p->chan_p, self_p->output, 3) != 3) {
+                return (-EIO);
+            }
+        }
+
+        if ((self_p->input.size > 0) || (left <= 4)) {
+            n = MIN(4 - self_p->input.size, left);
+            memcpy(&self_p->input.buf[self_p->input.size], b_p, n);
+            self_p->input.size += n;
+            b_p += n;
+            left -= n;
+        } else {
+            /* Decode directly from the input buffer, keeping at least
+               one character for the last group. */
+            groups = MIN((left - 1) / 4, sizeof(self_p->output) / 3);
+
+            if (decode_groups(self_p->output,
+                              b_p,
+                              groups,
+                              self_p->alphabet) != 0) {
+                return (-EINVAL);
+            }
+
+            if (chan_write(self_p->chan_p,
+                           self_p->output,
+                           3 * groups) != (3 * groups)) {
+                return (-EIO);
+            }
 
-        if ((index[0] == -1)
-            || (index[1] == -1)
-            || (index[2] == -1)
-            || (index[3] == -1)) {
-            return (-1);
+            b_p += (4 * groups);
+            left -= (4 * groups);
         }
+    }
+
+    return (size);
+}
 
-        d_p[j] = ((index[0] << 2) | (index[1] >> 4));
-        d_p[j + 1] = ((index[1] << 4) | (index[2] >> 2));
-        d_p[j + 2] = ((index[2] << 6) | index[3]);
+int base64_decoder_finish(struct base64_decoder_t *self_p)
+{
+    ssize_t size;
+
+    if (self_p->input.size == 0) {
+        return (0);
     }
-    
+
+    size = decode_last(self_p->output,
+                       self_p->input.buf,
+                       self_p->input.size,
+                       self_p->alphabet);
+    self_p->input.size = 0;
+
+    if (size < 0) {
+        return (size);
+    }
+
+    if (chan_write(self_p->chan_p, self_p->output, size) != size) {
+        return (-EIO);
+    }
+
     return (0);
 }
@@ -0,0 +1,1092 @@
+/**
+ * @file deflate.c
+ * @version 0.5.0
+ *
+ * @section License
+ * Copyright (C) 2016, Erik Moqvist
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Simba project.
+ */
+
+#include "simba.h"
+
+#define MATCH_MIN                                           3
+#define MATCH_MAX                                         258
+
+#define END_OF_BLOCK                                      256
+
+/* Decompressor states. */
+#define STATE_HEADER                                        0
+#define STATE_STORED_HEADER                                 1
+#define STATE_STORED                                        2
+#define STATE_DYNAMIC_HEADER                                3
+#define STATE_CODE_LENGTH_CODES                             4
+#define STATE_CODE_LENGTHS                                  5
+#define STATE_CODES                                         6
+#define STATE_COPY                                          7
+#define STATE_DONE                                          8
+
+static const uint16_t length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+
+static const uint8_t length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+static const uint16_t distance_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577
+};
+
+static const uint8_t distance_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+/* Order of the code length code lengths in a dynamic block
+   header. */
+static const uint8_t code_length_order[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+static struct fs_counter_t bytes_saved;
+
+/**
+ * Write the buffered compressed data to the output channel.
+ */
+static int deflate_output_flush(struct deflate_t *self_p)
+{
+    size_t size;
+
+    size = self_p->output.size;
+
+    if (size == 0) {
+        return (0);
+    }
+
+    if (chan_write(self_p->chan_p, self_p->output.buf, size) != size) {
+        return (-EIO);
+    }
+
+    self_p->counters.output += size;
+    self_p->output.size = 0;
+
+    return (0);
+}
+
+/**
+ * Append given bits to the output, least significant bit first.
+ */
+static int put_bits(struct deflate_t *self_p,
+                    uint32_t value,
+                    int size)
+{
+    self_p->bits.value |= (value << self_p->bits.size);
+    self_p->bits.size += size;
+
+    while (self_p->bits.size >= 8) {
+        self_p->output.buf[self_p->output.size++] = self_p->bits.value;
+        self_p->bits.value >>= 8;
+        self_p->bits.size -= 8;
+
+        if (self_p->output.size == sizeof(self_p->output.buf)) {
+            if (deflate_output_flush(self_p) != 0) {
+                return (-EIO);
+            }
+        }
+    }
+
+    return (0);
+}
+
+/**
+ * Huffman codes are packed starting with the most significant bit.
+ */
+static int put_code(struct deflate_t *self_p,
+                    uint32_t code,
+                    int size)
+{
+    uint32_t reversed;
+    int i;
+
+    reversed = 0;
+
+    for (i = 0; i < size; i++) {
+        reversed <<= 1;
+        reversed |= (code & 1);
+        code >>= 1;
+    }
+
+    return (put_bits(self_p, reversed, size));
+}
+
+/**
+ * Append the fixed Huffman code of given literal/length symbol.
+ */
+static int put_symbol(struct deflate_t *self_p,
+                      int symbol)
+{
+    if (symbol < 144) {
+        return (put_code(self_p, 0x30 + symbol, 8));
+    } else if (symbol < 256) {
+        return (put_code(self_p, 0x190 + symbol - 144, 9));
+    } else if (symbol < 280) {
+        return (put_code(self_p, symbol - 256, 7));
+    } else {
+        return (put_code(self_p, 0xc0 + symbol - 280, 8));
+    }
+}
+
+static int put_match(struct deflate_t *self_p,
+                     size_t length,
+                     size_t distance)
+{
+    int i;
+
+    i = (membersof(length_base) - 1);
+
+    while (length_base[i] > length) {
+        i--;
+    }
+
+    if (put_symbol(self_p, 257 + i) != 0) {
+        return (-EIO);
+    }
+
+    if (put_bits(self_p, length - length_base[i], length_extra[i]) != 0) {
+        return (-EIO);
+    }
+
+    i = (membersof(distance_base) - 1);
+
+    while (distance_base[i] > distance) {
+        i--;
+    }
+
+    if (put_code(self_p, i, 5) != 0) {
+        return (-EIO);
+    }
+
+    return (put_bits(self_p, distance - distance_base[i], distance_extra[i]));
+}
+
+/**
+ * Start a block with fixed Huffman codes, if not already started.
+ */
+static int block_begin(struct deflate_t *self_p)
+{
+    if (self_p->block_open == 1) {
+        return (0);
+    }
+
+    self_p->block_open = 1;
+
+    /* BFINAL = 0 and BTYPE = 01. */
+    return (put_bits(self_p, 0x2, 3));
+}
+
+static int block_end(struct deflate_t *self_p)
+{
+    if (self_p->block_open == 0) {
+        return (0);
+    }
+
+    self_p->block_open = 0;
+
+    return (put_symbol(self_p, END_OF_BLOCK));
+}
+
+static int hash(const uint8_t *buf_p)
+{
+    uint32_t value;
+
+    value = (((uint32_t)buf_p[0] << 16)
+             | ((uint32_t)buf_p[1] << 8)
+             | buf_p[2]);
+    value *= 2654435761ul;
+
+    return (value >> (32 - DEFLATE_HASH_BITS));
+}
+
+/**
+ * Compress buffered input. A full match length of lookahead is kept
+ * unless flushing.
+ */
+static int compress(struct deflate_t *self_p,
+                    int flush)
+{
+    uint8_t *buf_p;
+    size_t pos;
+    size_t end;
+    size_t available;
+    size_t candidate;
+    size_t distance;
+    size_t length;
+    size_t max;
+    size_t i;
+    int h;
+
+    buf_p = self_p->window.buf;
+    pos = self_p->window.pos;
+    end = self_p->window.end;
+    distance = 0;
+
+    while (1) {
+        available = (end - pos);
+
+        if ((available == 0)
+            || ((flush == 0) && (available < MATCH_MAX))) {
+            break;
+        }
+
+        /* Look for a match at the most recent position with the same
+           hash. */
+        length = 0;
+
+        if (available >= MATCH_MIN) {
+            h = hash(&buf_p[pos]);
+            candidate = self_p->head[h];
+            self_p->head[h] = (pos + 1);
+
+            if (candidate != 0) {
+                candidate--;
+                distance = (pos - candidate);
+
+                if (distance <= DEFLATE_WINDOW_SIZE) {
+                    max = MIN(available, MATCH_MAX);
+
+                    while ((length < max)
+                           && (buf_p[candidate + length] == buf_p[pos + length])) {
+                        length++;
+                    }
+                }
+            }
+        }
+
+        if (block_begin(self_p) != 0) {
+            return (-EIO);
+        }
+
+        if (length >= MATCH_MIN) {
+            if (put_match(self_p, length, distance) != 0) {
+                return (-EIO);
+            }
+
+            /* Hash the matched positions for later matches. */
+            for (i = 1; (i < length) && (pos + i + MATCH_MIN <= end); i++) {
+                self_p->head[hash(&buf_p[pos + i])] = (pos + i + 1);
+            }
+
+            pos += length;
+        } else {
+            if (put_symbol(self_p, buf_p[pos]) != 0) {
+                return (-EIO);
+            }
+
+            pos++;
+        }
+    }
+
+    self_p->window.pos = pos;
+
+    return (0);
+}
+
+/**
+ * Discard the oldest half of the input buffer. All compressed
+ * positions in the discarded half are outside the window.
+ */
+static void slide(struct deflate_t *self_p)
+{
+    size_t i;
+
+    memmove(&self_p->window.buf[0],
+            &self_p->window.buf[DEFLATE_WINDOW_SIZE],
+            DEFLATE_WINDOW_SIZE);
+    self_p->window.pos -= DEFLATE_WINDOW_SIZE;
+    self_p->window.end -= DEFLATE_WINDOW_SIZE;
+
+    for (i = 0; i < membersof(self_p->head); i++) {
+        if (self_p->head[i] > DEFLATE_WINDOW_SIZE) {
+            self_p->head[i] -= DEFLATE_WINDOW_SIZE;
+        } else {
+            self_p->head[i] = 0;
+        }
+    }
+}
+
+/**
+ * Pad the output to a byte boundary.
+ */
+static int align(struct deflate_t *self_p)
+{
+    if (self_p->bits.size == 0) {
+        return (0);
+    }
+
+    return (put_bits(self_p, 0, 8 - self_p->bits.size));
+}
+
+/**
+ * Write all buffered output and update the bytes saved counter.
+ */
+static int deflate_output_end(struct deflate_t *self_p)
+{
+    if (deflate_output_flush(self_p) != 0) {
+        return (-EIO);
+    }
+
+    if (self_p->counters.input > self_p->counters.output) {
+        fs_counter_increment(&bytes_saved,
+                             self_p->counters.input - self_p->counters.output);
+    }
+
+    self_p->counters.input = 0;
+    self_p->counters.output = 0;
+
+    return (0);
+}
+
+/**
+ * Read given number of bits from the bit buffer.
+ *
+ * @return zero(0) or -EAGAIN if the bit buffer has fewer bits.
+ */
+static int get_bits(struct inflate_t *self_p,
+                    int size,
+                    uint32_t *value_p)
+{
+    if (self_p->bits.size < size) {
+        return (-EAGAIN);
+    }
+
+    *value_p = (self_p->bits.value & (((uint64_t)1 << size) - 1));
+    self_p->bits.value >>= size;
+    self_p->bits.size -= size;
+
+    return (0);
+}
+
+/**
+ * Build a canonical Huffman decoding table from given code lengths.
+ */
+static int huffman_build(struct inflate_huffman_t *self_p,
+                         const uint8_t *lengths_p,
+                         int length)
+{
+    uint16_t offsets[16];
+    int left;
+    int i;
+
+    memset(self_p->counts, 0, sizeof(self_p->counts));
+
+    for (i = 0; i < length; i++) {
+        self_p->counts[lengths_p[i]]++;
+    }
+
+    /* Over-subscribed codes are invalid. Incomplete codes are
+       allowed. */
+    left = 1;
+
+    for (i = 1; i < 16; i++) {
+        left <<= 1;
+        left -= self_p->counts[i];
+
+        if (left < 0) {
+            return (-EBADMSG);
+        }
+    }
+
+    offsets[1] = 0;
+
+    for (i = 1; i < 15; i++) {
+        offsets[i + 1] = (offsets[i] + self_p->counts[i]);
+    }
+
+    for (i = 0; i < length; i++) {
+        if (lengths_p[i] != 0) {
+            self_p->symbols_p[offsets[lengths_p[i]]++] = i;
+        }
+    }
+
+    return (0);
+}
+
+/**
+ * Decode a symbol from the bit buffer.
+ *
+ * @return Symbol, -EAGAIN if the bit buffer has too few bits, or
+ *         -EBADMSG if the code is invalid.
+ */
+static int huffman_decode(struct inflate_t *self_p,
+                          struct inflate_huffman_t *huffman_p)
+{
+    int code;
+    int first;
+    int index;
+    int count;
+    int i;
+
+    code = 0;
+    first = 0;
+    index = 0;
+
+    for (i = 1; i < 16; i++) {
+        if (self_p->bits.size == 0) {
+            return (-EAGAIN);
+        }
+
+        code |= (self_p->bits.value & 1);
+        self_p->bits.value >>= 1;
+        self_p->bits.size--;
+        count = huffman_p->counts[i];
+
+        if (code - count < first) {
+            return (huffman_p->symbols_p[index + (code - first)]);
+        }
+
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+
+    return (-EBADMSG);
+}
+
+/**
+ * Write the decompressed data not yet written to the output channel.
+ */
+static int inflate_output_flush(struct inflate_t *self_p)
+{
+    size_t size;
+
+    size = (self_p->window.pos - self_p->window.flushed);
+
+    if (size == 0) {
+        return (0);
+    }
+
+    if (chan_write(self_p->chan_p,
+                   &self_p->window.buf[self_p->window.flushed],
+                   size) != size) {
+        return (-EIO);
+    }
+
+    self_p->window.flushed = self_p->window.pos;
+
+    return (0);
+}
+
+static int output_byte(struct inflate_t *self_p,
+                       uint8_t value)
+{
+    self_p->window.buf[self_p->window.pos++] = value;
+
+    if (self_p->window.pos == DEFLATE_WINDOW_SIZE) {
+        if (inflate_output_flush(self_p) != 0) {
+            return (-EIO);
+        }
+
+        self_p->window.pos = 0;
+        self_p->window.flushed = 0;
+        self_p->window.full = 1;
+    }
+
+    return (0);
+}
+
+static void end_of_block(struct inflate_t *self_p)
+{
+    if (self_p->final == 1) {
+        self_p->state = STATE_DONE;
+    } else {
+        self_p->state = STATE_HEADER;
+    }
+}
+
+static int build_fixed(struct inflate_t *self_p)
+{
+    uint8_t *lengths_p;
+
+    lengths_p = self_p->header.lengths;
+    memset(&lengths_p[0], 8, 144);
+    memset(&lengths_p[144], 9, 112);
+    memset(&lengths_p[256], 7, 24);
+    memset(&lengths_p[280], 8, 8);
+    memset(&lengths_p[288], 5, 30);
+
+    if (huffman_build(&self_p->literal, &lengths_p[0], 288) != 0) {
+        return (-EBADMSG);
+    }
+
+    return (huffman_build(&self_p->distance_codes, &lengths_p[288], 30));
+}
+
+static int step_header(struct inflate_t *self_p)
+{
+    uint32_t value;
+
+    if (get_bits(self_p, 3, &value) != 0) {
+        return (-EAGAIN);
+    }
+
+    self_p->final = (value & 0x1);
+
+    switch (value >> 1) {
+
+    case 0:
+        self_p->state = STATE_STORED_HEADER;
+        break;
+
+    case 1:
+        if (build_fixed(self_p) != 0) {
+            return (-EBADMSG);
+        }
+
+        self_p->state = STATE_CODES;
+        break;
+
+    case 2:
+        self_p->state = STATE_DYNAMIC_HEADER;
+        break;
+
+    default:
+        return (-EBADMSG);
+    }
+
+    return (0);
+}
+
+static int step_stored_header(struct inflate_t *self_p)
+{
+    uint32_t value;
+
+    /* The length is byte aligned. Whole bytes are loaded into the bit
+       buffer. */
+    self_p->bits.value >>= (self_p->bits.size % 8);
+    self_p->bits.size -= (self_p->bits.size % 8);
+
+    if (get_bits(self_p, 32, &value) != 0) {
+        return (-EAGAIN);
+    }
+
+    if ((value & 0xffff) != ((~value >> 16) & 0xffff)) {
+        return (-EBADMSG);
+    }
+
+    self_p->length = (value & 0xffff);
+
+    if (self_p->length == 0) {
+        end_of_block(self_p);
+    } else {
+        self_p->state = STATE_STORED;
+    }
+
+    return (0);
+}
+
+static int step_stored(struct inflate_t *self_p)
+{
+    uint32_t value;
+
+    if (get_bits(self_p, 8, &value) != 0) {
+        return (-EAGAIN);
+    }
+
+    if (output_byte(self_p, value) != 0) {
+        return (-EIO);
+    }
+
+    self_p->length--;
+
+    if (self_p->length == 0) {
+        end_of_block(self_p);
+    }
+
+    return (0);
+}
+
+static int step_dynamic_header(struct inflate_t *self_p)
+{
+    uint32_t value;
+
+    if (get_bits(self_p, 14, &value) != 0) {
+        return (-EAGAIN);
+    }
+
+    self_p->header.hlit = ((value & 0x1f) + 257);
+    self_p->header.hdist = (((value >> 5) & 0x1f) + 1);
+    self_p->header.hclen = (((value >> 10) & 0xf) + 4);
+
+    if ((self_p->header.hlit > 286) || (self_p->header.hdist > 30)) {
+        return (-EBADMSG);
+    }
+
+    memset(self_p->header.lengths, 0, membersof(code_length_order));
+    self_p->header.index = 0;
+    self_p->state = STATE_CODE_LENGTH_CODES;
+
+    return (0);
+}
+
+static int step_code_length_codes(struct inflate_t *self_p)
+{
+    uint32_t value;
+
+    if (get_bits(self_p, 3, &value) != 0) {
+        return (-EAGAIN);
+    }
+
+    self_p->header.lengths[code_length_order[self_p->header.index]] = value;
+    self_p->header.index++;
+
+    if (self_p->header.index == self_p->header.hclen) {
+        /* The distance table is used for the code length codes. */
+        if (huffman_build(&self_p->distance_codes,
+                          self_p->header.lengths,
+                          membersof(code_length_order)) != 0) {
+            return (-EBADMSG);
+        }
+
+        self_p->header.index = 0;
+        self_p->state = STATE_CODE_LENGTHS;
+    }
+
+    return (0);
+}
+
+static int step_code_lengths(struct inflate_t *self_p)
+{
+    uint8_t *lengths_p;
+    uint32_t value;
+    int symbol;
+    int length;
+    int count;
+    int total;
+
+    lengths_p = self_p->header.lengths;
+    total = (self_p->header.hlit + self_p->header.hdist);
+    symbol = huffman_decode(self_p, &self_p->distance_codes);
+
+    if (symbol < 0) {
+        return (symbol);
+    }
+
+    if (symbol < 16) {
+        lengths_p[self_p->header.index++] = symbol;
+    } else {
+        if (symbol == 16) {
+            if (self_p->header.index == 0) {
+                return (-EBADMSG);
+            }
+
+            length = lengths_p[self_p->header.index - 1];
+
+            if (get_bits(self_p, 2, &value) != 0) {
+                return (-EAGAIN);
+            }
+
+            count = (3 + value);
+        } else if (symbol == 17) {
+            length = 0;
+
+            if (get_bits(self_p, 3, &value) != 0) {
+                return (-EAGAIN);
+            }
+
+            count = (3 + value);
+        } else {
+            length = 0;
+
+            if (get_bits(self_p, 7, &value) != 0) {
+                return (-EAGAIN);
+            }
+
+            count = (11 + value);
+        }
+
+        if (self_p->header.index + count > total) {
+            return (-EBADMSG);
+        }
+
+        memset(&lengths_p[self_p->header.index], length, count);
+        self_p->header.index += count;
+    }
+
+    if (self_p->header.index == total) {
+        /* The end of block code is required. */
+        if (lengths_p[END_OF_BLOCK] == 0) {
+            return (-EBADMSG);
+        }
+
+        if (huffman_build(&self_p->literal,
+                          &lengths_p[0],
+                          self_p->header.hlit) != 0) {
+            return (-EBADMSG);
+        }
+
+        if (huffman_build(&self_p->distance_codes,
+                          &lengths_p[self_p->header.hlit],
+                          self_p->header.hdist) != 0) {
+            return (-EBADMSG);
+        }
+
+        self_p->state = STATE_CODES;
+    }
+
+    return (0);
+}
+
+static int step_codes(struct inflate_t *self_p)
+{
+    uint32_t value;
+    size_t length;
+    int symbol;
+
+    symbol = huffman_decode(self_p, &self_p->literal);
+
+    if (symbol < 0) {
+        return (symbol);
+    }
+
+    if (symbol < END_OF_BLOCK) {
+        return (output_byte(self_p, symbol));
+    }
+
+    if (symbol == END_OF_BLOCK) {
+        end_of_block(self_p);
+
+        return (0);
+    }
+
+    symbol -= 257;
+
+    if (symbol >= membersof(length_base)) {
+        return (-EBADMSG);
+    }
+
+    if (get_bits(self_p, length_extra[symbol], &value) != 0) {
+        return (-EAGAIN);
+    }
+
+    length = (length_base[symbol] + value);
+    symbol = huffman_decode(self_p, &self_p->distance_codes);
+
+    if (symbol < 0) {
+        return (symbol);
+    }
+
+    if (symbol >= membersof(distance_base)) {
+        return (-EBADMSG);
+    }
+
+    if (get_bits(self_p, distance_extra[symbol], &value) != 0) {
+        return (-EAGAIN);
+    }
+
+    self_p->distance = (distance_base[symbol] + value);
+    self_p->length = length;
+
+    /* The distance must be within the decompressed data. */
+    if ((self_p->distance > DEFLATE_WINDOW_SIZE)
+        || ((self_p->window.full == 0)
+            && (self_p->distance > self_p->window.pos))) {
+        return (-EBADMSG);
+    }
+
+    self_p->state = STATE_COPY;
+
+    return (0);
+}
+
+static int step_copy(struct inflate_t *self_p)
+{
+    size_t pos;
+
+    while (self_p->length > 0) {
+        pos = ((self_p->window.pos - self_p->distance)
+               & (DEFLATE_WINDOW_SIZE - 1));
+
+        if (output_byte(self_p, self_p->window.buf[pos]) != 0) {
+            return (-EIO);
+        }
+
+        self_p->length--;
+    }
+
+    self_p->state = STATE_CODES;
+
+    return (0);
+}
+
+static int step(struct inflate_t *self_p)
+{
+    switch (self_p->state) {
+
+    case STATE_HEADER:
+        return (step_header(self_p));
+
+    case STATE_STORED_HEADER:
+        return (step_stored_header(self_p));
+
+    case STATE_STORED:
+        return (step_stored(self_p));
+
+    case STATE_DYNAMIC_HEADER:
+        return (step_dynamic_header(self_p));
+
+    case STATE_CODE_LENGTH_CODES:
+        return (step_code_length_codes(self_p));
+
+    case STATE_CODE_LENGTHS:
+        return (step_code_lengths(self_p));
+
+    case STATE_CODES:
+        return (step_codes(self_p));
+
+    case STATE_COPY:
+        return (step_copy(self_p));
+
+    default:
+        return (-EBADMSG);
+    }
+}
+
+int deflate_module_init(void)
+{
+    fs_counter_init(&bytes_saved,
+                    FSTR("/slib/deflate/bytes_saved"),
+                    0);
+    fs_counter_register(&bytes_saved);
+
+    return (0);
+}
+
+int deflate_init(struct deflate_t *self_p,
+                 struct chan_t *chan_p,
+                 int format)
+{
+    static const uint8_t gzip_header[10] = {
+        0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff
+    };
+
+    chan_init(&self_p->base,
+              NULL,
+              (ssize_t (*)(void *, const void *, size_t))deflate_write,
+              NULL);
+
+    self_p->chan_p = chan_p;
+    self_p->format = format;
+    self_p->block_open = 0;
+    self_p->window.pos = 0;
+    self_p->window.end = 0;
+    memset(self_p->head, 0, sizeof(self_p->head));
+    self_p->bits.value = 0;
+    self_p->bits.size = 0;
+    self_p->output.size = 0;
+    self_p->counters.input = 0;
+    self_p->counters.output = 0;
+    self_p->crc = 0;
+    self_p->size = 0;
+
+    /* The gzip header is written with the first compressed data. */
+    if (format == DEFLATE_FORMAT_GZIP) {
+        memcpy(self_p->output.buf, gzip_header, sizeof(gzip_header));
+        self_p->output.size = sizeof(gzip_header);
+    }
+
+    return (0);
+}
+
+ssize_t deflate_write(struct deflate_t *self_p,
+                      const void *buf_p,
+                      size_t size)
+{
+    const uint8_t *b_p;
+    size_t left;
+    size_t n;
+
+    if (self_p->format == DEFLATE_FORMAT_GZIP) {
+        self_p->crc = crc_32(self_p->crc, buf_p, size);
+        self_p->size += size;
+    }
+
+    self_p->counters.input += size;
+    b_p = buf_p;
+    left = size;
+
+    while (left > 0) {
+        if (self_p->window.end == sizeof(self_p->window.buf)) {
+            slide(self_p);
+        }
+
+        n = (sizeof(self_p->window.buf) - self_p->window.end);
+
+        if (n > left) {
+            n = left;
+        }
+
+        memcpy(&self_p->window.buf[self_p->window.end], b_p, n);
+        self_p->window.end += n;
+        b_p += n;
+        left -= n;
+
+        if (compress(self_p, 0) != 0) {
+            return (-EIO);
+        }
+    }
+
+    return (size);
+}
+
+int deflate_flush(struct deflate_t *self_p)
+{
+    if (compress(self_p, 1) != 0) {
+        return (-EIO);
+    }
+
+    if (block_end(self_p) != 0) {
+        return (-EIO);
+    }
+
+    /* An empty stored block, BFINAL = 0 and BTYPE = 00, aligns the
+       output to a byte boundary. */
+    if (put_bits(self_p, 0x0, 3) != 0) {
+        return (-EIO);
+    }
+
+    if (align(self_p) != 0) {
+        return (-EIO);
+    }
+
+    if (put_bits(self_p, 0xffff0000, 32) != 0) {
+        return (-EIO);
+    }
+
+    return (deflate_output_end(self_p));
+}
+
+int deflate_finish(struct deflate_t *self_p)
+{
+    if (compress(self_p, 1) != 0) {
+        return (-EIO);
+    }
+
+    if (block_end(self_p) != 0) {
+        return (-EIO);
+    }
+
+    /* An empty final block, BFINAL = 1 and BTYPE = 01. */
+    if (put_bits(self_p, 0x3, 3) != 0) {
+        return (-EIO);
+    }
+
+    if (put_symbol(self_p, END_OF_BLOCK) != 0) {
+        return (-EIO);
+    }
+
+    if (align(self_p) != 0) {
+        return (-EIO);
+    }
+
+    if (self_p->format == DEFLATE_FORMAT_GZIP) {
+        if (put_bits(self_p, self_p->crc & 0xffff, 16) != 0) {
+            return (-EIO);
+        }
+
+        if (put_bits(self_p, self_p->crc >> 16, 16) != 0) {
+            return (-EIO);
+        }
+
+        if (put_bits(self_p, self_p->size & 0xffff, 16) != 0) {
+            return (-EIO);
+        }
+
+        if (put_bits(self_p, self_p->size >> 16, 16) != 0) {
+            return (-EIO);
+        }
+    }
+
+    return (deflate_output_end(self_p));
+}
+
+int inflate_init(struct inflate_t *self_p,
+                 struct chan_t *chan_p)
+{
+    chan_init(&self_p->base,
+              NULL,
+              (ssize_t (*)(void *, const void *, size_t))inflate_write,
+              NULL);
+
+    self_p->chan_p = chan_p;
+    self_p->state = STATE_HEADER;
+    self_p->final = 0;
+    self_p->bits.value = 0;
+    self_p->bits.size = 0;
+    self_p->window.pos = 0;
+    self_p->window.flushed = 0;
+    self_p->window.full = 0;
+    self_p->literal.symbols_p = self_p->literal_symbols;
+    self_p->distance_codes.symbols_p = self_p->distance_symbols;
+
+    return (0);
+}
+
+ssize_t inflate_write(struct inflate_t *self_p,
+                      const void *buf_p,
+                      size_t size)
+{
+    const uint8_t *b_p;
+    size_t left;
+    uint64_t value;
+    int bits;
+    int res;
+
+    b_p = buf_p;
+    left = size;
+
+    while (self_p->state != STATE_DONE) {
+        /* Load whole bytes into the bit buffer. No step needs more
+           than 48 bits. */
+        while ((left > 0) && (self_p->bits.size <= 56)) {
+            self_p->bits.value |= ((uint64_t)*b_p++ << self_p->bits.size);
+            self_p->bits.size += 8;
+            left--;
+        }
+
+        /* A step is retried from the start when more input is
+           available. */
+        value = self_p->bits.value;
+        bits = self_p->bits.size;
+        res = step(self_p);
+
+        if (res == -EAGAIN) {
+            self_p->bits.value = value;
+            self_p->bits.size = bits;
+            break;
+        } else if (res != 0) {
+            return (res);
+        }
+    }
+
+    if (inflate_output_flush(self_p) != 0) {
+        return (-EIO);
+    }
+
+    return (size);
+}
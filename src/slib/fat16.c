@@ -33,8 +33,13 @@
 /** Value for byte 510 and 511 of boot block or MBR. */
 #define BOOTSIG ntohs(0x55aa)
 
-#define CACHE_FOR_READ  0    /* cache a block for read. */
-#define CACHE_FOR_WRITE 1    /* cache a block and set dirty. */
+#define CACHE_FOR_READ  0x00    /* cache a block for read. */
+#define CACHE_FOR_WRITE 0x01    /* cache a block and set dirty. */
+#define CACHE_FAT       0x02    /* cache a FAT block. */
+#define CACHE_NO_READ   0x04    /* the whole block will be overwritten. */
+
+/* Block number of an unused cache block. */
+#define CACHE_BLOCK_NONE 0xffffffff
 
 /* FAT16 end of chain value used by Microsoft. */
 #define EOC16 0xffff
@@ -51,6 +56,18 @@
 /* Mask a for FAT32 entry. Entries are 28 bits. */
 #define ENTRY32_MASK 0x0fffffff
 
+/* FSInfo sector signatures. */
+#define FSINFO_LEAD_SIG   0x41615252
+#define FSINFO_STRUCT_SIG 0x61417272
+#define FSINFO_TAIL_SIG   0xaa550000
+
+/* Unknown free cluster count. */
+#define FREE_COUNT_UNKNOWN 0xffffffff
+
+/* Minimum number of clusters in a FAT16 and a FAT32 volume. */
+#define CLUSTER_COUNT_FAT16_MIN 4085
+#define CLUSTER_COUNT_FAT32_MIN 65525
+
 /* Type name for directoryEntry. */
 
 /* escape for name[0] = 0xe5. */
@@ -81,9 +98,67 @@
 /** Default time for file timestamp is 1 am. */
 #define DEFAULT_TIME (1 << 11)
 
-static int is_end_of_cluster(fat_t cluster)
+/**
+ * Day of the week of given date, where 1 is Monday and 7 is Sunday.
+ */
+static int weekday(int year, int month, int date)
+{
+    static const uint8_t offsets[] = {
+        0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4
+    };
+    int day;
+
+    if (month < 3) {
+        year--;
+    }
+
+    day = ((year + year / 4 - year / 100 + year / 400
+            + offsets[month - 1] + date) % 7);
+
+    return (day == 0 ? 7 : day);
+}
+
+static int is_end_of_cluster(struct fat16_t *self_p, fat_t cluster)
+{
+    if (self_p->fat_type == 32) {
+        return (cluster >= EOC32_MIN);
+    }
+
+    return (cluster >= EOC16_MIN);
+}
+
+/**
+ * End of chain value of given volume.
+ */
+static inline fat_t end_of_cluster(struct fat16_t *self_p)
+{
+    return (self_p->fat_type == 32 ? EOC32 : EOC16);
+}
+
+/**
+ * Number of FAT entries per block.
+ */
+static inline uint32_t fat_entries_per_block(struct fat16_t *self_p)
+{
+    return (self_p->fat_type == 32 ? 128 : 256);
+}
+
+/**
+ * First cluster of the file or directory of given directory
+ * entry. The high word is only used on FAT32 volumes.
+ */
+static inline fat_t dir_first_cluster(struct fat16_t *self_p,
+                                      const struct dir_t *dir_p)
 {
-    return (cluster >= 0xfff8);
+    fat_t cluster;
+
+    cluster = dir_p->first_cluster_low;
+
+    if (self_p->fat_type == 32) {
+        cluster |= ((fat_t)dir_p->first_cluster_high << 16);
+    }
+
+    return (cluster);
 }
 
 /**
@@ -202,31 +277,46 @@ static int make_name_from_83(char *dst_p, const char *dname_p)
     return (0);
 }
 
-static int cache_flush(struct fat16_t *self_p)
+static int cache_block_flush(struct fat16_t *self_p,
+                             struct fat16_cache_block_t *block_p)
 {
-    struct fat16_cache_t *cache_p = &self_p->cache;
-
-    if (cache_p->dirty) {
+    if (block_p->dirty) {
         if (self_p->write(self_p->arg_p,
-                          cache_p->block_number,
-                          cache_p->buffer.data) != BLOCK_SIZE)
-            {
+                          block_p->block_number,
+                          block_p->buffer.data) != BLOCK_SIZE) {
+            return (-1);
+        }
+
+        self_p->cache.counters.writes++;
+
+        if (block_p->mirror_block) {
+            if (self_p->write(self_p->arg_p,
+                              block_p->mirror_block,
+                              block_p->buffer.data) != BLOCK_SIZE) {
                 return (-1);
             }
 
-        if (cache_p->mirror_block)
-            {
-                if (self_p->write(self_p->arg_p,
-                                  cache_p->mirror_block,
-                                  cache_p->buffer.data) != BLOCK_SIZE)
-                    {
-                        return (-1);
-                    }
+            self_p->cache.counters.writes++;
+            block_p->mirror_block = 0;
+        }
 
-                cache_p->mirror_block = 0;
-            }
+        block_p->dirty = 0;
+    }
+
+    return (0);
+}
+
+/**
+ * Write all dirty blocks in the cache to the storage device.
+ */
+static int cache_flush(struct fat16_t *self_p)
+{
+    int i;
 
-        cache_p->dirty = 0;
+    for (i = 0; i < FAT16_CACHE_BLOCKS; i++) {
+        if (cache_block_flush(self_p, &self_p->cache.blocks[i]) != 0) {
+            return (-1);
+        }
     }
 
     return (0);
@@ -243,9 +333,89 @@ static inline uint16_t cache_data_offset(uint32_t position)
     return (position & 0x1ff);
 }
 
-static inline void cache_set_dirty(struct fat16_cache_t *cache_p)
+/**
+ * Index in the file of the cluster containing given position.
+ */
+static inline uint32_t cluster_index(struct fat16_t *self_p,
+                                     uint32_t position)
 {
-    cache_p->dirty |= CACHE_FOR_WRITE;
+    return ((position >> 9) / self_p->blocks_per_cluster);
+}
+
+/**
+ * Add given cluster at given index in the file to the extent cache of
+ * given file, if it directly follows the cached runs.
+ */
+static void extents_add(struct fat16_file_t *file_p,
+                        uint32_t index,
+                        fat_t cluster)
+{
+    struct fat16_extent_t *run_p;
+    int length;
+
+    length = file_p->extents.length;
+
+    if (length > 0) {
+        run_p = &file_p->extents.runs[length - 1];
+
+        if (index != run_p->index + run_p->length) {
+            return;
+        }
+
+        if (cluster == run_p->cluster + run_p->length) {
+            run_p->length++;
+
+            return;
+        }
+
+        if (length == FAT16_FILE_EXTENTS) {
+            return;
+        }
+    } else if (index != 0) {
+        return;
+    }
+
+    run_p = &file_p->extents.runs[length];
+    run_p->index = index;
+    run_p->cluster = cluster;
+    run_p->length = 1;
+    file_p->extents.length++;
+}
+
+/**
+ * Binary search for the cluster at given index in the file in the
+ * extent cache of given file.
+ *
+ * @return zero(0) if found, otherwise negative error code.
+ */
+static int extents_get(struct fat16_file_t *file_p,
+                       uint32_t index,
+                       fat_t *cluster_p)
+{
+    struct fat16_extent_t *run_p;
+    int low;
+    int high;
+    int middle;
+
+    low = 0;
+    high = (file_p->extents.length - 1);
+
+    while (low <= high) {
+        middle = ((low + high) / 2);
+        run_p = &file_p->extents.runs[middle];
+
+        if (index < run_p->index) {
+            high = (middle - 1);
+        } else if (index >= run_p->index + run_p->length) {
+            low = (middle + 1);
+        } else {
+            *cluster_p = (run_p->cluster + (index - run_p->index));
+
+            return (0);
+        }
+    }
+
+    return (-1);
 }
 
 static inline uint32_t data_block_lba(struct fat16_file_t *file_p,
@@ -257,29 +427,116 @@ static inline uint32_t data_block_lba(struct fat16_file_t *file_p,
             block_of_cluster);
 }
 
-static int cache_raw_block(struct fat16_t *self_p,
-                           uint32_t block_number,
-                           uint8_t action)
+/**
+ * Get given block from the cache, or read it from the storage device
+ * into the least recently used cache block. FAT blocks are only
+ * placed in the reserved FAT part of the cache, and other blocks only
+ * in the rest of it.
+ *
+ * @return Cache block or NULL on failure.
+ */
+static struct fat16_cache_block_t *cache_raw_block(struct fat16_t *self_p,
+                                                   uint32_t block_number,
+                                                   uint8_t action)
 {
     struct fat16_cache_t *cache_p = &self_p->cache;
+    struct fat16_cache_block_t *block_p;
+    int begin;
+    int end;
+    int i;
 
-    if (cache_p->block_number != block_number) {
-        if (cache_flush(self_p) != 0)
-            {
-                return (-1);
+    block_p = NULL;
+
+    for (i = 0; i < FAT16_CACHE_BLOCKS; i++) {
+        if (cache_p->blocks[i].block_number == block_number) {
+            block_p = &cache_p->blocks[i];
+            break;
+        }
+    }
+
+    if (block_p != NULL) {
+        cache_p->counters.hits++;
+    } else {
+        cache_p->counters.misses++;
+
+        if (action & CACHE_FAT) {
+            begin = 0;
+            end = (FAT16_CACHE_FAT_BLOCKS > 0
+                   ? FAT16_CACHE_FAT_BLOCKS
+                   : FAT16_CACHE_BLOCKS);
+        } else {
+            begin = FAT16_CACHE_FAT_BLOCKS;
+            end = FAT16_CACHE_BLOCKS;
+        }
+
+        /* Replace the least recently used block. */
+        block_p = &cache_p->blocks[begin];
+
+        for (i = begin + 1; i < end; i++) {
+            if (cache_p->blocks[i].last_used < block_p->last_used) {
+                block_p = &cache_p->blocks[i];
             }
+        }
 
-        if (self_p->read(self_p->arg_p,
-                         cache_p->buffer.data,
-                         block_number) != BLOCK_SIZE)
-            {
-                return (-1);
+        if (cache_block_flush(self_p, block_p) != 0) {
+            return (NULL);
+        }
+
+        block_p->block_number = CACHE_BLOCK_NONE;
+
+        if (action & CACHE_NO_READ) {
+            /* Do not leave data of the replaced block in, for example,
+               a new directory block. */
+            memset(block_p->buffer.data, 0, BLOCK_SIZE);
+        } else {
+            if (self_p->read(self_p->arg_p,
+                             block_p->buffer.data,
+                             block_number) != BLOCK_SIZE) {
+                return (NULL);
             }
+        }
 
-        cache_p->block_number = block_number;
+        block_p->block_number = block_number;
     }
 
-    cache_p->dirty |= action;
+    block_p->last_used = ++cache_p->tick;
+    block_p->dirty |= (action & CACHE_FOR_WRITE);
+
+    return (block_p);
+}
+
+/**
+ * Prepare the cache for a direct transfer of given blocks between the
+ * storage device and a caller buffer. Dirty cached blocks are written
+ * to the device before it is read. Cached blocks are dropped before
+ * the device is written, as they are overwritten.
+ */
+static int cache_prepare_transfer(struct fat16_t *self_p,
+                                  uint32_t block_number,
+                                  size_t count,
+                                  int write)
+{
+    struct fat16_cache_block_t *block_p;
+    int i;
+
+    for (i = 0; i < FAT16_CACHE_BLOCKS; i++) {
+        block_p = &self_p->cache.blocks[i];
+
+        if ((block_p->block_number < block_number)
+            || (block_p->block_number >= block_number + count)) {
+            continue;
+        }
+
+        if (write) {
+            block_p->block_number = CACHE_BLOCK_NONE;
+            block_p->last_used = 0;
+            block_p->dirty = 0;
+        } else {
+            if (cache_block_flush(self_p, block_p) != 0) {
+                return (-1);
+            }
+        }
+    }
 
     return (0);
 }
@@ -288,31 +545,83 @@ static int fat_get(struct fat16_t *self_p,
                    fat_t cluster,
                    fat_t* value)
 {
+    struct fat16_cache_block_t *block_p;
     uint32_t lba;
 
-    if (cluster > (self_p->cluster_count + 1))
-        {
-            return (-1);
-        }
+    if (cluster > (self_p->cluster_count + 1)) {
+        return (-1);
+    }
 
-    lba = self_p->fat_start_block + (cluster >> 8);
+    lba = (self_p->fat_start_block
+           + cluster / fat_entries_per_block(self_p));
+    block_p = cache_raw_block(self_p, lba, CACHE_FAT | CACHE_FOR_READ);
 
-    if (lba != self_p->cache.block_number)
-        {
-            if (cache_raw_block(self_p, lba, CACHE_FOR_READ))
-                {
-                    return (-1);
-                }
-        }
+    if (block_p == NULL) {
+        return (-1);
+    }
 
-    *value = self_p->cache.buffer.fat[cluster & 0xff];
+    if (self_p->fat_type == 32) {
+        *value = (block_p->buffer.fat32[cluster & 0x7f] & ENTRY32_MASK);
+    } else {
+        *value = block_p->buffer.fat16[cluster & 0xff];
+    }
 
     return (0);
 }
 
+static inline int bitmap_is_used(const uint8_t *bitmap_p, uint32_t cluster)
+{
+    return ((bitmap_p[cluster >> 3] >> (cluster & 7)) & 1);
+}
+
+/**
+ * Update the free cluster count, if known, and the free cluster
+ * bitmap, if built, when given FAT entry is changed from old to
+ * value.
+ */
+static void free_clusters_update(struct fat16_t *self_p,
+                                 fat_t cluster,
+                                 fat_t old,
+                                 fat_t value)
+{
+    uint8_t *bitmap_p;
+    uint8_t mask;
+
+    if ((old == 0) == (value == 0)) {
+        return;
+    }
+
+    if (self_p->free_clusters.count != FREE_COUNT_UNKNOWN) {
+        if (value == 0) {
+            self_p->free_clusters.count++;
+        } else {
+            self_p->free_clusters.count--;
+        }
+
+        self_p->free_clusters.fsinfo_dirty = 1;
+    }
+
+    bitmap_p = self_p->free_clusters.bitmap_p;
+
+    if (bitmap_p == NULL) {
+        return;
+    }
+
+    mask = (1 << (cluster & 7));
+
+    if (value == 0) {
+        bitmap_p[cluster >> 3] &= ~mask;
+    } else {
+        bitmap_p[cluster >> 3] |= mask;
+    }
+}
+
 static int fat_put(struct fat16_t *self_p, fat_t cluster, fat_t value)
 {
+    struct fat16_cache_block_t *block_p;
     uint32_t lba;
+    uint32_t *entry_p;
+    fat_t old;
 
     if (cluster < 2) {
         return (-1);
@@ -322,34 +631,47 @@ static int fat_put(struct fat16_t *self_p, fat_t cluster, fat_t value)
         return (-1);
     }
 
-    lba = self_p->fat_start_block + (cluster >> 8);
+    lba = (self_p->fat_start_block
+           + cluster / fat_entries_per_block(self_p));
+    block_p = cache_raw_block(self_p, lba, CACHE_FAT | CACHE_FOR_WRITE);
 
-    if (lba != self_p->cache.block_number) {
-        if (cache_raw_block(self_p, lba, CACHE_FOR_READ) != 0) {
-            return (-1);
-        }
+    if (block_p == NULL) {
+        return (-1);
     }
 
-    self_p->cache.buffer.fat[cluster & 0xff] = value;
-    cache_set_dirty(&self_p->cache);
+    if (self_p->fat_type == 32) {
+        /* The upper four bits are reserved and kept. */
+        entry_p = &block_p->buffer.fat32[cluster & 0x7f];
+        old = (*entry_p & ENTRY32_MASK);
+        *entry_p = ((*entry_p & ~ENTRY32_MASK) | (value & ENTRY32_MASK));
+    } else {
+        old = block_p->buffer.fat16[cluster & 0xff];
+        block_p->buffer.fat16[cluster & 0xff] = value;
+    }
 
     if (self_p->fat_count > 1) {
-        self_p->cache.mirror_block = (lba + self_p->blocks_per_fat);
+        block_p->mirror_block = (lba + self_p->blocks_per_fat);
     }
 
+    free_clusters_update(self_p, cluster, old, value);
+
     return (0);
 }
 
 static struct dir_t* cache_dir_entry(struct fat16_t *self_p,
-                                     uint16_t block,
+                                     uint32_t block,
                                      uint16_t index,
                                      uint8_t action)
 {
-    if (cache_raw_block(self_p, block + (index >> 4), action) != 0) {
+    struct fat16_cache_block_t *block_p;
+
+    block_p = cache_raw_block(self_p, block + (index >> 4), action);
+
+    if (block_p == NULL) {
         return (NULL);
     }
 
-    return (&self_p->cache.buffer.dir[index & 0xf]);
+    return (&block_p->buffer.dir[index & 0xf]);
 }
 
 static int free_chain(struct fat16_t *self_p, fat_t cluster)
@@ -365,7 +687,7 @@ static int free_chain(struct fat16_t *self_p, fat_t cluster)
             return (-1);
         }
 
-        if (is_end_of_cluster(next)) {
+        if (is_end_of_cluster(self_p, next)) {
             return (0);
         }
 
@@ -379,6 +701,8 @@ int fat16_init(struct fat16_t *self_p,
                void *arg_p,
                unsigned int partition)
 {
+    int i;
+
     /* Error if invalid partition. */
     if (partition > 4) {
         return (-EINVAL);
@@ -387,11 +711,211 @@ int fat16_init(struct fat16_t *self_p,
     /* Initialize datastructure.*/
     self_p->read = read;
     self_p->write = write;
+    self_p->read_blocks = NULL;
+    self_p->write_blocks = NULL;
     self_p->arg_p = arg_p;
     self_p->partition = partition;
-    self_p->cache.block_number = 0xffffffff;
-    self_p->cache.dirty = 0;
-    self_p->cache.mirror_block = 0;
+
+    for (i = 0; i < FAT16_CACHE_BLOCKS; i++) {
+        self_p->cache.blocks[i].block_number = CACHE_BLOCK_NONE;
+        self_p->cache.blocks[i].mirror_block = 0;
+        self_p->cache.blocks[i].last_used = 0;
+        self_p->cache.blocks[i].dirty = 0;
+    }
+
+    self_p->cache.tick = 0;
+    self_p->cache.counters.hits = 0;
+    self_p->cache.counters.misses = 0;
+    self_p->cache.counters.writes = 0;
+    self_p->free_clusters.buf_p = NULL;
+    self_p->free_clusters.size = 0;
+    self_p->free_clusters.bitmap_p = NULL;
+    self_p->free_clusters.fsinfo_dirty = 0;
+    self_p->fsinfo_block = 0;
+
+    return (0);
+}
+
+int fat16_set_multi_block_functions(struct fat16_t *self_p,
+                                    fat16_read_blocks_t read_blocks,
+                                    fat16_write_blocks_t write_blocks)
+{
+    self_p->read_blocks = read_blocks;
+    self_p->write_blocks = write_blocks;
+
+    return (0);
+}
+
+int fat16_set_free_cluster_bitmap(struct fat16_t *self_p,
+                                  uint8_t *buf_p,
+                                  size_t size)
+{
+    self_p->free_clusters.buf_p = buf_p;
+    self_p->free_clusters.size = size;
+    self_p->free_clusters.bitmap_p = NULL;
+
+    return (0);
+}
+
+/**
+ * Count the free clusters by reading the whole FAT. Used clusters are
+ * marked in given bitmap, unless NULL.
+ */
+static int fat_scan(struct fat16_t *self_p,
+                    uint8_t *bitmap_p,
+                    fat_t *count_p)
+{
+    struct fat16_cache_block_t *block_p;
+    uint32_t end;
+    uint32_t cluster;
+    uint32_t mask;
+    fat_t value;
+    fat_t count;
+
+    /* The FAT has cluster_count + 2 entries. */
+    end = (self_p->cluster_count + 2);
+    mask = (fat_entries_per_block(self_p) - 1);
+    block_p = NULL;
+    count = 0;
+
+    for (cluster = 0; cluster < end; cluster++) {
+        if ((cluster & mask) == 0) {
+            block_p = cache_raw_block(self_p,
+                                      (self_p->fat_start_block
+                                       + cluster / (mask + 1)),
+                                      CACHE_FAT | CACHE_FOR_READ);
+
+            if (block_p == NULL) {
+                return (-1);
+            }
+        }
+
+        if (cluster < 2) {
+            continue;
+        }
+
+        if (self_p->fat_type == 32) {
+            value = (block_p->buffer.fat32[cluster & mask] & ENTRY32_MASK);
+        } else {
+            value = block_p->buffer.fat16[cluster & mask];
+        }
+
+        if (value == 0) {
+            if (bitmap_p != NULL) {
+                bitmap_p[cluster >> 3] &= ~(1 << (cluster & 7));
+            }
+
+            count++;
+        }
+    }
+
+    *count_p = count;
+
+    return (0);
+}
+
+/**
+ * Build the free cluster bitmap by reading the whole FAT.
+ */
+static int free_clusters_build(struct fat16_t *self_p)
+{
+    uint8_t *bitmap_p;
+    fat_t count;
+
+    self_p->free_clusters.bitmap_p = NULL;
+    bitmap_p = self_p->free_clusters.buf_p;
+
+    if ((bitmap_p == NULL)
+        || (8 * self_p->free_clusters.size < self_p->cluster_count + 2)) {
+        return (0);
+    }
+
+    /* Clusters after the last one are marked as used. */
+    memset(bitmap_p, 0xff, self_p->free_clusters.size);
+
+    if (fat_scan(self_p, bitmap_p, &count) != 0) {
+        return (-1);
+    }
+
+    /* Correct the FSInfo hint if wrong. */
+    if (count != self_p->free_clusters.count) {
+        self_p->free_clusters.count = count;
+        self_p->free_clusters.fsinfo_dirty = 1;
+    }
+
+    self_p->free_clusters.bitmap_p = bitmap_p;
+
+    return (0);
+}
+
+/**
+ * Read the free cluster count and next free cluster hints from the
+ * FSInfo sector of a FAT32 volume. Both are unknown on FAT16 volumes.
+ */
+static int fsinfo_read(struct fat16_t *self_p)
+{
+    struct fat16_cache_block_t *block_p;
+    struct fsinfo_t *fsinfo_p;
+
+    self_p->free_clusters.count = FREE_COUNT_UNKNOWN;
+    self_p->free_clusters.next = 2;
+    self_p->free_clusters.fsinfo_dirty = 0;
+
+    if (self_p->fsinfo_block == 0) {
+        return (0);
+    }
+
+    block_p = cache_raw_block(self_p, self_p->fsinfo_block, CACHE_FOR_READ);
+
+    if (block_p == NULL) {
+        return (-1);
+    }
+
+    fsinfo_p = &block_p->buffer.fsinfo;
+
+    /* Never write to an invalid FSInfo sector. */
+    if ((fsinfo_p->lead_signature != FSINFO_LEAD_SIG)
+        || (fsinfo_p->struct_signature != FSINFO_STRUCT_SIG)
+        || (fsinfo_p->tail_signature != FSINFO_TAIL_SIG)) {
+        self_p->fsinfo_block = 0;
+
+        return (0);
+    }
+
+    if (fsinfo_p->free_count <= self_p->cluster_count) {
+        self_p->free_clusters.count = fsinfo_p->free_count;
+    }
+
+    if ((fsinfo_p->next_free >= 2)
+        && (fsinfo_p->next_free <= self_p->cluster_count + 1)) {
+        self_p->free_clusters.next = fsinfo_p->next_free;
+    }
+
+    return (0);
+}
+
+/**
+ * Write the free cluster count and next free cluster hints to the
+ * FSInfo sector of a FAT32 volume, if changed.
+ */
+static int fsinfo_write(struct fat16_t *self_p)
+{
+    struct fat16_cache_block_t *block_p;
+
+    if ((self_p->fsinfo_block == 0)
+        || !self_p->free_clusters.fsinfo_dirty) {
+        return (0);
+    }
+
+    block_p = cache_raw_block(self_p, self_p->fsinfo_block, CACHE_FOR_WRITE);
+
+    if (block_p == NULL) {
+        return (-1);
+    }
+
+    block_p->buffer.fsinfo.free_count = self_p->free_clusters.count;
+    block_p->buffer.fsinfo.next_free = self_p->free_clusters.next;
+    self_p->free_clusters.fsinfo_dirty = 0;
 
     return (0);
 }
@@ -401,62 +925,136 @@ int fat16_start(struct fat16_t *self_p)
     uint32_t volume_start_block = 0;
     uint32_t total_blocks;
     struct bpb_t* bpb_p;
+    struct fbs32_t *fbs32_p;
+    struct fat16_cache_block_t *block_p;
 
-    /* If part == 0 assume super floppy with FAT16 boot sector in block zero. */
+    /* If part == 0 assume super floppy with FAT boot sector in block zero. */
     /* If part > 0 assume mbr volume with partition table. */
     if (self_p->partition > 0) {
-        if (cache_raw_block(self_p, volume_start_block, CACHE_FOR_READ) != 0) {
+        block_p = cache_raw_block(self_p, volume_start_block, CACHE_FOR_READ);
+
+        if (block_p == NULL) {
             return (-1);
         }
 
         volume_start_block =
-            self_p->cache.buffer.mbr.part[self_p->partition - 1].first_sector;
+            block_p->buffer.mbr.part[self_p->partition - 1].first_sector;
     }
 
-    if (cache_raw_block(self_p, volume_start_block, CACHE_FOR_READ) != 0) {
+    block_p = cache_raw_block(self_p, volume_start_block, CACHE_FOR_READ);
+
+    if (block_p == NULL) {
         return (-1);
     }
 
     /* Check boot block signature. */
-    if (self_p->cache.buffer.fbs.boot_sector_sig != BOOTSIG) {
+    if (block_p->buffer.fbs.boot_sector_sig != BOOTSIG) {
         return (-1);
     }
 
-    bpb_p = &self_p->cache.buffer.fbs.bpb;
+    bpb_p = &block_p->buffer.fbs.bpb;
+    fbs32_p = &block_p->buffer.fbs32;
     self_p->fat_count = bpb_p->fat_count;
     self_p->blocks_per_cluster = bpb_p->sectors_per_cluster;
-    self_p->blocks_per_fat = bpb_p->sectors_per_fat;
+    self_p->blocks_per_fat = (bpb_p->sectors_per_fat != 0
+                              ? bpb_p->sectors_per_fat
+                              : fbs32_p->sectors_per_fat32);
     self_p->root_dir_entry_count = bpb_p->root_dir_entry_count;
     self_p->fat_start_block = volume_start_block + bpb_p->reserved_sector_count;
     self_p->root_dir_start_block = (self_p->fat_start_block
-                                    + bpb_p->fat_count * bpb_p->sectors_per_fat);
+                                    + bpb_p->fat_count * self_p->blocks_per_fat);
     self_p->data_start_block = (self_p->root_dir_start_block
                                 + ((32 * bpb_p->root_dir_entry_count + 511) / 512));
     total_blocks = (bpb_p->total_sectors_small
                     ? bpb_p->total_sectors_small
                     : bpb_p->total_sectors_large);
-    self_p->cluster_count = ((total_blocks
-                              - (self_p->data_start_block - volume_start_block))
-                             / bpb_p->sectors_per_cluster);
 
-    /* Check valid FAT16 volume. */
+    /* Check valid volume. exFAT volumes have no BIOS parameter
+       block and fail here. */
     if ((bpb_p->bytes_per_sector != 512)       /* Only allow 512 byte blocks. */
-        || (bpb_p->sectors_per_fat == 0)       /* Zero for FAT32. */
-        || (self_p->cluster_count < 4085)     /* FAT12 if true. */
-        || (total_blocks > 0x800000)           /* Max size for FAT16 volume. */
         || (bpb_p->reserved_sector_count == 0) /* Invalid volume. */
         || (bpb_p->fat_count == 0)             /* Invalid volume. */
-        || (bpb_p->sectors_per_fat < (self_p->cluster_count >> 8))
         || (bpb_p->sectors_per_cluster == 0)
-        || (bpb_p->sectors_per_cluster & (bpb_p->sectors_per_cluster - 1))) {
+        || (bpb_p->sectors_per_cluster & (bpb_p->sectors_per_cluster - 1))
+        || (self_p->data_start_block - volume_start_block >= total_blocks)) {
         return (-1);
     }
 
-    return (0);
+    self_p->cluster_count = ((total_blocks
+                              - (self_p->data_start_block - volume_start_block))
+                             / bpb_p->sectors_per_cluster);
+
+    /* The FAT type is given by the number of clusters. */
+    if (self_p->cluster_count < CLUSTER_COUNT_FAT16_MIN) {
+        /* FAT12 is not supported. */
+        return (-1);
+    } else if (self_p->cluster_count < CLUSTER_COUNT_FAT32_MIN) {
+        self_p->fat_type = 16;
+        self_p->root_dir_cluster = 0;
+        self_p->fsinfo_block = 0;
+
+        if ((bpb_p->sectors_per_fat == 0)
+            || (bpb_p->root_dir_entry_count == 0)) {
+            return (-1);
+        }
+    } else {
+        self_p->fat_type = 32;
+        self_p->root_dir_cluster = fbs32_p->fat32_root_cluster;
+        self_p->fsinfo_block = (fbs32_p->fat32_fsinfo != 0
+                                ? volume_start_block + fbs32_p->fat32_fsinfo
+                                : 0);
+
+        if ((bpb_p->sectors_per_fat != 0)
+            || (bpb_p->root_dir_entry_count != 0)
+            || (fbs32_p->fat32_version != 0)
+            || (self_p->root_dir_cluster < 2)
+            || (self_p->root_dir_cluster > self_p->cluster_count + 1)) {
+            return (-1);
+        }
+    }
+
+    /* The FAT must have an entry for each cluster. */
+    if ((self_p->blocks_per_fat * fat_entries_per_block(self_p))
+        < (self_p->cluster_count + 2)) {
+        return (-1);
+    }
+
+    if (fsinfo_read(self_p) != 0) {
+        return (-1);
+    }
+
+    return (free_clusters_build(self_p));
 }
 
 int fat16_stop(struct fat16_t *self_p)
 {
+    return (fat16_sync(self_p));
+}
+
+int fat16_sync(struct fat16_t *self_p)
+{
+    if (fsinfo_write(self_p) != 0) {
+        return (-1);
+    }
+
+    return (cache_flush(self_p));
+}
+
+int fat16_get_free_clusters(struct fat16_t *self_p, fat_t *count_p)
+{
+    fat_t count;
+
+    if (self_p->free_clusters.count == FREE_COUNT_UNKNOWN) {
+        if (fat_scan(self_p, NULL, &count) != 0) {
+            return (-1);
+        }
+
+        self_p->free_clusters.count = count;
+        self_p->free_clusters.fsinfo_dirty = 1;
+    }
+
+    *count_p = self_p->free_clusters.count;
+
     return (0);
 }
 
@@ -467,6 +1065,12 @@ int fat16_format(struct fat16_t *self_p)
     uint32_t fat_start_block;
     uint32_t blocks_per_fat;
     uint32_t root_dir_start_block;
+    struct fat16_cache_block_t *block_p;
+
+    /* The bitmap is built again by fat16_start(). */
+    self_p->free_clusters.bitmap_p = NULL;
+    self_p->free_clusters.fsinfo_dirty = 0;
+    self_p->fsinfo_block = 0;
 
     fbs.jmp_to_boot_code[0] = 0xeb;
     fbs.jmp_to_boot_code[1] = 0x3c;
@@ -501,42 +1105,52 @@ int fat16_format(struct fat16_t *self_p)
                             + fbs.bpb.fat_count * fbs.bpb.sectors_per_fat);
 
     /* Cache volume start block. */
-    if (cache_raw_block(self_p, volume_start_block, CACHE_FOR_WRITE) != 0) {
+    block_p = cache_raw_block(self_p,
+                              volume_start_block,
+                              CACHE_FOR_WRITE | CACHE_NO_READ);
+
+    if (block_p == NULL) {
         return (-1);
     }
 
-    self_p->cache.buffer.fbs = fbs;
+    block_p->buffer.fbs = fbs;
 
     /* Clear first fat block. */
-    if (cache_raw_block(self_p,
-                        fat_start_block,
-                        CACHE_FOR_WRITE) != 0) {
+    block_p = cache_raw_block(self_p,
+                              fat_start_block,
+                              CACHE_FAT | CACHE_FOR_WRITE | CACHE_NO_READ);
+
+    if (block_p == NULL) {
         return (-1);
     }
 
-    memset(&self_p->cache.buffer, 0, sizeof(self_p->cache.buffer));
-    self_p->cache.buffer.fat[0] = 0xfff8;
-    self_p->cache.buffer.fat[1] = 0xffff;
+    memset(&block_p->buffer, 0, sizeof(block_p->buffer));
+    block_p->buffer.fat16[0] = 0xfff8;
+    block_p->buffer.fat16[1] = 0xffff;
 
     /* Clear mirrored fat block. */
-    if (cache_raw_block(self_p,
-                        fat_start_block + blocks_per_fat,
-                        CACHE_FOR_WRITE) != 0) {
+    block_p = cache_raw_block(self_p,
+                              fat_start_block + blocks_per_fat,
+                              CACHE_FAT | CACHE_FOR_WRITE | CACHE_NO_READ);
+
+    if (block_p == NULL) {
         return (-1);
     }
 
-    memset(&self_p->cache.buffer, 0, sizeof(self_p->cache.buffer));
-    self_p->cache.buffer.fat[0] = 0xfff8;
-    self_p->cache.buffer.fat[1] = 0xffff;
+    memset(&block_p->buffer, 0, sizeof(block_p->buffer));
+    block_p->buffer.fat16[0] = 0xfff8;
+    block_p->buffer.fat16[1] = 0xffff;
 
     /* Clear root directory block. */
-    if (cache_raw_block(self_p,
-                        root_dir_start_block,
-                        CACHE_FOR_WRITE) != 0) {
+    block_p = cache_raw_block(self_p,
+                              root_dir_start_block,
+                              CACHE_FOR_WRITE | CACHE_NO_READ);
+
+    if (block_p == NULL) {
         return (-1);
     }
 
-    memset(&self_p->cache.buffer, 0, sizeof(self_p->cache.buffer));
+    memset(&block_p->buffer, 0, sizeof(block_p->buffer));
 
     return (cache_flush(self_p));
 }
@@ -544,22 +1158,30 @@ int fat16_format(struct fat16_t *self_p)
 int fat16_print(struct fat16_t *self_p, chan_t *chan_p)
 {
     std_fprintf(chan_p,
-                FSTR("fat_count = %u\r\n"
+                FSTR("fat_type = FAT%u\r\n"
+                     "fat_count = %u\r\n"
                      "blocks_per_cluster = %u\r\n"
                      "root_dir_entry_count = %u\r\n"
-                     "blocks_per_fat = %u\r\n"
-                     "cluster_count = %u\r\n"
+                     "blocks_per_fat = %lu\r\n"
+                     "cluster_count = %lu\r\n"
                      "fat_start_block = %lu\r\n"
                      "root_dir_start_block = %lu\r\n"
-                     "data_start_block = %lu\r\n"),
+                     "data_start_block = %lu\r\n"
+                     "cache_hits = %lu\r\n"
+                     "cache_misses = %lu\r\n"
+                     "cache_writes = %lu\r\n"),
+                (unsigned int)self_p->fat_type,
                 (unsigned int)self_p->fat_count,
                 (unsigned int)self_p->blocks_per_cluster,
                 (unsigned int)self_p->root_dir_entry_count,
-                (unsigned int)self_p->blocks_per_fat,
-                (unsigned int)self_p->cluster_count,
+                (unsigned long)self_p->blocks_per_fat,
+                (unsigned long)self_p->cluster_count,
                 (unsigned long)self_p->fat_start_block,
                 (unsigned long)self_p->root_dir_start_block,
-                (unsigned long)self_p->data_start_block);
+                (unsigned long)self_p->data_start_block,
+                (unsigned long)self_p->cache.counters.hits,
+                (unsigned long)self_p->cache.counters.misses,
+                (unsigned long)self_p->cache.counters.writes);
 
     return (0);
 }
@@ -588,6 +1210,9 @@ static int file_truncate(struct fat16_file_t *file_p,
                ? length
                : file_p->cur_position);
 
+    /* Clusters may be freed. */
+    file_p->extents.length = 0;
+
     if (length == 0) {
         /* Free all clusters. */
         if (free_chain(file_p->fat16_p, file_p->first_cluster) != 0) {
@@ -604,9 +1229,11 @@ static int file_truncate(struct fat16_file_t *file_p,
             return (-1);
         }
 
-        if (!is_end_of_cluster(to_free)) {
+        if (!is_end_of_cluster(file_p->fat16_p, to_free)) {
             /* Free extra clusters. */
-            if (!fat_put(file_p->fat16_p, file_p->cur_cluster, EOC16)) {
+            if (!fat_put(file_p->fat16_p,
+                         file_p->cur_cluster,
+                         end_of_cluster(file_p->fat16_p))) {
                 return (-1);
             }
 
@@ -626,13 +1253,100 @@ static int file_truncate(struct fat16_file_t *file_p,
     return (fat16_file_seek(file_p, new_pos, FAT16_SEEK_SET));
 }
 
-static int add_cluster(struct fat16_file_t *file_p)
+/**
+ * Find a run of given number of free clusters in the free cluster
+ * bitmap, searching after given cluster first, wrapping around at
+ * the end of the FAT.
+ *
+ * @return zero(0) if found, otherwise negative error code.
+ */
+static int find_free_run(struct fat16_t *self_p,
+                         fat_t start,
+                         fat_t length,
+                         fat_t *first_p)
+{
+    const uint8_t *bitmap_p;
+    uint32_t end;
+    uint32_t cluster;
+    uint32_t searched;
+    uint32_t run;
+
+    bitmap_p = self_p->free_clusters.bitmap_p;
+    end = (self_p->cluster_count + 2);
+    cluster = start + 1;
+    run = 0;
+
+    for (searched = 0; searched < end + length; searched++, cluster++) {
+        /* A run cannot wrap around. */
+        if (cluster >= end) {
+            cluster = 2;
+            run = 0;
+        }
+
+        /* Skip eight used clusters at a time. */
+        if ((run == 0)
+            && ((cluster & 7) == 0)
+            && (bitmap_p[cluster >> 3] == 0xff)) {
+            cluster += 7;
+            searched += 7;
+            continue;
+        }
+
+        if (bitmap_is_used(bitmap_p, cluster)) {
+            run = 0;
+        } else {
+            if (run == 0) {
+                *first_p = cluster;
+            }
+
+            run++;
+
+            if (run == length) {
+                return (0);
+            }
+        }
+    }
+
+    return (-1);
+}
+
+/**
+ * Find a free cluster, searching after given cluster first.
+ */
+static int find_free_cluster(struct fat16_t *self_p,
+                             fat_t start,
+                             fat_t *cluster_p)
 {
-    /* Start search after last cluster of file or at cluster two in FAT. */
-    fat_t free_cluster = file_p->cur_cluster ? file_p->cur_cluster : 1;
+    fat_t free_cluster;
     fat_t value;
     fat_t i;
-    fat_t cluster_count = file_p->fat16_p->cluster_count;
+    fat_t cluster_count;
+
+    if (self_p->free_clusters.bitmap_p != NULL) {
+        if (self_p->free_clusters.count == 0) {
+            return (-1);
+        }
+
+        /* Next fit if not appending to a chain. */
+        if (start == 0) {
+            start = (self_p->free_clusters.next - 1);
+        }
+
+        return (find_free_run(self_p, start, 1, cluster_p));
+    }
+
+    /* Start search after given cluster. Otherwise, start at cluster
+       two in the FAT of a FAT16 volume, and at the FSInfo next free
+       cluster hint of a FAT32 volume, as searching its larger FAT
+       from the start is slow. */
+    if (start == 0) {
+        start = (self_p->fat_type == 32
+                 ? self_p->free_clusters.next - 1
+                 : 1);
+    }
+
+    free_cluster = start;
+    cluster_count = self_p->cluster_count;
 
     for (i = 0; ; i++)
         {
@@ -648,7 +1362,7 @@ static int add_cluster(struct fat16_file_t *file_p)
 
             free_cluster++;
 
-            if (fat_get(file_p->fat16_p, free_cluster, &value) != 0) {
+            if (fat_get(self_p, free_cluster, &value) != 0) {
                 return (-1);
             }
 
@@ -657,20 +1371,57 @@ static int add_cluster(struct fat16_file_t *file_p)
             }
         }
 
+    *cluster_p = free_cluster;
+
+    return (0);
+}
+
+/**
+ * Mark given free cluster allocated and link it to the end of the
+ * cluster chain of given file, after given last cluster, or make it
+ * the first cluster if last is zero(0).
+ */
+static int append_cluster(struct fat16_file_t *file_p,
+                          fat_t last,
+                          fat_t cluster)
+{
     /* Mark cluster allocated. */
-    if (fat_put(file_p->fat16_p, free_cluster, EOC16) != 0) {
+    if (fat_put(file_p->fat16_p,
+                cluster,
+                end_of_cluster(file_p->fat16_p)) != 0) {
         return (-1);
     }
 
-    if (file_p->cur_cluster != 0) {
+    if (last != 0) {
         /* Link cluster to chain. */
-        if (fat_put(file_p->fat16_p, file_p->cur_cluster, free_cluster) != 0) {
+        if (fat_put(file_p->fat16_p, last, cluster) != 0) {
             return (-1);
         }
     } else {
         /* first cluster of file so update directory entry. */
         file_p->flags |= F_FILE_DIR_DIRTY;
-        file_p->first_cluster = free_cluster;
+        file_p->first_cluster = cluster;
+    }
+
+    file_p->fat16_p->free_clusters.next = (cluster + 1);
+    file_p->fat16_p->free_clusters.fsinfo_dirty = 1;
+
+    return (0);
+}
+
+static int add_cluster(struct fat16_file_t *file_p)
+{
+    fat_t free_cluster;
+
+    /* Start search after last cluster of file. */
+    if (find_free_cluster(file_p->fat16_p,
+                          file_p->cur_cluster,
+                          &free_cluster) != 0) {
+        return (-1);
+    }
+
+    if (append_cluster(file_p, file_p->cur_cluster, free_cluster) != 0) {
+        return (-1);
     }
 
     file_p->cur_cluster = free_cluster;
@@ -708,7 +1459,7 @@ static int get_dir_at_index_in_root(struct fat16_t *self_p,
                                     struct dir_t *dir_p)
 {
     int dir_entries_per_block;
-    int block;
+    uint32_t block;
     struct dir_t *d_p;
 
     dir_entries_per_block = (512 / sizeof(struct dir_t));
@@ -746,12 +1497,12 @@ static int get_dir_at_index_in_root(struct fat16_t *self_p,
  */
 static int dir_open_in_blocks(struct fat16_t *self_p,
                               const uint8_t *name_p,
-                              int16_t *block_p,
+                              uint32_t *block_p,
                               int16_t *index_p,
-                              int start_block,
-                              int end_block)
+                              uint32_t start_block,
+                              uint32_t end_block)
 {
-    int16_t block;
+    uint32_t block;
     int16_t index;
     int dir_entries_per_block;
     struct dir_t *dir_p;
@@ -792,7 +1543,58 @@ static int dir_open_in_blocks(struct fat16_t *self_p,
 }
 
 /**
- * Open directory with given name in the root folder.
+ * Open directory with given name in the directory stored in the
+ * cluster chain starting at given cluster.
+ *
+ * @param[out] index_p If true(1) is returned this is the index of an
+ *                     existing file. If false(0) is returned this is
+ *                     the index of the filst empty directory
+ *                     entry. Otherwise ignore this value.
+ *
+ * @return zero(0) or negative error code.
+ */
+static int dir_open_in_chain(struct fat16_t *self_p,
+                             const uint8_t *name_p,
+                             fat_t cluster,
+                             uint32_t *block_p,
+                             int16_t *index_p)
+{
+    uint32_t start_block;
+    int res = -1;
+
+    *index_p = -1;         /* index of empty slot. */
+
+    /* Error if bad cluster chain. */
+    if (cluster < 2) {
+        return (-1);
+    }
+
+    /* Iterate over clusters allocated by this folder. */
+    do {
+        start_block = (self_p->data_start_block
+                       + ((cluster - 2) * self_p->blocks_per_cluster));
+
+        if ((res = dir_open_in_blocks(self_p,
+                                      name_p,
+                                      block_p,
+                                      index_p,
+                                      start_block,
+                                      start_block + self_p->blocks_per_cluster)) != 0) {
+            return (res);
+        }
+
+        if (fat_get(self_p, cluster, &cluster) != 0) {
+            return (-1);
+        }
+    } while (!is_end_of_cluster(self_p, cluster));
+
+    return (res);
+}
+
+/**
+ * Open directory with given name in the root folder. The FAT16 root
+ * directory is a fixed area before the data clusters, and the FAT32
+ * root directory is a cluster chain.
  *
  * @param[out] index_p If true(1) is returned this is the index of an
  *                     existing file. If false(0) is returned this is
@@ -803,12 +1605,20 @@ static int dir_open_in_blocks(struct fat16_t *self_p,
  */
 static int dir_open_in_root(struct fat16_t *self_p,
                             const uint8_t *name_p,
-                            int16_t *block_p,
+                            uint32_t *block_p,
                             int16_t *index_p)
 {
     int root_dir_block_count;
     int dir_entries_per_block;
 
+    if (self_p->fat_type == 32) {
+        return (dir_open_in_chain(self_p,
+                                  name_p,
+                                  self_p->root_dir_cluster,
+                                  block_p,
+                                  index_p));
+    }
+
     *index_p = -1;         /* index of empty slot. */
     dir_entries_per_block = (512 / sizeof(struct dir_t));
     root_dir_block_count = (self_p->root_dir_entry_count / dir_entries_per_block);
@@ -834,47 +1644,25 @@ static int dir_open_in_root(struct fat16_t *self_p,
  */
 static int dir_open_in_subdir(struct fat16_t *self_p,
                               const uint8_t *name_p,
-                              int16_t *block_p,
+                              uint32_t *block_p,
                               int16_t *index_p)
 {
-    fat_t cluster;
-    int start_block;
     struct dir_t *dir_p;
-    int res = -1;
-
-    /* Cache the parent directory. */
-    if (!(dir_p = cache_dir_entry(self_p,
-                                  *block_p,
-                                  *index_p,
-                                  CACHE_FOR_WRITE))) {
-        return (-1);
-    }
-
-    *index_p = -1;         /* index of empty slot. */
-
-    /* Search for the file in the subdirectory. Iterate over clusters
-       allocated by this folder. */
-    cluster = dir_p->first_cluster_low;
-
-    do {
-        start_block = (self_p->data_start_block
-                       + ((cluster - 2) * self_p->blocks_per_cluster));
-
-        if ((res = dir_open_in_blocks(self_p,
-                                      name_p,
-                                      block_p,
-                                      index_p,
-                                      start_block,
-                                      start_block + self_p->blocks_per_cluster)) < 0) {
-            return (-1);
-        }
 
-        if (fat_get(self_p, cluster, &cluster) != 0) {
-            return (-1);
-        }
-    } while (!is_end_of_cluster(cluster));
+    /* Cache the parent directory. */
+    if (!(dir_p = cache_dir_entry(self_p,
+                                  *block_p,
+                                  *index_p,
+                                  CACHE_FOR_READ))) {
+        return (-1);
+    }
 
-    return (res);
+    /* Search for the file in the subdirectory. */
+    return (dir_open_in_chain(self_p,
+                              name_p,
+                              dir_first_cluster(self_p, dir_p),
+                              block_p,
+                              index_p));
 }
 
 /**
@@ -918,14 +1706,14 @@ static int dir_open(struct fat16_t *self_p,
                     const char *path_p,
                     int oflag,
                     uint8_t attributes,
-                    int16_t *block_p,
+                    uint32_t *block_p,
                     int16_t *index_p)
 {
     uint8_t dname[11];              /* name formated for dir entry. */
     struct dir_t *dir_p = NULL;     /* pointer to cached dir entry. */
     int res;
     int depth = 0;
-    int16_t parent_block = -1;
+    uint32_t parent_block = 0;
     int16_t parent_index = -1;
 
     do {
@@ -1009,12 +1797,226 @@ static int dir_open(struct fat16_t *self_p,
     return (0);
 }
 
+/**
+ * Move to the next cluster of given file at a cluster boundary. A
+ * cluster is added at the end of the chain if allocate is true(1),
+ * otherwise the end of the chain is an error.
+ *
+ * @param[in] index Index in the file of the next cluster.
+ */
+static int next_cluster(struct fat16_file_t *file_p,
+                        uint32_t index,
+                        int allocate)
+{
+    fat_t next;
+
+    if (file_p->cur_cluster == 0) {
+        next = file_p->first_cluster;
+    } else {
+        if (fat_get(file_p->fat16_p, file_p->cur_cluster, &next) != 0) {
+            return (-1);
+        }
+    }
+
+    if (((file_p->cur_cluster == 0) && (next == 0))
+        || is_end_of_cluster(file_p->fat16_p, next)) {
+        /* Add cluster if at end of chain. */
+        if (!allocate) {
+            return (-1);
+        }
+
+        if (add_cluster(file_p) != 0) {
+            return (-1);
+        }
+    } else if (next < 2) {
+        /* Return error if bad cluster chain. */
+        return (-1);
+    } else {
+        file_p->cur_cluster = next;
+    }
+
+    extents_add(file_p, index, file_p->cur_cluster);
+
+    return (0);
+}
+
+static int device_read_blocks(struct fat16_t *self_p,
+                              uint8_t *dst_p,
+                              uint32_t src_block,
+                              size_t count)
+{
+    size_t i;
+
+    if (cache_prepare_transfer(self_p, src_block, count, 0) != 0) {
+        return (-1);
+    }
+
+    if (self_p->read_blocks != NULL) {
+        if (self_p->read_blocks(self_p->arg_p,
+                                dst_p,
+                                src_block,
+                                count) != (BLOCK_SIZE * count)) {
+            return (-1);
+        }
+    } else {
+        for (i = 0; i < count; i++) {
+            if (self_p->read(self_p->arg_p,
+                             &dst_p[BLOCK_SIZE * i],
+                             src_block + i) != BLOCK_SIZE) {
+                return (-1);
+            }
+        }
+    }
+
+    return (0);
+}
+
+static int device_write_blocks(struct fat16_t *self_p,
+                               uint32_t dst_block,
+                               const uint8_t *src_p,
+                               size_t count)
+{
+    size_t i;
+
+    if (cache_prepare_transfer(self_p, dst_block, count, 1) != 0) {
+        return (-1);
+    }
+
+    if (self_p->write_blocks != NULL) {
+        if (self_p->write_blocks(self_p->arg_p,
+                                 dst_block,
+                                 src_p,
+                                 count) != (BLOCK_SIZE * count)) {
+            return (-1);
+        }
+    } else {
+        for (i = 0; i < count; i++) {
+            if (self_p->write(self_p->arg_p,
+                              dst_block + i,
+                              &src_p[BLOCK_SIZE * i]) != BLOCK_SIZE) {
+                return (-1);
+            }
+        }
+    }
+
+    return (0);
+}
+
+/**
+ * Transfer given number of whole blocks between the storage device
+ * and given buffer, starting at the current position of given file,
+ * which must be at a block boundary. Runs of consecutive blocks, that
+ * may span multiple clusters, are transferred at once.
+ *
+ * @return zero(0) or negative error code.
+ */
+static int file_transfer_blocks(struct fat16_file_t *file_p,
+                                uint8_t *buf_p,
+                                size_t count,
+                                int write)
+{
+    struct fat16_t *self_p;
+    fat_t cur_cluster;
+    uint32_t position;
+    uint32_t lba;
+    uint32_t run_lba;
+    size_t run_count;
+    size_t done;
+    size_t n;
+    uint8_t blk_of_cluster;
+    int res;
+
+    self_p = file_p->fat16_p;
+    cur_cluster = file_p->cur_cluster;
+    position = file_p->cur_position;
+    run_lba = 0;
+    run_count = 0;
+    done = 0;
+
+    while (done + run_count < count) {
+        blk_of_cluster = block_of_cluster(self_p->blocks_per_cluster, position);
+
+        if (blk_of_cluster == 0) {
+            if (next_cluster(file_p,
+                             cluster_index(self_p, position),
+                             write) != 0) {
+                file_p->cur_cluster = cur_cluster;
+
+                return (-1);
+            }
+        }
+
+        lba = data_block_lba(file_p, blk_of_cluster);
+
+        /* Transfer the current run if the next cluster is not
+           adjacent to it. */
+        if ((run_count > 0) && (lba != run_lba + run_count)) {
+            if (write) {
+                res = device_write_blocks(self_p,
+                                          run_lba,
+                                          &buf_p[BLOCK_SIZE * done],
+                                          run_count);
+            } else {
+                res = device_read_blocks(self_p,
+                                         &buf_p[BLOCK_SIZE * done],
+                                         run_lba,
+                                         run_count);
+            }
+
+            if (res != 0) {
+                file_p->cur_cluster = cur_cluster;
+
+                return (-1);
+            }
+
+            done += run_count;
+            run_count = 0;
+        }
+
+        if (run_count == 0) {
+            run_lba = lba;
+        }
+
+        /* Add the rest of the cluster to the run. */
+        n = (self_p->blocks_per_cluster - blk_of_cluster);
+
+        if (n > count - done - run_count) {
+            n = (count - done - run_count);
+        }
+
+        run_count += n;
+        position += (BLOCK_SIZE * n);
+    }
+
+    if (write) {
+        res = device_write_blocks(self_p,
+                                  run_lba,
+                                  &buf_p[BLOCK_SIZE * done],
+                                  run_count);
+    } else {
+        res = device_read_blocks(self_p,
+                                 &buf_p[BLOCK_SIZE * done],
+                                 run_lba,
+                                 run_count);
+    }
+
+    /* The caller only advances the position on success, so the
+       cluster must match it again on failure. */
+    if (res != 0) {
+        file_p->cur_cluster = cur_cluster;
+    }
+
+    return (res);
+}
+
 static int get_block(struct fat16_file_t *file_p,
+                     uint8_t **data_pp,
                      uint16_t *block_offset_p)
 {
     uint8_t blk_of_cluster;
-    fat_t next;
     uint32_t lba;
+    uint8_t action;
+    struct fat16_cache_block_t *block_p;
 
     blk_of_cluster = block_of_cluster(file_p->fat16_p->blocks_per_cluster,
                                       file_p->cur_position);
@@ -1023,48 +2025,29 @@ static int get_block(struct fat16_file_t *file_p,
 
     if ((blk_of_cluster == 0) && (*block_offset_p == 0)) {
         /* Start of new cluster. */
-        if (file_p->cur_cluster == 0) {
-            if (file_p->first_cluster == 0) {
-                /* Allocate first cluster of file. */
-                if (add_cluster(file_p) != 0) {
-                    return (FAT16_EOF);
-                }
-            } else {
-                file_p->cur_cluster = file_p->first_cluster;
-            }
-        } else {
-            if (fat_get(file_p->fat16_p, file_p->cur_cluster, &next) != 0) {
-                return (FAT16_EOF);
-            }
-
-            if (is_end_of_cluster(next)) {
-                /* Add cluster if at end of chain. */
-                if (add_cluster(file_p) != 0) {
-                    return (FAT16_EOF);
-                }
-            } else {
-                file_p->cur_cluster = next;
-            }
+        if (next_cluster(file_p,
+                         cluster_index(file_p->fat16_p, file_p->cur_position),
+                         1) != 0) {
+            return (FAT16_EOF);
         }
     }
 
     lba = data_block_lba(file_p, blk_of_cluster);
+    action = CACHE_FOR_WRITE;
 
     if ((*block_offset_p == 0) && (file_p->cur_position >= file_p->file_size)) {
         /* Start of new block don't need to read into cache. */
-        if (cache_flush(file_p->fat16_p) != 0) {
-            return (FAT16_EOF);
-        }
+        action |= CACHE_NO_READ;
+    }
 
-        file_p->fat16_p->cache.block_number = lba;
-        cache_set_dirty(&file_p->fat16_p->cache);
-    } else {
-        /* Rewrite part of block. */
-        if (cache_raw_block(file_p->fat16_p, lba, CACHE_FOR_WRITE) != 0) {
-            return (FAT16_EOF);
-        }
+    block_p = cache_raw_block(file_p->fat16_p, lba, action);
+
+    if (block_p == NULL) {
+        return (FAT16_EOF);
     }
 
+    *data_pp = block_p->buffer.data;
+
     return (0);
 }
 
@@ -1074,7 +2057,7 @@ static int file_open(struct fat16_t *self_p,
                      int oflag,
                      uint8_t attributes)
 {
-    int16_t block;
+    uint32_t block;
     int16_t index;
     struct dir_t* dir_p;
 
@@ -1113,8 +2096,9 @@ static int file_open(struct fat16_t *self_p,
     file_p->dir_entry_block = block;
     file_p->dir_entry_index = index;
     file_p->file_size = dir_p->file_size;
-    file_p->first_cluster = dir_p->first_cluster_low;
+    file_p->first_cluster = dir_first_cluster(self_p, dir_p);
     file_p->flags = oflag & (O_RDWR | O_SYNC | O_APPEND);
+    file_p->extents.length = 0;
 
     if (oflag & O_TRUNC) {
         return (file_truncate(file_p, 0));
@@ -1133,6 +2117,11 @@ int fat16_file_open(struct fat16_t *self_p,
 
 int fat16_file_close(struct fat16_file_t *file_p)
 {
+    /* Write buffered data and the directory entry. */
+    if (file_p->flags & O_WRITE) {
+        return (fat16_file_sync(file_p));
+    }
+
     return (0);
 }
 
@@ -1145,6 +2134,7 @@ ssize_t fat16_file_read(struct fat16_file_t *file_p,
     uint16_t block_offset;
     uint8_t *src_p, *dst_p;
     size_t n;
+    struct fat16_cache_block_t *block_p;
 
     /* Error if not open for read. */
     if (!(file_p->flags & O_READ)) {
@@ -1165,31 +2155,42 @@ ssize_t fat16_file_read(struct fat16_file_t *file_p,
                                           file_p->cur_position);
         block_offset = cache_data_offset(file_p->cur_position);
 
-        if (blk_of_cluster == 0 && block_offset == 0) {
-            /* Start next cluster. */
-            if (file_p->cur_cluster == 0) {
-                file_p->cur_cluster = file_p->first_cluster;
-            } else {
-                if (fat_get(file_p->fat16_p, file_p->cur_cluster, &file_p->cur_cluster) != 0) {
-                    return (FAT16_EOF);
-                }
+        /* Read whole blocks directly into the caller's buffer. */
+        if ((block_offset == 0) && (left >= BLOCK_SIZE)) {
+            n = (left / BLOCK_SIZE);
+
+            if (file_transfer_blocks(file_p, dst_p, n, 0) != 0) {
+                return (FAT16_EOF);
             }
 
-            /* Return error if bad cluster chain. */
-            if (file_p->cur_cluster < 2 || is_end_of_cluster(file_p->cur_cluster)) {
+            n *= BLOCK_SIZE;
+            file_p->cur_position += n;
+            dst_p += n;
+            left -= n;
+            continue;
+        }
+
+        if (blk_of_cluster == 0 && block_offset == 0) {
+            /* Start next cluster. */
+            if (next_cluster(file_p,
+                             cluster_index(file_p->fat16_p,
+                                           file_p->cur_position),
+                             0) != 0) {
                 return (FAT16_EOF);
             }
         }
 
         /* Cache data block. */
-        if (cache_raw_block(file_p->fat16_p,
-                            data_block_lba(file_p, blk_of_cluster),
-                            CACHE_FOR_READ) != 0) {
+        block_p = cache_raw_block(file_p->fat16_p,
+                                  data_block_lba(file_p, blk_of_cluster),
+                                  CACHE_FOR_READ);
+
+        if (block_p == NULL) {
             return (FAT16_EOF);
         }
 
         /* Location of data in cache. */
-        src_p = file_p->fat16_p->cache.buffer.data + block_offset;
+        src_p = block_p->buffer.data + block_offset;
 
         /* Max number of byte available in block. */
         n = 512 - block_offset;
@@ -1237,11 +2238,27 @@ ssize_t fat16_file_write(struct fat16_file_t *file_p,
     }
 
     while (left > 0) {
-        if (get_block(file_p, &block_offset) != 0) {
+        /* Write whole blocks directly from the caller's buffer. */
+        if ((cache_data_offset(file_p->cur_position) == 0)
+            && (left >= BLOCK_SIZE)) {
+            n = (left / BLOCK_SIZE);
+
+            if (file_transfer_blocks(file_p, (uint8_t *)csrc_p, n, 1) != 0) {
+                return (FAT16_EOF);
+            }
+
+            n *= BLOCK_SIZE;
+            file_p->cur_position += n;
+            left -= n;
+            csrc_p += n;
+            continue;
+        }
+
+        if (get_block(file_p, &dst_p, &block_offset) != 0) {
             return (FAT16_EOF);
         }
 
-        dst_p = file_p->fat16_p->cache.buffer.data + block_offset;
+        dst_p += block_offset;
 
         /* Max space in block. */
         n = 512 - block_offset;
@@ -1274,12 +2291,92 @@ ssize_t fat16_file_write(struct fat16_file_t *file_p,
     return (size);
 }
 
+int fat16_file_preallocate(struct fat16_file_t *file_p,
+                           size_t size)
+{
+    struct fat16_t *self_p;
+    uint32_t cluster_size;
+    uint32_t needed;
+    uint32_t count;
+    fat_t cluster;
+    fat_t last;
+    fat_t next;
+
+    /* Error if file is not open for write. */
+    if (!(file_p->flags & O_WRITE)) {
+        return (-1);
+    }
+
+    self_p = file_p->fat16_p;
+    cluster_size = (BLOCK_SIZE * self_p->blocks_per_cluster);
+    needed = ((size + cluster_size - 1) / cluster_size);
+
+    /* Find the last cluster of the file. */
+    count = 0;
+    last = 0;
+    cluster = file_p->first_cluster;
+
+    while ((cluster != 0) && (count < needed)) {
+        count++;
+        last = cluster;
+
+        if (fat_get(self_p, cluster, &next) != 0) {
+            return (-1);
+        }
+
+        if (is_end_of_cluster(self_p, next)) {
+            break;
+        }
+
+        cluster = next;
+    }
+
+    if (count >= needed) {
+        return (0);
+    }
+
+    /* Allocate a contiguous run if possible. */
+    if ((self_p->free_clusters.bitmap_p != NULL)
+        && (find_free_run(self_p,
+                          last != 0 ? last : self_p->free_clusters.next - 1,
+                          needed - count,
+                          &cluster) == 0)) {
+        while (count < needed) {
+            if (append_cluster(file_p, last, cluster) != 0) {
+                return (-1);
+            }
+
+            last = cluster;
+            cluster++;
+            count++;
+        }
+    } else {
+        while (count < needed) {
+            if (find_free_cluster(self_p, last, &cluster) != 0) {
+                return (-1);
+            }
+
+            if (append_cluster(file_p, last, cluster) != 0) {
+                return (-1);
+            }
+
+            last = cluster;
+            count++;
+        }
+    }
+
+    return (0);
+}
+
 int fat16_file_seek(struct fat16_file_t *file_p,
                     size_t pos,
                     int whence)
 {
-    fat_t n;
-    uint8_t blocks_per_cluster = file_p->fat16_p->blocks_per_cluster;
+    struct fat16_extent_t *run_p;
+    uint32_t n;
+    uint32_t index;
+    uint32_t cur_index;
+    fat_t cluster;
 
     if (whence == FAT16_SEEK_CUR) {
         pos += file_p->cur_position;
@@ -1302,24 +2399,40 @@ int fat16_file_seek(struct fat16_file_t *file_p,
         return (0);
     }
 
-    n = ((pos - 1) >> 9) / blocks_per_cluster;
+    n = cluster_index(file_p->fat16_p, pos - 1);
 
-    if (pos < file_p->cur_position || file_p->cur_position == 0) {
-        /* Must follow chain from first cluster. */
-        file_p->cur_cluster = file_p->first_cluster;
-    } else {
-        /* Advance from cur_position. */
-        n -= ((file_p->cur_position - 1) >> 9) / blocks_per_cluster;
-    }
+    if (extents_get(file_p, n, &cluster) != 0) {
+        /* Follow the chain from the last cached cluster. */
+        if (file_p->extents.length == 0) {
+            extents_add(file_p, 0, file_p->first_cluster);
+        }
 
-    while (n--) {
-        if (fat_get(file_p->fat16_p,
-                    file_p->cur_cluster,
-                    &file_p->cur_cluster) != 0) {
-            return (-1);
+        run_p = &file_p->extents.runs[file_p->extents.length - 1];
+        index = (run_p->index + run_p->length - 1);
+        cluster = (run_p->cluster + run_p->length - 1);
+
+        /* Advance from cur_position if it is closer. */
+        if ((file_p->cur_position != 0) && (pos >= file_p->cur_position)) {
+            cur_index = cluster_index(file_p->fat16_p,
+                                      file_p->cur_position - 1);
+
+            if (cur_index > index) {
+                index = cur_index;
+                cluster = file_p->cur_cluster;
+            }
+        }
+
+        while (index < n) {
+            if (fat_get(file_p->fat16_p, cluster, &cluster) != 0) {
+                return (-1);
+            }
+
+            index++;
+            extents_add(file_p, index, cluster);
         }
     }
 
+    file_p->cur_cluster = cluster;
     file_p->cur_position = pos;
 
     return (0);
@@ -1353,6 +2466,7 @@ int fat16_file_sync(struct fat16_file_t *file_p)
         /* Update file size and first cluster. */
         dir_p->file_size = file_p->file_size;
         dir_p->first_cluster_low = file_p->first_cluster;
+        dir_p->first_cluster_high = (file_p->first_cluster >> 16);
 
         /* Set modify time if user supplied a callback date/time function. */
         /* if (dateTime) { */
@@ -1363,9 +2477,93 @@ int fat16_file_sync(struct fat16_file_t *file_p)
         file_p->flags &= ~F_FILE_DIR_DIRTY;
     }
 
+    if (fsinfo_write(file_p->fat16_p) != 0) {
+        return (-1);
+    }
+
     return (cache_flush(file_p->fat16_p));
 }
 
+int fat16_stat(struct fat16_t *self_p,
+               const char *path_p,
+               struct fat16_stat_t *stat_p)
+{
+    uint32_t block;
+    int16_t index;
+    struct dir_t *dir_p;
+    union fat16_date_t date;
+    union fat16_time_t time;
+
+    /* Find the directory entry of the file. */
+    if (dir_open(self_p, path_p, O_READ, 0, &block, &index) != 0) {
+        return (-ENOENT);
+    }
+
+    dir_p = cache_dir_entry(self_p, block, index, CACHE_FOR_READ);
+
+    if (dir_p == NULL) {
+        return (-EIO);
+    }
+
+    stat_p->size = dir_p->file_size;
+    stat_p->is_dir = dir_is_subdir(dir_p);
+
+    /* Set the modification date. */
+    date.as_uint16 = dir_p->last_write_date;
+    time.as_uint16 = dir_p->last_write_time;
+    stat_p->latest_mod_date.year = 1980 + date.bits.year;
+    stat_p->latest_mod_date.month = date.bits.month;
+    stat_p->latest_mod_date.date = date.bits.day;
+    stat_p->latest_mod_date.hour = time.bits.hours;
+    stat_p->latest_mod_date.minute = time.bits.minutes;
+    stat_p->latest_mod_date.second = (2 * time.bits.seconds);
+
+    /* A zero date is invalid, so only calculate the weekday of valid
+       dates. */
+    if ((date.bits.month >= 1) && (date.bits.month <= 12)) {
+        stat_p->latest_mod_date.day = weekday(stat_p->latest_mod_date.year,
+                                              stat_p->latest_mod_date.month,
+                                              stat_p->latest_mod_date.date);
+    } else {
+        stat_p->latest_mod_date.day = 1;
+    }
+
+    return (0);
+}
+
+/**
+ * Open the FAT32 root directory for reading as a file. The file size
+ * is the size of its cluster chain.
+ */
+static int root_dir_open(struct fat16_t *self_p,
+                         struct fat16_file_t *file_p)
+{
+    fat_t cluster;
+    size_t size;
+
+    cluster = self_p->root_dir_cluster;
+    size = 0;
+
+    do {
+        size += (BLOCK_SIZE * self_p->blocks_per_cluster);
+
+        if (fat_get(self_p, cluster, &cluster) != 0) {
+            return (-1);
+        }
+    } while (!is_end_of_cluster(self_p, cluster));
+
+    file_p->cur_cluster = 0;
+    file_p->cur_position = 0;
+    file_p->dir_entry_block = 0;
+    file_p->dir_entry_index = 0;
+    file_p->file_size = size;
+    file_p->first_cluster = self_p->root_dir_cluster;
+    file_p->flags = O_READ;
+    file_p->extents.length = 0;
+
+    return (0);
+}
+
 int fat16_dir_open(struct fat16_t *self_p,
                    struct fat16_dir_t *dir_p,
                    const char *path_p,
@@ -1377,9 +2575,18 @@ int fat16_dir_open(struct fat16_t *self_p,
 
     /* Root directory is special. */
     if ((strcmp(path_p, ".") == 0) && (oflag & O_READ)) {
+        file_p->fat16_p = self_p;
+
+        if (self_p->fat_type == 32) {
+            /* Read the FAT32 root directory cluster chain as a
+               file. */
+            dir_p->root_index = -1;
+
+            return (root_dir_open(self_p, file_p));
+        }
+
         /* First index in root folder. */
         dir_p->root_index = 0;
-        file_p->fat16_p = self_p;
 
         return (0);
     } else if (file_open(self_p, file_p, path_p, oflag, DIR_ATTR_DIRECTORY) != 0) {
@@ -1407,6 +2614,11 @@ int fat16_dir_open(struct fat16_t *self_p,
 
 int fat16_dir_close(struct fat16_dir_t *dir_p)
 {
+    /* Write the first cluster of a created directory. */
+    if (dir_p->root_index == -1) {
+        return (fat16_file_close(&dir_p->file));
+    }
+
     return (0);
 }
 
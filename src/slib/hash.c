@@ -19,82 +19,711 @@
  */
 
 #include "simba.h"
-#include <arpa/inet.h>
+
+#if (HASH_SHA_INSTRUCTIONS == 1) && defined(ARCH_LINUX) && defined(__x86_64__)
+#    include <cpuid.h>
+#    include <immintrin.h>
+#    define HASH_HW_X86
+#elif (HASH_SHA_INSTRUCTIONS == 1) && defined(ARCH_LINUX) && defined(__aarch64__)
+#    include <sys/auxv.h>
+#    include <asm/hwcap.h>
+#    include <arm_neon.h>
+#    define HASH_HW_ARM
+#endif
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+    0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+    0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+typedef void (*compress_t)(uint32_t *h_p, const uint8_t *b_p, size_t blocks);
 
 static inline uint32_t rotateleft(uint32_t value, int positions)
 {
     return ((value << positions) | (value >> (32 - positions)));
 }
 
-static void block_update(struct hash_sha1_t *self_p,
-                         uint8_t *block_p)
+static inline uint32_t read_uint32_be(const uint8_t *b_p)
 {
-    uint32_t a ,b ,c ,d ,e, f, i ,t ,w[80];
-    uint32_t *b_p = (uint32_t *)block_p;
+    return (((uint32_t)b_p[0] << 24)
+            | ((uint32_t)b_p[1] << 16)
+            | ((uint32_t)b_p[2] << 8)
+            | ((uint32_t)b_p[3] << 0));
+}
+
+#define F1(b, c, d) ((d) ^ ((b) & ((c) ^ (d))))
+#define F2(b, c, d) ((b) ^ (c) ^ (d))
+#define F3(b, c, d) (((b) & (c)) | (((b) | (c)) & (d)))
+
+/* The message schedule is kept in a rolling window of 16 words. */
+#define LOAD(i) (w[i] = read_uint32_be(&b_p[4 * (i)]))
+#define EXPAND(i)                                                       \
+    (w[(i) & 15] = rotateleft(w[((i) + 13) & 15]                        \
+                              ^ w[((i) + 8) & 15]                       \
+                              ^ w[((i) + 2) & 15]                       \
+                              ^ w[(i) & 15], 1))
+
+#define SHA1_ROUND(a, b, c, d, e, f, k, w)                              \
+    e += (rotateleft(a, 5) + f(b, c, d) + k + w);                       \
+    b = rotateleft(b, 30)
+
+static void sw_sha1_compress(uint32_t *h_p,
+                             const uint8_t *b_p,
+                             size_t blocks)
+{
+    uint32_t a, b, c, d, e, w[16];
+
+    while (blocks > 0) {
+        a = h_p[0];
+        b = h_p[1];
+        c = h_p[2];
+        d = h_p[3];
+        e = h_p[4];
+
+        SHA1_ROUND(a, b, c, d, e, F1, 0x5a827999, LOAD(0));
+        SHA1_ROUND(e, a, b, c, d, F1, 0x5a827999, LOAD(1));
+        SHA1_ROUND(d, e, a, b, c, F1, 0x5a827999, LOAD(2));
+        SHA1_ROUND(c, d, e, a, b, F1, 0x5a827999, LOAD(3));
+        SHA1_ROUND(b, c, d, e, a, F1, 0x5a827999, LOAD(4));
+        SHA1_ROUND(a, b, c, d, e, F1, 0x5a827999, LOAD(5));
+        SHA1_ROUND(e, a, b, c, d, F1, 0x5a827999, LOAD(6));
+        SHA1_ROUND(d, e, a, b, c, F1, 0x5a827999, LOAD(7));
+        SHA1_ROUND(c, d, e, a, b, F1, 0x5a827999, LOAD(8));
+        SHA1_ROUND(b, c, d, e, a, F1, 0x5a827999, LOAD(9));
+        SHA1_ROUND(a, b, c, d, e, F1, 0x5a827999, LOAD(10));
+        SHA1_ROUND(e, a, b, c, d, F1, 0x5a827999, LOAD(11));
+        SHA1_ROUND(d, e, a, b, c, F1, 0x5a827999, LOAD(12));
+        SHA1_ROUND(c, d, e, a, b, F1, 0x5a827999, LOAD(13));
+        SHA1_ROUND(b, c, d, e, a, F1, 0x5a827999, LOAD(14));
+        SHA1_ROUND(a, b, c, d, e, F1, 0x5a827999, LOAD(15));
+        SHA1_ROUND(e, a, b, c, d, F1, 0x5a827999, EXPAND(16));
+        SHA1_ROUND(d, e, a, b, c, F1, 0x5a827999, EXPAND(17));
+        SHA1_ROUND(c, d, e, a, b, F1, 0x5a827999, EXPAND(18));
+        SHA1_ROUND(b, c, d, e, a, F1, 0x5a827999, EXPAND(19));
+        SHA1_ROUND(a, b, c, d, e, F2, 0x6ed9eba1, EXPAND(20));
+        SHA1_ROUND(e, a, b, c, d, F2, 0x6ed9eba1, EXPAND(21));
+        SHA1_ROUND(d, e, a, b, c, F2, 0x6ed9eba1, EXPAND(22));
+        SHA1_ROUND(c, d, e, a, b, F2, 0x6ed9eba1, EXPAND(23));
+        SHA1_ROUND(b, c, d, e, a, F2, 0x6ed9eba1, EXPAND(24));
+        SHA1_ROUND(a, b, c, d, e, F2, 0x6ed9eba1, EXPAND(25));
+        SHA1_ROUND(e, a, b, c, d, F2, 0x6ed9eba1, EXPAND(26));
+        SHA1_ROUND(d, e, a, b, c, F2, 0x6ed9eba1, EXPAND(27));
+        SHA1_ROUND(c, d, e, a, b, F2, 0x6ed9eba1, EXPAND(28));
+        SHA1_ROUND(b, c, d, e, a, F2, 0x6ed9eba1, EXPAND(29));
+        SHA1_ROUND(a, b, c, d, e, F2, 0x6ed9eba1, EXPAND(30));
+        SHA1_ROUND(e, a, b, c, d, F2, 0x6ed9eba1, EXPAND(31));
+        SHA1_ROUND(d, e, a, b, c, F2, 0x6ed9eba1, EXPAND(32));
+        SHA1_ROUND(c, d, e, a, b, F2, 0x6ed9eba1, EXPAND(33));
+        SHA1_ROUND(b, c, d, e, a, F2, 0x6ed9eba1, EXPAND(34));
+        SHA1_ROUND(a, b, c, d, e, F2, 0x6ed9eba1, EXPAND(35));
+        SHA1_ROUND(e, a, b, c, d, F2, 0x6ed9eba1, EXPAND(36));
+        SHA1_ROUND(d, e, a, b, c, F2, 0x6ed9eba1, EXPAND(37));
+        SHA1_ROUND(c, d, e, a, b, F2, 0x6ed9eba1, EXPAND(38));
+        SHA1_ROUND(b, c, d, e, a, F2, 0x6ed9eba1, EXPAND(39));
+        SHA1_ROUND(a, b, c, d, e, F3, 0x8f1bbcdc, EXPAND(40));
+        SHA1_ROUND(e, a, b, c, d, F3, 0x8f1bbcdc, EXPAND(41));
+        SHA1_ROUND(d, e, a, b, c, F3, 0x8f1bbcdc, EXPAND(42));
+        SHA1_ROUND(c, d, e, a, b, F3, 0x8f1bbcdc, EXPAND(43));
+        SHA1_ROUND(b, c, d, e, a, F3, 0x8f1bbcdc, EXPAND(44));
+        SHA1_ROUND(a, b, c, d, e, F3, 0x8f1bbcdc, EXPAND(45));
+        SHA1_ROUND(e, a, b, c, d, F3, 0x8f1bbcdc, EXPAND(46));
+        SHA1_ROUND(d, e, a, b, c, F3, 0x8f1bbcdc, EXPAND(47));
+        SHA1_ROUND(c, d, e, a, b, F3, 0x8f1bbcdc, EXPAND(48));
+        SHA1_ROUND(b, c, d, e, a, F3, 0x8f1bbcdc, EXPAND(49));
+        SHA1_ROUND(a, b, c, d, e, F3, 0x8f1bbcdc, EXPAND(50));
+        SHA1_ROUND(e, a, b, c, d, F3, 0x8f1bbcdc, EXPAND(51));
+        SHA1_ROUND(d, e, a, b, c, F3, 0x8f1bbcdc, EXPAND(52));
+        SHA1_ROUND(c, d, e, a, b, F3, 0x8f1bbcdc, EXPAND(53));
+        SHA1_ROUND(b, c, d, e, a, F3, 0x8f1bbcdc, EXPAND(54));
+        SHA1_ROUND(a, b, c, d, e, F3, 0x8f1bbcdc, EXPAND(55));
+        SHA1_ROUND(e, a, b, c, d, F3, 0x8f1bbcdc, EXPAND(56));
+        SHA1_ROUND(d, e, a, b, c, F3, 0x8f1bbcdc, EXPAND(57));
+        SHA1_ROUND(c, d, e, a, b, F3, 0x8f1bbcdc, EXPAND(58));
+        SHA1_ROUND(b, c, d, e, a, F3, 0x8f1bbcdc, EXPAND(59));
+        SHA1_ROUND(a, b, c, d, e, F2, 0xca62c1d6, EXPAND(60));
+        SHA1_ROUND(e, a, b, c, d, F2, 0xca62c1d6, EXPAND(61));
+        SHA1_ROUND(d, e, a, b, c, F2, 0xca62c1d6, EXPAND(62));
+        SHA1_ROUND(c, d, e, a, b, F2, 0xca62c1d6, EXPAND(63));
+        SHA1_ROUND(b, c, d, e, a, F2, 0xca62c1d6, EXPAND(64));
+        SHA1_ROUND(a, b, c, d, e, F2, 0xca62c1d6, EXPAND(65));
+        SHA1_ROUND(e, a, b, c, d, F2, 0xca62c1d6, EXPAND(66));
+        SHA1_ROUND(d, e, a, b, c, F2, 0xca62c1d6, EXPAND(67));
+        SHA1_ROUND(c, d, e, a, b, F2, 0xca62c1d6, EXPAND(68));
+        SHA1_ROUND(b, c, d, e, a, F2, 0xca62c1d6, EXPAND(69));
+        SHA1_ROUND(a, b, c, d, e, F2, 0xca62c1d6, EXPAND(70));
+        SHA1_ROUND(e, a, b, c, d, F2, 0xca62c1d6, EXPAND(71));
+        SHA1_ROUND(d, e, a, b, c, F2, 0xca62c1d6, EXPAND(72));
+        SHA1_ROUND(c, d, e, a, b, F2, 0xca62c1d6, EXPAND(73));
+        SHA1_ROUND(b, c, d, e, a, F2, 0xca62c1d6, EXPAND(74));
+        SHA1_ROUND(a, b, c, d, e, F2, 0xca62c1d6, EXPAND(75));
+        SHA1_ROUND(e, a, b, c, d, F2, 0xca62c1d6, EXPAND(76));
+        SHA1_ROUND(d, e, a, b, c, F2, 0xca62c1d6, EXPAND(77));
+        SHA1_ROUND(c, d, e, a, b, F2, 0xca62c1d6, EXPAND(78));
+        SHA1_ROUND(b, c, d, e, a, F2, 0xca62c1d6, EXPAND(79));
+
+        h_p[0] += a;
+        h_p[1] += b;
+        h_p[2] += c;
+        h_p[3] += d;
+        h_p[4] += e;
+        b_p += 64;
+        blocks--;
+    }
+}
+
+#undef LOAD
+#undef EXPAND
+
+/* Macros as they are used on vectors as well. */
+#define ROTATERIGHT(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define SIGMA0(x) (ROTATERIGHT(x, 2) ^ ROTATERIGHT(x, 13) ^ ROTATERIGHT(x, 22))
+#define SIGMA1(x) (ROTATERIGHT(x, 6) ^ ROTATERIGHT(x, 11) ^ ROTATERIGHT(x, 25))
+#define SCHEDULE0(x) (ROTATERIGHT(x, 7) ^ ROTATERIGHT(x, 18) ^ ((x) >> 3))
+#define SCHEDULE1(x) (ROTATERIGHT(x, 17) ^ ROTATERIGHT(x, 19) ^ ((x) >> 10))
+
+#define LOAD(i) (w[i] = read_uint32_be(&b_p[4 * (i)]))
+#define EXPAND(i)                                                       \
+    (w[(i) & 15] += (SCHEDULE1(w[((i) + 14) & 15])                      \
+                     + w[((i) + 9) & 15]                                \
+                     + SCHEDULE0(w[((i) + 1) & 15])))
+
+#define SHA256_ROUND(a, b, c, d, e, f, g, h, i, w)                      \
+    t = (h + SIGMA1(e) + F1(e, f, g) + sha256_k[i] + w);                \
+    d += t;                                                             \
+    h = (t + SIGMA0(a) + F3(a, b, c))
+
+#define SHA256_ROUNDS8(i, w)                                            \
+    SHA256_ROUND(a, b, c, d, e, f, g, h, (i) + 0, w((i) + 0));          \
+    SHA256_ROUND(h, a, b, c, d, e, f, g, (i) + 1, w((i) + 1));          \
+    SHA256_ROUND(g, h, a, b, c, d, e, f, (i) + 2, w((i) + 2));          \
+    SHA256_ROUND(f, g, h, a, b, c, d, e, (i) + 3, w((i) + 3));          \
+    SHA256_ROUND(e, f, g, h, a, b, c, d, (i) + 4, w((i) + 4));          \
+    SHA256_ROUND(d, e, f, g, h, a, b, c, (i) + 5, w((i) + 5));          \
+    SHA256_ROUND(c, d, e, f, g, h, a, b, (i) + 6, w((i) + 6));          \
+    SHA256_ROUND(b, c, d, e, f, g, h, a, (i) + 7, w((i) + 7))
+
+static void sw_sha256_compress(uint32_t *h_p,
+                               const uint8_t *b_p,
+                               size_t blocks)
+{
+    uint32_t a, b, c, d, e, f, g, h, t, w[16];
+    int i;
+
+    while (blocks > 0) {
+        a = h_p[0];
+        b = h_p[1];
+        c = h_p[2];
+        d = h_p[3];
+        e = h_p[4];
+        f = h_p[5];
+        g = h_p[6];
+        h = h_p[7];
+
+        for (i = 0; i < 16; i += 8) {
+            SHA256_ROUNDS8(i, LOAD);
+        }
+
+        for (; i < 64; i += 8) {
+            SHA256_ROUNDS8(i, EXPAND);
+        }
+
+        h_p[0] += a;
+        h_p[1] += b;
+        h_p[2] += c;
+        h_p[3] += d;
+        h_p[4] += e;
+        h_p[5] += f;
+        h_p[6] += g;
+        h_p[7] += h;
+        b_p += 64;
+        blocks--;
+    }
+}
+
+/* One 32 bits word per stream. */
+typedef uint32_t lanes_t __attribute__((vector_size(4 * HASH_MULTI_LANES)));
+
+#define WORD(i) (w[i])
+
+/**
+ * Compress one block per stream at a time, with the streams in the
+ * lanes of vectors. The compiler uses SIMD instructions if the CPU
+ * has them.
+ */
+static void sw_sha256_compress_multi(uint32_t *h_pp[HASH_MULTI_LANES],
+                                     const uint8_t *b_pp[HASH_MULTI_LANES],
+                                     size_t blocks)
+{
+    lanes_t a, b, c, d, e, f, g, h, t, w[16];
+    int i, l;
+
+    while (blocks > 0) {
+        for (l = 0; l < HASH_MULTI_LANES; l++) {
+            a[l] = h_pp[l][0];
+            b[l] = h_pp[l][1];
+            c[l] = h_pp[l][2];
+            d[l] = h_pp[l][3];
+            e[l] = h_pp[l][4];
+            f[l] = h_pp[l][5];
+            g[l] = h_pp[l][6];
+            h[l] = h_pp[l][7];
+
+            for (i = 0; i < 16; i++) {
+                w[i][l] = read_uint32_be(&b_pp[l][4 * i]);
+            }
+        }
+
+        for (i = 0; i < 16; i += 8) {
+            SHA256_ROUNDS8(i, WORD);
+        }
+
+        for (; i < 64; i += 8) {
+            SHA256_ROUNDS8(i, EXPAND);
+        }
+
+        for (l = 0; l < HASH_MULTI_LANES; l++) {
+            h_pp[l][0] += a[l];
+            h_pp[l][1] += b[l];
+            h_pp[l][2] += c[l];
+            h_pp[l][3] += d[l];
+            h_pp[l][4] += e[l];
+            h_pp[l][5] += f[l];
+            h_pp[l][6] += g[l];
+            h_pp[l][7] += h[l];
+            b_pp[l] += 64;
+        }
+
+        blocks--;
+    }
+}
+
+#if defined(HASH_HW_X86)
+
+static int hw_is_available(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0) {
+        return (0);
+    }
+
+    if (((ecx & bit_SSSE3) == 0) || ((ecx & bit_SSE4_1) == 0)) {
+        return (0);
+    }
 
-    for (i = 0; i < 16; i++) {
-        w[i] = ntohl(b_p[i]);
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) == 0) {
+        return (0);
     }
 
-    for (i = 16; i < 80; i++) {
-        w[i] = rotateleft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    return ((ebx & bit_SHA) != 0);
+}
+
+/* Four SHA-1 rounds per instruction. The message schedule of the
+   following groups of four rounds is calculated in parallel. */
+#define HW_SHA1_ROUNDS4(i)                                              \
+    if ((i) == 0) {                                                     \
+        e[0] = _mm_add_epi32(e[0], m[0]);                               \
+    } else {                                                            \
+        e[(i) & 1] = _mm_sha1nexte_epu32(e[(i) & 1], m[(i) & 3]);       \
+    }                                                                   \
+    e[((i) + 1) & 1] = abcd;                                            \
+    if (((i) >= 3) && ((i) <= 18)) {                                    \
+        m[((i) + 1) & 3] = _mm_sha1msg2_epu32(m[((i) + 1) & 3],         \
+                                              m[(i) & 3]);              \
+    }                                                                   \
+    abcd = _mm_sha1rnds4_epu32(abcd, e[(i) & 1], (i) / 5);              \
+    if (((i) >= 1) && ((i) <= 16)) {                                    \
+        m[((i) + 3) & 3] = _mm_sha1msg1_epu32(m[((i) + 3) & 3],         \
+                                              m[(i) & 3]);              \
+    }                                                                   \
+    if (((i) >= 2) && ((i) <= 17)) {                                    \
+        m[((i) + 2) & 3] = _mm_xor_si128(m[((i) + 2) & 3], m[(i) & 3]); \
     }
 
-    a = self_p->h[0];
-    b = self_p->h[1];
-    c = self_p->h[2];
-    d = self_p->h[3];
-    e = self_p->h[4];
+__attribute__((target("sha,sse4.1,ssse3")))
+static void hw_sha1_compress(uint32_t *h_p,
+                             const uint8_t *b_p,
+                             size_t blocks)
+{
+    __m128i abcd, abcd_save, e_save, mask, e[2], m[4];
+    int i;
+
+    mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+    abcd = _mm_loadu_si128((const __m128i *)h_p);
+    abcd = _mm_shuffle_epi32(abcd, 0x1b);
+    e[0] = _mm_set_epi32(h_p[4], 0, 0, 0);
+
+    while (blocks > 0) {
+        abcd_save = abcd;
+        e_save = e[0];
+
+        for (i = 0; i < 4; i++) {
+            m[i] = _mm_loadu_si128((const __m128i *)&b_p[16 * i]);
+            m[i] = _mm_shuffle_epi8(m[i], mask);
+        }
 
-    for (i = 0; i < 20; i++) {
-        f = ((b & c) ^ (~b & d));
-        t = rotateleft(a, 5) + f + e + 0x5a827999 + w[i];
-        e = d;
-        d = c;
-        c = rotateleft(b, 30);
-        b = a;
-        a = t;
+        HW_SHA1_ROUNDS4(0);
+        HW_SHA1_ROUNDS4(1);
+        HW_SHA1_ROUNDS4(2);
+        HW_SHA1_ROUNDS4(3);
+        HW_SHA1_ROUNDS4(4);
+        HW_SHA1_ROUNDS4(5);
+        HW_SHA1_ROUNDS4(6);
+        HW_SHA1_ROUNDS4(7);
+        HW_SHA1_ROUNDS4(8);
+        HW_SHA1_ROUNDS4(9);
+        HW_SHA1_ROUNDS4(10);
+        HW_SHA1_ROUNDS4(11);
+        HW_SHA1_ROUNDS4(12);
+        HW_SHA1_ROUNDS4(13);
+        HW_SHA1_ROUNDS4(14);
+        HW_SHA1_ROUNDS4(15);
+        HW_SHA1_ROUNDS4(16);
+        HW_SHA1_ROUNDS4(17);
+        HW_SHA1_ROUNDS4(18);
+        HW_SHA1_ROUNDS4(19);
+
+        e[0] = _mm_sha1nexte_epu32(e[0], e_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+        b_p += 64;
+        blocks--;
     }
 
-    for (; i < 40; i++) {
-        f = (b ^ c ^ d);
-        t = rotateleft(a, 5) + f + e + 0x6ed9eba1 + w[i];
-        e = d;
-        d = c;
-        c = rotateleft(b, 30);
-        b = a;
-        a = t;
+    abcd = _mm_shuffle_epi32(abcd, 0x1b);
+    _mm_storeu_si128((__m128i *)h_p, abcd);
+    h_p[4] = _mm_extract_epi32(e[0], 3);
+}
+
+/* Four SHA-256 rounds, two per instruction. */
+#define HW_SHA256_ROUNDS4(i)                                            \
+    x = _mm_add_epi32(m[(i) & 3],                                       \
+                      _mm_loadu_si128((const __m128i *)&sha256_k[4 * (i)])); \
+    cdgh = _mm_sha256rnds2_epu32(cdgh, abef, x);                        \
+    if (((i) >= 3) && ((i) <= 14)) {                                    \
+        t = _mm_alignr_epi8(m[(i) & 3], m[((i) + 3) & 3], 4);           \
+        m[((i) + 1) & 3] = _mm_add_epi32(m[((i) + 1) & 3], t);          \
+        m[((i) + 1) & 3] = _mm_sha256msg2_epu32(m[((i) + 1) & 3],       \
+                                                m[(i) & 3]);            \
+    }                                                                   \
+    x = _mm_shuffle_epi32(x, 0x0e);                                     \
+    abef = _mm_sha256rnds2_epu32(abef, cdgh, x);                        \
+    if (((i) >= 1) && ((i) <= 12)) {                                    \
+        m[((i) + 3) & 3] = _mm_sha256msg1_epu32(m[((i) + 3) & 3],       \
+                                                m[(i) & 3]);            \
     }
 
-    for (; i < 60; i++) {
-        f = ((b & c) ^ (b & d) ^ (c & d));
-        t = rotateleft(a, 5) + f + e + 0x8f1bbcdc + w[i];
-        e = d;
-        d = c;
-        c = rotateleft(b, 30);
-        b = a;
-        a = t;
+__attribute__((target("sha,sse4.1,ssse3")))
+static void hw_sha256_compress(uint32_t *h_p,
+                               const uint8_t *b_p,
+                               size_t blocks)
+{
+    __m128i abef, cdgh, abef_save, cdgh_save, mask, x, t, m[4];
+    int i;
+
+    mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    /* The instructions use the state in the order ABEF and CDGH. */
+    t = _mm_loadu_si128((const __m128i *)&h_p[0]);
+    cdgh = _mm_loadu_si128((const __m128i *)&h_p[4]);
+    t = _mm_shuffle_epi32(t, 0xb1);
+    cdgh = _mm_shuffle_epi32(cdgh, 0x1b);
+    abef = _mm_alignr_epi8(t, cdgh, 8);
+    cdgh = _mm_blend_epi16(cdgh, t, 0xf0);
+
+    while (blocks > 0) {
+        abef_save = abef;
+        cdgh_save = cdgh;
+
+        for (i = 0; i < 4; i++) {
+            m[i] = _mm_loadu_si128((const __m128i *)&b_p[16 * i]);
+            m[i] = _mm_shuffle_epi8(m[i], mask);
+        }
+
+        HW_SHA256_ROUNDS4(0);
+        HW_SHA256_ROUNDS4(1);
+        HW_SHA256_ROUNDS4(2);
+        HW_SHA256_ROUNDS4(3);
+        HW_SHA256_ROUNDS4(4);
+        HW_SHA256_ROUNDS4(5);
+        HW_SHA256_ROUNDS4(6);
+        HW_SHA256_ROUNDS4(7);
+        HW_SHA256_ROUNDS4(8);
+        HW_SHA256_ROUNDS4(9);
+        HW_SHA256_ROUNDS4(10);
+        HW_SHA256_ROUNDS4(11);
+        HW_SHA256_ROUNDS4(12);
+        HW_SHA256_ROUNDS4(13);
+        HW_SHA256_ROUNDS4(14);
+        HW_SHA256_ROUNDS4(15);
+
+        abef = _mm_add_epi32(abef, abef_save);
+        cdgh = _mm_add_epi32(cdgh, cdgh_save);
+        b_p += 64;
+        blocks--;
     }
 
-    for (; i < 80; i++) {
-        f = (b ^ c ^ d);
-        t = rotateleft(a,5) + f + e + 0xca62c1d6 + w[i];
-        e = d;
-        d = c;
-        c = rotateleft(b, 30);
-        b = a;
-        a = t;
+    t = _mm_shuffle_epi32(abef, 0x1b);
+    cdgh = _mm_shuffle_epi32(cdgh, 0xb1);
+    abef = _mm_blend_epi16(t, cdgh, 0xf0);
+    cdgh = _mm_alignr_epi8(cdgh, t, 8);
+    _mm_storeu_si128((__m128i *)&h_p[0], abef);
+    _mm_storeu_si128((__m128i *)&h_p[4], cdgh);
+}
+
+#elif defined(HASH_HW_ARM)
+
+static int hw_is_available(void)
+{
+    unsigned long hwcap;
+
+    hwcap = getauxval(AT_HWCAP);
+
+    return (((hwcap & HWCAP_SHA1) != 0) && ((hwcap & HWCAP_SHA2) != 0));
+}
+
+__attribute__((target("+crypto")))
+static void hw_sha1_compress(uint32_t *h_p,
+                             const uint8_t *b_p,
+                             size_t blocks)
+{
+    static const uint32_t k[4] = {
+        0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xca62c1d6
+    };
+    uint32x4_t abcd, abcd_save, x, m[4];
+    uint32_t e, e_next, e_save;
+    int i;
+
+    abcd = vld1q_u32(h_p);
+    e = h_p[4];
+
+    while (blocks > 0) {
+        abcd_save = abcd;
+        e_save = e;
+
+        for (i = 0; i < 4; i++) {
+            m[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(&b_p[16 * i])));
+        }
+
+        for (i = 0; i < 20; i++) {
+            x = vaddq_u32(m[i & 3], vdupq_n_u32(k[i / 5]));
+            e_next = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+
+            if (i < 5) {
+                abcd = vsha1cq_u32(abcd, e, x);
+            } else if ((i >= 10) && (i < 15)) {
+                abcd = vsha1mq_u32(abcd, e, x);
+            } else {
+                abcd = vsha1pq_u32(abcd, e, x);
+            }
+
+            e = e_next;
+
+            if (i < 16) {
+                m[i & 3] = vsha1su1q_u32(vsha1su0q_u32(m[i & 3],
+                                                       m[(i + 1) & 3],
+                                                       m[(i + 2) & 3]),
+                                         m[(i + 3) & 3]);
+            }
+        }
+
+        abcd = vaddq_u32(abcd, abcd_save);
+        e += e_save;
+        b_p += 64;
+        blocks--;
     }
 
-    self_p->h[0] += a;
-    self_p->h[1] += b;
-    self_p->h[2] += c;
-    self_p->h[3] += d;
-    self_p->h[4] += e;
+    vst1q_u32(h_p, abcd);
+    h_p[4] = e;
+}
+
+__attribute__((target("+crypto")))
+static void hw_sha256_compress(uint32_t *h_p,
+                               const uint8_t *b_p,
+                               size_t blocks)
+{
+    uint32x4_t abcd, efgh, abcd_save, efgh_save, x, t, m[4];
+    int i;
+
+    abcd = vld1q_u32(&h_p[0]);
+    efgh = vld1q_u32(&h_p[4]);
+
+    while (blocks > 0) {
+        abcd_save = abcd;
+        efgh_save = efgh;
+
+        for (i = 0; i < 4; i++) {
+            m[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(&b_p[16 * i])));
+        }
+
+        for (i = 0; i < 16; i++) {
+            x = vaddq_u32(m[i & 3], vld1q_u32(&sha256_k[4 * i]));
+
+            if (i < 12) {
+                m[i & 3] = vsha256su1q_u32(vsha256su0q_u32(m[i & 3],
+                                                           m[(i + 1) & 3]),
+                                           m[(i + 2) & 3],
+                                           m[(i + 3) & 3]);
+            }
+
+            t = abcd;
+            abcd = vsha256hq_u32(abcd, efgh, x);
+            efgh = vsha256h2q_u32(efgh, t, x);
+        }
+
+        abcd = vaddq_u32(abcd, abcd_save);
+        efgh = vaddq_u32(efgh, efgh_save);
+        b_p += 64;
+        blocks--;
+    }
+
+    vst1q_u32(&h_p[0], abcd);
+    vst1q_u32(&h_p[4], efgh);
+}
+
+#endif
+
+#if defined(HASH_HW_X86) || defined(HASH_HW_ARM)
+
+/* One(1) if the CPU has SHA instructions, zero(0) if not and minus
+   one(-1) before the first object is initialized. */
+static int hw_available = -1;
+
+static void detect_hw(void)
+{
+    if (hw_available == -1) {
+        hw_available = hw_is_available();
+    }
+}
+
+static void sha1_compress(uint32_t *h_p, const uint8_t *b_p, size_t blocks)
+{
+    if (hw_available == 1) {
+        hw_sha1_compress(h_p, b_p, blocks);
+    } else {
+        sw_sha1_compress(h_p, b_p, blocks);
+    }
+}
+
+static void sha256_compress(uint32_t *h_p, const uint8_t *b_p, size_t blocks)
+{
+    if (hw_available == 1) {
+        hw_sha256_compress(h_p, b_p, blocks);
+    } else {
+        sw_sha256_compress(h_p, b_p, blocks);
+    }
+}
+
+#else
+
+#    define hw_available 0
+#    define detect_hw()
+#    define sha1_compress sw_sha1_compress
+#    define sha256_compress sw_sha256_compress
+
+#endif
+
+/**
+ * Buffer given data and compress all complete blocks.
+ */
+static void update(uint8_t *block_p,
+                   uint32_t *block_size_p,
+                   uint64_t *size_p,
+                   uint32_t *h_p,
+                   compress_t compress,
+                   const uint8_t *b_p,
+                   size_t size)
+{
+    size_t temp;
+
+    *size_p += size;
+
+    /* Prologue: Fill the buffer. */
+    if (*block_size_p > 0) {
+        temp = MIN(64 - *block_size_p, size);
+        memcpy(&block_p[*block_size_p], b_p, temp);
+        *block_size_p += temp;
+        size -= temp;
+        b_p += temp;
+
+        if (*block_size_p < 64) {
+            return;
+        }
+
+        compress(h_p, block_p, 1);
+        *block_size_p = 0;
+    }
+
+    /* Main loop. Complete blocks are compressed in place. */
+    if (size >= 64) {
+        compress(h_p, b_p, size / 64);
+        b_p += (size & ~63ul);
+        size &= 63;
+    }
+
+    /* Epilogue: Save left over block in buffer. */
+    if (size > 0) {
+        memcpy(block_p, b_p, size);
+        *block_size_p = size;
+    }
+}
+
+/**
+ * Add the last byte 0x80, zero-padding and the message length, and
+ * write the big endian hash.
+ */
+static void digest(uint8_t *block_p,
+                   uint32_t block_size,
+                   uint64_t size,
+                   uint32_t *h_p,
+                   int length,
+                   compress_t compress,
+                   uint8_t *hash_p)
+{
+    int i;
+
+    i = block_size;
+    block_p[i++] = 0x80;
+
+    if (i > 56) {
+        memset(&block_p[i], 0, 64 - i);
+        compress(h_p, block_p, 1);
+        i = 0;
+    }
+
+    memset(&block_p[i], 0, 56 - i);
+
+    for (i = 0; i < 8; i++) {
+        block_p[56 + i] = ((8 * size) >> (56 - 8 * i));
+    }
+
+    compress(h_p, block_p, 1);
+
+    for (i = 0; i < length; i++) {
+        hash_p[4 * i + 0] = (h_p[i] >> 24);
+        hash_p[4 * i + 1] = (h_p[i] >> 16);
+        hash_p[4 * i + 2] = (h_p[i] >> 8);
+        hash_p[4 * i + 3] = (h_p[i] >> 0);
+    }
 }
 
 int hash_sha1_init(struct hash_sha1_t *self_p)
 {
+    detect_hw();
+
     self_p->block.size = 0;
     self_p->h[0] = 0x67452301;
     self_p->h[1] = 0xefcdab89;
@@ -107,81 +736,184 @@ int hash_sha1_init(struct hash_sha1_t *self_p)
 }
 
 int hash_sha1_update(struct hash_sha1_t *self_p,
-                     void *buf_p,
+                     const void *buf_p,
                      size_t size)
 {
-    uint32_t temp;
-    uint8_t *b_p = buf_p;
+    update(self_p->block.buf,
+           &self_p->block.size,
+           &self_p->size,
+           self_p->h,
+           sha1_compress,
+           buf_p,
+           size);
 
-    self_p->size += size;
+    return (0);
+}
 
-    /* Prologue: Fill the buffer. */
-    if (self_p->block.size > 0) {
-        if ((self_p->block.size + size) >= 64) {
-            temp = (64 - self_p->block.size);
-            memcpy(&self_p->block.buf[self_p->block.size], b_p, temp);
-            size -= temp;
-            b_p += temp;
-            block_update(self_p, self_p->block.buf);
-            self_p->block.size = 0;
-        }
-    }
+int hash_sha1_digest(struct hash_sha1_t *self_p,
+                     uint8_t *hash_p)
+{
+    digest(self_p->block.buf,
+           self_p->block.size,
+           self_p->size,
+           self_p->h,
+           membersof(self_p->h),
+           sha1_compress,
+           hash_p);
 
-    /* Main loop. */
-    while (size >= 64) {
-        memcpy(&self_p->block.buf[0], b_p, 64);
-        block_update(self_p, self_p->block.buf);
-        size -= 64;
-        b_p += 64;
-    }
+    return (0);
+}
 
-    /* Epilogue: Save left over block in buffer. */
-    if (size > 0) {
-        memcpy(&self_p->block.buf[self_p->block.size], b_p, size);
-        self_p->block.size += size;
-    }
+int hash_sha256_init(struct hash_sha256_t *self_p)
+{
+    detect_hw();
+
+    self_p->block.size = 0;
+    self_p->h[0] = 0x6a09e667;
+    self_p->h[1] = 0xbb67ae85;
+    self_p->h[2] = 0x3c6ef372;
+    self_p->h[3] = 0xa54ff53a;
+    self_p->h[4] = 0x510e527f;
+    self_p->h[5] = 0x9b05688c;
+    self_p->h[6] = 0x1f83d9ab;
+    self_p->h[7] = 0x5be0cd19;
+    self_p->size = 0;
 
     return (0);
 }
 
-int hash_sha1_digest(struct hash_sha1_t *self_p,
-                     uint8_t *hash_p)
+int hash_sha256_update(struct hash_sha256_t *self_p,
+                       const void *buf_p,
+                       size_t size)
 {
+    update(self_p->block.buf,
+           &self_p->block.size,
+           &self_p->size,
+           self_p->h,
+           sha256_compress,
+           buf_p,
+           size);
+
+    return (0);
+}
+
+int hash_sha256_update_multi(struct hash_sha256_t *selves_pp[],
+                             const void *bufs_pp[],
+                             size_t size,
+                             int length)
+{
+    uint32_t *h_pp[HASH_MULTI_LANES];
+    const uint8_t *b_pp[HASH_MULTI_LANES];
+    size_t blocks;
     int i;
+    int l;
 
-    i = self_p->block.size;
+    i = 0;
+    blocks = (size / 64);
 
-    /* Add the last byte 0x80 and zero-padding. */
-    if (self_p->block.size < 56) {
-        self_p->block.buf[i++] = 0x80;
+    /* Interleave groups of streams with no buffered data. The SHA
+       instructions are faster one stream at a time. */
+    if ((hw_available != 1) && (blocks > 0)) {
+        while (i + HASH_MULTI_LANES <= length) {
+            for (l = 0; l < HASH_MULTI_LANES; l++) {
+                if (selves_pp[i + l]->block.size != 0) {
+                    break;
+                }
+            }
 
-        if (i < 56) {
-            memset(&self_p->block.buf[i], 0, 56 - i);
-        }
-    } else {
-        self_p->block.buf[i++] = 0x80;
+            if (l < HASH_MULTI_LANES) {
+                break;
+            }
 
-        if (i < 64) {
-            memset(&self_p->block.buf[i], 0, 64 - i);
+            for (l = 0; l < HASH_MULTI_LANES; l++) {
+                h_pp[l] = selves_pp[i + l]->h;
+                b_pp[l] = bufs_pp[i + l];
+            }
+
+            sw_sha256_compress_multi(h_pp, b_pp, blocks);
+
+            for (l = 0; l < HASH_MULTI_LANES; l++) {
+                selves_pp[i + l]->size += (64 * blocks);
+                hash_sha256_update(selves_pp[i + l],
+                                   b_pp[l],
+                                   size - 64 * blocks);
+            }
+
+            i += HASH_MULTI_LANES;
         }
+    }
 
-        block_update(self_p, self_p->block.buf);
-        memset(self_p->block.buf, 0, 56);
+    /* Remaining streams. */
+    for (; i < length; i++) {
+        hash_sha256_update(selves_pp[i], bufs_pp[i], size);
     }
 
-    /* Append the message length and do the last block update. */
-    for (i = 0; i < 8; i++) {
-        self_p->block.buf[56 + i] = ((8 * self_p->size) >> (56 - 8 * i));
+    return (0);
+}
+
+int hash_sha256_digest(struct hash_sha256_t *self_p,
+                       uint8_t *hash_p)
+{
+    digest(self_p->block.buf,
+           self_p->block.size,
+           self_p->size,
+           self_p->h,
+           membersof(self_p->h),
+           sha256_compress,
+           hash_p);
+
+    return (0);
+}
+
+int hash_hmac_sha256_init(struct hash_hmac_sha256_t *self_p,
+                          const void *key_p,
+                          size_t key_size)
+{
+    uint8_t pad[64];
+    int i;
+
+    memset(pad, 0, sizeof(pad));
+
+    /* Long keys are replaced by their hash. */
+    if (key_size > sizeof(pad)) {
+        hash_sha256_init(&self_p->inner);
+        hash_sha256_update(&self_p->inner, key_p, key_size);
+        hash_sha256_digest(&self_p->inner, pad);
+    } else {
+        memcpy(pad, key_p, key_size);
     }
 
-    block_update(self_p, self_p->block.buf);
+    for (i = 0; i < sizeof(pad); i++) {
+        pad[i] ^= 0x36;
+    }
+
+    hash_sha256_init(&self_p->inner);
+    hash_sha256_update(&self_p->inner, pad, sizeof(pad));
 
-    /* Copy the hash to the output buffer. */
-    for (i = 0; i < membersof(self_p->h); i++) {
-        self_p->h[i] = htonl(self_p->h[i]);
+    for (i = 0; i < sizeof(pad); i++) {
+        pad[i] ^= (0x36 ^ 0x5c);
     }
 
-    memcpy(hash_p, self_p->h, 20);
+    hash_sha256_init(&self_p->outer);
+    hash_sha256_update(&self_p->outer, pad, sizeof(pad));
 
     return (0);
 }
+
+int hash_hmac_sha256_update(struct hash_hmac_sha256_t *self_p,
+                            const void *buf_p,
+                            size_t size)
+{
+    return (hash_sha256_update(&self_p->inner, buf_p, size));
+}
+
+int hash_hmac_sha256_digest(struct hash_hmac_sha256_t *self_p,
+                            uint8_t *mac_p)
+{
+    uint8_t hash[32];
+
+    hash_sha256_digest(&self_p->inner, hash);
+    hash_sha256_update(&self_p->outer, hash, sizeof(hash));
+
+    return (hash_sha256_digest(&self_p->outer, mac_p));
+}
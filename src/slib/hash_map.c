@@ -58,7 +58,14 @@ int hash_map_init(struct hash_map_t *self_p,
         buckets_p[i].list_p = NULL;
     }
 
-    /* Initialize entries free list. */
+    /* Initialize entries free list. An empty free list makes all
+       additions fail with -ENOMEM. */
+    if (entries_max == 0) {
+        self_p->entries_p = NULL;
+
+        return (0);
+    }
+
     self_p->entries_p = entries_p;
 
     for (i = 0; i < entries_max - 1; i++) {
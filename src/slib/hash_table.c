@@ -0,0 +1,290 @@
+/**
+ * @file hash_table.c
+ * @version 0.5.0
+ *
+ * @section License
+ * Copyright (C) 2014-2016, Erik Moqvist
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Simba project.
+ */
+
+#include "simba.h"
+
+/**
+ * 32 bits FNV-1a hash of given key.
+ */
+static uint32_t hash_key(const void *key_p, size_t key_size)
+{
+    const uint8_t *k_p;
+    uint32_t hash;
+
+    k_p = key_p;
+    hash = 2166136261UL;
+
+    while (key_size > 0) {
+        hash ^= *k_p++;
+        hash *= 16777619UL;
+        key_size--;
+    }
+
+    return (hash);
+}
+
+static int is_power_of_two(size_t length)
+{
+    return ((length > 0) && ((length & (length - 1)) == 0));
+}
+
+/**
+ * Returns the index of given key, or -1 if the key is not in the
+ * table. The probe stops at the first entry closer to its home slot
+ * than the key would be, as the key would have displaced it.
+ */
+static ssize_t find(struct hash_table_t *self_p,
+                    const void *key_p,
+                    size_t key_size,
+                    uint32_t hash)
+{
+    struct hash_table_entry_t *entry_p;
+    size_t index;
+    uint16_t distance;
+
+    index = (hash & self_p->mask);
+    distance = 1;
+
+    while (1) {
+        entry_p = &self_p->entries_p[index];
+
+        if (entry_p->distance < distance) {
+            return (-1);
+        }
+
+        if ((entry_p->hash == hash)
+            && (entry_p->key_size == key_size)
+            && (memcmp(entry_p->key_p, key_p, key_size) == 0)) {
+            return (index);
+        }
+
+        index = ((index + 1) & self_p->mask);
+        distance++;
+    }
+}
+
+/**
+ * Insert given entry, which is not in the table. Entries closer to
+ * their home slot are moved forward to make room for entries further
+ * away from theirs.
+ */
+static void insert(struct hash_table_t *self_p,
+                   struct hash_table_entry_t *entry_p)
+{
+    struct hash_table_entry_t entry;
+    struct hash_table_entry_t tmp;
+    size_t index;
+
+    entry = *entry_p;
+    entry.distance = 1;
+    index = (entry.hash & self_p->mask);
+
+    while (self_p->entries_p[index].distance != 0) {
+        if (self_p->entries_p[index].distance < entry.distance) {
+            tmp = self_p->entries_p[index];
+            self_p->entries_p[index] = entry;
+            entry = tmp;
+        }
+
+        index = ((index + 1) & self_p->mask);
+        entry.distance++;
+    }
+
+    self_p->entries_p[index] = entry;
+}
+
+static void clear(struct hash_table_entry_t *entries_p,
+                  size_t length)
+{
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+        entries_p[i].distance = 0;
+    }
+}
+
+int hash_table_init(struct hash_table_t *self_p,
+                    struct hash_table_entry_t *entries_p,
+                    size_t length,
+                    hash_table_full_fn_t on_full,
+                    void *arg_p)
+{
+    if (!is_power_of_two(length)) {
+        return (-EINVAL);
+    }
+
+    self_p->entries_p = entries_p;
+    self_p->mask = (length - 1);
+    self_p->length = 0;
+    self_p->length_max = (length - length / 8);
+    self_p->on_full = on_full;
+    self_p->arg_p = arg_p;
+    clear(entries_p, length);
+
+    return (0);
+}
+
+int hash_table_resize(struct hash_table_t *self_p,
+                      struct hash_table_entry_t *entries_p,
+                      size_t length)
+{
+    struct hash_table_entry_t *old_entries_p;
+    size_t old_length;
+    size_t i;
+
+    if (!is_power_of_two(length)) {
+        return (-EINVAL);
+    }
+
+    if ((length - length / 8) < self_p->length) {
+        return (-EINVAL);
+    }
+
+    old_entries_p = self_p->entries_p;
+    old_length = (self_p->mask + 1);
+
+    self_p->entries_p = entries_p;
+    self_p->mask = (length - 1);
+    self_p->length_max = (length - length / 8);
+    clear(entries_p, length);
+
+    for (i = 0; i < old_length; i++) {
+        if (old_entries_p[i].distance != 0) {
+            insert(self_p, &old_entries_p[i]);
+        }
+    }
+
+    return (0);
+}
+
+int hash_table_add(struct hash_table_t *self_p,
+                   const void *key_p,
+                   size_t key_size,
+                   void *value_p)
+{
+    struct hash_table_entry_t entry;
+    uint32_t hash;
+    ssize_t index;
+
+    if (key_size > 0xffff) {
+        return (-EINVAL);
+    }
+
+    hash = hash_key(key_p, key_size);
+    index = find(self_p, key_p, key_size, hash);
+
+    /* Is the key already in the table? */
+    if (index >= 0) {
+        self_p->entries_p[index].value_p = value_p;
+
+        return (0);
+    }
+
+    /* Let the user grow the table. */
+    if (self_p->length == self_p->length_max) {
+        if (self_p->on_full != NULL) {
+            self_p->on_full(self_p, self_p->arg_p);
+        }
+
+        if (self_p->length >= self_p->length_max) {
+            return (-ENOMEM);
+        }
+    }
+
+    entry.key_p = key_p;
+    entry.key_size = key_size;
+    entry.value_p = value_p;
+    entry.hash = hash;
+    insert(self_p, &entry);
+    self_p->length++;
+
+    return (0);
+}
+
+int hash_table_remove(struct hash_table_t *self_p,
+                      const void *key_p,
+                      size_t key_size)
+{
+    struct hash_table_entry_t *entries_p;
+    ssize_t index;
+    size_t next;
+
+    index = find(self_p, key_p, key_size, hash_key(key_p, key_size));
+
+    if (index < 0) {
+        return (-1);
+    }
+
+    /* Shift following entries back one step until an entry in its
+       home slot or an unused entry is found. No tombstones are
+       needed. */
+    entries_p = self_p->entries_p;
+    next = ((index + 1) & self_p->mask);
+
+    while (entries_p[next].distance > 1) {
+        entries_p[index] = entries_p[next];
+        entries_p[index].distance--;
+        index = next;
+        next = ((next + 1) & self_p->mask);
+    }
+
+    entries_p[index].distance = 0;
+    self_p->length--;
+
+    return (0);
+}
+
+void *hash_table_get(struct hash_table_t *self_p,
+                     const void *key_p,
+                     size_t key_size)
+{
+    ssize_t index;
+
+    index = find(self_p, key_p, key_size, hash_key(key_p, key_size));
+
+    if (index < 0) {
+        return (NULL);
+    }
+
+    return (self_p->entries_p[index].value_p);
+}
+
+struct hash_table_entry_t *hash_table_next(struct hash_table_t *self_p,
+                                           size_t *index_p)
+{
+    size_t index;
+
+    for (index = *index_p; index <= self_p->mask; index++) {
+        if (self_p->entries_p[index].distance != 0) {
+            *index_p = (index + 1);
+
+            return (&self_p->entries_p[index]);
+        }
+    }
+
+    *index_p = index;
+
+    return (NULL);
+}
+
+size_t hash_table_size(struct hash_table_t *self_p)
+{
+    return (self_p->length);
+}
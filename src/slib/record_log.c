@@ -0,0 +1,530 @@
+/**
+ * @file record_log.c
+ * @version 0.5.0
+ *
+ * @section License
+ * Copyright (C) 2016, Erik Moqvist
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Simba project.
+ */
+
+/*
+ * Storage layout
+ * --------------
+ *
+ * The first block of each segment is a header with the segment
+ * sequence number. The sequence number is incremented each time the
+ * log moves on to the next segment. The following blocks are filled
+ * with records. A record never spans two blocks and the unused end
+ * of a block is zero.
+ *
+ * The CRC of a record covers the sequence number of its segment, so
+ * records left in a segment from an earlier round are not valid.
+ */
+
+#include "simba.h"
+
+#define BLOCK_SIZE RECORD_LOG_BLOCK_SIZE
+#define HEADER_SIZE RECORD_LOG_RECORD_HEADER_SIZE
+
+#define SEGMENT_MAGIC 0x474c5253
+
+struct segment_header_t {
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t crc;
+};
+
+struct record_header_t {
+    uint16_t size;
+    uint16_t reserved;
+    uint32_t crc;
+};
+
+static uint32_t block_address(struct record_log_t *self_p,
+                              size_t segment,
+                              size_t block)
+{
+    return (self_p->start_block + segment * self_p->segment_length + block);
+}
+
+static uint32_t record_crc(uint32_t sequence,
+                           const struct record_header_t *header_p,
+                           const void *buf_p)
+{
+    uint32_t crc;
+
+    crc = crc_32(0, &sequence, sizeof(sequence));
+    crc = crc_32(crc, header_p, offsetof(struct record_header_t, crc));
+
+    return (crc_32(crc, buf_p, header_p->size));
+}
+
+/**
+ * Returns the size of the valid record at given offset in given
+ * block, or negative error code if there is no valid record.
+ */
+static ssize_t record_parse(uint32_t sequence,
+                            const uint8_t *block_p,
+                            size_t offset)
+{
+    struct record_header_t header;
+
+    if (offset + HEADER_SIZE > BLOCK_SIZE) {
+        return (-1);
+    }
+
+    memcpy(&header, &block_p[offset], sizeof(header));
+
+    if ((header.size == 0)
+        || (header.size > BLOCK_SIZE - offset - HEADER_SIZE)) {
+        return (-1);
+    }
+
+    if (record_crc(sequence, &header, &block_p[offset + HEADER_SIZE])
+        != header.crc) {
+        return (-1);
+    }
+
+    return (header.size);
+}
+
+static int read_block(struct record_log_t *self_p,
+                      void *dst_p,
+                      size_t segment,
+                      size_t block)
+{
+    if (self_p->read(self_p->arg_p,
+                     dst_p,
+                     block_address(self_p, segment, block),
+                     1) != BLOCK_SIZE) {
+        return (-EIO);
+    }
+
+    return (0);
+}
+
+/**
+ * Read the sequence number of given segment.
+ */
+static int read_segment_header(struct record_log_t *self_p,
+                               uint8_t *buf_p,
+                               size_t segment,
+                               uint32_t *sequence_p)
+{
+    struct segment_header_t header;
+
+    if (read_block(self_p, buf_p, segment, 0) != 0) {
+        return (-EIO);
+    }
+
+    memcpy(&header, buf_p, sizeof(header));
+
+    if ((header.magic != SEGMENT_MAGIC)
+        || (crc_32(0, &header, offsetof(struct segment_header_t, crc))
+            != header.crc)) {
+        return (-1);
+    }
+
+    *sequence_p = header.sequence;
+
+    return (0);
+}
+
+/**
+ * Write the buffered blocks up to and including the current block to
+ * the storage with a single write.
+ */
+static int buffer_write(struct record_log_t *self_p)
+{
+    size_t count;
+
+    if (self_p->buffer.uncommitted == 0) {
+        return (0);
+    }
+
+    count = (self_p->buffer.index + 1);
+
+    if (self_p->write(self_p->arg_p,
+                      block_address(self_p,
+                                    self_p->segment,
+                                    self_p->buffer.block),
+                      self_p->buffer.buf_p,
+                      count) != BLOCK_SIZE * count) {
+        return (-EIO);
+    }
+
+    self_p->buffer.uncommitted = 0;
+
+    return (0);
+}
+
+static void buffer_reset(struct record_log_t *self_p, size_t block)
+{
+    memset(self_p->buffer.buf_p, 0, BLOCK_SIZE * self_p->buffer.length);
+    self_p->buffer.block = block;
+    self_p->buffer.index = 0;
+    self_p->buffer.offset = 0;
+}
+
+/**
+ * Start writing to the next segment, overwriting its records.
+ */
+static int rotate(struct record_log_t *self_p)
+{
+    struct segment_header_t header;
+
+    self_p->segment++;
+    self_p->segment %= self_p->segments;
+    self_p->sequence++;
+
+    header.magic = SEGMENT_MAGIC;
+    header.sequence = self_p->sequence;
+    header.crc = crc_32(0, &header, offsetof(struct segment_header_t, crc));
+
+    buffer_reset(self_p, 0);
+    memcpy(self_p->buffer.buf_p, &header, sizeof(header));
+
+    if (self_p->write(self_p->arg_p,
+                      block_address(self_p, self_p->segment, 0),
+                      self_p->buffer.buf_p,
+                      1) != BLOCK_SIZE) {
+        return (-EIO);
+    }
+
+    buffer_reset(self_p, 1);
+
+    return (0);
+}
+
+/**
+ * Move on to the next block, writing the buffer to the storage if it
+ * is full.
+ */
+static int next_block(struct record_log_t *self_p)
+{
+    if (self_p->buffer.block + self_p->buffer.index + 1
+        == self_p->segment_length) {
+        if (buffer_write(self_p) != 0) {
+            return (-EIO);
+        }
+
+        return (rotate(self_p));
+    }
+
+    if (self_p->buffer.index + 1 == self_p->buffer.length) {
+        if (buffer_write(self_p) != 0) {
+            return (-EIO);
+        }
+
+        buffer_reset(self_p,
+                     self_p->buffer.block + self_p->buffer.index + 1);
+    } else {
+        self_p->buffer.index++;
+        self_p->buffer.offset = 0;
+    }
+
+    return (0);
+}
+
+int record_log_init(struct record_log_t *self_p,
+                    record_log_read_t read,
+                    record_log_write_t write,
+                    void *arg_p,
+                    uint32_t start_block,
+                    size_t segments,
+                    size_t segment_length,
+                    void *buf_p,
+                    size_t size)
+{
+    if ((segments < 2) || (segment_length < 2) || (size < BLOCK_SIZE)) {
+        return (-EINVAL);
+    }
+
+    self_p->read = read;
+    self_p->write = write;
+    self_p->arg_p = arg_p;
+    self_p->start_block = start_block;
+    self_p->segments = segments;
+    self_p->segment_length = segment_length;
+    self_p->segment = 0;
+    self_p->sequence = 0;
+    self_p->buffer.buf_p = buf_p;
+    self_p->buffer.length = (size / BLOCK_SIZE);
+    self_p->buffer.uncommitted = 0;
+    buffer_reset(self_p, 1);
+
+    return (0);
+}
+
+int record_log_start(struct record_log_t *self_p)
+{
+    uint8_t *buf_p;
+    uint32_t sequence;
+    size_t segment;
+    size_t block;
+    size_t offset;
+    ssize_t size;
+    size_t last_block;
+    size_t last_offset;
+    int found;
+
+    buf_p = self_p->buffer.buf_p;
+    found = 0;
+
+    /* The segment with the highest sequence number is written to. */
+    for (segment = 0; segment < self_p->segments; segment++) {
+        if (read_segment_header(self_p, buf_p, segment, &sequence) != 0) {
+            continue;
+        }
+
+        if (!found || ((int32_t)(sequence - self_p->sequence) > 0)) {
+            self_p->segment = segment;
+            self_p->sequence = sequence;
+            found = 1;
+        }
+    }
+
+    if (!found) {
+        return (record_log_format(self_p));
+    }
+
+    /* Find the end of the log. It is in the last block with valid
+       records. */
+    last_block = 0;
+    last_offset = 0;
+
+    for (block = 1; block < self_p->segment_length; block++) {
+        if (read_block(self_p, buf_p, self_p->segment, block) != 0) {
+            return (-EIO);
+        }
+
+        offset = 0;
+
+        while ((size = record_parse(self_p->sequence, buf_p, offset)) > 0) {
+            offset += (HEADER_SIZE + size);
+        }
+
+        if (offset == 0) {
+            break;
+        }
+
+        last_block = block;
+        last_offset = offset;
+    }
+
+    self_p->buffer.uncommitted = 0;
+
+    if (last_block == 0) {
+        buffer_reset(self_p, 1);
+    } else {
+        /* Continue appending to the last block. */
+        buffer_reset(self_p, last_block);
+
+        if (read_block(self_p, buf_p, self_p->segment, last_block) != 0) {
+            return (-EIO);
+        }
+
+        memset(&buf_p[last_offset], 0, BLOCK_SIZE - last_offset);
+        self_p->buffer.offset = last_offset;
+    }
+
+    return (0);
+}
+
+int record_log_format(struct record_log_t *self_p)
+{
+    uint8_t *buf_p;
+    uint32_t sequence;
+    uint32_t sequence_max;
+    size_t segment;
+
+    buf_p = self_p->buffer.buf_p;
+
+    /* The new sequence number must be higher than all earlier so
+       records written before the format are not valid. */
+    sequence_max = 0;
+
+    for (segment = 0; segment < self_p->segments; segment++) {
+        if (read_segment_header(self_p, buf_p, segment, &sequence) != 0) {
+            continue;
+        }
+
+        if ((int32_t)(sequence - sequence_max) > 0) {
+            sequence_max = sequence;
+        }
+    }
+
+    /* Clear all segment headers but the first, which is overwritten
+       by rotate(). */
+    memset(buf_p, 0, BLOCK_SIZE);
+
+    for (segment = 1; segment < self_p->segments; segment++) {
+        if (self_p->write(self_p->arg_p,
+                          block_address(self_p, segment, 0),
+                          buf_p,
+                          1) != BLOCK_SIZE) {
+            return (-EIO);
+        }
+    }
+
+    self_p->segment = (self_p->segments - 1);
+    self_p->sequence = sequence_max;
+    self_p->buffer.uncommitted = 0;
+
+    return (rotate(self_p));
+}
+
+int record_log_append(struct record_log_t *self_p,
+                      const void *buf_p,
+                      size_t size)
+{
+    struct record_header_t header;
+    uint8_t *block_p;
+
+    if ((size == 0) || (size > RECORD_LOG_RECORD_SIZE_MAX)) {
+        return (-EINVAL);
+    }
+
+    if (self_p->buffer.offset + HEADER_SIZE + size > BLOCK_SIZE) {
+        if (next_block(self_p) != 0) {
+            return (-EIO);
+        }
+    }
+
+    header.size = size;
+    header.reserved = 0;
+    header.crc = record_crc(self_p->sequence, &header, buf_p);
+
+    block_p = &self_p->buffer.buf_p[BLOCK_SIZE * self_p->buffer.index];
+    memcpy(&block_p[self_p->buffer.offset], &header, sizeof(header));
+    memcpy(&block_p[self_p->buffer.offset + HEADER_SIZE], buf_p, size);
+    self_p->buffer.offset += (HEADER_SIZE + size);
+    self_p->buffer.uncommitted++;
+
+    return (0);
+}
+
+int record_log_commit(struct record_log_t *self_p)
+{
+    uint8_t *buf_p;
+
+    if (buffer_write(self_p) != 0) {
+        return (-EIO);
+    }
+
+    /* Keep the current block in the buffer. It is written again with
+       the records appended to it. */
+    if (self_p->buffer.index > 0) {
+        buf_p = self_p->buffer.buf_p;
+        memcpy(buf_p, &buf_p[BLOCK_SIZE * self_p->buffer.index], BLOCK_SIZE);
+        memset(&buf_p[BLOCK_SIZE],
+               0,
+               BLOCK_SIZE * (self_p->buffer.length - 1));
+        self_p->buffer.block += self_p->buffer.index;
+        self_p->buffer.index = 0;
+    }
+
+    return (0);
+}
+
+int record_log_iter_init(struct record_log_iter_t *self_p,
+                         struct record_log_t *log_p)
+{
+    if (record_log_commit(log_p) != 0) {
+        return (-EIO);
+    }
+
+    self_p->log_p = log_p;
+    self_p->segments_left = log_p->segments;
+    self_p->segment = ((log_p->segment + 1) % log_p->segments);
+    self_p->block = 0;
+    self_p->offset = 0;
+
+    return (0);
+}
+
+ssize_t record_log_iter_read(struct record_log_iter_t *self_p,
+                             void *buf_p,
+                             size_t size)
+{
+    struct record_log_t *log_p;
+    uint32_t sequence;
+    ssize_t res;
+
+    log_p = self_p->log_p;
+
+    while (1) {
+        /* Start reading a segment. */
+        if (self_p->block == 0) {
+            if (self_p->segments_left == 0) {
+                return (0);
+            }
+
+            self_p->segments_left--;
+            res = read_segment_header(log_p,
+                                      self_p->buf,
+                                      self_p->segment,
+                                      &sequence);
+
+            if (res == -EIO) {
+                return (res);
+            }
+
+            /* Only segments written in the current round. */
+            if ((res != 0)
+                || ((int32_t)(log_p->sequence - sequence) < 0)
+                || (log_p->sequence - sequence >= log_p->segments)) {
+                self_p->segment = ((self_p->segment + 1) % log_p->segments);
+                continue;
+            }
+
+            self_p->sequence = sequence;
+            self_p->block = 1;
+            self_p->offset = 0;
+
+            if (read_block(log_p, self_p->buf, self_p->segment, 1) != 0) {
+                return (-EIO);
+            }
+        }
+
+        res = record_parse(self_p->sequence, self_p->buf, self_p->offset);
+
+        if (res > 0) {
+            if (res > size) {
+                return (-ENOMEM);
+            }
+
+            memcpy(buf_p, &self_p->buf[self_p->offset + HEADER_SIZE], res);
+            self_p->offset += (HEADER_SIZE + res);
+
+            return (res);
+        }
+
+        /* An empty block ends the segment. */
+        if ((self_p->offset == 0)
+            || (self_p->block + 1 == log_p->segment_length)) {
+            self_p->block = 0;
+            self_p->segment = ((self_p->segment + 1) % log_p->segments);
+            continue;
+        }
+
+        self_p->block++;
+        self_p->offset = 0;
+
+        if (read_block(log_p, self_p->buf, self_p->segment, self_p->block)
+            != 0) {
+            return (-EIO);
+        }
+    }
+}
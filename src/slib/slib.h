@@ -22,10 +22,13 @@
 #define __SLIB_H__
 
 #include "slib/crc.h"
+#include "slib/deflate.h"
 #include "slib/fat16.h"
 #include "slib/harness.h"
 #include "slib/hash_map.h"
+#include "slib/hash_table.h"
 #include "slib/midi.h"
+#include "slib/record_log.h"
 #include "slib/base64.h"
 #include "slib/hash.h"
 
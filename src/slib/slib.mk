@@ -22,11 +22,14 @@
 INC += $(SIMBA_ROOT)/src/slib
 
 SLIB_SRC ?= base64.c \
+            deflate.c \
             crc.c \
             fat16.c \
             harness.c \
             hash.c \
             hash_map.c \
-            midi.c
+            hash_table.c \
+            midi.c \
+            record_log.c
 
 SRC += $(SLIB_SRC:%=$(SIMBA_ROOT)/src/slib/%)
@@ -23,10 +23,52 @@
 
 #include "simba.h"
 
+/** The standard alphabet, with ``+`` and ``/``. */
+#define BASE64_ALPHABET_STANDARD                            0
+/** The URL and filename safe alphabet, with ``-`` and ``_``. */
+#define BASE64_ALPHABET_URL                                 1
+
+/** Size of the encoded data of given number of bytes. */
+#define BASE64_ENCODED_SIZE(size) (4 * (((size) + 2) / 3))
+
+/**
+ * Streaming encoder. Data written to the encoder is encoded and
+ * written to the output channel.
+ */
+struct base64_encoder_t {
+    struct chan_t base;
+    struct chan_t *chan_p;
+    int alphabet;
+    /* Bytes not yet encoded. */
+    struct {
+        uint8_t buf[3];
+        size_t size;
+    } input;
+    char output[64];
+};
+
+/**
+ * Streaming decoder. Data written to the decoder is decoded and
+ * written to the output channel.
+ */
+struct base64_decoder_t {
+    struct chan_t base;
+    struct chan_t *chan_p;
+    int alphabet;
+    /* Encoded characters not yet decoded. The last group of four is
+       kept until more data is written as it may contain padding. */
+    struct {
+        char buf[4];
+        size_t size;
+    } input;
+    uint8_t output[48];
+};
+
 /**
- * Encode given buffer.
+ * Encode given buffer using the standard alphabet.
  *
- * @param[out] dst_p Encoded output data.
+ * @param[out] dst_p Encoded output data of
+ *                   ``BASE64_ENCODED_SIZE(size)`` bytes.
  * @param[in] src_p Input data.
  * @param[in] size Number of bytes in the input data.
  *
@@ -35,14 +77,126 @@
 int base64_encode(char *dst_p, const void *src_p, size_t size);
 
 /**
- * Decode given base64 encoded buffer.
+ * Decode given buffer encoded using the standard alphabet. The input
+ * must be padded. Characters outside the alphabet, and padding
+ * anywhere but at the end, are rejected. Earlier versions decoded
+ * such characters as zero.
+ *
+ * Only the decoded bytes are written to the output, that is, one or
+ * two bytes less than ``3 * size / 4`` if the input is padded. The
+ * bytes the padding used to be decoded into are left unchanged.
  *
  * @param[out] dst_p Output data.
  * @param[in] src_p Encoded input data.
  * @param[in] size Number of bytes in the encoded input data.
  *
- * @return zero(0) or negative error code.
+ * @return zero(0), or -EINVAL if the size is not a multiple of four
+ *         or the input is not valid base64.
  */
 int base64_decode(void *dst_p, const char *src_p, size_t size);
 
+/**
+ * Encode given buffer using the URL and filename safe alphabet. The
+ * output is padded.
+ *
+ * @param[out] dst_p Encoded output data of
+ *                   ``BASE64_ENCODED_SIZE(size)`` bytes.
+ * @param[in] src_p Input data.
+ * @param[in] size Number of bytes in the input data.
+ *
+ * @return zero(0) or negative error code.
+ */
+int base64_url_encode(char *dst_p, const void *src_p, size_t size);
+
+/**
+ * Decode given buffer encoded using the URL and filename safe
+ * alphabet. The padding is optional.
+ *
+ * @param[out] dst_p Output data.
+ * @param[in] src_p Encoded input data.
+ * @param[in] size Number of bytes in the encoded input data.
+ *
+ * @return Number of decoded bytes or negative error code.
+ */
+ssize_t base64_url_decode(void *dst_p, const char *src_p, size_t size);
+
+/**
+ * Initialize given encoder.
+ *
+ * @param[out] self_p Encoder to initialize.
+ * @param[in] chan_p Channel to write encoded data to.
+ * @param[in] alphabet One of ``BASE64_ALPHABET_STANDARD`` and
+ *                     ``BASE64_ALPHABET_URL``.
+ *
+ * @return zero(0) or negative error code.
+ */
+int base64_encoder_init(struct base64_encoder_t *self_p,
+                        struct chan_t *chan_p,
+                        int alphabet);
+
+/**
+ * Encode given data. Up to two bytes are buffered in the encoder
+ * until more data is written or the encoder is finished.
+ *
+ * @param[in] self_p Initialized encoder.
+ * @param[in] buf_p Data to encode.
+ * @param[in] size Size of the data.
+ *
+ * @return Number of bytes written to the encoder or negative error
+ *         code.
+ */
+ssize_t base64_encoder_write(struct base64_encoder_t *self_p,
+                             const void *buf_p,
+                             size_t size);
+
+/**
+ * Encode and write buffered data to the output channel, followed by
+ * padding. The encoder can be reused after this call.
+ *
+ * @param[in] self_p Initialized encoder.
+ *
+ * @return zero(0) or negative error code.
+ */
+int base64_encoder_finish(struct base64_encoder_t *self_p);
+
+/**
+ * Initialize given decoder.
+ *
+ * @param[out] self_p Decoder to initialize.
+ * @param[in] chan_p Channel to write decoded data to.
+ * @param[in] alphabet One of ``BASE64_ALPHABET_STANDARD`` and
+ *                     ``BASE64_ALPHABET_URL``.
+ *
+ * @return zero(0) or negative error code.
+ */
+int base64_decoder_init(struct base64_decoder_t *self_p,
+                        struct chan_t *chan_p,
+                        int alphabet);
+
+/**
+ * Decode given encoded data. The data may be split at any character.
+ *
+ * @param[in] self_p Initialized decoder.
+ * @param[in] buf_p Encoded data.
+ * @param[in] size Size of the encoded data.
+ *
+ * @return Number of consumed bytes, or -EINVAL if the data is
+ *         not valid base64, or other negative error code.
+ */
+ssize_t base64_decoder_write(struct base64_decoder_t *self_p,
+                             const void *buf_p,
+                             size_t size);
+
+/**
+ * Decode and write the last group of encoded characters to the output
+ * channel. Padding is optional. The decoder can be reused after this
+ * call.
+ *
+ * @param[in] self_p Initialized decoder.
+ *
+ * @return zero(0), -EINVAL if the data is not valid base64, or other
+ *         negative error code.
+ */
+int base64_decoder_finish(struct base64_decoder_t *self_p);
+
 #endif
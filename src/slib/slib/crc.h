@@ -23,11 +23,30 @@
 
 #include "simba.h"
 
+/**
+ * Calculate CRC-32 eight bytes at a time using eight lookup tables,
+ * 8 kB in total, instead of one byte at a time using one 1 kB lookup
+ * table. Disabled by default on AVR to save flash.
+ */
+#ifndef CRC_32_SLICING_BY_8
+#    if defined(ARCH_AVR)
+#        define CRC_32_SLICING_BY_8 0
+#    else
+#        define CRC_32_SLICING_BY_8 1
+#    endif
+#endif
+
 /**
  * Calculate crc using the polynom
  * ``x^32+x^26+x^23+x^22+x^16+x^12+x^11+x^10+x^8+x^7+x^5+x^4+x^2+x^1+x^0``.
  *
- * @param[in] crc Initial crc. Often zero(0).
+ * On Linux the CRC instructions of the CPU are used if available,
+ * carry-less multiplication (PCLMULQDQ) on x86-64 and the CRC32
+ * instructions on ARMv8.
+ *
+ * @param[in] crc Initial crc. Often zero(0). Give the crc of the
+ *                previous part to calculate the crc of data in
+ *                multiple parts.
  * @param[in] buf_p Buffer to calculate crc of.
  * @param[in] size Size of the buffer.
  *
@@ -35,4 +54,32 @@
  */
 uint32_t crc_32(uint32_t crc, const void *buf_p, size_t size);
 
+/**
+ * Calculate CRC-16/XMODEM using the polynom
+ * ``x^16+x^12+x^5+x^0``. Used by SD cards to protect data blocks.
+ *
+ * @param[in] crc Initial crc. Often zero(0). Give the crc of the
+ *                previous part to calculate the crc of data in
+ *                multiple parts.
+ * @param[in] buf_p Buffer to calculate crc of.
+ * @param[in] size Size of the buffer.
+ *
+ * @return Calculated crc.
+ */
+uint16_t crc_xmodem(uint16_t crc, const void *buf_p, size_t size);
+
+/**
+ * Calculate CRC-7 using the polynom ``x^7+x^3+x^0``. Used by SD cards
+ * to protect commands, where it is sent as ``(crc << 1) | 1``.
+ *
+ * @param[in] crc Initial crc. Often zero(0). Give the crc of the
+ *                previous part to calculate the crc of data in
+ *                multiple parts.
+ * @param[in] buf_p Buffer to calculate crc of.
+ * @param[in] size Size of the buffer.
+ *
+ * @return Calculated seven bits crc.
+ */
+uint8_t crc_7(uint8_t crc, const void *buf_p, size_t size);
+
 #endif
@@ -0,0 +1,224 @@
+/**
+ * @file slib/deflate.h
+ * @version 0.5.0
+ *
+ * @section License
+ * Copyright (C) 2016, Erik Moqvist
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Simba project.
+ */
+
+#ifndef __SLIB_DEFLATE_H__
+#define __SLIB_DEFLATE_H__
+
+#include "simba.h"
+
+/**
+ * Base two logarithm of the LZ77 window size, 9 to 14. The
+ * compressor uses twice the window size for its input buffer and the
+ * decompressor uses the window size for its output history. The peer
+ * compressor must not use a larger window than the decompressor.
+ */
+#ifndef DEFLATE_WINDOW_BITS
+#    define DEFLATE_WINDOW_BITS 10
+#endif
+
+#if (DEFLATE_WINDOW_BITS < 9) || (DEFLATE_WINDOW_BITS > 14)
+#    error "DEFLATE_WINDOW_BITS must be 9 to 14."
+#endif
+
+#define DEFLATE_WINDOW_SIZE (1 << DEFLATE_WINDOW_BITS)
+
+/** Base two logarithm of the number of compressor hash table
+    entries. */
+#ifndef DEFLATE_HASH_BITS
+#    define DEFLATE_HASH_BITS 9
+#endif
+
+/** Raw deflate data, as used by the websocket permessage-deflate
+    extension. */
+#define DEFLATE_FORMAT_RAW                                 0
+/** Deflate data with a gzip header and trailer, as used by the HTTP
+    gzip content encoding. */
+#define DEFLATE_FORMAT_GZIP                                1
+
+/**
+ * Streaming compressor. Data written to the compressor is compressed
+ * with fixed Huffman codes and written to the output channel.
+ */
+struct deflate_t {
+    struct chan_t base;
+    struct chan_t *chan_p;
+    int format;
+    /* A compressed block is started but not ended. */
+    int block_open;
+    /* Input history and lookahead. */
+    struct {
+        uint8_t buf[2 * DEFLATE_WINDOW_SIZE];
+        size_t pos;
+        size_t end;
+    } window;
+    /* Most recent position plus one of each hashed three byte
+       sequence, or zero. */
+    uint16_t head[1 << DEFLATE_HASH_BITS];
+    struct {
+        uint32_t value;
+        int size;
+    } bits;
+    struct {
+        uint8_t buf[32];
+        size_t size;
+    } output;
+    /* Uncompressed and compressed sizes since the last flush. */
+    struct {
+        uint32_t input;
+        uint32_t output;
+    } counters;
+    /* Gzip trailer. */
+    uint32_t crc;
+    uint32_t size;
+};
+
+struct inflate_huffman_t {
+    uint16_t counts[16];
+    uint16_t *symbols_p;
+};
+
+/**
+ * Streaming decompressor of raw deflate data. Data written to the
+ * decompressor is decompressed and written to the output channel.
+ */
+struct inflate_t {
+    struct chan_t base;
+    struct chan_t *chan_p;
+    int state;
+    int final;
+    struct {
+        uint64_t value;
+        int size;
+    } bits;
+    /* Output history. */
+    struct {
+        uint8_t buf[DEFLATE_WINDOW_SIZE];
+        size_t pos;
+        size_t flushed;
+        int full;
+    } window;
+    /* Stored block or match length, and match distance. */
+    size_t length;
+    size_t distance;
+    /* Dynamic block header. */
+    struct {
+        int hlit;
+        int hdist;
+        int hclen;
+        int index;
+        uint8_t lengths[288 + 32];
+    } header;
+    struct inflate_huffman_t literal;
+    struct inflate_huffman_t distance_codes;
+    uint16_t literal_symbols[288];
+    uint16_t distance_symbols[32];
+};
+
+/**
+ * Initialize the deflate module. Registers the file system counter
+ * ``/slib/deflate/bytes_saved``, the number of bytes saved by
+ * compression.
+ *
+ * @return zero(0) or negative error code.
+ */
+int deflate_module_init(void);
+
+/**
+ * Initialize given compressor.
+ *
+ * @param[out] self_p Compressor to initialize.
+ * @param[in] chan_p Channel to write compressed data to.
+ * @param[in] format One of ``DEFLATE_FORMAT_RAW`` and
+ *                   ``DEFLATE_FORMAT_GZIP``.
+ *
+ * @return zero(0) or negative error code.
+ */
+int deflate_init(struct deflate_t *self_p,
+                 struct chan_t *chan_p,
+                 int format);
+
+/**
+ * Compress given data. Compressed data is written to the output
+ * channel as the compressor buffers fill up.
+ *
+ * @param[in] self_p Initialized compressor.
+ * @param[in] buf_p Data to compress.
+ * @param[in] size Size of the data.
+ *
+ * @return Number of bytes written to the compressor or negative
+ *         error code.
+ */
+ssize_t deflate_write(struct deflate_t *self_p,
+                      const void *buf_p,
+                      size_t size);
+
+/**
+ * Compress and write all buffered data to the output channel,
+ * followed by an empty stored block. The decompressor can decompress
+ * all data written so far, and the history is kept for the data
+ * written after the flush. The output ends with the four bytes 0x00,
+ * 0x00, 0xff and 0xff.
+ *
+ * @param[in] self_p Initialized compressor.
+ *
+ * @return zero(0) or negative error code.
+ */
+int deflate_flush(struct deflate_t *self_p);
+
+/**
+ * Compress and write all buffered data to the output channel and end
+ * the compressed data. The gzip trailer is written if the format is
+ * ``DEFLATE_FORMAT_GZIP``.
+ *
+ * @param[in] self_p Initialized compressor.
+ *
+ * @return zero(0) or negative error code.
+ */
+int deflate_finish(struct deflate_t *self_p);
+
+/**
+ * Initialize given decompressor.
+ *
+ * @param[out] self_p Decompressor to initialize.
+ * @param[in] chan_p Channel to write decompressed data to.
+ *
+ * @return zero(0) or negative error code.
+ */
+int inflate_init(struct inflate_t *self_p,
+                 struct chan_t *chan_p);
+
+/**
+ * Decompress given raw deflate data. The data may be split at any
+ * byte boundary. All data that can be decompressed is written to the
+ * output channel before this function returns. Data after the final
+ * block is ignored.
+ *
+ * @param[in] self_p Initialized decompressor.
+ * @param[in] buf_p Compressed data.
+ * @param[in] size Size of the compressed data.
+ *
+ * @return Number of consumed bytes, or -EBADMSG if the data is
+ *         corrupt, or other negative error code.
+ */
+ssize_t inflate_write(struct inflate_t *self_p,
+                      const void *buf_p,
+                      size_t size);
+
+#endif
@@ -26,7 +26,7 @@
 #include "simba.h"
 
 /*
- * FAT16 file structures.
+ * FAT16 and FAT32 file structures.
  *
  * @section Acknowledgement
  * Refactoring of Arduino Fat16 Library, Copyright (C) 2009 by William Greiman
@@ -44,6 +44,46 @@
 
 #define FAT16_EOF      -1
 
+/**
+ * Number of 512 bytes blocks in the block cache.
+ */
+#ifndef FAT16_CACHE_BLOCKS
+#    if defined(ARCH_AVR)
+#        define FAT16_CACHE_BLOCKS 2
+#    else
+#        define FAT16_CACHE_BLOCKS 4
+#    endif
+#endif
+
+/**
+ * Number of cache blocks reserved for FAT blocks. Zero(0) to let FAT,
+ * directory and file data blocks share all cache blocks.
+ */
+#ifndef FAT16_CACHE_FAT_BLOCKS
+#    define FAT16_CACHE_FAT_BLOCKS 1
+#endif
+
+#if FAT16_CACHE_FAT_BLOCKS >= FAT16_CACHE_BLOCKS
+#    error "FAT16_CACHE_FAT_BLOCKS must be less than FAT16_CACHE_BLOCKS."
+#endif
+
+/**
+ * Number of cluster runs in the extent cache of each open file. A
+ * file seek only follows the FAT cluster chain beyond the runs in the
+ * cache.
+ */
+#ifndef FAT16_FILE_EXTENTS
+#    if defined(ARCH_AVR)
+#        define FAT16_FILE_EXTENTS 2
+#    else
+#        define FAT16_FILE_EXTENTS 8
+#    endif
+#endif
+
+#if FAT16_FILE_EXTENTS < 1
+#    error "FAT16_FILE_EXTENTS must be at least one."
+#endif
+
 /* File open options. */
 #define O_READ   0x01                /* Open for reading. */
 #define O_RDONLY O_READ              /* Same as O_READ. */
@@ -73,8 +113,27 @@ typedef ssize_t (*fat16_write_t)(void *arg_p,
                                  uint32_t dst_block,
                                  const void *src_p);
 
-/* FAT entry.  */
-typedef uint16_t fat_t;
+/**
+ * Read given number of consecutive blocks. Returns the number of read
+ * bytes or negative error code.
+ */
+typedef ssize_t (*fat16_read_blocks_t)(void *arg_p,
+                                       void *dst_p,
+                                       uint32_t src_block,
+                                       size_t count);
+
+/**
+ * Write given number of consecutive blocks. Returns the number of
+ * written bytes or negative error code.
+ */
+typedef ssize_t (*fat16_write_blocks_t)(void *arg_p,
+                                        uint32_t dst_block,
+                                        const void *src_p,
+                                        size_t count);
+
+/* FAT entry. 16 bits on FAT16 volumes and 28 bits on FAT32
+   volumes. */
+typedef uint32_t fat_t;
 
 /**
  * FAT Time Format. A FAT directory entry time stamp is a 16-bit
@@ -316,6 +375,124 @@ struct fbs_t {
     uint16_t boot_sector_sig;
 } PACKED;
 
+/**
+ * Boot sector for a FAT32 volume. The BIOS parameter block is
+ * followed by FAT32 specific fields.
+ */
+struct fbs32_t {
+    /**
+     * X86 jmp to boot program
+     */
+    uint8_t jmp_to_boot_code[3];
+    /**
+     * Informational only - don't depend on it
+     */
+    char oem_name[8];
+    /**
+     * BIOS Parameter Block
+     */
+    struct bpb_t bpb;
+    /**
+     * Count of sectors occupied by one FAT.
+     */
+    uint32_t sectors_per_fat32;
+    /**
+     * Bits 0-3 are the zero-based number of the active FAT if bit 7
+     * is set. Otherwise all FATs are mirrored.
+     */
+    uint16_t fat32_flags;
+    /**
+     * FAT32 version, zero.
+     */
+    uint16_t fat32_version;
+    /**
+     * First cluster of the root directory.
+     */
+    uint32_t fat32_root_cluster;
+    /**
+     * Sector number of the FSInfo structure in the reserved area.
+     */
+    uint16_t fat32_fsinfo;
+    /**
+     * Sector number of a copy of the boot record in the reserved
+     * area, usually 6.
+     */
+    uint16_t fat32_back_boot_block;
+    /**
+     * Reserved, zero.
+     */
+    uint8_t fat32_reserved[12];
+    /**
+     * For int0x13 use value 0x80 for hard drive
+     */
+    uint8_t drive_number;
+    /**
+     * Used by Windows NT - should be zero for FAT
+     */
+    uint8_t reserved1;
+    /**
+     * 0x29 if next three fields are valid
+     */
+    uint8_t boot_signature;
+    /**
+     * Usually generated by combining date and time
+     */
+    uint32_t volume_serial_number;
+    /**
+     * Should match volume label in root dir
+     */
+    char volume_label[11];
+    /**
+     * Informational only - don't depend on it
+     */
+    char file_system_type[8];
+    /**
+     * X86 boot code
+     */
+    uint8_t boot_code[420];
+    /**
+     * Must be 0x55AA
+     */
+    uint16_t boot_sector_sig;
+} PACKED;
+
+/**
+ * FAT32 FSInfo sector. Holds hints of the number of free clusters
+ * and where to start searching for a free cluster, so that they are
+ * not computed by reading the whole FAT.
+ */
+struct fsinfo_t {
+    /**
+     * Must be 0x41615252.
+     */
+    uint32_t lead_signature;
+    /**
+     * Reserved, zero.
+     */
+    uint8_t reserved1[480];
+    /**
+     * Must be 0x61417272.
+     */
+    uint32_t struct_signature;
+    /**
+     * Last known free cluster count, or 0xffffffff if unknown.
+     */
+    uint32_t free_count;
+    /**
+     * Cluster to start searching for a free cluster at, or
+     * 0xffffffff if unknown.
+     */
+    uint32_t next_free;
+    /**
+     * Reserved, zero.
+     */
+    uint8_t reserved2[12];
+    /**
+     * Must be 0xaa550000.
+     */
+    uint32_t tail_signature;
+} PACKED;
+
 /**
  * Master Boot Record. The first block of a storage device that is
  * formatted with a MBR.
@@ -412,53 +589,108 @@ struct dir_t {
 union fat16_cache16_t {
     /* Used to access cached file data blocks. */
     uint8_t data[512];
-    /* Used to access cached FAT entries. */
-    fat_t fat[256];
+    /* Used to access cached FAT16 entries. */
+    uint16_t fat16[256];
+    /* Used to access cached FAT32 entries. */
+    uint32_t fat32[128];
     /* Used to access cached directory entries. */
     struct dir_t dir[16];
     /* Used to access a cached Master Boot Record. */
     struct mbr_t mbr;
     /* Used to access to a cached FAT16 boot sector. */
     struct fbs_t fbs;
+    /* Used to access to a cached FAT32 boot sector. */
+    struct fbs32_t fbs32;
+    /* Used to access to a cached FAT32 FSInfo sector. */
+    struct fsinfo_t fsinfo;
 };
 
-struct fat16_cache_t {
+struct fat16_cache_block_t {
     uint32_t block_number;         /* Logical number of block in the cache */
-    uint8_t dirty;                 /* cacheFlush() will write block if true */
     uint32_t mirror_block;         /* mirror block for second FAT */
+    uint32_t last_used;            /* LRU timestamp, zero if never used */
+    uint8_t dirty;                 /* written on eviction or sync if true */
     union fat16_cache16_t buffer;  /* 512 byte cache for raw blocks */
 };
 
+/**
+ * Write-back block cache with least recently used replacement. The
+ * first ``FAT16_CACHE_FAT_BLOCKS`` blocks only hold FAT blocks, so
+ * that reading file data does not evict the FAT block needed at the
+ * next cluster boundary, and vice versa.
+ */
+struct fat16_cache_t {
+    struct fat16_cache_block_t blocks[FAT16_CACHE_BLOCKS];
+    uint32_t tick;
+    struct {
+        uint32_t hits;
+        uint32_t misses;
+        uint32_t writes;
+    } counters;
+};
+
 struct fat16_t {
     /* Data block read and wrte functions. */
     fat16_read_t read;
     fat16_write_t write;
+    /* Optional multi block read and write functions. */
+    fat16_read_blocks_t read_blocks;
+    fat16_write_blocks_t write_blocks;
     void *arg_p;
     unsigned int partition;
 
     /* Volume info */
+    uint8_t fat_type;              /* 16 or 32 */
     uint8_t fat_count;             /* number of FATs */
     uint8_t blocks_per_cluster;    /* must be power of 2 */
-    uint16_t root_dir_entry_count; /* should be 512 for FAT16 */
-    fat_t blocks_per_fat;          /* number of blocks in one FAT */
+    uint16_t root_dir_entry_count; /* should be 512 for FAT16, 0 for FAT32 */
+    uint32_t blocks_per_fat;       /* number of blocks in one FAT */
     fat_t cluster_count;           /* total clusters in volume */
     uint32_t fat_start_block;      /* start of first FAT */
-    uint32_t root_dir_start_block; /* start of root dir */
+    uint32_t root_dir_start_block; /* start of FAT16 root dir */
+    fat_t root_dir_cluster;        /* first cluster of FAT32 root dir */
+    uint32_t fsinfo_block;         /* FAT32 FSInfo block, or zero */
     uint32_t data_start_block;     /* start of data clusters */
 
     /* block cache */
     struct fat16_cache_t cache;
+
+    /* Free cluster bitmap, one bit per cluster, set if used. */
+    struct {
+        uint8_t *buf_p;            /* caller provided buffer */
+        size_t size;               /* buffer size in bytes */
+        uint8_t *bitmap_p;         /* buf_p when built, otherwise NULL */
+        fat_t count;               /* number of free clusters, or
+                                      0xffffffff if unknown */
+        fat_t next;                /* next fit search start */
+        uint8_t fsinfo_dirty;      /* FSInfo hints must be written */
+    } free_clusters;
+};
+
+/**
+ * A run of clusters after each other in a file.
+ */
+struct fat16_extent_t {
+    fat_t index;             /* index in the file of the first cluster */
+    fat_t cluster;           /* first cluster */
+    fat_t length;            /* number of clusters */
 };
 
 struct fat16_file_t {
     struct fat16_t *fat16_p; /* file system that contains this file */
     uint8_t flags;           /* see above for bit definitions */
-    int16_t dir_entry_block; /* block of directory entry for open file */
+    uint32_t dir_entry_block; /* block of directory entry for open file */
     int16_t dir_entry_index; /* index of directory entry for open file */
     fat_t first_cluster;     /* first cluster of file */
     size_t file_size;        /* fileSize */
     fat_t cur_cluster;       /* current cluster */
     size_t cur_position;     /* current byte offset */
+    /* Extent cache of the first cluster runs of the file, filled
+       while the cluster chain is followed. */
+    struct {
+        struct fat16_extent_t runs[FAT16_FILE_EXTENTS];
+        int length;
+    } extents;
 };
 
 struct fat16_dir_t {
@@ -474,8 +706,16 @@ struct fat16_dir_entry_t {
     struct date_t latest_mod_date;
 };
 
+struct fat16_stat_t {
+    size_t size;
+    int is_dir;
+    struct date_t latest_mod_date;
+};
+
 /**
- * Initialize a FAT16 volume.
+ * Initialize a FAT16 or FAT32 volume. The FAT type is detected by
+ * `fat16_start()` from the number of clusters in the volume. exFAT
+ * volumes are not supported.
  *
  * @param[in,out] self_p FAT16 object to initialize.
  * @param[in] read Callback function used to read blocks of data.
@@ -497,6 +737,60 @@ int fat16_init(struct fat16_t *self_p,
                void *arg_p,
                unsigned int partition);
 
+/**
+ * Set functions used to read and write multiple consecutive blocks
+ * at once. File data of whole blocks is transferred directly between
+ * the storage device and the buffer given to
+ * `fat16_file_read()` or `fat16_file_write()`, one cluster run at a
+ * time. Without these functions whole blocks are transferred directly
+ * one at a time with the read and write functions given to
+ * `fat16_init()`.
+ *
+ * @param[in] self_p FAT16 object.
+ * @param[in] read_blocks Multi block read function, or NULL.
+ * @param[in] write_blocks Multi block write function, or NULL.
+ *
+ * @return zero(0) or negative error code.
+ */
+int fat16_set_multi_block_functions(struct fat16_t *self_p,
+                                    fat16_read_blocks_t read_blocks,
+                                    fat16_write_blocks_t write_blocks);
+
+/**
+ * Set a buffer for a bitmap of free clusters, built by
+ * `fat16_start()`. With the bitmap, allocating a cluster does not
+ * scan the FAT, and `fat16_file_preallocate()` can allocate
+ * contiguous runs of clusters. The buffer must be at least one bit
+ * per cluster plus two bits large, otherwise the bitmap is not
+ * used. 8192 bytes is enough for any FAT16 volume. A FAT32 volume
+ * needs one byte per 8 clusters, for example 128 kB for a 32 GB card
+ * with 32 kB clusters.
+ *
+ * @param[in] self_p FAT16 object.
+ * @param[in] buf_p Bitmap buffer, or NULL to not use a bitmap.
+ * @param[in] size Buffer size in bytes.
+ *
+ * @return zero(0) or negative error code.
+ */
+int fat16_set_free_cluster_bitmap(struct fat16_t *self_p,
+                                  uint8_t *buf_p,
+                                  size_t size);
+
+/**
+ * Get the number of free clusters in given volume. A cluster is
+ * `blocks_per_cluster` blocks of 512 bytes. The count is known
+ * without reading the FAT if a free cluster bitmap is used, or from
+ * the FSInfo sector of a FAT32 volume. Otherwise the whole FAT is
+ * read once, and the count is then maintained as clusters are
+ * allocated and freed.
+ *
+ * @param[in] self_p Started FAT16 object.
+ * @param[out] count_p Number of free clusters.
+ *
+ * @return zero(0) or negative error code.
+ */
+int fat16_get_free_clusters(struct fat16_t *self_p, fat_t *count_p);
+
 /**
  * Start given FAT16 volume. Starts the SD device and reads driver
  * information
@@ -508,7 +802,8 @@ int fat16_init(struct fat16_t *self_p,
 int fat16_start(struct fat16_t *self_p);
 
 /**
- * Stop given FAT16 volume.
+ * Stop given FAT16 volume. All modified blocks in the block cache are
+ * written to the storage device.
  *
  * @param[in] self_p FAT16 object.
  *
@@ -524,7 +819,18 @@ int fat16_stop(struct fat16_t *self_p);
 int fat16_format(struct fat16_t *self_p);
 
 /**
- * Print volume information to given channel.
+ * Write all modified blocks in the block cache, and the free cluster
+ * hints of a FAT32 volume, to the storage device.
+ *
+ * @param[in] self_p FAT16 object.
+ *
+ * @return zero(0) or negative error code.
+ */
+int fat16_sync(struct fat16_t *self_p);
+
+/**
+ * Print volume information and block cache statistics to given
+ * channel.
  *
  * @param[in] self_p FAT16 object.
  * @param[in] chan_p Output channel.
@@ -584,6 +890,22 @@ ssize_t fat16_file_write(struct fat16_file_t *file_p,
                          const void *buf_p,
                          size_t size);
 
+/**
+ * Allocate clusters for given number of bytes to the file, without
+ * changing its size, so that later writes up to that size do not
+ * allocate clusters. The clusters are allocated after each other if
+ * a free cluster bitmap is used and a large enough free run exists.
+ * Allocated clusters beyond the end of the file are kept until the
+ * file is truncated.
+ *
+ * @param[in] file_p File object opened for writing.
+ * @param[in] size Number of bytes to allocate clusters for.
+ *
+ * @return zero(0) or negative error code.
+ */
+int fat16_file_preallocate(struct fat16_file_t *file_p,
+                           size_t size);
+
 /**
  * Sets the file's read/write position relative to mode.
  *
@@ -625,6 +947,19 @@ ssize_t fat16_file_size(struct fat16_file_t *file_p);
  */
 int fat16_file_sync(struct fat16_file_t *file_p);
 
+/**
+ * Gets file status by path.
+ *
+ * @param[in] self_p FAT16 object.
+ * @param[in] path_p A valid 8.3 DOS name for a file or directory path.
+ * @param[out] stat_p Read file status.
+ *
+ * @return zero(0) or negative error code.
+ */
+int fat16_stat(struct fat16_t *self_p,
+               const char *path_p,
+               struct fat16_stat_t *stat_p);
+
 /**
  * Open a directory by directory path and mode flags.
  *
@@ -23,18 +23,46 @@
 
 #include "simba.h"
 
+/** Use the SHA instructions of the CPU if available. Only used on
+    Linux. */
+#ifndef HASH_SHA_INSTRUCTIONS
+#    define HASH_SHA_INSTRUCTIONS 1
+#endif
+
+/** Number of streams hashed in parallel by
+    ``hash_sha256_update_multi()``. */
+#define HASH_MULTI_LANES                                    4
+
 struct hash_sha1_t {
     struct {
-        uint8_t buf[64]; 
-        uint32_t size; 
+        uint8_t buf[64];
+        uint32_t size;
+    } block;
+    uint32_t h[5];
+    uint64_t size;
+};
+
+struct hash_sha256_t {
+    struct {
+        uint8_t buf[64];
+        uint32_t size;
     } block;
-    uint32_t h[5]; 
-    uint64_t size; 
-}; 
+    uint32_t h[8];
+    uint64_t size;
+};
+
+struct hash_hmac_sha256_t {
+    struct hash_sha256_t inner;
+    struct hash_sha256_t outer;
+};
 
 /**
  * Initialize given SHA1 object.
  *
+ * On Linux the SHA instructions of the CPU are used if available,
+ * SHA-NI on x86-64 and the cryptographic extension on ARMv8. This
+ * applies to SHA256 as well.
+ *
  * @param[in,out] self_p SHA1 object.
  *
  * @return zero(0) or negative error code.
@@ -53,7 +81,7 @@ int hash_sha1_init(struct hash_sha1_t *self_p);
  * @return zero(0) or negative error code.
  */
 int hash_sha1_update(struct hash_sha1_t *self_p,
-                     void *buf_p,
+                     const void *buf_p,
                      size_t size);
 
 /**
@@ -69,4 +97,98 @@ int hash_sha1_update(struct hash_sha1_t *self_p,
 int hash_sha1_digest(struct hash_sha1_t *self_p,
                      uint8_t *hash_p);
 
+/**
+ * Initialize given SHA256 object.
+ *
+ * @param[in,out] self_p SHA256 object.
+ *
+ * @return zero(0) or negative error code.
+ */
+int hash_sha256_init(struct hash_sha256_t *self_p);
+
+/**
+ * Update the sha object with the given buffer. Repeated calls are
+ * equivalent to a single call with the concatenation of all the
+ * arguments.
+ *
+ * @param[in] self_p SHA256 object.
+ * @param[in] buf_p Buffer to update the sha object with.
+ * @param[in] size Size of the buffer.
+ *
+ * @return zero(0) or negative error code.
+ */
+int hash_sha256_update(struct hash_sha256_t *self_p,
+                       const void *buf_p,
+                       size_t size);
+
+/**
+ * Update given independent sha objects with one buffer each, all of
+ * the same size. Equivalent to calling ``hash_sha256_update()`` once
+ * per object, but up to ``HASH_MULTI_LANES`` objects are hashed in
+ * parallel when the CPU has no SHA instructions.
+ *
+ * @param[in] selves_pp Array of SHA256 objects.
+ * @param[in] bufs_pp Array of buffers, one per object.
+ * @param[in] size Size of each buffer.
+ * @param[in] length Number of objects and buffers.
+ *
+ * @return zero(0) or negative error code.
+ */
+int hash_sha256_update_multi(struct hash_sha256_t *selves_pp[],
+                             const void *bufs_pp[],
+                             size_t size,
+                             int length);
+
+/**
+ * Return the digest of the strings passed to the
+ * hash_sha256_update() method so far. This is a 32-byte value which
+ * may contain non-ASCII characters, including null bytes.
+ *
+ * @param[in] self_p SHA256 object.
+ * @param[in] hash_p Hash sum.
+ *
+ * @return zero(0) or negative error code.
+ */
+int hash_sha256_digest(struct hash_sha256_t *self_p,
+                       uint8_t *hash_p);
+
+/**
+ * Initialize given HMAC-SHA256 object with given key.
+ *
+ * @param[in,out] self_p HMAC-SHA256 object.
+ * @param[in] key_p Key.
+ * @param[in] key_size Key size. Keys longer than 64 bytes are
+ *                     hashed.
+ *
+ * @return zero(0) or negative error code.
+ */
+int hash_hmac_sha256_init(struct hash_hmac_sha256_t *self_p,
+                          const void *key_p,
+                          size_t key_size);
+
+/**
+ * Update the HMAC object with the given buffer.
+ *
+ * @param[in] self_p HMAC-SHA256 object.
+ * @param[in] buf_p Buffer to update the HMAC object with.
+ * @param[in] size Size of the buffer.
+ *
+ * @return zero(0) or negative error code.
+ */
+int hash_hmac_sha256_update(struct hash_hmac_sha256_t *self_p,
+                            const void *buf_p,
+                            size_t size);
+
+/**
+ * Return the 32-byte message authentication code of the strings
+ * passed to the hash_hmac_sha256_update() method so far.
+ *
+ * @param[in] self_p HMAC-SHA256 object.
+ * @param[in] mac_p Message authentication code.
+ *
+ * @return zero(0) or negative error code.
+ */
+int hash_hmac_sha256_digest(struct hash_hmac_sha256_t *self_p,
+                            uint8_t *mac_p);
+
 #endif
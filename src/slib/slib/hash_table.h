@@ -0,0 +1,170 @@
+/**
+ * @file slib/hash_table.h
+ * @version 0.5.0
+ *
+ * @section License
+ * Copyright (C) 2016, Erik Moqvist
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Simba project.
+ */
+
+#ifndef __SLIB_HASH_TABLE_H__
+#define __SLIB_HASH_TABLE_H__
+
+#include "simba.h"
+
+struct hash_table_t;
+
+/**
+ * Called by `hash_table_add()` when the table is full. The callback
+ * may call `hash_table_resize()` with a larger array of entries, in
+ * which case the new key is added to the resized table.
+ */
+typedef void (*hash_table_full_fn_t)(struct hash_table_t *self_p,
+                                     void *arg_p);
+
+struct hash_table_entry_t {
+    /** Key. Only referred to, not copied. */
+    const void *key_p;
+    /** Value. */
+    void *value_p;
+    /* Hash of the key. */
+    uint32_t hash;
+    /** Key size in bytes. */
+    uint16_t key_size;
+    /* Probe distance from the home slot plus one, or zero if the
+       entry is unused. */
+    uint16_t distance;
+};
+
+/**
+ * A hash table with open addressing and Robin Hood probing. The keys
+ * are byte strings. Entries are stored in a caller provided array
+ * whose length is a power of two, so a lookup is a hash, a mask and
+ * a short linear probe with no division and no pointer chasing.
+ */
+struct hash_table_t {
+    struct hash_table_entry_t *entries_p;
+    /* Array length minus one. */
+    size_t mask;
+    /* Number of used entries. */
+    size_t length;
+    /* Maximum number of used entries before the table is full. */
+    size_t length_max;
+    hash_table_full_fn_t on_full;
+    void *arg_p;
+};
+
+/**
+ * Initialize given hash table.
+ *
+ * @param[out] self_p Hash table to initialize.
+ * @param[in] entries_p Array of entries.
+ * @param[in] length Number of entries in the array. Must be a power
+ *                   of two. At most seven eighths of the entries are
+ *                   used.
+ * @param[in] on_full Callback called when the table is full, or NULL.
+ * @param[in] arg_p Callback argument.
+ *
+ * @return zero(0) or negative error code.
+ */
+int hash_table_init(struct hash_table_t *self_p,
+                    struct hash_table_entry_t *entries_p,
+                    size_t length,
+                    hash_table_full_fn_t on_full,
+                    void *arg_p);
+
+/**
+ * Move all keys in given hash table to given array of entries. The
+ * previous array is not used by the table after this call.
+ *
+ * @param[in] self_p Initialized hash table.
+ * @param[in] entries_p New array of entries.
+ * @param[in] length Number of entries in the new array. Must be a
+ *                   power of two, large enough to hold all keys in
+ *                   the table.
+ *
+ * @return zero(0) or negative error code.
+ */
+int hash_table_resize(struct hash_table_t *self_p,
+                      struct hash_table_entry_t *entries_p,
+                      size_t length);
+
+/**
+ * Add given key-value pair to given hash table. Overwrites the old
+ * value if the key is already in the table. The key is not copied
+ * and must be valid as long as it is in the table.
+ *
+ * @param[in] self_p Initialized hash table.
+ * @param[in] key_p Key.
+ * @param[in] key_size Key size in bytes.
+ * @param[in] value_p Value.
+ *
+ * @return zero(0), -ENOMEM if the table is full, or other negative
+ *         error code.
+ */
+int hash_table_add(struct hash_table_t *self_p,
+                   const void *key_p,
+                   size_t key_size,
+                   void *value_p);
+
+/**
+ * Remove given key from given hash table.
+ *
+ * @param[in] self_p Initialized hash table.
+ * @param[in] key_p Key.
+ * @param[in] key_size Key size in bytes.
+ *
+ * @return zero(0) or negative error code.
+ */
+int hash_table_remove(struct hash_table_t *self_p,
+                      const void *key_p,
+                      size_t key_size);
+
+/**
+ * Get the value of given key.
+ *
+ * @param[in] self_p Initialized hash table.
+ * @param[in] key_p Key.
+ * @param[in] key_size Key size in bytes.
+ *
+ * @return Value or NULL if the key is not in the table.
+ */
+void *hash_table_get(struct hash_table_t *self_p,
+                     const void *key_p,
+                     size_t key_size);
+
+/**
+ * Get the next used entry at or after given index. Iterate over all
+ * entries by starting at index zero. The table must not be modified
+ * during the iteration.
+ *
+ * @param[in] self_p Initialized hash table.
+ * @param[in,out] index_p Index to start searching at. Set to the
+ *                        index after the returned entry.
+ *
+ * @return Next entry or NULL when all entries have been visited.
+ */
+struct hash_table_entry_t *hash_table_next(struct hash_table_t *self_p,
+                                           size_t *index_p);
+
+/**
+ * Get the number of keys in given hash table.
+ *
+ * @param[in] self_p Initialized hash table.
+ *
+ * @return Number of keys.
+ */
+size_t hash_table_size(struct hash_table_t *self_p);
+
+#endif
@@ -0,0 +1,201 @@
+/**
+ * @file slib/record_log.h
+ * @version 0.5.0
+ *
+ * @section License
+ * Copyright (C) 2016, Erik Moqvist
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Simba project.
+ */
+
+#ifndef __SLIB_RECORD_LOG_H__
+#define __SLIB_RECORD_LOG_H__
+
+#include "simba.h"
+
+#define RECORD_LOG_BLOCK_SIZE 512
+
+/** Size of the header of each record. */
+#define RECORD_LOG_RECORD_HEADER_SIZE 8
+
+/** Maximum size of the data in a record. */
+#define RECORD_LOG_RECORD_SIZE_MAX                      \
+    (RECORD_LOG_BLOCK_SIZE - RECORD_LOG_RECORD_HEADER_SIZE)
+
+/**
+ * Read given number of consecutive blocks from the storage. Has the
+ * same signature as `sd_read_blocks()` and `blockdev_read_blocks()`.
+ */
+typedef ssize_t (*record_log_read_t)(void *arg_p,
+                                     void *dst_p,
+                                     uint32_t src_block,
+                                     size_t count);
+
+/**
+ * Write given number of consecutive blocks to the storage.
+ */
+typedef ssize_t (*record_log_write_t)(void *arg_p,
+                                      uint32_t dst_block,
+                                      const void *src_p,
+                                      size_t count);
+
+/**
+ * An append-only log of records on a block device. The storage is
+ * divided into segments that are written one after the other in a
+ * circle, so all segments wear evenly. When the log wraps around the
+ * oldest segment is overwritten.
+ *
+ * Appended records are buffered in RAM and written to the storage by
+ * `record_log_commit()`, or when the write buffer is full. Each
+ * record is protected by a CRC, which is used to find the end of the
+ * log in `record_log_start()` after a power failure.
+ */
+struct record_log_t {
+    record_log_read_t read;
+    record_log_write_t write;
+    void *arg_p;
+    uint32_t start_block;
+    size_t segments;
+    /* Number of blocks in a segment, including the header block. */
+    size_t segment_length;
+    /* The segment written to and its sequence number. */
+    size_t segment;
+    uint32_t sequence;
+    struct {
+        uint8_t *buf_p;
+        /* Size of the buffer in blocks. */
+        size_t length;
+        /* Block in the segment of the first block in the buffer. */
+        size_t block;
+        /* Current block in the buffer and offset in it. */
+        size_t index;
+        size_t offset;
+        /* Number of records not yet written to the storage. */
+        size_t uncommitted;
+    } buffer;
+};
+
+/**
+ * Reads the records in a log, oldest first.
+ */
+struct record_log_iter_t {
+    struct record_log_t *log_p;
+    /* Number of segments left to read, including the current. */
+    size_t segments_left;
+    size_t segment;
+    uint32_t sequence;
+    size_t block;
+    size_t offset;
+    uint8_t buf[RECORD_LOG_BLOCK_SIZE];
+};
+
+/**
+ * Initialize given record log.
+ *
+ * @param[out] self_p Record log to initialize.
+ * @param[in] read Storage read function.
+ * @param[in] write Storage write function.
+ * @param[in] arg_p Argument passed to the read and write functions.
+ * @param[in] start_block First block of the log on the storage.
+ * @param[in] segments Number of segments, at least two.
+ * @param[in] segment_length Number of blocks in each segment, at
+ *                           least two.
+ * @param[in] buf_p Write buffer.
+ * @param[in] size Size of the write buffer in bytes. A multiple of
+ *                 ``RECORD_LOG_BLOCK_SIZE``. A larger buffer gives
+ *                 fewer and larger writes.
+ *
+ * @return zero(0) or negative error code.
+ */
+int record_log_init(struct record_log_t *self_p,
+                    record_log_read_t read,
+                    record_log_write_t write,
+                    void *arg_p,
+                    uint32_t start_block,
+                    size_t segments,
+                    size_t segment_length,
+                    void *buf_p,
+                    size_t size);
+
+/**
+ * Start given record log by scanning the storage for the end of the
+ * log. An empty log is created if the storage does not contain a
+ * log.
+ *
+ * @param[in] self_p Initialized record log.
+ *
+ * @return zero(0) or negative error code.
+ */
+int record_log_start(struct record_log_t *self_p);
+
+/**
+ * Remove all records from given record log.
+ *
+ * @param[in] self_p Initialized record log.
+ *
+ * @return zero(0) or negative error code.
+ */
+int record_log_format(struct record_log_t *self_p);
+
+/**
+ * Append a record to given log. The record is buffered and written
+ * to the storage by `record_log_commit()`, or when the write buffer
+ * is full.
+ *
+ * @param[in] self_p Started record log.
+ * @param[in] buf_p Record data.
+ * @param[in] size Record size. At most
+ *                 ``RECORD_LOG_RECORD_SIZE_MAX`` bytes.
+ *
+ * @return zero(0) or negative error code.
+ */
+int record_log_append(struct record_log_t *self_p,
+                      const void *buf_p,
+                      size_t size);
+
+/**
+ * Write all appended records to the storage with a single write.
+ *
+ * @param[in] self_p Started record log.
+ *
+ * @return zero(0) or negative error code.
+ */
+int record_log_commit(struct record_log_t *self_p);
+
+/**
+ * Initialize given iterator to read the records of given log, oldest
+ * first. Appended records are committed.
+ *
+ * @param[out] self_p Iterator to initialize.
+ * @param[in] log_p Started record log.
+ *
+ * @return zero(0) or negative error code.
+ */
+int record_log_iter_init(struct record_log_iter_t *self_p,
+                         struct record_log_t *log_p);
+
+/**
+ * Read the next record.
+ *
+ * @param[in] self_p Initialized iterator.
+ * @param[out] buf_p Buffer to read the record into.
+ * @param[in] size Size of the buffer.
+ *
+ * @return Record size, zero(0) when all records have been read, or
+ *         negative error code.
+ */
+ssize_t record_log_iter_read(struct record_log_iter_t *self_p,
+                             void *buf_p,
+                             size_t size);
+
+#endif
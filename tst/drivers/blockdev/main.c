@@ -0,0 +1,470 @@
+/**
+ * @file main.c
+ * @version 0.5.0
+ *
+ * @section License
+ * Copyright (C) 2016, Erik Moqvist
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Simba project.
+ */
+
+#include "simba.h"
+
+#define BLOCK_SIZE BLOCKDEV_BLOCK_SIZE
+
+/* Large enough for a formatted fat16 volume. */
+static uint8_t ram[32768 * BLOCK_SIZE];
+
+static struct blockdev_ram_t ram_dev;
+static struct blockdev_t blockdev;
+static uint8_t merge_buf[8 * BLOCK_SIZE];
+static struct blockdev_cache_block_t cache_blocks[4];
+static uint8_t buf[8 * BLOCK_SIZE];
+static uint8_t bufs[4][BLOCK_SIZE];
+
+/* Transfers made to the RAM device. */
+static struct {
+    int direction;
+    uint32_t block;
+    size_t count;
+} transfers[16];
+static int transfers_length;
+
+static ssize_t read_blocks(void *arg_p,
+                           void *dst_p,
+                           uint32_t src_block,
+                           size_t count)
+{
+    if (transfers_length < membersof(transfers)) {
+        transfers[transfers_length].direction = BLOCKDEV_REQUEST_READ;
+        transfers[transfers_length].block = src_block;
+        transfers[transfers_length].count = count;
+    }
+
+    transfers_length++;
+
+    return (blockdev_ram_read(arg_p, dst_p, src_block, count));
+}
+
+static ssize_t write_blocks(void *arg_p,
+                            uint32_t dst_block,
+                            const void *src_p,
+                            size_t count)
+{
+    if (transfers_length < membersof(transfers)) {
+        transfers[transfers_length].direction = BLOCKDEV_REQUEST_WRITE;
+        transfers[transfers_length].block = dst_block;
+        transfers[transfers_length].count = count;
+    }
+
+    transfers_length++;
+
+    return (blockdev_ram_write(arg_p, dst_block, src_p, count));
+}
+
+static int init(void)
+{
+    memset(ram, 0, sizeof(ram));
+    transfers_length = 0;
+
+    BTASSERT(blockdev_ram_init(&ram_dev, ram, sizeof(ram)) == 0);
+    BTASSERT(blockdev_init(&blockdev, read_blocks, write_blocks, &ram_dev) == 0);
+
+    return (0);
+}
+
+static int test_read_write(struct harness_t *harness_p)
+{
+    int i;
+
+    BTASSERT(init() == 0);
+
+    for (i = 0; i < sizeof(buf); i++) {
+        buf[i] = i;
+    }
+
+    BTASSERT(blockdev_write_blocks(&blockdev, 3, buf, 8) == 8 * BLOCK_SIZE);
+    BTASSERT(blockdev_write_block(&blockdev, 11, buf) == BLOCK_SIZE);
+    BTASSERT(transfers_length == 2);
+    BTASSERT(memcmp(&ram[3 * BLOCK_SIZE], buf, sizeof(buf)) == 0);
+
+    memset(buf, 0, sizeof(buf));
+    BTASSERT(blockdev_read_blocks(&blockdev, buf, 4, 2) == 2 * BLOCK_SIZE);
+    BTASSERT(memcmp(buf, &ram[4 * BLOCK_SIZE], 2 * BLOCK_SIZE) == 0);
+    BTASSERT(blockdev_read_block(&blockdev, buf, 11) == BLOCK_SIZE);
+    BTASSERT(memcmp(buf, &ram[3 * BLOCK_SIZE], BLOCK_SIZE) == 0);
+    BTASSERT(transfers_length == 4);
+
+    /* Out of range. */
+    BTASSERT(blockdev_read_block(&blockdev, buf, 32768) == -EINVAL);
+
+    return (0);
+}
+
+static int test_merge(struct harness_t *harness_p)
+{
+    struct blockdev_request_t requests[4];
+    int i;
+
+    BTASSERT(init() == 0);
+
+    /* Adjacent blocks and adjacent buffers are merged without a
+       merge buffer. */
+    for (i = 0; i < 4; i++) {
+        memset(&buf[BLOCK_SIZE * i], i, BLOCK_SIZE);
+        BTASSERT(blockdev_request_init(&requests[i],
+                                       BLOCKDEV_REQUEST_WRITE,
+                                       &buf[BLOCK_SIZE * i],
+                                       20 + i,
+                                       1) == 0);
+    }
+
+    BTASSERT(blockdev_submit(&blockdev, &requests[2]) == 0);
+    BTASSERT(blockdev_submit(&blockdev, &requests[0]) == 0);
+    BTASSERT(blockdev_submit(&blockdev, &requests[3]) == 0);
+    BTASSERT(blockdev_submit(&blockdev, &requests[1]) == 0);
+    BTASSERT(transfers_length == 0);
+    BTASSERT(blockdev_dispatch(&blockdev) == 0);
+    BTASSERT(transfers_length == 1);
+    BTASSERT(transfers[0].block == 20);
+    BTASSERT(transfers[0].count == 4);
+
+    for (i = 0; i < 4; i++) {
+        BTASSERT(requests[i].done == 1);
+        BTASSERT(blockdev_wait(&blockdev, &requests[i]) == BLOCK_SIZE);
+        BTASSERT(ram[BLOCK_SIZE * (20 + i)] == i);
+    }
+
+    /* Buffers that are not adjacent are not merged without a merge
+       buffer. */
+    for (i = 0; i < 4; i++) {
+        BTASSERT(blockdev_request_init(&requests[i],
+                                       BLOCKDEV_REQUEST_READ,
+                                       &bufs[3 - i][0],
+                                       20 + i,
+                                       1) == 0);
+        BTASSERT(blockdev_submit(&blockdev, &requests[i]) == 0);
+    }
+
+    transfers_length = 0;
+    BTASSERT(blockdev_dispatch(&blockdev) == 0);
+    BTASSERT(transfers_length == 4);
+
+    for (i = 0; i < 4; i++) {
+        BTASSERT(bufs[3 - i][0] == i);
+    }
+
+    /* With a merge buffer they are. */
+    BTASSERT(blockdev_set_merge_buffer(&blockdev,
+                                       merge_buf,
+                                       sizeof(merge_buf)) == 0);
+    memset(bufs, 0xff, sizeof(bufs));
+
+    for (i = 0; i < 4; i++) {
+        BTASSERT(blockdev_submit(&blockdev, &requests[i]) == 0);
+    }
+
+    transfers_length = 0;
+    BTASSERT(blockdev_wait(&blockdev, &requests[1]) == BLOCK_SIZE);
+    BTASSERT(transfers_length == 1);
+    BTASSERT(transfers[0].direction == BLOCKDEV_REQUEST_READ);
+    BTASSERT(transfers[0].block == 20);
+    BTASSERT(transfers[0].count == 4);
+
+    for (i = 0; i < 4; i++) {
+        BTASSERT(bufs[3 - i][0] == i);
+        BTASSERT(bufs[3 - i][BLOCK_SIZE - 1] == i);
+    }
+
+    /* Reads and writes are not merged. */
+    requests[1].direction = BLOCKDEV_REQUEST_WRITE;
+
+    for (i = 0; i < 4; i++) {
+        BTASSERT(blockdev_submit(&blockdev, &requests[i]) == 0);
+    }
+
+    transfers_length = 0;
+    BTASSERT(blockdev_dispatch(&blockdev) == 0);
+    BTASSERT(transfers_length == 3);
+
+    return (0);
+}
+
+static int test_elevator(struct harness_t *harness_p)
+{
+    struct blockdev_request_t requests[5];
+    uint32_t blocks[5] = { 50, 10, 30, 60, 5 };
+    int i;
+
+    BTASSERT(init() == 0);
+
+    for (i = 0; i < 3; i++) {
+        BTASSERT(blockdev_request_init(&requests[i],
+                                       BLOCKDEV_REQUEST_READ,
+                                       bufs[i],
+                                       blocks[i],
+                                       1) == 0);
+        BTASSERT(blockdev_submit(&blockdev, &requests[i]) == 0);
+    }
+
+    /* Served in ascending order. */
+    BTASSERT(blockdev_dispatch(&blockdev) == 0);
+    BTASSERT(transfers_length == 3);
+    BTASSERT(transfers[0].block == 10);
+    BTASSERT(transfers[1].block == 30);
+    BTASSERT(transfers[2].block == 50);
+
+    /* Continue upwards from block 51 and then wrap around. */
+    for (i = 3; i < 5; i++) {
+        BTASSERT(blockdev_request_init(&requests[i],
+                                       BLOCKDEV_REQUEST_READ,
+                                       bufs[i - 3],
+                                       blocks[i],
+                                       1) == 0);
+        BTASSERT(blockdev_submit(&blockdev, &requests[i]) == 0);
+    }
+
+    BTASSERT(blockdev_dispatch(&blockdev) == 0);
+    BTASSERT(transfers_length == 5);
+    BTASSERT(transfers[3].block == 60);
+    BTASSERT(transfers[4].block == 5);
+
+    return (0);
+}
+
+static int test_deadline(struct harness_t *harness_p)
+{
+    struct blockdev_request_t low;
+    struct blockdev_request_t high;
+    int i;
+
+    BTASSERT(init() == 0);
+
+    /* Move the elevator to block 100. */
+    BTASSERT(blockdev_read_block(&blockdev, buf, 99) == BLOCK_SIZE);
+
+    BTASSERT(blockdev_request_init(&low,
+                                   BLOCKDEV_REQUEST_READ,
+                                   bufs[0],
+                                   0,
+                                   1) == 0);
+    BTASSERT(blockdev_submit(&blockdev, &low) == 0);
+
+    /* Requests above the elevator are served first until the
+       deadline of the low request has passed. */
+    for (i = 0; i < BLOCKDEV_REQUEST_DEADLINE; i++) {
+        BTASSERT(blockdev_request_init(&high,
+                                       BLOCKDEV_REQUEST_READ,
+                                       bufs[1],
+                                       100 + i,
+                                       1) == 0);
+        BTASSERT(blockdev_submit(&blockdev, &high) == 0);
+        BTASSERT(blockdev_wait(&blockdev, &high) == BLOCK_SIZE);
+        BTASSERT(low.done == 0);
+    }
+
+    BTASSERT(blockdev_submit(&blockdev, &high) == 0);
+    BTASSERT(blockdev_wait(&blockdev, &high) == BLOCK_SIZE);
+    BTASSERT(low.done == 1);
+    BTASSERT(transfers[transfers_length - 2].block == 0);
+
+    return (0);
+}
+
+static int test_overlap(struct harness_t *harness_p)
+{
+    struct blockdev_request_t requests[4];
+
+    BTASSERT(init() == 0);
+
+    /* A read of blocks 20-21 is queued after a write of block 21 and
+       must see the written data, although the elevator reaches block
+       20 first. */
+    memset(bufs[0], 0x11, BLOCK_SIZE);
+    BTASSERT(blockdev_request_init(&requests[0],
+                                   BLOCKDEV_REQUEST_WRITE,
+                                   bufs[0],
+                                   21,
+                                   1) == 0);
+    BTASSERT(blockdev_submit(&blockdev, &requests[0]) == 0);
+    BTASSERT(blockdev_request_init(&requests[1],
+                                   BLOCKDEV_REQUEST_READ,
+                                   &buf[0],
+                                   20,
+                                   2) == 0);
+    BTASSERT(blockdev_submit(&blockdev, &requests[1]) == 0);
+
+    /* Overlapping writes are applied in queue order. */
+    memset(bufs[1], 0x22, BLOCK_SIZE);
+    memset(&buf[2 * BLOCK_SIZE], 0x33, 2 * BLOCK_SIZE);
+    BTASSERT(blockdev_request_init(&requests[2],
+                                   BLOCKDEV_REQUEST_WRITE,
+                                   bufs[1],
+                                   31,
+                                   1) == 0);
+    BTASSERT(blockdev_submit(&blockdev, &requests[2]) == 0);
+    BTASSERT(blockdev_request_init(&requests[3],
+                                   BLOCKDEV_REQUEST_WRITE,
+                                   &buf[2 * BLOCK_SIZE],
+                                   30,
+                                   2) == 0);
+    BTASSERT(blockdev_submit(&blockdev, &requests[3]) == 0);
+
+    BTASSERT(blockdev_dispatch(&blockdev) == 0);
+    BTASSERT(requests[1].res == 2 * BLOCK_SIZE);
+    BTASSERT(buf[0] == 0x00);
+    BTASSERT(buf[BLOCK_SIZE] == 0x11);
+    BTASSERT(ram[30 * BLOCK_SIZE] == 0x33);
+    BTASSERT(ram[31 * BLOCK_SIZE] == 0x33);
+
+    return (0);
+}
+
+static int test_cache(struct harness_t *harness_p)
+{
+    int i;
+
+    BTASSERT(init() == 0);
+    BTASSERT(blockdev_set_merge_buffer(&blockdev,
+                                       merge_buf,
+                                       sizeof(merge_buf)) == 0);
+    BTASSERT(blockdev_set_cache(&blockdev,
+                                cache_blocks,
+                                membersof(cache_blocks)) == 0);
+
+    /* Written to the cache only. */
+    for (i = 0; i < 4; i++) {
+        memset(buf, i + 1, BLOCK_SIZE);
+        BTASSERT(blockdev_write_block(&blockdev, 13 - i, buf) == BLOCK_SIZE);
+    }
+
+    BTASSERT(transfers_length == 0);
+    BTASSERT(blockdev_read_block(&blockdev, buf, 11) == BLOCK_SIZE);
+    BTASSERT(buf[0] == 3);
+    BTASSERT(transfers_length == 0);
+
+    /* Multiple block reads see the cached blocks. */
+    BTASSERT(blockdev_read_blocks(&blockdev, buf, 9, 4) == 4 * BLOCK_SIZE);
+    BTASSERT(buf[0] == 0);
+    BTASSERT(buf[BLOCK_SIZE] == 4);
+    BTASSERT(buf[3 * BLOCK_SIZE] == 2);
+    BTASSERT(transfers_length == 1);
+
+    /* The dirty blocks are written with one transfer. */
+    BTASSERT(blockdev_flush(&blockdev) == 0);
+    BTASSERT(transfers_length == 2);
+    BTASSERT(transfers[1].direction == BLOCKDEV_REQUEST_WRITE);
+    BTASSERT(transfers[1].block == 10);
+    BTASSERT(transfers[1].count == 4);
+    BTASSERT(ram[10 * BLOCK_SIZE] == 4);
+    BTASSERT(ram[13 * BLOCK_SIZE] == 1);
+
+    /* Nothing to flush. */
+    BTASSERT(blockdev_flush(&blockdev) == 0);
+    BTASSERT(transfers_length == 2);
+
+    /* Evicting a dirty block writes back all dirty blocks. Blocks 13
+       and 12 are the least recently used. */
+    memset(buf, 5, BLOCK_SIZE);
+    BTASSERT(blockdev_write_block(&blockdev, 10, buf) == BLOCK_SIZE);
+    BTASSERT(blockdev_write_block(&blockdev, 11, buf) == BLOCK_SIZE);
+    BTASSERT(blockdev_read_block(&blockdev, buf, 40) == BLOCK_SIZE);
+    BTASSERT(blockdev_read_block(&blockdev, buf, 41) == BLOCK_SIZE);
+    BTASSERT(transfers_length == 4);
+    BTASSERT(ram[10 * BLOCK_SIZE] == 4);
+    BTASSERT(blockdev_read_block(&blockdev, buf, 42) == BLOCK_SIZE);
+    BTASSERT(transfers_length == 6);
+    BTASSERT(transfers[4].direction == BLOCKDEV_REQUEST_WRITE);
+    BTASSERT(transfers[4].block == 10);
+    BTASSERT(transfers[4].count == 2);
+    BTASSERT(transfers[5].block == 42);
+    BTASSERT(ram[10 * BLOCK_SIZE] == 5);
+    BTASSERT(ram[11 * BLOCK_SIZE] == 5);
+
+    return (0);
+}
+
+static int test_fat16(struct harness_t *harness_p)
+{
+    struct fat16_t fs;
+    struct fat16_file_t file;
+
+    BTASSERT(init() == 0);
+    BTASSERT(blockdev_set_merge_buffer(&blockdev,
+                                       merge_buf,
+                                       sizeof(merge_buf)) == 0);
+    BTASSERT(blockdev_set_cache(&blockdev,
+                                cache_blocks,
+                                membersof(cache_blocks)) == 0);
+
+    /* Mount a file system on the block device. */
+    BTASSERT(fat16_init(&fs,
+                        (fat16_read_t)blockdev_read_block,
+                        (fat16_write_t)blockdev_write_block,
+                        &blockdev,
+                        0) == 0);
+    BTASSERT(fat16_set_multi_block_functions(
+                 &fs,
+                 (fat16_read_blocks_t)blockdev_read_blocks,
+                 (fat16_write_blocks_t)blockdev_write_blocks) == 0);
+    BTASSERT(fat16_format(&fs) == 0);
+    BTASSERT(fat16_start(&fs) == 0);
+
+    memset(buf, 'a', sizeof(buf));
+    BTASSERT(fat16_file_open(&fs, &file, "FOO.TXT", O_CREAT | O_WRITE) == 0);
+    BTASSERT(fat16_file_write(&file, buf, sizeof(buf)) == sizeof(buf));
+    BTASSERT(fat16_file_close(&file) == 0);
+    BTASSERT(fat16_stop(&fs) == 0);
+    BTASSERT(blockdev_flush(&blockdev) == 0);
+
+    /* Mount the RAM device directly and read the file. */
+    BTASSERT(blockdev_init(&blockdev, read_blocks, write_blocks, &ram_dev) == 0);
+    BTASSERT(fat16_init(&fs,
+                        (fat16_read_t)blockdev_read_block,
+                        (fat16_write_t)blockdev_write_block,
+                        &blockdev,
+                        0) == 0);
+    BTASSERT(fat16_start(&fs) == 0);
+
+    memset(buf, 0, sizeof(buf));
+    BTASSERT(fat16_file_open(&fs, &file, "FOO.TXT", O_READ) == 0);
+    BTASSERT(fat16_file_read(&file, buf, sizeof(buf)) == sizeof(buf));
+    BTASSERT(buf[0] == 'a');
+    BTASSERT(buf[sizeof(buf) - 1] == 'a');
+    BTASSERT(fat16_file_close(&file) == 0);
+    BTASSERT(fat16_stop(&fs) == 0);
+
+    return (0);
+}
+
+int main()
+{
+    struct harness_t harness;
+    struct harness_testcase_t harness_testcases[] = {
+        { test_read_write, "test_read_write" },
+        { test_merge, "test_merge" },
+        { test_elevator, "test_elevator" },
+        { test_deadline, "test_deadline" },
+        { test_overlap, "test_overlap" },
+        { test_cache, "test_cache" },
+        { test_fat16, "test_fat16" },
+        { NULL, NULL }
+    };
+
+    sys_start();
+
+    harness_init(&harness);
+    harness_run(&harness, harness_testcases);
+
+    return (0);
+}
@@ -6,3 +6,4 @@ FILENAME=sdcard
 
 rm -f ${FILENAME}
 seq 1000 | xargs > ${FILENAME}
+dd if=/dev/zero of=${FILENAME} bs=1024 count=0 seek=1024
@@ -20,12 +20,27 @@
 
 #include "simba.h"
 
+#if defined(ARCH_LINUX)
+/* The slave select pin is not used by the SD card emulator. */
+#    define pin_sd_ss_dev pin_d10_dev
+
+extern long spi_stub_get_commands(void);
+extern long spi_stub_get_erase_count(void);
+#else
+#    define pin_sd_ss_dev pin_d53_dev
+#endif
+
+/* Number of blocks transferred by the throughput test. */
+#define THROUGHPUT_BLOCKS 32
+
 static struct spi_driver_t spi;
 static struct sd_driver_t sd;
 
 static char reference[SD_BLOCK_SIZE];
 static char zeros[SD_BLOCK_SIZE];
 static char buf[SD_BLOCK_SIZE];
+static uint8_t blocks_reference[THROUGHPUT_BLOCKS * SD_BLOCK_SIZE];
+static uint8_t blocks_buf[THROUGHPUT_BLOCKS * SD_BLOCK_SIZE];
 
 static int test_read_cid_csd(struct harness_t *harness_p)
 {
@@ -187,7 +202,7 @@ static int test_read_write(struct harness_t *harness_p)
 
     memset(zeros, 0, sizeof(zeros));
 
-    /* Erase, write and read the first block. */
+    /* Erase, write and read the first blocks. */
     for (block = 0; block < 5; block++) {
         std_printf(FSTR("block = %d\r\n"), block);
 
@@ -195,13 +210,13 @@ static int test_read_write(struct harness_t *harness_p)
             reference[i] = (block + i);
         }
 
-        BTASSERT(sd_write_block(&sd, 0, reference) == SD_BLOCK_SIZE);
+        BTASSERT(sd_write_block(&sd, block, reference) == SD_BLOCK_SIZE);
         memset(buf, 0, sizeof(buf));
         BTASSERT(sd_read_block(&sd, buf, block) == SD_BLOCK_SIZE);
         BTASSERT(memcmp(buf, reference, SD_BLOCK_SIZE) == 0);
 
         /* Write zeros to the block. */
-        BTASSERT(sd_write_block(&sd, 0, zeros) == SD_BLOCK_SIZE);
+        BTASSERT(sd_write_block(&sd, block, zeros) == SD_BLOCK_SIZE);
         memset(buf, -1, sizeof(buf));
         BTASSERT(sd_read_block(&sd, buf, block) == SD_BLOCK_SIZE);
         BTASSERT(memcmp(buf, zeros, SD_BLOCK_SIZE) == 0);
@@ -210,12 +225,159 @@ static int test_read_write(struct harness_t *harness_p)
     return (0);
 }
 
+static int test_read_write_blocks(struct harness_t *harness_p)
+{
+    int i;
+
+    for (i = 0; i < 8 * SD_BLOCK_SIZE; i++) {
+        blocks_reference[i] = (3 * i + i / SD_BLOCK_SIZE);
+    }
+
+    /* Write eight blocks in one command and read them back. */
+    BTASSERT(sd_write_blocks(&sd, 16, blocks_reference, 8)
+             == 8 * SD_BLOCK_SIZE);
+    memset(blocks_buf, 0, sizeof(blocks_buf));
+    BTASSERT(sd_read_blocks(&sd, blocks_buf, 16, 8) == 8 * SD_BLOCK_SIZE);
+    BTASSERT(memcmp(blocks_buf, blocks_reference, 8 * SD_BLOCK_SIZE) == 0);
+
+    /* Each block is where the single block commands expect it. */
+    for (i = 0; i < 8; i++) {
+        BTASSERT(sd_read_block(&sd, buf, 16 + i) == SD_BLOCK_SIZE);
+        BTASSERT(memcmp(buf,
+                        &blocks_reference[i * SD_BLOCK_SIZE],
+                        SD_BLOCK_SIZE) == 0);
+    }
+
+    /* Read a few blocks in the middle, and a single block. */
+    memset(blocks_buf, 0, sizeof(blocks_buf));
+    BTASSERT(sd_read_blocks(&sd, blocks_buf, 18, 3) == 3 * SD_BLOCK_SIZE);
+    BTASSERT(memcmp(blocks_buf,
+                    &blocks_reference[2 * SD_BLOCK_SIZE],
+                    3 * SD_BLOCK_SIZE) == 0);
+    BTASSERT(sd_read_blocks(&sd, blocks_buf, 23, 1) == SD_BLOCK_SIZE);
+    BTASSERT(memcmp(blocks_buf,
+                    &blocks_reference[7 * SD_BLOCK_SIZE],
+                    SD_BLOCK_SIZE) == 0);
+
+    /* Overwrite two blocks in the middle. */
+    memset(blocks_buf, 0, 2 * SD_BLOCK_SIZE);
+    BTASSERT(sd_write_blocks(&sd, 19, blocks_buf, 2) == 2 * SD_BLOCK_SIZE);
+    memset(&blocks_reference[3 * SD_BLOCK_SIZE], 0, 2 * SD_BLOCK_SIZE);
+    BTASSERT(sd_read_blocks(&sd, blocks_buf, 16, 8) == 8 * SD_BLOCK_SIZE);
+    BTASSERT(memcmp(blocks_buf, blocks_reference, 8 * SD_BLOCK_SIZE) == 0);
+
+    /* Zero blocks are not sent to the card. */
+    BTASSERT(sd_read_blocks(&sd, blocks_buf, 16, 0) == 0);
+    BTASSERT(sd_write_blocks(&sd, 16, blocks_buf, 0) == 0);
+
+    /* The following commands still work. */
+    BTASSERT(sd_read_block(&sd, buf, 4) == SD_BLOCK_SIZE);
+    BTASSERT(memcmp(buf, zeros, SD_BLOCK_SIZE) == 0);
+
+    return (0);
+}
+
+static void print_elapsed_time(const char *name_p,
+                               struct time_t *start_p)
+{
+    struct time_t now, diff;
+
+    time_get(&now);
+    time_diff(&diff, &now, start_p);
+    std_printf(FSTR("%s: %lu ms\r\n"),
+               name_p,
+               (unsigned long)(diff.seconds * 1000
+                               + diff.nanoseconds / 1000000));
+}
+
+static int test_throughput(struct harness_t *harness_p)
+{
+    struct time_t start;
+    int i;
+#if defined(ARCH_LINUX)
+    long commands;
+#endif
+
+    for (i = 0; i < sizeof(blocks_reference); i++) {
+        blocks_reference[i] = (i + i / SD_BLOCK_SIZE);
+    }
+
+    /* One command per block. */
+#if defined(ARCH_LINUX)
+    commands = spi_stub_get_commands();
+#endif
+    time_get(&start);
+
+    for (i = 0; i < THROUGHPUT_BLOCKS; i++) {
+        BTASSERT(sd_write_block(&sd,
+                                64 + i,
+                                &blocks_reference[i * SD_BLOCK_SIZE])
+                 == SD_BLOCK_SIZE);
+    }
+
+    print_elapsed_time("single block write", &start);
+#if defined(ARCH_LINUX)
+    /* A write and a status command per block. */
+    BTASSERT(spi_stub_get_commands() - commands == 2 * THROUGHPUT_BLOCKS);
+    commands = spi_stub_get_commands();
+#endif
+    time_get(&start);
+
+    for (i = 0; i < THROUGHPUT_BLOCKS; i++) {
+        BTASSERT(sd_read_block(&sd,
+                               &blocks_buf[i * SD_BLOCK_SIZE],
+                               64 + i) == SD_BLOCK_SIZE);
+    }
+
+    print_elapsed_time("single block read", &start);
+#if defined(ARCH_LINUX)
+    BTASSERT(spi_stub_get_commands() - commands == THROUGHPUT_BLOCKS);
+#endif
+    BTASSERT(memcmp(blocks_buf,
+                    blocks_reference,
+                    sizeof(blocks_reference)) == 0);
+
+    /* All blocks in one command. */
+    for (i = 0; i < sizeof(blocks_reference); i++) {
+        blocks_reference[i] = ~blocks_reference[i];
+    }
+
+#if defined(ARCH_LINUX)
+    commands = spi_stub_get_commands();
+#endif
+    time_get(&start);
+    BTASSERT(sd_write_blocks(&sd, 64, blocks_reference, THROUGHPUT_BLOCKS)
+             == sizeof(blocks_reference));
+    print_elapsed_time("multiple block write", &start);
+#if defined(ARCH_LINUX)
+    /* Pre-erase, write and status. */
+    BTASSERT(spi_stub_get_commands() - commands == 4);
+    BTASSERT(spi_stub_get_erase_count() == THROUGHPUT_BLOCKS);
+    commands = spi_stub_get_commands();
+#endif
+    time_get(&start);
+    BTASSERT(sd_read_blocks(&sd, blocks_buf, 64, THROUGHPUT_BLOCKS)
+             == sizeof(blocks_buf));
+    print_elapsed_time("multiple block read", &start);
+#if defined(ARCH_LINUX)
+    /* Read and stop. */
+    BTASSERT(spi_stub_get_commands() - commands == 2);
+#endif
+    BTASSERT(memcmp(blocks_buf,
+                    blocks_reference,
+                    sizeof(blocks_reference)) == 0);
+
+    return (0);
+}
+
 int main()
 {
     struct harness_t harness;
     struct harness_testcase_t harness_testcases[] = {
         { test_read_cid_csd, "test_read_cid_csd" },
         { test_read_write, "test_read_write" },
+        { test_read_write_blocks, "test_read_write_blocks" },
+        { test_throughput, "test_throughput" },
         { NULL, NULL }
     };
 
@@ -228,7 +390,7 @@ int main()
 
     BTASSERT(spi_init(&spi,
                       &spi_device[0],
-                      &pin_d53_dev,
+                      &pin_sd_ss_dev,
                       SPI_MODE_MASTER,
                       SPI_SPEED_500KBPS,
                       0,
@@ -0,0 +1,430 @@
+/**
+ * @file spi_stub.c
+ * @version 0.5.0
+ *
+ * @section License
+ * Copyright (C) 2016, Erik Moqvist
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Simba project.
+ */
+
+/*
+ * An SD card in SPI mode, emulated on top of the file 'sdcard'. Only
+ * the commands used by the SD driver are implemented. The card is a
+ * high capacity card, so all addresses are block numbers.
+ */
+
+#include "simba.h"
+
+/* Emulator states. */
+#define STATE_COMMAND     0
+#define STATE_WRITE_TOKEN 1
+#define STATE_WRITE_DATA  2
+
+static const uint8_t cid[16] = {
+    0x03, 'S', 'M', 'S', 'i', 'm', 'b', 'a', 0x10,
+    0x00, 0x00, 0x04, 0xd2, 0x01, 0x0a, 0x01
+};
+
+static const uint8_t csd[16] = {
+    0x40, 0x0e, 0x00, 0x32, 0x5b, 0x59, 0x00, 0x00,
+    0x00, 0x01, 0x7f, 0x80, 0x0a, 0x40, 0x00, 0x01
+};
+
+static struct {
+    FILE *file_p;
+    int state;
+    int idle;
+    int app_command;
+    int write_multiple;
+    /* Next block to send in a multiple block read, or -1. */
+    long read_block;
+    uint32_t write_block;
+    struct {
+        uint8_t buf[6];
+        size_t size;
+    } command;
+    /* Data block and checksum received from the host. */
+    struct {
+        uint8_t buf[SD_BLOCK_SIZE + 2];
+        size_t size;
+    } data;
+    /* Bytes to send to the host. */
+    struct {
+        uint8_t buf[SD_BLOCK_SIZE + 8];
+        size_t pos;
+        size_t size;
+    } output;
+    long commands;
+    long erase_count;
+} card;
+
+static void output_reset(void)
+{
+    card.output.pos = 0;
+    card.output.size = 0;
+}
+
+static void output_put(uint8_t value)
+{
+    card.output.buf[card.output.size++] = value;
+}
+
+/**
+ * Queue given data with a start token and checksum.
+ */
+static void output_data_block(const void *buf_p, size_t size)
+{
+    uint16_t crc;
+
+    crc = crc_xmodem(0, buf_p, size);
+
+    /* One byte access time before the start token. */
+    output_put(0xff);
+    output_put(0xfe);
+    memcpy(&card.output.buf[card.output.size], buf_p, size);
+    card.output.size += size;
+    output_put(crc >> 8);
+    output_put(crc);
+}
+
+static void output_file_block(uint32_t block)
+{
+    uint8_t buf[SD_BLOCK_SIZE];
+    size_t size;
+
+    size = 0;
+
+    if (fseek(card.file_p, SD_BLOCK_SIZE * block, SEEK_SET) == 0) {
+        size = fread(buf, 1, sizeof(buf), card.file_p);
+    }
+
+    /* Blocks after the end of the file are zero. */
+    memset(&buf[size], 0, sizeof(buf) - size);
+    output_data_block(buf, sizeof(buf));
+}
+
+static void execute_command(void)
+{
+    uint8_t index;
+    uint32_t arg;
+    uint8_t r1;
+    int app_command;
+
+    index = (card.command.buf[0] & 0x3f);
+    arg = ((card.command.buf[1] << 24)
+           | (card.command.buf[2] << 16)
+           | (card.command.buf[3] << 8)
+           | (card.command.buf[4] << 0));
+    r1 = card.idle;
+    app_command = card.app_command;
+    card.app_command = 0;
+    card.commands++;
+
+    /* Any command ends an ongoing multiple block read. */
+    card.read_block = -1;
+
+    output_reset();
+
+    /* One byte response time. */
+    output_put(0xff);
+
+    if (app_command) {
+        switch (index) {
+
+        case 23:
+            card.erase_count = arg;
+            output_put(r1);
+            break;
+
+        case 41:
+            card.idle = 0;
+            output_put(0);
+            break;
+
+        default:
+            output_put(r1 | 0x04);
+            break;
+        }
+
+        return;
+    }
+
+    switch (index) {
+
+    case 0:
+        card.idle = 1;
+        card.state = STATE_COMMAND;
+        output_put(1);
+        break;
+
+    case 8:
+        output_put(r1);
+        output_put(0);
+        output_put(0);
+        output_put(1);
+        output_put(arg);
+        break;
+
+    case 9:
+        output_put(r1);
+        output_data_block(csd, sizeof(csd));
+        break;
+
+    case 10:
+        output_put(r1);
+        output_data_block(cid, sizeof(cid));
+        break;
+
+    case 12:
+        /* Stuff byte, response and busy. */
+        output_put(r1);
+        output_put(0);
+        output_put(0);
+        break;
+
+    case 13:
+        output_put(r1);
+        output_put(0);
+        break;
+
+    case 17:
+        output_put(r1);
+        output_file_block(arg);
+        break;
+
+    case 18:
+        output_put(r1);
+        card.read_block = arg;
+        break;
+
+    case 24:
+    case 25:
+        output_put(r1);
+        card.write_block = arg;
+        card.write_multiple = (index == 25);
+        card.state = STATE_WRITE_TOKEN;
+        break;
+
+    case 55:
+        card.app_command = 1;
+        output_put(r1);
+        break;
+
+    case 58:
+        output_put(r1);
+        output_put(0xc0);
+        output_put(0xff);
+        output_put(0x80);
+        output_put(0x00);
+        break;
+
+    case 59:
+        output_put(r1);
+        break;
+
+    default:
+        output_put(r1 | 0x04);
+        break;
+    }
+}
+
+static void write_data_block(void)
+{
+    uint16_t crc;
+
+    crc = ((card.data.buf[SD_BLOCK_SIZE] << 8)
+           | card.data.buf[SD_BLOCK_SIZE + 1]);
+
+    output_reset();
+
+    if (crc_xmodem(0, card.data.buf, SD_BLOCK_SIZE) != crc) {
+        output_put(0x0b);
+    } else {
+        fseek(card.file_p, SD_BLOCK_SIZE * card.write_block, SEEK_SET);
+        fwrite(card.data.buf, 1, SD_BLOCK_SIZE, card.file_p);
+        fflush(card.file_p);
+        card.write_block++;
+
+        /* Data accepted, followed by busy. */
+        output_put(0x05);
+        output_put(0);
+        output_put(0);
+    }
+
+    if (card.write_multiple) {
+        card.state = STATE_WRITE_TOKEN;
+    } else {
+        card.state = STATE_COMMAND;
+    }
+}
+
+static void input_write_token(uint8_t value)
+{
+    if (card.write_multiple) {
+        if (value == 0xfc) {
+            card.data.size = 0;
+            card.state = STATE_WRITE_DATA;
+        } else if (value == 0xfd) {
+            /* One byte delay before busy. */
+            output_reset();
+            output_put(0xff);
+            output_put(0);
+            output_put(0);
+            card.state = STATE_COMMAND;
+        }
+    } else if (value == 0xfe) {
+        card.data.size = 0;
+        card.state = STATE_WRITE_DATA;
+    }
+}
+
+/**
+ * Exchange one byte with the card.
+ */
+static uint8_t transfer_byte(uint8_t value)
+{
+    uint8_t response;
+
+    /* Send the next block in a multiple block read when the previous
+       one is sent. */
+    if ((card.output.pos == card.output.size) && (card.read_block >= 0)) {
+        output_reset();
+        output_file_block(card.read_block);
+        card.read_block++;
+    }
+
+    if (card.output.pos < card.output.size) {
+        response = card.output.buf[card.output.pos++];
+    } else {
+        response = 0xff;
+    }
+
+    switch (card.state) {
+
+    case STATE_WRITE_TOKEN:
+        input_write_token(value);
+        break;
+
+    case STATE_WRITE_DATA:
+        card.data.buf[card.data.size++] = value;
+
+        if (card.data.size == sizeof(card.data.buf)) {
+            write_data_block();
+        }
+
+        break;
+
+    default:
+        /* Commands start with the bits 01. */
+        if ((card.command.size > 0) || ((value & 0xc0) == 0x40)) {
+            card.command.buf[card.command.size++] = value;
+
+            if (card.command.size == sizeof(card.command.buf)) {
+                card.command.size = 0;
+                execute_command();
+            }
+        }
+
+        break;
+    }
+
+    return (response);
+}
+
+long spi_stub_get_commands(void)
+{
+    return (card.commands);
+}
+
+long spi_stub_get_erase_count(void)
+{
+    return (card.erase_count);
+}
+
+int spi_module_init(void)
+{
+    return (0);
+}
+
+int spi_init(struct spi_driver_t *self_p,
+             struct spi_device_t *dev_p,
+             struct pin_device_t *ss_pin_p,
+             int mode,
+             int speed,
+             int cpol,
+             int cpha)
+{
+    self_p->dev_p = dev_p;
+    self_p->mode = mode;
+    self_p->speed = speed;
+    self_p->cpol = cpol;
+    self_p->cpha = cpha;
+
+    memset(&card, 0, sizeof(card));
+    card.idle = 1;
+    card.read_block = -1;
+    card.file_p = fopen("sdcard", "r+b");
+
+    return (card.file_p == NULL ? -1 : 0);
+}
+
+ssize_t spi_transfer(struct spi_driver_t *self_p,
+                     void *rxbuf_p,
+                     const void *txbuf_p,
+                     size_t size)
+{
+    const uint8_t *u8_txbuf_p;
+    uint8_t *u8_rxbuf_p;
+    uint8_t response;
+    size_t i;
+
+    u8_txbuf_p = txbuf_p;
+    u8_rxbuf_p = rxbuf_p;
+
+    for (i = 0; i < size; i++) {
+        response = transfer_byte(u8_txbuf_p != NULL ? u8_txbuf_p[i] : 0xff);
+
+        if (u8_rxbuf_p != NULL) {
+            u8_rxbuf_p[i] = response;
+        }
+    }
+
+    return (size);
+}
+
+ssize_t spi_read(struct spi_driver_t *self_p,
+                 void *rxbuf_p,
+                 size_t size)
+{
+    return (spi_transfer(self_p, rxbuf_p, NULL, size));
+}
+
+ssize_t spi_write(struct spi_driver_t *self_p,
+                  const void *txbuf_p,
+                  size_t size)
+{
+    return (spi_transfer(self_p, NULL, txbuf_p, size));
+}
+
+ssize_t spi_get(struct spi_driver_t *self_p,
+                uint8_t *data_p)
+{
+    return (spi_read(self_p, data_p, 1));
+}
+
+ssize_t spi_put(struct spi_driver_t *self_p,
+                uint8_t data)
+{
+    return (spi_write(self_p, &data, 1));
+}
@@ -18,49 +18,248 @@
  * This file is part of the Simba project.
  */
 
+/*
+ * The received data is expected to be the transmitted data. Connect
+ * MOSI to MISO when running on hardware.
+ */
+
 #include "simba.h"
 
-static char qinbuf[32];
-static struct uart_driver_t uart;
 static struct spi_driver_t spi;
+static struct spi_driver_t spi_other;
 static uint8_t txbuf[128];
 static uint8_t rxbuf[128];
 
-int main()
+/* Order in which the transaction complete callbacks are called. */
+static int order[8];
+static int order_length;
+
+static void on_complete(struct spi_transaction_t *transaction_p,
+                        void *arg_p)
 {
-    int i;
+    order[order_length++] = (int)(long)arg_p;
+}
 
-    sys_start();
-    uart_module_init();
-    spi_module_init();
+static struct spi_transaction_t *chain_p;
+static int chain_length;
 
-    uart_init(&uart, &uart_device[0], 38400, qinbuf, sizeof(qinbuf));
-    uart_start(&uart);
-    sys_set_stdout(&uart.chout);
+static void on_complete_chain(struct spi_transaction_t *transaction_p,
+                              void *arg_p)
+{
+    /* Queue the next transaction from the callback. */
+    if (chain_length > 0) {
+        chain_length--;
+        spi_transfer_async_isr(chain_p);
+        chain_p++;
+    }
+}
 
-    spi_init(&spi,
-             &spi_device[0],
-             &pin_d5_dev,
-             SPI_MODE_MASTER,
-             SPI_SPEED_1MBPS,
-             0,
-             0);
+static int requeue_length;
 
-    std_printf(sys_get_info());
+static void on_complete_requeue(struct spi_transaction_t *transaction_p,
+                                void *arg_p)
+{
+    /* Queue the same transaction again from the callback. */
+    if (requeue_length > 0) {
+        requeue_length--;
+        spi_transfer_async_isr(transaction_p);
+    }
+}
+
+static int test_transfer(struct harness_t *harness_p)
+{
+    int i;
+    uint8_t value;
 
     for (i = 0; i < membersof(txbuf); i++) {
         txbuf[i] = i;
         rxbuf[i] = 1;
     }
 
-    spi_transfer(&spi, &rxbuf[4], &txbuf[4], sizeof(rxbuf) - 8);
+    BTASSERT(spi_transfer(&spi, &rxbuf[4], &txbuf[4], sizeof(rxbuf) - 8)
+             == sizeof(rxbuf) - 8);
+
+    for (i = 0; i < membersof(txbuf); i++) {
+        if ((i < 4) || (i >= membersof(txbuf) - 4)) {
+            BTASSERT(rxbuf[i] == 1);
+        } else {
+            BTASSERT(rxbuf[i] == i);
+        }
+    }
+
+    /* Read only transfers write 0xff. */
+    BTASSERT(spi_read(&spi, rxbuf, 16) == 16);
+
+    for (i = 0; i < 16; i++) {
+        BTASSERT(rxbuf[i] == 0xff);
+    }
+
+    BTASSERT(spi_write(&spi, txbuf, 16) == 16);
+    BTASSERT(spi_put(&spi, 0x12) == 1);
+    BTASSERT(spi_get(&spi, &value) == 1);
+    BTASSERT(value == 0xff);
+
+    /* Empty transfers complete without touching the hardware. */
+    BTASSERT(spi_write(&spi, txbuf, 0) == 0);
+
+    return (0);
+}
+
+static int test_async(struct harness_t *harness_p)
+{
+    int i;
+    struct spi_transaction_t transactions[4];
+    struct spi_driver_t *drivers[4] = {
+        &spi, &spi, &spi_other, &spi
+    };
+#if defined(ARCH_LINUX)
+    long starts;
+#endif
+
+    for (i = 0; i < membersof(txbuf); i++) {
+        txbuf[i] = (2 * i);
+    }
+
+    memset(rxbuf, 0, sizeof(rxbuf));
+    order_length = 0;
+
+    /* The last transfer was made with the first driver. */
+#if defined(ARCH_LINUX)
+    starts = spi_device[0].starts;
+#endif
+
+    /* Queue four transactions, the third with the other driver. */
+    for (i = 0; i < membersof(transactions); i++) {
+        BTASSERT(spi_transaction_init(&transactions[i],
+                                      drivers[i],
+                                      &rxbuf[32 * i],
+                                      &txbuf[32 * i],
+                                      32,
+                                      on_complete,
+                                      (void *)(long)i) == 0);
+        BTASSERT(spi_transfer_async(&transactions[i]) == 0);
+    }
+
+#if defined(ARCH_LINUX)
+    /* Nothing is transferred until next system tick. */
+    BTASSERT(transactions[0].done == 0);
+#endif
+
+    /* Transactions complete in order. */
+    BTASSERT(spi_transfer_wait(&transactions[3]) == 32);
+
+    for (i = 0; i < membersof(transactions); i++) {
+        BTASSERT(transactions[i].done == 1);
+        BTASSERT(transactions[i].res == 32);
+        BTASSERT(order[i] == i);
+    }
+
+    BTASSERT(order_length == 4);
+    BTASSERT(memcmp(rxbuf, txbuf, sizeof(rxbuf)) == 0);
+
+    /* Waiting for a complete transaction returns immediately. */
+    BTASSERT(spi_transfer_wait(&transactions[0]) == 32);
+
+#if defined(ARCH_LINUX)
+    /* Only the driver changes reconfigure the hardware. */
+    BTASSERT(spi_device[0].starts - starts == 2);
+#endif
+
+    return (0);
+}
+
+static int test_async_chain(struct harness_t *harness_p)
+{
+    int i;
+    struct spi_transaction_t transactions[4];
 
     for (i = 0; i < membersof(txbuf); i++) {
-        std_printf(FSTR("[%d]: tx = 0x%x, rx = 0x%x\r\n"),
-                   i,
-                   txbuf[i],
-                   rxbuf[i]);
+        txbuf[i] = (255 - i);
     }
 
+    memset(rxbuf, 0, sizeof(rxbuf));
+
+    for (i = 0; i < membersof(transactions); i++) {
+        BTASSERT(spi_transaction_init(&transactions[i],
+                                      &spi,
+                                      &rxbuf[32 * i],
+                                      &txbuf[32 * i],
+                                      32,
+                                      on_complete_chain,
+                                      NULL) == 0);
+    }
+
+    /* Each callback queues the next transaction. */
+    chain_p = &transactions[1];
+    chain_length = 3;
+    BTASSERT(spi_transfer_async(&transactions[0]) == 0);
+    BTASSERT(spi_transfer_wait(&transactions[0]) == 32);
+    BTASSERT(spi_transfer_wait(&transactions[3]) == 32);
+    BTASSERT(chain_length == 0);
+    BTASSERT(memcmp(rxbuf, txbuf, sizeof(rxbuf)) == 0);
+
+    return (0);
+}
+
+static int test_async_requeue(struct harness_t *harness_p)
+{
+    struct spi_transaction_t transaction;
+
+    memset(rxbuf, 0, sizeof(rxbuf));
+
+    BTASSERT(spi_transaction_init(&transaction,
+                                  &spi,
+                                  rxbuf,
+                                  txbuf,
+                                  32,
+                                  on_complete_requeue,
+                                  NULL) == 0);
+
+    /* The waiter gets the result of the first transfer, although the
+       callback queues the transaction again. */
+    requeue_length = 1;
+    BTASSERT(spi_transfer_async(&transaction) == 0);
+    BTASSERT(spi_transfer_wait(&transaction) == 32);
+    BTASSERT(spi_transfer_wait(&transaction) == 32);
+    BTASSERT(transaction.done == 1);
+    BTASSERT(requeue_length == 0);
+    BTASSERT(memcmp(rxbuf, txbuf, 32) == 0);
+
+    return (0);
+}
+
+int main()
+{
+    struct harness_t harness;
+    struct harness_testcase_t harness_testcases[] = {
+        { test_transfer, "test_transfer" },
+        { test_async, "test_async" },
+        { test_async_chain, "test_async_chain" },
+        { test_async_requeue, "test_async_requeue" },
+        { NULL, NULL }
+    };
+
+    sys_start();
+    uart_module_init();
+    spi_module_init();
+
+    BTASSERT(spi_init(&spi,
+                      &spi_device[0],
+                      &pin_d5_dev,
+                      SPI_MODE_MASTER,
+                      SPI_SPEED_1MBPS,
+                      0,
+                      0) == 0);
+    BTASSERT(spi_init(&spi_other,
+                      &spi_device[0],
+                      &pin_d6_dev,
+                      SPI_MODE_MASTER,
+                      SPI_SPEED_250KBPS,
+                      1,
+                      1) == 0);
+
+    harness_init(&harness);
+    harness_run(&harness, harness_testcases);
+
     return (0);
 }
@@ -28,10 +28,200 @@ extern void socket_stub_input(void *buf_p, size_t size);
 extern void socket_stub_output(void *buf_p, size_t size);
 
 static struct http_server_t foo;
+static struct fat16_t fs;
+static struct deflate_t deflate;
+static struct http_websocket_deflate_t websocket_deflate;
+static FILE *sdcard_p = NULL;
 
 THRD_STACK(listener_stack, 1024);
 THRD_STACK(connection_stack, 1024);
 
+static ssize_t sdcard_read_block(void *arg_p,
+                                 void *dst_p,
+                                 uint32_t src_block)
+{
+    if (fseek(arg_p, SD_BLOCK_SIZE * src_block, SEEK_SET) != 0) {
+        return (-1);
+    }
+
+    return (fread(dst_p, 1, SD_BLOCK_SIZE, arg_p));
+}
+
+static ssize_t sdcard_write_block(void *arg_p,
+                                  uint32_t dst_block,
+                                  const void *src_p)
+{
+    if (fseek(arg_p, SD_BLOCK_SIZE * dst_block, SEEK_SET) != 0) {
+        return (-1);
+    }
+
+    return (fwrite(src_p, 1, SD_BLOCK_SIZE, arg_p));
+}
+
+/**
+ * Clear the modification date of given file in the root of the WWW
+ * directory, as if it was written by a device without a clock.
+ */
+static int clear_file_date(const char *name_p)
+{
+    uint8_t buf[SD_BLOCK_SIZE];
+    struct dir_t *dir_p;
+    uint32_t block;
+    size_t i;
+
+    if (fat16_stop(&fs) != 0) {
+        return (-1);
+    }
+
+    for (block = 0; block < 32768; block++) {
+        if (sdcard_read_block(sdcard_p, buf, block) != SD_BLOCK_SIZE) {
+            return (-1);
+        }
+
+        for (i = 0; i < SD_BLOCK_SIZE; i += sizeof(*dir_p)) {
+            dir_p = (struct dir_t *)&buf[i];
+
+            if (memcmp(dir_p->name, name_p, sizeof(dir_p->name)) == 0) {
+                dir_p->last_write_date = 0;
+
+                if (sdcard_write_block(sdcard_p,
+                                       block,
+                                       buf) != SD_BLOCK_SIZE) {
+                    return (-1);
+                }
+
+                if (fat16_init(&fs,
+                               sdcard_read_block,
+                               sdcard_write_block,
+                               sdcard_p,
+                               0) != 0) {
+                    return (-1);
+                }
+
+                return (fat16_start(&fs));
+            }
+        }
+    }
+
+    return (-1);
+}
+
+/**
+ * Create a file system with the files served by the http server.
+ */
+static int create_file_system(void)
+{
+    struct fat16_dir_t dir;
+    struct fat16_file_t file;
+    char buf[100];
+    int i;
+
+    /* Create an empty 16 MB sd card file. */
+    sdcard_p = fopen("sdcard", "w+b");
+
+    if (sdcard_p == NULL) {
+        return (-1);
+    }
+
+    if (fseek(sdcard_p, 32768 * SD_BLOCK_SIZE - 1, SEEK_SET) != 0) {
+        return (-1);
+    }
+
+    if (fputc(0, sdcard_p) != 0) {
+        return (-1);
+    }
+
+    if (fat16_init(&fs,
+                   sdcard_read_block,
+                   sdcard_write_block,
+                   sdcard_p,
+                   0) != 0) {
+        return (-1);
+    }
+
+    if (fat16_format(&fs) != 0) {
+        return (-1);
+    }
+
+    if (fat16_start(&fs) != 0) {
+        return (-1);
+    }
+
+    /* The http server root directory. */
+    if (fat16_dir_open(&fs, &dir, "WWW", O_CREAT | O_WRITE | O_SYNC) != 0) {
+        return (-1);
+    }
+
+    fat16_dir_close(&dir);
+
+    if (fat16_file_open(&fs,
+                        &file,
+                        "WWW/INDEX.HTM",
+                        O_CREAT | O_WRITE | O_SYNC) != 0) {
+        return (-1);
+    }
+
+    if (fat16_file_write(&file, "<html>Index</html>", 18) != 18) {
+        return (-1);
+    }
+
+    fat16_file_close(&file);
+
+    /* A file spanning several blocks. */
+    if (fat16_file_open(&fs,
+                        &file,
+                        "WWW/APP.JS",
+                        O_CREAT | O_WRITE | O_SYNC) != 0) {
+        return (-1);
+    }
+
+    for (i = 0; i < 10; i++) {
+        memset(buf, '0' + i, sizeof(buf));
+
+        if (fat16_file_write(&file, buf, sizeof(buf)) != sizeof(buf)) {
+            return (-1);
+        }
+    }
+
+    fat16_file_close(&file);
+
+    /* A gzip compressed copy of the file. */
+    if (fat16_dir_open(&fs, &dir, "WWW/GZ", O_CREAT | O_WRITE | O_SYNC) != 0) {
+        return (-1);
+    }
+
+    fat16_dir_close(&dir);
+
+    if (fat16_file_open(&fs,
+                        &file,
+                        "WWW/GZ/APP.JS",
+                        O_CREAT | O_WRITE | O_SYNC) != 0) {
+        return (-1);
+    }
+
+    if (fat16_file_write(&file, "compressed", 10) != 10) {
+        return (-1);
+    }
+
+    fat16_file_close(&file);
+
+    /* A file without a valid modification date. */
+    if (fat16_file_open(&fs,
+                        &file,
+                        "WWW/NODATE.TXT",
+                        O_CREAT | O_WRITE | O_SYNC) != 0) {
+        return (-1);
+    }
+
+    if (fat16_file_write(&file, "nodate", 6) != 6) {
+        return (-1);
+    }
+
+    fat16_file_close(&file);
+
+    return (clear_file_date("NODATE  TXT"));
+}
+
 /**
  * Handler for the index request.
  */
@@ -54,6 +244,64 @@ static int request_index(struct http_server_connection_t *connection_p,
     return (http_server_response_write(connection_p, request_p, &response));
 }
 
+/**
+ * Handler for the stream request. Writes 1000 bytes of JSON in small
+ * pieces.
+ */
+static int request_stream(struct http_server_connection_t *connection_p,
+                          struct http_server_request_t *request_p)
+{
+    struct http_server_response_stream_t stream;
+    int i;
+
+    if (http_server_response_stream_begin(&stream,
+                                          connection_p,
+                                          http_server_response_code_201_created_t,
+                                          "application/json",
+                                          NULL) != 0) {
+        return (-1);
+    }
+
+    for (i = 0; i < 100; i++) {
+        if (http_server_response_stream_write(&stream,
+                                              "0123456789",
+                                              10) != 10) {
+            return (-1);
+        }
+    }
+
+    return (http_server_response_stream_end(&stream));
+}
+
+/**
+ * Handler for the gzip stream request. Writes the same body as the
+ * stream request, compressed.
+ */
+static int request_stream_gzip(struct http_server_connection_t *connection_p,
+                               struct http_server_request_t *request_p)
+{
+    struct http_server_response_stream_t stream;
+    int i;
+
+    if (http_server_response_stream_begin_gzip(&stream,
+                                               connection_p,
+                                               http_server_response_code_200_ok_t,
+                                               "application/json",
+                                               &deflate) != 0) {
+        return (-1);
+    }
+
+    for (i = 0; i < 100; i++) {
+        if (http_server_response_stream_write(&stream,
+                                              "0123456789",
+                                              10) != 10) {
+            return (-1);
+        }
+    }
+
+    return (http_server_response_stream_end(&stream));
+}
+
 /**
  * Handler for the websocket echo request. Echo all websocket messages
  * the client sends on the socket.
@@ -70,6 +318,11 @@ static int request_websocket_echo(struct http_server_connection_t *connection_p,
         return (-1);
     }
 
+    if (http_websocket_server_enable_deflate(&server,
+                                             &websocket_deflate) != 0) {
+        return (-1);
+    }
+
     /* Handshake sequence. */
     if (http_websocket_server_handshake(&server, request_p) != 0) {
         return (-1);
@@ -103,6 +356,13 @@ static int request_404_not_found(struct http_server_connection_t *connection_p,
     size_t size;
     struct http_server_response_t response;
 
+    /* Serve static files from the file system. */
+    res = http_server_response_write_file(connection_p, request_p, &fs);
+
+    if (res != -ENOENT) {
+        return (res);
+    }
+
     /* Create the response. */
     size = std_sprintf(content,
                        FSTR("The requested page '%s' could not be found."),
@@ -129,6 +389,8 @@ static int test_start(struct harness_t *harness_p)
 {
     static struct http_server_route_t routes[] = {
         { .path_p = "/index.html", .callback = request_index },
+        { .path_p = "/stream", .callback = request_stream },
+        { .path_p = "/stream.gz", .callback = request_stream_gzip },
         { .path_p = "/websocket/echo", .callback = request_websocket_echo },
         { .path_p = NULL, .callback = NULL }
     };
@@ -168,11 +430,12 @@ static int test_start(struct harness_t *harness_p)
     };
 
     socket_stub_init();
+    BTASSERT(create_file_system() == 0);
 
     BTASSERT(http_server_init(&foo,
                               &listener,
                               connections,
-                              NULL,
+                              "www",
                               routes,
                               request_404_not_found) == 0);
 
@@ -245,27 +508,39 @@ static int test_request_websocket(struct harness_t *harness_p)
         "\r\n";
 
     socket_stub_output(buf, strlen(str_p));
+    buf[strlen(str_p)] = '\0';
     BTASSERT(strcmp(buf, str_p) == 0);
 
     for (i = 0; i < 3; i++) {
         /* Input a websocket frame on the socket. */
         buf[0] = 0x81; /* FIN & TEXT. */
-        buf[1] = 0x84; /* MASK and 1 byte payload length. */
-        buf[2] = 0x00; /* Masking key 0. */
-        buf[3] = 0x00; /* Masking key 1. */
-        buf[4] = 0x00; /* Masking key 2. */
-        buf[5] = 0x00; /* Masking key 3. */
-        buf[6] = '1';  /* Payload 0. */
-        buf[7] = '2';  /* Payload 1. */
-        buf[8] = '3';  /* Payload 2. */
-        buf[9] = '\0'; /* Payload 3. */
+        buf[1] = 0x84; /* MASK and 4 bytes payload length. */
+        buf[2] = 0x11; /* Masking key 0. */
+        buf[3] = 0x22; /* Masking key 1. */
+        buf[4] = 0x33; /* Masking key 2. */
+        buf[5] = 0x44; /* Masking key 3. */
+        buf[6] = ('1' ^ 0x11);  /* Payload 0. */
+        buf[7] = ('2' ^ 0x22);  /* Payload 1. */
+        buf[8] = ('3' ^ 0x33);  /* Payload 2. */
+        buf[9] = ('\0' ^ 0x44); /* Payload 3. */
         socket_stub_input(buf, 10);
 
-        /* Read the echo frame from the socket. */
-        socket_stub_output(buf, 10);
-        BTASSERT(strcmp(&buf[6], "123") == 0);
+        /* Read the unmasked echo frame from the socket. */
+        socket_stub_output(buf, 6);
+        BTASSERT(buf[0] == 0x81);
+        BTASSERT(buf[1] == 0x04);
+        BTASSERT(strcmp(&buf[2], "123") == 0);
     }
 
+    /* Close the connection. The close frame is echoed. */
+    buf[0] = 0x88; /* FIN & CLOSE. */
+    buf[1] = 0x80; /* MASK and no payload. */
+    memset(&buf[2], 0, 4);
+    socket_stub_input(buf, 6);
+    socket_stub_output(buf, 2);
+    BTASSERT((uint8_t)buf[0] == 0x88);
+    BTASSERT(buf[1] == 0x00);
+
     return (0);
 }
 
@@ -301,6 +576,357 @@ static int test_request_no_route(struct harness_t *harness_p)
     return (0);
 }
 
+/**
+ * Send given request and verify that the response is equal to given
+ * expected response.
+ */
+static int request(const char *request_p, const char *response_p)
+{
+    char buf[1300];
+    size_t size;
+
+    /* Input the accept answer. */
+    socket_stub_accept();
+
+    socket_stub_input((void *)request_p, strlen(request_p));
+
+    size = strlen(response_p);
+    socket_stub_output(buf, size);
+    buf[size] = '\0';
+
+    return (strcmp(buf, response_p));
+}
+
+static int test_request_file(struct harness_t *harness_p)
+{
+    char response[1300];
+    size_t size;
+    int i;
+
+    /* The index file in the root directory. */
+    BTASSERT(request("GET / HTTP/1.1\r\n"
+                     "User-Agent: TestcaseRequestFile\r\n"
+                     "\r\n",
+                     "HTTP/1.1 200 OK\r\n"
+                     "Content-Type: text/html\r\n"
+                     "Content-Length: 18\r\n"
+                     "Accept-Ranges: bytes\r\n"
+                     "ETag: \"12-20000101010000\"\r\n"
+                     "Last-Modified: Sat, 01 Jan 2000 01:00:00 GMT\r\n"
+                     "\r\n"
+                     "<html>Index</html>") == 0);
+
+    /* A file spanning several blocks, in lower case and with a query
+       string. */
+    size = std_sprintf(response,
+                       FSTR("HTTP/1.1 200 OK\r\n"
+                            "Content-Type: application/javascript\r\n"
+                            "Content-Length: 1000\r\n"
+                            "Accept-Ranges: bytes\r\n"
+                            "ETag: \"3e8-20000101010000\"\r\n"
+                            "Last-Modified: Sat, 01 Jan 2000 01:00:00 GMT\r\n"
+                            "\r\n"));
+
+    for (i = 0; i < 10; i++) {
+        memset(&response[size], '0' + i, 100);
+        size += 100;
+    }
+
+    response[size] = '\0';
+
+    BTASSERT(request("GET /app.js?version=2 HTTP/1.1\r\n"
+                     "\r\n",
+                     response) == 0);
+
+    return (0);
+}
+
+static int test_request_file_no_date(struct harness_t *harness_p)
+{
+    /* The Last-Modified header is omitted. */
+    BTASSERT(request("GET /NODATE.TXT HTTP/1.1\r\n"
+                     "If-Modified-Since: Sat, 01 Jan 2000 01:00:00 GMT\r\n"
+                     "\r\n",
+                     "HTTP/1.1 200 OK\r\n"
+                     "Content-Type: text/plain\r\n"
+                     "Content-Length: 6\r\n"
+                     "Accept-Ranges: bytes\r\n"
+                     "ETag: \"6-19800000010000\"\r\n"
+                     "\r\n"
+                     "nodate") == 0);
+
+    return (0);
+}
+
+static int test_request_file_not_modified(struct harness_t *harness_p)
+{
+    BTASSERT(request("GET /APP.JS HTTP/1.1\r\n"
+                     "If-None-Match: \"3e8-20000101010000\"\r\n"
+                     "\r\n",
+                     "HTTP/1.1 304 Not Modified\r\n"
+                     "ETag: \"3e8-20000101010000\"\r\n"
+                     "Last-Modified: Sat, 01 Jan 2000 01:00:00 GMT\r\n"
+                     "\r\n") == 0);
+
+    BTASSERT(request("GET /APP.JS HTTP/1.1\r\n"
+                     "If-Modified-Since: Sat, 01 Jan 2000 01:00:00 GMT\r\n"
+                     "\r\n",
+                     "HTTP/1.1 304 Not Modified\r\n"
+                     "ETag: \"3e8-20000101010000\"\r\n"
+                     "Last-Modified: Sat, 01 Jan 2000 01:00:00 GMT\r\n"
+                     "\r\n") == 0);
+
+    return (0);
+}
+
+static int test_request_file_range(struct harness_t *harness_p)
+{
+    /* A range crossing a block boundary. */
+    BTASSERT(request("GET /APP.JS HTTP/1.1\r\n"
+                     "Range: bytes=498-503\r\n"
+                     "\r\n",
+                     "HTTP/1.1 206 Partial Content\r\n"
+                     "Content-Range: bytes 498-503/1000\r\n"
+                     "Content-Type: application/javascript\r\n"
+                     "Content-Length: 6\r\n"
+                     "Accept-Ranges: bytes\r\n"
+                     "ETag: \"3e8-20000101010000\"\r\n"
+                     "Last-Modified: Sat, 01 Jan 2000 01:00:00 GMT\r\n"
+                     "\r\n"
+                     "445555") == 0);
+
+    /* The last three bytes. */
+    BTASSERT(request("GET /APP.JS HTTP/1.1\r\n"
+                     "Range: bytes=-3\r\n"
+                     "\r\n",
+                     "HTTP/1.1 206 Partial Content\r\n"
+                     "Content-Range: bytes 997-999/1000\r\n"
+                     "Content-Type: application/javascript\r\n"
+                     "Content-Length: 3\r\n"
+                     "Accept-Ranges: bytes\r\n"
+                     "ETag: \"3e8-20000101010000\"\r\n"
+                     "Last-Modified: Sat, 01 Jan 2000 01:00:00 GMT\r\n"
+                     "\r\n"
+                     "999") == 0);
+
+    /* Out of range. */
+    BTASSERT(request("GET /APP.JS HTTP/1.1\r\n"
+                     "Range: bytes=1000-\r\n"
+                     "\r\n",
+                     "HTTP/1.1 416 Range Not Satisfiable\r\n"
+                     "Content-Range: bytes */1000\r\n"
+                     "Content-Length: 0\r\n"
+                     "\r\n") == 0);
+
+    /* A malformed range is ignored. */
+    BTASSERT(request("GET /INDEX.HTM HTTP/1.1\r\n"
+                     "Range: bytes=-\r\n"
+                     "\r\n",
+                     "HTTP/1.1 200 OK\r\n"
+                     "Content-Type: text/html\r\n"
+                     "Content-Length: 18\r\n"
+                     "Accept-Ranges: bytes\r\n"
+                     "ETag: \"12-20000101010000\"\r\n"
+                     "Last-Modified: Sat, 01 Jan 2000 01:00:00 GMT\r\n"
+                     "\r\n"
+                     "<html>Index</html>") == 0);
+
+    return (0);
+}
+
+static int test_request_file_gzip(struct harness_t *harness_p)
+{
+    BTASSERT(request("GET /APP.JS HTTP/1.1\r\n"
+                     "Accept-Encoding: gzip, deflate\r\n"
+                     "\r\n",
+                     "HTTP/1.1 200 OK\r\n"
+                     "Content-Type: application/javascript\r\n"
+                     "Content-Length: 10\r\n"
+                     "Accept-Ranges: bytes\r\n"
+                     "ETag: \"a-20000101010000\"\r\n"
+                     "Last-Modified: Sat, 01 Jan 2000 01:00:00 GMT\r\n"
+                     "Content-Encoding: gzip\r\n"
+                     "Vary: Accept-Encoding\r\n"
+                     "\r\n"
+                     "compressed") == 0);
+
+    /* No compressed copy of the index file. */
+    BTASSERT(request("GET / HTTP/1.1\r\n"
+                     "Accept-Encoding: gzip\r\n"
+                     "\r\n",
+                     "HTTP/1.1 200 OK\r\n"
+                     "Content-Type: text/html\r\n"
+                     "Content-Length: 18\r\n"
+                     "Accept-Ranges: bytes\r\n"
+                     "ETag: \"12-20000101010000\"\r\n"
+                     "Last-Modified: Sat, 01 Jan 2000 01:00:00 GMT\r\n"
+                     "\r\n"
+                     "<html>Index</html>") == 0);
+
+    return (0);
+}
+
+static int test_request_stream(struct harness_t *harness_p)
+{
+    char response[1300];
+    size_t size;
+    int i;
+
+    /* The small writes are coalesced into chunks filling the stream
+       buffer. The header is sent in the first chunk. */
+    size = std_sprintf(response,
+                       FSTR("HTTP/1.1 201 Created\r\n"
+                            "Content-Type: application/json\r\n"
+                            "Transfer-Encoding: chunked\r\n"
+                            "\r\n"
+                            "01b7\r\n"));
+
+    for (i = 0; i < 1000; i++) {
+        if (i == 439) {
+            size += std_sprintf(&response[size], FSTR("\r\n020b\r\n"));
+        } else if (i == 962) {
+            size += std_sprintf(&response[size], FSTR("\r\n0026\r\n"));
+        }
+
+        response[size++] = ('0' + i % 10);
+    }
+
+    size += std_sprintf(&response[size], FSTR("\r\n0\r\n\r\n"));
+    response[size] = '\0';
+
+    BTASSERT(request("GET /stream HTTP/1.1\r\n"
+                     "\r\n",
+                     response) == 0);
+
+    return (0);
+}
+
+static int test_request_stream_gzip(struct harness_t *harness_p)
+{
+    static struct inflate_t inflate;
+    static struct queue_t queue;
+    static char queue_buf[1024];
+    char buf[256];
+    char *str_p;
+    size_t size;
+    int i;
+
+    socket_stub_accept();
+
+    str_p =
+        "GET /stream.gz HTTP/1.1\r\n"
+        "Accept-Encoding: gzip, deflate\r\n"
+        "\r\n";
+    socket_stub_input(str_p, strlen(str_p));
+
+    str_p =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: application/json\r\n"
+        "Content-Encoding: gzip\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "\r\n";
+    socket_stub_output(buf, strlen(str_p));
+    buf[strlen(str_p)] = '\0';
+    BTASSERT(strcmp(buf, str_p) == 0);
+
+    /* The compressed body fits in one chunk. */
+    socket_stub_output(buf, 6);
+    buf[4] = '\0';
+    size = strtol(buf, NULL, 16);
+    BTASSERT(size > 18);
+    BTASSERT(size < 100);
+    socket_stub_output(buf, size + 7);
+    BTASSERT(memcmp(&buf[size], "\r\n0\r\n\r\n", 7) == 0);
+    BTASSERT(memcmp(buf, "\x1f\x8b\x08", 3) == 0);
+
+    /* Decompress the data between the gzip header and trailer. */
+    BTASSERT(queue_init(&queue, queue_buf, sizeof(queue_buf)) == 0);
+    BTASSERT(inflate_init(&inflate, &queue.base) == 0);
+    BTASSERT(inflate_write(&inflate, &buf[10], size - 18) == size - 18);
+
+    for (i = 0; i < 1000; i++) {
+        BTASSERT(queue_read(&queue, &buf[0], 1) == 1);
+        BTASSERT(buf[0] == ('0' + i % 10));
+    }
+
+    BTASSERT(queue_size(&queue) == 0);
+
+    return (0);
+}
+
+static int test_request_websocket_deflate(struct harness_t *harness_p)
+{
+    static const uint8_t key[4] = { 0x11, 0x22, 0x33, 0x44 };
+    /* "Hello" compressed twice by zlib. The second message refers to
+       the first. */
+    static const uint8_t hellos[2][7] = {
+        { 0xf2, 0x48, 0xcd, 0xc9, 0xc9, 0x07, 0x00 },
+        { 0xf2, 0x00, 0x11, 0x00, 0x00 }
+    };
+    static const size_t sizes[2] = { 7, 5 };
+    static struct inflate_t inflate;
+    static struct queue_t queue;
+    static char queue_buf[16];
+    char *str_p;
+    char buf[256];
+    size_t size;
+    int i;
+    int j;
+
+    socket_stub_accept();
+
+    str_p =
+        "GET /websocket/echo HTTP/1.1\r\n"
+        "Upgrade: WebSocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Key: x3JJHMbDL1EzLkh9GBhXDw==\r\n"
+        "Sec-WebSocket-Extensions: permessage-deflate; client_max_window_bits\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "\r\n";
+    socket_stub_input(str_p, strlen(str_p));
+
+    str_p =
+        "HTTP/1.1 101 Switching Protocols\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Accept: HSmrc0sMlYUkAGmm5OPpG2HaGWk=\r\n"
+        "Sec-WebSocket-Extensions: permessage-deflate; "
+        "server_max_window_bits=10; client_max_window_bits=10\r\n"
+        "\r\n";
+    socket_stub_output(buf, strlen(str_p));
+    buf[strlen(str_p)] = '\0';
+    BTASSERT(strcmp(buf, str_p) == 0);
+
+    BTASSERT(queue_init(&queue, queue_buf, sizeof(queue_buf)) == 0);
+    BTASSERT(inflate_init(&inflate, &queue.base) == 0);
+
+    for (i = 0; i < 2; i++) {
+        /* Input a masked and compressed frame. */
+        buf[0] = 0xc1; /* FIN, RSV1 & TEXT. */
+        buf[1] = (0x80 | sizes[i]);
+        memcpy(&buf[2], key, 4);
+
+        for (j = 0; j < sizes[i]; j++) {
+            buf[6 + j] = (hellos[i][j] ^ key[j % 4]);
+        }
+
+        socket_stub_input(buf, 6 + sizes[i]);
+
+        /* The echo is compressed and refers to the previous echo. */
+        socket_stub_output(buf, 2);
+        BTASSERT((uint8_t)buf[0] == 0xc1);
+        size = buf[1];
+        BTASSERT(size <= sizes[i]);
+        socket_stub_output(buf, size);
+        BTASSERT(inflate_write(&inflate, buf, size) == size);
+        BTASSERT(inflate_write(&inflate, "\x00\x00\xff\xff", 4) == 4);
+        BTASSERT(queue_read(&queue, buf, 5) == 5);
+        BTASSERT(memcmp(buf, "Hello", 5) == 0);
+        BTASSERT(queue_size(&queue) == 0);
+    }
+
+    return (0);
+}
+
 static int test_stop(struct harness_t *harness_p)
 {
     BTASSERT(http_server_stop(&foo) == 0);
@@ -315,7 +941,15 @@ int main()
         { test_start, "test_start" },
         { test_request_index, "test_request_index" },
         { test_request_no_route, "test_request_no_route" },
+        { test_request_file, "test_request_file" },
+        { test_request_file_no_date, "test_request_file_no_date" },
+        { test_request_file_not_modified, "test_request_file_not_modified" },
+        { test_request_file_range, "test_request_file_range" },
+        { test_request_file_gzip, "test_request_file_gzip" },
+        { test_request_stream, "test_request_stream" },
+        { test_request_stream_gzip, "test_request_stream_gzip" },
         { test_request_websocket, "test_request_websocket" },
+        { test_request_websocket_deflate, "test_request_websocket_deflate" },
         { test_stop, "test_stop" },
         { NULL, NULL }
     };
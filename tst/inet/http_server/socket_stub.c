@@ -26,6 +26,13 @@ static struct queue_t qinput;
 static struct queue_t qoutput;
 static char qinputbuf[256];
 static char qoutputbuf[256];
+
+/* Input data lent to the application. */
+static struct {
+    char buf[256];
+    size_t offset;
+    size_t size;
+} borrowed;
 static struct event_t accept_events;
 
 static ssize_t read(chan_t *self_p,
@@ -47,6 +54,13 @@ static size_t size(chan_t *self_p)
     return (0);
 }
 
+int socket_inet_aton(const char *src_p, uint32_t *dst_p)
+{
+    *dst_p = 0;
+
+    return (0);
+}
+
 int socket_open(struct socket_t *self_p,
                 int domain,
                 int type,
@@ -92,6 +106,12 @@ int socket_accept(struct socket_t *self_p,
     return (0);
 }
 
+int socket_set_recv_timeout(struct socket_t *self_p,
+                            const struct time_t *timeout_p)
+{
+    return (0);
+}
+
 ssize_t socket_sendto(struct socket_t *self_p,
                       const void *buf_p,
                       size_t size,
@@ -126,8 +146,60 @@ ssize_t socket_read(struct socket_t *self_p,
     return (read(NULL, buf_p, size));
 }
 
+ssize_t socket_writev(struct socket_t *self_p,
+                      const struct socket_iov_t *iov_p,
+                      size_t length,
+                      int flags)
+{
+    size_t i;
+    ssize_t size;
+
+    size = 0;
+
+    for (i = 0; i < length; i++) {
+        size += write(NULL, iov_p[i].buf_p, iov_p[i].size);
+    }
+
+    return (size);
+}
+
+ssize_t socket_recv_borrow(struct socket_t *self_p,
+                           const void **buf_pp)
+{
+    size_t size;
+
+    /* Wait for at least one byte and lend all available input. */
+    if (borrowed.offset == borrowed.size) {
+        size = chan_size(&qinput);
+
+        if (size == 0) {
+            size = 1;
+        }
+
+        if (size > sizeof(borrowed.buf)) {
+            size = sizeof(borrowed.buf);
+        }
+
+        borrowed.offset = 0;
+        borrowed.size = read(NULL, borrowed.buf, size);
+    }
+
+    *buf_pp = &borrowed.buf[borrowed.offset];
+
+    return (borrowed.size - borrowed.offset);
+}
+
+int socket_recv_release(struct socket_t *self_p, size_t size)
+{
+    borrowed.offset += size;
+
+    return (0);
+}
+
 void socket_stub_init()
 {
+    borrowed.offset = 0;
+    borrowed.size = 0;
     queue_init(&qinput, qinputbuf, sizeof(qinputbuf));
     queue_init(&qoutput, qoutputbuf, sizeof(qoutputbuf));
     event_init(&accept_events);
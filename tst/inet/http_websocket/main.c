@@ -0,0 +1,550 @@
+/**
+ * @file main.c
+ * @version 0.5.0
+ *
+ * @section License
+ * Copyright (C) 2014-2016, Erik Moqvist
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Simba project.
+ */
+
+#include "simba.h"
+
+#include "inet.h"
+
+#define TCP_PORT 10090
+#define HUB_TCP_PORT 10091
+#define DEFLATE_TCP_PORT 10092
+
+#define MESSAGE_SIZE_MIN 1024
+#define MESSAGE_SIZE_MAX 65536
+
+/* Number of messages echoed per message size in the benchmark. */
+#define BENCHMARK_MESSAGES 128
+
+static THRD_STACK(server_stack, 1024);
+static THRD_STACK(hub_writer_stacks[2], 1024);
+
+static struct socket_t listener;
+static struct socket_t client;
+static struct socket_t server;
+static struct http_websocket_t client_websocket;
+static uint8_t client_buf[MESSAGE_SIZE_MAX];
+static uint8_t server_buf[MESSAGE_SIZE_MAX];
+static uint8_t message[MESSAGE_SIZE_MAX];
+
+static struct http_websocket_hub_t hub;
+static struct http_websocket_hub_subscriber_t subscribers[2];
+static struct socket_t hub_sockets[2];
+static struct heap_t hub_heap;
+static char heap_buf[2048];
+
+static struct http_websocket_deflate_t deflates[2];
+
+static long elapsed_ms(struct time_t *start_p, struct time_t *stop_p)
+{
+    return (1000L * (stop_p->seconds - start_p->seconds)
+            + (stop_p->nanoseconds - start_p->nanoseconds) / 1000000L);
+}
+
+/**
+ * Websocket echo server thread. Echoes all messages until the
+ * connection is closed.
+ */
+static void *server_main(void *arg_p)
+{
+    struct http_websocket_t websocket;
+    ssize_t size;
+    int type;
+    int *res_p;
+
+    res_p = arg_p;
+    *res_p = -1;
+
+    if (socket_accept(&listener, &server, NULL, NULL) != 0) {
+        return (NULL);
+    }
+
+    http_websocket_init(&websocket, &server, 0);
+
+    while (1) {
+        size = http_websocket_read(&websocket,
+                                   &type,
+                                   server_buf,
+                                   sizeof(server_buf));
+
+        if (size <= 0) {
+            *res_p = size;
+            break;
+        }
+
+        if (http_websocket_write(&websocket,
+                                 type,
+                                 server_buf,
+                                 size) != size) {
+            break;
+        }
+    }
+
+    socket_close(&server);
+
+    return (NULL);
+}
+
+/**
+ * Hub writer thread. Writes broadcasted frames to one subscriber.
+ */
+static void *hub_writer_main(void *arg_p)
+{
+    struct http_websocket_hub_subscriber_t *subscriber_p;
+
+    subscriber_p = arg_p;
+
+    while (http_websocket_hub_write(&hub, subscriber_p) >= 0);
+
+    return (NULL);
+}
+
+static int broadcast(int value)
+{
+    char *buf_p;
+
+    buf_p = http_websocket_hub_alloc(&hub, 8);
+
+    if (buf_p == NULL) {
+        return (-1);
+    }
+
+    std_sprintf(buf_p, FSTR("frame %d"), value);
+
+    return (http_websocket_hub_broadcast(&hub, HTTP_TYPE_TEXT, buf_p, 7));
+}
+
+static int test_unmask(struct harness_t *harness_p)
+{
+    static const uint8_t key[4] = { 0x12, 0x34, 0x56, 0x78 };
+    uint8_t buf[64];
+    size_t offset;
+    size_t start;
+    size_t size;
+    size_t i;
+
+    /* All combinations of alignment, size and key offset. */
+    for (start = 0; start < 8; start++) {
+        for (size = 0; size < 40; size++) {
+            for (offset = 0; offset < 4; offset++) {
+                for (i = 0; i < size; i++) {
+                    buf[start + i] = (i ^ key[(offset + i) & 0x3]);
+                }
+
+                BTASSERT(http_websocket_unmask(&buf[start],
+                                               size,
+                                               key,
+                                               offset)
+                         == ((offset + size) & 0x3));
+
+                for (i = 0; i < size; i++) {
+                    BTASSERT(buf[start + i] == i);
+                }
+            }
+        }
+    }
+
+    return (0);
+}
+
+static int test_unmask_benchmark(struct harness_t *harness_p)
+{
+    static const uint8_t key[4] = { 0x12, 0x34, 0x56, 0x78 };
+    struct time_t start;
+    struct time_t stop;
+    long ms;
+    int i;
+
+    time_get(&start);
+
+    for (i = 0; i < 4096; i++) {
+        http_websocket_unmask(message, sizeof(message), key, 0);
+    }
+
+    time_get(&stop);
+
+    ms = elapsed_ms(&start, &stop);
+
+    std_printf(FSTR("Unmasked %ld kB in %ld ms.\r\n"),
+               4096L * sizeof(message) / 1024,
+               ms);
+
+    return (0);
+}
+
+static int test_echo_benchmark(struct harness_t *harness_p)
+{
+    struct socket_addr_t addr;
+    struct time_t start;
+    struct time_t stop;
+    size_t size;
+    size_t i;
+    long ms;
+    int server_res;
+    int type;
+    int j;
+
+    for (i = 0; i < sizeof(message); i++) {
+        message[i] = (i * 7);
+    }
+
+    BTASSERT(socket_open(&listener,
+                         SOCKET_DOMAIN_AF_INET,
+                         SOCKET_TYPE_STREAM,
+                         0) == 0);
+
+    socket_inet_aton("127.0.0.1", &addr.ip);
+    addr.port = TCP_PORT;
+    BTASSERT(socket_bind(&listener, &addr, sizeof(addr)) == 0);
+    BTASSERT(socket_listen(&listener, 5) == 0);
+
+    BTASSERT(thrd_spawn(server_main,
+                        &server_res,
+                        0,
+                        server_stack,
+                        sizeof(server_stack)) != NULL);
+
+    BTASSERT(socket_open(&client,
+                         SOCKET_DOMAIN_AF_INET,
+                         SOCKET_TYPE_STREAM,
+                         0) == 0);
+    BTASSERT(socket_connect(&client, &addr, sizeof(addr)) == 0);
+    BTASSERT(http_websocket_init(&client_websocket, &client, 1) == 0);
+
+    /* Echo messages of 1 kB to 64 kB. */
+    for (size = MESSAGE_SIZE_MIN; size <= MESSAGE_SIZE_MAX; size *= 2) {
+        time_get(&start);
+
+        for (j = 0; j < BENCHMARK_MESSAGES; j++) {
+            BTASSERT(http_websocket_write(&client_websocket,
+                                          HTTP_TYPE_BINARY,
+                                          message,
+                                          size) == size);
+            BTASSERT(http_websocket_read(&client_websocket,
+                                         &type,
+                                         client_buf,
+                                         sizeof(client_buf)) == size);
+            BTASSERT(type == HTTP_TYPE_BINARY);
+        }
+
+        time_get(&stop);
+
+        BTASSERT(memcmp(client_buf, message, size) == 0);
+
+        ms = elapsed_ms(&start, &stop);
+
+        std_printf(FSTR("%5u bytes messages: %ld kB echoed in %ld ms.\r\n"),
+                   (unsigned)size,
+                   (long)(BENCHMARK_MESSAGES * size / 1024),
+                   ms);
+    }
+
+    /* A fragmented message with a ping in the middle. */
+    BTASSERT(http_websocket_write_frame(&client_websocket,
+                                       INET_HTTP_WEBSOCKET_OPCODE_TEXT,
+                                       0,
+                                       "Hello ",
+                                       6) == 6);
+    BTASSERT(http_websocket_write_frame(&client_websocket,
+                                       INET_HTTP_WEBSOCKET_OPCODE_PING,
+                                       1,
+                                       "ping",
+                                       4) == 4);
+    BTASSERT(http_websocket_write_frame(&client_websocket,
+                                       INET_HTTP_WEBSOCKET_OPCODE_CONTINUATION,
+                                       1,
+                                       "World!",
+                                       6) == 6);
+
+    /* The pong is ignored by the client. */
+    BTASSERT(http_websocket_read(&client_websocket,
+                                 &type,
+                                 client_buf,
+                                 sizeof(client_buf)) == 12);
+    BTASSERT(type == HTTP_TYPE_TEXT);
+    BTASSERT(memcmp(client_buf, "Hello World!", 12) == 0);
+
+    /* Close the connection with status code 1000. */
+    BTASSERT(http_websocket_write_frame(&client_websocket,
+                                       INET_HTTP_WEBSOCKET_OPCODE_CLOSE,
+                                       1,
+                                       "\x03\xe8",
+                                       2) == 2);
+    BTASSERT(http_websocket_read(&client_websocket,
+                                 &type,
+                                 client_buf,
+                                 sizeof(client_buf)) == 0);
+
+    BTASSERT(socket_close(&client) == 0);
+    BTASSERT(socket_close(&listener) == 0);
+
+    thrd_usleep(100000);
+    BTASSERT(server_res == 0);
+
+    return (0);
+}
+
+static int test_hub(struct harness_t *harness_p)
+{
+    struct socket_t listener;
+    struct socket_t clients[2];
+    struct http_websocket_t websockets[2];
+    struct socket_addr_t addr;
+    size_t sizes[HEAP_FIXED_SIZES_MAX] = {
+        16, 32, 64, 128, 256, 512, 1024, 1024
+    };
+    char buf[16];
+    void *buf_p;
+    int type;
+    int i;
+
+    BTASSERT(heap_init(&hub_heap, heap_buf, sizeof(heap_buf), sizes) == 0);
+    BTASSERT(http_websocket_hub_init(&hub, &hub_heap) == 0);
+
+    /* Nobody to broadcast to. */
+    BTASSERT(broadcast(0) == 0);
+
+    BTASSERT(socket_open(&listener,
+                         SOCKET_DOMAIN_AF_INET,
+                         SOCKET_TYPE_STREAM,
+                         0) == 0);
+
+    socket_inet_aton("127.0.0.1", &addr.ip);
+    addr.port = HUB_TCP_PORT;
+    BTASSERT(socket_bind(&listener, &addr, sizeof(addr)) == 0);
+    BTASSERT(socket_listen(&listener, 5) == 0);
+
+    /* Connect two clients and subscribe them. */
+    for (i = 0; i < 2; i++) {
+        BTASSERT(socket_open(&clients[i],
+                             SOCKET_DOMAIN_AF_INET,
+                             SOCKET_TYPE_STREAM,
+                             0) == 0);
+        BTASSERT(socket_connect(&clients[i], &addr, sizeof(addr)) == 0);
+        BTASSERT(socket_accept(&listener, &hub_sockets[i], NULL, NULL) == 0);
+        BTASSERT(http_websocket_init(&websockets[i], &clients[i], 1) == 0);
+        BTASSERT(http_websocket_hub_subscribe(&hub,
+                                              &subscribers[i],
+                                              &hub_sockets[i]) == 0);
+    }
+
+    /* Only the first subscriber has a writer. The second is a slow
+       consumer. */
+    BTASSERT(thrd_spawn(hub_writer_main,
+                        &subscribers[0],
+                        0,
+                        hub_writer_stacks[0],
+                        sizeof(hub_writer_stacks[0])) != NULL);
+
+    for (i = 0; i < 6; i++) {
+        BTASSERT(broadcast(i) == 2);
+        memset(buf, 0, sizeof(buf));
+        BTASSERT(http_websocket_read(&websockets[0],
+                                     &type,
+                                     buf,
+                                     sizeof(buf)) == 7);
+        BTASSERT(type == HTTP_TYPE_TEXT);
+        BTASSERT(buf[6] == '0' + i);
+    }
+
+    /* The two oldest frames of the slow subscriber were dropped. */
+    BTASSERT(subscribers[0].dropped == 0);
+    BTASSERT(subscribers[1].dropped == 2);
+
+    BTASSERT(thrd_spawn(hub_writer_main,
+                        &subscribers[1],
+                        0,
+                        hub_writer_stacks[1],
+                        sizeof(hub_writer_stacks[1])) != NULL);
+
+    for (i = 2; i < 6; i++) {
+        memset(buf, 0, sizeof(buf));
+        BTASSERT(http_websocket_read(&websockets[1],
+                                     &type,
+                                     buf,
+                                     sizeof(buf)) == 7);
+        BTASSERT(buf[6] == '0' + i);
+    }
+
+    /* Only one subscriber left. */
+    BTASSERT(http_websocket_hub_unsubscribe(&hub, &subscribers[1]) == 0);
+    BTASSERT(http_websocket_hub_unsubscribe(&hub, &subscribers[1]) == -1);
+    BTASSERT(broadcast(6) == 1);
+    BTASSERT(http_websocket_read(&websockets[0],
+                                 &type,
+                                 buf,
+                                 sizeof(buf)) == 7);
+    BTASSERT(buf[6] == '6');
+    BTASSERT(http_websocket_hub_unsubscribe(&hub, &subscribers[0]) == 0);
+
+    /* The frames are back in the heap. */
+    buf_p = http_websocket_hub_alloc(&hub, 8);
+    BTASSERT(buf_p != NULL);
+    BTASSERT(http_websocket_hub_broadcast(&hub, HTTP_TYPE_TEXT, buf_p, 0) == 0);
+
+    for (i = 0; i < 2; i++) {
+        BTASSERT(socket_close(&clients[i]) == 0);
+    }
+
+    BTASSERT(socket_close(&listener) == 0);
+
+    return (0);
+}
+
+/**
+ * Write given message on one websocket and read it on the other.
+ */
+static int transfer(struct http_websocket_t *writer_p,
+                    struct http_websocket_t *reader_p,
+                    const void *buf_p,
+                    size_t size)
+{
+    int type;
+
+    if (http_websocket_write(writer_p, HTTP_TYPE_TEXT, buf_p, size) != size) {
+        return (-1);
+    }
+
+    if (http_websocket_read(reader_p,
+                            &type,
+                            client_buf,
+                            sizeof(client_buf)) != size) {
+        return (-1);
+    }
+
+    if (type != HTTP_TYPE_TEXT) {
+        return (-1);
+    }
+
+    return (memcmp(client_buf, buf_p, size));
+}
+
+static int test_deflate(struct harness_t *harness_p)
+{
+    struct socket_t listener;
+    struct socket_t sockets[2];
+    struct http_websocket_t websockets[2];
+    struct socket_addr_t addr;
+    static const char text[] =
+        "{\"temperature\": 21.5, \"humidity\": 40, \"pressure\": 1013}\n";
+    size_t size;
+    size_t i;
+    int type;
+
+    BTASSERT(socket_open(&listener,
+                         SOCKET_DOMAIN_AF_INET,
+                         SOCKET_TYPE_STREAM,
+                         0) == 0);
+
+    socket_inet_aton("127.0.0.1", &addr.ip);
+    addr.port = DEFLATE_TCP_PORT;
+    BTASSERT(socket_bind(&listener, &addr, sizeof(addr)) == 0);
+    BTASSERT(socket_listen(&listener, 5) == 0);
+    BTASSERT(socket_open(&sockets[0],
+                         SOCKET_DOMAIN_AF_INET,
+                         SOCKET_TYPE_STREAM,
+                         0) == 0);
+    BTASSERT(socket_connect(&sockets[0], &addr, sizeof(addr)) == 0);
+    BTASSERT(socket_accept(&listener, &sockets[1], NULL, NULL) == 0);
+
+    /* A client and a server with the extension enabled. */
+    BTASSERT(http_websocket_init(&websockets[0], &sockets[0], 1) == 0);
+    BTASSERT(http_websocket_enable_deflate(&websockets[0], &deflates[0]) == 0);
+    BTASSERT(http_websocket_init(&websockets[1], &sockets[1], 0) == 0);
+    BTASSERT(http_websocket_enable_deflate(&websockets[1], &deflates[1]) == 0);
+
+    /* Text messages fragmented into several compressed frames. */
+    size = 0;
+
+    while (size + sizeof(text) - 1 <= 8192) {
+        memcpy(&message[size], text, sizeof(text) - 1);
+        size += (sizeof(text) - 1);
+    }
+
+    BTASSERT(transfer(&websockets[0], &websockets[1], message, size) == 0);
+    BTASSERT(transfer(&websockets[1], &websockets[0], message, size) == 0);
+    BTASSERT(transfer(&websockets[0], &websockets[1], text, sizeof(text) - 1) == 0);
+    BTASSERT(transfer(&websockets[1], &websockets[0], text, sizeof(text) - 1) == 0);
+
+    /* An empty message. */
+    BTASSERT(transfer(&websockets[0], &websockets[1], text, 0) == 0);
+
+    /* Incompressible data. */
+    for (i = 0; i < 8192; i++) {
+        message[i] = ((i * 7919) >> 3);
+    }
+
+    BTASSERT(transfer(&websockets[1], &websockets[0], message, 8192) == 0);
+
+    /* Uncompressed frames are still accepted. */
+    BTASSERT(http_websocket_write_frame(&websockets[0],
+                                        INET_HTTP_WEBSOCKET_OPCODE_BINARY,
+                                        1,
+                                        "raw",
+                                        3) == 3);
+    BTASSERT(http_websocket_read(&websockets[1],
+                                 &type,
+                                 client_buf,
+                                 sizeof(client_buf)) == 3);
+    BTASSERT(type == HTTP_TYPE_BINARY);
+    BTASSERT(memcmp(client_buf, "raw", 3) == 0);
+
+    /* Truncated read of a compressed message. */
+    BTASSERT(http_websocket_write(&websockets[1],
+                                  HTTP_TYPE_TEXT,
+                                  text,
+                                  sizeof(text) - 1) == sizeof(text) - 1);
+    BTASSERT(http_websocket_read(&websockets[0],
+                                 &type,
+                                 client_buf,
+                                 5) == 5);
+    BTASSERT(memcmp(client_buf, text, 5) == 0);
+    BTASSERT(transfer(&websockets[1], &websockets[0], text, sizeof(text) - 1) == 0);
+
+    for (i = 0; i < 2; i++) {
+        BTASSERT(socket_close(&sockets[i]) == 0);
+    }
+
+    BTASSERT(socket_close(&listener) == 0);
+
+    return (0);
+}
+
+int main()
+{
+    struct harness_t harness;
+    struct harness_testcase_t harness_testcases[] = {
+        { test_unmask, "test_unmask" },
+        { test_unmask_benchmark, "test_unmask_benchmark" },
+        { test_echo_benchmark, "test_echo_benchmark" },
+        { test_hub, "test_hub" },
+        { test_deflate, "test_deflate" },
+        { NULL, NULL }
+    };
+
+    sys_start();
+    uart_module_init();
+    socket_module_init();
+    deflate_module_init();
+
+    harness_init(&harness);
+    harness_run(&harness, harness_testcases);
+
+    return (0);
+}
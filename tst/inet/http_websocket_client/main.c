@@ -129,9 +129,58 @@ static int test_read(struct harness_t *harness_p)
     return (0);
 }
 
+static int test_read_fragmented(struct harness_t *harness_p)
+{
+    uint8_t buf[32];
+
+    /* First fragment of a text message. */
+    buf[0] = 0x01; /* TEXT. */
+    buf[1] = 0x02; /* 2 bytes payload length. */
+    buf[2] = 'f'; /* Payload 0. */
+    buf[3] = 'o'; /* Payload 1. */
+
+    /* A ping in the middle of the message. */
+    buf[4] = 0x89; /* FIN & PING. */
+    buf[5] = 0x01; /* 1 byte payload length. */
+    buf[6] = 'p'; /* Payload 0. */
+
+    /* Last fragment. */
+    buf[7] = 0x80; /* FIN & CONTINUATION. */
+    buf[8] = 0x01; /* 1 byte payload length. */
+    buf[9] = 'o'; /* Payload 0. */
+    socket_stub_input(buf, 10);
+
+    memset(buf, 0, sizeof(buf));
+    BTASSERT(http_websocket_client_read(&foo, buf, sizeof(buf)) == 3);
+    BTASSERT(memcmp(buf, "foo", 3) == 0);
+
+    /* The ping is answered with a masked pong. */
+    socket_stub_output(buf, 7);
+    BTASSERT(buf[0] == 0x8a); /* FIN & PONG. */
+    BTASSERT(buf[1] == 0x81); /* MASK and 1 byte of payload. */
+    BTASSERT((buf[6] ^ buf[2]) == 'p'); /* Payload 0. */
+
+    /* A message longer than the buffer is truncated. */
+    buf[0] = 0x82; /* FIN & BINARY. */
+    buf[1] = 0x05; /* 5 bytes payload length. */
+    memcpy(&buf[2], "abcde", 5);
+    buf[7] = 0x82; /* FIN & BINARY. */
+    buf[8] = 0x01; /* 1 byte payload length. */
+    buf[9] = 'f'; /* Payload 0. */
+    socket_stub_input(buf, 10);
+
+    BTASSERT(http_websocket_client_read(&foo, buf, 2) == 2);
+    BTASSERT(memcmp(buf, "ab", 2) == 0);
+    BTASSERT(http_websocket_client_read(&foo, buf, 2) == 1);
+    BTASSERT(buf[0] == 'f');
+
+    return (0);
+}
+
 static int test_write(struct harness_t *harness_p)
 {
     char buf[256];
+    char key[4];
 
     buf[0] = 'f';
     buf[1] = 'u';
@@ -142,13 +191,15 @@ static int test_write(struct harness_t *harness_p)
     socket_stub_output(buf, 9);
     BTASSERT(buf[0] == 0x82); /* FIN & BINARY. */
     BTASSERT(buf[1] == 0x83); /* MASK and 3 bytes of payload. */
-    BTASSERT(buf[2] == 0x00); /* Masking key 0. */
-    BTASSERT(buf[3] == 0x00); /* Masking key 1. */
-    BTASSERT(buf[4] == 0x00); /* Masking key 2. */
-    BTASSERT(buf[5] == 0x00); /* Masking key 3. */
-    BTASSERT(buf[6] == 'f'); /* Payload 0. */
-    BTASSERT(buf[7] == 'u'); /* Payload 1. */
-    BTASSERT(buf[8] == 'm'); /* Payload 2. */
+    BTASSERT((buf[6] ^ buf[2]) == 'f'); /* Payload 0. */
+    BTASSERT((buf[7] ^ buf[3]) == 'u'); /* Payload 1. */
+    BTASSERT((buf[8] ^ buf[4]) == 'm'); /* Payload 2. */
+
+    /* A new masking key is generated for each frame. */
+    memcpy(key, &buf[2], sizeof(key));
+    BTASSERT(http_websocket_client_write(&foo, HTTP_TYPE_BINARY, buf, 3) == 3);
+    socket_stub_output(buf, 9);
+    BTASSERT(memcmp(key, &buf[2], sizeof(key)) != 0);
 
     return (0);
 }
@@ -160,14 +211,63 @@ static int test_disconnect(struct harness_t *harness_p)
     return (0);
 }
 
+static int test_connect_deflate(struct harness_t *harness_p)
+{
+    static struct http_websocket_deflate_t deflate;
+    char *str_p;
+    char buf[256];
+
+    BTASSERT(http_websocket_client_init(&foo,
+                                        "localhost",
+                                        8090,
+                                        "/") == 0);
+    BTASSERT(http_websocket_client_enable_deflate(&foo, &deflate) == 0);
+
+    /* The server accepts the extension. */
+    str_p =
+        "HTTP/1.1 101 Switching Protocols\r\n"
+        "Sec-WebSocket-Extensions: permessage-deflate; "
+        "server_max_window_bits=10; client_max_window_bits=10\r\n"
+        "\r\n";
+    socket_stub_input(str_p, strlen(str_p));
+
+    BTASSERT(http_websocket_client_connect(&foo) == 0);
+
+    str_p =
+        "GET / HTTP/1.1\r\n"
+        "Host: localhost\r\n"
+        "Upgrade: WebSocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Origin: SimbaWebSocketClient\r\n"
+        "Sec-WebSocket-Extensions: permessage-deflate; "
+        "client_max_window_bits=10; server_max_window_bits=10\r\n"
+        "\r\n";
+    socket_stub_output(buf, strlen(str_p));
+    buf[strlen(str_p)] = '\0';
+    BTASSERT(strcmp(buf, str_p) == 0);
+    BTASSERT(foo.websocket.deflate_p == &deflate);
+
+    /* Read "Hello" compressed by zlib. */
+    memcpy(buf, "\xc1\x07\xf2\x48\xcd\xc9\xc9\x07\x00", 9);
+    socket_stub_input(buf, 9);
+    BTASSERT(http_websocket_client_read(&foo, buf, sizeof(buf)) == 5);
+    BTASSERT(memcmp(buf, "Hello", 5) == 0);
+
+    BTASSERT(http_websocket_client_disconnect(&foo) == 0);
+
+    return (0);
+}
+
 int main()
 {
     struct harness_t harness;
     struct harness_testcase_t harness_testcases[] = {
         { test_connect, "test_connect" },
         { test_read, "test_read" },
+        { test_read_fragmented, "test_read_fragmented" },
         { test_write, "test_write" },
         { test_disconnect, "test_disconnect" },
+        { test_connect_deflate, "test_connect_deflate" },
         { NULL, NULL }
     };
 
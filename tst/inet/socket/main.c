@@ -22,14 +22,678 @@
 
 #include "inet.h"
 
-int test_init(struct harness_t *harness_p)
+#define TCP_PORT 10080
+#define TCP_BULK_PORT 10083
+#define UDP_PORT_0 10081
+#define UDP_PORT_1 10082
+#define UDP_BATCH_PORT_0 10084
+#define UDP_BATCH_PORT_1 10085
+#define UDP_POLL_PORT 10086
+#define TCP_TIMEOUT_PORT 10087
+
+/* Number of datagrams sent to overflow the kernel receive buffer. */
+#define UDP_FLOOD_MAX 1000
+
+/* Number of messages echoed by the TCP server. */
+#define TCP_ECHO_MAX 1000
+
+/* Size of each buffer and number of buffers in the bulk transfer. */
+#define TCP_BULK_BUFFER_SIZE 1024
+#define TCP_BULK_BUFFERS_MAX 1024
+
+static THRD_STACK(client_stack, 1024);
+static THRD_STACK(bulk_client_stack, 1024);
+static THRD_STACK(udp_sender_stack, 1024);
+
+static uint8_t bulk_buf[TCP_BULK_BUFFER_SIZE];
+
+/**
+ * TCP client thread. Connects to the echo server and verifies the
+ * echoed messages.
+ */
+static void *client_main(void *arg_p)
+{
+    struct socket_t socket;
+    struct socket_addr_t addr;
+    char buf[16];
+    int *res_p;
+    int i;
+
+    res_p = arg_p;
+    *res_p = -1;
+
+    if (socket_open(&socket,
+                    SOCKET_DOMAIN_AF_INET,
+                    SOCKET_TYPE_STREAM,
+                    0) != 0) {
+        return (NULL);
+    }
+
+    socket_inet_aton("127.0.0.1", &addr.ip);
+    addr.port = TCP_PORT;
+
+    if (socket_connect(&socket, &addr, sizeof(addr)) != 0) {
+        return (NULL);
+    }
+
+    for (i = 0; i < TCP_ECHO_MAX; i++) {
+        std_sprintf(buf, FSTR("ping %05d"), i);
+
+        if (socket_write(&socket, buf, 10) != 10) {
+            return (NULL);
+        }
+
+        memset(buf, 0, sizeof(buf));
+
+        if (socket_read(&socket, buf, 10) != 10) {
+            return (NULL);
+        }
+
+        if (strncmp(buf, "ping ", 5) != 0) {
+            return (NULL);
+        }
+    }
+
+    *res_p = 0;
+    socket_close(&socket);
+
+    return (NULL);
+}
+
+/**
+ * TCP bulk client thread. Writes the same buffer twice per io vector
+ * until all data has been sent.
+ */
+static void *bulk_client_main(void *arg_p)
 {
     struct socket_t socket;
+    struct socket_addr_t addr;
+    struct socket_iov_t iov[2];
+    int *res_p;
+    int i;
+
+    res_p = arg_p;
+    *res_p = -1;
+
+    if (socket_open(&socket,
+                    SOCKET_DOMAIN_AF_INET,
+                    SOCKET_TYPE_STREAM,
+                    0) != 0) {
+        return (NULL);
+    }
+
+    socket_inet_aton("127.0.0.1", &addr.ip);
+    addr.port = TCP_BULK_PORT;
+
+    if (socket_connect(&socket, &addr, sizeof(addr)) != 0) {
+        return (NULL);
+    }
+
+    iov[0].buf_p = bulk_buf;
+    iov[0].size = sizeof(bulk_buf);
+    iov[1].buf_p = bulk_buf;
+    iov[1].size = sizeof(bulk_buf);
+
+    for (i = 0; i < TCP_BULK_BUFFERS_MAX; i += 2) {
+        if (socket_writev(&socket,
+                          iov,
+                          membersof(iov),
+                          SOCKET_FLAG_NO_COPY) != 2 * sizeof(bulk_buf)) {
+            return (NULL);
+        }
+    }
+
+    *res_p = 0;
+    socket_close(&socket);
+
+    return (NULL);
+}
+
+/**
+ * Send a datagram to the poll test socket after a short delay.
+ */
+static void *udp_sender_main(void *arg_p)
+{
+    struct socket_t socket;
+    struct socket_addr_t addr;
+
+    thrd_usleep(50000);
+
+    socket_open(&socket, SOCKET_DOMAIN_AF_INET, SOCKET_TYPE_DGRAM, 0);
+    socket_inet_aton("127.0.0.1", &addr.ip);
+    addr.port = UDP_POLL_PORT;
+    socket_sendto(&socket, "late", 4, 0, &addr, sizeof(addr));
+    socket_close(&socket);
+
+    return (NULL);
+}
+
+static int test_init(struct harness_t *harness_p)
+{
+    struct socket_t socket;
+
+    BTASSERT(socket_module_init() == 0);
 
     BTASSERT(socket_open(&socket,
                          SOCKET_DOMAIN_AF_INET,
                          SOCKET_TYPE_DGRAM,
                          0) == 0);
+    BTASSERT(socket_close(&socket) == 0);
+
+    return (0);
+}
+
+static int test_inet_aton(struct harness_t *harness_p)
+{
+    uint32_t addr;
+
+    BTASSERT(socket_inet_aton("127.0.0.1", &addr) == 0);
+    BTASSERT(memcmp(&addr, "\x7f\x00\x00\x01", 4) == 0);
+    BTASSERT(socket_inet_aton("192.168.1.103", &addr) == 0);
+    BTASSERT(memcmp(&addr, "\xc0\xa8\x01\x67", 4) == 0);
+
+    BTASSERT(socket_inet_aton("192.168.1", &addr) == -EINVAL);
+    BTASSERT(socket_inet_aton("192.168.1.256", &addr) == -EINVAL);
+    BTASSERT(socket_inet_aton("192.168.1.1.", &addr) == -EINVAL);
+    BTASSERT(socket_inet_aton("localhost", &addr) == -EINVAL);
+
+    return (0);
+}
+
+static int test_udp(struct harness_t *harness_p)
+{
+    struct socket_t socket[2];
+    struct socket_addr_t addr;
+    struct socket_addr_t remote_addr;
+    char buf[16];
+
+    BTASSERT(socket_open(&socket[0],
+                         SOCKET_DOMAIN_AF_INET,
+                         SOCKET_TYPE_DGRAM,
+                         0) == 0);
+    BTASSERT(socket_open(&socket[1],
+                         SOCKET_DOMAIN_AF_INET,
+                         SOCKET_TYPE_DGRAM,
+                         0) == 0);
+
+    socket_inet_aton("127.0.0.1", &addr.ip);
+    addr.port = UDP_PORT_0;
+    BTASSERT(socket_bind(&socket[0], &addr, sizeof(addr)) == 0);
+    addr.port = UDP_PORT_1;
+    BTASSERT(socket_bind(&socket[1], &addr, sizeof(addr)) == 0);
+
+    /* Send a datagram from the first socket to the second. */
+    BTASSERT(socket_sendto(&socket[0],
+                           "hello",
+                           5,
+                           0,
+                           &addr,
+                           sizeof(addr)) == 5);
+
+    memset(buf, 0, sizeof(buf));
+    BTASSERT(socket_recvfrom(&socket[1],
+                             buf,
+                             sizeof(buf),
+                             0,
+                             &remote_addr,
+                             sizeof(remote_addr)) == 5);
+    BTASSERT(strcmp(buf, "hello") == 0);
+    BTASSERT(remote_addr.ip == addr.ip);
+    BTASSERT(remote_addr.port == UDP_PORT_0);
+
+    BTASSERT(socket_close(&socket[0]) == 0);
+    BTASSERT(socket_close(&socket[1]) == 0);
+
+    return (0);
+}
+
+static int test_udp_batch(struct harness_t *harness_p)
+{
+    struct socket_t socket[2];
+    struct socket_addr_t addr[2];
+    struct socket_msg_t msgs[8];
+    char bufs[8][16];
+    int i;
+
+    BTASSERT(socket_open(&socket[0],
+                         SOCKET_DOMAIN_AF_INET,
+                         SOCKET_TYPE_DGRAM,
+                         0) == 0);
+    BTASSERT(socket_open(&socket[1],
+                         SOCKET_DOMAIN_AF_INET,
+                         SOCKET_TYPE_DGRAM,
+                         0) == 0);
+
+    socket_inet_aton("127.0.0.1", &addr[0].ip);
+    addr[0].port = UDP_BATCH_PORT_0;
+    BTASSERT(socket_bind(&socket[0], &addr[0], sizeof(addr[0])) == 0);
+    addr[1] = addr[0];
+    addr[1].port = UDP_BATCH_PORT_1;
+    BTASSERT(socket_bind(&socket[1], &addr[1], sizeof(addr[1])) == 0);
+
+    /* Send five datagrams in one call. */
+    for (i = 0; i < 5; i++) {
+        std_sprintf(bufs[i], FSTR("datagram %d"), i);
+        msgs[i].buf_p = bufs[i];
+        msgs[i].size = 10;
+        msgs[i].addr = addr[1];
+    }
+
+    BTASSERT(socket_sendmmsg(&socket[0], msgs, 5, 0) == 5);
+
+    for (i = 0; i < 5; i++) {
+        BTASSERT(msgs[i].length == 10);
+    }
+
+    /* All queued datagrams are received in one call. The last
+       buffer is too small for its datagram. */
+    memset(bufs, 0, sizeof(bufs));
+
+    for (i = 0; i < 8; i++) {
+        msgs[i].buf_p = bufs[i];
+        msgs[i].size = sizeof(bufs[i]);
+    }
+
+    msgs[4].size = 4;
+
+    BTASSERT(socket_recvmmsg(&socket[1], msgs, 8, 0) == 5);
+
+    for (i = 0; i < 4; i++) {
+        BTASSERT(msgs[i].length == 10);
+        BTASSERT(memcmp(bufs[i], "datagram ", 9) == 0);
+        BTASSERT(bufs[i][9] == '0' + i);
+        BTASSERT(msgs[i].addr.ip == addr[0].ip);
+        BTASSERT(msgs[i].addr.port == UDP_BATCH_PORT_0);
+    }
+
+    BTASSERT(msgs[4].length == 4);
+    BTASSERT(memcmp(bufs[4], "data", 5) == 0);
+
+    BTASSERT(socket_close(&socket[0]) == 0);
+    BTASSERT(socket_close(&socket[1]) == 0);
+
+    /* Only datagram sockets. */
+    BTASSERT(socket_open(&socket[0],
+                         SOCKET_DOMAIN_AF_INET,
+                         SOCKET_TYPE_STREAM,
+                         0) == 0);
+    BTASSERT(socket_sendmmsg(&socket[0], msgs, 1, 0) == -EINVAL);
+    BTASSERT(socket_recvmmsg(&socket[0], msgs, 1, 0) == -EINVAL);
+    BTASSERT(socket_close(&socket[0]) == 0);
+
+    return (0);
+}
+
+static int test_udp_dropped(struct harness_t *harness_p)
+{
+    struct socket_t socket[2];
+    struct socket_addr_t addr[2];
+    struct socket_msg_t msgs[16];
+    char buf[1024];
+    char command[64];
+    char output[40];
+    struct queue_t qout;
+    int i;
+    ssize_t res;
+    int done;
+
+    BTASSERT(socket_open(&socket[0],
+                         SOCKET_DOMAIN_AF_INET,
+                         SOCKET_TYPE_DGRAM,
+                         0) == 0);
+    BTASSERT(socket_open(&socket[1],
+                         SOCKET_DOMAIN_AF_INET,
+                         SOCKET_TYPE_DGRAM,
+                         0) == 0);
+
+    socket_inet_aton("127.0.0.1", &addr[0].ip);
+    addr[0].port = UDP_BATCH_PORT_0;
+    BTASSERT(socket_bind(&socket[0], &addr[0], sizeof(addr[0])) == 0);
+    addr[1] = addr[0];
+    addr[1].port = UDP_BATCH_PORT_1;
+    BTASSERT(socket_bind(&socket[1], &addr[1], sizeof(addr[1])) == 0);
+
+    /* Send more datagrams than the receiver can queue. */
+    memset(buf, 'a', sizeof(buf));
+
+    for (i = 0; i < membersof(msgs); i++) {
+        msgs[i].buf_p = buf;
+        msgs[i].size = sizeof(buf);
+        msgs[i].addr = addr[1];
+    }
+
+    for (i = 0; i < UDP_FLOOD_MAX; i += membersof(msgs)) {
+        BTASSERT(socket_sendmmsg(&socket[0],
+                                 msgs,
+                                 membersof(msgs),
+                                 0) == membersof(msgs));
+    }
+
+    /* Make room for a last datagram, which is queued with the number
+       of dropped datagrams. */
+    BTASSERT(socket_recvmmsg(&socket[1], msgs, membersof(msgs), 0) > 0);
+    BTASSERT(socket_sendto(&socket[0],
+                           "last",
+                           4,
+                           0,
+                           &addr[1],
+                           sizeof(addr[1])) == 4);
+
+    done = 0;
+
+    while (!done) {
+        res = socket_recvmmsg(&socket[1], msgs, membersof(msgs), 0);
+        BTASSERT(res > 0);
+
+        for (i = 0; i < res; i++) {
+            if (msgs[i].length == 4) {
+                done = 1;
+            }
+        }
+    }
+
+    /* The counter value is printed in hexadecimal. */
+    BTASSERT(queue_init(&qout, output, sizeof(output)) == 0);
+    strcpy(command, "/inet/socket/udp/rx_dropped");
+    BTASSERT(fs_call(command, NULL, &qout, NULL) == 0);
+    BTASSERT(queue_size(&qout) == 18);
+    BTASSERT(queue_read(&qout, output, 18) == 18);
+    BTASSERT(memcmp(output, "0000000000000000", 16) != 0);
+
+    BTASSERT(socket_close(&socket[0]) == 0);
+    BTASSERT(socket_close(&socket[1]) == 0);
+
+    return (0);
+}
+
+static int test_timeout(struct harness_t *harness_p)
+{
+    struct socket_t socket;
+    struct socket_t listener;
+    struct socket_t accepted;
+    struct socket_addr_t addr;
+    struct socket_msg_t msg;
+    struct time_t timeout;
+    char buf[16];
+
+    BTASSERT(socket_open(&socket,
+                         SOCKET_DOMAIN_AF_INET,
+                         SOCKET_TYPE_DGRAM,
+                         0) == 0);
+    socket_inet_aton("127.0.0.1", &addr.ip);
+    addr.port = UDP_POLL_PORT;
+    BTASSERT(socket_bind(&socket, &addr, sizeof(addr)) == 0);
+
+    /* Non-blocking receive. */
+    BTASSERT(socket_recvfrom(&socket,
+                             buf,
+                             sizeof(buf),
+                             SOCKET_FLAG_DONT_WAIT,
+                             NULL,
+                             0) == -EAGAIN);
+    msg.buf_p = buf;
+    msg.size = sizeof(buf);
+    BTASSERT(socket_recvmmsg(&socket,
+                             &msg,
+                             1,
+                             SOCKET_FLAG_DONT_WAIT) == -EAGAIN);
+
+    /* A zero timeout makes the socket non-blocking. */
+    timeout.seconds = 0;
+    timeout.nanoseconds = 0;
+    BTASSERT(socket_set_recv_timeout(&socket, &timeout) == 0);
+    BTASSERT(socket_read(&socket, buf, sizeof(buf)) == -EAGAIN);
+
+    /* Receive timeout. */
+    timeout.nanoseconds = 50000000;
+    BTASSERT(socket_set_recv_timeout(&socket, &timeout) == 0);
+    BTASSERT(socket_read(&socket, buf, sizeof(buf)) == -ETIMEDOUT);
+
+    /* Data received before the timeout expires. */
+    BTASSERT(socket_sendto(&socket, "hi", 2, 0, &addr, sizeof(addr)) == 2);
+    BTASSERT(socket_read(&socket, buf, sizeof(buf)) == 2);
+    BTASSERT(socket_set_recv_timeout(&socket, NULL) == 0);
+    BTASSERT(socket_close(&socket) == 0);
+
+    /* Accept timeout. */
+    BTASSERT(socket_open(&listener,
+                         SOCKET_DOMAIN_AF_INET,
+                         SOCKET_TYPE_STREAM,
+                         0) == 0);
+    addr.port = TCP_TIMEOUT_PORT;
+    BTASSERT(socket_bind(&listener, &addr, sizeof(addr)) == 0);
+    BTASSERT(socket_listen(&listener, 1) == 0);
+    BTASSERT(socket_set_recv_timeout(&listener, &timeout) == 0);
+    BTASSERT(socket_accept(&listener, &accepted, NULL, NULL) == -ETIMEDOUT);
+
+    /* Receive timeout on a connection, and partial reads. */
+    BTASSERT(socket_open(&socket,
+                         SOCKET_DOMAIN_AF_INET,
+                         SOCKET_TYPE_STREAM,
+                         0) == 0);
+    BTASSERT(socket_connect(&socket, &addr, sizeof(addr)) == 0);
+    BTASSERT(socket_accept(&listener, &accepted, NULL, NULL) == 0);
+    BTASSERT(socket_set_recv_timeout(&accepted, &timeout) == 0);
+    BTASSERT(socket_read(&accepted, buf, sizeof(buf)) == -ETIMEDOUT);
+    BTASSERT(socket_write(&socket, "abc", 3) == 3);
+    BTASSERT(socket_read(&accepted, buf, sizeof(buf)) == 3);
+    BTASSERT(memcmp(buf, "abc", 3) == 0);
+
+    BTASSERT(socket_close(&accepted) == 0);
+    BTASSERT(socket_close(&socket) == 0);
+    BTASSERT(socket_close(&listener) == 0);
+
+    return (0);
+}
+
+static int test_poll(struct harness_t *harness_p)
+{
+    struct socket_t socket;
+    struct socket_addr_t addr;
+    struct queue_t queue;
+    struct chan_list_t list;
+    struct time_t timeout;
+    char workspace[64];
+    char queue_buf[8];
+    char buf[16];
+
+    BTASSERT(socket_open(&socket,
+                         SOCKET_DOMAIN_AF_INET,
+                         SOCKET_TYPE_DGRAM,
+                         0) == 0);
+    socket_inet_aton("127.0.0.1", &addr.ip);
+    addr.port = UDP_POLL_PORT;
+    BTASSERT(socket_bind(&socket, &addr, sizeof(addr)) == 0);
+    BTASSERT(socket_size(&socket) == 0);
+
+    BTASSERT(queue_init(&queue, queue_buf, sizeof(queue_buf)) == 0);
+    BTASSERT(chan_list_init(&list, workspace, sizeof(workspace)) == 0);
+    BTASSERT(chan_list_add(&list, &queue) == 0);
+    BTASSERT(chan_list_add(&list, &socket) == 0);
+
+    /* Nothing to read. */
+    timeout.seconds = 0;
+    timeout.nanoseconds = 50000000;
+    BTASSERT(chan_list_poll(&list, &timeout) == NULL);
+
+    /* Data in the queue. */
+    BTASSERT(queue_write(&queue, "q", 1) == 1);
+    BTASSERT(chan_list_poll(&list, &timeout) == &queue);
+    BTASSERT(queue_read(&queue, buf, 1) == 1);
+
+    /* A datagram already received. */
+    BTASSERT(socket_sendto(&socket, "now", 3, 0, &addr, sizeof(addr)) == 3);
+    BTASSERT(chan_list_poll(&list, &timeout) == &socket);
+    BTASSERT(socket_size(&socket) == 3);
+    BTASSERT(socket_read(&socket, buf, sizeof(buf)) == 3);
+
+    /* The polling thread is resumed when a datagram is received. */
+    BTASSERT(thrd_spawn(udp_sender_main,
+                        NULL,
+                        0,
+                        udp_sender_stack,
+                        sizeof(udp_sender_stack)) != NULL);
+    BTASSERT(chan_list_poll(&list, NULL) == &socket);
+    BTASSERT(socket_read(&socket, buf, sizeof(buf)) == 4);
+    BTASSERT(memcmp(buf, "late", 4) == 0);
+
+    BTASSERT(chan_list_destroy(&list) == 0);
+    BTASSERT(socket_close(&socket) == 0);
+
+    return (0);
+}
+
+static int test_tcp(struct harness_t *harness_p)
+{
+    struct socket_t listener;
+    struct socket_t client;
+    struct socket_addr_t addr;
+    struct time_t start;
+    struct time_t stop;
+    char buf[10];
+    int client_res;
+    int i;
+
+    BTASSERT(socket_open(&listener,
+                         SOCKET_DOMAIN_AF_INET,
+                         SOCKET_TYPE_STREAM,
+                         0) == 0);
+
+    socket_inet_aton("127.0.0.1", &addr.ip);
+    addr.port = TCP_PORT;
+    BTASSERT(socket_bind(&listener, &addr, sizeof(addr)) == 0);
+    BTASSERT(socket_listen(&listener, 5) == 0);
+
+    time_get(&start);
+
+    BTASSERT(thrd_spawn(client_main,
+                        &client_res,
+                        0,
+                        client_stack,
+                        sizeof(client_stack)) != NULL);
+
+    BTASSERT(socket_accept(&listener, &client, &addr, NULL) == 0);
+    BTASSERT(addr.port != TCP_PORT);
+
+    /* Echo all messages. */
+    for (i = 0; i < TCP_ECHO_MAX; i++) {
+        BTASSERT(socket_read(&client, buf, sizeof(buf)) == sizeof(buf));
+        BTASSERT(socket_write(&client, buf, sizeof(buf)) == sizeof(buf));
+    }
+
+    /* The client closes the connection. */
+    BTASSERT(socket_read(&client, buf, sizeof(buf)) == 0);
+
+    time_get(&stop);
+
+    std_printf(FSTR("%d round trips in %ld ms.\r\n"),
+               TCP_ECHO_MAX,
+               (long)(1000L * (stop.seconds - start.seconds)
+                      + (stop.nanoseconds - start.nanoseconds) / 1000000L));
+
+    BTASSERT(client_res == 0);
+
+    BTASSERT(socket_close(&client) == 0);
+    BTASSERT(socket_close(&listener) == 0);
+
+    return (0);
+}
+
+static int test_tcp_bulk(struct harness_t *harness_p)
+{
+    struct socket_t listener;
+    struct socket_t client;
+    struct socket_addr_t addr;
+    struct socket_iov_t iov[3];
+    struct time_t start;
+    struct time_t stop;
+    const void *buf_p;
+    char header[3];
+    char trailer[5];
+    long size;
+    long ms;
+    ssize_t n;
+    int client_res;
+    int i;
+
+    for (i = 0; i < sizeof(bulk_buf); i++) {
+        bulk_buf[i] = i;
+    }
+
+    BTASSERT(socket_open(&listener,
+                         SOCKET_DOMAIN_AF_INET,
+                         SOCKET_TYPE_STREAM,
+                         0) == 0);
+
+    socket_inet_aton("127.0.0.1", &addr.ip);
+    addr.port = TCP_BULK_PORT;
+    BTASSERT(socket_bind(&listener, &addr, sizeof(addr)) == 0);
+    BTASSERT(socket_listen(&listener, 5) == 0);
+
+    time_get(&start);
+
+    BTASSERT(thrd_spawn(bulk_client_main,
+                        &client_res,
+                        0,
+                        bulk_client_stack,
+                        sizeof(bulk_client_stack)) != NULL);
+
+    BTASSERT(socket_accept(&listener, &client, &addr, NULL) == 0);
+
+    /* Scatter the first bytes into three buffers. */
+    iov[0].buf_p = header;
+    iov[0].size = sizeof(header);
+    iov[1].buf_p = NULL;
+    iov[1].size = 0;
+    iov[2].buf_p = trailer;
+    iov[2].size = sizeof(trailer);
+    BTASSERT(socket_readv(&client, iov, membersof(iov)) == 8);
+    BTASSERT(memcmp(header, "\x00\x01\x02", 3) == 0);
+    BTASSERT(memcmp(trailer, "\x03\x04\x05\x06\x07", 5) == 0);
+    size = 8;
+
+    /* Read the rest without copying. */
+    while (1) {
+        n = socket_recv_borrow(&client, &buf_p);
+        BTASSERT(n >= 0);
+
+        if (n == 0) {
+            break;
+        }
+
+        for (i = 0; i < n; i++) {
+            BTASSERT(((const uint8_t *)buf_p)[i]
+                     == (uint8_t)((size + i) % sizeof(bulk_buf)));
+        }
+
+        /* Release the data in two steps. */
+        BTASSERT(socket_recv_release(&client, n / 2) == 0);
+        BTASSERT(socket_recv_release(&client, n - n / 2) == 0);
+        size += n;
+    }
+
+    time_get(&stop);
+
+    BTASSERT(client_res == 0);
+    BTASSERT(size == TCP_BULK_BUFFER_SIZE * TCP_BULK_BUFFERS_MAX);
+
+    /* Nothing left to release. */
+    BTASSERT(socket_recv_release(&client, 1) == -EINVAL);
+
+    ms = (1000L * (stop.seconds - start.seconds)
+          + (stop.nanoseconds - start.nanoseconds) / 1000000L);
+
+    if (ms == 0) {
+        ms = 1;
+    }
+
+    std_printf(FSTR("%ld bytes in %ld ms (%ld kB/s).\r\n"),
+               size,
+               ms,
+               size / ms);
+
+    BTASSERT(socket_close(&client) == 0);
+    BTASSERT(socket_close(&listener) == 0);
 
     return (0);
 }
@@ -39,6 +703,14 @@ int main()
     struct harness_t harness;
     struct harness_testcase_t harness_testcases[] = {
         { test_init, "test_init" },
+        { test_inet_aton, "test_inet_aton" },
+        { test_udp, "test_udp" },
+        { test_udp_batch, "test_udp_batch" },
+        { test_udp_dropped, "test_udp_dropped" },
+        { test_timeout, "test_timeout" },
+        { test_poll, "test_poll" },
+        { test_tcp, "test_tcp" },
+        { test_tcp_bulk, "test_tcp_bulk" },
         { NULL, NULL }
     };
 
@@ -118,6 +118,243 @@ int test_string(struct harness_t *harness_p)
     return (0);
 }
 
+int test_transaction(struct harness_t *harness_p)
+{
+    struct setting_transaction_t transaction;
+    uint8_t buf[32];
+    int8_t int8;
+    uint16_t uint16;
+
+    BTASSERT(setting_transaction_init(&transaction, buf, sizeof(buf)) == 0);
+
+    /* Nothing is written before the commit. */
+    int8 = 10;
+    BTASSERT(setting_transaction_write(&transaction,
+                                       SETTING_INT8_ADDR,
+                                       &int8,
+                                       SETTING_INT8_SIZE) == 0);
+    uint16 = 1000;
+    BTASSERT(setting_transaction_write(&transaction,
+                                       SETTING_UINT16_ADDR,
+                                       &uint16,
+                                       SETTING_UINT16_SIZE) == 0);
+    int8 = 11;
+    BTASSERT(setting_transaction_write(&transaction,
+                                       SETTING_INT8_ADDR,
+                                       &int8,
+                                       SETTING_INT8_SIZE) == 0);
+
+    BTASSERT(setting_read(&int8,
+                          SETTING_INT8_ADDR,
+                          SETTING_INT8_SIZE) == SETTING_INT8_SIZE);
+    BTASSERT(int8 == SETTING_INT8_VALUE);
+
+    BTASSERT(setting_transaction_commit(&transaction) == 0);
+
+    /* The last write of a setting in a transaction wins. */
+    BTASSERT(setting_read(&int8,
+                          SETTING_INT8_ADDR,
+                          SETTING_INT8_SIZE) == SETTING_INT8_SIZE);
+    BTASSERT(int8 == 11);
+    BTASSERT(setting_read(&uint16,
+                          SETTING_UINT16_ADDR,
+                          SETTING_UINT16_SIZE) == SETTING_UINT16_SIZE);
+    BTASSERT(uint16 == 1000);
+
+    /* The transaction buffer is too small. */
+    BTASSERT(setting_transaction_init(&transaction, buf, 8) == 0);
+    BTASSERT(setting_transaction_write(&transaction,
+                                       SETTING_INT64_ADDR,
+                                       buf,
+                                       SETTING_INT64_SIZE) == -ENOMEM);
+
+    /* Bad address. */
+    BTASSERT(setting_transaction_write(&transaction,
+                                       SETTING_IMAGE_SIZE,
+                                       buf,
+                                       1) == -EINVAL);
+    BTASSERT(setting_read(buf, SETTING_STRING_ADDR, 3) == -EINVAL);
+
+    return (0);
+}
+
+int test_compaction(struct harness_t *harness_p)
+{
+    int32_t int32;
+    uint64_t uint64;
+    int i;
+
+    /* Write a setting enough times to compact the log several
+       times. */
+    for (i = 0; i < 1000; i++) {
+        int32 = i;
+        BTASSERT(setting_write(SETTING_INT32_ADDR,
+                               &int32,
+                               SETTING_INT32_SIZE) == SETTING_INT32_SIZE);
+    }
+
+    BTASSERT(setting_read(&int32,
+                          SETTING_INT32_ADDR,
+                          SETTING_INT32_SIZE) == SETTING_INT32_SIZE);
+    BTASSERT(int32 == 999);
+
+    /* Settings written before the compactions are kept. */
+    BTASSERT(setting_read(&uint64,
+                          SETTING_UINT64_ADDR,
+                          SETTING_UINT64_SIZE) == SETTING_UINT64_SIZE);
+    BTASSERT(uint64 == 46);
+
+    return (0);
+}
+
+int test_restart(struct harness_t *harness_p)
+{
+    int8_t int8;
+    int32_t int32;
+    char string[SETTING_STRING_SIZE];
+
+    int8 = -100;
+    BTASSERT(setting_write(SETTING_INT8_ADDR,
+                           &int8,
+                           SETTING_INT8_SIZE) == SETTING_INT8_SIZE);
+
+    /* Find the settings in the log after a restart. */
+    BTASSERT(setting_module_init() == 0);
+
+    BTASSERT(setting_read(&int8,
+                          SETTING_INT8_ADDR,
+                          SETTING_INT8_SIZE) == SETTING_INT8_SIZE);
+    BTASSERT(int8 == -100);
+    BTASSERT(setting_read(&int32,
+                          SETTING_INT32_ADDR,
+                          SETTING_INT32_SIZE) == SETTING_INT32_SIZE);
+    BTASSERT(int32 == 999);
+    BTASSERT(setting_read(string,
+                          SETTING_STRING_ADDR,
+                          SETTING_STRING_SIZE) == SETTING_STRING_SIZE);
+    BTASSERT(strcmp(string, "x") == 0);
+
+    return (0);
+}
+
+static int read_settings_file(uint8_t *buf_p, size_t size)
+{
+    FILE *file_p;
+
+    file_p = fopen("settings.bin", "rb");
+    BTASSERT(file_p != NULL);
+    BTASSERT(fread(buf_p, 1, size, file_p) == size);
+    fclose(file_p);
+
+    return (0);
+}
+
+int test_power_failure(struct harness_t *harness_p)
+{
+    static uint8_t before[SETTING_AREA_SIZE];
+    static uint8_t after[SETTING_AREA_SIZE];
+    FILE *file_p;
+    int16_t int16;
+    int i;
+
+    int16 = 7;
+    BTASSERT(setting_write(SETTING_INT16_ADDR,
+                           &int16,
+                           SETTING_INT16_SIZE) == SETTING_INT16_SIZE);
+
+    /* Write a setting and corrupt the record, as if the power failed
+       during the write. */
+    BTASSERT(read_settings_file(before, sizeof(before)) == 0);
+    int16 = 8;
+    BTASSERT(setting_write(SETTING_INT16_ADDR,
+                           &int16,
+                           SETTING_INT16_SIZE) == SETTING_INT16_SIZE);
+    BTASSERT(read_settings_file(after, sizeof(after)) == 0);
+
+    for (i = sizeof(after) - 1; i >= 0; i--) {
+        if (after[i] != before[i]) {
+            break;
+        }
+    }
+
+    BTASSERT(i >= 0);
+    after[i] ^= 0x01;
+    file_p = fopen("settings.bin", "wb");
+    BTASSERT(file_p != NULL);
+    BTASSERT(fwrite(after, 1, sizeof(after), file_p) == sizeof(after));
+    fclose(file_p);
+
+    /* The corrupt record is dropped. */
+    BTASSERT(setting_module_init() == 0);
+    BTASSERT(setting_read(&int16,
+                          SETTING_INT16_ADDR,
+                          SETTING_INT16_SIZE) == SETTING_INT16_SIZE);
+    BTASSERT(int16 == 7);
+
+    /* New settings are written after a restart. */
+    int16 = 9;
+    BTASSERT(setting_write(SETTING_INT16_ADDR,
+                           &int16,
+                           SETTING_INT16_SIZE) == SETTING_INT16_SIZE);
+    BTASSERT(setting_module_init() == 0);
+    BTASSERT(setting_read(&int16,
+                          SETTING_INT16_ADDR,
+                          SETTING_INT16_SIZE) == SETTING_INT16_SIZE);
+    BTASSERT(int16 == 9);
+
+    return (0);
+}
+
+int test_overlap(struct harness_t *harness_p)
+{
+    struct setting_transaction_t transaction;
+    uint8_t buf[32];
+    uint8_t value[4];
+
+    /* Write a setting, and then part of it with another address and
+       size. */
+    memcpy(value, "\x01\x02\x03\x04", 4);
+    BTASSERT(setting_write(SETTING_UINT32_ADDR,
+                           value,
+                           SETTING_UINT32_SIZE) == SETTING_UINT32_SIZE);
+    BTASSERT(setting_write(SETTING_UINT32_ADDR + 2, "\x05\x06", 2) == 2);
+
+    /* The newest bytes are read with either address and size. */
+    BTASSERT(setting_read(value,
+                          SETTING_UINT32_ADDR,
+                          SETTING_UINT32_SIZE) == SETTING_UINT32_SIZE);
+    BTASSERT(memcmp(value, "\x01\x02\x05\x06", 4) == 0);
+    BTASSERT(setting_read(value, SETTING_UINT32_ADDR + 1, 2) == 2);
+    BTASSERT(memcmp(value, "\x02\x05", 2) == 0);
+
+    /* Overwrite the whole setting again, also after a restart. */
+    memcpy(value, "\x07\x08\x09\x0a", 4);
+    BTASSERT(setting_write(SETTING_UINT32_ADDR,
+                           value,
+                           SETTING_UINT32_SIZE) == SETTING_UINT32_SIZE);
+    BTASSERT(setting_module_init() == 0);
+    BTASSERT(setting_read(value, SETTING_UINT32_ADDR + 2, 2) == 2);
+    BTASSERT(memcmp(value, "\x09\x0a", 2) == 0);
+
+    /* Overlapping settings with another address or size are not
+       allowed in a transaction. */
+    BTASSERT(setting_transaction_init(&transaction, buf, sizeof(buf)) == 0);
+    BTASSERT(setting_transaction_write(&transaction,
+                                       SETTING_UINT32_ADDR,
+                                       value,
+                                       SETTING_UINT32_SIZE) == 0);
+    BTASSERT(setting_transaction_write(&transaction,
+                                       SETTING_UINT32_ADDR + 3,
+                                       value,
+                                       2) == -EINVAL);
+    BTASSERT(setting_transaction_write(&transaction,
+                                       SETTING_UINT32_ADDR,
+                                       value,
+                                       SETTING_UINT32_SIZE) == 0);
+
+    return (0);
+}
+
 int main()
 {
     struct harness_t harness;
@@ -125,6 +362,11 @@ int main()
         { test_integer, "test_integer" },
         { test_unsigned_integer, "test_unsigned_integer" },
         { test_string, "test_string" },
+        { test_transaction, "test_transaction" },
+        { test_compaction, "test_compaction" },
+        { test_restart, "test_restart" },
+        { test_power_failure, "test_power_failure" },
+        { test_overlap, "test_overlap" },
         { NULL, NULL }
     };
 
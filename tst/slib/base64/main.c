@@ -41,6 +41,83 @@ static char decoded_ma[] = "Ma";
 static char encoded_man[] = "TWFu";
 static char decoded_man[] = "Man";
 
+/* Benchmark duration in microseconds. */
+#define BENCHMARK_DURATION_US                          200000
+
+struct buffer_t {
+    struct chan_t base;
+    uint8_t buf[2048];
+    size_t size;
+};
+
+static struct buffer_t output;
+static uint8_t data[1024];
+static char encoded[2048];
+static uint8_t decoded[2048];
+
+static ssize_t buffer_write(struct buffer_t *self_p,
+                            const void *buf_p,
+                            size_t size)
+{
+    if (self_p->size + size > sizeof(self_p->buf)) {
+        return (-ENOMEM);
+    }
+
+    memcpy(&self_p->buf[self_p->size], buf_p, size);
+    self_p->size += size;
+
+    return (size);
+}
+
+static void buffer_init(struct buffer_t *self_p)
+{
+    chan_init(&self_p->base,
+              NULL,
+              (ssize_t (*)(void *, const void *, size_t))buffer_write,
+              NULL);
+    self_p->size = 0;
+}
+
+/* Bit by bit reference encoder. */
+static void reference_encode(char *dst_p,
+                             const uint8_t *src_p,
+                             size_t size,
+                             const char *alphabet_p)
+{
+    size_t bit;
+    int index;
+    int i;
+
+    for (bit = 0; bit < 8 * size; bit += 6) {
+        index = 0;
+
+        for (i = 0; i < 6; i++) {
+            index <<= 1;
+
+            if ((bit + i) < 8 * size) {
+                index |= ((src_p[(bit + i) / 8] >> (7 - (bit + i) % 8)) & 1);
+            }
+        }
+
+        *dst_p++ = alphabet_p[index];
+    }
+
+    while ((size % 3) != 0) {
+        *dst_p++ = '=';
+        size++;
+    }
+}
+
+static long elapsed_us(struct time_t *start_p)
+{
+    struct time_t now;
+
+    time_get(&now);
+
+    return (1000000L * (now.seconds - start_p->seconds)
+            + (now.nanoseconds - start_p->nanoseconds) / 1000L);
+}
+
 static int test_encode(struct harness_t *harness_p)
 {
     char buf[512];
@@ -84,6 +161,218 @@ static int test_decode(struct harness_t *harness_p)
     buf[strlen(decoded_man)] = '\0';
     BTASSERT(strcmp(buf, decoded_man) == 0);
 
+    /* No bytes are written for the padding. */
+    memset(buf, 0x55, 3);
+    BTASSERT(base64_decode(buf, encoded_m, strlen(encoded_m)) == 0);
+    BTASSERT(buf[0] == 'M');
+    BTASSERT(buf[1] == 0x55);
+    BTASSERT(buf[2] == 0x55);
+
+    return (0);
+}
+
+static int test_compare_with_reference(struct harness_t *harness_p)
+{
+    char reference[2048];
+    size_t offset;
+    size_t size;
+    size_t i;
+
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = (i * 37 + (i >> 3));
+    }
+
+    /* All sizes through the SIMD, twelve bytes and three bytes
+       loops. */
+    for (offset = 0; offset < 3; offset++) {
+        for (size = 0; size < 200; size++) {
+            reference_encode(reference,
+                             &data[offset],
+                             size,
+                             "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                             "abcdefghijklmnopqrstuvwxyz"
+                             "0123456789+/");
+            BTASSERT(base64_encode(encoded, &data[offset], size) == 0);
+            BTASSERT(memcmp(encoded,
+                            reference,
+                            BASE64_ENCODED_SIZE(size)) == 0);
+            BTASSERT(base64_decode(decoded,
+                                   encoded,
+                                   BASE64_ENCODED_SIZE(size)) == 0);
+            BTASSERT(memcmp(decoded, &data[offset], size) == 0);
+
+            reference_encode(reference,
+                             &data[offset],
+                             size,
+                             "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                             "abcdefghijklmnopqrstuvwxyz"
+                             "0123456789-_");
+            BTASSERT(base64_url_encode(encoded, &data[offset], size) == 0);
+            BTASSERT(memcmp(encoded,
+                            reference,
+                            BASE64_ENCODED_SIZE(size)) == 0);
+            BTASSERT(base64_url_decode(decoded,
+                                       encoded,
+                                       BASE64_ENCODED_SIZE(size)) == size);
+            BTASSERT(memcmp(decoded, &data[offset], size) == 0);
+        }
+    }
+
+    return (0);
+}
+
+static int test_url(struct harness_t *harness_p)
+{
+    uint8_t buf[4];
+
+    BTASSERT(base64_url_encode(encoded, "\xfb\xff", 2) == 0);
+    BTASSERT(memcmp(encoded, "-_8=", 4) == 0);
+
+    /* Padding is optional. */
+    BTASSERT(base64_url_decode(buf, "-_8=", 4) == 2);
+    BTASSERT(memcmp(buf, "\xfb\xff", 2) == 0);
+    BTASSERT(base64_url_decode(buf, "-_8", 3) == 2);
+    BTASSERT(memcmp(buf, "\xfb\xff", 2) == 0);
+    BTASSERT(base64_url_decode(buf, "TQ", 2) == 1);
+    BTASSERT(buf[0] == 'M');
+    BTASSERT(base64_url_decode(buf, "", 0) == 0);
+
+    /* Wrong alphabet and sizes. */
+    BTASSERT(base64_url_decode(buf, "+/8=", 4) == -EINVAL);
+    BTASSERT(base64_decode(buf, "-_8=", 4) == -EINVAL);
+    BTASSERT(base64_url_decode(buf, "T", 1) == -EINVAL);
+    BTASSERT(base64_url_decode(buf, "TWFuT", 5) == -EINVAL);
+
+    return (0);
+}
+
+static int test_invalid(struct harness_t *harness_p)
+{
+    char buf[32];
+    int valid;
+    int i;
+    int c;
+
+    /* Every character at every position. The first 16 characters are
+       decoded 16 at a time, if supported by the CPU. */
+    for (i = 0; i < sizeof(buf); i++) {
+        for (c = 0; c < 256; c++) {
+            memset(buf, 'A', sizeof(buf));
+            buf[i] = c;
+            valid = (((c >= 'A') && (c <= 'Z'))
+                     || ((c >= 'a') && (c <= 'z'))
+                     || ((c >= '0') && (c <= '9'))
+                     || (c == '+')
+                     || (c == '/'));
+
+            if (valid) {
+                BTASSERT(base64_decode(decoded, buf, sizeof(buf)) == 0);
+            } else if ((c != '=') || (i < 30)) {
+                BTASSERT(base64_decode(decoded, buf, sizeof(buf)) == -EINVAL);
+            }
+        }
+    }
+
+    /* Padding. */
+    BTASSERT(base64_decode(decoded, "TQ==TQ==", 8) == -EINVAL);
+    BTASSERT(base64_decode(decoded, "T===", 4) == -EINVAL);
+    BTASSERT(base64_decode(decoded, "TQ=A", 4) == -EINVAL);
+    BTASSERT(base64_decode(decoded, "TWFu", 3) == -EINVAL);
+
+    return (0);
+}
+
+static int test_stream(struct harness_t *harness_p)
+{
+    struct base64_encoder_t encoder;
+    struct base64_decoder_t decoder;
+    size_t chunk;
+    size_t i;
+    size_t size;
+
+    /* Split the data in chunks of different sizes. */
+    for (chunk = 1; chunk < 100; chunk += 7) {
+        buffer_init(&output);
+        BTASSERT(base64_encoder_init(&encoder,
+                                     &output.base,
+                                     BASE64_ALPHABET_STANDARD) == 0);
+
+        for (i = 0; i < 500; i += size) {
+            size = MIN(chunk, 500 - i);
+            BTASSERT(chan_write(&encoder, &data[i], size) == size);
+        }
+
+        BTASSERT(base64_encoder_finish(&encoder) == 0);
+        BTASSERT(output.size == BASE64_ENCODED_SIZE(500));
+        BTASSERT(base64_encode(encoded, data, 500) == 0);
+        BTASSERT(memcmp(output.buf, encoded, output.size) == 0);
+
+        buffer_init(&output);
+        BTASSERT(base64_decoder_init(&decoder,
+                                     &output.base,
+                                     BASE64_ALPHABET_STANDARD) == 0);
+
+        for (i = 0; i < BASE64_ENCODED_SIZE(500); i += size) {
+            size = MIN(chunk, BASE64_ENCODED_SIZE(500) - i);
+            BTASSERT(chan_write(&decoder, &encoded[i], size) == size);
+        }
+
+        BTASSERT(base64_decoder_finish(&decoder) == 0);
+        BTASSERT(output.size == 500);
+        BTASSERT(memcmp(output.buf, data, 500) == 0);
+    }
+
+    /* Unpadded URL safe data. */
+    buffer_init(&output);
+    BTASSERT(base64_decoder_init(&decoder,
+                                 &output.base,
+                                 BASE64_ALPHABET_URL) == 0);
+    BTASSERT(base64_decoder_write(&decoder, "TWFu-_", 6) == 6);
+    BTASSERT(base64_decoder_write(&decoder, "8", 1) == 1);
+    BTASSERT(base64_decoder_finish(&decoder) == 0);
+    BTASSERT(output.size == 5);
+    BTASSERT(memcmp(output.buf, "Man\xfb\xff", 5) == 0);
+
+    /* Padding before the end. */
+    buffer_init(&output);
+    BTASSERT(base64_decoder_init(&decoder,
+                                 &output.base,
+                                 BASE64_ALPHABET_STANDARD) == 0);
+    BTASSERT(base64_decoder_write(&decoder, "TQ==", 4) == 4);
+    BTASSERT(base64_decoder_write(&decoder, "TQ==", 4) == -EINVAL);
+
+    return (0);
+}
+
+static int test_benchmark(struct harness_t *harness_p)
+{
+    struct time_t start;
+    long blocks;
+
+    blocks = 0;
+    time_get(&start);
+
+    do {
+        BTASSERT(base64_encode(encoded, data, 768) == 0);
+        blocks++;
+    } while (elapsed_us(&start) < BENCHMARK_DURATION_US);
+
+    std_printf(FSTR("encode: %ld kB/s.\r\n"),
+               (long)((768LL * blocks * 1000000LL / 1024)
+                      / elapsed_us(&start)));
+
+    blocks = 0;
+    time_get(&start);
+
+    do {
+        BTASSERT(base64_decode(decoded, encoded, 1024) == 0);
+        blocks++;
+    } while (elapsed_us(&start) < BENCHMARK_DURATION_US);
+
+    std_printf(FSTR("decode: %ld kB/s.\r\n"),
+               (long)((768LL * blocks * 1000000LL / 1024)
+                      / elapsed_us(&start)));
+
     return (0);
 }
 
@@ -93,6 +382,11 @@ int main()
     struct harness_testcase_t harness_testcases[] = {
         { test_encode, "test_encode" },
         { test_decode, "test_decode" },
+        { test_compare_with_reference, "test_compare_with_reference" },
+        { test_url, "test_url" },
+        { test_invalid, "test_invalid" },
+        { test_stream, "test_stream" },
+        { test_benchmark, "test_benchmark" },
         { NULL, NULL }
     };
 
@@ -20,11 +20,217 @@
 
 #include "simba.h"
 
+/* Run long enough to be measured with the system tick. */
+#if defined(ARCH_LINUX)
+#    define BENCHMARK_BLOCKS_MAX                        20000
+#else
+#    define BENCHMARK_BLOCKS_MAX                          100
+#endif
+
+static uint8_t buf[1024];
+
+/* Bit at a time reference implementations. */
+static uint32_t reference_crc_32(uint32_t crc, const uint8_t *buf_p, size_t size)
+{
+    int i;
+
+    crc = ~crc;
+
+    while (size-- > 0) {
+        crc ^= *buf_p++;
+
+        for (i = 0; i < 8; i++) {
+            crc = ((crc >> 1) ^ ((crc & 1) ? 0xedb88320 : 0));
+        }
+    }
+
+    return (~crc);
+}
+
+static uint16_t reference_crc_xmodem(uint16_t crc,
+                                     const uint8_t *buf_p,
+                                     size_t size)
+{
+    int i;
+
+    while (size-- > 0) {
+        crc ^= (*buf_p++ << 8);
+
+        for (i = 0; i < 8; i++) {
+            crc = ((crc << 1) ^ ((crc & 0x8000) ? 0x1021 : 0));
+        }
+    }
+
+    return (crc);
+}
+
+static uint8_t reference_crc_7(uint8_t crc, const uint8_t *buf_p, size_t size)
+{
+    int i;
+
+    while (size-- > 0) {
+        for (i = 7; i >= 0; i--) {
+            crc <<= 1;
+
+            if (((crc >> 7) ^ (*buf_p >> i)) & 1) {
+                crc ^= 0x09;
+            }
+        }
+
+        crc &= 0x7f;
+        buf_p++;
+    }
+
+    return (crc);
+}
+
+static long elapsed_us(struct time_t *start_p, struct time_t *stop_p)
+{
+    long us;
+
+    us = (1000000L * (stop_p->seconds - start_p->seconds)
+          + (stop_p->nanoseconds - start_p->nanoseconds) / 1000L);
+
+    if (us == 0) {
+        us = 1;
+    }
+
+    return (us);
+}
+
+static void print_throughput(const char *name_p,
+                             long blocks,
+                             struct time_t *start_p,
+                             struct time_t *stop_p)
+{
+    long long size;
+
+    size = (512LL * blocks);
+
+    std_printf(FSTR("%s: %ld kB/s.\r\n"),
+               name_p,
+               (long)((size * 1000000LL / 1024) / elapsed_us(start_p, stop_p)));
+}
+
 int test_calculate_crc(struct harness_t *harness_p)
 {
     char string[] = "The quick brown fox jumps over the lazy dog";
 
     BTASSERT(crc_32(0, string, strlen(string)) == 0x414fa339);
+    BTASSERT(crc_32(0, "123456789", 9) == 0xcbf43926);
+    BTASSERT(crc_xmodem(0, "123456789", 9) == 0x31c3);
+    BTASSERT(crc_7(0, "123456789", 9) == 0x75);
+
+    /* SD card commands CMD0 and CMD8. */
+    BTASSERT(crc_7(0, "\x40\x00\x00\x00\x00", 5) == 0x4a);
+    BTASSERT(crc_7(0, "\x48\x00\x00\x01\xaa", 5) == 0x43);
+
+    return (0);
+}
+
+int test_compare_with_reference(struct harness_t *harness_p)
+{
+    size_t offset;
+    size_t size;
+    size_t i;
+
+    for (i = 0; i < sizeof(buf); i++) {
+        buf[i] = (i * 37 + (i >> 3));
+    }
+
+    /* All sizes and alignments through the hardware, slicing and byte
+       at a time loops. */
+    for (offset = 0; offset < 8; offset++) {
+        for (size = 0; size < 300; size++) {
+            BTASSERT(crc_32(0, &buf[offset], size)
+                     == reference_crc_32(0, &buf[offset], size));
+            BTASSERT(crc_xmodem(0, &buf[offset], size)
+                     == reference_crc_xmodem(0, &buf[offset], size));
+            BTASSERT(crc_7(0, &buf[offset], size)
+                     == reference_crc_7(0, &buf[offset], size));
+        }
+    }
+
+    BTASSERT(crc_32(0, buf, sizeof(buf))
+             == reference_crc_32(0, buf, sizeof(buf)));
+
+    return (0);
+}
+
+int test_incremental(struct harness_t *harness_p)
+{
+    size_t size;
+
+    for (size = 0; size < sizeof(buf); size += 61) {
+        BTASSERT(crc_32(crc_32(0, buf, size), &buf[size], sizeof(buf) - size)
+                 == crc_32(0, buf, sizeof(buf)));
+        BTASSERT(crc_xmodem(crc_xmodem(0, buf, size),
+                            &buf[size],
+                            sizeof(buf) - size)
+                 == crc_xmodem(0, buf, sizeof(buf)));
+        BTASSERT(crc_7(crc_7(0, buf, size), &buf[size], sizeof(buf) - size)
+                 == crc_7(0, buf, sizeof(buf)));
+    }
+
+    return (0);
+}
+
+int test_benchmark(struct harness_t *harness_p)
+{
+    struct time_t start;
+    struct time_t stop;
+    uint32_t crc32;
+    uint16_t crc16;
+    uint8_t crc7;
+    long i;
+
+    crc32 = 0;
+    time_get(&start);
+
+    for (i = 0; i < 16 * BENCHMARK_BLOCKS_MAX; i++) {
+        crc32 = crc_32(crc32, buf, 512);
+    }
+
+    time_get(&stop);
+    print_throughput("crc_32", 16 * BENCHMARK_BLOCKS_MAX, &start, &stop);
+
+    crc32 = 0;
+    time_get(&start);
+
+    for (i = 0; i < BENCHMARK_BLOCKS_MAX / 8; i++) {
+        crc32 = reference_crc_32(crc32, buf, 512);
+    }
+
+    time_get(&stop);
+    print_throughput("reference_crc_32",
+                     BENCHMARK_BLOCKS_MAX / 8,
+                     &start,
+                     &stop);
+
+    crc16 = 0;
+    time_get(&start);
+
+    for (i = 0; i < BENCHMARK_BLOCKS_MAX; i++) {
+        crc16 = crc_xmodem(crc16, buf, 512);
+    }
+
+    time_get(&stop);
+    print_throughput("crc_xmodem", BENCHMARK_BLOCKS_MAX, &start, &stop);
+
+    crc7 = 0;
+    time_get(&start);
+
+    for (i = 0; i < BENCHMARK_BLOCKS_MAX; i++) {
+        crc7 = crc_7(crc7, buf, 512);
+    }
+
+    time_get(&stop);
+    print_throughput("crc_7", BENCHMARK_BLOCKS_MAX, &start, &stop);
+
+    /* Use the results. */
+    BTASSERT(crc32 != 0x12345678);
+    BTASSERT(crc16 != 0x1234);
+    BTASSERT(crc7 != 0x80);
 
     return (0);
 }
@@ -34,6 +240,9 @@ int main()
     struct harness_t harness;
     struct harness_testcase_t harness_testcases[] = {
         { test_calculate_crc, "test_calculate_crc" },
+        { test_compare_with_reference, "test_compare_with_reference" },
+        { test_incremental, "test_incremental" },
+        { test_benchmark, "test_benchmark" },
         { NULL, NULL }
     };
 
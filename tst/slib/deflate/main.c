@@ -0,0 +1,386 @@
+/**
+ * @file main.c
+ * @version 0.5.0
+ *
+ * @section License
+ * Copyright (C) 2014-2016, Erik Moqvist
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Simba project.
+ */
+
+#include "simba.h"
+
+/* Write only channel collecting written data in a buffer. */
+struct buffer_t {
+    struct chan_t base;
+    uint8_t buf[16384];
+    size_t size;
+};
+
+static struct deflate_t deflate;
+static struct inflate_t inflate;
+static struct buffer_t compressed;
+static struct buffer_t decompressed;
+static uint8_t data[12000];
+
+static const char text[] =
+    "{\"temperature\": 21.5, \"humidity\": 40, \"pressure\": 1013}\n";
+
+static ssize_t buffer_write(struct buffer_t *self_p,
+                            const void *buf_p,
+                            size_t size)
+{
+    if (size > sizeof(self_p->buf) - self_p->size) {
+        return (-ENOMEM);
+    }
+
+    memcpy(&self_p->buf[self_p->size], buf_p, size);
+    self_p->size += size;
+
+    return (size);
+}
+
+static void buffer_init(struct buffer_t *self_p)
+{
+    chan_init(&self_p->base,
+              NULL,
+              (ssize_t (*)(void *, const void *, size_t))buffer_write,
+              NULL);
+    self_p->size = 0;
+}
+
+/**
+ * Decompress given data in chunks of given size.
+ */
+static int decompress(const void *buf_p,
+                      size_t size,
+                      size_t chunk_size)
+{
+    const uint8_t *b_p;
+    size_t n;
+
+    b_p = buf_p;
+
+    while (size > 0) {
+        n = MIN(size, chunk_size);
+
+        if (inflate_write(&inflate, b_p, n) != n) {
+            return (-1);
+        }
+
+        b_p += n;
+        size -= n;
+    }
+
+    return (0);
+}
+
+static int test_inflate_fixed(struct harness_t *harness_p)
+{
+    /* "hello" compressed with fixed Huffman codes by zlib. */
+    static const uint8_t hello[] = {
+        0xcb, 0x48, 0xcd, 0xc9, 0xc9, 0x07, 0x00
+    };
+
+    buffer_init(&decompressed);
+    BTASSERT(inflate_init(&inflate, &decompressed.base) == 0);
+    BTASSERT(inflate_write(&inflate, hello, sizeof(hello)) == sizeof(hello));
+    BTASSERT(decompressed.size == 5);
+    BTASSERT(memcmp(decompressed.buf, "hello", 5) == 0);
+
+    return (0);
+}
+
+static int test_inflate_dynamic(struct harness_t *harness_p)
+{
+    /* Compressed with dynamic Huffman codes by zlib. */
+    static const uint8_t fox[] = {
+        0xcd, 0xca, 0xc9, 0x01, 0x80, 0x20, 0x0c, 0x04, 0xc0, 0x56,
+        0xb6, 0x02, 0x9a, 0x91, 0x06, 0x82, 0x89, 0x88, 0x0a, 0x41,
+        0x0e, 0xaf, 0xea, 0xb5, 0x0c, 0xdf, 0x33, 0x76, 0x16, 0xec,
+        0x3d, 0x8c, 0x2b, 0x5c, 0xd1, 0x33, 0x61, 0xd2, 0x0b, 0x4b,
+        0x8f, 0xb9, 0x42, 0x0f, 0x29, 0x68, 0x1f, 0x6f, 0xf4, 0xdc,
+        0x60, 0xf5, 0x06, 0xf6, 0x1f, 0x79, 0x08, 0xd1, 0x11, 0x42,
+        0x05, 0x25, 0x48, 0x74, 0xc2, 0x2c, 0x0c, 0xcd, 0x52, 0xa8,
+        0x85, 0xe4, 0x51, 0xef, 0xda, 0x24, 0x9a, 0x17
+    };
+    static const char expected[] =
+        "The quick brown fox jumps over the lazy dog. "
+        "The quick brown fox jumps over the lazy dog. "
+        "The quick brown fox jumps over the lazy dog. "
+        "The quick brown fox jumps over the lazy dog. "
+        "Simba is an embedded operating system.";
+
+    /* All at once. */
+    buffer_init(&decompressed);
+    BTASSERT(inflate_init(&inflate, &decompressed.base) == 0);
+    BTASSERT(decompress(fox, sizeof(fox), sizeof(fox)) == 0);
+    BTASSERT(decompressed.size == strlen(expected));
+    BTASSERT(memcmp(decompressed.buf, expected, strlen(expected)) == 0);
+
+    /* One byte at a time. */
+    buffer_init(&decompressed);
+    BTASSERT(inflate_init(&inflate, &decompressed.base) == 0);
+    BTASSERT(decompress(fox, sizeof(fox), 1) == 0);
+    BTASSERT(decompressed.size == strlen(expected));
+    BTASSERT(memcmp(decompressed.buf, expected, strlen(expected)) == 0);
+
+    return (0);
+}
+
+static int test_inflate_stored(struct harness_t *harness_p)
+{
+    static const uint8_t abc[] = {
+        0x01, 0x03, 0x00, 0xfc, 0xff, 0x61, 0x62, 0x63
+    };
+
+    buffer_init(&decompressed);
+    BTASSERT(inflate_init(&inflate, &decompressed.base) == 0);
+    BTASSERT(decompress(abc, sizeof(abc), 3) == 0);
+    BTASSERT(decompressed.size == 3);
+    BTASSERT(memcmp(decompressed.buf, "abc", 3) == 0);
+
+    return (0);
+}
+
+static int test_inflate_corrupt(struct harness_t *harness_p)
+{
+    /* Reserved block type. */
+    static const uint8_t reserved[] = { 0x07 };
+    /* Stored block length check mismatch. */
+    static const uint8_t stored[] = { 0x01, 0x03, 0x00, 0xfc, 0xfe };
+    /* A match before the start of the data. */
+    static const uint8_t distance[] = { 0x03, 0x02 };
+
+    buffer_init(&decompressed);
+    BTASSERT(inflate_init(&inflate, &decompressed.base) == 0);
+    BTASSERT(inflate_write(&inflate, reserved, sizeof(reserved)) == -EBADMSG);
+
+    BTASSERT(inflate_init(&inflate, &decompressed.base) == 0);
+    BTASSERT(inflate_write(&inflate, stored, sizeof(stored)) == -EBADMSG);
+
+    BTASSERT(inflate_init(&inflate, &decompressed.base) == 0);
+    BTASSERT(inflate_write(&inflate, distance, sizeof(distance)) == -EBADMSG);
+
+    return (0);
+}
+
+/**
+ * Compress given data and decompress it again.
+ */
+static int round_trip(const uint8_t *buf_p,
+                      size_t size)
+{
+    size_t i;
+    size_t n;
+
+    buffer_init(&compressed);
+    buffer_init(&decompressed);
+
+    if (deflate_init(&deflate, &compressed.base, DEFLATE_FORMAT_RAW) != 0) {
+        return (-1);
+    }
+
+    for (i = 0; i < size; i += n) {
+        n = MIN(size - i, 100);
+
+        if (chan_write(&deflate, &buf_p[i], n) != n) {
+            return (-1);
+        }
+    }
+
+    if (deflate_finish(&deflate) != 0) {
+        return (-1);
+    }
+
+    if (inflate_init(&inflate, &decompressed.base) != 0) {
+        return (-1);
+    }
+
+    if (decompress(compressed.buf, compressed.size, 7) != 0) {
+        return (-1);
+    }
+
+    if ((decompressed.size != size)
+        || (memcmp(decompressed.buf, buf_p, size) != 0)) {
+        return (-1);
+    }
+
+    return (compressed.size);
+}
+
+static int test_round_trip(struct harness_t *harness_p)
+{
+    uint32_t seed;
+    size_t i;
+    int size;
+
+    /* Empty. */
+    BTASSERT(round_trip(data, 0) >= 0);
+
+    /* Repeated text. */
+    for (i = 0; i < 200; i++) {
+        memcpy(&data[i * (sizeof(text) - 1)], text, sizeof(text) - 1);
+    }
+
+    size = round_trip(data, 200 * (sizeof(text) - 1));
+    std_printf(FSTR("text: %u -> %d bytes\r\n"),
+               200 * (sizeof(text) - 1),
+               size);
+    BTASSERT(size > 0);
+    BTASSERT(size < 200 * (sizeof(text) - 1) / 10);
+
+    /* Zeros. */
+    memset(data, 0, sizeof(data));
+    size = round_trip(data, sizeof(data));
+    BTASSERT(size > 0);
+    BTASSERT(size < sizeof(data) / 50);
+
+    /* Pseudo random data is expanded by at most one bit per byte. */
+    seed = 1;
+
+    for (i = 0; i < sizeof(data); i++) {
+        seed = (1103515245 * seed + 12345);
+        data[i] = (seed >> 16);
+    }
+
+    size = round_trip(data, sizeof(data));
+    BTASSERT(size > 0);
+    BTASSERT(size <= 9 * sizeof(data) / 8 + 16);
+
+    /* Random data repeated at a distance longer than the window. */
+    memcpy(&data[DEFLATE_WINDOW_SIZE + 1], data, DEFLATE_WINDOW_SIZE);
+    BTASSERT(round_trip(data, sizeof(data)) > 0);
+
+    return (0);
+}
+
+static int test_flush(struct harness_t *harness_p)
+{
+    size_t first;
+    size_t second;
+
+    buffer_init(&compressed);
+    buffer_init(&decompressed);
+    BTASSERT(deflate_init(&deflate,
+                          &compressed.base,
+                          DEFLATE_FORMAT_RAW) == 0);
+    BTASSERT(inflate_init(&inflate, &decompressed.base) == 0);
+
+    /* The first message. */
+    BTASSERT(deflate_write(&deflate, text, sizeof(text) - 1) == sizeof(text) - 1);
+    BTASSERT(deflate_flush(&deflate) == 0);
+    first = compressed.size;
+    BTASSERT(first > 4);
+    BTASSERT(memcmp(&compressed.buf[first - 4], "\x00\x00\xff\xff", 4) == 0);
+    BTASSERT(decompress(compressed.buf, first, first) == 0);
+    BTASSERT(decompressed.size == sizeof(text) - 1);
+
+    /* The second message refers to the first. */
+    BTASSERT(deflate_write(&deflate, text, sizeof(text) - 1) == sizeof(text) - 1);
+    BTASSERT(deflate_flush(&deflate) == 0);
+    second = (compressed.size - first);
+    BTASSERT(second < first / 4);
+    BTASSERT(memcmp(&compressed.buf[compressed.size - 4],
+                    "\x00\x00\xff\xff",
+                    4) == 0);
+    BTASSERT(decompress(&compressed.buf[first], second, second) == 0);
+    BTASSERT(decompressed.size == 2 * (sizeof(text) - 1));
+    BTASSERT(memcmp(&decompressed.buf[sizeof(text) - 1],
+                    text,
+                    sizeof(text) - 1) == 0);
+
+    /* An empty message. */
+    BTASSERT(deflate_flush(&deflate) == 0);
+    BTASSERT(compressed.size - first - second == 5);
+
+    return (0);
+}
+
+static int test_gzip(struct harness_t *harness_p)
+{
+    uint8_t *trailer_p;
+    uint32_t crc;
+    uint32_t size;
+
+    buffer_init(&compressed);
+    buffer_init(&decompressed);
+    BTASSERT(deflate_init(&deflate,
+                          &compressed.base,
+                          DEFLATE_FORMAT_GZIP) == 0);
+    BTASSERT(deflate_write(&deflate, text, sizeof(text) - 1) == sizeof(text) - 1);
+    BTASSERT(deflate_write(&deflate, text, sizeof(text) - 1) == sizeof(text) - 1);
+    BTASSERT(deflate_finish(&deflate) == 0);
+
+    /* Header. */
+    BTASSERT(compressed.size > 18);
+    BTASSERT(memcmp(compressed.buf, "\x1f\x8b\x08\x00", 4) == 0);
+
+    /* Trailer. */
+    trailer_p = &compressed.buf[compressed.size - 8];
+    crc = ((trailer_p[3] << 24)
+           | (trailer_p[2] << 16)
+           | (trailer_p[1] << 8)
+           | trailer_p[0]);
+    size = ((trailer_p[7] << 24)
+            | (trailer_p[6] << 16)
+            | (trailer_p[5] << 8)
+            | trailer_p[4]);
+    BTASSERT(size == 2 * (sizeof(text) - 1));
+
+    /* Compressed data. */
+    BTASSERT(inflate_init(&inflate, &decompressed.base) == 0);
+    BTASSERT(decompress(&compressed.buf[10], compressed.size - 18, 64) == 0);
+    BTASSERT(decompressed.size == size);
+    BTASSERT(crc_32(0, decompressed.buf, decompressed.size) == crc);
+
+    return (0);
+}
+
+static int test_bytes_saved(struct harness_t *harness_p)
+{
+    char command[64];
+
+    buffer_init(&decompressed);
+    strcpy(command, "/slib/deflate/bytes_saved");
+    BTASSERT(fs_call(command, NULL, &decompressed.base, NULL) == 0);
+    BTASSERT(decompressed.size == 18);
+    BTASSERT(memcmp(decompressed.buf, "0000000000000000", 16) != 0);
+
+    return (0);
+}
+
+int main()
+{
+    struct harness_t harness;
+    struct harness_testcase_t harness_testcases[] = {
+        { test_inflate_fixed, "test_inflate_fixed" },
+        { test_inflate_dynamic, "test_inflate_dynamic" },
+        { test_inflate_stored, "test_inflate_stored" },
+        { test_inflate_corrupt, "test_inflate_corrupt" },
+        { test_round_trip, "test_round_trip" },
+        { test_flush, "test_flush" },
+        { test_gzip, "test_gzip" },
+        { test_bytes_saved, "test_bytes_saved" },
+        { NULL, NULL }
+    };
+
+    sys_start();
+    uart_module_init();
+    deflate_module_init();
+
+    harness_init(&harness);
+    harness_run(&harness, harness_testcases);
+
+    return (0);
+}
@@ -0,0 +1,10 @@
+#!/usr/bin/env bash
+# create a empty FAT32 file system in a file called 'sdcard32'
+
+set -e
+
+FILENAME=sdcard32
+
+rm -f ${FILENAME}
+dd bs=1M count=0 seek=64 of=${FILENAME}
+mkdosfs -F 32 -s 1 ${FILENAME}
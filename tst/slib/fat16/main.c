@@ -25,17 +25,37 @@ static struct spi_driver_t spi;
 static struct sd_driver_t sd;
 #endif
 
+/* Benchmark duration in microseconds. */
+#define BENCHMARK_DURATION_US                          200000
+
 static struct fat16_t fs;
 
 #if defined(ARCH_LINUX)
 static FILE *file_p = NULL;
 
+/* Number of block reads and writes from and to the storage device. */
+static long device_reads = 0;
+static long device_writes = 0;
+
+/* Number of multi block read and write calls. */
+static long device_multi_reads = 0;
+static long device_multi_writes = 0;
+
+/* Multi block read call that fails, or -1. */
+static long device_multi_reads_fail = -1;
+
+static uint8_t buf[2048];
+static uint8_t big_buf[32768];
+static uint8_t bitmap[1024];
+
 static ssize_t linux_read_block(void *arg_p,
                                 void *dst_p,
                                 uint32_t src_block)
 {
     size_t block_start;
 
+    device_reads++;
+
     /* Find given block. */
     block_start = (SD_BLOCK_SIZE * src_block);
 
@@ -52,6 +72,8 @@ static ssize_t linux_write_block(void *arg_p,
 {
     size_t block_start;
 
+    device_writes++;
+
     /* Find given block. */
     block_start = (SD_BLOCK_SIZE * dst_block);
 
@@ -67,6 +89,45 @@ static ssize_t linux_write_block(void *arg_p,
 
     return (SD_BLOCK_SIZE);
 }
+
+static ssize_t linux_read_blocks(void *arg_p,
+                                 void *dst_p,
+                                 uint32_t src_block,
+                                 size_t count)
+{
+    device_multi_reads++;
+
+    if (device_multi_reads == device_multi_reads_fail) {
+        return (-1);
+    }
+
+    if (fseek(arg_p, SD_BLOCK_SIZE * src_block, SEEK_SET) != 0) {
+        return (-1);
+    }
+
+    return (fread(dst_p, 1, SD_BLOCK_SIZE * count, arg_p));
+}
+
+static ssize_t linux_write_blocks(void *arg_p,
+                                  uint32_t dst_block,
+                                  const void *src_p,
+                                  size_t count)
+{
+    device_multi_writes++;
+
+    if (fseek(arg_p, SD_BLOCK_SIZE * dst_block, SEEK_SET) != 0) {
+        return (-1);
+    }
+
+    if (fwrite(src_p, 1, SD_BLOCK_SIZE * count, arg_p)
+        != (SD_BLOCK_SIZE * count)) {
+        return (-1);
+    }
+
+    fflush(arg_p);
+
+    return (SD_BLOCK_SIZE * count);
+}
 #endif
 
 int test_print(struct harness_t *harness_p)
@@ -272,6 +333,818 @@ int test_append(struct harness_t *harness_p)
     return (0);
 }
 
+#if defined(ARCH_LINUX)
+
+static long elapsed_us(struct time_t *start_p)
+{
+    struct time_t now;
+
+    time_get(&now);
+
+    return (1000000L * (now.seconds - start_p->seconds)
+            + (now.nanoseconds - start_p->nanoseconds) / 1000L);
+}
+
+/**
+ * Create a file of given size with a known pattern.
+ */
+static int create_file(const char *path_p, size_t size)
+{
+    struct fat16_file_t file;
+    size_t i;
+    size_t n;
+
+    if (fat16_file_open(&fs, &file, path_p, O_CREAT | O_WRITE | O_TRUNC) != 0) {
+        return (-1);
+    }
+
+    for (i = 0; i < size; i += n) {
+        n = MIN(sizeof(buf), size - i);
+        memset(buf, (i / sizeof(buf)), n);
+
+        if (fat16_file_write(&file, buf, n) != n) {
+            return (-1);
+        }
+    }
+
+    return (fat16_file_close(&file));
+}
+
+int test_cache(struct harness_t *harness_p)
+{
+    struct fat16_file_t file;
+    long reads;
+    long writes;
+    size_t i;
+    size_t blocks;
+
+    BTASSERT(create_file("CACHE.TXT", 16 * sizeof(buf)) == 0);
+
+    /* Read the file sequentially. Each data block is read once from
+       the device. The FAT block is cached in the FAT part of the
+       cache and not read at each cluster boundary. */
+    BTASSERT(fat16_file_open(&fs, &file, "CACHE.TXT", O_READ) == 0);
+    reads = device_reads;
+
+    for (i = 0; i < 16; i++) {
+        BTASSERT(fat16_file_read(&file, buf, sizeof(buf)) == sizeof(buf));
+        BTASSERT(buf[0] == i);
+        BTASSERT(buf[sizeof(buf) - 1] == i);
+    }
+
+    blocks = (16 * sizeof(buf) / 512);
+    std_printf(FSTR("Sequential read of %u blocks: %ld device reads.\r\n"),
+               (unsigned int)blocks,
+               device_reads - reads);
+    BTASSERT(device_reads - reads <= blocks + 1);
+
+    /* Reading the first bytes again is a cache hit if the cache
+       holds at least two data blocks. */
+    BTASSERT(fat16_file_seek(&file, 0, FAT16_SEEK_SET) == 0);
+    BTASSERT(fat16_file_read(&file, buf, 16) == 16);
+    reads = device_reads;
+    BTASSERT(fat16_file_seek(&file, 0, FAT16_SEEK_SET) == 0);
+    BTASSERT(fat16_file_read(&file, buf, 16) == 16);
+    BTASSERT(device_reads == reads);
+    BTASSERT(fat16_file_close(&file) == 0);
+
+    /* Writes are buffered in the cache until the file is synced. */
+    BTASSERT(fat16_file_open(&fs, &file, "CACHE.TXT", O_RDWR) == 0);
+    writes = device_writes;
+    memset(buf, 0xa5, 16);
+    BTASSERT(fat16_file_write(&file, buf, 16) == 16);
+    BTASSERT(device_writes == writes);
+    BTASSERT(fat16_file_sync(&file) == 0);
+    BTASSERT(device_writes == writes + 1);
+    BTASSERT(fat16_sync(&fs) == 0);
+    BTASSERT(device_writes == writes + 1);
+    BTASSERT(fat16_file_close(&file) == 0);
+
+    /* Read the written data from the device. */
+    BTASSERT(fat16_init(&fs,
+                        linux_read_block,
+                        linux_write_block,
+                        file_p,
+                        0) == 0);
+    BTASSERT(fat16_start(&fs) == 0);
+    BTASSERT(fat16_file_open(&fs, &file, "CACHE.TXT", O_READ) == 0);
+    BTASSERT(fat16_file_read(&file, buf, 17) == 17);
+    BTASSERT(buf[0] == 0xa5);
+    BTASSERT(buf[15] == 0xa5);
+    BTASSERT(buf[16] == 0);
+    BTASSERT(fat16_file_close(&file) == 0);
+
+    BTASSERT(fat16_print(&fs, &harness_p->uart.chout) == 0);
+
+    return (0);
+}
+
+static uint8_t pattern(size_t offset)
+{
+    return ((offset * 7) + (offset >> 9));
+}
+
+static int check_pattern(const uint8_t *buf_p, size_t offset, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        if (buf_p[i] != pattern(offset + i)) {
+            return (-1);
+        }
+    }
+
+    return (0);
+}
+
+int test_multi_block(struct harness_t *harness_p)
+{
+    struct fat16_file_t file;
+    struct fat16_file_t other;
+    size_t i;
+    size_t offset;
+    size_t size;
+    long reads;
+    long writes;
+
+    for (i = 0; i < sizeof(big_buf); i++) {
+        big_buf[i] = pattern(i);
+    }
+
+    /* Whole blocks are written one by one without the multi block
+       functions, bypassing the cache. */
+    BTASSERT(fat16_file_open(&fs,
+                             &file,
+                             "MULTI.TXT",
+                             O_CREAT | O_RDWR | O_TRUNC) == 0);
+    writes = device_writes;
+    BTASSERT(fat16_file_write(&file, big_buf, 16384) == 16384);
+    BTASSERT(device_writes - writes == 32);
+
+    /* Set the multi block functions. The rest of the file is written
+       in one call as the clusters are allocated after each other. */
+    BTASSERT(fat16_set_multi_block_functions(&fs,
+                                             linux_read_blocks,
+                                             linux_write_blocks) == 0);
+    writes = device_multi_writes;
+    BTASSERT(fat16_file_write(&file, &big_buf[16384], 16384) == 16384);
+    BTASSERT(device_multi_writes - writes == 1);
+    BTASSERT(fat16_file_close(&file) == 0);
+
+    /* Read the whole file in one call. */
+    BTASSERT(fat16_file_open(&fs, &file, "MULTI.TXT", O_READ) == 0);
+    memset(big_buf, 0, sizeof(big_buf));
+    reads = device_multi_reads;
+    BTASSERT(fat16_file_read(&file, big_buf, 32768) == 32768);
+    BTASSERT(device_multi_reads - reads == 1);
+    BTASSERT(check_pattern(big_buf, 0, 32768) == 0);
+
+    /* Reads with partial head and tail blocks. */
+    for (offset = 0; offset < 2048; offset += 301) {
+        for (size = 1; size < 8192; size += 1531) {
+            BTASSERT(fat16_file_seek(&file, offset, FAT16_SEEK_SET) == 0);
+            BTASSERT(fat16_file_read(&file, big_buf, size) == size);
+            BTASSERT(check_pattern(big_buf, offset, size) == 0);
+        }
+    }
+
+    BTASSERT(fat16_file_close(&file) == 0);
+
+    /* Interleave the clusters of two files. Only adjacent clusters
+       are transferred in the same call. */
+    BTASSERT(fat16_file_open(&fs,
+                             &file,
+                             "MULTI.TXT",
+                             O_CREAT | O_RDWR | O_TRUNC) == 0);
+    BTASSERT(fat16_file_open(&fs,
+                             &other,
+                             "OTHER.TXT",
+                             O_CREAT | O_RDWR | O_TRUNC) == 0);
+
+    for (i = 0; i < 8; i++) {
+        memset(buf, 0x55, sizeof(buf));
+        BTASSERT(fat16_file_write(&other, buf, 2048) == 2048);
+
+        for (offset = 0; offset < 2048; offset++) {
+            buf[offset] = pattern(2048 * i + offset);
+        }
+
+        BTASSERT(fat16_file_write(&file, buf, 2048) == 2048);
+    }
+
+    BTASSERT(fat16_file_close(&other) == 0);
+    BTASSERT(fat16_file_seek(&file, 0, FAT16_SEEK_SET) == 0);
+    reads = device_multi_reads;
+    BTASSERT(fat16_file_read(&file, big_buf, 16384) == 16384);
+    BTASSERT(device_multi_reads - reads == 8);
+    BTASSERT(check_pattern(big_buf, 0, 16384) == 0);
+
+    /* A read failing after a few clusters leaves the file at the
+       same position, and it can be read again. */
+    BTASSERT(fat16_file_seek(&file, 0, FAT16_SEEK_SET) == 0);
+    device_multi_reads_fail = (device_multi_reads + 3);
+    BTASSERT(fat16_file_read(&file, big_buf, 16384) == FAT16_EOF);
+    device_multi_reads_fail = -1;
+    BTASSERT(fat16_file_tell(&file) == 0);
+    memset(big_buf, 0, 16384);
+    BTASSERT(fat16_file_read(&file, big_buf, 16384) == 16384);
+    BTASSERT(check_pattern(big_buf, 0, 16384) == 0);
+
+    /* A dirty cached block is written to the device before it is
+       read directly. */
+    BTASSERT(fat16_file_seek(&file, 600, FAT16_SEEK_SET) == 0);
+    BTASSERT(fat16_file_write(&file, "dirty", 5) == 5);
+    BTASSERT(fat16_file_seek(&file, 0, FAT16_SEEK_SET) == 0);
+    BTASSERT(fat16_file_read(&file, big_buf, 2048) == 2048);
+    BTASSERT(memcmp(&big_buf[600], "dirty", 5) == 0);
+    BTASSERT(check_pattern(big_buf, 0, 600) == 0);
+
+    /* A cached block is dropped when it is written directly. */
+    memset(buf, 0xaa, 512);
+    BTASSERT(fat16_file_seek(&file, 512, FAT16_SEEK_SET) == 0);
+    BTASSERT(fat16_file_write(&file, buf, 512) == 512);
+    BTASSERT(fat16_file_seek(&file, 600, FAT16_SEEK_SET) == 0);
+    BTASSERT(fat16_file_read(&file, big_buf, 5) == 5);
+    BTASSERT(memcmp(big_buf, "\xaa\xaa\xaa\xaa\xaa", 5) == 0);
+    BTASSERT(fat16_file_close(&file) == 0);
+
+    BTASSERT(fat16_set_multi_block_functions(&fs, NULL, NULL) == 0);
+
+    return (0);
+}
+
+/**
+ * Restart the file system with or without the free cluster bitmap.
+ */
+static int restart(int use_bitmap)
+{
+    BTASSERT(fat16_stop(&fs) == 0);
+    BTASSERT(fat16_init(&fs,
+                        linux_read_block,
+                        linux_write_block,
+                        file_p,
+                        0) == 0);
+
+    if (use_bitmap) {
+        BTASSERT(fat16_set_free_cluster_bitmap(&fs,
+                                               bitmap,
+                                               sizeof(bitmap)) == 0);
+    }
+
+    BTASSERT(fat16_set_multi_block_functions(&fs,
+                                             linux_read_blocks,
+                                             linux_write_blocks) == 0);
+
+    return (fat16_start(&fs));
+}
+
+/**
+ * Create a new file with one cluster and return the number of device
+ * reads needed to allocate the cluster.
+ */
+static int append_one_cluster(const char *path_p, long *reads_p)
+{
+    struct fat16_file_t file;
+
+    BTASSERT(fat16_file_open(&fs,
+                             &file,
+                             path_p,
+                             O_CREAT | O_WRITE | O_TRUNC) == 0);
+    *reads_p = device_reads;
+    BTASSERT(fat16_file_write(&file, buf, 2048) == 2048);
+    *reads_p = (device_reads - *reads_p);
+
+    return (fat16_file_close(&file));
+}
+
+int test_free_clusters(struct harness_t *harness_p)
+{
+    struct fat16_file_t file;
+    struct fat16_file_t other;
+    fat_t free_count;
+    long reads;
+    long writes;
+    size_t i;
+
+    /* A too small bitmap is not used. */
+    BTASSERT(fat16_stop(&fs) == 0);
+    BTASSERT(fat16_init(&fs,
+                        linux_read_block,
+                        linux_write_block,
+                        file_p,
+                        0) == 0);
+    BTASSERT(fat16_set_free_cluster_bitmap(&fs, bitmap, 100) == 0);
+    BTASSERT(fat16_start(&fs) == 0);
+    BTASSERT(fs.free_clusters.bitmap_p == NULL);
+
+    BTASSERT(restart(1) == 0);
+    BTASSERT(fs.free_clusters.bitmap_p == bitmap);
+    free_count = fs.free_clusters.count;
+
+    /* Fill most of the card, 6000 of the 8167 clusters. */
+    memset(big_buf, 0, sizeof(big_buf));
+    BTASSERT(fat16_file_open(&fs,
+                             &file,
+                             "FULL.TXT",
+                             O_CREAT | O_WRITE | O_TRUNC) == 0);
+
+    for (i = 0; i < 375; i++) {
+        BTASSERT(fat16_file_write(&file, big_buf, sizeof(big_buf))
+                 == sizeof(big_buf));
+    }
+
+    BTASSERT(fat16_file_close(&file) == 0);
+    BTASSERT(fs.free_clusters.count == free_count - 6000);
+
+    /* The bitmap built from the FAT matches the maintained one. */
+    free_count = fs.free_clusters.count;
+    memcpy(big_buf, bitmap, sizeof(bitmap));
+    BTASSERT(restart(1) == 0);
+    BTASSERT(fs.free_clusters.count == free_count);
+    BTASSERT(memcmp(big_buf, bitmap, sizeof(bitmap)) == 0);
+
+    /* Appending a cluster scans the FAT without the bitmap. */
+    BTASSERT(append_one_cluster("APPEND.TXT", &reads) == 0);
+    std_printf(FSTR("Append with bitmap: %ld device reads.\r\n"), reads);
+    BTASSERT(reads <= 1);
+    BTASSERT(restart(0) == 0);
+    BTASSERT(append_one_cluster("APPEND.TXT", &reads) == 0);
+    std_printf(FSTR("Append without bitmap: %ld device reads.\r\n"), reads);
+    BTASSERT(reads > 20);
+
+    /* Preallocate a file while another file allocates clusters. The
+       preallocated clusters are after each other. */
+    BTASSERT(restart(1) == 0);
+    BTASSERT(fat16_file_open(&fs,
+                             &file,
+                             "PREALLOC.TXT",
+                             O_CREAT | O_RDWR | O_TRUNC) == 0);
+    BTASSERT(fat16_file_open(&fs,
+                             &other,
+                             "OTHER.TXT",
+                             O_CREAT | O_RDWR | O_TRUNC) == 0);
+    free_count = fs.free_clusters.count;
+    BTASSERT(fat16_file_preallocate(&file, sizeof(big_buf)) == 0);
+    BTASSERT(fat16_file_size(&file) == 0);
+    BTASSERT(fs.free_clusters.count == free_count - 16);
+    BTASSERT(fat16_file_write(&other, buf, 2048) == 2048);
+    BTASSERT(fat16_file_preallocate(&file, 1000) == 0);
+    BTASSERT(fs.free_clusters.count == free_count - 17);
+
+    for (i = 0; i < sizeof(big_buf); i++) {
+        big_buf[i] = pattern(i);
+    }
+
+    writes = device_multi_writes;
+    BTASSERT(fat16_file_write(&file, big_buf, sizeof(big_buf))
+             == sizeof(big_buf));
+    BTASSERT(device_multi_writes - writes == 1);
+    BTASSERT(fs.free_clusters.count == free_count - 17);
+
+    /* Preallocate more and write past the first run. */
+    BTASSERT(fat16_file_preallocate(&file, 2 * sizeof(big_buf)) == 0);
+    BTASSERT(fs.free_clusters.count == free_count - 33);
+    BTASSERT(fat16_file_write(&file, big_buf, sizeof(big_buf))
+             == sizeof(big_buf));
+    BTASSERT(fat16_file_close(&file) == 0);
+    BTASSERT(fat16_file_close(&other) == 0);
+
+    BTASSERT(fat16_file_open(&fs, &file, "PREALLOC.TXT", O_READ) == 0);
+    BTASSERT(fat16_file_size(&file) == 2 * sizeof(big_buf));
+
+    for (i = 0; i < 2; i++) {
+        memset(big_buf, 0, sizeof(big_buf));
+        BTASSERT(fat16_file_read(&file, big_buf, sizeof(big_buf))
+                 == sizeof(big_buf));
+        BTASSERT(check_pattern(big_buf, 0, sizeof(big_buf)) == 0);
+    }
+
+    BTASSERT(fat16_file_close(&file) == 0);
+
+    /* Preallocation without the bitmap. */
+    BTASSERT(restart(0) == 0);
+    BTASSERT(fat16_file_open(&fs,
+                             &file,
+                             "PREALLOC.TXT",
+                             O_CREAT | O_RDWR | O_TRUNC) == 0);
+    BTASSERT(fat16_file_preallocate(&file, 3 * 2048) == 0);
+    BTASSERT(fat16_file_write(&file, big_buf, 3 * 2048) == 3 * 2048);
+    BTASSERT(fat16_file_seek(&file, 0, FAT16_SEEK_SET) == 0);
+    memset(big_buf, 0, sizeof(big_buf));
+    BTASSERT(fat16_file_read(&file, big_buf, 3 * 2048) == 3 * 2048);
+    BTASSERT(check_pattern(big_buf, 0, 3 * 2048) == 0);
+    BTASSERT(fat16_file_close(&file) == 0);
+
+    /* Truncating frees the clusters. */
+    BTASSERT(restart(1) == 0);
+    free_count = fs.free_clusters.count;
+    BTASSERT(fat16_file_open(&fs, &file, "FULL.TXT", O_WRITE | O_TRUNC) == 0);
+    BTASSERT(fat16_file_close(&file) == 0);
+    BTASSERT(fs.free_clusters.count == free_count + 6000);
+
+    BTASSERT(restart(0) == 0);
+    BTASSERT(fat16_set_multi_block_functions(&fs, NULL, NULL) == 0);
+
+    return (0);
+}
+
+/**
+ * Write given number of bytes of the pattern at the end of given
+ * file.
+ */
+static int write_pattern(struct fat16_file_t *file_p, size_t size)
+{
+    size_t offset;
+    size_t i;
+    size_t n;
+
+    offset = fat16_file_tell(file_p);
+
+    while (size > 0) {
+        n = MIN(size, sizeof(big_buf));
+
+        for (i = 0; i < n; i++) {
+            big_buf[i] = pattern(offset + i);
+        }
+
+        BTASSERT(fat16_file_write(file_p, big_buf, n) == n);
+        offset += n;
+        size -= n;
+    }
+
+    return (0);
+}
+
+/**
+ * Seek to pseudo random positions in given file and verify the data.
+ */
+static int random_seeks(struct fat16_file_t *file_p, int count)
+{
+    uint32_t seed;
+    size_t offset;
+    size_t size;
+
+    seed = 1;
+    size = fat16_file_size(file_p);
+
+    while (count-- > 0) {
+        seed = (1103515245 * seed + 12345);
+        offset = ((seed >> 8) % (size - 16));
+        BTASSERT(fat16_file_seek(file_p, offset, FAT16_SEEK_SET) == 0);
+        BTASSERT(fat16_file_read(file_p, buf, 16) == 16);
+        BTASSERT(check_pattern(buf, offset, 16) == 0);
+    }
+
+    return (0);
+}
+
+int test_extents(struct harness_t *harness_p)
+{
+    struct fat16_file_t file;
+    struct fat16_file_t other;
+    long reads;
+    int i;
+
+    BTASSERT(restart(1) == 0);
+
+    /* A 4 MB file with all its clusters after each other. */
+    BTASSERT(fat16_file_open(&fs,
+                             &file,
+                             "EXTENTS.TXT",
+                             O_CREAT | O_WRITE | O_TRUNC) == 0);
+    BTASSERT(write_pattern(&file, 4 * 1024 * 1024L) == 0);
+    BTASSERT(fat16_file_close(&file) == 0);
+
+    /* Seeking to the end walks the cluster chain once. All later
+       seeks are found in the extent cache and only read the data
+       block, or two if the read crosses a block boundary. */
+    BTASSERT(restart(0) == 0);
+    BTASSERT(fat16_file_open(&fs, &file, "EXTENTS.TXT", O_READ) == 0);
+    reads = device_reads;
+    BTASSERT(fat16_file_seek(&file, 0, FAT16_SEEK_END) == 0);
+    std_printf(FSTR("Seek to end: %ld device reads.\r\n"),
+               device_reads - reads);
+
+    reads = device_reads;
+    BTASSERT(random_seeks(&file, 100) == 0);
+    std_printf(FSTR("100 random seeks and reads: %ld device reads.\r\n"),
+               device_reads - reads);
+    BTASSERT(device_reads - reads <= 110);
+    BTASSERT(fat16_file_close(&file) == 0);
+
+    /* A fragmented file with more runs than the extent cache can
+       hold. */
+    BTASSERT(fat16_file_open(&fs,
+                             &file,
+                             "FRAG.TXT",
+                             O_CREAT | O_RDWR | O_TRUNC) == 0);
+    BTASSERT(fat16_file_open(&fs,
+                             &other,
+                             "OTHER.TXT",
+                             O_CREAT | O_WRITE | O_TRUNC) == 0);
+
+    for (i = 0; i < 4 * FAT16_FILE_EXTENTS; i++) {
+        BTASSERT(write_pattern(&file, 2048) == 0);
+        BTASSERT(fat16_file_write(&other, buf, 2048) == 2048);
+    }
+
+    BTASSERT(fat16_file_close(&other) == 0);
+    BTASSERT(file.extents.length == FAT16_FILE_EXTENTS);
+    BTASSERT(random_seeks(&file, 100) == 0);
+
+    BTASSERT(fat16_file_close(&file) == 0);
+
+    /* Truncating invalidates the extent cache. */
+    BTASSERT(fat16_file_open(&fs,
+                             &file,
+                             "FRAG.TXT",
+                             O_RDWR | O_TRUNC) == 0);
+    BTASSERT(file.extents.length == 0);
+    BTASSERT(write_pattern(&file, 11 * 2048 + 100) == 0);
+    BTASSERT(random_seeks(&file, 100) == 0);
+    BTASSERT(fat16_file_close(&file) == 0);
+
+    BTASSERT(restart(0) == 0);
+    BTASSERT(fat16_set_multi_block_functions(&fs, NULL, NULL) == 0);
+
+    return (0);
+}
+
+int test_fat32(struct harness_t *harness_p)
+{
+    static struct fat16_t fs32;
+    struct fat16_file_t file;
+    struct fat16_dir_t dir;
+    struct fat16_dir_entry_t entry;
+    struct fat16_stat_t stat;
+    FILE *file32_p;
+    fat_t free_count;
+    fat_t count;
+    fat_t high_cluster;
+    long reads;
+
+    /* The free cluster count of a FAT16 volume is counted once. */
+    BTASSERT(fat16_get_free_clusters(&fs, &free_count) == 0);
+    BTASSERT(free_count < fs.cluster_count);
+    reads = device_reads;
+    BTASSERT(fat16_get_free_clusters(&fs, &count) == 0);
+    BTASSERT(count == free_count);
+    BTASSERT(device_reads == reads);
+
+    /* A 64 MB FAT32 volume with 512 bytes clusters. */
+    system("./create_sdcard_fat32_linux.sh");
+    file32_p = fopen("sdcard32", "r+b");
+    BTASSERT(file32_p != NULL);
+    BTASSERT(fat16_init(&fs32,
+                        linux_read_block,
+                        linux_write_block,
+                        file32_p,
+                        0) == 0);
+
+    /* Mounting and getting the free cluster count only reads the
+       boot sector and the FSInfo sector. */
+    reads = device_reads;
+    BTASSERT(fat16_start(&fs32) == 0);
+    BTASSERT(fat16_get_free_clusters(&fs32, &free_count) == 0);
+    std_printf(FSTR("FAT32 start and free cluster count: "
+                    "%ld device reads.\r\n"),
+               device_reads - reads);
+    BTASSERT(device_reads - reads == 2);
+    BTASSERT(fs32.fat_type == 32);
+    BTASSERT(fs32.cluster_count >= 65525);
+    BTASSERT(free_count == fs32.cluster_count - 1);
+    BTASSERT(fat16_print(&fs32, &harness_p->uart.chout) == 0);
+
+    /* A file in the root directory. */
+    BTASSERT(fat16_file_open(&fs32,
+                             &file,
+                             "DATA.BIN",
+                             O_CREAT | O_WRITE | O_TRUNC) == 0);
+    BTASSERT(write_pattern(&file, 3 * sizeof(big_buf)) == 0);
+    BTASSERT(fat16_file_close(&file) == 0);
+
+    /* A directory with a file. */
+    BTASSERT(fat16_dir_open(&fs32, &dir, "HOME", O_CREAT | O_WRITE) == 0);
+    BTASSERT(fat16_dir_close(&dir) == 0);
+    BTASSERT(fat16_file_open(&fs32,
+                             &file,
+                             "HOME/FOO.TXT",
+                             O_CREAT | O_WRITE) == 0);
+    BTASSERT(fat16_file_write(&file, "FAT32\n", 6) == 6);
+    BTASSERT(fat16_file_close(&file) == 0);
+
+    /* A file with clusters above 65535 uses the high word of the
+       first cluster in the directory entry. */
+    fs32.free_clusters.next = 100000;
+    BTASSERT(fat16_file_open(&fs32,
+                             &file,
+                             "HIGH.BIN",
+                             O_CREAT | O_WRITE) == 0);
+    BTASSERT(write_pattern(&file, 4096) == 0);
+    high_cluster = file.first_cluster;
+    BTASSERT(high_cluster == 100000);
+    BTASSERT(fat16_file_close(&file) == 0);
+
+    /* 192 + 1 + 8 file clusters and one directory cluster. */
+    BTASSERT(fat16_get_free_clusters(&fs32, &count) == 0);
+    BTASSERT(count == free_count - 202);
+
+    /* The FSInfo sector holds the free cluster count after a
+       restart. */
+    BTASSERT(fat16_stop(&fs32) == 0);
+    BTASSERT(fat16_init(&fs32,
+                        linux_read_block,
+                        linux_write_block,
+                        file32_p,
+                        0) == 0);
+    BTASSERT(fat16_start(&fs32) == 0);
+    reads = device_reads;
+    BTASSERT(fat16_get_free_clusters(&fs32, &count) == 0);
+    BTASSERT(device_reads == reads);
+    BTASSERT(count == free_count - 202);
+
+    /* Read the root directory. */
+    BTASSERT(fat16_dir_open(&fs32, &dir, ".", O_READ) == 0);
+    BTASSERT(fat16_dir_read(&dir, &entry) == 1);
+    BTASSERT(strcmp(entry.name, "DATA.BIN") == 0);
+    BTASSERT(entry.is_dir == 0);
+    BTASSERT(entry.size == 3 * sizeof(big_buf));
+    BTASSERT(fat16_dir_read(&dir, &entry) == 1);
+    BTASSERT(strcmp(entry.name, "HOME") == 0);
+    BTASSERT(entry.is_dir == 1);
+    BTASSERT(fat16_dir_read(&dir, &entry) == 1);
+    BTASSERT(strcmp(entry.name, "HIGH.BIN") == 0);
+    BTASSERT(fat16_dir_read(&dir, &entry) == 0);
+    BTASSERT(fat16_dir_close(&dir) == 0);
+
+    /* Read the files. */
+    BTASSERT(fat16_stat(&fs32, "HOME/FOO.TXT", &stat) == 0);
+    BTASSERT(stat.size == 6);
+    BTASSERT(fat16_file_open(&fs32, &file, "HOME/FOO.TXT", O_READ) == 0);
+    BTASSERT(fat16_file_read(&file, buf, 6) == 6);
+    BTASSERT(memcmp(buf, "FAT32\n", 6) == 0);
+    BTASSERT(fat16_file_close(&file) == 0);
+
+    BTASSERT(fat16_file_open(&fs32, &file, "HIGH.BIN", O_READ) == 0);
+    BTASSERT(file.first_cluster == high_cluster);
+    BTASSERT(fat16_file_read(&file, big_buf, 4096) == 4096);
+    BTASSERT(check_pattern(big_buf, 0, 4096) == 0);
+    BTASSERT(fat16_file_close(&file) == 0);
+
+    BTASSERT(fat16_file_open(&fs32, &file, "DATA.BIN", O_READ) == 0);
+    BTASSERT(random_seeks(&file, 100) == 0);
+
+    /* Truncating frees the clusters. */
+    BTASSERT(fat16_file_open(&fs32, &file, "DATA.BIN", O_WRITE | O_TRUNC) == 0);
+    BTASSERT(fat16_file_close(&file) == 0);
+    BTASSERT(fat16_get_free_clusters(&fs32, &count) == 0);
+    BTASSERT(count == free_count - 10);
+
+    /* The free cluster count read from the whole FAT matches. */
+    BTASSERT(fat16_stop(&fs32) == 0);
+    BTASSERT(fat16_init(&fs32,
+                        linux_read_block,
+                        linux_write_block,
+                        file32_p,
+                        0) == 0);
+    BTASSERT(fat16_set_free_cluster_bitmap(&fs32,
+                                           big_buf,
+                                           sizeof(big_buf)) == 0);
+    BTASSERT(fat16_start(&fs32) == 0);
+    BTASSERT(fs32.free_clusters.bitmap_p == big_buf);
+    BTASSERT(fat16_get_free_clusters(&fs32, &count) == 0);
+    BTASSERT(count == free_count - 10);
+    BTASSERT(fat16_stop(&fs32) == 0);
+    fclose(file32_p);
+
+    return (0);
+}
+
+/**
+ * Write and read a 256 kB file in 32 kB chunks.
+ */
+static int benchmark_chunks(const char *name_p, size_t offset)
+{
+    struct fat16_file_t file;
+    struct time_t start;
+    long bytes;
+    long elapsed;
+    size_t size;
+
+    size = (8 * sizeof(big_buf));
+    BTASSERT(fat16_file_open(&fs,
+                             &file,
+                             "CHUNKS.TXT",
+                             O_CREAT | O_RDWR | O_TRUNC) == 0);
+    BTASSERT(fat16_file_write(&file, big_buf, offset) == offset);
+    bytes = 0;
+    time_get(&start);
+
+    do {
+        if (fat16_file_tell(&file) + sizeof(big_buf) > size) {
+            BTASSERT(fat16_file_seek(&file, offset, FAT16_SEEK_SET) == 0);
+        }
+
+        BTASSERT(fat16_file_write(&file, big_buf, sizeof(big_buf))
+                 == sizeof(big_buf));
+        bytes += sizeof(big_buf);
+    } while ((elapsed = elapsed_us(&start)) < BENCHMARK_DURATION_US);
+
+    std_printf(FSTR("%s write: %ld kB/s.\r\n"),
+               name_p,
+               (long)((1000000LL * bytes / 1024) / elapsed));
+
+    BTASSERT(fat16_file_seek(&file, offset, FAT16_SEEK_SET) == 0);
+    bytes = 0;
+    time_get(&start);
+
+    do {
+        if (fat16_file_tell(&file) + sizeof(big_buf) > size) {
+            BTASSERT(fat16_file_seek(&file, offset, FAT16_SEEK_SET) == 0);
+        }
+
+        BTASSERT(fat16_file_read(&file, big_buf, sizeof(big_buf))
+                 == sizeof(big_buf));
+        bytes += sizeof(big_buf);
+    } while ((elapsed = elapsed_us(&start)) < BENCHMARK_DURATION_US);
+
+    std_printf(FSTR("%s read: %ld kB/s.\r\n"),
+               name_p,
+               (long)((1000000LL * bytes / 1024) / elapsed));
+
+    return (fat16_file_close(&file));
+}
+
+int test_benchmark(struct harness_t *harness_p)
+{
+    struct fat16_file_t file;
+    struct time_t start;
+    long reads;
+    long bytes;
+    long elapsed;
+    uint32_t seed;
+    size_t size;
+
+    size = (256 * sizeof(buf));
+    BTASSERT(create_file("BENCH.TXT", size) == 0);
+    BTASSERT(fat16_file_open(&fs, &file, "BENCH.TXT", O_READ) == 0);
+
+    /* Sequential reads. */
+    bytes = 0;
+    reads = device_reads;
+    time_get(&start);
+
+    do {
+        if (fat16_file_tell(&file) == size) {
+            BTASSERT(fat16_file_seek(&file, 0, FAT16_SEEK_SET) == 0);
+        }
+
+        BTASSERT(fat16_file_read(&file, buf, 256) == 256);
+        bytes += 256;
+    } while ((elapsed = elapsed_us(&start)) < BENCHMARK_DURATION_US);
+
+    std_printf(FSTR("sequential cached read: %ld kB/s, %ld device reads "
+                    "per 100 blocks.\r\n"),
+               (long)((1000000LL * bytes / 1024) / elapsed),
+               (100 * (device_reads - reads)) / (bytes / 512));
+
+    /* Random reads within a 16 kB window of the file. */
+    bytes = 0;
+    seed = 1;
+    reads = device_reads;
+    time_get(&start);
+
+    do {
+        seed = (1103515245 * seed + 12345);
+        BTASSERT(fat16_file_seek(&file,
+                                 ((seed >> 16) % 64) * 256,
+                                 FAT16_SEEK_SET) == 0);
+        BTASSERT(fat16_file_read(&file, buf, 256) == 256);
+        bytes += 256;
+    } while ((elapsed = elapsed_us(&start)) < BENCHMARK_DURATION_US);
+
+    std_printf(FSTR("random cached read: %ld kB/s, %ld device reads "
+                    "per 100 blocks.\r\n"),
+               (long)((1000000LL * bytes / 1024) / elapsed),
+               (100 * (device_reads - reads)) / (bytes / 512));
+
+    BTASSERT(fat16_file_close(&file) == 0);
+
+    /* Data logger like 32 kB writes and reads, with and without the
+       multi block functions, and unaligned through the cache. */
+    BTASSERT(benchmark_chunks("32 kB", 0) == 0);
+    BTASSERT(fat16_set_multi_block_functions(&fs,
+                                             linux_read_blocks,
+                                             linux_write_blocks) == 0);
+    BTASSERT(benchmark_chunks("32 kB multi block", 0) == 0);
+    BTASSERT(benchmark_chunks("32 kB unaligned", 1) == 0);
+    BTASSERT(fat16_set_multi_block_functions(&fs, NULL, NULL) == 0);
+
+    return (0);
+}
+
+#endif
+
 int main()
 {
     struct harness_t harness;
@@ -284,6 +1157,14 @@ int main()
         { test_bad_file, "test_bad_file" },
         { test_truncate, "test_truncate" },
         { test_append, "test_append" },
+#if defined(ARCH_LINUX)
+        { test_cache, "test_cache" },
+        { test_multi_block, "test_multi_block" },
+        { test_free_clusters, "test_free_clusters" },
+        { test_extents, "test_extents" },
+        { test_fat32, "test_fat32" },
+        { test_benchmark, "test_benchmark" },
+#endif
         { NULL, NULL }
     };
 
@@ -77,3 +77,34 @@ ssize_t sd_write_block(struct sd_driver_t *self_p,
 
     return (SD_BLOCK_SIZE);
 }
+
+ssize_t sd_read_blocks(struct sd_driver_t *self_p,
+                       void *dst_p,
+                       uint32_t src_block,
+                       size_t count)
+{
+    if (fseek(file_p, SD_BLOCK_SIZE * src_block, SEEK_SET) != 0) {
+        return (-1);
+    }
+
+    return (fread(dst_p, 1, SD_BLOCK_SIZE * count, file_p));
+}
+
+ssize_t sd_write_blocks(struct sd_driver_t *self_p,
+                        uint32_t dst_block,
+                        const void *src_p,
+                        size_t count)
+{
+    if (fseek(file_p, SD_BLOCK_SIZE * dst_block, SEEK_SET) != 0) {
+        return (-1);
+    }
+
+    if (fwrite(src_p, 1, SD_BLOCK_SIZE * count, file_p)
+        != (SD_BLOCK_SIZE * count)) {
+        return (-1);
+    }
+
+    fflush(file_p);
+
+    return (SD_BLOCK_SIZE * count);
+}
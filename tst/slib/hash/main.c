@@ -20,6 +20,34 @@
 
 #include "simba.h"
 
+/* Benchmark duration in microseconds. */
+#define BENCHMARK_DURATION_US                          200000
+
+static uint8_t buf[1024];
+
+static long elapsed_us(struct time_t *start_p)
+{
+    struct time_t now;
+
+    time_get(&now);
+
+    return (1000000L * (now.seconds - start_p->seconds)
+            + (now.nanoseconds - start_p->nanoseconds) / 1000L);
+}
+
+static void print_throughput(const char *name_p,
+                             long blocks,
+                             struct time_t *start_p)
+{
+    long long size;
+
+    size = (512LL * blocks);
+
+    std_printf(FSTR("%s: %ld kB/s.\r\n"),
+               name_p,
+               (long)((size * 1000000LL / 1024) / elapsed_us(start_p)));
+}
+
 int test_sha1(struct harness_t *harness_p)
 {
     struct hash_sha1_t foo;
@@ -114,11 +142,241 @@ int test_sha1(struct harness_t *harness_p)
     return (0);
 }
 
+int test_sha256(struct harness_t *harness_p)
+{
+    struct hash_sha256_t foo;
+    uint8_t hash[32];
+    int i;
+    struct {
+        char *name_p;
+        char *input_p;
+        char *hash_p;
+    } testdata[] = {
+        {
+            .name_p = "Empty",
+            .input_p = "",
+            .hash_p =
+            "\xe3\xb0\xc4\x42\x98\xfc\x1c\x14\x9a\xfb\xf4\xc8\x99\x6f\xb9\x24"
+            "\x27\xae\x41\xe4\x64\x9b\x93\x4c\xa4\x95\x99\x1b\x78\x52\xb8\x55"
+        },
+
+        {
+            .name_p = "Abc",
+            .input_p = "abc",
+            .hash_p =
+            "\xba\x78\x16\xbf\x8f\x01\xcf\xea\x41\x41\x40\xde\x5d\xae\x22\x23"
+            "\xb0\x03\x61\xa3\x96\x17\x7a\x9c\xb4\x10\xff\x61\xf2\x00\x15\xad"
+        },
+
+        {
+            .name_p = "Dog",
+            .input_p = "The quick brown fox jumps over the lazy dog",
+            .hash_p =
+            "\xd7\xa8\xfb\xb3\x07\xd7\x80\x94\x69\xca\x9a\xbc\xb0\x08\x2e\x4f"
+            "\x8d\x56\x51\xe4\x6d\x3c\xdb\x76\x2d\x02\xd0\xbf\x37\xc9\xe5\x92"
+        },
+
+        {
+            .name_p = "Long",
+            .input_p = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+            .hash_p =
+            "\x24\x8d\x6a\x61\xd2\x06\x38\xb8\xe5\xc0\x26\x93\x0c\x3e\x60\x39"
+            "\xa3\x3c\xe4\x59\x64\xff\x21\x67\xf6\xec\xed\xd4\x19\xdb\x06\xc1"
+        }
+    };
+
+    /* Test vectors. */
+    for (i = 0; i < membersof(testdata); i++) {
+        std_printf(FSTR("%s\r\n"), testdata[i].name_p);
+
+        BTASSERT(hash_sha256_init(&foo) == 0);
+        BTASSERT(hash_sha256_update(&foo,
+                                    testdata[i].input_p,
+                                    strlen(testdata[i].input_p)) == 0);
+        BTASSERT(hash_sha256_digest(&foo, hash) == 0);
+
+        BTASSERT(memcmp(hash, testdata[i].hash_p, 32) == 0);
+    }
+
+    /* Multiple updates. */
+    BTASSERT(hash_sha256_init(&foo) == 0);
+
+    for (i = 0; i < 400; i++) {
+        BTASSERT(hash_sha256_update(&foo, "1", 1) == 0);
+    }
+
+    BTASSERT(hash_sha256_digest(&foo, hash) == 0);
+
+    BTASSERT(memcmp(hash,
+                    "\xb1\x25\x47\xda\x74\xee\x44\xf5\xba\x82\x9a\x26\xda\xe1\x03\x55"
+                    "\xc7\x61\xee\x17\xe9\x3f\x0c\xb1\xd3\xfc\x5c\xc0\x84\x03\xec\x58",
+                    32) == 0);
+
+    return (0);
+}
+
+int test_hmac_sha256(struct harness_t *harness_p)
+{
+    struct hash_hmac_sha256_t foo;
+    uint8_t mac[32];
+    uint8_t key[131];
+
+    /* Test vectors from RFC 4231. */
+    memset(key, 0x0b, 20);
+    BTASSERT(hash_hmac_sha256_init(&foo, key, 20) == 0);
+    BTASSERT(hash_hmac_sha256_update(&foo, "Hi There", 8) == 0);
+    BTASSERT(hash_hmac_sha256_digest(&foo, mac) == 0);
+    BTASSERT(memcmp(mac,
+                    "\xb0\x34\x4c\x61\xd8\xdb\x38\x53\x5c\xa8\xaf\xce\xaf\x0b\xf1\x2b"
+                    "\x88\x1d\xc2\x00\xc9\x83\x3d\xa7\x26\xe9\x37\x6c\x2e\x32\xcf\xf7",
+                    32) == 0);
+
+    BTASSERT(hash_hmac_sha256_init(&foo, "Jefe", 4) == 0);
+    BTASSERT(hash_hmac_sha256_update(&foo, "what do ya want ", 16) == 0);
+    BTASSERT(hash_hmac_sha256_update(&foo, "for nothing?", 12) == 0);
+    BTASSERT(hash_hmac_sha256_digest(&foo, mac) == 0);
+    BTASSERT(memcmp(mac,
+                    "\x5b\xdc\xc1\x46\xbf\x60\x75\x4e\x6a\x04\x24\x26\x08\x95\x75\xc7"
+                    "\x5a\x00\x3f\x08\x9d\x27\x39\x83\x9d\xec\x58\xb9\x64\xec\x38\x43",
+                    32) == 0);
+
+    /* Key longer than the block size. */
+    memset(key, 0xaa, sizeof(key));
+    BTASSERT(hash_hmac_sha256_init(&foo, key, sizeof(key)) == 0);
+    BTASSERT(hash_hmac_sha256_update(
+                 &foo,
+                 "Test Using Larger Than Block-Size Key - Hash Key First",
+                 54) == 0);
+    BTASSERT(hash_hmac_sha256_digest(&foo, mac) == 0);
+    BTASSERT(memcmp(mac,
+                    "\x60\xe4\x31\x59\x1e\xe0\xb6\x7f\x0d\x8a\x26\xaa\xcb\xf5\xb7\x7f"
+                    "\x8e\x0b\xc6\x21\x37\x28\xc5\x14\x05\x46\x04\x0f\x0e\xe3\x7f\x54",
+                    32) == 0);
+
+    return (0);
+}
+
+int test_sha256_multi(struct harness_t *harness_p)
+{
+    struct hash_sha256_t single;
+    struct hash_sha256_t multi[6];
+    struct hash_sha256_t *multi_p[6];
+    const void *bufs_p[6];
+    uint8_t single_hash[32];
+    uint8_t multi_hash[32];
+    size_t sizes[] = { 0, 1, 63, 64, 65, 200, 999 };
+    int i;
+    int j;
+
+    for (i = 0; i < sizeof(buf); i++) {
+        buf[i] = (i * 37 + (i >> 3));
+    }
+
+    /* Six streams, four interleaved and two hashed one at a time. */
+    for (i = 0; i < membersof(sizes); i++) {
+        for (j = 0; j < membersof(multi); j++) {
+            BTASSERT(hash_sha256_init(&multi[j]) == 0);
+            multi_p[j] = &multi[j];
+            bufs_p[j] = &buf[j];
+        }
+
+        /* A buffered byte in the last stream. */
+        BTASSERT(hash_sha256_update(&multi[5], buf, 1) == 0);
+
+        BTASSERT(hash_sha256_update_multi(multi_p,
+                                          bufs_p,
+                                          sizes[i],
+                                          membersof(multi)) == 0);
+
+        for (j = 0; j < membersof(multi); j++) {
+            BTASSERT(hash_sha256_init(&single) == 0);
+
+            if (j == 5) {
+                BTASSERT(hash_sha256_update(&single, buf, 1) == 0);
+            }
+
+            BTASSERT(hash_sha256_update(&single, &buf[j], sizes[i]) == 0);
+            BTASSERT(hash_sha256_digest(&single, single_hash) == 0);
+            BTASSERT(hash_sha256_digest(&multi[j], multi_hash) == 0);
+            BTASSERT(memcmp(single_hash, multi_hash, 32) == 0);
+        }
+    }
+
+    /* The first byte followed by 999 bytes at offset five. */
+    BTASSERT(memcmp(single_hash,
+                    "\x3f\xfc\x0f\xf9\x45\x53\xa7\x63\x83\xc9\xf7\x8c\x29\x76\xda\x4f"
+                    "\xa9\x66\xe6\x0a\xa5\xc2\x44\xc7\x70\x9b\xeb\xe8\x05\xd3\x61\x44",
+                    32) == 0);
+
+    return (0);
+}
+
+int test_benchmark(struct harness_t *harness_p)
+{
+    struct hash_sha1_t sha1;
+    struct hash_sha256_t sha256[HASH_MULTI_LANES];
+    struct hash_sha256_t *sha256_p[HASH_MULTI_LANES];
+    const void *bufs_p[HASH_MULTI_LANES];
+    struct time_t start;
+    uint8_t hash[32];
+    long blocks;
+
+    /* Hash 512 bytes blocks for a fixed duration. */
+    BTASSERT(hash_sha1_init(&sha1) == 0);
+    blocks = 0;
+    time_get(&start);
+
+    do {
+        BTASSERT(hash_sha1_update(&sha1, buf, 512) == 0);
+        blocks++;
+    } while (elapsed_us(&start) < BENCHMARK_DURATION_US);
+
+    print_throughput("sha1", blocks, &start);
+    BTASSERT(hash_sha1_digest(&sha1, hash) == 0);
+
+    BTASSERT(hash_sha256_init(&sha256[0]) == 0);
+    blocks = 0;
+    time_get(&start);
+
+    do {
+        BTASSERT(hash_sha256_update(&sha256[0], buf, 512) == 0);
+        blocks++;
+    } while (elapsed_us(&start) < BENCHMARK_DURATION_US);
+
+    print_throughput("sha256", blocks, &start);
+    BTASSERT(hash_sha256_digest(&sha256[0], hash) == 0);
+
+    for (blocks = 0; blocks < HASH_MULTI_LANES; blocks++) {
+        BTASSERT(hash_sha256_init(&sha256[blocks]) == 0);
+        sha256_p[blocks] = &sha256[blocks];
+        bufs_p[blocks] = buf;
+    }
+
+    blocks = 0;
+    time_get(&start);
+
+    do {
+        BTASSERT(hash_sha256_update_multi(sha256_p,
+                                          bufs_p,
+                                          512,
+                                          HASH_MULTI_LANES) == 0);
+        blocks += HASH_MULTI_LANES;
+    } while (elapsed_us(&start) < BENCHMARK_DURATION_US);
+
+    print_throughput("sha256 multi", blocks, &start);
+
+    return (0);
+}
+
 int main()
 {
     struct harness_t harness;
     struct harness_testcase_t harness_testcases[] = {
         { test_sha1, "test_sha1" },
+        { test_sha256, "test_sha256" },
+        { test_hmac_sha256, "test_hmac_sha256" },
+        { test_sha256_multi, "test_sha256_multi" },
+        { test_benchmark, "test_benchmark" },
         { NULL, NULL }
     };
 
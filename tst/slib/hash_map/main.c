@@ -20,11 +20,54 @@
 
 #include "simba.h"
 
+#define BENCHMARK_KEYS_MAX                                256
+/* Run long enough to be measured with the system tick. */
+#if defined(ARCH_LINUX)
+#    define BENCHMARK_LOOKUPS_MAX                     2000000
+#else
+#    define BENCHMARK_LOOKUPS_MAX                       20000
+#endif
+
 static int hash(long key)
 {
     return (0);
 }
 
+static int hash_identity(long key)
+{
+    return (key);
+}
+
+static long elapsed_us(struct time_t *start_p, struct time_t *stop_p)
+{
+    long us;
+
+    us = (1000000L * (stop_p->seconds - start_p->seconds)
+          + (stop_p->nanoseconds - start_p->nanoseconds) / 1000L);
+
+    if (us == 0) {
+        us = 1;
+    }
+
+    return (us);
+}
+
+static struct hash_table_entry_t grown_entries[16];
+
+static void on_full(struct hash_table_t *self_p, void *arg_p)
+{
+    int *count_p;
+
+    count_p = arg_p;
+    (*count_p)++;
+
+    if (hash_table_resize(self_p,
+                          grown_entries,
+                          membersof(grown_entries)) != 0) {
+        std_printf(FSTR("resize failed\r\n"));
+    }
+}
+
 int test_add_get_remove(struct harness_t *harness)
 {
     struct hash_map_t map;
@@ -74,11 +117,239 @@ int test_add_get_remove(struct harness_t *harness)
     return (0);
 }
 
+int test_no_entries(struct harness_t *harness)
+{
+    struct hash_map_t map;
+    struct hash_map_bucket_t buckets[1];
+
+    BTASSERT(hash_map_init(&map,
+                           buckets,
+                           membersof(buckets),
+                           NULL,
+                           0,
+                           hash) == 0);
+    BTASSERT(hash_map_add(&map, 1, (void *)1) == -ENOMEM);
+    BTASSERT(hash_map_get(&map, 1) == NULL);
+
+    return (0);
+}
+
+int test_table_add_get_remove(struct harness_t *harness)
+{
+    struct hash_table_t table;
+    struct hash_table_entry_t entries[8];
+    char key[4];
+    int i;
+
+    BTASSERT(hash_table_init(&table, entries, 6, NULL, NULL) == -EINVAL);
+    BTASSERT(hash_table_init(&table,
+                             entries,
+                             membersof(entries),
+                             NULL,
+                             NULL) == 0);
+    BTASSERT(hash_table_size(&table) == 0);
+
+    /* String and binary keys. */
+    BTASSERT(hash_table_add(&table, "foo", 3, (void *)1) == 0);
+    BTASSERT(hash_table_add(&table, "bar", 3, (void *)2) == 0);
+    BTASSERT(hash_table_add(&table, "fo", 2, (void *)3) == 0);
+    BTASSERT(hash_table_add(&table, "\x00\x01", 2, (void *)4) == 0);
+    BTASSERT(hash_table_add(&table, "", 0, (void *)5) == 0);
+    BTASSERT(hash_table_size(&table) == 5);
+
+    /* Overwrite a value. */
+    BTASSERT(hash_table_add(&table, "bar", 3, (void *)6) == 0);
+    BTASSERT(hash_table_size(&table) == 5);
+
+    BTASSERT(hash_table_get(&table, "foo", 3) == (void *)1);
+    BTASSERT(hash_table_get(&table, "bar", 3) == (void *)6);
+    BTASSERT(hash_table_get(&table, "fo", 2) == (void *)3);
+    BTASSERT(hash_table_get(&table, "\x00\x01", 2) == (void *)4);
+    BTASSERT(hash_table_get(&table, "", 0) == (void *)5);
+    BTASSERT(hash_table_get(&table, "\x00\x02", 2) == NULL);
+    BTASSERT(hash_table_get(&table, "f", 1) == NULL);
+
+    /* Remove. */
+    BTASSERT(hash_table_remove(&table, "foo", 3) == 0);
+    BTASSERT(hash_table_remove(&table, "foo", 3) == -1);
+    BTASSERT(hash_table_get(&table, "foo", 3) == NULL);
+    BTASSERT(hash_table_get(&table, "fo", 2) == (void *)3);
+    BTASSERT(hash_table_size(&table) == 4);
+
+    /* Seven of eight entries can be used. */
+    key[0] = 'k';
+    key[1] = '0';
+    BTASSERT(hash_table_add(&table, &key[0], 2, (void *)7) == 0);
+    key[2] = 'k';
+    key[3] = '1';
+    BTASSERT(hash_table_add(&table, &key[2], 2, (void *)8) == 0);
+    BTASSERT(hash_table_add(&table, "baz", 3, (void *)9) == 0);
+    BTASSERT(hash_table_add(&table, "full", 4, (void *)10) == -ENOMEM);
+    BTASSERT(hash_table_size(&table) == 7);
+
+    /* Remove all in a different order than added. */
+    BTASSERT(hash_table_remove(&table, "baz", 3) == 0);
+    BTASSERT(hash_table_remove(&table, "", 0) == 0);
+    BTASSERT(hash_table_remove(&table, "bar", 3) == 0);
+    BTASSERT(hash_table_remove(&table, &key[0], 2) == 0);
+    BTASSERT(hash_table_get(&table, &key[2], 2) == (void *)8);
+    BTASSERT(hash_table_remove(&table, &key[2], 2) == 0);
+    BTASSERT(hash_table_remove(&table, "fo", 2) == 0);
+    BTASSERT(hash_table_remove(&table, "\x00\x01", 2) == 0);
+    BTASSERT(hash_table_size(&table) == 0);
+
+    for (i = 0; i < membersof(entries); i++) {
+        BTASSERT(entries[i].distance == 0);
+    }
+
+    return (0);
+}
+
+int test_table_iterate_and_grow(struct harness_t *harness)
+{
+    struct hash_table_t table;
+    struct hash_table_entry_t entries[4];
+    struct hash_table_entry_t *entry_p;
+    uint8_t keys[12];
+    size_t index;
+    int count;
+    int sum;
+    int i;
+
+    count = 0;
+    BTASSERT(hash_table_init(&table,
+                             entries,
+                             membersof(entries),
+                             on_full,
+                             &count) == 0);
+
+    /* The table grows from four to 16 entries on the fourth key. */
+    for (i = 0; i < membersof(keys); i++) {
+        keys[i] = i;
+        BTASSERT(hash_table_add(&table, &keys[i], 1, (void *)(long)i) == 0);
+    }
+
+    BTASSERT(count == 1);
+    BTASSERT(table.entries_p == grown_entries);
+    BTASSERT(hash_table_size(&table) == membersof(keys));
+
+    for (i = 0; i < membersof(keys); i++) {
+        BTASSERT(hash_table_get(&table, &keys[i], 1) == (void *)(long)i);
+    }
+
+    /* Visit all keys once. */
+    index = 0;
+    sum = 0;
+    i = 0;
+
+    while ((entry_p = hash_table_next(&table, &index)) != NULL) {
+        BTASSERT(entry_p->key_size == 1);
+        sum += (long)entry_p->value_p;
+        i++;
+    }
+
+    BTASSERT(i == membersof(keys));
+    BTASSERT(sum == 66);
+    BTASSERT(hash_table_next(&table, &index) == NULL);
+
+    /* Too small. */
+    BTASSERT(hash_table_resize(&table, entries, membersof(entries)) == -EINVAL);
+
+    /* The 15th key does not fit, and the callback cannot help. */
+    BTASSERT(hash_table_add(&table, "a", 1, NULL) == 0);
+    BTASSERT(hash_table_add(&table, "b", 1, NULL) == 0);
+    BTASSERT(hash_table_add(&table, "c", 1, NULL) == -ENOMEM);
+    BTASSERT(count == 2);
+
+    return (0);
+}
+
+int test_benchmark(struct harness_t *harness)
+{
+    static struct hash_map_bucket_t buckets[BENCHMARK_KEYS_MAX];
+    static struct hash_map_entry_t map_entries[BENCHMARK_KEYS_MAX];
+    static struct hash_table_entry_t table_entries[2 * BENCHMARK_KEYS_MAX];
+    static long keys[BENCHMARK_KEYS_MAX];
+    struct hash_map_t map;
+    struct hash_table_t table;
+    struct time_t start;
+    struct time_t stop;
+    long i;
+    long us;
+    long found;
+
+    BTASSERT(hash_map_init(&map,
+                           buckets,
+                           membersof(buckets),
+                           map_entries,
+                           membersof(map_entries),
+                           hash_identity) == 0);
+    BTASSERT(hash_table_init(&table,
+                             table_entries,
+                             membersof(table_entries),
+                             NULL,
+                             NULL) == 0);
+
+    for (i = 0; i < BENCHMARK_KEYS_MAX; i++) {
+        keys[i] = (7 * i + 3);
+        BTASSERT(hash_map_add(&map, keys[i], &keys[i]) == 0);
+        BTASSERT(hash_table_add(&table,
+                                &keys[i],
+                                sizeof(keys[i]),
+                                &keys[i]) == 0);
+    }
+
+    /* Chained hash map. */
+    found = 0;
+    time_get(&start);
+
+    for (i = 0; i < BENCHMARK_LOOKUPS_MAX; i++) {
+        if (hash_map_get(&map, keys[i % BENCHMARK_KEYS_MAX]) != NULL) {
+            found++;
+        }
+    }
+
+    time_get(&stop);
+    us = elapsed_us(&start, &stop);
+    BTASSERT(found == BENCHMARK_LOOKUPS_MAX);
+
+    std_printf(FSTR("hash_map: %ld lookups/ms, %d bytes/entry.\r\n"),
+               (long)((1000LL * BENCHMARK_LOOKUPS_MAX) / us),
+               (int)((sizeof(buckets) + sizeof(map_entries))
+                     / BENCHMARK_KEYS_MAX));
+
+    /* Open addressing hash table. */
+    found = 0;
+    time_get(&start);
+
+    for (i = 0; i < BENCHMARK_LOOKUPS_MAX; i++) {
+        if (hash_table_get(&table,
+                           &keys[i % BENCHMARK_KEYS_MAX],
+                           sizeof(keys[0])) != NULL) {
+            found++;
+        }
+    }
+
+    time_get(&stop);
+    us = elapsed_us(&start, &stop);
+    BTASSERT(found == BENCHMARK_LOOKUPS_MAX);
+
+    std_printf(FSTR("hash_table: %ld lookups/ms, %d bytes/entry.\r\n"),
+               (long)((1000LL * BENCHMARK_LOOKUPS_MAX) / us),
+               (int)(sizeof(table_entries) / BENCHMARK_KEYS_MAX));
+
+    return (0);
+}
+
 int main()
 {
     struct harness_t harness;
     struct harness_testcase_t harness_testcases[] = {
         { test_add_get_remove, "test_add_get_remove" },
+        { test_no_entries, "test_no_entries" },
+        { test_table_add_get_remove, "test_table_add_get_remove" },
+        { test_table_iterate_and_grow, "test_table_iterate_and_grow" },
+        { test_benchmark, "test_benchmark" },
         { NULL, NULL }
     };
 
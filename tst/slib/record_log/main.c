@@ -0,0 +1,419 @@
+/**
+ * @file main.c
+ * @version 0.5.0
+ *
+ * @section License
+ * Copyright (C) 2016, Erik Moqvist
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * This file is part of the Simba project.
+ */
+
+#include "simba.h"
+
+#define BLOCK_SIZE RECORD_LOG_BLOCK_SIZE
+
+#define SEGMENTS                                            4
+#define SEGMENT_LENGTH                                      8
+
+#define BENCHMARK_DURATION_US                          200000
+
+/* The benchmark file is truncated when it reaches this size. */
+#define BENCHMARK_FILE_SIZE_MAX                        1048576
+
+/* Number of records per commit and sync in the benchmark. */
+#define BENCHMARK_GROUP                                    10
+
+/* Large enough for a formatted fat16 volume. */
+static uint8_t storage[32768 * BLOCK_SIZE];
+
+/* Number of block reads and writes, and write calls. */
+static long device_reads;
+static long device_writes;
+static long device_write_calls;
+
+/* Number of writes to each segment header. */
+static long header_writes[SEGMENTS];
+
+static struct record_log_t log;
+static uint8_t buf[2 * BLOCK_SIZE];
+static struct fat16_t fs;
+
+static ssize_t read_blocks(void *arg_p,
+                           void *dst_p,
+                           uint32_t src_block,
+                           size_t count)
+{
+    device_reads += count;
+    memcpy(dst_p, &storage[BLOCK_SIZE * src_block], BLOCK_SIZE * count);
+
+    return (BLOCK_SIZE * count);
+}
+
+static ssize_t write_blocks(void *arg_p,
+                            uint32_t dst_block,
+                            const void *src_p,
+                            size_t count)
+{
+    if ((dst_block % SEGMENT_LENGTH == 0)
+        && (dst_block < SEGMENTS * SEGMENT_LENGTH)) {
+        header_writes[dst_block / SEGMENT_LENGTH]++;
+    }
+
+    device_writes += count;
+    device_write_calls++;
+    memcpy(&storage[BLOCK_SIZE * dst_block], src_p, BLOCK_SIZE * count);
+
+    return (BLOCK_SIZE * count);
+}
+
+static ssize_t read_block(void *arg_p,
+                          void *dst_p,
+                          uint32_t src_block)
+{
+    return (read_blocks(arg_p, dst_p, src_block, 1));
+}
+
+static ssize_t write_block(void *arg_p,
+                           uint32_t dst_block,
+                           const void *src_p)
+{
+    return (write_blocks(arg_p, dst_block, src_p, 1));
+}
+
+static long elapsed_us(struct time_t *start_p)
+{
+    struct time_t now;
+
+    time_get(&now);
+
+    return (1000000L * (now.seconds - start_p->seconds)
+            + (now.nanoseconds - start_p->nanoseconds) / 1000L);
+}
+
+static void reset_counters(void)
+{
+    device_reads = 0;
+    device_writes = 0;
+    device_write_calls = 0;
+    memset(header_writes, 0, sizeof(header_writes));
+}
+
+static int log_init(void)
+{
+    BTASSERT(record_log_init(&log,
+                             read_blocks,
+                             write_blocks,
+                             NULL,
+                             0,
+                             SEGMENTS,
+                             SEGMENT_LENGTH,
+                             buf,
+                             sizeof(buf)) == 0);
+    BTASSERT(record_log_start(&log) == 0);
+
+    return (0);
+}
+
+/**
+ * Append records with the text "record <number>".
+ */
+static int append(int first, int last)
+{
+    char record[32];
+    int i;
+
+    for (i = first; i < last; i++) {
+        std_sprintf(record, FSTR("record %d"), i);
+        BTASSERT(record_log_append(&log, record, strlen(record) + 1) == 0);
+    }
+
+    return (0);
+}
+
+/**
+ * Read all records and check that they have consecutive numbers from
+ * first to last.
+ */
+static int check(int first, int last)
+{
+    struct record_log_iter_t iter;
+    char record[32];
+    char expected[32];
+    int i;
+
+    BTASSERT(record_log_iter_init(&iter, &log) == 0);
+
+    for (i = first; i < last; i++) {
+        std_sprintf(expected, FSTR("record %d"), i);
+        BTASSERT(record_log_iter_read(&iter, record, sizeof(record))
+                 == strlen(expected) + 1);
+        BTASSERT(strcmp(record, expected) == 0);
+    }
+
+    BTASSERT(record_log_iter_read(&iter, record, sizeof(record)) == 0);
+
+    return (0);
+}
+
+static int test_append(struct harness_t *harness_p)
+{
+    struct record_log_iter_t iter;
+    uint8_t record[RECORD_LOG_RECORD_SIZE_MAX + 1];
+
+    memset(storage, 0xa5, SEGMENTS * SEGMENT_LENGTH * BLOCK_SIZE);
+    BTASSERT(log_init() == 0);
+
+    /* An empty log. */
+    BTASSERT(record_log_iter_init(&iter, &log) == 0);
+    BTASSERT(record_log_iter_read(&iter, record, sizeof(record)) == 0);
+
+    BTASSERT(append(0, 100) == 0);
+    BTASSERT(check(0, 100) == 0);
+
+    /* Bad record sizes. */
+    BTASSERT(record_log_append(&log, record, 0) == -EINVAL);
+    BTASSERT(record_log_append(&log, record, sizeof(record)) == -EINVAL);
+
+    /* The largest record fills a block. */
+    memset(record, 1, sizeof(record));
+    BTASSERT(record_log_append(&log, record, sizeof(record) - 1) == 0);
+    BTASSERT(record_log_iter_init(&iter, &log) == 0);
+
+    while (record_log_iter_read(&iter, record, sizeof(record)) != sizeof(record) - 1);
+
+    BTASSERT(record[sizeof(record) - 2] == 1);
+    BTASSERT(record_log_iter_read(&iter, record, sizeof(record)) == 0);
+
+    return (0);
+}
+
+static int test_group_commit(struct harness_t *harness_p)
+{
+    BTASSERT(record_log_format(&log) == 0);
+    reset_counters();
+
+    /* Appended records are written by the commit in one write. */
+    BTASSERT(append(0, 40) == 0);
+    BTASSERT(device_writes == 0);
+    BTASSERT(record_log_commit(&log) == 0);
+    BTASSERT(device_write_calls == 1);
+
+    /* Nothing to commit. */
+    BTASSERT(record_log_commit(&log) == 0);
+    BTASSERT(device_write_calls == 1);
+
+    BTASSERT(check(0, 40) == 0);
+
+    return (0);
+}
+
+static int test_recovery(struct harness_t *harness_p)
+{
+    BTASSERT(record_log_format(&log) == 0);
+    BTASSERT(append(0, 50) == 0);
+    BTASSERT(record_log_commit(&log) == 0);
+
+    /* Records that are not committed are lost. */
+    BTASSERT(append(50, 60) == 0);
+
+    /* Find the end of the log and continue appending. */
+    BTASSERT(log_init() == 0);
+    BTASSERT(check(0, 50) == 0);
+    BTASSERT(append(50, 120) == 0);
+    BTASSERT(record_log_commit(&log) == 0);
+
+    BTASSERT(log_init() == 0);
+    BTASSERT(check(0, 120) == 0);
+
+    return (0);
+}
+
+static int test_corrupt_record(struct harness_t *harness_p)
+{
+    struct record_log_iter_t iter;
+    char record[32];
+
+    BTASSERT(record_log_format(&log) == 0);
+    BTASSERT(append(0, 10) == 0);
+    BTASSERT(record_log_commit(&log) == 0);
+
+    /* Corrupt the sixth record, "record 5". Records are 17 bytes
+       including the header. */
+    storage[BLOCK_SIZE * (log.segment * SEGMENT_LENGTH + 1) + 5 * 17 + 8] ^= 1;
+
+    BTASSERT(log_init() == 0);
+    BTASSERT(check(0, 5) == 0);
+
+    /* The corrupt record is overwritten. */
+    BTASSERT(record_log_append(&log, "new", 4) == 0);
+    BTASSERT(record_log_iter_init(&iter, &log) == 0);
+
+    while (record_log_iter_read(&iter, record, sizeof(record)) > 0) {
+        if (strcmp(record, "record 4") == 0) {
+            break;
+        }
+    }
+
+    BTASSERT(record_log_iter_read(&iter, record, sizeof(record)) == 4);
+    BTASSERT(strcmp(record, "new") == 0);
+    BTASSERT(record_log_iter_read(&iter, record, sizeof(record)) == 0);
+
+    return (0);
+}
+
+static int test_rotation(struct harness_t *harness_p)
+{
+    struct record_log_iter_t iter;
+    char record[32];
+    long first;
+    int i;
+    long min;
+    long max;
+
+    BTASSERT(record_log_format(&log) == 0);
+    reset_counters();
+
+    /* Wrap around the storage many times. */
+    for (i = 0; i < 5000; i += 50) {
+        BTASSERT(append(i, i + 50) == 0);
+        BTASSERT(record_log_commit(&log) == 0);
+    }
+
+    /* The oldest records are overwritten. */
+    BTASSERT(record_log_iter_init(&iter, &log) == 0);
+    BTASSERT(record_log_iter_read(&iter, record, sizeof(record)) > 0);
+    BTASSERT(std_strtol(&record[7], &first) == 0);
+    BTASSERT(first > 4000);
+    BTASSERT(check(first, 5000) == 0);
+
+    /* All segments are written equally often. */
+    min = header_writes[0];
+    max = header_writes[0];
+
+    for (i = 1; i < SEGMENTS; i++) {
+        if (header_writes[i] < min) {
+            min = header_writes[i];
+        }
+
+        if (header_writes[i] > max) {
+            max = header_writes[i];
+        }
+    }
+
+    std_printf(FSTR("Segment header writes: min %ld, max %ld.\r\n"), min, max);
+    BTASSERT(min > 0);
+    BTASSERT(max - min <= 1);
+
+    /* The log is found after a restart. */
+    BTASSERT(log_init() == 0);
+    BTASSERT(check(first, 5000) == 0);
+
+    return (0);
+}
+
+static int test_benchmark(struct harness_t *harness_p)
+{
+    struct fat16_file_t file;
+    struct time_t start;
+    long records;
+    long elapsed;
+    char record[32];
+
+    memset(record, 'x', sizeof(record));
+
+    /* Append to a file with a sync after each group. */
+    BTASSERT(fat16_init(&fs, read_block, write_block, NULL, 0) == 0);
+    BTASSERT(fat16_format(&fs) == 0);
+    BTASSERT(fat16_start(&fs) == 0);
+    BTASSERT(fat16_file_open(&fs,
+                             &file,
+                             "LOG.TXT",
+                             O_CREAT | O_WRITE | O_TRUNC) == 0);
+    reset_counters();
+    records = 0;
+    time_get(&start);
+
+    do {
+        /* Start over before the file system is full. */
+        if (fat16_file_size(&file) >= BENCHMARK_FILE_SIZE_MAX) {
+            BTASSERT(fat16_file_close(&file) == 0);
+            BTASSERT(fat16_file_open(&fs,
+                                     &file,
+                                     "LOG.TXT",
+                                     O_WRITE | O_TRUNC) == 0);
+        }
+
+        BTASSERT(fat16_file_write(&file, record, sizeof(record))
+                 == sizeof(record));
+        records++;
+
+        if ((records % BENCHMARK_GROUP) == 0) {
+            BTASSERT(fat16_file_sync(&file) == 0);
+        }
+    } while ((elapsed = elapsed_us(&start)) < BENCHMARK_DURATION_US);
+
+    std_printf(FSTR("fat16 append: %ld records/s, %ld device writes "
+                    "per 1000 records.\r\n"),
+               (long)(1000000LL * records / elapsed),
+               (long)(1000LL * device_writes / records));
+
+    BTASSERT(fat16_file_close(&file) == 0);
+    BTASSERT(fat16_stop(&fs) == 0);
+
+    /* Append to a record log with a commit after each group. */
+    BTASSERT(log_init() == 0);
+    BTASSERT(record_log_format(&log) == 0);
+    reset_counters();
+    records = 0;
+    time_get(&start);
+
+    do {
+        BTASSERT(record_log_append(&log, record, sizeof(record)) == 0);
+        records++;
+
+        if ((records % BENCHMARK_GROUP) == 0) {
+            BTASSERT(record_log_commit(&log) == 0);
+        }
+    } while ((elapsed = elapsed_us(&start)) < BENCHMARK_DURATION_US);
+
+    std_printf(FSTR("record log append: %ld records/s, %ld device writes "
+                    "per 1000 records.\r\n"),
+               (long)(1000000LL * records / elapsed),
+               (long)(1000LL * device_writes / records));
+
+    /* Appending never reads from the storage. */
+    BTASSERT(device_reads == 0);
+
+    return (0);
+}
+
+int main()
+{
+    struct harness_t harness;
+    struct harness_testcase_t harness_testcases[] = {
+        { test_append, "test_append" },
+        { test_group_commit, "test_group_commit" },
+        { test_recovery, "test_recovery" },
+        { test_corrupt_record, "test_corrupt_record" },
+        { test_rotation, "test_rotation" },
+        { test_benchmark, "test_benchmark" },
+        { NULL, NULL }
+    };
+
+    sys_start();
+
+    harness_init(&harness);
+    harness_run(&harness, harness_testcases);
+
+    return (0);
+}